@@ -0,0 +1,121 @@
+#include "boot_sequence.h"
+
+#include <string.h>
+
+static const char* statusNames[] = {"waiting", "running", "done", "failed", "skipped"};
+
+uint32_t BootSequence::add(const char* name, BootStep step, uint32_t needs, uint32_t timeoutMs, uint32_t after) {
+    if (_count == BOOT_MAX_STAGES) return 0;
+    BootStage& s = _stages[_count];
+    s.name = name;
+    s.step = step;
+    s.needs = needs;
+    s.after = after;
+    s.timeoutMs = timeoutMs;
+    s.status = BOOT_WAITING;
+    s.timedOut = false;
+    s.phase = 0;
+    s.phaseStartMs = 0;
+    s.startMs = 0;
+    s.endMs = 0;
+    return 1UL << _count++;
+}
+
+void BootSequence::finish(BootStage& stage, BootStatus status, uint32_t now) {
+    stage.status = status;
+    stage.endMs = now;
+    uint32_t bit = 1UL << (&stage - _stages);
+    if (status == BOOT_DONE) {
+        _doneMask |= bit;
+    } else {
+        _failedMask |= bit;
+    }
+}
+
+bool BootSequence::poll() {
+    bool active = false;
+    for (int i = 0; i < _count; i++) {
+        BootStage& s = _stages[i];
+        if (s.status == BOOT_WAITING) {
+            if (s.needs & _failedMask) {
+                finish(s, BOOT_SKIPPED, millis());
+                continue;
+            }
+            if (!done(s.needs) || !finished(s.after)) {
+                active = true;
+                continue;
+            }
+            s.status = BOOT_RUNNING;
+            s.startMs = s.phaseStartMs = millis();
+        }
+        if (s.status != BOOT_RUNNING) continue;
+
+        BootStatus status = s.step(s);
+        uint32_t now = millis();
+        if (status == BOOT_RUNNING && s.timeoutMs && now - s.startMs >= s.timeoutMs) {
+            s.timedOut = true;
+            status = BOOT_FAILED;
+        }
+        if (status == BOOT_RUNNING) {
+            active = true;
+        } else {
+            finish(s, status == BOOT_DONE ? BOOT_DONE : BOOT_FAILED, now);
+            // Dependents may start in this same round
+            if (status == BOOT_DONE) active = true;
+        }
+    }
+    return active;
+}
+
+void BootSequence::run(void (*idle)()) {
+    while (poll()) {
+        if (idle) {
+            idle();
+        } else {
+            delay(1);
+        }
+    }
+}
+
+const BootStage* BootSequence::stage(const char* name) const {
+    for (int i = 0; i < _count; i++) {
+        if (strcmp(_stages[i].name, name) == 0) return &_stages[i];
+    }
+    return nullptr;
+}
+
+void BootSequence::milestone(const char* name) {
+    for (int i = 0; i < _milestoneCount; i++) {
+        if (strcmp(_milestones[i].name, name) == 0) return;
+    }
+    if (_milestoneCount == BOOT_MAX_MILESTONES) return;
+    BootMilestone& m = _milestones[_milestoneCount++];
+    m.name = name;
+    m.atMs = millis();
+    if (_out) _out->printf("Boot: %s at %lu ms\n", m.name, (unsigned long)m.atMs);
+}
+
+uint32_t BootSequence::milestoneMs(const char* name) const {
+    for (int i = 0; i < _milestoneCount; i++) {
+        if (strcmp(_milestones[i].name, name) == 0) return _milestones[i].atMs;
+    }
+    return 0;
+}
+
+void BootSequence::report(Print& out) {
+    _out = &out;
+    out.println("Boot stages (ms since boot):");
+    for (int i = 0; i < _count; i++) {
+        const BootStage& s = _stages[i];
+        if (s.status == BOOT_SKIPPED || s.status == BOOT_WAITING) {
+            out.printf("  %-12s %s\n", s.name, statusNames[s.status]);
+            continue;
+        }
+        uint32_t endMs = s.status == BOOT_RUNNING ? millis() : s.endMs;
+        out.printf("  %-12s %6lu .. %6lu  %6lu ms  %s%s\n", s.name, (unsigned long)s.startMs, (unsigned long)endMs,
+                   (unsigned long)(endMs - s.startMs), statusNames[s.status], s.timedOut ? " (timeout)" : "");
+    }
+    for (int i = 0; i < _milestoneCount; i++) {
+        out.printf("Boot: %s at %lu ms\n", _milestones[i].name, (unsigned long)_milestones[i].atMs);
+    }
+}
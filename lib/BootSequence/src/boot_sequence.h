@@ -0,0 +1,120 @@
+#pragma once
+
+// Boot orchestrator: setup() declares its init stages and what each one
+// needs first; stages whose dependencies are done run side by side.
+//
+//   BootStatus bootWifi(BootStage& stage) {
+//       if (stage.phase == 0) {
+//           WiFi.begin(ssid, password);
+//           stage.next();
+//       }
+//       return WiFi.status() == WL_CONNECTED ? BOOT_DONE : BOOT_RUNNING;
+//   }
+//
+//   BootSequence boot;
+//
+//   void setup() {
+//       uint32_t display = boot.add("display", bootDisplay);
+//       uint32_t sensor = boot.add("scd40", bootSensor);
+//       uint32_t wifi = boot.add("wifi", bootWifi, 0, 10000);      // fails after 10 s
+//       boot.add("mqtt", bootMqtt, wifi);
+//       uint32_t reading = boot.add("reading", bootReading, sensor);
+//       boot.add("render", bootRender, display, 0, reading);
+//       boot.run();
+//       boot.report(Serial);
+//   }
+//
+// A stage is a step function that is called again and again until it returns
+// BOOT_DONE or BOOT_FAILED. It must not block: it starts something, returns
+// BOOT_RUNNING and looks again on the next call. stage.phase and
+// stage.phaseMs() carry where it left off. Stages are stepped round-robin
+// in the order they were added, so a WiFi association, a sensor warm-up and
+// drawing the first screen all make progress together; run() sleeps a
+// millisecond between rounds.
+//
+// add() returns the stage's bit for other stages to depend on. A stage starts
+// once every stage in `needs` is done and every stage in `after` has
+// finished, however it went; when one it needs fails or is skipped, it is
+// skipped. A timeout (from the stage's start) fails a stage that is still
+// running.
+//
+// milestone() stamps points like "first render" and "first publish" once.
+// They are usually reached after setup(), so after report() each one prints
+// as it happens.
+
+#include <Arduino.h>
+
+const int BOOT_MAX_STAGES = 16;
+const int BOOT_MAX_MILESTONES = 8;
+
+enum BootStatus : uint8_t {
+    BOOT_WAITING,       // for its dependencies
+    BOOT_RUNNING,
+    BOOT_DONE,
+    BOOT_FAILED,
+    BOOT_SKIPPED,       // a dependency failed
+};
+
+struct BootStage;
+typedef BootStatus (*BootStep)(BootStage& stage);
+
+struct BootStage {
+    const char* name;
+    BootStep step;
+    uint32_t needs;
+    uint32_t after;
+    uint32_t timeoutMs;             // 0: none
+    BootStatus status;
+    bool timedOut;
+    int phase;                      // for the step function; starts at 0
+    uint32_t phaseStartMs;
+    uint32_t startMs;
+    uint32_t endMs;
+
+    // Moves to the next phase and restarts phaseMs()
+    void next() {
+        phase++;
+        phaseStartMs = millis();
+    }
+    uint32_t phaseMs() const { return millis() - phaseStartMs; }
+};
+
+struct BootMilestone {
+    const char* name;
+    uint32_t atMs;
+};
+
+class BootSequence {
+public:
+    // Returns the stage's bit; 0 when the table is full
+    uint32_t add(const char* name, BootStep step, uint32_t needs = 0, uint32_t timeoutMs = 0, uint32_t after = 0);
+
+    // One round over the stages; false once none is waiting or running
+    bool poll();
+    // Polls until every stage has finished; `idle` runs between rounds
+    // instead of delay(1)
+    void run(void (*idle)() = nullptr);
+
+    bool done(uint32_t stages) const { return (_doneMask & stages) == stages; }
+    bool finished(uint32_t stages) const { return ((_doneMask | _failedMask) & stages) == stages; }
+    const BootStage* stage(const char* name) const;
+
+    // Stamps `name` (a string literal) the first time it is reached
+    void milestone(const char* name);
+    uint32_t milestoneMs(const char* name) const;   // 0 when not reached yet
+
+    // Prints each stage's start, end and result, and the milestones so far;
+    // later milestones print to `out` as they are reached
+    void report(Print& out);
+
+private:
+    void finish(BootStage& stage, BootStatus status, uint32_t now);
+
+    BootStage _stages[BOOT_MAX_STAGES];
+    int _count = 0;
+    uint32_t _doneMask = 0;
+    uint32_t _failedMask = 0;       // failed or skipped
+    BootMilestone _milestones[BOOT_MAX_MILESTONES];
+    int _milestoneCount = 0;
+    Print* _out = nullptr;
+};
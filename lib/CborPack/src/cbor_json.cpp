@@ -0,0 +1,258 @@
+#include "cbor_json.h"
+#include "cbor_pack.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+static const int MAX_DEPTH = 16;
+
+namespace {
+
+struct Converter {
+    const uint8_t* in;
+    size_t inLength;
+    size_t pos;
+    char* out;
+    size_t size;
+    size_t length;
+    bool failed;
+    // How many quoted keys the output is inside: a map or array used as a
+    // key is written as a JSON string, escaped once per level
+    int quoted;
+
+    void emit(const char* text, size_t n) { emitQuoted(text, n, quoted); }
+    void emitQuoted(const char* text, size_t n, int level) {
+        if (level > 0) {
+            for (size_t i = 0; i < n && !failed; i++) {
+                if (text[i] == '"' || text[i] == '\\') emitQuoted("\\", 1, level - 1);
+                emitQuoted(text + i, 1, level - 1);
+            }
+            return;
+        }
+        if (failed || n >= size - length) {
+            failed = true;
+            return;
+        }
+        memcpy(out + length, text, n);
+        length += n;
+    }
+    void emit(const char* text) { emit(text, strlen(text)); }
+    void emitf(const char* format, double value) {
+        char number[32];
+        int n = snprintf(number, sizeof(number), format, value);
+        emit(number, n);
+    }
+
+    bool byte(uint8_t& b) {
+        if (pos >= inLength) return false;
+        b = in[pos++];
+        return true;
+    }
+
+    // The argument of an initial byte; `indefinite` for the 0x1F lengths
+    bool argument(uint8_t info, uint64_t& value, bool& indefinite) {
+        indefinite = false;
+        if (info < 24) {
+            value = info;
+            return true;
+        }
+        if (info == 31) {
+            indefinite = true;
+            return true;
+        }
+        if (info > 27) return false;
+        size_t count = (size_t)1 << (info - 24);
+        if (inLength - pos < count) return false;
+        value = 0;
+        for (size_t i = 0; i < count; i++) value = value << 8 | in[pos++];
+        return true;
+    }
+
+    bool atBreak() { return pos < inLength && in[pos] == 0xFF; }
+
+    void emitNumber(double value, const char* format) {
+        if (isnan(value) || isinf(value)) {
+            emit("null");
+        } else {
+            emitf(format, value);
+        }
+    }
+
+    void emitEscaped(const uint8_t* text, size_t n) {
+        for (size_t i = 0; i < n && !failed; i++) {
+            uint8_t c = text[i];
+            if (c == '"' || c == '\\') {
+                char escaped[2] = {'\\', (char)c};
+                emit(escaped, 2);
+            } else if (c < 0x20) {
+                char escaped[8];
+                snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                emit(escaped, 6);
+            } else {
+                emit((const char*)&c, 1);
+            }
+        }
+    }
+
+    // Text and byte strings (as hex), definite or in chunks
+    bool string(uint8_t major, uint64_t n, bool indefinite) {
+        auto chunk = [&](uint64_t count) {
+            if (inLength - pos < count) return false;
+            if (major == 3) {
+                emitEscaped(in + pos, count);
+            } else {
+                for (uint64_t i = 0; i < count; i++) {
+                    char hex[3];
+                    snprintf(hex, sizeof(hex), "%02x", in[pos + i]);
+                    emit(hex, 2);
+                }
+            }
+            pos += count;
+            return true;
+        };
+        emit("\"", 1);
+        if (!indefinite) {
+            if (!chunk(n)) return false;
+        } else {
+            while (!atBreak()) {
+                uint8_t b;
+                uint64_t count;
+                bool nested;
+                if (!byte(b) || b >> 5 != major || !argument(b & 0x1F, count, nested) || nested) return false;
+                if (!chunk(count)) return false;
+            }
+            pos++;
+        }
+        emit("\"", 1);
+        return true;
+    }
+
+    bool item(int depth, bool asKey) {
+        if (depth > MAX_DEPTH) return false;
+        uint8_t initial;
+        if (!byte(initial)) return false;
+        uint8_t major = initial >> 5;
+        uint8_t info = initial & 0x1F;
+        uint64_t value = 0;
+        bool indefinite = false;
+        if (major != 7 && !argument(info, value, indefinite)) return false;
+        if (indefinite && major < 2) return false;
+
+        // A key must be a JSON string
+        bool quote = asKey && major != 2 && major != 3;
+        if (quote) {
+            emit("\"", 1);
+            quoted++;
+        }
+        switch (major) {
+            case 0: {
+                char number[24];
+                snprintf(number, sizeof(number), "%llu", (unsigned long long)value);
+                emit(number);
+                break;
+            }
+            case 1: {
+                char number[24];
+                if (value < (1ULL << 63)) {
+                    snprintf(number, sizeof(number), "-%llu", (unsigned long long)value + 1);
+                } else {
+                    snprintf(number, sizeof(number), "-18446744073709551616");
+                }
+                emit(number);
+                break;
+            }
+            case 2:
+            case 3:
+                if (!string(major, value, indefinite)) return false;
+                break;
+            case 4: {
+                emit("[", 1);
+                for (uint64_t i = 0; indefinite ? !atBreak() : i < value; i++) {
+                    if (i) emit(",", 1);
+                    if (!item(depth + 1, false)) return false;
+                }
+                if (indefinite) pos++;
+                emit("]", 1);
+                break;
+            }
+            case 5: {
+                emit("{", 1);
+                for (uint64_t i = 0; indefinite ? !atBreak() : i < value; i++) {
+                    if (i) emit(",", 1);
+                    if (!item(depth + 1, true)) return false;
+                    emit(":", 1);
+                    if (!item(depth + 1, false)) return false;
+                }
+                if (indefinite) pos++;
+                emit("}", 1);
+                break;
+            }
+            case 6:
+                if (!item(depth + 1, asKey && !quote)) return false;
+                break;
+            case 7:
+                if (!simple(info)) return false;
+                break;
+        }
+        if (quote) {
+            quoted--;
+            emit("\"", 1);
+        }
+        return !failed;
+    }
+
+    bool simple(uint8_t info) {
+        switch (info) {
+            case 20: emit("false"); return true;
+            case 21: emit("true"); return true;
+            case 22:
+            case 23: emit("null"); return true;
+            case 25: {
+                if (inLength - pos < 2) return false;
+                uint16_t half = in[pos] << 8 | in[pos + 1];
+                pos += 2;
+                emitNumber(cborHalfToFloat(half), "%.5g");
+                return true;
+            }
+            case 26: {
+                if (inLength - pos < 4) return false;
+                uint32_t bits = (uint32_t)in[pos] << 24 | (uint32_t)in[pos + 1] << 16 | in[pos + 2] << 8 | in[pos + 3];
+                pos += 4;
+                float value;
+                memcpy(&value, &bits, 4);
+                emitNumber(value, "%.7g");
+                return true;
+            }
+            case 27: {
+                if (inLength - pos < 8) return false;
+                uint64_t bits = 0;
+                for (int i = 0; i < 8; i++) bits = bits << 8 | in[pos + i];
+                pos += 8;
+                double value;
+                memcpy(&value, &bits, 8);
+                emitNumber(value, "%.15g");
+                return true;
+            }
+            default:
+                // Other simple values have no JSON meaning
+                if (info == 24) pos++;
+                if (info > 24) return false;
+                emit("null");
+                return pos <= inLength;
+        }
+    }
+};
+
+}  // namespace
+
+size_t cborToJson(const uint8_t* cbor, size_t length, char* out, size_t size) {
+    if (size == 0) return 0;
+    Converter c = {cbor, length, 0, out, size, 0, false, 0};
+    if (!c.item(0, false) || c.pos != length) {
+        out[0] = 0;
+        return 0;
+    }
+    out[c.length] = 0;
+    return c.length;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+// CBOR to JSON text, for a bridge that republishes binary payloads to
+// consumers that only read JSON (Home Assistant).
+//
+//   char json[2048];
+//   size_t n = cborToJson(payload, length, json, sizeof(json));
+//   if (n) mqtt.publish(jsonTopic, json);
+//
+// Maps, arrays, integers, floats (16, 32 and 64 bit), text, true/false/null
+// are converted as they are. Byte strings become hex strings, map keys that
+// are not text become their JSON text in quotes, tags are dropped (their
+// content is kept), and NaN and infinities become null. Indefinite lengths
+// are supported. Floats print with the digits their width carries (5 for
+// half, 7 for single), so 22.53 sent as a half reads 22.531.
+
+#include <Arduino.h>
+
+// Writes NUL-terminated JSON to `out`; returns its length, or 0 when the
+// input is not one complete CBOR item, nests deeper than 16 or `out` is too
+// small
+size_t cborToJson(const uint8_t* cbor, size_t length, char* out, size_t size);
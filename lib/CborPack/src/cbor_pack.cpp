@@ -0,0 +1,187 @@
+#include "cbor_pack.h"
+
+#include <string.h>
+
+void CborWriter::put8(uint8_t byte) {
+    put(&byte, 1);
+}
+
+void CborWriter::put(const void* data, size_t length) {
+    if (_overflow || length > _size - _length) {
+        _overflow = true;
+        return;
+    }
+    memcpy(_buffer + _length, data, length);
+    _length += length;
+}
+
+// Major type in the top 3 bits; the argument inline below 24, else in the
+// smallest of 1, 2, 4 or 8 big-endian bytes
+void CborWriter::head(uint8_t major, uint64_t value) {
+    uint8_t bytes[9];
+    size_t count;
+    if (value < 24) {
+        bytes[0] = major << 5 | (uint8_t)value;
+        count = 1;
+    } else if (value <= 0xFF) {
+        bytes[0] = major << 5 | 24;
+        count = 2;
+    } else if (value <= 0xFFFF) {
+        bytes[0] = major << 5 | 25;
+        count = 3;
+    } else if (value <= 0xFFFFFFFF) {
+        bytes[0] = major << 5 | 26;
+        count = 5;
+    } else {
+        bytes[0] = major << 5 | 27;
+        count = 9;
+    }
+    for (size_t i = 1; i < count; i++) bytes[i] = (uint8_t)(value >> (8 * (count - 1 - i)));
+    put(bytes, count);
+}
+
+void CborWriter::writeInt(int64_t value) {
+    if (value >= 0) {
+        head(0, (uint64_t)value);
+    } else {
+        head(1, (uint64_t)(-(value + 1)));
+    }
+}
+
+void CborWriter::writeHalf(float value) {
+    uint16_t half = cborHalf(value);
+    uint8_t bytes[3] = {0xF9, (uint8_t)(half >> 8), (uint8_t)half};
+    put(bytes, 3);
+}
+
+void CborWriter::writeFloat(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, 4);
+    uint8_t bytes[5] = {0xFA, (uint8_t)(bits >> 24), (uint8_t)(bits >> 16), (uint8_t)(bits >> 8), (uint8_t)bits};
+    put(bytes, 5);
+}
+
+void CborWriter::writeText(const char* text, size_t length) {
+    head(3, length);
+    put(text, length);
+}
+
+void CborWriter::writeBytes(const uint8_t* data, size_t length) {
+    head(2, length);
+    put(data, length);
+}
+
+uint16_t cborHalf(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, 4);
+    uint16_t sign = (bits >> 16) & 0x8000;
+    uint32_t exponent = (bits >> 23) & 0xFF;
+    uint32_t mantissa = bits & 0x7FFFFF;
+
+    if (exponent == 0xFF) return sign | 0x7C00 | (mantissa ? 0x200 : 0);     // inf, NaN
+    int32_t e = (int32_t)exponent - 127 + 15;
+    if (e >= 0x1F) return sign | 0x7C00;                                    // too large: inf
+    if (e <= 0) {
+        // Subnormal half (or zero): shift the mantissa with its implicit 1
+        if (e < -10) return sign;
+        mantissa |= 0x800000;
+        uint32_t shift = 14 - e;
+        uint32_t half = mantissa >> shift;
+        uint32_t rest = mantissa & ((1u << shift) - 1);
+        uint32_t halfway = 1u << (shift - 1);
+        if (rest > halfway || (rest == halfway && (half & 1))) half++;
+        return sign | (uint16_t)half;
+    }
+    uint32_t half = (uint32_t)e << 10 | mantissa >> 13;
+    uint32_t rest = mantissa & 0x1FFF;
+    // A carry out of the mantissa moves into the exponent, as it should
+    if (rest > 0x1000 || (rest == 0x1000 && (half & 1))) half++;
+    return sign | (uint16_t)half;
+}
+
+float cborHalfToFloat(uint16_t half) {
+    uint32_t sign = (uint32_t)(half & 0x8000) << 16;
+    uint32_t exponent = (half >> 10) & 0x1F;
+    uint32_t mantissa = half & 0x3FF;
+    uint32_t bits;
+    if (exponent == 0x1F) {
+        bits = sign | 0x7F800000 | mantissa << 13;
+    } else if (exponent == 0) {
+        if (mantissa == 0) {
+            bits = sign;
+        } else {
+            // Subnormal: normalise
+            exponent = 127 - 15 + 1;
+            while (!(mantissa & 0x400)) {
+                mantissa <<= 1;
+                exponent--;
+            }
+            bits = sign | exponent << 23 | (mantissa & 0x3FF) << 13;
+        }
+    } else {
+        bits = sign | (exponent + 127 - 15) << 23 | mantissa << 13;
+    }
+    float value;
+    memcpy(&value, &bits, 4);
+    return value;
+}
+
+void cborWriteValue(CborWriter& out, const CborField& field, const void* record) {
+    const uint8_t* p = (const uint8_t*)record + field.offset;
+    switch (field.type) {
+        case CBOR_HALF: {
+            float v;
+            memcpy(&v, p, sizeof(v));
+            out.writeHalf(v);
+            break;
+        }
+        case CBOR_FLOAT: {
+            float v;
+            memcpy(&v, p, sizeof(v));
+            out.writeFloat(v);
+            break;
+        }
+        case CBOR_UINT16: {
+            uint16_t v;
+            memcpy(&v, p, sizeof(v));
+            out.writeUint(v);
+            break;
+        }
+        case CBOR_UINT32: {
+            uint32_t v;
+            memcpy(&v, p, sizeof(v));
+            out.writeUint(v);
+            break;
+        }
+        case CBOR_INT32: {
+            int32_t v;
+            memcpy(&v, p, sizeof(v));
+            out.writeInt(v);
+            break;
+        }
+        case CBOR_BOOL: {
+            bool v;
+            memcpy(&v, p, sizeof(v));
+            out.writeBool(v);
+            break;
+        }
+    }
+}
+
+void cborWriteMap(CborWriter& out, const CborSchema& schema, const void* record) {
+    out.beginMap(schema.count);
+    for (uint8_t i = 0; i < schema.count; i++) {
+        out.writeText(schema.fields[i].name);
+        cborWriteValue(out, schema.fields[i], record);
+    }
+}
+
+void cborWriteNames(CborWriter& out, const CborSchema& schema) {
+    out.beginArray(schema.count);
+    for (uint8_t i = 0; i < schema.count; i++) out.writeText(schema.fields[i].name);
+}
+
+void cborWriteRow(CborWriter& out, const CborSchema& schema, const void* record) {
+    out.beginArray(schema.count);
+    for (uint8_t i = 0; i < schema.count; i++) cborWriteValue(out, schema.fields[i], record);
+}
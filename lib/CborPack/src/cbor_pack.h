@@ -0,0 +1,104 @@
+#pragma once
+
+// CBOR (RFC 8949) payloads for topics where JSON text costs too much airtime.
+//
+//   struct Reading { float temperature; float humidity; uint16_t co2; };
+//   const CborField readingFields[] = {
+//       CBOR_FIELD(Reading, temperature, CBOR_HALF),
+//       CBOR_FIELD(Reading, humidity, CBOR_HALF),
+//       CBOR_FIELD(Reading, co2, CBOR_UINT16),
+//   };
+//   const CborSchema readingSchema = CBOR_SCHEMA(readingFields);
+//
+//   uint8_t buffer[256];
+//   CborWriter cbor(buffer, sizeof(buffer));
+//   cborWriteMap(cbor, readingSchema, &reading);   // {"temperature": 22.5, ...}
+//   if (!cbor.overflow()) mqtt.publish(topic, cbor.data(), cbor.length());
+//
+// CborWriter encodes straight into the caller's buffer: no heap, no document
+// tree, nothing to size beforehand. Writing past the end sets overflow() and
+// drops the rest, so a caller checks once at the end.
+//
+// A schema lists a struct's fields with the member type and how each one goes
+// on the wire. CBOR_HALF sends a float as a 16-bit float: 3 bytes instead of 5,
+// with 11 significant bits (steps of 1/64 between 16 and 32, 1/32 between 32
+// and 64), which is finer than the SCD40 resolves. cborWriteMap() writes one
+// record with its field names; for a batch, cborWriteNames() once and
+// cborWriteRow() per record (values in field order) leaves the names out of
+// every row.
+//
+// The payload describes itself, so a consumer needs no copy of the schema:
+// cborToJson() (cbor_json.h) turns any of it back into JSON.
+
+#include <Arduino.h>
+#include <stddef.h>
+
+class CborWriter {
+public:
+    CborWriter(uint8_t* buffer, size_t size) : _buffer(buffer), _size(size) {}
+
+    void beginMap(size_t pairs) { head(5, pairs); }
+    void beginArray(size_t items) { head(4, items); }
+    void writeUint(uint64_t value) { head(0, value); }
+    void writeInt(int64_t value);
+    void writeHalf(float value);
+    void writeFloat(float value);
+    void writeBool(bool value) { put8(value ? 0xF5 : 0xF4); }
+    void writeNull() { put8(0xF6); }
+    void writeText(const char* text) { writeText(text, strlen(text)); }
+    void writeText(const char* text, size_t length);
+    void writeBytes(const uint8_t* data, size_t length);
+
+    const uint8_t* data() const { return _buffer; }
+    size_t length() const { return _length; }
+    bool overflow() const { return _overflow; }
+    void reset() {
+        _length = 0;
+        _overflow = false;
+    }
+
+private:
+    void head(uint8_t major, uint64_t value);
+    void put8(uint8_t byte);
+    void put(const void* data, size_t length);
+
+    uint8_t* _buffer;
+    size_t _size;
+    size_t _length = 0;
+    bool _overflow = false;
+};
+
+// IEEE 754 binary16, rounded to nearest even; infinities and NaN carried over
+uint16_t cborHalf(float value);
+float cborHalfToFloat(uint16_t half);
+
+enum CborFieldType : uint8_t {
+    CBOR_HALF,          // float member, 16-bit float on the wire
+    CBOR_FLOAT,         // float member, 32-bit float
+    CBOR_UINT16,        // uint16_t member
+    CBOR_UINT32,        // uint32_t member
+    CBOR_INT32,         // int32_t member
+    CBOR_BOOL,          // bool member
+};
+
+struct CborField {
+    const char* name;
+    CborFieldType type;
+    uint16_t offset;
+};
+
+struct CborSchema {
+    const CborField* fields;
+    uint8_t count;
+};
+
+#define CBOR_FIELD(Struct, member, type) {#member, type, (uint16_t)offsetof(Struct, member)}
+#define CBOR_SCHEMA(fields) {fields, (uint8_t)(sizeof(fields) / sizeof(fields[0]))}
+
+void cborWriteValue(CborWriter& out, const CborField& field, const void* record);
+// {name: value, ...}
+void cborWriteMap(CborWriter& out, const CborSchema& schema, const void* record);
+// [name, ...]
+void cborWriteNames(CborWriter& out, const CborSchema& schema);
+// [value, ...] in field order
+void cborWriteRow(CborWriter& out, const CborSchema& schema, const void* record);
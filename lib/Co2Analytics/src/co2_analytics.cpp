@@ -0,0 +1,138 @@
+#include "co2_analytics.h"
+
+#include <math.h>
+
+// A decay without a new low for this long has levelled off
+static const uint32_t DECAY_STALL_MS = 10 * 60000UL;
+static const double DECAY_MIN_LOG_DROP = 0.1625;    // ln(1 / 0.85): 15% of the excess
+static const double DECAY_MIN_R2 = 0.8;
+static const float DECAY_WEIGHT = 0.3f;
+static const double MS_PER_HOUR = 3600000.0;
+
+double Co2LineFit::slope() const {
+    double d = n * sxx - sx * sx;
+    if (n < 2 || d <= 0) return NAN;
+    return (n * sxy - sx * sy) / d;
+}
+
+double Co2LineFit::r2() const {
+    double dx = n * sxx - sx * sx;
+    double dy = n * syy - sy * sy;
+    if (n < 2 || dx <= 0) return NAN;
+    if (dy <= 0) return 1;
+    double c = n * sxy - sx * sy;
+    return c * c / (dx * dy);
+}
+
+void Co2Analytics::reset() {
+    _head = 0;
+    _count = 0;
+    _lastMs = 0;
+    _st = _stt = _sy = _sty = 0;
+    _decaying = false;
+}
+
+void Co2Analytics::add(uint32_t nowMs, float co2) {
+    if (_count && nowMs - _lastMs > CO2_TREND_MAX_GAP_MS) reset();
+
+    // Shifts t so the new reading is at 0: t' = t - dt
+    if (_count) {
+        double dt = (nowMs - _lastMs) / MS_PER_HOUR;
+        _stt += -2 * dt * _st + _count * dt * dt;
+        _sty -= dt * _sy;
+        _st -= _count * dt;
+    }
+    if (_count == CO2_TREND_SAMPLES) {
+        const Sample& oldest = _ring[_head];
+        double t = -((nowMs - oldest.ms) / MS_PER_HOUR);
+        _st -= t;
+        _stt -= t * t;
+        _sy -= oldest.ppm;
+        _sty -= t * oldest.ppm;
+        _count--;
+    }
+    _ring[_head] = {nowMs, co2};
+    _head = (_head + 1) % CO2_TREND_SAMPLES;
+    _count++;
+    _sy += co2;
+    _lastMs = nowMs;
+
+    float slope = trend();
+    if (isnan(slope)) return;
+    float now = level();
+
+    if (!_decaying) {
+        if (slope < -CO2_DECAY_START_PPMH && now - _outdoorPpm >= CO2_DECAY_MIN_EXCESS) startDecay(nowMs);
+        if (!_decaying) return;
+    }
+
+    float excess = co2 - _outdoorPpm;
+    if (excess > CO2_DECAY_FLOOR) _decayFit.add((nowMs - _decayStartMs) / MS_PER_HOUR, log(excess));
+    if (now < _decayLow) {
+        _decayLow = now;
+        _decayAtLow = _decayFit;
+        _decayAtLowMs = nowMs;
+    }
+    if (now > _decayLow + CO2_DECAY_END_RISE || now - _outdoorPpm < CO2_DECAY_FLOOR ||
+        nowMs - _decayAtLowMs > DECAY_STALL_MS || nowMs - _decayStartMs > CO2_DECAY_MAX_MS) {
+        endDecay();
+    }
+}
+
+void Co2Analytics::startDecay(uint32_t nowMs) {
+    _decaying = true;
+    _decayStartMs = nowMs;
+    _decayLow = level();
+    _decayFit.reset();
+    _decayAtLow.reset();
+    _decayAtLowMs = nowMs;
+}
+
+// Up to its lowest level; what came after is the room filling again
+void Co2Analytics::endDecay() {
+    _decaying = false;
+    const Co2LineFit& fit = _decayAtLow;
+    if (_decayAtLowMs - _decayStartMs < CO2_DECAY_MIN_MS) return;
+    double slope = fit.slope();
+    double hours = (_decayAtLowMs - _decayStartMs) / MS_PER_HOUR;
+    if (isnan(slope) || -slope * hours < DECAY_MIN_LOG_DROP || fit.r2() < DECAY_MIN_R2) return;
+
+    float ach = -slope;
+    _ach = _decays == 0 ? ach : _ach + DECAY_WEIGHT * (ach - _ach);
+    if (_decays < 0xFFFF) _decays++;
+}
+
+float Co2Analytics::trend() const {
+    if (_count < CO2_TREND_MIN_SAMPLES) return NAN;
+    double d = _count * _stt - _st * _st;
+    if (d <= 0) return NAN;
+    return (_count * _sty - _st * _sy) / d;
+}
+
+float Co2Analytics::level() const {
+    float slope = trend();
+    if (isnan(slope)) return _count ? _sy / _count : NAN;
+    return (_sy - slope * _st) / _count;
+}
+
+float Co2Analytics::occupancy() const {
+    float slope = trend();
+    if (isnan(slope)) return NAN;
+    float people = _volumeM3 * (slope + _ach * (level() - _outdoorPpm)) / (CO2_PERSON_LPH * 1000);
+    return people > 0 ? people : 0;
+}
+
+size_t Co2Analytics::json(char* out, size_t size) const {
+    float slope = trend();
+    if (isnan(slope)) {
+        if (size) out[0] = 0;
+        return 0;
+    }
+    int length = snprintf(out, size, "{\"co2_trend\": %.0f, \"air_changes\": %.2f, \"decays\": %u, \"occupancy\": %.1f}",
+                          slope, _ach, (unsigned)_decays, occupancy());
+    if (length < 0 || (size_t)length >= size) {
+        if (size) out[0] = 0;
+        return 0;
+    }
+    return length;
+}
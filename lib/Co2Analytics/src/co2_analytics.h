@@ -0,0 +1,147 @@
+#pragma once
+
+// What the CO2 readings say about the room beyond their level: how fast CO2
+// is rising or falling, how often the air is exchanged, and how many people
+// it takes to explain the rest.
+//
+//   Co2Analytics air;
+//   ... on each reading:
+//   air.setRoom(settings.room_m3);
+//   air.add(millis(), co2);
+//   air.trend(), air.airChanges(), air.occupancy()
+//   air.json(payload, sizeof(payload));     // for the "air" topic
+//
+// The room is taken as one well-mixed volume V exchanging air with outside
+// (CO2 at Co) at λ air changes per hour, with N people each breathing out G
+// litres of CO2 an hour:
+//
+//   dC/dt = λ (Co - C) + N G 1000 / V        (ppm per hour)
+//
+// Trend: the slope of a least-squares line through the last
+// CO2_TREND_SAMPLES readings (5 minutes at 5 s), in ppm per hour. The sums
+// of the regression are kept with the newest reading at t = 0 and shifted
+// by the time since the previous one, so a reading adds one sample and
+// drops the oldest in O(1), and the sums stay small however long the device
+// runs. A gap over CO2_TREND_MAX_GAP_MS starts the window over.
+//
+// Air changes: with nobody in the room C - Co decays as e^(-λt), so ln(C - Co)
+// falls on a line of slope -λ. A decay starts when the fitted level is
+// CO2_DECAY_MIN_EXCESS above outside and the trend falls below
+// -CO2_DECAY_START_PPMH; from then on ln(C - Co) goes into a second
+// regression, kept as it was at the lowest level so far. It ends when the
+// level rises CO2_DECAY_END_RISE above that low (someone came back), makes
+// no new low for 10 minutes, comes within CO2_DECAY_FLOOR of outside, or
+// after CO2_DECAY_MAX_MS. A decay of at least CO2_DECAY_MIN_MS that took at
+// least 15% off the excess and fits its line (R² of 0.8 or more) gives λ;
+// later ones are averaged in with a weight of 0.3, as windows and the
+// heating change it. Until the first one, λ is CO2_DEFAULT_ACH.
+//
+// Occupancy: N from the balance above with the trend for dC/dt, the fitted
+// level for C and the measured λ: V (trend + λ (C - Co)) / (G 1000). It
+// takes a known room volume (setRoom()), counts seated adults (G of
+// CO2_PERSON_LPH) and, with the trend over 5 minutes, follows people coming
+// and going with a lag of a few minutes. Outside is CO2_OUTDOOR_PPM unless
+// set; with the SCD40's automatic self-calibration the sensor reads the
+// freshest air it sees as 400 ppm, so keep it close to that.
+//
+// Fixed memory (about 650 bytes, the window of readings most of it), no
+// allocation. tools/co2_analytics checks the estimates against simulated
+// rooms with known ventilation and occupancy, and runs recorded traces.
+
+#include <Arduino.h>
+
+#ifndef CO2_TREND_SAMPLES
+#define CO2_TREND_SAMPLES 60            // 5 minutes at 5 s; at most 255
+#endif
+
+const uint8_t CO2_TREND_MIN_SAMPLES = 12;          // no trend before a minute of readings
+const uint32_t CO2_TREND_MAX_GAP_MS = 60000;
+const float CO2_OUTDOOR_PPM = 420;
+const float CO2_PERSON_LPH = 18;                   // a seated adult, litres of CO2 an hour
+const float CO2_DEFAULT_ACH = 0.5f;                // a closed room with trickle vents
+const float CO2_DECAY_MIN_EXCESS = 150;            // ppm above outside for a decay to start
+const float CO2_DECAY_START_PPMH = 60;
+const float CO2_DECAY_END_RISE = 40;
+const float CO2_DECAY_FLOOR = 40;
+const uint32_t CO2_DECAY_MIN_MS = 20 * 60000UL;
+const uint32_t CO2_DECAY_MAX_MS = 4 * 3600000UL;
+
+// A least-squares line through (x, y) points added one by one
+struct Co2LineFit {
+    uint32_t n;
+    double sx, sxx, sy, syy, sxy;
+
+    void reset() { n = 0; sx = sxx = sy = syy = sxy = 0; }
+    void add(double x, double y) {
+        n++;
+        sx += x;
+        sxx += x * x;
+        sy += y;
+        syy += y * y;
+        sxy += x * y;
+    }
+    // NaN with fewer than two distinct x
+    double slope() const;
+    double r2() const;
+};
+
+class Co2Analytics {
+public:
+    Co2Analytics() { reset(); }
+
+    // The room's volume in m³ and the CO2 outside; only occupancy() uses the
+    // volume, so it can change at any time
+    void setRoom(float volumeM3, float outdoorPpm = CO2_OUTDOOR_PPM) {
+        _volumeM3 = volumeM3;
+        _outdoorPpm = outdoorPpm;
+    }
+    // Forgets everything but the air changes measured so far
+    void reset();
+
+    void add(uint32_t nowMs, float co2);
+
+    // ppm per hour; NaN until CO2_TREND_MIN_SAMPLES readings
+    float trend() const;
+    // The line's value at the newest reading: the level without the noise
+    float level() const;
+    // Per hour; CO2_DEFAULT_ACH until a decay was measured
+    float airChanges() const { return _ach; }
+    uint16_t decays() const { return _decays; }
+    bool decaying() const { return _decaying; }
+    // People; NaN while the trend is
+    float occupancy() const;
+
+    // {"co2_trend": -85, "air_changes": 1.42, "decays": 3, "occupancy": 1.6};
+    // 0 while there is no trend yet or it did not fit
+    size_t json(char* out, size_t size) const;
+
+private:
+    struct Sample {
+        uint32_t ms;
+        float ppm;
+    };
+
+    void startDecay(uint32_t nowMs);
+    void endDecay();
+
+    float _volumeM3 = 40;
+    float _outdoorPpm = CO2_OUTDOOR_PPM;
+
+    // The trend window; t in hours, 0 at the newest reading
+    Sample _ring[CO2_TREND_SAMPLES];
+    uint8_t _head;
+    uint8_t _count;
+    uint32_t _lastMs;
+    double _st, _stt, _sy, _sty;
+
+    // The decay going on; x in hours since it started
+    bool _decaying;
+    uint32_t _decayStartMs;
+    float _decayLow;                // the lowest level so far
+    Co2LineFit _decayFit;
+    Co2LineFit _decayAtLow;         // the fit as it was at _decayLow
+    uint32_t _decayAtLowMs;
+
+    float _ach = CO2_DEFAULT_ACH;
+    uint16_t _decays = 0;
+};
@@ -0,0 +1,143 @@
+#include "co_task.h"
+
+struct CoSlot {
+    CoTask::Handle handle;
+    const char* name;
+    uint16_t generation;
+    bool running;      // inside resume(); cannot be destroyed until it suspends
+    bool cancelled;
+};
+
+alignas(16) static uint8_t framePool[CO_TASK_FRAMES][CO_TASK_FRAME_BYTES];
+static bool frameUsed[CO_TASK_FRAMES];
+static size_t largestFrame = 0;
+static uint32_t startFailures = 0;
+
+static CoSlot slots[CO_TASK_FRAMES];
+static uint32_t pollRound = 0;
+
+void* coFrameAlloc(size_t size) {
+    if (size > largestFrame) largestFrame = size;
+    if (size > (size_t)CO_TASK_FRAME_BYTES) return nullptr;
+    for (int i = 0; i < CO_TASK_FRAMES; i++) {
+        if (!frameUsed[i]) {
+            frameUsed[i] = true;
+            return framePool[i];
+        }
+    }
+    return nullptr;
+}
+
+void coFrameFree(void* frame) {
+    int i = ((uint8_t*)frame - &framePool[0][0]) / CO_TASK_FRAME_BYTES;
+    if (i >= 0 && i < CO_TASK_FRAMES) frameUsed[i] = false;
+}
+
+static CoTaskId slotId(int i) {
+    return ((CoTaskId)slots[i].generation << 8) | (CoTaskId)(i + 1);
+}
+
+static CoSlot* findSlot(CoTaskId id) {
+    int i = (int)(id & 0xFF) - 1;
+    if (i < 0 || i >= CO_TASK_FRAMES) return nullptr;
+    CoSlot& s = slots[i];
+    if (!s.handle || s.generation != (uint16_t)(id >> 8)) return nullptr;
+    return &s;
+}
+
+// Runs one step of the task; frees it if it finished or was cancelled meanwhile
+static void resume(CoSlot& s) {
+    s.running = true;
+    s.handle.resume();
+    s.running = false;
+
+    if (s.handle.done() || s.cancelled) {
+        s.handle.destroy();
+        s.handle = nullptr;
+        return;
+    }
+    // Not again in the round it suspended in, so coYield() means "next loop"
+    s.handle.promise().wait.poll = pollRound;
+}
+
+CoTaskId coStart(CoTask&& task, const char* name) {
+    if (!task) {
+        startFailures++;
+        return 0;
+    }
+    for (int i = 0; i < CO_TASK_FRAMES; i++) {
+        CoSlot& s = slots[i];
+        if (s.handle) continue;
+        s.handle = task.release();
+        s.name = name;
+        s.generation++;
+        s.cancelled = false;
+        CoTaskId id = slotId(i);
+        resume(s);
+        return id;
+    }
+    startFailures++;
+    return 0;   // task goes out of scope and frees its frame
+}
+
+void coPoll() {
+    pollRound++;
+    for (int i = 0; i < CO_TASK_FRAMES; i++) {
+        CoSlot& s = slots[i];
+        if (!s.handle || s.running) continue;
+        CoWait& w = s.handle.promise().wait;
+        if (w.poll == pollRound) continue;
+
+        uint32_t now = millis();
+        bool ready = false;
+        switch (w.kind) {
+            case CO_WAIT_YIELD: ready = true; break;
+            case CO_WAIT_SLEEP: ready = now - w.startMs >= w.timeoutMs; break;
+            case CO_WAIT_UNTIL: ready = w.pred(w.user); break;
+            case CO_WAIT_EVENT: ready = w.event->consume(); break;
+        }
+        if (!ready && w.kind != CO_WAIT_SLEEP && w.timeoutMs != CO_FOREVER && now - w.startMs >= w.timeoutMs) {
+            w.timedOut = true;
+            ready = true;
+        }
+        if (ready) resume(s);
+    }
+}
+
+void coCancel(CoTaskId id) {
+    CoSlot* s = findSlot(id);
+    if (!s) return;
+    if (s->running) {
+        s->cancelled = true;
+        return;
+    }
+    s->handle.destroy();
+    s->handle = nullptr;
+}
+
+bool coRunning(CoTaskId id) {
+    CoSlot* s = findSlot(id);
+    return s && !s->cancelled;
+}
+
+CoTaskStats coTaskStats() {
+    CoTaskStats stats = {0, 0, largestFrame, startFailures};
+    for (int i = 0; i < CO_TASK_FRAMES; i++) {
+        if (slots[i].handle) stats.running++;
+        if (frameUsed[i]) stats.framesInUse++;
+    }
+    return stats;
+}
+
+void printCoTasks(Print& out) {
+    static const char* const kinds[] = {"yield", "sleep", "until", "event"};
+    uint32_t now = millis();
+    for (int i = 0; i < CO_TASK_FRAMES; i++) {
+        CoSlot& s = slots[i];
+        if (!s.handle) continue;
+        const CoWait& w = s.handle.promise().wait;
+        out.printf("co %s: %s", s.name ? s.name : "?", kinds[w.kind]);
+        if (w.timeoutMs != CO_FOREVER) out.printf(", %u of %u ms", (unsigned)(now - w.startMs), (unsigned)w.timeoutMs);
+        out.printf("\n");
+    }
+}
@@ -0,0 +1,212 @@
+#pragma once
+
+// Cooperative coroutine tasks for flows that used to block in delay().
+//
+//   CoTask playMelody() {
+//       for (int i = 0; i < melodyLength; i++) {
+//           M5.Speaker.tone(melody[i], 250);
+//           co_await coSleep(250);
+//       }
+//   }
+//
+//   melodyTask = coStart(playMelody(), "melody");   // from setup() or a handler
+//   coPoll();                                       // once per loop()
+//
+// A task runs on whichever task calls coPoll() (the Arduino loop task), one
+// step at a time from one co_await to the next, so the flow reads top to
+// bottom while drawing and sensor reads carry on between its steps. Nothing
+// preempts a task: code between two awaits must not block.
+//
+// Awaitables:
+//   coSleep(ms)                resumes after ms
+//   coYield()                  resumes on the next coPoll()
+//   coUntil(pred, timeoutMs)   resumes once pred() returns true; pred is checked
+//                              on every coPoll(), so it suits I/O such as
+//                              WiFi.status() or M5.Speaker.isPlaying()
+//   coWait(event, timeoutMs)   resumes once event.set() has been called
+// The last two give false when they time out.
+//
+// coCancel(id) destroys a task where it is suspended: destructors of its
+// locals run, nothing after the await does. Whoever cancels a task undoes its
+// side effects (stops the speaker, clears a banner).
+//
+// Frames come from a fixed pool of CO_TASK_FRAMES blocks of CO_TASK_FRAME_BYTES;
+// nothing is allocated from the heap. coStart() returns 0 if no block is free
+// or the frame does not fit. coTaskStats() shows the largest frame so far.
+//
+// coStart(), coPoll() and coCancel() belong to the polling task. CoEvent::set()
+// may be called from any FreeRTOS task.
+//
+// Needs C++20 coroutines: the Tab5 toolchain, or GCC 10+ with -std=gnu++20 on
+// the host. The CoreInk and Paper toolchains (GCC 8) cannot build it.
+
+#include <Arduino.h>
+#include <atomic>
+#include <coroutine>
+
+const int CO_TASK_FRAMES = 8;
+const int CO_TASK_FRAME_BYTES = 512;
+const uint32_t CO_FOREVER = 0xFFFFFFFF;
+
+typedef uint32_t CoTaskId;   // 0 = no task
+
+class CoEvent;
+
+enum CoWaitKind : uint8_t {
+    CO_WAIT_YIELD,
+    CO_WAIT_SLEEP,
+    CO_WAIT_UNTIL,
+    CO_WAIT_EVENT,
+};
+
+// What a suspended task is waiting for; filled in by the awaitable
+struct CoWait {
+    CoWaitKind kind = CO_WAIT_YIELD;
+    uint32_t startMs = 0;
+    uint32_t timeoutMs = CO_FOREVER;
+    bool (*pred)(void*) = nullptr;
+    void* user = nullptr;
+    CoEvent* event = nullptr;
+    uint32_t poll = 0;        // coPoll() round it suspended in
+    bool timedOut = false;
+};
+
+// Frame pool, used by CoTask::promise_type
+void* coFrameAlloc(size_t size);
+void coFrameFree(void* frame);
+
+class CoTask {
+public:
+    struct promise_type {
+        CoWait wait;
+
+        CoTask get_return_object() {
+            return CoTask(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+        static CoTask get_return_object_on_allocation_failure() { return CoTask(); }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { abort(); }
+
+        static void* operator new(size_t size) noexcept { return coFrameAlloc(size); }
+        static void operator delete(void* frame) noexcept { coFrameFree(frame); }
+    };
+    typedef std::coroutine_handle<promise_type> Handle;
+
+    CoTask() {}
+    CoTask(const CoTask&) = delete;
+    CoTask& operator=(const CoTask&) = delete;
+    CoTask(CoTask&& other) : _handle(other._handle) { other._handle = nullptr; }
+    ~CoTask() {
+        if (_handle) _handle.destroy();   // never started
+    }
+
+    explicit operator bool() const { return (bool)_handle; }
+    Handle release() {
+        Handle h = _handle;
+        _handle = nullptr;
+        return h;
+    }
+
+private:
+    explicit CoTask(Handle handle) : _handle(handle) {}
+    Handle _handle = nullptr;
+};
+
+// Runs the task up to its first await and keeps polling it from coPoll().
+// Returns 0 (and drops the task) if the frame pool or task table is full.
+CoTaskId coStart(CoTask&& task, const char* name = nullptr);
+
+// Resumes every task whose wait is over; call once per loop()
+void coPoll();
+
+// Destroys the task at its current await. A task may cancel itself; it then
+// ends at its next await. Ids of finished tasks are ignored.
+void coCancel(CoTaskId id);
+bool coRunning(CoTaskId id);
+
+struct CoTaskStats {
+    int running;
+    int framesInUse;
+    size_t largestFrame;       // bytes, over all tasks started so far
+    uint32_t startFailures;    // coStart() calls that found no frame or slot
+};
+CoTaskStats coTaskStats();
+
+// One line per running task: name and what it is waiting for
+void printCoTasks(Print& out);
+
+// Auto-reset event: set() wakes one waiter, or the next one to wait if nobody
+// is waiting yet
+class CoEvent {
+public:
+    void set() { _set.store(true, std::memory_order_release); }
+    void clear() { _set.store(false, std::memory_order_relaxed); }
+    bool isSet() const { return _set.load(std::memory_order_acquire); }
+    bool consume() { return _set.exchange(false, std::memory_order_acq_rel); }
+
+private:
+    std::atomic<bool> _set{false};
+};
+
+// Awaitables
+
+struct CoAwait {
+    bool await_ready() const { return false; }
+    void suspend(CoTask::Handle h, CoWaitKind kind, uint32_t timeoutMs) {
+        _promise = &h.promise();
+        CoWait& w = _promise->wait;
+        w = CoWait();
+        w.kind = kind;
+        w.startMs = millis();
+        w.timeoutMs = timeoutMs;
+    }
+    bool finished() const { return !_promise || !_promise->wait.timedOut; }
+
+    CoTask::promise_type* _promise = nullptr;
+};
+
+struct CoSleepAwait : CoAwait {
+    uint32_t ms;
+    explicit CoSleepAwait(uint32_t ms) : ms(ms) {}
+    void await_suspend(CoTask::Handle h) { suspend(h, CO_WAIT_SLEEP, ms); }
+    void await_resume() {}
+};
+
+struct CoYieldAwait : CoAwait {
+    void await_suspend(CoTask::Handle h) { suspend(h, CO_WAIT_YIELD, CO_FOREVER); }
+    void await_resume() {}
+};
+
+template <typename Pred>
+struct CoUntilAwait : CoAwait {
+    Pred pred;
+    uint32_t timeoutMs;
+    CoUntilAwait(Pred pred, uint32_t timeoutMs) : pred(pred), timeoutMs(timeoutMs) {}
+    bool await_ready() { return pred(); }
+    void await_suspend(CoTask::Handle h) {
+        suspend(h, CO_WAIT_UNTIL, timeoutMs);
+        _promise->wait.pred = [](void* user) { return (bool)(*(Pred*)user)(); };
+        _promise->wait.user = &pred;
+    }
+    bool await_resume() { return finished(); }
+};
+
+struct CoEventAwait : CoAwait {
+    CoEvent& event;
+    uint32_t timeoutMs;
+    CoEventAwait(CoEvent& event, uint32_t timeoutMs) : event(event), timeoutMs(timeoutMs) {}
+    bool await_ready() { return event.consume(); }
+    void await_suspend(CoTask::Handle h) {
+        suspend(h, CO_WAIT_EVENT, timeoutMs);
+        _promise->wait.event = &event;
+    }
+    bool await_resume() { return finished(); }
+};
+
+inline CoSleepAwait coSleep(uint32_t ms) { return CoSleepAwait(ms); }
+inline CoYieldAwait coYield() { return CoYieldAwait(); }
+inline CoEventAwait coWait(CoEvent& event, uint32_t timeoutMs = CO_FOREVER) { return CoEventAwait(event, timeoutMs); }
+template <typename Pred>
+CoUntilAwait<Pred> coUntil(Pred pred, uint32_t timeoutMs = CO_FOREVER) { return CoUntilAwait<Pred>(pred, timeoutMs); }
@@ -0,0 +1,462 @@
+#include "deferlog.h"
+
+#include <stdio.h>
+
+#ifdef ESP_PLATFORM
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#endif
+
+#ifndef DEFERLOG_RING_BYTES
+#define DEFERLOG_RING_BYTES 4096    // power of two
+#endif
+
+#ifndef DEFERLOG_STACK_SIZE
+#define DEFERLOG_STACK_SIZE 4096
+#endif
+
+// Records are rendered to text on this side instead of sent as frames
+#if (!defined(ESP_PLATFORM) && !defined(DEFERLOG_FRAMES)) || defined(DEFERLOG_TEXT)
+#define DEFERLOG_RENDER_LOCALLY 1
+#endif
+
+// The ring is made of words so every access is a plain atomic. A record is
+// [header][id][micros][arguments...]; the header is written last, with the
+// committed bit, and the drain task stops at the first record whose header is
+// not committed yet. Producers reserve words with a compare-exchange on
+// reserveWord, so any task may log; the drain task is the only consumer and
+// zeroes what it has read before handing the words back.
+//
+// reserveWord and readWord only grow and are compared through their
+// difference, so wrapping after 2^32 words is harmless.
+
+const uint32_t RING_WORDS = DEFERLOG_RING_BYTES / 4;
+const uint32_t RECORD_COMMITTED = 0x80000000u;
+const uint32_t RECORD_HEADER_WORDS = 3;
+
+static std::atomic<uint32_t> ring[RING_WORDS];
+static std::atomic<uint32_t> reserveWord(0);
+static std::atomic<uint32_t> readWord(0);
+
+static std::atomic<uint32_t> recordsWritten(0);
+static std::atomic<uint32_t> recordsDropped(0);
+static std::atomic<uint32_t> droppedUnreported(0);
+static std::atomic<uint32_t> maxUsedWords(0);
+
+static DeferLogModule* modules = nullptr;
+static std::atomic<DeferLogSite*> sites(nullptr);
+static std::atomic_flag registering = ATOMIC_FLAG_INIT;
+static std::atomic_flag draining = ATOMIC_FLAG_INIT;
+
+static Print* output = nullptr;
+
+// Modules
+
+DeferLogModule::DeferLogModule(const char* name, DeferLogLevel level) : name(name), level(level) {
+    // Modules are globals, constructed before any task starts
+    next = modules;
+    modules = this;
+}
+
+DeferLogModule* deferLogModules() {
+    return modules;
+}
+
+bool deferLogSetLevel(const char* module, DeferLogLevel level) {
+    for (DeferLogModule* m = modules; m; m = m->next) {
+        if (strcmp(m->name, module) == 0) {
+            m->level = level;
+            return true;
+        }
+    }
+    return false;
+}
+
+char deferLogLevelLetter(uint8_t level) {
+    static const char letters[] = "NEWIDV";
+    return level < sizeof(letters) - 1 ? letters[level] : '?';
+}
+
+// Call sites
+
+void deferLogRegister(DeferLogSite& site, const char* types) {
+    while (registering.test_and_set(std::memory_order_acquire)) {
+    }
+    if (!site.registered.load(std::memory_order_relaxed)) {
+        site.types = types;
+        site.id = deferLogHash(types, site.formatHash);
+        site.next = sites.load(std::memory_order_relaxed);
+        sites.store(&site, std::memory_order_release);
+        site.registered.store(true, std::memory_order_release);
+    }
+    registering.clear(std::memory_order_release);
+}
+
+// Producer side
+
+void deferLogCommit(const DeferLogSite& site, const uint8_t* args, size_t length) {
+    uint32_t argWords = (length + 3) / 4;
+    uint32_t words = RECORD_HEADER_WORDS + argWords;
+
+    uint32_t start = reserveWord.load(std::memory_order_relaxed);
+    uint32_t used;
+    do {
+        used = start + words - readWord.load(std::memory_order_acquire);
+        if (used > RING_WORDS) {
+            recordsDropped.fetch_add(1, std::memory_order_relaxed);
+            droppedUnreported.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+    } while (!reserveWord.compare_exchange_weak(start, start + words, std::memory_order_acq_rel,
+                                                std::memory_order_relaxed));
+
+    uint32_t seen = maxUsedWords.load(std::memory_order_relaxed);
+    while (used > seen && !maxUsedWords.compare_exchange_weak(seen, used, std::memory_order_relaxed)) {
+    }
+
+    ring[(start + 1) % RING_WORDS].store(site.id, std::memory_order_relaxed);
+    ring[(start + 2) % RING_WORDS].store(micros(), std::memory_order_relaxed);
+    for (uint32_t i = 0; i < argWords; i++) {
+        uint32_t w = 0;
+        size_t n = length - i * 4 < 4 ? length - i * 4 : 4;
+        memcpy(&w, args + i * 4, n);
+        ring[(start + RECORD_HEADER_WORDS + i) % RING_WORDS].store(w, std::memory_order_relaxed);
+    }
+    ring[start % RING_WORDS].store(RECORD_COMMITTED | (uint32_t)length, std::memory_order_release);
+    recordsWritten.fetch_add(1, std::memory_order_relaxed);
+
+#ifndef ESP_PLATFORM
+    deferLogFlush();
+#endif
+}
+
+// Drain side
+
+#ifdef DEFERLOG_RENDER_LOCALLY
+
+static const DeferLogSite* findSite(uint32_t id) {
+    for (const DeferLogSite* s = sites.load(std::memory_order_acquire); s; s = s->next) {
+        if (s->id == id) return s;
+    }
+    return nullptr;
+}
+
+static void emitText(uint8_t level, const char* module, uint32_t us, const char* text) {
+    output->printf("%c (%lu) %s: %s\n", deferLogLevelLetter(level), (unsigned long)(us / 1000), module, text);
+}
+
+static void emitRecord(uint32_t id, uint32_t us, const uint8_t* args, size_t length) {
+    char text[320];
+    const DeferLogSite* site = findSite(id);
+    if (!site) return;
+    deferLogRender(text, sizeof(text), site->format, site->types, args, length);
+    emitText(site->level, site->module->name, us, text);
+}
+
+static void emitDropped(uint32_t count) {
+    char text[48];
+    snprintf(text, sizeof(text), "%u records dropped, ring full", (unsigned)count);
+    emitText(DLOG_WARN, "deferlog", micros(), text);
+}
+
+static void announceSites() {}
+
+#else
+
+static uint32_t lastDictionaryMs = 0;
+
+// Large enough for a record or a dictionary entry; longer ones are not sent
+static void emitFrame(uint8_t type, const uint8_t* parts[], const size_t lengths[], int count) {
+    uint8_t frame[5 + 8 + DEFERLOG_MAX_RECORD + 256 + 1];
+    size_t n = 5;
+    uint8_t check = 0;
+    for (int i = 0; i < count; i++) {
+        if (n + lengths[i] > sizeof(frame) - 1) return;
+        memcpy(frame + n, parts[i], lengths[i]);
+        for (size_t j = 0; j < lengths[i]; j++) check ^= parts[i][j];
+        n += lengths[i];
+    }
+    frame[0] = DEFERLOG_MAGIC0;
+    frame[1] = DEFERLOG_MAGIC1;
+    frame[2] = type;
+    frame[3] = (uint8_t)(n - 5);
+    frame[4] = (uint8_t)((n - 5) >> 8);
+    frame[n++] = check;
+    output->write(frame, n);   // one write, so frames never interleave with other Serial output
+}
+
+static void emitRecord(uint32_t id, uint32_t us, const uint8_t* args, size_t length) {
+    const uint8_t* parts[] = {(const uint8_t*)&id, (const uint8_t*)&us, args};
+    const size_t lengths[] = {4, 4, length};
+    emitFrame(DEFERLOG_FRAME_RECORD, parts, lengths, 3);
+}
+
+static void emitDropped(uint32_t count) {
+    const uint8_t* parts[] = {(const uint8_t*)&count};
+    const size_t lengths[] = {4};
+    emitFrame(DEFERLOG_FRAME_DROPPED, parts, lengths, 1);
+}
+
+static void announceSites() {
+    bool repeat = millis() - lastDictionaryMs > DEFERLOG_DICT_INTERVAL_MS;
+    if (repeat) lastDictionaryMs = millis();
+
+    for (DeferLogSite* s = sites.load(std::memory_order_acquire); s; s = s->next) {
+        if (s->announced.load(std::memory_order_relaxed) && !repeat) continue;
+        const char* module = s->module->name;
+        const uint8_t* parts[] = {(const uint8_t*)&s->id, &s->level, (const uint8_t*)module,
+                                  (const uint8_t*)s->format, (const uint8_t*)s->types};
+        const size_t lengths[] = {4, 1, strlen(module) + 1, strlen(s->format) + 1, strlen(s->types) + 1};
+        emitFrame(DEFERLOG_FRAME_DICT, parts, lengths, 5);
+        s->announced.store(true, std::memory_order_relaxed);
+    }
+}
+
+#endif
+
+void deferLogFlush() {
+    if (!output) return;
+    if (draining.test_and_set(std::memory_order_acquire)) return;   // someone else is draining
+
+    // Sites register before their first record is written, so announcing
+    // first means the decoder never sees a record it has no format for
+    announceSites();
+
+    uint8_t args[DEFERLOG_MAX_RECORD + 4];
+    uint32_t r = readWord.load(std::memory_order_relaxed);
+    while (r != reserveWord.load(std::memory_order_acquire)) {
+        uint32_t header = ring[r % RING_WORDS].load(std::memory_order_acquire);
+        if (!(header & RECORD_COMMITTED)) break;
+
+        size_t length = header & 0xFFFF;
+        uint32_t argWords = (length + 3) / 4;
+        uint32_t id = ring[(r + 1) % RING_WORDS].load(std::memory_order_relaxed);
+        uint32_t us = ring[(r + 2) % RING_WORDS].load(std::memory_order_relaxed);
+        for (uint32_t i = 0; i < argWords; i++) {
+            uint32_t w = ring[(r + RECORD_HEADER_WORDS + i) % RING_WORDS].load(std::memory_order_relaxed);
+            memcpy(args + i * 4, &w, 4);
+        }
+        for (uint32_t i = 0; i < RECORD_HEADER_WORDS + argWords; i++) {
+            ring[(r + i) % RING_WORDS].store(0, std::memory_order_relaxed);
+        }
+        r += RECORD_HEADER_WORDS + argWords;
+        readWord.store(r, std::memory_order_release);
+
+        emitRecord(id, us, args, length);
+    }
+
+    uint32_t lost = droppedUnreported.exchange(0, std::memory_order_relaxed);
+    if (lost) emitDropped(lost);
+
+    draining.clear(std::memory_order_release);
+}
+
+#ifdef ESP_PLATFORM
+static void drainTask(void*) {
+    for (;;) {
+        deferLogFlush();
+        vTaskDelay(pdMS_TO_TICKS(20));
+    }
+}
+#endif
+
+void deferLogBegin(Print& out) {
+    if (output) return;
+    output = &out;
+#ifdef ESP_PLATFORM
+    // Priority 1, the same as the Arduino loop task: it only runs when the
+    // loop blocks or its time slice ends, never in front of it
+    xTaskCreate(drainTask, "deferlog", DEFERLOG_STACK_SIZE, nullptr, 1, nullptr);
+#else
+    deferLogFlush();
+#endif
+}
+
+DeferLogStats deferLogStats() {
+    DeferLogStats stats;
+    stats.written = recordsWritten.load(std::memory_order_relaxed);
+    stats.dropped = recordsDropped.load(std::memory_order_relaxed);
+    stats.maxUsedBytes = maxUsedWords.load(std::memory_order_relaxed) * 4;
+    return stats;
+}
+
+// Rendering
+
+// Reads arguments in the order the type letters give them
+struct ArgReader {
+    const char* types;
+    const uint8_t* args;
+    size_t length;
+    size_t pos;
+
+    bool next(char& type, const uint8_t*& p, size_t& n) {
+        if (!*types) return false;
+        type = *types++;
+        size_t size = (type == 'I' || type == 'U' || type == 'd' || type == 'p') ? 8 : 4;
+        if (type == 's') {
+            uint16_t len;
+            if (pos + 2 > length) return false;
+            memcpy(&len, args + pos, 2);
+            pos += 2;
+            size = len;
+        }
+        if (pos + size > length) return false;
+        p = args + pos;
+        n = size;
+        pos += size;
+        return true;
+    }
+
+    bool integer(long long& v) {
+        char type;
+        const uint8_t* p;
+        size_t n;
+        if (!next(type, p, n)) return false;
+        if (type == 'i') { int32_t x; memcpy(&x, p, 4); v = x; }
+        else if (type == 'u') { uint32_t x; memcpy(&x, p, 4); v = x; }
+        else if (type == 'I' || type == 'U' || type == 'p') { int64_t x; memcpy(&x, p, 8); v = x; }
+        else if (type == 'f') { float x; memcpy(&x, p, 4); v = (long long)x; }
+        else if (type == 'd') { double x; memcpy(&x, p, 8); v = (long long)x; }
+        else v = 0;
+        return true;
+    }
+
+    bool real(double& v) {
+        char type;
+        const uint8_t* p;
+        size_t n;
+        if (!next(type, p, n)) return false;
+        if (type == 'f') { float x; memcpy(&x, p, 4); v = x; }
+        else if (type == 'd') { memcpy(&v, p, 8); }
+        else if (type == 'i') { int32_t x; memcpy(&x, p, 4); v = x; }
+        else if (type == 'u') { uint32_t x; memcpy(&x, p, 4); v = x; }
+        else if (type == 'I' || type == 'U') { int64_t x; memcpy(&x, p, 8); v = (double)x; }
+        else v = 0;
+        return true;
+    }
+
+    bool string(char* out, size_t cap) {
+        char type;
+        const uint8_t* p;
+        size_t n;
+        if (!next(type, p, n)) return false;
+        if (type != 's') n = 0;
+        if (n > cap - 1) n = cap - 1;
+        memcpy(out, p, n);
+        out[n] = 0;
+        return true;
+    }
+};
+
+size_t deferLogRender(char* out, size_t cap, const char* format, const char* types,
+                      const uint8_t* args, size_t argsLength) {
+    ArgReader reader = {types ? types : "", args, argsLength, 0};
+    size_t n = 0;
+    if (cap == 0) return 0;
+
+    const char* f = format;
+    while (*f && n + 1 < cap) {
+        if (*f != '%') {
+            out[n++] = *f++;
+            continue;
+        }
+        if (f[1] == '%') {
+            out[n++] = '%';
+            f += 2;
+            continue;
+        }
+
+        // Rebuild the conversion with our own length modifier. The format can
+        // come off the wire (tools/deferlog_decode), so a spec that does not
+        // fit is rendered as "<?>" rather than cut short.
+        char spec[24];
+        const size_t room = sizeof(spec) - 4;   // leaves "ll", the conversion and the NUL
+        size_t s = 0;
+        bool fits = true;
+        spec[s++] = *f++;
+        while (*f && strchr("-+ #0", *f)) {
+            if (s < room) spec[s++] = *f;
+            else fits = false;
+            f++;
+        }
+        for (int part = 0; part < 2; part++) {
+            if (part == 1) {
+                if (*f != '.') break;
+                if (s < room) spec[s++] = *f;
+                else fits = false;
+                f++;
+            }
+            if (*f == '*') {
+                long long v = 0;
+                reader.integer(v);
+                int w = snprintf(spec + s, room - s + 1, "%d", (int)v);
+                if (w < 0 || (size_t)w > room - s) fits = false;
+                else s += w;
+                f++;
+            } else {
+                while (*f >= '0' && *f <= '9') {
+                    if (s < room) spec[s++] = *f;
+                    else fits = false;
+                    f++;
+                }
+            }
+        }
+        while (*f && strchr("hljztLq", *f)) f++;
+        char conversion = *f;
+        if (conversion) f++;
+
+        char piece[DEFERLOG_MAX_STRING + 64];
+        int written = 0;
+        bool ok = true;
+        switch (conversion) {
+            case 'd': case 'i': case 'u': case 'o': case 'x': case 'X': {
+                long long v = 0;
+                ok = reader.integer(v);
+                spec[s++] = 'l';
+                spec[s++] = 'l';
+                spec[s++] = conversion;
+                spec[s] = 0;
+                written = snprintf(piece, sizeof(piece), spec, v);
+                break;
+            }
+            case 'c': {
+                long long v = 0;
+                ok = reader.integer(v);
+                spec[s++] = 'c';
+                spec[s] = 0;
+                written = snprintf(piece, sizeof(piece), spec, (int)v);
+                break;
+            }
+            case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A': {
+                double v = 0;
+                ok = reader.real(v);
+                spec[s++] = conversion;
+                spec[s] = 0;
+                written = snprintf(piece, sizeof(piece), spec, v);
+                break;
+            }
+            case 's': {
+                char str[DEFERLOG_MAX_STRING + 1];
+                ok = reader.string(str, sizeof(str));
+                spec[s++] = 's';
+                spec[s] = 0;
+                written = snprintf(piece, sizeof(piece), spec, str);
+                break;
+            }
+            case 'p': {
+                long long v = 0;
+                ok = reader.integer(v);
+                written = snprintf(piece, sizeof(piece), "0x%llx", (unsigned long long)v);
+                break;
+            }
+            default:
+                break;
+        }
+        if (!ok || !fits) written = snprintf(piece, sizeof(piece), "<?>");
+        if (written < 0) written = 0;
+        if ((size_t)written > sizeof(piece) - 1) written = sizeof(piece) - 1;
+        for (int i = 0; i < written && n + 1 < cap; i++) out[n++] = piece[i];
+    }
+    out[n] = 0;
+    return n;
+}
@@ -0,0 +1,219 @@
+#pragma once
+
+// Deferred binary logging for hot paths.
+//
+//   DeferLogModule mqttLog("mqtt", DLOG_INFO);
+//   DLOG_I(mqttLog, "Published to %s: %s", topic, payload);
+//
+// A call checks the module's level, then copies a 32-bit id, a timestamp and
+// the raw arguments into a lock-free ring. Nothing is formatted and nothing
+// waits for the UART. The id is an FNV-1a hash of the format string, computed
+// at compile time, mixed with the argument types the first time the call site
+// runs. Format strings are still checked by -Wformat.
+//
+// deferLogBegin() starts a low-priority task that drains the ring to Serial as
+// binary frames. A call site's format string, module, level and argument types
+// are sent once, the first time it logs, and again every
+// DEFERLOG_DICT_INTERVAL_MS for a decoder that attached late. tools/deferlog_decode
+// turns the stream back into text and passes ordinary Serial output through.
+//
+// With -DDEFERLOG_TEXT the drain task prints text itself, for a plain serial
+// monitor. On the host (no ESP_PLATFORM) records are drained as soon as they
+// are written, so host runs keep program order; they are printed as text unless
+// built with -DDEFERLOG_FRAMES.
+//
+// Arguments may be integers up to 64 bit, float, double, pointers and C strings
+// (copied, at most DEFERLOG_MAX_STRING bytes; pass String as .c_str()). A record
+// that does not fit in the ring is dropped and counted; the drain task reports
+// the count.
+//
+// Wire format, shared with the decoder: DEFERLOG_MAGIC0 DEFERLOG_MAGIC1, type,
+// payload length (u16 little endian), payload, XOR of the payload bytes.
+//   'L' record     u32 id, u32 micros, arguments
+//   'D' dictionary u32 id, u8 level, module\0 format\0 argument types\0
+//   'X' dropped    u32 records dropped since the last 'X'
+
+#include <Arduino.h>
+#include <atomic>
+#include <string.h>
+#include <type_traits>
+
+enum DeferLogLevel : uint8_t {
+    DLOG_NONE = 0,
+    DLOG_ERROR,
+    DLOG_WARN,
+    DLOG_INFO,
+    DLOG_DEBUG,
+    DLOG_VERBOSE,
+};
+
+const int DEFERLOG_MAX_RECORD = 256;    // bytes of arguments per call
+const int DEFERLOG_MAX_STRING = 200;
+const uint32_t DEFERLOG_DICT_INTERVAL_MS = 60000;
+
+const uint8_t DEFERLOG_MAGIC0 = 0xD1;
+const uint8_t DEFERLOG_MAGIC1 = 0x06;
+const uint8_t DEFERLOG_FRAME_RECORD = 'L';
+const uint8_t DEFERLOG_FRAME_DICT = 'D';
+const uint8_t DEFERLOG_FRAME_DROPPED = 'X';
+
+// One per subsystem; the level can be changed at runtime
+class DeferLogModule {
+public:
+    DeferLogModule(const char* name, DeferLogLevel level);
+
+    const char* name;
+    volatile uint8_t level;
+    DeferLogModule* next;
+};
+
+// Changes a module's level by name; false if there is no such module
+bool deferLogSetLevel(const char* module, DeferLogLevel level);
+DeferLogModule* deferLogModules();
+
+// Starts draining to out. Records written before this wait in the ring.
+void deferLogBegin(Print& out = Serial);
+
+// Drains the ring on the calling task; the drain task does this on its own
+void deferLogFlush();
+
+struct DeferLogStats {
+    uint32_t written;
+    uint32_t dropped;
+    uint32_t maxUsedBytes;   // high-water mark of the ring
+};
+DeferLogStats deferLogStats();
+
+// Formats one record's arguments with its format string and argument types.
+// Shared with the decoder. Returns the length written (truncated to cap - 1).
+size_t deferLogRender(char* out, size_t cap, const char* format, const char* types,
+                      const uint8_t* args, size_t argsLength);
+
+char deferLogLevelLetter(uint8_t level);
+
+// Compile-time FNV-1a, C++11 constexpr so the GCC 8 boards can use it too
+constexpr uint32_t deferLogHash(const char* s, uint32_t h = 2166136261u) {
+    return *s ? deferLogHash(s + 1, (h ^ (uint8_t)*s) * 16777619u) : h;
+}
+
+// A call site; constant-initialised, so the static in each macro costs no guard
+struct DeferLogSite {
+    constexpr DeferLogSite(const DeferLogModule* module, uint8_t level, const char* format, uint32_t formatHash)
+        : module(module), format(format), types(nullptr), next(nullptr), formatHash(formatHash), id(0),
+          level(level), registered(false), announced(false) {}
+
+    const DeferLogModule* module;
+    const char* format;
+    const char* types;
+    DeferLogSite* next;
+    uint32_t formatHash;
+    uint32_t id;
+    uint8_t level;
+    std::atomic<bool> registered;
+    std::atomic<bool> announced;
+};
+
+// Internal: used by deferLog()
+void deferLogRegister(DeferLogSite& site, const char* types);
+void deferLogCommit(const DeferLogSite& site, const uint8_t* args, size_t length);
+
+// Argument type letters: i/u 32-bit, I/U 64-bit, f float, d double, s string, p pointer
+template <typename T, typename Enable = void>
+struct DeferLogType;
+template <typename T>
+struct DeferLogType<T, typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value>::type> {
+    static const char letter = sizeof(T) > 4 ? (std::is_signed<T>::value ? 'I' : 'U')
+                                             : (std::is_signed<T>::value ? 'i' : 'u');
+};
+template <> struct DeferLogType<float> { static const char letter = 'f'; };
+template <> struct DeferLogType<double> { static const char letter = 'd'; };
+template <> struct DeferLogType<char*> { static const char letter = 's'; };
+template <> struct DeferLogType<const char*> { static const char letter = 's'; };
+template <typename T>
+struct DeferLogType<T*, typename std::enable_if<!std::is_same<typename std::remove_cv<T>::type, char>::value>::type> {
+    static const char letter = 'p';
+};
+
+template <typename... Args>
+struct DeferLogTypes {
+    static const char letters[sizeof...(Args) + 1];
+};
+template <typename... Args>
+const char DeferLogTypes<Args...>::letters[sizeof...(Args) + 1] = {
+    DeferLogType<typename std::decay<Args>::type>::letter..., 0};
+
+// Packs arguments; a value that no longer fits is left out (and the record
+// shortened), never written past the end
+struct DeferLogPacker {
+    uint8_t bytes[DEFERLOG_MAX_RECORD];
+    size_t length = 0;
+
+    void raw(const void* p, size_t n) {
+        if (length + n > sizeof(bytes)) return;
+        memcpy(bytes + length, p, n);
+        length += n;
+    }
+    void put(const char* s) {
+        if (length + 2 > sizeof(bytes)) return;
+        size_t n = 0;
+        while (s && n < (size_t)DEFERLOG_MAX_STRING && s[n]) n++;
+        if (n > sizeof(bytes) - length - 2) n = sizeof(bytes) - length - 2;
+        uint16_t len = n;
+        raw(&len, 2);
+        raw(s, n);
+    }
+    void put(char* s) { put((const char*)s); }
+    void put(float v) { raw(&v, 4); }
+    void put(double v) { raw(&v, 8); }
+    template <typename T>
+    typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value>::type put(T v) {
+        if (sizeof(T) > 4) {
+            uint64_t x = (uint64_t)v;
+            raw(&x, 8);
+        } else {
+            uint32_t x = std::is_signed<T>::value ? (uint32_t)(int32_t)v : (uint32_t)v;
+            raw(&x, 4);
+        }
+    }
+    template <typename T>
+    typename std::enable_if<!std::is_same<typename std::remove_cv<T>::type, char>::value>::type put(T* p) {
+        uint64_t x = (uint64_t)(uintptr_t)p;
+        raw(&x, 8);
+    }
+
+    void putAll() {}
+    template <typename First, typename... Rest>
+    void putAll(const First& first, const Rest&... rest) {
+        put(first);
+        putAll(rest...);
+    }
+};
+
+template <typename... Args>
+inline void deferLog(DeferLogSite& site, const Args&... args) {
+    if (!site.registered.load(std::memory_order_acquire)) {
+        deferLogRegister(site, DeferLogTypes<Args...>::letters);
+    }
+    DeferLogPacker packer;
+    packer.putAll(args...);
+    deferLogCommit(site, packer.bytes, packer.length);
+}
+
+// Never called; lets -Wformat check every DLOG format string
+inline void deferLogCheckFormat(const char* format, ...) __attribute__((format(printf, 1, 2)));
+inline void deferLogCheckFormat(const char*, ...) {}
+
+#define DLOG(module, lvl, format, ...)                                                          \
+    do {                                                                                        \
+        if ((uint8_t)(lvl) <= (module).level) {                                                 \
+            static DeferLogSite _dlogSite(&(module), (lvl), format, deferLogHash(format));      \
+            if (false) deferLogCheckFormat(format, ##__VA_ARGS__);                              \
+            deferLog(_dlogSite, ##__VA_ARGS__);                                                 \
+        }                                                                                       \
+    } while (0)
+
+#define DLOG_E(module, format, ...) DLOG(module, DLOG_ERROR, format, ##__VA_ARGS__)
+#define DLOG_W(module, format, ...) DLOG(module, DLOG_WARN, format, ##__VA_ARGS__)
+#define DLOG_I(module, format, ...) DLOG(module, DLOG_INFO, format, ##__VA_ARGS__)
+#define DLOG_D(module, format, ...) DLOG(module, DLOG_DEBUG, format, ##__VA_ARGS__)
+#define DLOG_V(module, format, ...) DLOG(module, DLOG_VERBOSE, format, ##__VA_ARGS__)
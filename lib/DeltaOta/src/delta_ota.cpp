@@ -0,0 +1,829 @@
+#include "delta_ota.h"
+
+#include <json_escape.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#ifdef ESP_PLATFORM
+#include <Preferences.h>
+#include <esp_ota_ops.h>
+#include <esp_partition.h>
+#endif
+
+static const uint8_t MIN_MATCH = 3;
+static const size_t WRITE_BYTES = 4096;         // a flash sector
+static const size_t MANIFEST_BYTES = 2048;
+static const size_t HASH_STEP_BYTES = 16384;    // running image hashed per step
+
+// ---- SHA-256 ----
+
+static const uint32_t SHA_K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static inline uint32_t rotr(uint32_t x, uint8_t n) {
+    return (x >> n) | (x << (32 - n));
+}
+
+static void shaBlock(uint32_t* state, const uint8_t* block) {
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++) {
+        w[i] = (uint32_t)block[4 * i] << 24 | (uint32_t)block[4 * i + 1] << 16 | (uint32_t)block[4 * i + 2] << 8 |
+               block[4 * i + 3];
+    }
+    for (int i = 16; i < 64; i++) {
+        uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+    for (int i = 0; i < 64; i++) {
+        uint32_t t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + SHA_K[i] + w[i];
+        uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+}
+
+void DeltaSha256::begin() {
+    static const uint32_t INITIAL[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                                        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+    memcpy(state, INITIAL, sizeof(state));
+    length = 0;
+    blockLength = 0;
+}
+
+void DeltaSha256::update(const uint8_t* data, size_t n) {
+    length += n;
+    if (blockLength) {
+        size_t take = 64 - (size_t)blockLength;
+        if (take > n) take = n;
+        memcpy(block + blockLength, data, take);
+        blockLength += take;
+        data += take;
+        n -= take;
+        if (blockLength < 64) return;
+        shaBlock(state, block);
+        blockLength = 0;
+    }
+    for (; n >= 64; data += 64, n -= 64) shaBlock(state, data);
+    memcpy(block, data, n);
+    blockLength = n;
+}
+
+void DeltaSha256::finish(uint8_t out[32]) {
+    uint64_t bits = length * 8;
+    block[blockLength++] = 0x80;
+    if (blockLength > 56) {
+        memset(block + blockLength, 0, 64 - blockLength);
+        shaBlock(state, block);
+        blockLength = 0;
+    }
+    memset(block + blockLength, 0, 56 - blockLength);
+    for (int i = 0; i < 8; i++) block[56 + i] = bits >> (56 - 8 * i);
+    shaBlock(state, block);
+    for (int i = 0; i < 32; i++) out[i] = state[i / 4] >> (24 - 8 * (i % 4));
+}
+
+static uint32_t readLe32(const uint8_t* p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static bool parseHex(const char* text, uint8_t* out, size_t bytes) {
+    for (size_t i = 0; i < 2 * bytes; i++) {
+        char c = text[i];
+        uint8_t v;
+        if (c >= '0' && c <= '9') v = c - '0';
+        else if (c >= 'a' && c <= 'f') v = c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F') v = c - 'A' + 10;
+        else return false;
+        out[i / 2] = (i % 2) ? (out[i / 2] | v) : (uint8_t)(v << 4);
+    }
+    return text[2 * bytes] == 0 || text[2 * bytes] == ' ';
+}
+
+// ---- Patch ----
+
+DeltaPatch::~DeltaPatch() {
+    free(_window);
+    free(_out);
+}
+
+void DeltaPatch::begin(DeltaReadOld readOld, DeltaWriteNew writeNew, void* user) {
+    free(_window);
+    free(_out);
+    *this = DeltaPatch();
+    _readOld = readOld;
+    _writeNew = writeNew;
+    _user = user;
+}
+
+size_t DeltaPatch::ramBytes() const {
+    return sizeof(*this) + (_window ? (size_t)_windowMask + 1 : 0) + (_out ? WRITE_BYTES : 0);
+}
+
+bool DeltaPatch::fail(const char* error) {
+    if (!_error) _error = error;
+    return false;
+}
+
+bool DeltaPatch::feed(const uint8_t* data, size_t length) {
+    if (_error) return false;
+    while (length && _headerLength < DELTA_OTA_HEADER_BYTES) {
+        _header[_headerLength++] = *data++;
+        length--;
+        if (_headerLength == DELTA_OTA_HEADER_BYTES && !readHeader()) return false;
+    }
+    // Whatever follows the last image byte is padding of the last LZSS byte
+    if (!length || _done) return true;
+    return decode(data, length);
+}
+
+bool DeltaPatch::readHeader() {
+    if (memcmp(_header, "M5DP", 4) != 0) return fail("not a patch");
+    if (_header[4] != DELTA_OTA_FORMAT) return fail("unknown patch format");
+    _windowBits = _header[5];
+    _lookaheadBits = _header[6];
+    if (_windowBits < 8 || _windowBits > 14 || _lookaheadBits < 3 || _lookaheadBits > 8 ||
+        _lookaheadBits >= _windowBits) {
+        return fail("bad LZSS parameters");
+    }
+    _oldSize = readLe32(_header + 8);
+    _newSize = readLe32(_header + 12);
+    if (_newSize == 0) return fail("empty image");
+
+    _window = (uint8_t*)calloc(1, (size_t)1 << _windowBits);
+    _out = (uint8_t*)malloc(WRITE_BYTES);
+    if (!_window || !_out) return fail("out of memory");
+    _windowMask = (1 << _windowBits) - 1;
+    _sha.begin();
+    return true;
+}
+
+// LZSS, MSB first: 1 and a literal byte, or 0, distance - 1 in windowBits
+// and length - MIN_MATCH in lookaheadBits. _bits holds the next _bitCount
+// bits at its top.
+bool DeltaPatch::decode(const uint8_t* data, size_t length) {
+    const uint8_t* end = data + length;
+    const uint8_t backrefBits = 1 + _windowBits + _lookaheadBits;
+    for (;;) {
+        while (_bitCount <= 24 && data < end) {
+            _bits |= (uint32_t)*data++ << (24 - _bitCount);
+            _bitCount += 8;
+        }
+        if (_bitCount == 0) return true;
+        if (_bits >> 31) {
+            if (_bitCount < 9) return true;
+            uint8_t byte = _bits >> 23;
+            _bits <<= 9;
+            _bitCount -= 9;
+            if (!emit(byte)) return false;
+        } else {
+            if (_bitCount < backrefBits) return true;
+            uint32_t distance = ((_bits << 1) >> (32 - _windowBits)) + 1;
+            uint32_t count = ((_bits << (1 + _windowBits)) >> (32 - _lookaheadBits)) + MIN_MATCH;
+            _bits <<= backrefBits;
+            _bitCount -= backrefBits;
+            for (uint32_t i = 0; i < count && !_done; i++) {
+                if (!emit(_window[(_windowHead - distance) & _windowMask])) return false;
+            }
+        }
+        if (_done) return true;
+    }
+}
+
+// One byte of the operation stream: an operation header (add, copy, seek as
+// little-endian 32-bit), or a byte of its add or copy run
+bool DeltaPatch::emit(uint8_t byte) {
+    _window[_windowHead & _windowMask] = byte;
+    _windowHead++;
+
+    if (_addLeft) {
+        if (_oldPos < _oldBufferPos || _oldPos >= _oldBufferPos + _oldBufferLength) {
+            if (_oldPos >= _oldSize) return fail("patch reads past the old image");
+            _oldBufferPos = _oldPos;
+            _oldBufferLength = _oldSize - _oldPos < sizeof(_oldBuffer) ? _oldSize - _oldPos : sizeof(_oldBuffer);
+            if (!_readOld(_oldBufferPos, _oldBuffer, _oldBufferLength, _user)) return fail("old image read failed");
+        }
+        uint8_t old = _oldBuffer[_oldPos++ - _oldBufferPos];
+        _addLeft--;
+        if (!_addLeft && !_copyLeft) _oldPos += _seek;
+        return output(old + byte);
+    }
+    if (_copyLeft) {
+        _copyLeft--;
+        if (!_copyLeft) _oldPos += _seek;
+        return output(byte);
+    }
+
+    _op[_opLength++] = byte;
+    if (_opLength < sizeof(_op)) return true;
+    _opLength = 0;
+    _addLeft = readLe32(_op);
+    _copyLeft = readLe32(_op + 4);
+    _seek = (int32_t)readLe32(_op + 8);
+    if ((uint64_t)_written + _addLeft + _copyLeft > _newSize) return fail("patch writes past the new image");
+    if (!_addLeft && !_copyLeft) _oldPos += _seek;
+    return true;
+}
+
+bool DeltaPatch::output(uint8_t byte) {
+    _out[_outLength++] = byte;
+    _written++;
+    if (_outLength == WRITE_BYTES && !flush()) return false;
+    if (_written < _newSize) return true;
+
+    if (!flush()) return false;
+    uint8_t sha[32];
+    _sha.finish(sha);
+    if (memcmp(sha, _header + 48, 32) != 0) return fail("new image hash mismatch");
+    _done = true;
+    return true;
+}
+
+bool DeltaPatch::flush() {
+    if (!_outLength) return true;
+    _sha.update(_out, _outLength);
+    bool ok = _writeNew(_out, _outLength, _user);
+    _outLength = 0;
+    return ok || fail("image write failed");
+}
+
+// ---- Partitions ----
+
+static uint8_t readySha[32];    // of the image made ready, for deltaOtaRestart()
+
+#ifdef ESP_PLATFORM
+static const esp_partition_t* targetPartition = nullptr;
+static esp_ota_handle_t targetHandle = 0;
+#else
+static const char* hostRunningPath = "running.bin";
+static const char* hostUpdatePath = "update.bin";
+static FILE* hostTarget = nullptr;
+
+void deltaOtaHostFiles(const char* runningPath, const char* updatePath) {
+    hostRunningPath = runningPath;
+    hostUpdatePath = updatePath;
+}
+#endif
+
+static uint32_t runningSize() {
+#ifdef ESP_PLATFORM
+    const esp_partition_t* running = esp_ota_get_running_partition();
+    return running ? running->size : 0;
+#else
+    FILE* f = fopen(hostRunningPath, "rb");
+    if (!f) return 0;
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fclose(f);
+    return size > 0 ? size : 0;
+#endif
+}
+
+static bool readRunning(uint32_t offset, uint8_t* out, size_t length, void*) {
+#ifdef ESP_PLATFORM
+    const esp_partition_t* running = esp_ota_get_running_partition();
+    return running && esp_partition_read(running, offset, out, length) == ESP_OK;
+#else
+    // Kept open only for the read; the host has no flash cache to worry about
+    FILE* f = fopen(hostRunningPath, "rb");
+    bool ok = f && fseek(f, offset, SEEK_SET) == 0 && fread(out, 1, length, f) == length;
+    if (f) fclose(f);
+    return ok;
+#endif
+}
+
+static bool targetBegin(uint32_t size) {
+#ifdef ESP_PLATFORM
+    targetPartition = esp_ota_get_next_update_partition(nullptr);
+    if (!targetPartition || size > targetPartition->size) return false;
+    // Sequential writes erase each sector as it is reached, instead of the
+    // whole partition up front (seconds with the loop stalled)
+    return esp_ota_begin(targetPartition, OTA_WITH_SEQUENTIAL_WRITES, &targetHandle) == ESP_OK;
+#else
+    (void)size;
+    hostTarget = fopen(hostUpdatePath, "wb");
+    return hostTarget != nullptr;
+#endif
+}
+
+static bool writeTarget(const uint8_t* data, size_t length, void*) {
+#ifdef ESP_PLATFORM
+    return esp_ota_write(targetHandle, data, length) == ESP_OK;
+#else
+    return fwrite(data, 1, length, hostTarget) == length;
+#endif
+}
+
+// Closes the new image; `keep` makes it the boot partition, otherwise it is
+// dropped
+static bool targetEnd(bool keep) {
+#ifdef ESP_PLATFORM
+    if (!keep) {
+        esp_ota_abort(targetHandle);
+        return false;
+    }
+    // esp_ota_end() also checks the image header and its own checksum
+    return esp_ota_end(targetHandle) == ESP_OK && esp_ota_set_boot_partition(targetPartition) == ESP_OK;
+#else
+    bool ok = fclose(hostTarget) == 0 && keep;
+    hostTarget = nullptr;
+    if (!ok) remove(hostUpdatePath);
+    return ok;
+#endif
+}
+
+// The image that failed its trial here, so the manifest that offered it is
+// not followed again
+static bool imageRejected(const uint8_t* sha) {
+#ifdef ESP_PLATFORM
+    Preferences prefs;
+    uint8_t rejected[32];
+    if (!prefs.begin("deltaota", true)) return false;
+    bool found = prefs.getBytes("rejected", rejected, sizeof(rejected)) == sizeof(rejected);
+    prefs.end();
+    return found && memcmp(rejected, sha, sizeof(rejected)) == 0;
+#else
+    (void)sha;
+    return false;
+#endif
+}
+
+// ---- Updater ----
+
+bool DeltaOta::check(const char* manifestUrl) {
+    if (active()) return false;
+    snprintf(_url, sizeof(_url), "%s", manifestUrl);
+    _version[0] = 0;
+    _error[0] = 0;
+    _stats = {};
+    _startMs = millis();
+    free(_manifest);
+    _manifest = (char*)malloc(MANIFEST_BYTES);
+    _manifestLength = 0;
+    if (!_manifest) {
+        fail("out of memory");
+        return true;
+    }
+    _state = DELTA_OTA_CHECKING;
+    if (!request(_url)) fail("%s: no connection", _url);
+    return true;
+}
+
+void DeltaOta::cancel() {
+    if (active()) fail("cancelled");
+}
+
+uint8_t DeltaOta::progress() const {
+    if (_state == DELTA_OTA_READY) return 100;
+    if (_state != DELTA_OTA_DOWNLOADING || !_imageSize) return 0;
+    return (uint64_t)_patch.written() * 100 / _imageSize;
+}
+
+size_t DeltaOta::statusJson(char* out, size_t size) const {
+    char text[96];
+    switch (_state) {
+        case DELTA_OTA_IDLE: snprintf(text, sizeof(text), "idle"); break;
+        case DELTA_OTA_CHECKING:
+        case DELTA_OTA_HASHING: snprintf(text, sizeof(text), "checking"); break;
+        case DELTA_OTA_DOWNLOADING: snprintf(text, sizeof(text), "updating to %s, %u%%", _version, progress()); break;
+        case DELTA_OTA_READY: snprintf(text, sizeof(text), "ready %s", _version); break;
+        case DELTA_OTA_UP_TO_DATE: snprintf(text, sizeof(text), "up to date %s", _version); break;
+        case DELTA_OTA_FAILED: snprintf(text, sizeof(text), "failed: %s", _error); break;
+    }
+    // The error can quote a URL or a file name from the manifest
+    char status[sizeof(text) * 2];
+    jsonEscape(status, sizeof(status), text);
+    return snprintf(out, size, "\"ota_status\":\"%s\"", status);
+}
+
+void DeltaOta::fail(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    vsnprintf(_error, sizeof(_error), format, args);
+    va_end(args);
+    finish(DELTA_OTA_FAILED);
+}
+
+void DeltaOta::finish(DeltaOtaState state) {
+    _client.stop();
+    if (_targetOpen) {
+        _targetOpen = false;
+        if (!targetEnd(state == DELTA_OTA_READY)) {
+            if (state == DELTA_OTA_READY) snprintf(_error, sizeof(_error), "new image rejected");
+            state = DELTA_OTA_FAILED;
+        }
+    }
+    if (state == DELTA_OTA_READY) memcpy(readySha, _imageSha, sizeof(readySha));
+    free(_manifest);
+    _manifest = nullptr;
+    _patch.begin(nullptr, nullptr, nullptr);    // frees the patch buffers
+    _state = state;
+}
+
+// GET over HTTP/1.0: the server closes the connection after the body, so
+// there is no chunked encoding to undo
+bool DeltaOta::request(const char* url) {
+    if (strncmp(url, "http://", 7) != 0) return false;
+    const char* host = url + 7;
+    const char* path = strchr(host, '/');
+    size_t hostLength = path ? (size_t)(path - host) : strlen(host);
+    if (!path) path = "/";
+    char hostName[64];
+    if (hostLength == 0 || hostLength >= sizeof(hostName)) return false;
+    memcpy(hostName, host, hostLength);
+    hostName[hostLength] = 0;
+    uint16_t port = 80;
+    char* colon = strchr(hostName, ':');
+    if (colon) {
+        *colon = 0;
+        port = atoi(colon + 1);
+    }
+
+    _client.stop();
+    _headersDone = false;
+    _lineLength = 0;
+    _status = 0;
+    _contentLength = -1;
+    _bodyRead = 0;
+    _lastDataMs = millis();
+    if (!_client.connect(hostName, port)) return false;
+    char request[256];
+    int n = snprintf(request, sizeof(request), "GET %s HTTP/1.0\r\nHost: %s\r\nConnection: close\r\n\r\n", path,
+                     hostName);
+    return n > 0 && (size_t)n < sizeof(request) && _client.write((const uint8_t*)request, n) == (size_t)n;
+}
+
+// Bytes of the response body: >0 read, 0 none yet, -1 at its end
+int DeltaOta::readBody(uint8_t* out, size_t size) {
+    while (!_headersDone) {
+        if (_client.available() <= 0) return _client.connected() ? 0 : -1;
+        uint8_t c;
+        if (_client.read(&c, 1) != 1) return 0;
+        _lastDataMs = millis();
+        if (c == '\r') continue;
+        if (c != '\n') {
+            if (_lineLength < sizeof(_line) - 1) _line[_lineLength++] = c;
+            continue;
+        }
+        _line[_lineLength] = 0;
+        if (_status == 0) {
+            if (sscanf(_line, "HTTP/%*s %d", &_status) != 1) _status = -1;
+        } else if (_lineLength == 0) {
+            _headersDone = true;
+        } else if (strncasecmp(_line, "Content-Length:", 15) == 0) {
+            _contentLength = atol(_line + 15);
+        }
+        _lineLength = 0;
+    }
+    if (_contentLength >= 0 && _bodyRead >= (uint32_t)_contentLength) return -1;
+    int available = _client.available();
+    if (available <= 0) return _client.connected() ? 0 : -1;
+    size_t want = (size_t)available < size ? available : size;
+    if (_contentLength >= 0 && want > _contentLength - _bodyRead) want = _contentLength - _bodyRead;
+    int n = _client.read(out, want);
+    if (n <= 0) return 0;
+    _bodyRead += n;
+    _lastDataMs = millis();
+    return n;
+}
+
+bool DeltaOta::parseManifest() {
+    _manifest[_manifestLength] = 0;
+    _imageSize = 0;
+    _entryCount = 0;
+    for (char* line = strtok(_manifest, "\n"); line; line = strtok(nullptr, "\n")) {
+        size_t n = strlen(line);
+        if (n && line[n - 1] == '\r') line[n - 1] = 0;
+        char sha[65];
+        unsigned long size, patchSize;
+        if (strncmp(line, "version ", 8) == 0) {
+            snprintf(_version, sizeof(_version), "%s", line + 8);
+        } else if (sscanf(line, "image %lu %64s", &size, sha) == 2) {
+            _imageSize = size;
+            if (!parseHex(sha, _imageSha, 32)) _imageSize = 0;
+        } else if (strncmp(line, "patch ", 6) == 0 && _entryCount < DELTA_OTA_MAX_PATCHES) {
+            Entry& e = _entries[_entryCount];
+            char file[sizeof(e.file)];
+            if (sscanf(line, "patch %lu %64s %lu %47s", &size, sha, &patchSize, file) != 4) continue;
+            e.fromSize = size;
+            e.patchSize = patchSize;
+            memcpy(e.file, file, sizeof(file));
+            if (size && !parseHex(sha, e.fromSha, 32)) continue;
+            _entryCount++;
+        }
+    }
+    if (!_imageSize || !_entryCount) {
+        fail("manifest: no image or patches");
+        return false;
+    }
+    if (imageRejected(_imageSha)) {
+        fail("%s was rolled back", _version);
+        return false;
+    }
+
+    // One pass over the running image, hashed up to each size in turn
+    uint32_t available = runningSize();
+    _hashSizeCount = 0;
+    auto addSize = [&](uint32_t size) {
+        if (!size || size > available) return;
+        for (uint8_t i = 0; i < _hashSizeCount; i++) {
+            if (_hashSizes[i] == size) return;
+        }
+        uint8_t i = _hashSizeCount++;
+        for (; i > 0 && _hashSizes[i - 1] > size; i--) _hashSizes[i] = _hashSizes[i - 1];
+        _hashSizes[i] = size;
+    };
+    addSize(_imageSize);
+    for (uint8_t i = 0; i < _entryCount; i++) addSize(_entries[i].fromSize);
+    _hashEntry = 0;
+    _hashOffset = 0;
+    _hashSha.begin();
+    _chosen = -1;
+    return true;
+}
+
+// Hashes the next stretch of the running image; false when done
+bool DeltaOta::hashStep() {
+    if (_hashEntry == _hashSizeCount) return false;
+    uint8_t buffer[512];
+    uint32_t stepEnd = _hashOffset + HASH_STEP_BYTES;
+    while (_hashOffset < stepEnd && _hashEntry < _hashSizeCount) {
+        uint32_t target = _hashSizes[_hashEntry];
+        size_t n = target - _hashOffset < sizeof(buffer) ? target - _hashOffset : sizeof(buffer);
+        if (!readRunning(_hashOffset, buffer, n, nullptr)) {
+            fail("running image read failed");
+            return false;
+        }
+        _hashSha.update(buffer, n);
+        _hashOffset += n;
+        if (_hashOffset == target) {
+            DeltaSha256 copy = _hashSha;
+            uint8_t sha[32];
+            copy.finish(sha);
+            matchHash(target, sha);
+            _hashEntry++;
+            if (_state != DELTA_OTA_HASHING) return false;
+        }
+    }
+    return _hashEntry < _hashSizeCount;
+}
+
+void DeltaOta::matchHash(uint32_t size, const uint8_t* sha) {
+    if (size == _imageSize && memcmp(sha, _imageSha, 32) == 0) {
+        _stats.checkMs = millis() - _startMs;
+        finish(DELTA_OTA_UP_TO_DATE);
+        return;
+    }
+    for (uint8_t i = 0; i < _entryCount && _chosen < 0; i++) {
+        if (_entries[i].fromSize == size && memcmp(sha, _entries[i].fromSha, 32) == 0) _chosen = i;
+    }
+}
+
+bool DeltaOta::startPatch() {
+    for (uint8_t i = 0; i < _entryCount && _chosen < 0; i++) {
+        if (_entries[i].fromSize == 0) _chosen = i;
+    }
+    if (_chosen < 0) {
+        fail("no patch for the running image");
+        return false;
+    }
+    const Entry& e = _entries[_chosen];
+    _stats.oldSize = e.fromSize;
+    _stats.checkMs = millis() - _startMs;
+    _startMs = millis();
+
+    // The patch file sits next to the manifest
+    char url[sizeof(_url) + sizeof(e.file)];
+    deltaOtaFileUrl(url, sizeof(url), _url, e.file);
+    free(_manifest);
+    _manifest = nullptr;
+    _patch.begin(readRunning, writeTarget, nullptr);
+    if (!request(url)) {
+        fail("%s: no connection", e.file);
+        return false;
+    }
+    _state = DELTA_OTA_DOWNLOADING;
+    return true;
+}
+
+size_t deltaOtaFileUrl(char* out, size_t size, const char* manifestUrl, const char* file) {
+    // The last '/' of the path, not the one of "//" before the host
+    const char* scheme = strstr(manifestUrl, "://");
+    const char* host = scheme ? scheme + 3 : manifestUrl;
+    const char* path = strchr(host, '/');
+    if (!path) return snprintf(out, size, "%s/%s", manifestUrl, file);
+    const char* slash = strrchr(path, '/');
+    return snprintf(out, size, "%.*s/%s", (int)(slash - manifestUrl), manifestUrl, file);
+}
+
+DeltaOtaState DeltaOta::poll(uint32_t budgetMs) {
+    uint32_t start = millis();
+    do {
+        switch (_state) {
+            case DELTA_OTA_CHECKING: {
+                int n = readBody((uint8_t*)_manifest + _manifestLength, MANIFEST_BYTES - 1 - _manifestLength);
+                if (_headersDone && _status != 200) {
+                    fail("manifest: HTTP %d", _status);
+                } else if (n > 0) {
+                    _manifestLength += n;
+                    if (_manifestLength == MANIFEST_BYTES - 1) fail("manifest: too long");
+                } else if (n < 0) {
+                    _client.stop();
+                    if (!_headersDone) fail("manifest: no response");
+                    else if (parseManifest()) _state = DELTA_OTA_HASHING;
+                } else if (millis() - _lastDataMs > DELTA_OTA_TIMEOUT_MS) {
+                    fail("manifest: timeout");
+                } else {
+                    return _state;
+                }
+                break;
+            }
+            case DELTA_OTA_HASHING:
+                if (!hashStep() && _state == DELTA_OTA_HASHING) startPatch();
+                break;
+            case DELTA_OTA_DOWNLOADING: {
+                uint8_t buffer[1024];
+                int n = readBody(buffer, sizeof(buffer));
+                if (_headersDone && _status != 200) {
+                    fail("patch: HTTP %d", _status);
+                    break;
+                }
+                if (n == 0) {
+                    if (millis() - _lastDataMs > DELTA_OTA_TIMEOUT_MS) fail("patch: timeout");
+                    else return _state;
+                    break;
+                }
+                if (n > 0) {
+                    // The header alone first: it is checked, and the
+                    // partition opened, before any image byte comes out
+                    size_t header = 0;
+                    if (!_patch.headerRead()) {
+                        header = DELTA_OTA_HEADER_BYTES - _stats.patchBytes;
+                        if (header > (size_t)n) header = n;
+                    }
+                    _stats.patchBytes += n;
+                    if (!_patch.feed(buffer, header)) {
+                        fail("patch: %s", _patch.error());
+                        break;
+                    }
+                    if (header && _patch.headerRead()) {
+                        const Entry& e = _entries[_chosen];
+                        if (_patch.newSize() != _imageSize || _patch.oldSize() != e.fromSize ||
+                            (e.fromSize && memcmp(_patch.oldSha(), e.fromSha, 32) != 0)) {
+                            fail("patch: not for this image");
+                            break;
+                        }
+                        if (!targetBegin(_imageSize)) {
+                            fail("patch: no partition to write");
+                            break;
+                        }
+                        _targetOpen = true;
+                    }
+                    if (!_patch.feed(buffer + header, n - header)) {
+                        fail("patch: %s", _patch.error());
+                        break;
+                    }
+                    size_t ram = _patch.ramBytes();
+                    if (ram > _stats.peakRam) _stats.peakRam = ram;
+                    _stats.imageBytes = _patch.written();
+                }
+                if (_patch.done()) {
+                    _stats.patchMs = millis() - _startMs;
+                    finish(DELTA_OTA_READY);
+                } else if (n < 0) {
+                    fail("patch: ended at %u of %u bytes", (unsigned)_patch.written(), (unsigned)_imageSize);
+                }
+                break;
+            }
+            default:
+                return _state;
+        }
+    } while (active() && millis() - start < budgetMs);
+    return _state;
+}
+
+// ---- Trial boots ----
+
+static bool onTrial = false;
+
+#ifdef ESP_PLATFORM
+// Forgets the trial; an image that failed it is kept as rejected
+static void endTrial(Preferences& prefs, bool failed) {
+    uint8_t sha[32];
+    bool known = failed && prefs.getBytes("image", sha, sizeof(sha)) == sizeof(sha);
+    prefs.remove("previous");
+    prefs.remove("boots");
+    prefs.remove("image");
+    if (known) prefs.putBytes("rejected", sha, sizeof(sha));
+}
+
+static void rollBack(const char* reason) {
+    Preferences prefs;
+    char label[17] = "";
+    if (prefs.begin("deltaota", false)) {
+        prefs.getString("previous", label, sizeof(label));
+        endTrial(prefs, true);
+        prefs.end();
+    }
+    const esp_partition_t* previous =
+        label[0] ? esp_partition_find_first(ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_ANY, label) : nullptr;
+    log_e("Rolling back to %s: %s", label, reason);
+    if (previous) esp_ota_set_boot_partition(previous);
+    ESP.restart();
+}
+#endif
+
+void deltaOtaBoot(Print& log) {
+#ifdef ESP_PLATFORM
+    Preferences prefs;
+    if (!prefs.begin("deltaota", false)) return;
+    if (!prefs.isKey("previous")) {
+        prefs.end();
+        return;
+    }
+    char label[17];
+    prefs.getString("previous", label, sizeof(label));
+    const esp_partition_t* running = esp_ota_get_running_partition();
+    if (running && strcmp(running->label, label) == 0) {
+        // The bootloader already went back (its own rollback)
+        endTrial(prefs, true);
+        prefs.end();
+        log.println("Firmware update was rolled back by the bootloader");
+        return;
+    }
+    uint8_t boots = prefs.getUChar("boots", 0) + 1;
+    prefs.putUChar("boots", boots);
+    prefs.end();
+    if (boots > DELTA_OTA_TRIAL_BOOTS) rollBack("did not come up");
+    onTrial = true;
+    log.printf("New firmware on trial, boot %u of %u\n", boots, DELTA_OTA_TRIAL_BOOTS);
+#else
+    (void)log;
+#endif
+}
+
+void deltaOtaConfirm() {
+    if (!onTrial) return;
+    onTrial = false;
+#ifdef ESP_PLATFORM
+    Preferences prefs;
+    if (prefs.begin("deltaota", false)) {
+        endTrial(prefs, false);
+        prefs.end();
+    }
+#ifdef CONFIG_APP_ROLLBACK_ENABLE
+    esp_ota_mark_app_valid_cancel_rollback();
+#endif
+#endif
+}
+
+bool deltaOtaOnTrial() {
+    return onTrial;
+}
+
+void deltaOtaCheckTrial() {
+#ifdef ESP_PLATFORM
+    if (onTrial && millis() > DELTA_OTA_TRIAL_MS) rollBack("not confirmed in time");
+#endif
+}
+
+void deltaOtaRestart() {
+#ifdef ESP_PLATFORM
+    Preferences prefs;
+    const esp_partition_t* running = esp_ota_get_running_partition();
+    if (running && prefs.begin("deltaota", false)) {
+        prefs.putString("previous", running->label);
+        prefs.putUChar("boots", 0);
+        prefs.putBytes("image", readySha, sizeof(readySha));
+        prefs.end();
+    }
+#endif
+    ESP.restart();
+}
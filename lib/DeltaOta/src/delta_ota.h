@@ -0,0 +1,256 @@
+#pragma once
+
+// Firmware updates as binary patches against the running image, fetched over
+// plain HTTP from a server on the LAN and applied while the device goes on
+// measuring; the only downtime is the restart into the new image.
+//
+//   WiFiClient otaClient;
+//   DeltaOta ota(otaClient);
+//   deltaOtaBoot(Serial);                       // setup(): rolls back a new image that failed
+//   ota.check("http://192.168.2.10:8000/coreink/manifest.txt");
+//   void loop() {
+//       if (ota.poll(30) == DELTA_OTA_READY) deltaOtaRestart();
+//       ... ota.progress() for the display ...
+//   }
+//   deltaOtaConfirm();                          // once the broker is reached
+//
+// tools/ota_delta makes the patches and the manifest from the old and the new
+// images; the manifest is text, one entry a line:
+//     version 1.4.0
+//     image <size> <sha256>                     the new image
+//     patch <from size> <from sha256> <patch size> <file>
+//     patch 0 - <patch size> <file>             the whole image, for any other
+// The device hashes the first <from size> bytes of its running partition and
+// takes the patch made from that image, else the whole-image one. <file> is
+// relative to the manifest.
+//
+// A patch is an 80-byte header (magic "M5DP", format, LZSS window and
+// lookahead bits, old and new size, old and new SHA-256) and then an LZSS
+// stream (heatshrink-style: a flag bit, then a literal byte or a window
+// offset and length) of bsdiff operations: add <x> bytes (old plus the
+// difference bytes that follow), copy the <y> bytes that follow, move the old
+// position by <seek>. A patch is applied as it arrives: the LZSS window, a
+// write buffer and a read buffer of the old image are all it keeps, about
+// 9 KB with the default 4 KB window, whatever the image size. The new image
+// is written straight to the other OTA partition (erased sector by sector as
+// it goes) and checked against its SHA-256 before it is made the boot
+// partition.
+//
+// Rollback: deltaOtaRestart() boots the new image on trial. deltaOtaConfirm()
+// keeps it; a trial image that resets DELTA_OTA_TRIAL_BOOTS times, or runs
+// DELTA_OTA_TRIAL_MS without being confirmed, is rolled back to the previous
+// partition (kept in NVS, so this holds whether or not the bootloader does
+// its own rollback). Firmwares on the Arduino core define
+// verifyRollbackLater() to return true, so the core leaves the image pending
+// until deltaOtaConfirm(). An image that was rolled back is not taken again
+// from the same manifest.
+//
+// On the host the running partition and the new one are files (see
+// deltaOtaHostFiles()), for tools/ota_delta. Only http:// URLs; the images
+// are checked by hash, not by who served them.
+
+#include <Arduino.h>
+
+const uint8_t DELTA_OTA_FORMAT = 1;
+const size_t DELTA_OTA_HEADER_BYTES = 80;
+const uint8_t DELTA_OTA_TRIAL_BOOTS = 3;
+const uint32_t DELTA_OTA_TRIAL_MS = 300000;
+const uint32_t DELTA_OTA_TIMEOUT_MS = 15000;    // no data from the server
+const uint8_t DELTA_OTA_MAX_PATCHES = 8;        // manifest entries looked at
+
+enum DeltaOtaState : uint8_t {
+    DELTA_OTA_IDLE,
+    DELTA_OTA_CHECKING,     // reading the manifest
+    DELTA_OTA_HASHING,      // the running image, to pick a patch
+    DELTA_OTA_DOWNLOADING,  // and patching
+    DELTA_OTA_READY,        // new image in the boot partition; restart to run it
+    DELTA_OTA_UP_TO_DATE,
+    DELTA_OTA_FAILED,       // error() says why; the running image is untouched
+};
+
+struct DeltaOtaStats {
+    uint32_t patchBytes;    // downloaded
+    uint32_t imageBytes;    // written
+    uint32_t oldSize;       // 0 for a whole-image patch
+    uint32_t checkMs;       // manifest and hashing
+    uint32_t patchMs;       // download, patch, verify
+    uint32_t peakRam;       // buffers held while patching
+};
+
+// SHA-256, for the images and the manifest (tools/ota_delta hashes with it
+// too)
+struct DeltaSha256 {
+    void begin();
+    void update(const uint8_t* data, size_t length);
+    void finish(uint8_t out[32]);
+
+    uint32_t state[8];
+    uint64_t length;
+    uint8_t block[64];
+    uint8_t blockLength;
+};
+
+// The patch format on its own: bytes in, image bytes out. Old bytes are read
+// and new ones written through the callbacks; `user` goes back to them.
+typedef bool (*DeltaReadOld)(uint32_t offset, uint8_t* out, size_t length, void* user);
+typedef bool (*DeltaWriteNew)(const uint8_t* data, size_t length, void* user);
+
+class DeltaPatch {
+public:
+    ~DeltaPatch();
+
+    void begin(DeltaReadOld readOld, DeltaWriteNew writeNew, void* user);
+    // Takes the next bytes of the patch; false on an error (error() says
+    // which). The header is checked as soon as it is in.
+    bool feed(const uint8_t* data, size_t length);
+    // True once the whole new image is out and matched its SHA-256
+    bool done() const { return _done; }
+    bool headerRead() const { return _headerLength == DELTA_OTA_HEADER_BYTES; }
+    uint32_t oldSize() const { return _oldSize; }
+    uint32_t newSize() const { return _newSize; }
+    const uint8_t* oldSha() const { return _header + 16; }
+    uint32_t written() const { return _written; }
+    size_t ramBytes() const;
+    const char* error() const { return _error; }
+
+private:
+    bool fail(const char* error);
+    bool readHeader();
+    bool decode(const uint8_t* data, size_t length);
+    bool emit(uint8_t byte);
+    bool output(uint8_t byte);
+    bool flush();
+
+    DeltaReadOld _readOld = nullptr;
+    DeltaWriteNew _writeNew = nullptr;
+    void* _user = nullptr;
+    uint8_t _header[DELTA_OTA_HEADER_BYTES];
+    size_t _headerLength = 0;
+    uint32_t _oldSize = 0;
+    uint32_t _newSize = 0;
+    uint32_t _written = 0;
+    bool _done = false;
+    const char* _error = nullptr;
+
+    // LZSS
+    uint8_t* _window = nullptr;
+    uint16_t _windowMask = 0;
+    uint16_t _windowHead = 0;
+    uint8_t _windowBits = 0;
+    uint8_t _lookaheadBits = 0;
+    uint32_t _bits = 0;
+    uint8_t _bitCount = 0;
+
+    // bsdiff operations
+    uint8_t _op[12];
+    uint8_t _opLength = 0;
+    uint32_t _addLeft = 0;
+    uint32_t _copyLeft = 0;
+    int32_t _seek = 0;
+    uint32_t _oldPos = 0;
+    uint8_t _oldBuffer[256];
+    uint32_t _oldBufferPos = 0;
+    uint16_t _oldBufferLength = 0;
+
+    uint8_t* _out = nullptr;
+    uint16_t _outLength = 0;
+    DeltaSha256 _sha;
+};
+
+// Checks a manifest, picks a patch, downloads and applies it, step by step
+// from loop()
+class DeltaOta {
+public:
+    explicit DeltaOta(Client& client) : _client(client) {}
+
+    // Starts a check; false when one is already going on
+    bool check(const char* manifestUrl);
+    // Works for up to `budgetMs` (flash writes can take longer) and returns
+    // the state
+    DeltaOtaState poll(uint32_t budgetMs);
+    void cancel();
+
+    DeltaOtaState state() const { return _state; }
+    bool active() const { return _state >= DELTA_OTA_CHECKING && _state <= DELTA_OTA_DOWNLOADING; }
+    // 0..100 while downloading
+    uint8_t progress() const;
+    const char* version() const { return _version; }
+    const char* error() const { return _error; }
+    const DeltaOtaStats& stats() const { return _stats; }
+    // "ota_status":"ready 1.4.0" (no braces, to go into an object)
+    size_t statusJson(char* out, size_t size) const;
+
+private:
+    struct Entry {
+        uint32_t fromSize;
+        uint8_t fromSha[32];
+        uint32_t patchSize;
+        char file[48];
+    };
+
+    bool request(const char* url);
+    int readBody(uint8_t* out, size_t size);
+    bool parseManifest();
+    bool hashStep();
+    void matchHash(uint32_t size, const uint8_t* sha);
+    bool startPatch();
+    void fail(const char* format, ...);
+    void finish(DeltaOtaState state);
+
+    Client& _client;
+    DeltaOtaState _state = DELTA_OTA_IDLE;
+    char _url[128] = "";
+    char _version[24] = "";
+    char _error[64] = "";
+    DeltaOtaStats _stats = {};
+    uint32_t _startMs = 0;
+    uint32_t _lastDataMs = 0;
+
+    // HTTP response
+    bool _headersDone = false;
+    char _line[128];
+    uint8_t _lineLength = 0;
+    int _status = 0;
+    int32_t _contentLength = -1;
+    uint32_t _bodyRead = 0;
+
+    // Manifest
+    char* _manifest = nullptr;
+    size_t _manifestLength = 0;
+    uint32_t _imageSize = 0;
+    uint8_t _imageSha[32];
+    Entry _entries[DELTA_OTA_MAX_PATCHES];
+    uint8_t _entryCount = 0;
+
+    // Hashing the running image once, ascending: the hash at each entry's
+    // size and at the new image's
+    uint8_t _hashEntry = 0;         // next of _hashSizes
+    uint32_t _hashSizes[DELTA_OTA_MAX_PATCHES + 1];
+    uint8_t _hashSizeCount = 0;
+    uint32_t _hashOffset = 0;
+    DeltaSha256 _hashSha;
+    int _chosen = -1;
+
+    DeltaPatch _patch;
+    bool _targetOpen = false;
+};
+
+// setup(): counts a boot of an image on trial and rolls back to the previous
+// one (restarting) when it has had its DELTA_OTA_TRIAL_BOOTS
+void deltaOtaBoot(Print& log);
+// The image on trial works (call once the broker is reached); no-op otherwise
+void deltaOtaConfirm();
+bool deltaOtaOnTrial();
+// Rolls an image on trial back when DELTA_OTA_TRIAL_MS passed unconfirmed;
+// from loop()
+void deltaOtaCheckTrial();
+// Restarts into the image DeltaOta made ready, on trial
+void deltaOtaRestart();
+
+// Host: the running image and the file the new one goes to
+void deltaOtaHostFiles(const char* runningPath, const char* updatePath);
+
+// The URL of `file` next to the manifest: http://host/fw/manifest.txt gives
+// http://host/fw/<file>, and http://host:8000 (no path) http://host:8000/<file>.
+// The return value is snprintf's.
+size_t deltaOtaFileUrl(char* out, size_t size, const char* manifestUrl, const char* file);
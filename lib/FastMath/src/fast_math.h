@@ -0,0 +1,330 @@
+#pragma once
+
+// Fast replacements for the libm calls in per-pixel and per-vertex loops.
+//
+// Most of the cost in the demos is not the function itself but the type: an
+// expression such as sin(x * 0.1 + t) or sqrt(dx*dx + dy*dy) is evaluated in
+// double, and the ESP32-P4 FPU is single precision only, so every such call
+// runs a software double routine. Everything here stays in float or in integers.
+//
+// Float functions are single-precision polynomials (Cephes-style range reduction
+// and coefficients) with no errno handling and no NaN/Inf special cases. Integer
+// variants work on binary angles (65536 per turn, like lib/PolarRaster) and Q15
+// fixed point, from tables that are generated at compile time.
+//
+// Every function documents its maximum error as a constant next to it. The
+// bounds are measured (and enforced) by m5tab5/fast_math_bench, which sweeps each
+// function against libm in double on the host and on the device.
+//
+// Needs C++17 (inline constexpr tables).
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+namespace fast_math_detail {
+
+constexpr float PI_F = 3.14159265358979f;
+constexpr float HALF_PI_F = 1.57079632679490f;
+constexpr float QUARTER_PI_F = 0.78539816339745f;
+constexpr float TWO_OVER_PI_F = 0.63661977236758f;
+constexpr float LOG2E_F = 1.44269504088896f;
+constexpr float LN2_F = 0.69314718055995f;
+
+// pi/2 split in three parts so x - k * pi/2 stays exact for moderate k
+constexpr float PIO2_1 = 1.5703125f;
+constexpr float PIO2_2 = 4.837512969970703125e-4f;
+constexpr float PIO2_3 = 7.54978995489188216e-8f;
+
+inline uint32_t floatBits(float f) { uint32_t u; memcpy(&u, &f, 4); return u; }
+inline float bitsFloat(uint32_t u) { float f; memcpy(&f, &u, 4); return f; }
+
+// Round to nearest without calling into libm (floorf/roundf are library calls on some targets)
+inline int32_t roundToInt(float x) { return (int32_t)(x >= 0 ? x + 0.5f : x - 0.5f); }
+
+// sin and cos on [-pi/4, pi/4]
+inline float sinPoly(float r) {
+    float z = r * r;
+    return ((-1.9515295891e-4f * z + 8.3321608736e-3f) * z - 1.6666654611e-1f) * z * r + r;
+}
+
+inline float cosPoly(float r) {
+    float z = r * r;
+    return ((2.443315711809948e-5f * z - 1.388731625493765e-3f) * z + 4.166664568298827e-2f) * z * z - 0.5f * z + 1.0f;
+}
+
+// Quadrant (0..3) and remainder in [-pi/4, pi/4]
+inline float reduceQuadrant(float x, int32_t& quadrant) {
+    int32_t k = roundToInt(x * TWO_OVER_PI_F);
+    float kf = (float)k;
+    quadrant = k & 3;
+    return ((x - kf * PIO2_1) - kf * PIO2_2) - kf * PIO2_3;
+}
+
+// Compile-time helpers (double, only evaluated while building the tables)
+constexpr double ctSin(double x) {
+    // x in [0, 2*pi]: fold to [0, pi/2], then Taylor to x^21 (error < 1e-15)
+    double sign = 1;
+    if (x > 3.14159265358979323846) { x -= 3.14159265358979323846; sign = -1; }
+    if (x > 1.57079632679489661923) x = 3.14159265358979323846 - x;
+    double term = x, sum = x;
+    for (int n = 1; n <= 10; n++) {
+        term *= -x * x / ((2 * n) * (2 * n + 1));
+        sum += term;
+    }
+    return sign * sum;
+}
+
+constexpr double ctAtan(double x) {
+    // Euler's series, converges geometrically for x in [0, 1]
+    double k = x * x / (1 + x * x);
+    double term = x / (1 + x * x), sum = term;
+    for (int n = 1; n < 64; n++) {
+        term *= k * (2 * n) / (2 * n + 1);
+        sum += term;
+    }
+    return sum;
+}
+
+constexpr int32_t ctRound(double x) { return (int32_t)(x >= 0 ? x + 0.5 : x - 0.5); }
+
+// 256 steps per turn plus a guard entry for interpolation, in Q15
+struct SineTable { int16_t v[257]; };
+constexpr SineTable makeSineTable() {
+    SineTable t{};
+    for (int i = 0; i <= 256; i++) t.v[i] = (int16_t)ctRound(ctSin(i * (6.28318530717958647692 / 256)) * 32767);
+    return t;
+}
+inline constexpr SineTable SINE_TABLE = makeSineTable();
+
+// atan(i / 256) for i = 0..256, in binary angle units (8192 = 45 degrees)
+struct AtanTable { uint16_t v[257]; };
+constexpr AtanTable makeAtanTable() {
+    AtanTable t{};
+    for (int i = 0; i <= 256; i++) t.v[i] = (uint16_t)ctRound(ctAtan(i / 256.0) * (32768 / 3.14159265358979323846));
+    return t;
+}
+inline constexpr AtanTable ATAN_TABLE = makeAtanTable();
+
+}  // namespace fast_math_detail
+
+// ---------------------------------------------------------------------------
+// Float trigonometry
+
+// Max absolute error 2e-7 for |x| <= 1000 (grows slowly with |x| beyond that)
+const float FAST_SIN_MAX_ERROR = 2e-7f;
+
+inline float fastSin(float x) {
+    using namespace fast_math_detail;
+    int32_t q;
+    float r = reduceQuadrant(x, q);
+    switch (q) {
+        case 0: return sinPoly(r);
+        case 1: return cosPoly(r);
+        case 2: return -sinPoly(r);
+        default: return -cosPoly(r);
+    }
+}
+
+inline float fastCos(float x) {
+    using namespace fast_math_detail;
+    int32_t q;
+    float r = reduceQuadrant(x, q);
+    switch (q) {
+        case 0: return cosPoly(r);
+        case 1: return -sinPoly(r);
+        case 2: return -cosPoly(r);
+        default: return sinPoly(r);
+    }
+}
+
+// Both at once for rotations: one range reduction instead of two
+inline void fastSinCos(float x, float& s, float& c) {
+    using namespace fast_math_detail;
+    int32_t q;
+    float r = reduceQuadrant(x, q);
+    float sp = sinPoly(r);
+    float cp = cosPoly(r);
+    switch (q) {
+        case 0: s = sp; c = cp; break;
+        case 1: s = cp; c = -sp; break;
+        case 2: s = -sp; c = -cp; break;
+        default: s = -cp; c = sp; break;
+    }
+}
+
+// Max absolute error 3e-7 rad; fastAtan2(0, 0) returns 0
+const float FAST_ATAN_MAX_ERROR = 3e-7f;
+
+inline float fastAtan(float x) {
+    using namespace fast_math_detail;
+    float sign = 1;
+    if (x < 0) { x = -x; sign = -1; }
+    float y = 0;
+    if (x > 2.414213562373095f) {
+        y = HALF_PI_F;
+        x = -1.0f / x;
+    } else if (x > 0.4142135623730950f) {
+        y = QUARTER_PI_F;
+        x = (x - 1.0f) / (x + 1.0f);
+    }
+    float z = x * x;
+    y += (((8.05374449538e-2f * z - 1.38776856032e-1f) * z + 1.99777106478e-1f) * z - 3.33329491539e-1f) * z * x + x;
+    return sign * y;
+}
+
+inline float fastAtan2(float y, float x) {
+    using namespace fast_math_detail;
+    float ax = fabsf(x), ay = fabsf(y);
+    if (ax == 0 && ay == 0) return 0;
+    // Keep the argument in [0, 1] so the fold is exact
+    float r = ay <= ax ? fastAtan(ay / ax) : HALF_PI_F - fastAtan(ax / ay);
+    if (x < 0) r = PI_F - r;
+    return y < 0 ? -r : r;
+}
+
+// ---------------------------------------------------------------------------
+// Square roots
+
+// sqrtf is a single instruction on the P4 and on every host; the gain over the
+// demos' sqrt(int) is staying in float. Exact (correctly rounded); 0 for x <= 0.
+inline float fastSqrt(float x) {
+    return x > 0 ? __builtin_sqrtf(x) : 0.0f;
+}
+
+// Max relative error 5e-6 (bit-trick estimate plus two Newton steps), for
+// normalising vectors without a divide; x must be positive
+const float FAST_INV_SQRT_MAX_REL_ERROR = 5e-6f;
+
+inline float fastInvSqrt(float x) {
+    using namespace fast_math_detail;
+    float y = bitsFloat(0x5f375a86 - (floatBits(x) >> 1));
+    float half = 0.5f * x;
+    y = y * (1.5f - half * y * y);
+    y = y * (1.5f - half * y * y);
+    return y;
+}
+
+// Exact floor(sqrt(n))
+inline uint32_t isqrt(uint32_t n) {
+    uint32_t root = 0;
+    uint32_t bit = 1UL << 30;
+    while (bit > n) bit >>= 2;
+    while (bit) {
+        if (n >= root + bit) {
+            n -= root + bit;
+            root = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return root;
+}
+
+// ---------------------------------------------------------------------------
+// Exponentials and logarithms
+
+// Max relative error 3e-7 for x in [-125, 127]; clamps outside (no Inf/denormals)
+const float FAST_EXP_MAX_REL_ERROR = 3e-7f;
+
+inline float fastExp2(float x) {
+    using namespace fast_math_detail;
+    if (x < -125.0f) x = -125.0f;
+    if (x > 127.0f) x = 127.0f;
+    int32_t i = roundToInt(x);
+    float f = x - (float)i;   // [-0.5, 0.5]
+    float p = (((((1.535336188319500e-4f * f + 1.339887440266574e-3f) * f + 9.618437357674640e-3f) * f +
+                 5.550332471162809e-2f) * f + 2.402264791363012e-1f) * f + 6.931472028550421e-1f) * f + 1.0f;
+    return bitsFloat(floatBits(p) + ((uint32_t)i << 23));
+}
+
+// Relative error grows with |x| (x * log2(e) is rounded to float first): 5e-6 for |x| <= 80
+const float FAST_EXP_E_MAX_REL_ERROR = 5e-6f;
+
+inline float fastExp(float x) {
+    return fastExp2(x * fast_math_detail::LOG2E_F);
+}
+
+// Max absolute error 4e-6 for positive normal x, which is the float rounding of
+// results near +-127; returns -127 for x <= 0
+const float FAST_LOG2_MAX_ERROR = 4e-6f;
+
+inline float fastLog2(float x) {
+    using namespace fast_math_detail;
+    if (!(x > 0)) return -127.0f;
+    uint32_t bits = floatBits(x);
+    int32_t e = (int32_t)((bits >> 23) & 0xFF) - 127;
+    float m = bitsFloat((bits & 0x007FFFFF) | 0x3F800000);   // [1, 2)
+    // Centre the mantissa on 1 so the series argument stays in [-0.29, 0.41]
+    if (m > 1.41421356f) {
+        m *= 0.5f;
+        e++;
+    }
+    float t = m - 1.0f;
+    float z = t * t;
+    float y = ((((((((7.0376836292e-2f * t - 1.1514610310e-1f) * t + 1.1676998740e-1f) * t -
+                    1.2420140846e-1f) * t + 1.4249322787e-1f) * t - 1.6668057665e-1f) * t +
+                 2.0000714765e-1f) * t - 2.4999993993e-1f) * t + 3.3333331174e-1f) * t * z;
+    float ln = t - 0.5f * z + y;
+    return (float)e + ln * LOG2E_F;
+}
+
+inline float fastLog(float x) {
+    return fastLog2(x) * fast_math_detail::LN2_F;
+}
+
+// pow(a, b) = 2^(b * log2 a) for a > 0 (0 for a <= 0). The relative error is
+// about |b * log2 a| * 2e-7 + 3e-7, e.g. 1e-6 for the easing curves' 2^(10 t)
+inline float fastPow(float a, float b) {
+    if (!(a > 0)) return 0.0f;
+    return fastExp2(b * fastLog2(a));
+}
+
+// ---------------------------------------------------------------------------
+// Integer angles and Q15 fixed point
+
+// Binary angle (65536 per turn) -> Q15, from a 256-entry table with linear
+// interpolation. Max error 4 LSB (1.2e-4).
+const int FAST_ISIN_MAX_ERROR_LSB = 4;
+
+inline int16_t isin(uint16_t angle) {
+    const int16_t* t = fast_math_detail::SINE_TABLE.v;
+    int index = angle >> 8;
+    int frac = angle & 0xFF;
+    int s0 = t[index];
+    return (int16_t)(s0 + (((t[index + 1] - s0) * frac) >> 8));
+}
+
+inline int16_t icos(uint16_t angle) {
+    return isin(angle + 16384);
+}
+
+// Binary angle of (x, y): 0 = +x, 16384 = +y. Integer only; max error 2 units
+// (0.011 degrees). iatan2(0, 0) returns 0.
+const int FAST_IATAN2_MAX_ERROR = 2;
+
+inline uint16_t iatan2(int32_t y, int32_t x) {
+    uint32_t ax = x < 0 ? -(uint32_t)x : x;
+    uint32_t ay = y < 0 ? -(uint32_t)y : y;
+    if (ax == 0 && ay == 0) return 0;
+
+    // Octant fold: ratio = min/max in 1/65536, then the first-octant angle
+    bool steep = ay > ax;
+    uint32_t lo = steep ? ax : ay;
+    uint32_t hi = steep ? ay : ax;
+    uint32_t ratio = (uint32_t)(((uint64_t)lo << 16) / hi);
+    uint32_t index = ratio >> 8;
+    uint32_t frac = ratio & 0xFF;
+    const uint16_t* t = fast_math_detail::ATAN_TABLE.v;
+    uint32_t a = index >= 256 ? t[256] : t[index] + (((t[index + 1] - t[index]) * frac + 128) >> 8);
+
+    if (steep) a = 16384 - a;
+    if (x < 0) a = 32768 - a;
+    return (uint16_t)(y < 0 ? 65536 - a : a);
+}
+
+// Q15 multiply with rounding
+inline int16_t q15Mul(int16_t a, int16_t b) {
+    return (int16_t)(((int32_t)a * b + (1 << 14)) >> 15);
+}
@@ -0,0 +1,111 @@
+#include "ha_device.h"
+
+#include <ArduinoJson.h>
+
+const HaEntity HA_SCD40_ENTITIES[3] = {
+    {"temperature", "Temperature", "temperature", "°C", "state", "{{ value_json.temperature }}", false, nullptr, nullptr},
+    {"humidity", "Humidity", "humidity", "%", "state", "{{ value_json.humidity }}", false, nullptr, nullptr},
+    {"co2", "CO2", "carbon_dioxide", "ppm", "state", "{{ value_json.co2 }}", false, nullptr, nullptr},
+};
+
+const HaEntity HA_LOOP_STALLS_ENTITY = {
+    "loop_stalls", "Loop stalls", nullptr, nullptr, "diagnostics", "{{ value_json.stalls }}", true,
+    "total_increasing", nullptr,
+};
+
+const HaEntity HA_STATS_ENTITIES[6] = {
+    {"temperature_5m", "Temperature (5 min)", "temperature", "°C", "stats/5m", "{{ value_json.temperature.mean }}",
+     false, "measurement", "{{ value_json.temperature | tojson }}"},
+    {"humidity_5m", "Humidity (5 min)", "humidity", "%", "stats/5m", "{{ value_json.humidity.mean }}", false,
+     "measurement", "{{ value_json.humidity | tojson }}"},
+    {"co2_5m", "CO2 (5 min)", "carbon_dioxide", "ppm", "stats/5m", "{{ value_json.co2.mean }}", false,
+     "measurement", "{{ value_json.co2 | tojson }}"},
+    {"temperature_1h", "Temperature (hourly)", "temperature", "°C", "stats/1h", "{{ value_json.temperature.mean }}",
+     false, "measurement", "{{ value_json.temperature | tojson }}"},
+    {"humidity_1h", "Humidity (hourly)", "humidity", "%", "stats/1h", "{{ value_json.humidity.mean }}", false,
+     "measurement", "{{ value_json.humidity | tojson }}"},
+    {"co2_1h", "CO2 (hourly)", "carbon_dioxide", "ppm", "stats/1h", "{{ value_json.co2.mean }}", false,
+     "measurement", "{{ value_json.co2 | tojson }}"},
+};
+
+const HaEntity HA_AIR_ENTITIES[3] = {
+    {"co2_trend", "CO2 trend", nullptr, "ppm/h", "air", "{{ value_json.co2_trend }}", false, "measurement", nullptr},
+    {"air_changes", "Air changes", nullptr, "1/h", "air", "{{ value_json.air_changes }}", false, "measurement",
+     "{{ {'decays': value_json.decays} | tojson }}"},
+    {"occupancy", "Occupancy", nullptr, "people", "air", "{{ value_json.occupancy }}", false, "measurement", nullptr},
+};
+
+size_t haTopic(char* out, size_t size, const HaDevice& device, const char* level) {
+    return snprintf(out, size, "homeassistant/sensor/%s/%s", device.id, level);
+}
+
+size_t haConfigTopic(char* out, size_t size, const HaDevice& device, const HaEntity& entity) {
+    return snprintf(out, size, "homeassistant/sensor/%s_%s/config", device.id, entity.key);
+}
+
+// The keys in the order the firmwares have always sent them
+size_t haConfigPayload(char* out, size_t size, const HaDevice& device, const HaEntity& entity) {
+    char stateTopic[100];
+    char availTopic[100];
+    char uniqueId[80];
+    haTopic(stateTopic, sizeof(stateTopic), device, entity.topic);
+    haTopic(availTopic, sizeof(availTopic), device, "availability");
+    snprintf(uniqueId, sizeof(uniqueId), "%s_%s", device.id, entity.key);
+
+    JsonDocument doc;
+    doc["name"] = entity.name;
+    if (entity.diagnostic) doc["entity_category"] = "diagnostic";
+    if (entity.stateClass) doc["state_class"] = entity.stateClass;
+    if (entity.deviceClass) doc["device_class"] = entity.deviceClass;
+    if (entity.unit) doc["unit_of_measurement"] = entity.unit;
+    doc["state_topic"] = stateTopic;
+    doc["availability_topic"] = availTopic;
+    doc["value_template"] = entity.valueTemplate;
+    if (entity.diagnostic || entity.attributes) doc["json_attributes_topic"] = stateTopic;
+    if (entity.attributes) doc["json_attributes_template"] = entity.attributes;
+    doc["unique_id"] = uniqueId;
+
+    JsonObject info = doc["device"].to<JsonObject>();
+    info["identifiers"][0] = device.id;
+    info["name"] = device.name;
+    info["model"] = device.model;
+    info["manufacturer"] = "M5Stack";
+    return serializeJson(doc, out, size);
+}
+
+size_t haStatePayload(char* out, size_t size, float temperature, float humidity, uint16_t co2) {
+    JsonDocument doc;
+    doc["temperature"] = temperature;
+    doc["humidity"] = round(humidity);
+    doc["co2"] = co2;
+    return serializeJson(doc, out, size);
+}
+
+// A number after "key": anywhere in the object; the payloads are small and
+// flat, so a scan is cheaper than a JsonDocument per message
+static bool stateNumber(const char* text, const char* key, float& value) {
+    char quoted[24];
+    snprintf(quoted, sizeof(quoted), "\"%s\"", key);
+    const char* at = strstr(text, quoted);
+    if (!at) return false;
+    at += strlen(quoted);
+    while (*at == ' ') at++;
+    if (*at++ != ':') return false;
+    char* end;
+    value = strtof(at, &end);
+    return end != at;
+}
+
+bool haParseState(const uint8_t* payload, size_t length, float& temperature, float& humidity, uint16_t& co2) {
+    char text[160];
+    if (length >= sizeof(text)) return false;
+    memcpy(text, payload, length);
+    text[length] = 0;
+    float co2Value;
+    if (!stateNumber(text, "temperature", temperature) || !stateNumber(text, "humidity", humidity) ||
+        !stateNumber(text, "co2", co2Value) || co2Value < 0 || co2Value > 65535) {
+        return false;
+    }
+    co2 = (uint16_t)co2Value;
+    return true;
+}
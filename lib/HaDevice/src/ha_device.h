@@ -0,0 +1,90 @@
+#pragma once
+
+// The MQTT side of the 1_temp_hum monitors as Home Assistant sees it: topics,
+// discovery configs, the state payload and the connect with its will. The
+// three firmwares and tools/fleet_sim build their messages here, so a
+// simulated fleet sends byte for byte what the boards send.
+//
+//   const HaDevice haDevice = {device_id, device_name, "M5CoreInk"};
+//
+//   haConnect(mqttClient, haDevice, clientId, mqtt_user, mqtt_password);
+//   for (const HaEntity& entity : HA_SCD40_ENTITIES) {
+//       haConfigTopic(topic, sizeof(topic), haDevice, entity);
+//       haConfigPayload(payload, sizeof(payload), haDevice, entity);
+//       mqttClient.publish(topic, payload, true);
+//   }
+//   haStatePayload(payload, sizeof(payload), temperature, humidity, co2);
+//
+// Everything is under homeassistant/sensor/<device_id>/: "state" for the
+// readings, "stats/5m" and "stats/1h" for their statistics per window, "air"
+// for what the CO2 says about the room, "availability" for online/offline (the will), and a config topic
+// homeassistant/sensor/<device_id>_<key>/config per entity.
+
+#include <Arduino.h>
+
+struct HaDevice {
+    const char* id;         // device_id: topics, unique ids
+    const char* name;       // shown in Home Assistant
+    const char* model;
+};
+
+struct HaEntity {
+    const char* key;                // unique id and config topic suffix
+    const char* name;
+    const char* deviceClass;        // nullptr for none
+    const char* unit;               // nullptr for none
+    const char* topic;              // state topic level under the device
+    const char* valueTemplate;
+    bool diagnostic;                // a diagnostic with its topic as attributes
+    const char* stateClass;         // nullptr for none
+    const char* attributes;         // json_attributes_template from its topic; nullptr for none
+};
+
+// temperature, humidity, co2 from the "state" topic
+extern const HaEntity HA_SCD40_ENTITIES[3];
+// Loop stalls from the "diagnostics" topic (lib/LoopWatch)
+extern const HaEntity HA_LOOP_STALLS_ENTITY;
+// The means of temperature, humidity and CO2 over 5 minutes ("stats/5m"),
+// then over an hour ("stats/1h"), with min, max and last as attributes (see
+// lib/WindowStats)
+extern const HaEntity HA_STATS_ENTITIES[6];
+// CO2 trend, air changes and occupancy estimated from the "air" topic (see
+// lib/Co2Analytics)
+extern const HaEntity HA_AIR_ENTITIES[3];
+
+// homeassistant/sensor/<id>/<level>; the return values are snprintf's
+size_t haTopic(char* out, size_t size, const HaDevice& device, const char* level);
+size_t haConfigTopic(char* out, size_t size, const HaDevice& device, const HaEntity& entity);
+size_t haConfigPayload(char* out, size_t size, const HaDevice& device, const HaEntity& entity);
+// {"temperature": 22.5, "humidity": 45, "co2": 650}; humidity is rounded
+size_t haStatePayload(char* out, size_t size, float temperature, float humidity, uint16_t co2);
+// Reads a state payload back (another device's, for a hub); false unless all
+// three keys have numbers. `payload` need not be NUL-terminated.
+bool haParseState(const uint8_t* payload, size_t length, float& temperature, float& humidity, uint16_t& co2);
+
+// Connects with a retained "offline" will on the availability topic; an
+// empty or null user connects without credentials. Works with PubSubClient
+// and MqttPipe (each keeps its own clean session default). The caller
+// publishes "online" once it is connected.
+template <class Mqtt>
+bool haConnect(Mqtt& mqtt, const HaDevice& device, const char* clientId, const char* user, const char* password) {
+    char willTopic[100];
+    haTopic(willTopic, sizeof(willTopic), device, "availability");
+    if (!user || !*user) return mqtt.connect(clientId, nullptr, nullptr, willTopic, 0, true, "offline");
+    return mqtt.connect(clientId, user, password, willTopic, 0, true, "offline");
+}
+
+// Takes a device out of Home Assistant: empties the retained config of each
+// entity and marks it offline. A device that changes its id calls it with the
+// old id and the entities its discovery published; publish(topic, payload)
+// sends one retained message.
+template <class Publish>
+void haClearIdentity(const HaDevice& device, const HaEntity* const* entities, size_t count, Publish publish) {
+    char topic[200];
+    for (size_t i = 0; i < count; i++) {
+        haConfigTopic(topic, sizeof(topic), device, *entities[i]);
+        publish(topic, "");
+    }
+    haTopic(topic, sizeof(topic), device, "availability");
+    publish(topic, "offline");
+}
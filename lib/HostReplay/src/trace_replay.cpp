@@ -0,0 +1,247 @@
+#include "trace_replay.h"
+
+#include <algorithm>
+
+static ReplayBackend replay;
+static uint32_t tailMs = 30000;
+static unsigned long loopStartVirtualMs = 0;
+static unsigned long loopStartHostUs = 0;
+
+// ReplayBackend
+
+bool ReplayBackend::load(const std::vector<TraceEvent>& events) {
+    _events = events;
+    _next = 0;
+    _lastEventMs = events.empty() ? 0 : events.back().timeMs;
+
+    uint64_t publishUs = 0;
+    uint32_t publishCount = 0;
+    for (const TraceEvent& e : _events) {
+        if (e.type == TRACE_MQTT_CONNECT) {
+            _brokerTimeline.push_back(std::make_pair(e.timeMs, e.flag));
+        } else if (e.type == TRACE_MQTT_STATE) {
+            _brokerTimeline.push_back(std::make_pair(e.timeMs, e.state == MQTT_CONNECTED));
+        } else if (e.type == TRACE_PUBLISH) {
+            if (!e.flag) _brokerTimeline.push_back(std::make_pair(e.timeMs, false));
+            publishUs += e.duration;
+            publishCount++;
+        }
+    }
+    _meanPublishUs = publishCount ? publishUs / publishCount : 0;
+    return !_events.empty();
+}
+
+void ReplayBackend::sync(uint32_t nowMs) {
+    while (_next < _events.size() && _events[_next].timeMs <= nowMs) {
+        const TraceEvent& e = _events[_next++];
+        switch (e.type) {
+            case TRACE_SENSOR:
+                _readings.push_back(e);
+                break;
+            case TRACE_TOUCH:
+                M5.Touch.hostTouch(e.x, e.y, e.flag);
+                _stats.inputEvents++;
+                break;
+            case TRACE_BUTTON:
+                if (e.code == 0) M5.BtnA.hostPress(e.flag);
+                else if (e.code == 1) M5.BtnB.hostPress(e.flag);
+                else if (e.code == 2) M5.BtnC.hostPress(e.flag);
+                else M5.BtnPWR.hostPress(e.flag);
+                _stats.inputEvents++;
+                break;
+            case TRACE_WIFI:
+                _wifiStatus = e.code;
+                break;
+            default:
+                // Connect/publish outcomes are looked up when the firmware makes the call
+                break;
+        }
+    }
+}
+
+bool ReplayBackend::finished(uint32_t nowMs, uint32_t tail) const {
+    return _next >= _events.size() && nowMs >= _lastEventMs + tail;
+}
+
+bool ReplayBackend::brokerUp(uint32_t nowMs) const {
+    if (_brokerTimeline.empty()) return false;
+    // Before the first recorded transition the broker is in whatever state that transition found it
+    auto it = std::upper_bound(_brokerTimeline.begin(), _brokerTimeline.end(), nowMs,
+                               [](uint32_t t, const std::pair<uint32_t, bool>& p) { return t < p.first; });
+    if (it == _brokerTimeline.begin()) return it->second;
+    return (it - 1)->second;
+}
+
+const TraceEvent* ReplayBackend::nextOutcome(TraceEventType type, uint32_t nowMs, bool wantFlag) const {
+    auto it = std::lower_bound(_events.begin(), _events.end(), nowMs,
+                               [](const TraceEvent& e, uint32_t t) { return e.timeMs < t; });
+    for (; it != _events.end(); ++it) {
+        if (it->type == type && it->flag == wantFlag) return &*it;
+    }
+    // Past the end of the trace: fall back to the last matching outcome
+    for (auto r = _events.rbegin(); r != _events.rend(); ++r) {
+        if (r->type == type && r->flag == wantFlag) return &*r;
+    }
+    return nullptr;
+}
+
+uint8_t ReplayBackend::wifiStatus() {
+    sync(millis());
+    return _wifiStatus;
+}
+
+int ReplayBackend::mqttConnect(PubSubClient& client, const char* clientId) {
+    (void)client; (void)clientId;
+    sync(millis());
+    _stats.connectAttempts++;
+
+    bool up = _wifiStatus == WL_CONNECTED && brokerUp(millis());
+    const TraceEvent* outcome = nextOutcome(TRACE_MQTT_CONNECT, millis(), up);
+    if (outcome) hostAdvanceClock(outcome->duration * 1000UL);
+
+    if (up) return MQTT_CONNECTED;
+    _stats.connectFailures++;
+    return outcome ? outcome->state : MQTT_CONNECTION_TIMEOUT;
+}
+
+bool ReplayBackend::mqttConnected(PubSubClient& client) {
+    (void)client;
+    sync(millis());
+    return _wifiStatus == WL_CONNECTED && brokerUp(millis());
+}
+
+bool ReplayBackend::mqttPublish(PubSubClient& client, const char* topic, const uint8_t* payload,
+                                size_t length, bool retained) {
+    (void)client; (void)payload; (void)length; (void)retained;
+    uint32_t now = millis();
+    bool ok = mqttConnected(client);
+    const TraceEvent* outcome = nextOutcome(TRACE_PUBLISH, now, ok);
+    hostAdvanceClock(outcome ? outcome->duration : _meanPublishUs);
+
+    _stats.publishes++;
+    if (!ok) {
+        _stats.publishFailures++;
+        return false;
+    }
+
+    size_t topicLength = strlen(topic);
+    bool isState = topicLength >= 6 && strcmp(topic + topicLength - 6, "/state") == 0;
+    if (isState && _readingPending) {
+        _stats.publishLatencyMs.push_back(millis() - _pendingReadingMs);
+        _stats.readingsPublished++;
+        _readingPending = false;
+    }
+    return true;
+}
+
+bool ReplayBackend::scd4xDataReady() {
+    sync(millis());
+    return !_readings.empty();
+}
+
+uint16_t ReplayBackend::scd4xRead(uint16_t& co2, float& temperature, float& humidity) {
+    sync(millis());
+    if (_readings.empty()) {
+        co2 = 0;
+        temperature = humidity = 0;
+        return 0x0100;   // stands in for a NACK from the sensor
+    }
+    // Only the newest reading is visible on the sensor; older ones were overwritten
+    TraceEvent reading = _readings.back();
+    _readings.clear();
+
+    co2 = reading.co2;
+    temperature = reading.temperature;
+    humidity = reading.humidity;
+    if (reading.code == 0 && reading.co2 > 0) {
+        _stats.readings++;
+        _readingPending = true;
+        _pendingReadingMs = reading.timeMs;
+    }
+    return reading.code;
+}
+
+// Report
+
+static uint32_t percentileOf(std::vector<uint32_t> values, int pct) {
+    if (values.empty()) return 0;
+    std::sort(values.begin(), values.end());
+    size_t rank = (pct * values.size() + 99) / 100;
+    return values[rank ? rank - 1 : 0];
+}
+
+static String distribution(const std::vector<uint32_t>& values) {
+    return "{\"count\":" + String((unsigned long)values.size()) +
+           ",\"p50\":" + String(percentileOf(values, 50)) +
+           ",\"p90\":" + String(percentileOf(values, 90)) +
+           ",\"p99\":" + String(percentileOf(values, 99)) +
+           ",\"max\":" + String(percentileOf(values, 100)) + "}";
+}
+
+static void finishReplay() {
+    ReplayStats& s = replay.stats();
+    String out = "{\"virtual_ms\":" + String(millis());
+    out += ",\"loops\":" + String((unsigned long)s.loopVirtualMs.size());
+    out += ",\"loop_virtual_ms\":" + distribution(s.loopVirtualMs);
+    out += ",\"loop_host_us\":" + distribution(s.loopHostUs);
+    out += ",\"publish_latency_ms\":" + distribution(s.publishLatencyMs);
+    out += ",\"readings\":" + String(s.readings);
+    out += ",\"readings_published\":" + String(s.readingsPublished);
+    out += ",\"connect_attempts\":" + String(s.connectAttempts);
+    out += ",\"connect_failures\":" + String(s.connectFailures);
+    out += ",\"publishes\":" + String(s.publishes);
+    out += ",\"publish_failures\":" + String(s.publishFailures);
+    out += ",\"input_events\":" + String(s.inputEvents);
+    out += "}";
+
+    Serial.println("--- replay report ---");
+    Serial.println(out);
+    Serial.println("--- end report ---");
+
+    const char* reportPath = hostArg("report");
+    if (reportPath) {
+        FILE* f = fopen(reportPath, "w");
+        if (f) {
+            fwrite(out.c_str(), 1, out.length(), f);
+            fclose(f);
+        }
+    }
+    hostExit(0);
+}
+
+// Host main() hooks
+
+void hostBeforeSetup() {
+    const char* tracePath = hostArg("trace");
+    std::vector<TraceEvent> events;
+    if (!tracePath || !loadTrace(tracePath, events)) {
+        fprintf(stderr, "replay: no events in --trace=%s\n", tracePath ? tracePath : "");
+        hostExit(2);
+    }
+
+    const char* savePath = hostArg("save");
+    if (savePath && !saveTrace(savePath, events)) {
+        fprintf(stderr, "replay: cannot write %s\n", savePath);
+    }
+
+    tailMs = atoi(hostArg("tail", "30")) * 1000;
+    fprintf(stderr, "replay: %zu events over %.1f s\n", events.size(), events.back().timeMs / 1000.0);
+
+    replay.load(events);
+    hostUseVirtualClock(true);
+    hostSetNetBackend(&replay);
+}
+
+void hostBeforeLoop() {
+    replay.sync(millis());
+    loopStartVirtualMs = millis();
+    loopStartHostUs = hostWallMicros();
+}
+
+void hostAfterLoop() {
+    ReplayStats& s = replay.stats();
+    s.loopVirtualMs.push_back(millis() - loopStartVirtualMs);
+    s.loopHostUs.push_back(hostWallMicros() - loopStartHostUs);
+
+    if (replay.finished(millis(), tailMs)) finishReplay();
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+// Trace replay harness. Linking this library into a native build takes over the
+// host main() hooks: the sketch runs on the virtual clock (as fast as the host
+// allows) while the recorded inputs are fed back in at their recorded times.
+//
+//   program --trace=run.log [--save=run.trc] [--report=replay.json] [--tail=30]
+//
+// Sensor readings, touches and button presses are replayed as they happened.
+// WiFi and broker availability are replayed as timelines rather than as a fixed
+// list of call results, so a modified firmware that connects or publishes at
+// different moments still sees the same outages. Connect and publish calls cost
+// the virtual time they took on the device.
+
+#include <deque>
+#include <vector>
+
+#include <M5Unified.h>
+#include <PubSubClient.h>
+#include <WiFi.h>
+#include <trace_file.h>
+
+struct ReplayStats {
+    std::vector<uint32_t> loopVirtualMs;    // modelled time per loop(), including delays and network calls
+    std::vector<uint32_t> loopHostUs;       // real CPU time per loop() on the host
+    std::vector<uint32_t> publishLatencyMs; // reading available on the sensor -> state published
+    uint32_t readings = 0;
+    uint32_t readingsPublished = 0;
+    uint32_t connectAttempts = 0;
+    uint32_t connectFailures = 0;
+    uint32_t publishes = 0;
+    uint32_t publishFailures = 0;
+    uint32_t inputEvents = 0;
+};
+
+class ReplayBackend : public HostNetBackend {
+public:
+    bool load(const std::vector<TraceEvent>& events);
+
+    // Applies every timed event up to nowMs (touch, buttons, readings, outages)
+    void sync(uint32_t nowMs);
+    bool finished(uint32_t nowMs, uint32_t tailMs) const;
+    ReplayStats& stats() { return _stats; }
+
+    uint8_t wifiStatus() override;
+    IPAddress wifiLocalIP() override { return IPAddress(192, 168, 2, 50); }
+    int mqttConnect(PubSubClient& client, const char* clientId) override;
+    bool mqttConnected(PubSubClient& client) override;
+    bool mqttPublish(PubSubClient& client, const char* topic, const uint8_t* payload,
+                     size_t length, bool retained) override;
+    bool scd4xDataReady() override;
+    uint16_t scd4xRead(uint16_t& co2, float& temperature, float& humidity) override;
+
+private:
+    const TraceEvent* nextOutcome(TraceEventType type, uint32_t nowMs, bool wantFlag) const;
+    bool brokerUp(uint32_t nowMs) const;
+
+    std::vector<TraceEvent> _events;
+    size_t _next = 0;
+    uint32_t _lastEventMs = 0;
+
+    uint8_t _wifiStatus = WL_DISCONNECTED;
+    std::vector<std::pair<uint32_t, bool>> _brokerTimeline;   // (time, up) transitions
+    std::deque<TraceEvent> _readings;
+    bool _readingPending = false;       // read but not yet published
+    uint32_t _pendingReadingMs = 0;
+    uint32_t _meanPublishUs = 0;
+
+    ReplayStats _stats;
+};
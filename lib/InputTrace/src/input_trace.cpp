@@ -0,0 +1,294 @@
+#include "input_trace.h"
+
+static size_t putVarint(uint8_t* out, uint32_t value) {
+    size_t n = 0;
+    while (value >= 0x80) {
+        out[n++] = (value & 0x7F) | 0x80;
+        value >>= 7;
+    }
+    out[n++] = value;
+    return n;
+}
+
+static size_t getVarint(const uint8_t* in, size_t size, uint32_t& value) {
+    value = 0;
+    for (size_t i = 0; i < size && i < 5; i++) {
+        value |= (uint32_t)(in[i] & 0x7F) << (7 * i);
+        if (!(in[i] & 0x80)) return i + 1;
+    }
+    return 0;
+}
+
+static size_t putFloat(uint8_t* out, float value) {
+    memcpy(out, &value, 4);
+    return 4;
+}
+
+static size_t putInt16(uint8_t* out, int16_t value) {
+    out[0] = value & 0xFF;
+    out[1] = (uint16_t)value >> 8;
+    return 2;
+}
+
+static int16_t getInt16(const uint8_t* in) {
+    return (int16_t)(in[0] | (in[1] << 8));
+}
+
+size_t encodeTraceEvent(const TraceEvent& event, int32_t deltaMs, uint8_t* out) {
+    // Zigzag so the occasional out-of-order event (recorded from another task)
+    // costs one byte like everything else
+    size_t n = putVarint(out, ((uint32_t)deltaMs << 1) ^ (uint32_t)(deltaMs >> 31));
+    out[n++] = event.type;
+
+    switch (event.type) {
+        case TRACE_SENSOR:
+            n += putInt16(out + n, event.code);
+            n += putInt16(out + n, event.co2);
+            n += putFloat(out + n, event.temperature);
+            n += putFloat(out + n, event.humidity);
+            break;
+        case TRACE_TOUCH:
+            n += putInt16(out + n, event.x);
+            n += putInt16(out + n, event.y);
+            out[n++] = event.flag;
+            break;
+        case TRACE_BUTTON:
+            out[n++] = event.code;
+            out[n++] = event.flag;
+            break;
+        case TRACE_WIFI:
+            out[n++] = event.code;
+            break;
+        case TRACE_MQTT_CONNECT:
+            out[n++] = event.flag;
+            out[n++] = (int8_t)event.state;
+            n += putVarint(out + n, event.duration);
+            break;
+        case TRACE_MQTT_STATE:
+            out[n++] = (int8_t)event.state;
+            break;
+        case TRACE_PUBLISH:
+            out[n++] = event.flag;
+            n += putVarint(out + n, event.length);
+            n += putVarint(out + n, event.duration);
+            break;
+    }
+    return n;
+}
+
+size_t decodeTraceEvent(const uint8_t* in, size_t size, int32_t& deltaMs, TraceEvent& event) {
+    uint32_t zigzag;
+    size_t n = getVarint(in, size, zigzag);
+    if (!n || n >= size) return 0;
+    deltaMs = (int32_t)(zigzag >> 1) ^ -(int32_t)(zigzag & 1);
+
+    event = TraceEvent();
+    event.type = (TraceEventType)in[n++];
+    size_t left = size - n;
+    const uint8_t* p = in + n;
+    size_t used = 0;
+
+    switch (event.type) {
+        case TRACE_SENSOR:
+            if (left < 12) return 0;
+            event.code = getInt16(p);
+            event.co2 = getInt16(p + 2);
+            memcpy(&event.temperature, p + 4, 4);
+            memcpy(&event.humidity, p + 8, 4);
+            used = 12;
+            break;
+        case TRACE_TOUCH:
+            if (left < 5) return 0;
+            event.x = getInt16(p);
+            event.y = getInt16(p + 2);
+            event.flag = p[4];
+            used = 5;
+            break;
+        case TRACE_BUTTON:
+            if (left < 2) return 0;
+            event.code = p[0];
+            event.flag = p[1];
+            used = 2;
+            break;
+        case TRACE_WIFI:
+            if (left < 1) return 0;
+            event.code = p[0];
+            used = 1;
+            break;
+        case TRACE_MQTT_CONNECT: {
+            if (left < 3) return 0;
+            event.flag = p[0];
+            event.state = (int8_t)p[1];
+            size_t v = getVarint(p + 2, left - 2, event.duration);
+            if (!v) return 0;
+            used = 2 + v;
+            break;
+        }
+        case TRACE_MQTT_STATE:
+            if (left < 1) return 0;
+            event.state = (int8_t)p[0];
+            used = 1;
+            break;
+        case TRACE_PUBLISH: {
+            if (left < 2) return 0;
+            event.flag = p[0];
+            size_t a = getVarint(p + 1, left - 1, event.length);
+            if (!a) return 0;
+            size_t b = getVarint(p + 1 + a, left - 1 - a, event.duration);
+            if (!b) return 0;
+            used = 1 + a + b;
+            break;
+        }
+        default:
+            return 0;
+    }
+    return n + used;
+}
+
+#ifdef INPUT_TRACE
+
+// Events are appended under a lock (WiFi status arrives from the event task);
+// only traceFlush(), on the loop task, does Serial output
+static const size_t TRACE_BUFFER_SIZE = 1024;
+static const uint32_t TRACE_FLUSH_INTERVAL = 1000;
+
+static Print* traceOut = nullptr;
+static uint8_t traceBuffer[TRACE_BUFFER_SIZE];
+static size_t traceLength = 0;
+static uint32_t traceStartMs = 0;
+static uint32_t traceLastMs = 0;
+static uint32_t traceLastFlush = 0;
+static uint32_t traceDropped = 0;
+
+#ifdef ESP32
+static portMUX_TYPE traceLock = portMUX_INITIALIZER_UNLOCKED;
+#define TRACE_LOCK() portENTER_CRITICAL(&traceLock)
+#define TRACE_UNLOCK() portEXIT_CRITICAL(&traceLock)
+#else
+#define TRACE_LOCK()
+#define TRACE_UNLOCK()
+#endif
+
+static void traceRecord(TraceEvent& event) {
+    event.timeMs = millis();
+
+    TRACE_LOCK();
+    if (traceLength == 0) {
+        traceStartMs = event.timeMs;
+        traceLastMs = event.timeMs;
+    }
+    if (traceLength + TRACE_EVENT_MAX_BYTES <= TRACE_BUFFER_SIZE) {
+        traceLength += encodeTraceEvent(event, (int32_t)(event.timeMs - traceLastMs), traceBuffer + traceLength);
+        traceLastMs = event.timeMs;
+    } else {
+        traceDropped++;
+    }
+    TRACE_UNLOCK();
+}
+
+void traceBegin(Print& out) {
+    traceOut = &out;
+    traceLastFlush = millis();
+}
+
+void traceSensor(uint16_t error, uint16_t co2, float temperature, float humidity) {
+    TraceEvent event;
+    event.type = TRACE_SENSOR;
+    event.code = error;
+    event.co2 = co2;
+    event.temperature = temperature;
+    event.humidity = humidity;
+    traceRecord(event);
+}
+
+void traceTouch(int16_t x, int16_t y, bool pressed) {
+    TraceEvent event;
+    event.type = TRACE_TOUCH;
+    event.x = x;
+    event.y = y;
+    event.flag = pressed;
+    traceRecord(event);
+}
+
+void traceButton(uint8_t index, bool pressed) {
+    TraceEvent event;
+    event.type = TRACE_BUTTON;
+    event.code = index;
+    event.flag = pressed;
+    traceRecord(event);
+}
+
+void traceWifi(uint8_t status) {
+    TraceEvent event;
+    event.type = TRACE_WIFI;
+    event.code = status;
+    traceRecord(event);
+}
+
+void traceMqttConnect(bool connected, int state, uint32_t durationMs) {
+    TraceEvent event;
+    event.type = TRACE_MQTT_CONNECT;
+    event.flag = connected;
+    event.state = state;
+    event.duration = durationMs;
+    traceRecord(event);
+}
+
+void traceMqttState(int state) {
+    TraceEvent event;
+    event.type = TRACE_MQTT_STATE;
+    event.state = state;
+    traceRecord(event);
+}
+
+void tracePublish(bool accepted, uint32_t length, uint32_t durationUs) {
+    TraceEvent event;
+    event.type = TRACE_PUBLISH;
+    event.flag = accepted;
+    event.length = length;
+    event.duration = durationUs;
+    traceRecord(event);
+}
+
+void traceFlush() {
+    if (!traceOut || millis() - traceLastFlush < TRACE_FLUSH_INTERVAL) return;
+    traceLastFlush = millis();
+
+    static uint8_t copy[TRACE_BUFFER_SIZE];
+    TRACE_LOCK();
+    size_t length = traceLength;
+    uint32_t startMs = traceStartMs;
+    memcpy(copy, traceBuffer, length);
+    traceLength = 0;
+    TRACE_UNLOCK();
+    if (!length) return;
+
+    static const char hex[] = "0123456789abcdef";
+    char line[2 * TRACE_BUFFER_SIZE + 32];
+    int n = snprintf(line, sizeof(line), "@trc %lu ", (unsigned long)startMs);
+    for (size_t i = 0; i < length; i++) {
+        line[n++] = hex[copy[i] >> 4];
+        line[n++] = hex[copy[i] & 0x0F];
+    }
+    line[n++] = '\n';
+    traceOut->write((const uint8_t*)line, n);
+}
+
+uint32_t traceDroppedEvents() {
+    return traceDropped;
+}
+
+#else
+
+void traceBegin(Print&) {}
+void traceSensor(uint16_t, uint16_t, float, float) {}
+void traceTouch(int16_t, int16_t, bool) {}
+void traceButton(uint8_t, bool) {}
+void traceWifi(uint8_t) {}
+void traceMqttConnect(bool, int, uint32_t) {}
+void traceMqttState(int) {}
+void tracePublish(bool, uint32_t, uint32_t) {}
+void traceFlush() {}
+uint32_t traceDroppedEvents() { return 0; }
+
+#endif
@@ -0,0 +1,62 @@
+#pragma once
+
+// Record/replay trace of everything the 1_temp_hum firmware reacts to: SCD40
+// readings, touch and button changes, WiFi status, MQTT connect attempts and
+// connection state, and publish outcomes.
+//
+// Recording is compiled in only with -DINPUT_TRACE. The record functions below
+// are then thread-safe and cheap (a few bytes appended to a RAM buffer), and
+// traceFlush() writes the buffer out as a text line:
+//
+//     @trc <start ms> <hex bytes>
+//
+// so a trace is simply the Serial log of a run (`pio device monitor | tee run.log`).
+// Inside a line every event is a zigzag varint time delta in ms, a type byte and
+// a type-specific payload. The binary .trc form is "TRC1" followed by the same
+// event encoding, with deltas running across the whole file.
+
+#include <Arduino.h>
+
+enum TraceEventType : uint8_t {
+    TRACE_SENSOR = 1,       // code = SCD4x error, co2/temperature/humidity
+    TRACE_TOUCH = 2,        // x/y, flag = pressed
+    TRACE_BUTTON = 3,       // code = button index (0 = A), flag = pressed
+    TRACE_WIFI = 4,         // code = wl_status_t
+    TRACE_MQTT_CONNECT = 5, // flag = connected, state = PubSubClient state, duration in ms
+    TRACE_MQTT_STATE = 6,   // state = PubSubClient state after a change
+    TRACE_PUBLISH = 7,      // flag = accepted, length = payload bytes, duration in us
+};
+
+struct TraceEvent {
+    uint32_t timeMs = 0;
+    TraceEventType type = TRACE_SENSOR;
+    bool flag = false;
+    uint16_t code = 0;
+    int16_t state = 0;
+    int16_t x = 0;
+    int16_t y = 0;
+    uint16_t co2 = 0;
+    float temperature = 0;
+    float humidity = 0;
+    uint32_t length = 0;
+    uint32_t duration = 0;
+};
+
+// Encoding shared by the recorder and the host tools. encodeTraceEvent() returns
+// the number of bytes written (at most TRACE_EVENT_MAX_BYTES); decodeTraceEvent()
+// returns the number consumed, or 0 if the input is truncated or malformed.
+const size_t TRACE_EVENT_MAX_BYTES = 24;
+size_t encodeTraceEvent(const TraceEvent& event, int32_t deltaMs, uint8_t* out);
+size_t decodeTraceEvent(const uint8_t* in, size_t size, int32_t& deltaMs, TraceEvent& event);
+
+// Recording (no-ops unless built with -DINPUT_TRACE)
+void traceBegin(Print& out);
+void traceSensor(uint16_t error, uint16_t co2, float temperature, float humidity);
+void traceTouch(int16_t x, int16_t y, bool pressed);
+void traceButton(uint8_t index, bool pressed);
+void traceWifi(uint8_t status);
+void traceMqttConnect(bool connected, int state, uint32_t durationMs);
+void traceMqttState(int state);
+void tracePublish(bool accepted, uint32_t length, uint32_t durationUs);
+void traceFlush();               // call from loop(); writes at most once a second
+uint32_t traceDroppedEvents();   // events lost because the buffer was full between flushes
@@ -0,0 +1,87 @@
+#include "trace_file.h"
+
+#include <algorithm>
+#include <stdio.h>
+
+static const char TRACE_MAGIC[4] = {'T', 'R', 'C', '1'};
+
+static bool decodeEvents(const uint8_t* data, size_t size, uint32_t startMs, std::vector<TraceEvent>& events) {
+    int64_t timeMs = startMs;
+    size_t pos = 0;
+    while (pos < size) {
+        int32_t deltaMs;
+        TraceEvent event;
+        size_t n = decodeTraceEvent(data + pos, size - pos, deltaMs, event);
+        if (!n) return false;
+        timeMs += deltaMs;
+        event.timeMs = timeMs < 0 ? 0 : (uint32_t)timeMs;
+        events.push_back(event);
+        pos += n;
+    }
+    return true;
+}
+
+static int hexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static void decodeLogLine(const char* line, std::vector<TraceEvent>& events) {
+    const char* marker = strstr(line, "@trc ");
+    if (!marker) return;
+
+    char* end;
+    unsigned long startMs = strtoul(marker + 5, &end, 10);
+    while (*end == ' ') end++;
+
+    std::vector<uint8_t> bytes;
+    for (const char* p = end; hexValue(p[0]) >= 0 && hexValue(p[1]) >= 0; p += 2) {
+        bytes.push_back(hexValue(p[0]) << 4 | hexValue(p[1]));
+    }
+    // A line cut short by the monitor still yields its complete events
+    decodeEvents(bytes.data(), bytes.size(), startMs, events);
+}
+
+bool loadTrace(const char* path, std::vector<TraceEvent>& events) {
+    FILE* f = fopen(path, "rb");
+    if (!f) return false;
+    std::vector<uint8_t> data;
+    uint8_t buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) data.insert(data.end(), buf, buf + n);
+    fclose(f);
+
+    events.clear();
+    if (data.size() >= 4 && memcmp(data.data(), TRACE_MAGIC, 4) == 0) {
+        decodeEvents(data.data() + 4, data.size() - 4, 0, events);
+    } else {
+        data.push_back(0);
+        char* text = (char*)data.data();
+        for (char* line = strtok(text, "\r\n"); line; line = strtok(nullptr, "\r\n")) {
+            decodeLogLine(line, events);
+        }
+    }
+
+    std::stable_sort(events.begin(), events.end(),
+                     [](const TraceEvent& a, const TraceEvent& b) { return a.timeMs < b.timeMs; });
+    return !events.empty();
+}
+
+bool saveTrace(const char* path, const std::vector<TraceEvent>& events) {
+    FILE* f = fopen(path, "wb");
+    if (!f) return false;
+    fwrite(TRACE_MAGIC, 1, 4, f);
+
+    uint32_t lastMs = 0;
+    uint8_t buf[TRACE_EVENT_MAX_BYTES];
+    for (const TraceEvent& event : events) {
+        size_t n = encodeTraceEvent(event, (int32_t)(event.timeMs - lastMs), buf);
+        fwrite(buf, 1, n, f);
+        lastMs = event.timeMs;
+    }
+    bool ok = !ferror(f);
+    fclose(f);
+    return ok;
+}
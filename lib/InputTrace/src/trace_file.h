@@ -0,0 +1,14 @@
+#pragma once
+
+// Loading and saving whole traces (host tools)
+
+#include "input_trace.h"
+
+#include <vector>
+
+// Accepts either a binary .trc file or a captured Serial log; in a log every
+// "@trc" line is decoded and everything else is ignored. Events come back sorted
+// by time. Returns false if the file cannot be read or holds no events.
+bool loadTrace(const char* path, std::vector<TraceEvent>& events);
+
+bool saveTrace(const char* path, const std::vector<TraceEvent>& events);
@@ -0,0 +1,26 @@
+#pragma once
+
+// Text for inside a JSON string, for the "key":"value" fragments the
+// libraries add to the diagnostics payload (TlsClient, RemoteConfig,
+// DeltaOta): quotes and backslashes escaped, control characters as spaces,
+// cut short to fit. Bytes from 0x80 up are UTF-8 and pass through.
+//
+//   char status[sizeof(text) * 2];
+//   jsonEscape(status, sizeof(status), text);
+//   snprintf(out, size, "\"tls\":\"%s\"", status);
+//
+// Header only, no dependencies; C++11 for the CoreInk and Paper toolchains.
+
+#include <stddef.h>
+
+// Always NUL-terminated (unless size is 0); returns the length written
+inline size_t jsonEscape(char* out, size_t size, const char* text) {
+    if (!size) return 0;
+    size_t n = 0;
+    for (const char* c = text; *c && n + 2 < size; c++) {
+        if (*c == '"' || *c == '\\') out[n++] = '\\';
+        out[n++] = ((unsigned char)*c < 0x20) ? ' ' : *c;
+    }
+    out[n] = 0;
+    return n;
+}
@@ -0,0 +1,394 @@
+#include "loop_watch.h"
+
+#include <atomic>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef ESP_PLATFORM
+#include <esp_attr.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#else
+#define RTC_NOINIT_ATTR
+#endif
+
+// Backtraces read the context FreeRTOS saved for the loop task, whose layout
+// is only known here for the RISC-V port
+#if defined(ESP_PLATFORM) && defined(__riscv)
+#include <esp_memory_utils.h>
+#include <riscv/rvruntime-frames.h>
+#define LOOP_WATCH_HAS_BACKTRACE 1
+#endif
+
+#ifndef LOOP_WATCH_TASK_STACK_SIZE
+#define LOOP_WATCH_TASK_STACK_SIZE 3072
+#endif
+
+#ifndef LOOP_WATCH_SCAN_WORDS
+#define LOOP_WATCH_SCAN_WORDS 512
+#endif
+
+const uint32_t LOOP_WATCH_BUCKET_MS[LOOP_WATCH_BUCKETS - 1] = {500, 1000, 2000, 5000, 10000};
+
+static const uint32_t HISTOGRAM_MAGIC = 0x4C57A7C1;
+static const uint32_t STALL_MAGIC = 0x5374A11E;
+static const int TIMELINE_LENGTH = 24;
+static const int MAX_PENDING = 4;
+
+// Set by the watchdog task once the current section is over budget and
+// cleared when it ends: still set after a reset means it never ended
+struct StallMark {
+    uint32_t magic;
+    char name[LOOP_WATCH_NAME_LENGTH];
+};
+
+RTC_NOINIT_ATTR static LoopWatchHistogram histogram;
+RTC_NOINIT_ATTR static StallMark stallMark;
+
+static Print* report = nullptr;
+static uint32_t budgetUs = LOOP_WATCH_BUDGET_MS * 1000UL;
+static LoopWatchStats stats;
+
+// The current section, written by the loop task only. serial is odd while
+// name and start change, so the watchdog task can tell a torn read.
+static std::atomic<uint32_t> sectionSerial(0);
+static std::atomic<const char*> sectionName(nullptr);
+static std::atomic<uint32_t> sectionStartUs(0);
+
+// A backtrace of section `serial`, published the same way
+struct Capture {
+    std::atomic<uint32_t> serial;
+    int count;
+    uint32_t pcs[LOOP_WATCH_BACKTRACE];
+};
+static Capture capture;
+static bool watchdogRunning = false;
+
+struct Mark {
+    const char* name;
+    uint32_t atUs;      // since loopWatchBegin()
+};
+static Mark timeline[TIMELINE_LENGTH];
+static int timelineLength = 0;
+static bool passActive = false;
+static uint32_t passStartUs = 0;
+
+struct PendingStall {
+    const char* name;
+    uint32_t ms;
+    int count;          // backtrace entries; 0 when the watchdog did not catch it
+    uint32_t pcs[LOOP_WATCH_BACKTRACE];
+};
+static PendingStall pending[MAX_PENDING];
+static int pendingCount = 0;
+static uint32_t pendingDropped = 0;
+
+// Histogram
+
+static uint32_t checksumOf(const LoopWatchHistogram& h) {
+    const uint8_t* p = (const uint8_t*)&h;
+    size_t length = offsetof(LoopWatchHistogram, checksum);
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) hash = (hash ^ p[i]) * 16777619u;
+    return hash;
+}
+
+static bool histogramValid() {
+    return histogram.magic == HISTOGRAM_MAGIC && histogram.causeCount <= (uint32_t)LOOP_WATCH_MAX_CAUSES &&
+           histogram.checksum == checksumOf(histogram);
+}
+
+static void seal() {
+    histogram.checksum = checksumOf(histogram);
+}
+
+void loopWatchClear() {
+    memset(&histogram, 0, sizeof(histogram));
+    histogram.magic = HISTOGRAM_MAGIC;
+    seal();
+}
+
+// The cause entry for a section name; once the table is full everything new
+// shares the last entry, "other"
+static LoopWatchCause& causeFor(const char* name) {
+    for (uint32_t i = 0; i < histogram.causeCount; i++) {
+        if (strncmp(histogram.causes[i].name, name, LOOP_WATCH_NAME_LENGTH - 1) == 0) return histogram.causes[i];
+    }
+    if (histogram.causeCount < (uint32_t)LOOP_WATCH_MAX_CAUSES - 1) {
+        LoopWatchCause& cause = histogram.causes[histogram.causeCount++];
+        snprintf(cause.name, sizeof(cause.name), "%s", name);
+        return cause;
+    }
+    LoopWatchCause& other = histogram.causes[LOOP_WATCH_MAX_CAUSES - 1];
+    if (histogram.causeCount < (uint32_t)LOOP_WATCH_MAX_CAUSES) {
+        histogram.causeCount = LOOP_WATCH_MAX_CAUSES;
+        snprintf(other.name, sizeof(other.name), "other");
+    }
+    return other;
+}
+
+static int bucketFor(uint32_t ms) {
+    int b = 0;
+    while (b < LOOP_WATCH_BUCKETS - 1 && ms >= LOOP_WATCH_BUCKET_MS[b]) b++;
+    return b;
+}
+
+// Backtrace
+
+#ifdef LOOP_WATCH_HAS_BACKTRACE
+static TaskHandle_t loopTask = nullptr;
+
+// Fills pcs from the context the loop task was switched out with; 0 when it
+// is running right now and that context is stale
+static int captureBacktrace(uint32_t* pcs, int max) {
+    if (eTaskGetState(loopTask) == eRunning) return 0;
+    // pxTopOfStack is the first member of the task control block; the port
+    // leaves the interrupted context there, PC in mepc
+    const RvExcFrame* frame = *(RvExcFrame* const*)loopTask;
+    const uint32_t* stackStart = (const uint32_t*)pxTaskGetStackStart(loopTask);
+    const uint32_t* stackEnd = stackStart + getArduinoLoopTaskStackSize() / sizeof(uint32_t);
+    if ((const uint32_t*)frame < stackStart || (const uint32_t*)frame >= stackEnd) return 0;
+
+    int n = 0;
+    pcs[n++] = frame->mepc;
+    if (esp_ptr_executable((void*)frame->ra)) pcs[n++] = frame->ra;
+    const uint32_t* sp = (const uint32_t*)frame->sp;
+    if (sp < stackStart || sp >= stackEnd) return n;
+    for (int i = 0; i < LOOP_WATCH_SCAN_WORDS && sp + i < stackEnd && n < max; i++) {
+        uint32_t word = sp[i];
+        if (word != pcs[n - 1] && esp_ptr_executable((void*)word)) pcs[n++] = word;
+    }
+    return n;
+}
+#endif
+
+#ifdef ESP_PLATFORM
+static void watchdogLoop(void*) {
+    uint32_t markedSerial = 0;
+    uint32_t caughtSerial = 0;
+    for (;;) {
+        vTaskDelay(pdMS_TO_TICKS(LOOP_WATCH_PERIOD_MS));
+        uint32_t serial = sectionSerial.load(std::memory_order_acquire);
+        if (serial & 1) continue;
+        const char* name = sectionName.load(std::memory_order_relaxed);
+        uint32_t startUs = sectionStartUs.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (sectionSerial.load(std::memory_order_relaxed) != serial) continue;
+        if (!name || micros() - startUs < budgetUs) continue;
+
+        if (serial != markedSerial) {
+            markedSerial = serial;
+            snprintf(stallMark.name, sizeof(stallMark.name), "%s", name);
+            stallMark.magic = STALL_MAGIC;
+            // The section may have ended while the mark was written
+            if (sectionSerial.load(std::memory_order_acquire) != serial) stallMark.magic = 0;
+        }
+
+#ifdef LOOP_WATCH_HAS_BACKTRACE
+        if (serial == caughtSerial) continue;
+        uint32_t pcs[LOOP_WATCH_BACKTRACE];
+        int count = captureBacktrace(pcs, LOOP_WATCH_BACKTRACE);
+        if (count == 0) continue;   // busy on its core; next period
+        if (sectionSerial.load(std::memory_order_acquire) != serial) continue;
+        capture.serial.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        memcpy(capture.pcs, pcs, count * sizeof(uint32_t));
+        capture.count = count;
+        capture.serial.store(serial, std::memory_order_release);
+        caughtSerial = serial;
+#else
+        (void)caughtSerial;
+#endif
+    }
+}
+#endif
+
+// Sections
+
+static void recordStall(const char* name, uint32_t us, uint32_t serial) {
+    uint32_t ms = us / 1000;
+    stats.stalls++;
+    LoopWatchCause& cause = causeFor(name);
+    cause.stalls++;
+    cause.totalMs += ms;
+    if (ms > cause.maxMs) cause.maxMs = ms;
+    cause.buckets[bucketFor(ms)]++;
+    seal();
+
+    if (pendingCount == MAX_PENDING) {
+        pendingDropped++;
+        return;
+    }
+    PendingStall& p = pending[pendingCount++];
+    p.name = name;
+    p.ms = ms;
+    p.count = 0;
+    if (capture.serial.load(std::memory_order_acquire) == serial) {
+        int count = capture.count;
+        memcpy(p.pcs, capture.pcs, count * sizeof(uint32_t));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (capture.serial.load(std::memory_order_relaxed) == serial) {
+            p.count = count;
+            stats.backtraces++;
+        }
+    }
+}
+
+// Ends the current section (recording it when it stalled) and starts `name`
+static void switchSection(const char* name) {
+    uint32_t now = micros();
+    uint32_t serial = sectionSerial.load(std::memory_order_relaxed);
+    const char* ended = sectionName.load(std::memory_order_relaxed);
+    uint32_t startUs = sectionStartUs.load(std::memory_order_relaxed);
+
+    sectionSerial.store(serial + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    sectionName.store(name, std::memory_order_relaxed);
+    sectionStartUs.store(now, std::memory_order_relaxed);
+    sectionSerial.store(serial + 2, std::memory_order_release);
+
+    if (ended) {
+        stallMark.magic = 0;
+        if (now - startUs >= budgetUs) recordStall(ended, now - startUs, serial);
+    }
+    if (name && passActive && timelineLength < TIMELINE_LENGTH) {
+        timeline[timelineLength++] = {name, now - passStartUs};
+    }
+}
+
+bool loopWatchStart(Print& out, uint32_t budgetMs) {
+    report = &out;
+    budgetUs = budgetMs * 1000UL;
+
+    bool kept = histogramValid();
+    if (!kept) loopWatchClear();
+    if (kept && stallMark.magic == STALL_MAGIC) {
+        stallMark.name[LOOP_WATCH_NAME_LENGTH - 1] = 0;
+        causeFor(stallMark.name).resets++;
+    }
+    stallMark.magic = 0;
+    histogram.boots++;
+    seal();
+
+#ifdef ESP_PLATFORM
+    if (!watchdogRunning) {
+#ifdef LOOP_WATCH_HAS_BACKTRACE
+        loopTask = xTaskGetCurrentTaskHandle();
+#endif
+#if portNUM_PROCESSORS > 1
+        BaseType_t core = xPortGetCoreID() ? 0 : 1;
+#else
+        BaseType_t core = 0;
+#endif
+        watchdogRunning = xTaskCreatePinnedToCore(watchdogLoop, "loop watch", LOOP_WATCH_TASK_STACK_SIZE, nullptr,
+                                                  configMAX_PRIORITIES - 2, nullptr, core) == pdPASS;
+    }
+#endif
+    return kept;
+}
+
+void loopWatchBegin() {
+    switchSection(nullptr);
+    passActive = true;
+    passStartUs = micros();
+    timelineLength = 0;
+    stats.passes++;
+}
+
+void loopWatchSection(const char* name) {
+    switchSection(name);
+}
+
+const char* loopWatchSwap(const char* name) {
+    const char* previous = sectionName.load(std::memory_order_relaxed);
+    switchSection(name);
+    return previous;
+}
+
+void loopWatchEnd() {
+    switchSection(nullptr);
+    uint32_t passUs = micros() - passStartUs;
+    if (passActive) {
+        stats.lastPassUs = passUs;
+        if (passUs > stats.maxPassUs) stats.maxPassUs = passUs;
+    }
+
+    if (pendingCount && report) {
+        for (int i = 0; i < pendingCount; i++) {
+            const PendingStall& p = pending[i];
+            report->printf("Loop stall: %s %u ms", p.name, (unsigned)p.ms);
+            if (passActive) {
+                report->printf(" (pass %u ms:", (unsigned)(passUs / 1000));
+                for (int m = 0; m < timelineLength; m++) {
+                    report->printf(" %s +%u", timeline[m].name, (unsigned)(timeline[m].atUs / 1000));
+                }
+                report->print(")");
+            }
+            report->println();
+            if (p.count) {
+                report->print("  backtrace:");
+                for (int b = 0; b < p.count; b++) report->printf(" 0x%08x", (unsigned)p.pcs[b]);
+                report->println();
+            } else if (watchdogRunning) {
+                report->println("  no backtrace: the loop task was busy whenever it was checked");
+            }
+        }
+        if (pendingDropped) report->printf("  and %u more stalls\n", (unsigned)pendingDropped);
+    }
+    pendingCount = 0;
+    pendingDropped = 0;
+    passActive = false;
+}
+
+const LoopWatchHistogram& loopWatchHistogram() {
+    return histogram;
+}
+
+LoopWatchStats loopWatchStats() {
+    return stats;
+}
+
+// JSON
+
+size_t loopWatchJson(char* out, size_t size) {
+    if (size == 0) return 0;
+    uint32_t stalls = 0, resets = 0;
+    for (uint32_t i = 0; i < histogram.causeCount; i++) {
+        stalls += histogram.causes[i].stalls;
+        resets += histogram.causes[i].resets;
+    }
+
+    size_t n = snprintf(out, size,
+                        "{\"boots\":%u,\"stalls\":%u,\"resets\":%u,\"budget_ms\":%u,\"loop_max_ms\":%u,\"bucket_ms\":[",
+                        (unsigned)histogram.boots, (unsigned)stalls, (unsigned)resets, (unsigned)(budgetUs / 1000),
+                        (unsigned)(stats.maxPassUs / 1000));
+    for (int b = 0; b < LOOP_WATCH_BUCKETS - 1 && n < size; b++) {
+        n += snprintf(out + n, size - n, "%s%u", b ? "," : "", (unsigned)LOOP_WATCH_BUCKET_MS[b]);
+    }
+    if (n < size) n += snprintf(out + n, size - n, "],\"causes\":{");
+
+    // Each cause goes in whole or not at all; 2 bytes stay free for "}}"
+    bool first = true;
+    for (uint32_t i = 0; i < histogram.causeCount && n + 2 < size; i++) {
+        const LoopWatchCause& c = histogram.causes[i];
+        char entry[200];
+        int e = snprintf(entry, sizeof(entry), "%s\"%s\":{\"stalls\":%u,\"resets\":%u,\"max_ms\":%u,\"total_ms\":%u,\"histogram\":[",
+                         first ? "" : ",", c.name, (unsigned)c.stalls, (unsigned)c.resets, (unsigned)c.maxMs,
+                         (unsigned)c.totalMs);
+        for (int b = 0; b < LOOP_WATCH_BUCKETS; b++) {
+            e += snprintf(entry + e, sizeof(entry) - e, "%s%u", b ? "," : "", (unsigned)c.buckets[b]);
+        }
+        e += snprintf(entry + e, sizeof(entry) - e, "]}");
+        if (n + e + 2 >= size) break;
+        memcpy(out + n, entry, e);
+        n += e;
+        first = false;
+    }
+    if (n + 2 >= size) {
+        out[0] = 0;
+        return 0;
+    }
+    memcpy(out + n, "}}", 3);
+    return n + 2;
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+// Software watchdog for loop(): where it stalled, with what call stack, and
+// how often each cause has stalled it, across resets.
+//
+//   loopWatchStart();                          // setup()
+//
+//   void loop() {
+//       loopWatchBegin();
+//       loopWatchSection("wifi");
+//       checkWiFiConnection();
+//       loopWatchSection("scd4x");
+//       error = scd4x.readMeasurement(co2, temperature, humidity);
+//       loopWatchEnd();                        // prints the stalls of this pass
+//       delay(100);
+//   }
+//
+//   bool connectMQTT() {
+//       LoopWatchScope watch("mqtt.connect");  // back to the caller's section on return
+//       ...
+//   }
+//
+// A section runs from its mark to the next one (or loopWatchEnd()). One that
+// takes longer than the budget (LOOP_WATCH_BUDGET_MS) is a stall: it is
+// counted under the section's name in a histogram of stall durations. The
+// histogram lives in RTC memory with a checksum, so it survives resets and
+// panics (not power-off). A reset while a section was over its budget (task
+// watchdog, brownout, a panic further on) counts as a reset of that cause.
+//
+// On the ESP32-P4 a watchdog task looks at the current section every
+// LOOP_WATCH_PERIOD_MS. Once it is over budget and the loop task is blocked
+// (in a delay, a socket, an I2C transfer) it takes a backtrace of the loop
+// task: the saved PC and return address, then every word on the loop task's
+// stack that points into code. The RISC-V build has no frame pointers, so the
+// stack cannot be unwound exactly; the scan can include stale return
+// addresses further down. Decode the addresses with
+//     riscv32-esp-elf-addr2line -pfiaC -e .pio/build/<env>/firmware.elf 0x4ff0...
+// A loop task that is busy on its core when checked has no saved context; the
+// watchdog tries again the next period. Without the watchdog task (host
+// builds, Xtensa boards) stalls are still timed and counted, without a
+// backtrace.
+//
+// Section names must outlive the watchdog (string literals); the histogram
+// keeps a copy of at most LOOP_WATCH_NAME_LENGTH - 1 characters.
+
+#include <Arduino.h>
+
+#ifndef LOOP_WATCH_BUDGET_MS
+#define LOOP_WATCH_BUDGET_MS 250
+#endif
+
+#ifndef LOOP_WATCH_PERIOD_MS
+#define LOOP_WATCH_PERIOD_MS 20
+#endif
+
+const int LOOP_WATCH_NAME_LENGTH = 20;
+const int LOOP_WATCH_MAX_CAUSES = 12;       // further causes are counted as "other"
+const int LOOP_WATCH_BUCKETS = 6;
+const int LOOP_WATCH_BACKTRACE = 12;
+
+// Upper bounds of the first LOOP_WATCH_BUCKETS - 1 buckets; the last one is
+// open. The first bucket starts at the budget.
+extern const uint32_t LOOP_WATCH_BUCKET_MS[LOOP_WATCH_BUCKETS - 1];
+
+struct LoopWatchCause {
+    char name[LOOP_WATCH_NAME_LENGTH];
+    uint32_t stalls;
+    uint32_t resets;        // resets while over budget in this section
+    uint32_t maxMs;
+    uint32_t totalMs;
+    uint32_t buckets[LOOP_WATCH_BUCKETS];
+};
+
+struct LoopWatchHistogram {
+    uint32_t magic;
+    uint32_t boots;         // since the histogram was last cleared
+    uint32_t causeCount;
+    LoopWatchCause causes[LOOP_WATCH_MAX_CAUSES];
+    uint32_t checksum;
+};
+
+struct LoopWatchStats {
+    uint32_t passes;        // loopWatchBegin() calls since boot
+    uint32_t stalls;        // since boot
+    uint32_t lastPassUs;
+    uint32_t maxPassUs;
+    uint32_t backtraces;    // stalls the watchdog task caught in the act
+};
+
+// Checks the histogram in RTC memory (starting a new one when it is not
+// valid) and starts the watchdog task on the other core. Call from setup():
+// the calling task is the one that gets watched. Returns true when the
+// histogram was kept from before the reset.
+bool loopWatchStart(Print& report = Serial, uint32_t budgetMs = LOOP_WATCH_BUDGET_MS);
+
+void loopWatchBegin();
+void loopWatchSection(const char* name);
+// Ends the pass: records its time and prints the stalls seen since the
+// previous call, each with the pass's section timeline and backtrace
+void loopWatchEnd();
+
+// Changes the current section and returns the one before; the previous
+// section starts over when it is restored
+const char* loopWatchSwap(const char* name);
+
+const LoopWatchHistogram& loopWatchHistogram();
+LoopWatchStats loopWatchStats();
+void loopWatchClear();
+
+// The histogram as one JSON object, for example as an MQTT diagnostics
+// payload. Causes that do not fit into `size` are left out. Returns the length.
+size_t loopWatchJson(char* out, size_t size);
+
+class LoopWatchScope {
+public:
+    explicit LoopWatchScope(const char* name) : _previous(loopWatchSwap(name)) {}
+    ~LoopWatchScope() { loopWatchSwap(_previous); }
+
+private:
+    const char* _previous;
+};
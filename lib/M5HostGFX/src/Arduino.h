@@ -0,0 +1,262 @@
+#pragma once
+
+// Host (Linux) stand-in for the subset of the Arduino core used by the
+// sketches in this repository. Only compiled for `platform = native`.
+
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <math.h>
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <type_traits>
+
+#define M5HOST 1
+
+using std::abs;
+using std::max;
+using std::min;
+
+#define PI 3.1415926535897932384626433832795
+#define HALF_PI 1.5707963267948966192313216916398
+#define TWO_PI 6.283185307179586476925286766559
+#define DEG_TO_RAD 0.017453292519943295769236907684886
+#define RAD_TO_DEG 57.295779513082320876798154814105
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+#define radians(deg) ((deg) * DEG_TO_RAD)
+#define degrees(rad) ((rad) * RAD_TO_DEG)
+#define sq(x) ((x) * (x))
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+// Time
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield();
+
+// Random numbers (deterministic unless randomSeed() is called)
+long random(long howbig);
+long random(long howsmall, long howbig);
+void randomSeed(unsigned long seed);
+
+long map(long x, long in_min, long in_max, long out_min, long out_max);
+
+// Virtual clock: once enabled, millis()/micros() only move when the host calls
+// hostAdvanceClock() (delay() advances it too), so renders that depend on time
+// are reproducible. hostWallMicros() always reads the real clock.
+void hostUseVirtualClock(bool enabled);
+void hostAdvanceClock(unsigned long us);
+void hostSetClock(unsigned long us);    // never moves the clock backwards
+unsigned long hostWallMicros();
+
+// Host process control
+int hostArgc();
+char** hostArgv();
+const char* hostArg(const char* name, const char* fallback = nullptr);  // --name=value
+void hostExit(int code);
+
+class String {
+public:
+    String() {}
+    String(const char* s) : _s(s ? s : "") {}
+    String(const std::string& s) : _s(s) {}
+    explicit String(char c) : _s(1, c) {}
+    explicit String(unsigned char value, unsigned char base = DEC) : String((unsigned long)value, base) {}
+    explicit String(int value, unsigned char base = DEC) : String((long)value, base) {}
+    explicit String(unsigned int value, unsigned char base = DEC) : String((unsigned long)value, base) {}
+    explicit String(long value, unsigned char base = DEC);
+    explicit String(unsigned long value, unsigned char base = DEC);
+    explicit String(long long value, unsigned char base = DEC) : String((long)value, base) {}
+    explicit String(unsigned long long value, unsigned char base = DEC) : String((unsigned long)value, base) {}
+    explicit String(float value, unsigned int decimalPlaces = 2) : String((double)value, decimalPlaces) {}
+    explicit String(double value, unsigned int decimalPlaces = 2);
+
+    const char* c_str() const { return _s.c_str(); }
+    unsigned int length() const { return _s.size(); }
+    bool isEmpty() const { return _s.empty(); }
+    void reserve(unsigned int size) { _s.reserve(size); }
+
+    char charAt(unsigned int index) const { return index < _s.size() ? _s[index] : 0; }
+    char operator[](unsigned int index) const { return charAt(index); }
+    char& operator[](unsigned int index) { return _s[index]; }
+    String substring(unsigned int from) const { return from < _s.size() ? String(_s.substr(from)) : String(); }
+    String substring(unsigned int from, unsigned int to) const;
+    int indexOf(char c, unsigned int from = 0) const;
+    int indexOf(const String& s, unsigned int from = 0) const;
+    bool startsWith(const String& s) const { return _s.compare(0, s._s.size(), s._s) == 0; }
+    bool endsWith(const String& s) const;
+    bool equals(const String& s) const { return _s == s._s; }
+    long toInt() const { return strtol(_s.c_str(), nullptr, 10); }
+    float toFloat() const { return strtof(_s.c_str(), nullptr); }
+    void toUpperCase();
+    void toLowerCase();
+    void trim();
+
+    String& operator+=(const String& rhs) { _s += rhs._s; return *this; }
+    String& operator+=(const char* rhs) { _s += rhs; return *this; }
+    String& operator+=(char c) { _s += c; return *this; }
+    template <typename T, typename std::enable_if<std::is_arithmetic<T>::value && !std::is_same<T, char>::value, int>::type = 0>
+    String& operator+=(T value) { return *this += String(value); }
+    bool concat(const String& rhs) { _s += rhs._s; return true; }
+
+    bool operator==(const String& rhs) const { return _s == rhs._s; }
+    bool operator==(const char* rhs) const { return _s == (rhs ? rhs : ""); }
+    bool operator!=(const String& rhs) const { return !(*this == rhs); }
+    bool operator!=(const char* rhs) const { return !(*this == rhs); }
+    bool operator<(const String& rhs) const { return _s < rhs._s; }
+
+    const std::string& str() const { return _s; }
+
+private:
+    std::string _s;
+};
+
+inline String operator+(const String& a, const String& b) { String r(a); r += b; return r; }
+inline String operator+(const String& a, const char* b) { String r(a); r += b; return r; }
+inline String operator+(const char* a, const String& b) { String r(a); r += b; return r; }
+inline String operator+(const String& a, char c) { String r(a); r += c; return r; }
+template <typename T, typename std::enable_if<std::is_arithmetic<T>::value && !std::is_same<T, char>::value, int>::type = 0>
+inline String operator+(const String& a, T value) { return a + String(value); }
+
+class Print;
+
+class Printable {
+public:
+    virtual ~Printable() {}
+    virtual size_t printTo(Print& p) const = 0;
+};
+
+// Serial goes to stdout
+class Print {
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t* buffer, size_t size);
+    size_t write(const char* s) { return write((const uint8_t*)s, strlen(s)); }
+
+    size_t print(const char* s) { return write(s); }
+    size_t print(const String& s) { return write(s.c_str()); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(int n, int base = DEC) { return print(String(n, base)); }
+    size_t print(unsigned int n, int base = DEC) { return print(String(n, base)); }
+    size_t print(long n, int base = DEC) { return print(String(n, base)); }
+    size_t print(unsigned long n, int base = DEC) { return print(String(n, base)); }
+    size_t print(double n, int digits = 2) { return print(String(n, digits)); }
+    size_t print(const Printable& p) { return p.printTo(*this); }
+
+    template <typename T>
+    size_t println(const T& value) { size_t n = print(value); return n + println(); }
+    template <typename T>
+    size_t println(const T& value, int format) { size_t n = print(value, format); return n + println(); }
+    size_t println() { return write((const uint8_t*)"\r\n", 2); }
+
+    size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+};
+
+class HostSerial : public Print {
+public:
+    void begin(unsigned long baud) { (void)baud; }
+    void end() {}
+    int available() { return 0; }
+    int read() { return -1; }
+    void flush() { fflush(stdout); }
+    void setTxBufferSize(size_t size) { (void)size; }
+    size_t write(uint8_t c) override { return fwrite(&c, 1, 1, stdout); }
+    size_t write(const uint8_t* buffer, size_t size) override { return fwrite(buffer, 1, size, stdout); }
+    using Print::write;
+    operator bool() const { return true; }
+};
+
+extern HostSerial Serial;
+
+class IPAddress : public Printable {
+public:
+    IPAddress() {}
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : _bytes{a, b, c, d} {}
+    explicit IPAddress(uint32_t address) { memcpy(_bytes, &address, 4); }
+
+    uint8_t operator[](int index) const { return _bytes[index]; }
+    operator uint32_t() const { uint32_t a; memcpy(&a, _bytes, 4); return a; }
+    bool operator==(const IPAddress& rhs) const { return memcmp(_bytes, rhs._bytes, 4) == 0; }
+    bool operator!=(const IPAddress& rhs) const { return !(*this == rhs); }
+
+    String toString() const {
+        char buf[16];
+        snprintf(buf, sizeof(buf), "%u.%u.%u.%u", _bytes[0], _bytes[1], _bytes[2], _bytes[3]);
+        return String(buf);
+    }
+    size_t printTo(Print& p) const override { return p.print(toString()); }
+
+private:
+    uint8_t _bytes[4] = {0, 0, 0, 0};
+};
+
+// Base of network clients (Arduino's Client.h); the host network stand-ins derive from it.
+// The byte stream calls default to a closed connection for stand-ins that only
+// track the connection state.
+class Client {
+public:
+    virtual ~Client() {}
+    virtual int connect(IPAddress ip, uint16_t port) { return connect(ip.toString().c_str(), port); }
+    virtual int connect(const char* host, uint16_t port) { (void)host; (void)port; return 0; }
+    virtual size_t write(const uint8_t* buf, size_t size) { (void)buf; (void)size; return 0; }
+    virtual int available() { return 0; }
+    virtual int read(uint8_t* buf, size_t size) { (void)buf; (void)size; return -1; }
+    virtual uint8_t connected() = 0;
+    virtual void stop() = 0;
+};
+
+// GPIO numbers only matter to pin setup calls, which are no-ops on the host
+enum gpio_num_t {
+    GPIO_NUM_NC = -1,
+    GPIO_NUM_0, GPIO_NUM_1, GPIO_NUM_2, GPIO_NUM_3, GPIO_NUM_4, GPIO_NUM_5, GPIO_NUM_6, GPIO_NUM_7,
+    GPIO_NUM_8, GPIO_NUM_9, GPIO_NUM_10, GPIO_NUM_11, GPIO_NUM_12, GPIO_NUM_13, GPIO_NUM_14, GPIO_NUM_15,
+    GPIO_NUM_16, GPIO_NUM_17, GPIO_NUM_18, GPIO_NUM_19, GPIO_NUM_20, GPIO_NUM_21, GPIO_NUM_22, GPIO_NUM_23,
+    GPIO_NUM_24, GPIO_NUM_25, GPIO_NUM_26, GPIO_NUM_27, GPIO_NUM_28, GPIO_NUM_29, GPIO_NUM_30, GPIO_NUM_31,
+    GPIO_NUM_32, GPIO_NUM_33, GPIO_NUM_34, GPIO_NUM_35, GPIO_NUM_36, GPIO_NUM_37, GPIO_NUM_38, GPIO_NUM_39,
+    GPIO_NUM_40, GPIO_NUM_41, GPIO_NUM_42, GPIO_NUM_43, GPIO_NUM_44, GPIO_NUM_45, GPIO_NUM_46, GPIO_NUM_47,
+    GPIO_NUM_48, GPIO_NUM_49, GPIO_NUM_50, GPIO_NUM_51, GPIO_NUM_52, GPIO_NUM_53, GPIO_NUM_54, GPIO_NUM_MAX
+};
+
+// Heap figures are simulated: the host library accounts for buffers it allocates
+// on behalf of the sketch (sprites, framebuffers) against a fixed-size heap
+class HostESP {
+public:
+    uint32_t getHeapSize();
+    uint32_t getFreeHeap();
+    uint32_t getMinFreeHeap();
+    uint32_t getMaxAllocHeap();
+    uint32_t getPsramSize() { return 0; }
+    uint32_t getFreePsram() { return 0; }
+    uint32_t getCpuFreqMHz() { return 360; }
+    uint64_t getEfuseMac() { return 0x0000C0FFEE5A5A00ULL; }
+    void restart() { hostExit(0); }
+};
+
+extern HostESP ESP;
+
+void hostHeapAlloc(size_t bytes);
+void hostHeapFree(size_t bytes);
+
+// Sketch entry points
+void setup();
+void loop();
+
+// Optional harness hooks around the sketch, called by the host main(). The
+// library's own definitions are empty and weak; a harness library (e.g. a
+// replay driver) overrides them.
+void hostBeforeSetup();
+void hostBeforeLoop();
+void hostAfterLoop();
@@ -0,0 +1,5 @@
+#pragma once
+
+// Host stand-in for <M5GFX.h>: see host_gfx.h
+
+#include "host_gfx.h"
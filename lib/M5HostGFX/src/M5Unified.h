@@ -0,0 +1,166 @@
+#pragma once
+
+// Host stand-in for <M5Unified.h>. The display is an in-memory framebuffer,
+// buttons and touch are driven by scripted input (hostPress()/hostTouch()),
+// and the speaker only records what it was asked to play.
+
+#include "Arduino.h"
+#include "M5GFX.h"
+
+namespace m5 {
+
+class Button_Class {
+public:
+    bool isPressed() const { return _pressed; }
+    bool isReleased() const { return !_pressed; }
+    bool wasPressed() const { return _pressed && !_wasPressed; }
+    bool wasReleased() const { return !_pressed && _wasPressed; }
+    bool wasClicked() const { return wasReleased(); }
+    bool pressedFor(uint32_t ms) const { return _pressed && millis() - _changeTime >= ms; }
+    bool wasHold() const { return false; }
+
+    // Host input: state seen by the next M5.update()
+    void hostPress(bool pressed) { _next = pressed; }
+
+    void update() {
+        _wasPressed = _pressed;
+        if (_next != _pressed) _changeTime = millis();
+        _pressed = _next;
+    }
+
+private:
+    bool _pressed = false;
+    bool _wasPressed = false;
+    bool _next = false;
+    uint32_t _changeTime = 0;
+};
+
+struct touch_detail_t {
+    int16_t x = -1, y = -1;
+    int16_t prev_x = -1, prev_y = -1;
+    int16_t base_x = -1, base_y = -1;
+    uint32_t base_msec = 0;
+    bool pressed = false;
+    bool wasPressedFlag = false;
+    bool wasReleasedFlag = false;
+
+    bool isPressed() const { return pressed; }
+    bool isReleased() const { return !pressed; }
+    bool wasPressed() const { return wasPressedFlag; }
+    bool wasReleased() const { return wasReleasedFlag; }
+    bool wasClicked() const { return wasReleasedFlag; }
+    bool isHolding() const { return pressed && millis() - base_msec > 500; }
+    bool wasHold() const { return false; }
+    bool wasFlicked() const { return false; }
+    bool isFlicking() const { return false; }
+    int deltaX() const { return x - prev_x; }
+    int deltaY() const { return y - prev_y; }
+    int distanceX() const { return x - base_x; }
+    int distanceY() const { return y - base_y; }
+};
+
+class Touch_Class {
+public:
+    bool isEnabled() const { return true; }
+    uint8_t getCount() const { return _detail.pressed ? 1 : 0; }
+    const touch_detail_t& getDetail(size_t index = 0) const { (void)index; return _detail; }
+
+    // Host input: finger at (x, y), or lifted when pressed == false
+    void hostTouch(int16_t x, int16_t y, bool pressed = true) { _nextX = x; _nextY = y; _nextPressed = pressed; }
+
+    void update() {
+        bool was = _detail.pressed;
+        _detail.prev_x = _detail.x;
+        _detail.prev_y = _detail.y;
+        _detail.pressed = _nextPressed;
+        if (_nextPressed) {
+            _detail.x = _nextX;
+            _detail.y = _nextY;
+        }
+        _detail.wasPressedFlag = _nextPressed && !was;
+        _detail.wasReleasedFlag = !_nextPressed && was;
+        if (_detail.wasPressedFlag) {
+            _detail.base_x = _detail.x;
+            _detail.base_y = _detail.y;
+            _detail.base_msec = millis();
+        }
+    }
+
+private:
+    touch_detail_t _detail;
+    int16_t _nextX = -1, _nextY = -1;
+    bool _nextPressed = false;
+};
+
+class Speaker_Class {
+public:
+    bool begin() { return true; }
+    void end() {}
+    bool isEnabled() const { return true; }
+    bool isPlaying() const { return millis() < _busyUntil; }
+    void setVolume(uint8_t volume) { _volume = volume; }
+    uint8_t getVolume() const { return _volume; }
+    bool tone(float frequency, uint32_t duration = UINT32_MAX, int channel = -1, bool stopCurrent = true) {
+        (void)channel; (void)stopCurrent;
+        _lastFrequency = frequency;
+        _busyUntil = duration == UINT32_MAX ? UINT32_MAX : millis() + duration;
+        _toneCount++;
+        return true;
+    }
+    void stop() { _busyUntil = 0; }
+
+    // Host inspection
+    float lastFrequency() const { return _lastFrequency; }
+    uint32_t toneCount() const { return _toneCount; }
+
+private:
+    uint8_t _volume = 64;
+    float _lastFrequency = 0;
+    uint32_t _toneCount = 0;
+    unsigned long _busyUntil = 0;
+};
+
+struct config_t {
+    uint32_t serial_baudrate = 115200;
+    bool clear_display = true;
+    bool output_power = true;
+    bool internal_imu = true;
+    bool internal_rtc = true;
+    bool internal_spk = true;
+    bool internal_mic = true;
+    bool external_imu = false;
+    bool external_rtc = false;
+    bool external_spk = false;
+    bool led_brightness = 0;
+};
+
+class M5Unified {
+public:
+    config_t config() const { return config_t(); }
+
+    void begin(const config_t& cfg = config_t()) {
+        Display.begin();
+        if (cfg.clear_display) Display.fillScreen(TFT_BLACK);
+    }
+
+    void update() {
+        BtnA.update();
+        BtnB.update();
+        BtnC.update();
+        BtnPWR.update();
+        Touch.update();
+    }
+
+    M5GFX Display;
+    M5GFX& Lcd = Display;
+    Touch_Class Touch;
+    Button_Class BtnA;
+    Button_Class BtnB;
+    Button_Class BtnC;
+    Button_Class BtnPWR;
+    Speaker_Class Speaker;
+};
+
+}  // namespace m5
+
+extern m5::M5Unified M5;
@@ -0,0 +1,244 @@
+#include "Arduino.h"
+
+#include <chrono>
+#include <thread>
+
+HostSerial Serial;
+HostESP ESP;
+
+static const auto startTime = std::chrono::steady_clock::now();
+static bool virtualClock = false;
+static uint64_t virtualMicros = 0;
+static uint32_t randomState = 0x2545F491;
+
+static int argcSaved = 0;
+static char** argvSaved = nullptr;
+
+// Simulated heap (matches the ESP32-P4's internal SRAM order of magnitude)
+static const uint32_t HOST_HEAP_SIZE = 512 * 1024 + 32 * 1024 * 1024;
+static uint32_t heapUsed = 0;
+static uint32_t heapPeak = 0;
+
+unsigned long hostWallMicros() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+// The virtual clock starts at zero, so enable it before anything reads the time
+void hostUseVirtualClock(bool enabled) {
+    virtualClock = enabled;
+}
+
+void hostAdvanceClock(unsigned long us) {
+    virtualMicros += us;
+}
+
+void hostSetClock(unsigned long us) {
+    if (us > virtualMicros) virtualMicros = us;
+}
+
+unsigned long millis() {
+    return micros() / 1000;
+}
+
+unsigned long micros() {
+    return virtualClock ? (unsigned long)virtualMicros : hostWallMicros();
+}
+
+void delay(unsigned long ms) {
+    if (virtualClock) {
+        virtualMicros += ms * 1000ULL;
+        return;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void delayMicroseconds(unsigned int us) {
+    if (virtualClock) {
+        virtualMicros += us;
+        return;
+    }
+    std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+void yield() {
+    std::this_thread::yield();
+}
+
+long random(long howbig) {
+    if (howbig <= 0) return 0;
+    // xorshift32: fast and identical on every host, so runs are reproducible
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 17;
+    randomState ^= randomState << 5;
+    return randomState % howbig;
+}
+
+long random(long howsmall, long howbig) {
+    if (howsmall >= howbig) return howsmall;
+    return howsmall + random(howbig - howsmall);
+}
+
+void randomSeed(unsigned long seed) {
+    if (seed != 0) randomState = seed;
+}
+
+long map(long x, long in_min, long in_max, long out_min, long out_max) {
+    if (in_max == in_min) return out_min;
+    return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
+}
+
+int hostArgc() {
+    return argcSaved;
+}
+
+char** hostArgv() {
+    return argvSaved;
+}
+
+const char* hostArg(const char* name, const char* fallback) {
+    size_t len = strlen(name);
+    for (int i = 1; i < argcSaved; i++) {
+        const char* a = argvSaved[i];
+        if (strncmp(a, "--", 2) == 0 && strncmp(a + 2, name, len) == 0) {
+            if (a[2 + len] == '=') return a + 3 + len;
+            if (a[2 + len] == 0) return "1";
+        }
+    }
+    return fallback;
+}
+
+void hostExit(int code) {
+    fflush(stdout);
+    exit(code);
+}
+
+// String
+
+String::String(long value, unsigned char base) {
+    if (base == DEC) {
+        _s = std::to_string(value);
+    } else {
+        *this = String((unsigned long)value, base);
+    }
+}
+
+String::String(unsigned long value, unsigned char base) {
+    if (base < 2 || base > 16) base = DEC;
+    char buf[8 * sizeof(long) + 1];
+    char* p = buf + sizeof(buf) - 1;
+    *p = 0;
+    do {
+        *--p = "0123456789abcdef"[value % base];
+        value /= base;
+    } while (value);
+    _s = p;
+}
+
+String::String(double value, unsigned int decimalPlaces) {
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%.*f", decimalPlaces, value);
+    _s = buf;
+}
+
+String String::substring(unsigned int from, unsigned int to) const {
+    if (from > to) std::swap(from, to);
+    if (from >= _s.size()) return String();
+    return String(_s.substr(from, to - from));
+}
+
+int String::indexOf(char c, unsigned int from) const {
+    size_t pos = _s.find(c, from);
+    return pos == std::string::npos ? -1 : (int)pos;
+}
+
+int String::indexOf(const String& s, unsigned int from) const {
+    size_t pos = _s.find(s._s, from);
+    return pos == std::string::npos ? -1 : (int)pos;
+}
+
+bool String::endsWith(const String& s) const {
+    return _s.size() >= s._s.size() && _s.compare(_s.size() - s._s.size(), s._s.size(), s._s) == 0;
+}
+
+void String::toUpperCase() {
+    for (auto& c : _s) c = toupper((unsigned char)c);
+}
+
+void String::toLowerCase() {
+    for (auto& c : _s) c = tolower((unsigned char)c);
+}
+
+void String::trim() {
+    size_t b = _s.find_first_not_of(" \t\r\n");
+    size_t e = _s.find_last_not_of(" \t\r\n");
+    _s = (b == std::string::npos) ? std::string() : _s.substr(b, e - b + 1);
+}
+
+// Print
+
+size_t Print::write(const uint8_t* buffer, size_t size) {
+    size_t n = 0;
+    while (size--) n += write(*buffer++);
+    return n;
+}
+
+size_t Print::printf(const char* format, ...) {
+    char small[256];
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(small, sizeof(small), format, args);
+    va_end(args);
+    if (len < 0) return 0;
+    if ((size_t)len < sizeof(small)) return write((const uint8_t*)small, len);
+
+    std::string big(len + 1, '\0');
+    va_start(args, format);
+    vsnprintf(&big[0], big.size(), format, args);
+    va_end(args);
+    return write((const uint8_t*)big.data(), len);
+}
+
+// Heap accounting
+
+void hostHeapAlloc(size_t bytes) {
+    heapUsed += bytes;
+    if (heapUsed > heapPeak) heapPeak = heapUsed;
+}
+
+void hostHeapFree(size_t bytes) {
+    heapUsed = bytes > heapUsed ? 0 : heapUsed - bytes;
+}
+
+uint32_t HostESP::getHeapSize() {
+    return HOST_HEAP_SIZE;
+}
+
+uint32_t HostESP::getFreeHeap() {
+    return HOST_HEAP_SIZE - heapUsed;
+}
+
+uint32_t HostESP::getMinFreeHeap() {
+    return HOST_HEAP_SIZE - heapPeak;
+}
+
+uint32_t HostESP::getMaxAllocHeap() {
+    return HOST_HEAP_SIZE - heapUsed;
+}
+
+// Arduino-style entry point: setup() once, then loop() until the sketch calls hostExit()
+
+__attribute__((weak)) void hostBeforeSetup() {}
+__attribute__((weak)) void hostBeforeLoop() {}
+__attribute__((weak)) void hostAfterLoop() {}
+
+int main(int argc, char** argv) {
+    argcSaved = argc;
+    argvSaved = argv;
+    hostBeforeSetup();
+    setup();
+    for (;;) {
+        hostBeforeLoop();
+        loop();
+        hostAfterLoop();
+    }
+}
@@ -0,0 +1,548 @@
+#include "host_gfx.h"
+#include "host_font.h"
+
+// LovyanGFX
+
+void LovyanGFX::setBuffer(uint16_t* buffer, int32_t w, int32_t h) {
+    _buffer = buffer;
+    _width = buffer ? w : 0;
+    _height = buffer ? h : 0;
+    clearClipRect();
+}
+
+void LovyanGFX::setClipRect(int32_t x, int32_t y, int32_t w, int32_t h) {
+    _clipX0 = max<int32_t>(0, x);
+    _clipY0 = max<int32_t>(0, y);
+    _clipX1 = min<int32_t>(_width, x + w);
+    _clipY1 = min<int32_t>(_height, y + h);
+}
+
+void LovyanGFX::clearClipRect() {
+    _clipX0 = 0;
+    _clipY0 = 0;
+    _clipX1 = _width;
+    _clipY1 = _height;
+}
+
+void LovyanGFX::drawPixel(int32_t x, int32_t y, uint16_t color) {
+    if (x < _clipX0 || x >= _clipX1 || y < _clipY0 || y >= _clipY1) return;
+    _buffer[y * _width + x] = color;
+}
+
+uint16_t LovyanGFX::readPixel(int32_t x, int32_t y) const {
+    if (x < 0 || x >= _width || y < 0 || y >= _height) return 0;
+    return _buffer[y * _width + x];
+}
+
+void LovyanGFX::fillRect(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t color) {
+    if (w < 0) { x += w + 1; w = -w; }
+    if (h < 0) { y += h + 1; h = -h; }
+    int32_t x0 = max(x, _clipX0);
+    int32_t y0 = max(y, _clipY0);
+    int32_t x1 = min(x + w, _clipX1);
+    int32_t y1 = min(y + h, _clipY1);
+    if (x0 >= x1 || y0 >= y1) return;
+    for (int32_t yy = y0; yy < y1; yy++) {
+        uint16_t* p = _buffer + yy * _width + x0;
+        std::fill(p, p + (x1 - x0), color);
+    }
+}
+
+void LovyanGFX::drawFastHLine(int32_t x, int32_t y, int32_t w, uint16_t color) {
+    fillRect(x, y, w, 1, color);
+}
+
+void LovyanGFX::drawFastVLine(int32_t x, int32_t y, int32_t h, uint16_t color) {
+    fillRect(x, y, 1, h, color);
+}
+
+void LovyanGFX::drawRect(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t color) {
+    if (w <= 0 || h <= 0) return;
+    drawFastHLine(x, y, w, color);
+    drawFastHLine(x, y + h - 1, w, color);
+    drawFastVLine(x, y + 1, h - 2, color);
+    drawFastVLine(x + w - 1, y + 1, h - 2, color);
+}
+
+void LovyanGFX::drawLine(int32_t x0, int32_t y0, int32_t x1, int32_t y1, uint16_t color) {
+    if (y0 == y1) {
+        if (x1 < x0) std::swap(x0, x1);
+        drawFastHLine(x0, y0, x1 - x0 + 1, color);
+        return;
+    }
+    if (x0 == x1) {
+        if (y1 < y0) std::swap(y0, y1);
+        drawFastVLine(x0, y0, y1 - y0 + 1, color);
+        return;
+    }
+
+    // Bresenham
+    int32_t dx = abs(x1 - x0), sx = x0 < x1 ? 1 : -1;
+    int32_t dy = -abs(y1 - y0), sy = y0 < y1 ? 1 : -1;
+    int32_t err = dx + dy;
+    for (;;) {
+        drawPixel(x0, y0, color);
+        if (x0 == x1 && y0 == y1) break;
+        int32_t e2 = 2 * err;
+        if (e2 >= dy) { err += dy; x0 += sx; }
+        if (e2 <= dx) { err += dx; y0 += sy; }
+    }
+}
+
+void LovyanGFX::circleHelper(int32_t x0, int32_t y0, int32_t r, uint8_t corners, uint16_t color) {
+    int32_t f = 1 - r;
+    int32_t ddF_x = 1;
+    int32_t ddF_y = -2 * r;
+    int32_t x = 0;
+    int32_t y = r;
+    while (x < y) {
+        if (f >= 0) { y--; ddF_y += 2; f += ddF_y; }
+        x++;
+        ddF_x += 2;
+        f += ddF_x;
+        if (corners & 0x4) { drawPixel(x0 + x, y0 + y, color); drawPixel(x0 + y, y0 + x, color); }
+        if (corners & 0x2) { drawPixel(x0 + x, y0 - y, color); drawPixel(x0 + y, y0 - x, color); }
+        if (corners & 0x8) { drawPixel(x0 - y, y0 + x, color); drawPixel(x0 - x, y0 + y, color); }
+        if (corners & 0x1) { drawPixel(x0 - y, y0 - x, color); drawPixel(x0 - x, y0 - y, color); }
+    }
+}
+
+void LovyanGFX::fillCircleHelper(int32_t x0, int32_t y0, int32_t r, uint8_t sides, int32_t delta, uint16_t color) {
+    int32_t f = 1 - r;
+    int32_t ddF_x = 1;
+    int32_t ddF_y = -2 * r;
+    int32_t x = 0;
+    int32_t y = r;
+    int32_t px = x;
+    int32_t py = y;
+    delta++;
+    while (x < y) {
+        if (f >= 0) { y--; ddF_y += 2; f += ddF_y; }
+        x++;
+        ddF_x += 2;
+        f += ddF_x;
+        if (x < y + 1) {
+            if (sides & 1) drawFastVLine(x0 + x, y0 - y, 2 * y + delta, color);
+            if (sides & 2) drawFastVLine(x0 - x, y0 - y, 2 * y + delta, color);
+        }
+        if (y != py) {
+            if (sides & 1) drawFastVLine(x0 + py, y0 - px, 2 * px + delta, color);
+            if (sides & 2) drawFastVLine(x0 - py, y0 - px, 2 * px + delta, color);
+            py = y;
+        }
+        px = x;
+    }
+}
+
+void LovyanGFX::drawCircle(int32_t x, int32_t y, int32_t r, uint16_t color) {
+    if (r < 0) return;
+    drawPixel(x, y + r, color);
+    drawPixel(x, y - r, color);
+    drawPixel(x + r, y, color);
+    drawPixel(x - r, y, color);
+    circleHelper(x, y, r, 0xF, color);
+}
+
+void LovyanGFX::fillCircle(int32_t x, int32_t y, int32_t r, uint16_t color) {
+    if (r < 0) return;
+    drawFastVLine(x, y - r, 2 * r + 1, color);
+    fillCircleHelper(x, y, r, 3, 0, color);
+}
+
+void LovyanGFX::drawRoundRect(int32_t x, int32_t y, int32_t w, int32_t h, int32_t r, uint16_t color) {
+    if (w <= 0 || h <= 0) return;
+    r = min(r, min(w, h) / 2);
+    drawFastHLine(x + r, y, w - 2 * r, color);
+    drawFastHLine(x + r, y + h - 1, w - 2 * r, color);
+    drawFastVLine(x, y + r, h - 2 * r, color);
+    drawFastVLine(x + w - 1, y + r, h - 2 * r, color);
+    circleHelper(x + r, y + r, r, 1, color);
+    circleHelper(x + w - r - 1, y + r, r, 2, color);
+    circleHelper(x + w - r - 1, y + h - r - 1, r, 4, color);
+    circleHelper(x + r, y + h - r - 1, r, 8, color);
+}
+
+void LovyanGFX::fillRoundRect(int32_t x, int32_t y, int32_t w, int32_t h, int32_t r, uint16_t color) {
+    if (w <= 0 || h <= 0) return;
+    r = min(r, min(w, h) / 2);
+    fillRect(x + r, y, w - 2 * r, h, color);
+    fillCircleHelper(x + w - r - 1, y + r, r, 1, h - 2 * r - 1, color);
+    fillCircleHelper(x + r, y + r, r, 2, h - 2 * r - 1, color);
+}
+
+void LovyanGFX::drawEllipse(int32_t x0, int32_t y0, int32_t rx, int32_t ry, uint16_t color) {
+    if (rx < 0 || ry < 0) return;
+    if (rx == 0) { drawFastVLine(x0, y0 - ry, 2 * ry + 1, color); return; }
+    if (ry == 0) { drawFastHLine(x0 - rx, y0, 2 * rx + 1, color); return; }
+
+    int64_t rx2 = (int64_t)rx * rx;
+    int64_t ry2 = (int64_t)ry * ry;
+    int64_t fx2 = 4 * rx2;
+    int64_t fy2 = 4 * ry2;
+    int64_t x, y, s;
+    for (x = 0, y = ry, s = 2 * ry2 + rx2 * (1 - 2 * ry); ry2 * x <= rx2 * y; x++) {
+        drawPixel(x0 + x, y0 + y, color);
+        drawPixel(x0 - x, y0 + y, color);
+        drawPixel(x0 - x, y0 - y, color);
+        drawPixel(x0 + x, y0 - y, color);
+        if (s >= 0) { s += fx2 * (1 - y); y--; }
+        s += ry2 * ((4 * x) + 6);
+    }
+    for (x = rx, y = 0, s = 2 * rx2 + ry2 * (1 - 2 * rx); rx2 * y <= ry2 * x; y++) {
+        drawPixel(x0 + x, y0 + y, color);
+        drawPixel(x0 - x, y0 + y, color);
+        drawPixel(x0 - x, y0 - y, color);
+        drawPixel(x0 + x, y0 - y, color);
+        if (s >= 0) { s += fy2 * (1 - x); x--; }
+        s += rx2 * ((4 * y) + 6);
+    }
+}
+
+void LovyanGFX::fillEllipse(int32_t x0, int32_t y0, int32_t rx, int32_t ry, uint16_t color) {
+    if (rx < 0 || ry < 0) return;
+    if (rx == 0) { drawFastVLine(x0, y0 - ry, 2 * ry + 1, color); return; }
+    if (ry == 0) { drawFastHLine(x0 - rx, y0, 2 * rx + 1, color); return; }
+
+    int64_t rx2 = (int64_t)rx * rx;
+    int64_t ry2 = (int64_t)ry * ry;
+    int64_t fx2 = 4 * rx2;
+    int64_t fy2 = 4 * ry2;
+    int64_t x, y, s;
+    for (x = 0, y = ry, s = 2 * ry2 + rx2 * (1 - 2 * ry); ry2 * x <= rx2 * y; x++) {
+        drawFastHLine(x0 - x, y0 - y, x + x + 1, color);
+        drawFastHLine(x0 - x, y0 + y, x + x + 1, color);
+        if (s >= 0) { s += fx2 * (1 - y); y--; }
+        s += ry2 * ((4 * x) + 6);
+    }
+    for (x = rx, y = 0, s = 2 * rx2 + ry2 * (1 - 2 * rx); rx2 * y <= ry2 * x; y++) {
+        drawFastHLine(x0 - x, y0 - y, x + x + 1, color);
+        drawFastHLine(x0 - x, y0 + y, x + x + 1, color);
+        if (s >= 0) { s += fy2 * (1 - x); x--; }
+        s += rx2 * ((4 * y) + 6);
+    }
+}
+
+void LovyanGFX::drawTriangle(int32_t x0, int32_t y0, int32_t x1, int32_t y1, int32_t x2, int32_t y2, uint16_t color) {
+    drawLine(x0, y0, x1, y1, color);
+    drawLine(x1, y1, x2, y2, color);
+    drawLine(x2, y2, x0, y0, color);
+}
+
+void LovyanGFX::fillTriangle(int32_t x0, int32_t y0, int32_t x1, int32_t y1, int32_t x2, int32_t y2, uint16_t color) {
+    // Sort by y, then fill flat-bottom and flat-top halves one span per row
+    if (y0 > y1) { std::swap(y0, y1); std::swap(x0, x1); }
+    if (y1 > y2) { std::swap(y2, y1); std::swap(x2, x1); }
+    if (y0 > y1) { std::swap(y0, y1); std::swap(x0, x1); }
+
+    if (y0 == y2) {
+        int32_t a = min(x0, min(x1, x2));
+        int32_t b = max(x0, max(x1, x2));
+        drawFastHLine(a, y0, b - a + 1, color);
+        return;
+    }
+
+    int64_t dx01 = x1 - x0, dy01 = y1 - y0;
+    int64_t dx02 = x2 - x0, dy02 = y2 - y0;
+    int64_t dx12 = x2 - x1, dy12 = y2 - y1;
+    int64_t sa = 0, sb = 0;
+    int32_t last = (y1 == y2) ? y1 : y1 - 1;
+    int32_t y;
+    for (y = y0; y <= last; y++) {
+        int32_t a = x0 + sa / dy01;
+        int32_t b = x0 + sb / dy02;
+        sa += dx01;
+        sb += dx02;
+        if (a > b) std::swap(a, b);
+        drawFastHLine(a, y, b - a + 1, color);
+    }
+    sa = dx12 * (y - y1);
+    sb = dx02 * (y - y0);
+    for (; y <= y2; y++) {
+        int32_t a = x1 + sa / dy12;
+        int32_t b = x0 + sb / dy02;
+        sa += dx12;
+        sb += dx02;
+        if (a > b) std::swap(a, b);
+        drawFastHLine(a, y, b - a + 1, color);
+    }
+}
+
+void LovyanGFX::pushImage(int32_t x, int32_t y, int32_t w, int32_t h, const uint16_t* data) {
+    for (int32_t yy = max(y, _clipY0); yy < min(y + h, _clipY1); yy++) {
+        int32_t x0 = max(x, _clipX0);
+        int32_t x1 = min(x + w, _clipX1);
+        if (x0 >= x1) return;
+        memcpy(_buffer + yy * _width + x0, data + (yy - y) * w + (x0 - x), (x1 - x0) * sizeof(uint16_t));
+    }
+}
+
+void LovyanGFX::pushImage(int32_t x, int32_t y, int32_t w, int32_t h, const uint16_t* data, uint16_t transparent) {
+    for (int32_t yy = max(y, _clipY0); yy < min(y + h, _clipY1); yy++) {
+        const uint16_t* src = data + (yy - y) * w;
+        for (int32_t xx = max(x, _clipX0); xx < min(x + w, _clipX1); xx++) {
+            uint16_t c = src[xx - x];
+            if (c != transparent) _buffer[yy * _width + xx] = c;
+        }
+    }
+}
+
+void LovyanGFX::pushImage(int32_t x, int32_t y, int32_t w, int32_t h, const lgfx::swap565_t* data) {
+    for (int32_t yy = max(y, _clipY0); yy < min(y + h, _clipY1); yy++) {
+        const lgfx::swap565_t* src = data + (yy - y) * w;
+        for (int32_t xx = max(x, _clipX0); xx < min(x + w, _clipX1); xx++) {
+            uint16_t c = src[xx - x].raw;
+            _buffer[yy * _width + xx] = (c >> 8) | (c << 8);
+        }
+    }
+}
+
+// Text
+
+void LovyanGFX::setTextSize(float sx, float sy) {
+    _textSizeX = max(1, (int32_t)lroundf(sx));
+    _textSizeY = max(1, (int32_t)lroundf(sy));
+}
+
+// Decodes one UTF-8 sequence starting at *s, advancing the pointer
+static uint32_t nextCodepoint(const char*& s) {
+    uint8_t c = *s++;
+    if (c < 0x80) return c;
+    int extra = (c >= 0xF0) ? 3 : (c >= 0xE0) ? 2 : (c >= 0xC0) ? 1 : 0;
+    uint32_t code = c & (0x3F >> extra);
+    while (extra-- && (*s & 0xC0) == 0x80) {
+        code = (code << 6) | (*s++ & 0x3F);
+    }
+    return code;
+}
+
+int32_t LovyanGFX::textWidth(const char* str) const {
+    int32_t count = 0;
+    while (*str) {
+        nextCodepoint(str);
+        count++;
+    }
+    return count * 6 * _textSizeX;
+}
+
+void LovyanGFX::drawGlyph(uint32_t code, int32_t x, int32_t y, bool fillBackground) {
+    const uint8_t* glyph = nullptr;
+    if (code >= 32 && code < 127) glyph = hostFont5x7[code - 32];
+    else if (code == 0xB0) glyph = hostFontDegree;
+    else if (code == 0x2022) glyph = hostFontBullet;
+
+    if (fillBackground) {
+        fillRect(x, y, 6 * _textSizeX, 8 * _textSizeY, _textBgColor);
+    }
+    if (!glyph) return;
+
+    for (int32_t col = 0; col < 5; col++) {
+        uint8_t bits = glyph[col];
+        for (int32_t row = 0; row < 7; row++) {
+            if (bits & (1 << row)) {
+                fillRect(x + col * _textSizeX, y + row * _textSizeY, _textSizeX, _textSizeY, _textColor);
+            }
+        }
+    }
+}
+
+size_t LovyanGFX::drawString(const char* str, int32_t x, int32_t y) {
+    int32_t w = textWidth(str);
+    int32_t h = fontHeight();
+
+    // Datum: low two bits select horizontal alignment, the rest vertical
+    uint8_t horizontal = _textDatum & 3;
+    if (horizontal == 1) x -= w / 2;
+    else if (horizontal == 2) x -= w;
+
+    if (_textDatum & baseline_left) y -= 7 * _textSizeY;
+    else if (_textDatum & bottom_left) y -= h;
+    else if (_textDatum & middle_left) y -= h / 2;
+
+    bool fillBackground = _textBgColor != _textColor;
+    if (fillBackground && (int32_t)_textPadding > w) {
+        int32_t pad = _textPadding - w;
+        int32_t left = horizontal == 1 ? pad / 2 : horizontal == 2 ? pad : 0;
+        fillRect(x - left, y, _textPadding, h, _textBgColor);
+    }
+
+    int32_t cx = x;
+    while (*str) {
+        drawGlyph(nextCodepoint(str), cx, y, fillBackground);
+        cx += 6 * _textSizeX;
+    }
+    return w;
+}
+
+size_t LovyanGFX::drawCentreString(const char* str, int32_t x, int32_t y) {
+    uint8_t datum = _textDatum;
+    _textDatum = top_center;
+    size_t w = drawString(str, x, y);
+    _textDatum = datum;
+    return w;
+}
+
+size_t LovyanGFX::drawNumber(long value, int32_t x, int32_t y) {
+    char buf[24];
+    snprintf(buf, sizeof(buf), "%ld", value);
+    return drawString(buf, x, y);
+}
+
+size_t LovyanGFX::drawFloat(float value, uint8_t decimals, int32_t x, int32_t y) {
+    char buf[48];
+    snprintf(buf, sizeof(buf), "%.*f", decimals, value);
+    return drawString(buf, x, y);
+}
+
+size_t LovyanGFX::drawChar(uint16_t uniCode, int32_t x, int32_t y) {
+    drawGlyph(uniCode, x, y, _textBgColor != _textColor);
+    return 6 * _textSizeX;
+}
+
+size_t LovyanGFX::write(uint8_t c) {
+    // Assemble UTF-8 sequences written byte by byte through print()/printf()
+    uint32_t code;
+    if (_utf8Remaining) {
+        _utf8Pending = (_utf8Pending << 6) | (c & 0x3F);
+        if (--_utf8Remaining) return 1;
+        code = _utf8Pending;
+    } else if (c >= 0xC0) {
+        _utf8Remaining = (c >= 0xF0) ? 3 : (c >= 0xE0) ? 2 : 1;
+        _utf8Pending = c & (0x3F >> _utf8Remaining);
+        return 1;
+    } else {
+        code = c;
+    }
+
+    if (code == '\n') {
+        _cursorX = 0;
+        _cursorY += 8 * _textSizeY;
+        return 1;
+    }
+    if (code == '\r') return 1;
+
+    if (_textWrap && _cursorX + 6 * _textSizeX > _width) {
+        _cursorX = 0;
+        _cursorY += 8 * _textSizeY;
+    }
+    drawGlyph(code, _cursorX, _cursorY, _textBgColor != _textColor);
+    _cursorX += 6 * _textSizeX;
+    return 1;
+}
+
+// LGFX_Sprite
+
+void* LGFX_Sprite::createSprite(int32_t w, int32_t h) {
+    deleteSprite();
+    if (w <= 0 || h <= 0) return nullptr;
+    uint16_t* buffer = (uint16_t*)calloc((size_t)w * h, sizeof(uint16_t));
+    if (!buffer) return nullptr;
+    setBuffer(buffer, w, h);
+    hostHeapAlloc(bufferLength());
+    return buffer;
+}
+
+void LGFX_Sprite::deleteSprite() {
+    if (!_buffer) return;
+    hostHeapFree(bufferLength());
+    free(_buffer);
+    setBuffer(nullptr, 0, 0);
+}
+
+void LGFX_Sprite::pushSprite(LovyanGFX* dst, int32_t x, int32_t y) {
+    if (_buffer) dst->pushImage(x, y, _width, _height, _buffer);
+}
+
+void LGFX_Sprite::pushSprite(LovyanGFX* dst, int32_t x, int32_t y, uint16_t transparent) {
+    if (_buffer) dst->pushImage(x, y, _width, _height, _buffer, transparent);
+}
+
+void LGFX_Sprite::pushRotateZoom(float x, float y, float angle, float zoomX, float zoomY) {
+    if (_parent) pushTransformed(_parent, x, y, angle, zoomX, zoomY, false, 0);
+}
+
+void LGFX_Sprite::pushRotateZoom(float x, float y, float angle, float zoomX, float zoomY, uint16_t transparent) {
+    if (_parent) pushTransformed(_parent, x, y, angle, zoomX, zoomY, true, transparent);
+}
+
+void LGFX_Sprite::pushRotateZoom(LovyanGFX* dst, float x, float y, float angle, float zoomX, float zoomY) {
+    pushTransformed(dst, x, y, angle, zoomX, zoomY, false, 0);
+}
+
+void LGFX_Sprite::pushRotateZoom(LovyanGFX* dst, float x, float y, float angle, float zoomX, float zoomY, uint16_t transparent) {
+    pushTransformed(dst, x, y, angle, zoomX, zoomY, true, transparent);
+}
+
+void LGFX_Sprite::pushRotated(LovyanGFX* dst, float angle) {
+    pushTransformed(dst, dst->getPivotX(), dst->getPivotY(), angle, 1.0f, 1.0f, false, 0);
+}
+
+void LGFX_Sprite::pushRotated(LovyanGFX* dst, float angle, uint16_t transparent) {
+    pushTransformed(dst, dst->getPivotX(), dst->getPivotY(), angle, 1.0f, 1.0f, true, transparent);
+}
+
+void LGFX_Sprite::pushTransformed(LovyanGFX* dst, float x, float y, float angle, float zoomX, float zoomY,
+                                  bool useTransparent, uint16_t transparent) {
+    if (!_buffer || zoomX == 0 || zoomY == 0) return;
+
+    float rad = angle * (float)DEG_TO_RAD;
+    float c = cosf(rad);
+    float s = sinf(rad);
+
+    // Destination bounding box of the four transformed corners
+    float corners[4][2] = {
+        {-_pivotX, -_pivotY}, {_width - _pivotX, -_pivotY},
+        {-_pivotX, _height - _pivotY}, {_width - _pivotX, _height - _pivotY}
+    };
+    float minX = 1e9f, minY = 1e9f, maxX = -1e9f, maxY = -1e9f;
+    for (auto& p : corners) {
+        float px = p[0] * zoomX;
+        float py = p[1] * zoomY;
+        float dx = x + px * c - py * s;
+        float dy = y + px * s + py * c;
+        minX = min(minX, dx); maxX = max(maxX, dx);
+        minY = min(minY, dy); maxY = max(maxY, dy);
+    }
+
+    // Inverse-map each destination pixel centre back into the sprite (nearest neighbour)
+    for (int32_t dy = (int32_t)floorf(minY); dy <= (int32_t)ceilf(maxY); dy++) {
+        for (int32_t dx = (int32_t)floorf(minX); dx <= (int32_t)ceilf(maxX); dx++) {
+            float rx = dx + 0.5f - x;
+            float ry = dy + 0.5f - y;
+            float sx = (rx * c + ry * s) / zoomX + _pivotX;
+            float sy = (-rx * s + ry * c) / zoomY + _pivotY;
+            int32_t ix = (int32_t)floorf(sx);
+            int32_t iy = (int32_t)floorf(sy);
+            if (ix < 0 || iy < 0 || ix >= _width || iy >= _height) continue;
+            uint16_t color = _buffer[iy * _width + ix];
+            if (useTransparent && color == transparent) continue;
+            dst->drawPixel(dx, dy, color);
+        }
+    }
+}
+
+// M5GFX
+
+M5GFX::~M5GFX() {
+    free(_framebuffer);
+}
+
+bool M5GFX::begin(int32_t panelWidth, int32_t panelHeight) {
+    if (_framebuffer) return true;
+    _framebuffer = (uint16_t*)calloc((size_t)panelWidth * panelHeight, sizeof(uint16_t));
+    if (!_framebuffer) return false;
+    _panelWidth = panelWidth;
+    _panelHeight = panelHeight;
+    setBuffer(_framebuffer, panelWidth, panelHeight);
+    return true;
+}
+
+void M5GFX::setRotation(uint8_t rotation) {
+    _rotation = rotation & 7;
+    // Odd rotations are landscape; the buffer is simply re-interpreted, the
+    // sketches clear the screen right after rotating anyway
+    if (_rotation & 1) {
+        setBuffer(_framebuffer, _panelHeight, _panelWidth);
+    } else {
+        setBuffer(_framebuffer, _panelWidth, _panelHeight);
+    }
+}
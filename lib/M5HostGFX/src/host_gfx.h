@@ -0,0 +1,251 @@
+#pragma once
+
+// Software implementation of the LovyanGFX / M5GFX drawing API subset used by
+// the sketches in this repository, rendering into an in-memory RGB565 buffer.
+//
+// Colours are plain (non byte-swapped) RGB565 everywhere. Sprites always store
+// 16 bpp internally; setColorDepth() only affects the heap accounting.
+
+#include "Arduino.h"
+
+#define TFT_BLACK       0x0000
+#define TFT_NAVY        0x000F
+#define TFT_DARKBLUE    0x0010
+#define TFT_DARKGREEN   0x03E0
+#define TFT_DARKCYAN    0x03EF
+#define TFT_MAROON      0x7800
+#define TFT_PURPLE      0x780F
+#define TFT_OLIVE       0x7BE0
+#define TFT_LIGHTGREY   0xD69A
+#define TFT_LIGHTGRAY   0xD69A
+#define TFT_DARKGREY    0x7BEF
+#define TFT_DARKGRAY    0x7BEF
+#define TFT_BLUE        0x001F
+#define TFT_GREEN       0x07E0
+#define TFT_CYAN        0x07FF
+#define TFT_RED         0xF800
+#define TFT_MAGENTA     0xF81F
+#define TFT_YELLOW      0xFFE0
+#define TFT_WHITE       0xFFFF
+#define TFT_ORANGE      0xFDA0
+#define TFT_GREENYELLOW 0xB7E0
+#define TFT_PINK        0xFE19
+#define TFT_BROWN       0x9A60
+#define TFT_GOLD        0xFEA0
+#define TFT_SILVER      0xC618
+#define TFT_SKYBLUE     0x867D
+#define TFT_VIOLET      0x915C
+#define TFT_TRANSPARENT 0x0120
+
+namespace lgfx {
+    // Pixel formats accepted by pushImage(); the panel driver's native format is
+    // byte-swapped RGB565, which is what DMA-ready buffers are filled with
+    struct rgb565_t { uint16_t raw; };
+    struct swap565_t { uint16_t raw; };
+}
+
+enum textdatum_t : uint8_t {
+    top_left = 0,
+    top_center = 1,
+    top_right = 2,
+    middle_left = 4,
+    middle_center = 5,
+    middle_right = 6,
+    bottom_left = 8,
+    bottom_center = 9,
+    bottom_right = 10,
+    baseline_left = 16,
+    baseline_center = 17,
+    baseline_right = 18,
+};
+
+#define TL_DATUM top_left
+#define TC_DATUM top_center
+#define TR_DATUM top_right
+#define ML_DATUM middle_left
+#define CL_DATUM middle_left
+#define MC_DATUM middle_center
+#define CC_DATUM middle_center
+#define MR_DATUM middle_right
+#define CR_DATUM middle_right
+#define BL_DATUM bottom_left
+#define BC_DATUM bottom_center
+#define BR_DATUM bottom_right
+#define L_BASELINE baseline_left
+#define C_BASELINE baseline_center
+#define R_BASELINE baseline_right
+
+class LovyanGFX : public Print {
+public:
+    virtual ~LovyanGFX() {}
+
+    int32_t width() const { return _width; }
+    int32_t height() const { return _height; }
+
+    static uint16_t color565(uint8_t r, uint8_t g, uint8_t b) {
+        return ((r & 0xF8) << 8) | ((g & 0xFC) << 3) | (b >> 3);
+    }
+    static uint32_t color888(uint8_t r, uint8_t g, uint8_t b) {
+        return (r << 16) | (g << 8) | b;
+    }
+
+    // Bus control is meaningless in memory; kept so sketches compile unchanged
+    void startWrite() {}
+    void endWrite() {}
+    void waitDMA() {}
+    void display() {}
+    void setBrightness(uint8_t brightness) { _brightness = brightness; }
+    uint8_t getBrightness() const { return _brightness; }
+
+    void setClipRect(int32_t x, int32_t y, int32_t w, int32_t h);
+    void clearClipRect();
+
+    // Primitives
+    void drawPixel(int32_t x, int32_t y, uint16_t color);
+    uint16_t readPixel(int32_t x, int32_t y) const;
+    void drawFastHLine(int32_t x, int32_t y, int32_t w, uint16_t color);
+    void drawFastVLine(int32_t x, int32_t y, int32_t h, uint16_t color);
+    void drawLine(int32_t x0, int32_t y0, int32_t x1, int32_t y1, uint16_t color);
+    void fillRect(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t color);
+    void drawRect(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t color);
+    void fillScreen(uint16_t color) { fillRect(0, 0, _width, _height, color); }
+    void clear(uint16_t color = 0) { fillScreen(color); }
+    void drawRoundRect(int32_t x, int32_t y, int32_t w, int32_t h, int32_t r, uint16_t color);
+    void fillRoundRect(int32_t x, int32_t y, int32_t w, int32_t h, int32_t r, uint16_t color);
+    void drawCircle(int32_t x, int32_t y, int32_t r, uint16_t color);
+    void fillCircle(int32_t x, int32_t y, int32_t r, uint16_t color);
+    void drawEllipse(int32_t x, int32_t y, int32_t rx, int32_t ry, uint16_t color);
+    void fillEllipse(int32_t x, int32_t y, int32_t rx, int32_t ry, uint16_t color);
+    void drawTriangle(int32_t x0, int32_t y0, int32_t x1, int32_t y1, int32_t x2, int32_t y2, uint16_t color);
+    void fillTriangle(int32_t x0, int32_t y0, int32_t x1, int32_t y1, int32_t x2, int32_t y2, uint16_t color);
+
+    // Raw RGB565 block transfer
+    void pushImage(int32_t x, int32_t y, int32_t w, int32_t h, const uint16_t* data);
+    void pushImage(int32_t x, int32_t y, int32_t w, int32_t h, const uint16_t* data, uint16_t transparent);
+    void pushImage(int32_t x, int32_t y, int32_t w, int32_t h, const lgfx::rgb565_t* data) { pushImage(x, y, w, h, (const uint16_t*)data); }
+    void pushImage(int32_t x, int32_t y, int32_t w, int32_t h, const lgfx::swap565_t* data);
+    void pushImageDMA(int32_t x, int32_t y, int32_t w, int32_t h, const uint16_t* data) { pushImage(x, y, w, h, data); }
+    void pushImageDMA(int32_t x, int32_t y, int32_t w, int32_t h, const lgfx::rgb565_t* data) { pushImage(x, y, w, h, data); }
+    void pushImageDMA(int32_t x, int32_t y, int32_t w, int32_t h, const lgfx::swap565_t* data) { pushImage(x, y, w, h, data); }
+
+    // Text (built-in 6x8 font, scaled by text size)
+    void setTextColor(uint16_t color) { _textColor = color; _textBgColor = color; }
+    void setTextColor(uint16_t color, uint16_t bg) { _textColor = color; _textBgColor = bg; }
+    void setTextSize(float size) { setTextSize(size, size); }
+    void setTextSize(float sx, float sy);
+    void setTextDatum(uint8_t datum) { _textDatum = datum; }
+    uint8_t getTextDatum() const { return _textDatum; }
+    void setTextWrap(bool wrapX, bool wrapY = false) { _textWrap = wrapX; (void)wrapY; }
+    void setTextPadding(uint32_t padding) { _textPadding = padding; }
+    void setCursor(int32_t x, int32_t y) { _cursorX = x; _cursorY = y; }
+    int32_t getCursorX() const { return _cursorX; }
+    int32_t getCursorY() const { return _cursorY; }
+
+    int32_t textWidth(const char* str) const;
+    int32_t textWidth(const String& str) const { return textWidth(str.c_str()); }
+    int32_t fontHeight() const { return 8 * _textSizeY; }
+
+    size_t drawString(const char* str, int32_t x, int32_t y);
+    size_t drawString(const String& str, int32_t x, int32_t y) { return drawString(str.c_str(), x, y); }
+    size_t drawCentreString(const char* str, int32_t x, int32_t y);
+    size_t drawNumber(long value, int32_t x, int32_t y);
+    size_t drawFloat(float value, uint8_t decimals, int32_t x, int32_t y);
+    size_t drawChar(uint16_t uniCode, int32_t x, int32_t y);
+
+    size_t write(uint8_t c) override;
+    using Print::write;
+
+    // Rotation/zoom pivot used by LGFX_Sprite::pushRotated()
+    void setPivot(float x, float y) { _pivotX = x; _pivotY = y; }
+    float getPivotX() const { return _pivotX; }
+    float getPivotY() const { return _pivotY; }
+
+    // Direct buffer access (host only)
+    uint16_t* getBuffer() { return _buffer; }
+    const uint16_t* getBuffer() const { return _buffer; }
+
+protected:
+    void setBuffer(uint16_t* buffer, int32_t w, int32_t h);
+    void drawGlyph(uint32_t code, int32_t x, int32_t y, bool fillBackground);
+    void circleHelper(int32_t x, int32_t y, int32_t r, uint8_t corners, uint16_t color);
+    void fillCircleHelper(int32_t x, int32_t y, int32_t r, uint8_t sides, int32_t delta, uint16_t color);
+
+    uint16_t* _buffer = nullptr;
+    int32_t _width = 0;
+    int32_t _height = 0;
+
+    int32_t _clipX0 = 0, _clipY0 = 0, _clipX1 = 0, _clipY1 = 0;   // [x0, x1) x [y0, y1)
+
+    uint16_t _textColor = TFT_WHITE;
+    uint16_t _textBgColor = TFT_WHITE;
+    int32_t _textSizeX = 1;
+    int32_t _textSizeY = 1;
+    uint8_t _textDatum = top_left;
+    bool _textWrap = true;
+    uint32_t _textPadding = 0;
+    int32_t _cursorX = 0;
+    int32_t _cursorY = 0;
+    uint32_t _utf8Pending = 0;
+    uint8_t _utf8Remaining = 0;
+
+    float _pivotX = 0;
+    float _pivotY = 0;
+    uint8_t _brightness = 128;
+};
+
+class LGFX_Sprite : public LovyanGFX {
+public:
+    LGFX_Sprite(LovyanGFX* parent = nullptr) : _parent(parent) {}
+    ~LGFX_Sprite() override { deleteSprite(); }
+
+    void setColorDepth(int bits) { _colorDepth = bits; }
+    int getColorDepth() const { return _colorDepth; }
+    void setPsram(bool enabled) { (void)enabled; }
+    void* createSprite(int32_t w, int32_t h);
+    void deleteSprite();
+    size_t bufferLength() const { return (size_t)_width * _height * ((_colorDepth + 7) / 8); }
+
+    void fillSprite(uint16_t color) { fillScreen(color); }
+
+    void pushSprite(int32_t x, int32_t y) { if (_parent) pushSprite(_parent, x, y); }
+    void pushSprite(int32_t x, int32_t y, uint16_t transparent) { if (_parent) pushSprite(_parent, x, y, transparent); }
+    void pushSprite(LovyanGFX* dst, int32_t x, int32_t y);
+    void pushSprite(LovyanGFX* dst, int32_t x, int32_t y, uint16_t transparent);
+
+    // angle in degrees; the sprite pivot lands on (x, y) of the destination
+    void pushRotateZoom(float x, float y, float angle, float zoomX, float zoomY);
+    void pushRotateZoom(float x, float y, float angle, float zoomX, float zoomY, uint16_t transparent);
+    void pushRotateZoom(LovyanGFX* dst, float x, float y, float angle, float zoomX, float zoomY);
+    void pushRotateZoom(LovyanGFX* dst, float x, float y, float angle, float zoomX, float zoomY, uint16_t transparent);
+    void pushRotated(float angle) { if (_parent) pushRotated(_parent, angle); }
+    void pushRotated(float angle, uint16_t transparent) { if (_parent) pushRotated(_parent, angle, transparent); }
+    void pushRotated(LovyanGFX* dst, float angle);
+    void pushRotated(LovyanGFX* dst, float angle, uint16_t transparent);
+
+private:
+    void pushTransformed(LovyanGFX* dst, float x, float y, float angle, float zoomX, float zoomY,
+                         bool useTransparent, uint16_t transparent);
+
+    LovyanGFX* _parent;
+    int _colorDepth = 16;
+};
+
+// The panel: a fixed-size RGB565 framebuffer whose logical size follows setRotation()
+class M5GFX : public LovyanGFX {
+public:
+    ~M5GFX() override;
+
+    // Panel size before rotation; defaults to the Tab5's 720x1280 portrait panel
+    bool begin(int32_t panelWidth = 720, int32_t panelHeight = 1280);
+    bool init() { return begin(); }
+    void setRotation(uint8_t rotation);
+    uint8_t getRotation() const { return _rotation; }
+
+private:
+    uint16_t* _framebuffer = nullptr;
+    int32_t _panelWidth = 0;
+    int32_t _panelHeight = 0;
+    uint8_t _rotation = 0;
+};
+
+typedef M5GFX LGFX_Device;
@@ -0,0 +1,3 @@
+#include "M5Unified.h"
+
+m5::M5Unified M5;
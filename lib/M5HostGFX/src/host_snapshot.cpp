@@ -0,0 +1,550 @@
+#include "host_snapshot.h"
+
+// Self-contained PNG codec: no zlib on purpose, so the native build has no
+// dependencies beyond the C++ standard library. The encoder uses fixed-Huffman
+// deflate with a small hash-chain matcher, which is plenty for UI screenshots
+// (large flat areas); the decoder is a complete inflate.
+
+// CRC-32 and Adler-32
+
+static uint32_t crcTable[256];
+
+static void initCrcTable() {
+    if (crcTable[1]) return;
+    for (uint32_t n = 0; n < 256; n++) {
+        uint32_t c = n;
+        for (int k = 0; k < 8; k++) {
+            c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        }
+        crcTable[n] = c;
+    }
+}
+
+static uint32_t crc32(uint32_t crc, const uint8_t* data, size_t len) {
+    initCrcTable();
+    crc = ~crc;
+    while (len--) crc = crcTable[(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+static uint32_t adler32(const uint8_t* data, size_t len) {
+    uint32_t a = 1, b = 0;
+    while (len) {
+        size_t block = min<size_t>(len, 5552);
+        len -= block;
+        while (block--) {
+            a += *data++;
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+    return (b << 16) | a;
+}
+
+// Deflate tables (RFC 1951)
+
+static const uint16_t lengthBase[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                        35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const uint8_t lengthExtra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                                        3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const uint16_t distBase[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+                                      257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+                                      8193, 12289, 16385, 24577};
+static const uint8_t distExtra[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+                                      7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+// Encoder
+
+class BitWriter {
+public:
+    explicit BitWriter(std::vector<uint8_t>& out) : _out(out) {}
+
+    void bits(uint32_t value, int count) {
+        _acc |= value << _count;
+        _count += count;
+        while (_count >= 8) {
+            _out.push_back(_acc & 0xFF);
+            _acc >>= 8;
+            _count -= 8;
+        }
+    }
+
+    // Huffman codes are defined MSB first but packed LSB first
+    void code(uint32_t code, int length) {
+        uint32_t reversed = 0;
+        for (int i = 0; i < length; i++) {
+            reversed = (reversed << 1) | ((code >> i) & 1);
+        }
+        bits(reversed, length);
+    }
+
+    void flush() {
+        if (_count) _out.push_back(_acc & 0xFF);
+        _acc = 0;
+        _count = 0;
+    }
+
+private:
+    std::vector<uint8_t>& _out;
+    uint32_t _acc = 0;
+    int _count = 0;
+};
+
+static void writeFixedLiteral(BitWriter& bw, int symbol) {
+    if (symbol < 144) bw.code(0x30 + symbol, 8);
+    else if (symbol < 256) bw.code(0x190 + symbol - 144, 9);
+    else if (symbol < 280) bw.code(symbol - 256, 7);
+    else bw.code(0xC0 + symbol - 280, 8);
+}
+
+static void writeMatch(BitWriter& bw, int length, int distance) {
+    int l = 28;
+    while (lengthBase[l] > length) l--;
+    writeFixedLiteral(bw, 257 + l);
+    bw.bits(length - lengthBase[l], lengthExtra[l]);
+
+    int d = 29;
+    while (distBase[d] > distance) d--;
+    bw.code(d, 5);
+    bw.bits(distance - distBase[d], distExtra[d]);
+}
+
+static void deflateFixed(const uint8_t* data, size_t size, std::vector<uint8_t>& out) {
+    const int WINDOW = 32768;
+    const int HASH_BITS = 15;
+    const int MAX_CHAIN = 16;
+
+    std::vector<int32_t> head(1 << HASH_BITS, -1);
+    std::vector<int32_t> prev(WINDOW, -1);
+    auto hashAt = [&](size_t i) {
+        return ((data[i] << 10) ^ (data[i + 1] << 5) ^ data[i + 2]) & ((1 << HASH_BITS) - 1);
+    };
+    auto insert = [&](size_t i) {
+        if (i + 2 >= size) return;
+        int h = hashAt(i);
+        prev[i & (WINDOW - 1)] = head[h];
+        head[h] = (int32_t)i;
+    };
+
+    BitWriter bw(out);
+    bw.bits(1, 1);  // BFINAL
+    bw.bits(1, 2);  // fixed Huffman
+
+    size_t i = 0;
+    while (i < size) {
+        int bestLength = 0;
+        int bestDistance = 0;
+        if (i + 2 < size) {
+            int32_t candidate = head[hashAt(i)];
+            int maxLength = (int)min<size_t>(258, size - i);
+            for (int chain = 0; chain < MAX_CHAIN && candidate >= 0 && i - candidate <= (size_t)WINDOW - 1; chain++) {
+                const uint8_t* a = data + candidate;
+                const uint8_t* b = data + i;
+                int length = 0;
+                while (length < maxLength && a[length] == b[length]) length++;
+                if (length > bestLength) {
+                    bestLength = length;
+                    bestDistance = (int)(i - candidate);
+                    if (length == maxLength) break;
+                }
+                candidate = prev[candidate & (WINDOW - 1)];
+            }
+        }
+
+        if (bestLength >= 3) {
+            writeMatch(bw, bestLength, bestDistance);
+            for (int k = 0; k < bestLength; k++) insert(i + k);
+            i += bestLength;
+        } else {
+            writeFixedLiteral(bw, data[i]);
+            insert(i);
+            i++;
+        }
+    }
+    writeFixedLiteral(bw, 256);
+    bw.flush();
+}
+
+static void putBE32(std::vector<uint8_t>& out, uint32_t v) {
+    out.push_back(v >> 24);
+    out.push_back(v >> 16);
+    out.push_back(v >> 8);
+    out.push_back(v);
+}
+
+static void writeChunk(FILE* f, const char* type, const std::vector<uint8_t>& data) {
+    std::vector<uint8_t> buf;
+    putBE32(buf, data.size());
+    buf.insert(buf.end(), type, type + 4);
+    buf.insert(buf.end(), data.begin(), data.end());
+    putBE32(buf, crc32(0, buf.data() + 4, buf.size() - 4));
+    fwrite(buf.data(), 1, buf.size(), f);
+}
+
+bool writePngRGB(const char* path, const uint8_t* rgb, int32_t width, int32_t height) {
+    if (width <= 0 || height <= 0) return false;
+
+    // Filter type 0 (none) on every row; the matcher already catches repeats
+    size_t stride = (size_t)width * 3;
+    std::vector<uint8_t> raw;
+    raw.reserve((stride + 1) * height);
+    for (int32_t y = 0; y < height; y++) {
+        raw.push_back(0);
+        raw.insert(raw.end(), rgb + y * stride, rgb + (y + 1) * stride);
+    }
+
+    std::vector<uint8_t> idat = {0x78, 0x01};
+    deflateFixed(raw.data(), raw.size(), idat);
+    putBE32(idat, adler32(raw.data(), raw.size()));
+
+    std::vector<uint8_t> ihdr;
+    putBE32(ihdr, width);
+    putBE32(ihdr, height);
+    ihdr.push_back(8);  // bit depth
+    ihdr.push_back(2);  // truecolour
+    ihdr.push_back(0);
+    ihdr.push_back(0);
+    ihdr.push_back(0);
+
+    FILE* f = fopen(path, "wb");
+    if (!f) return false;
+    static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    fwrite(signature, 1, sizeof(signature), f);
+    writeChunk(f, "IHDR", ihdr);
+    writeChunk(f, "IDAT", idat);
+    writeChunk(f, "IEND", std::vector<uint8_t>());
+    bool ok = !ferror(f);
+    fclose(f);
+    return ok;
+}
+
+// Decoder
+
+struct Huffman {
+    uint16_t counts[16];
+    uint16_t symbols[288];
+};
+
+class BitReader {
+public:
+    BitReader(const uint8_t* data, size_t size) : _data(data), _size(size) {}
+
+    int bits(int count) {
+        uint32_t value = 0;
+        for (int i = 0; i < count; i++) {
+            if (_pos >= _size) {
+                _overrun = true;
+                return 0;
+            }
+            value |= ((_data[_pos] >> _bit) & 1u) << i;
+            if (++_bit == 8) {
+                _bit = 0;
+                _pos++;
+            }
+        }
+        return value;
+    }
+
+    void alignToByte() {
+        if (_bit) {
+            _bit = 0;
+            _pos++;
+        }
+    }
+
+    bool overrun() const { return _overrun; }
+    size_t position() const { return _pos; }
+    void skip(size_t bytes) { _pos += bytes; }
+
+private:
+    const uint8_t* _data;
+    size_t _size;
+    size_t _pos = 0;
+    int _bit = 0;
+    bool _overrun = false;
+};
+
+static bool buildHuffman(Huffman& h, const uint8_t* lengths, int count) {
+    memset(h.counts, 0, sizeof(h.counts));
+    for (int i = 0; i < count; i++) h.counts[lengths[i]]++;
+    h.counts[0] = 0;
+
+    uint16_t offsets[16];
+    offsets[1] = 0;
+    for (int len = 1; len < 15; len++) offsets[len + 1] = offsets[len] + h.counts[len];
+    for (int i = 0; i < count; i++) {
+        if (lengths[i]) h.symbols[offsets[lengths[i]]++] = i;
+    }
+    return true;
+}
+
+// Canonical decode one bit at a time (as in zlib's puff.c)
+static int decodeSymbol(BitReader& br, const Huffman& h) {
+    int code = 0, first = 0, index = 0;
+    for (int len = 1; len < 16; len++) {
+        code |= br.bits(1);
+        int count = h.counts[len];
+        if (code - count < first) return h.symbols[index + (code - first)];
+        index += count;
+        first += count;
+        first <<= 1;
+        code <<= 1;
+        if (br.overrun()) return -1;
+    }
+    return -1;
+}
+
+static bool inflateCodes(BitReader& br, std::vector<uint8_t>& out, const Huffman& lit, const Huffman& dist) {
+    for (;;) {
+        int symbol = decodeSymbol(br, lit);
+        if (symbol < 0) return false;
+        if (symbol < 256) {
+            out.push_back(symbol);
+        } else if (symbol == 256) {
+            return true;
+        } else {
+            symbol -= 257;
+            if (symbol >= 29) return false;
+            int length = lengthBase[symbol] + br.bits(lengthExtra[symbol]);
+            int d = decodeSymbol(br, dist);
+            if (d < 0 || d >= 30) return false;
+            size_t distance = distBase[d] + br.bits(distExtra[d]);
+            if (distance > out.size()) return false;
+            size_t from = out.size() - distance;
+            for (int i = 0; i < length; i++) out.push_back(out[from + i]);
+        }
+        if (br.overrun()) return false;
+    }
+}
+
+static bool inflate(const uint8_t* data, size_t size, std::vector<uint8_t>& out) {
+    BitReader br(data, size);
+    int final;
+    do {
+        final = br.bits(1);
+        int type = br.bits(2);
+
+        if (type == 0) {
+            br.alignToByte();
+            size_t pos = br.position();
+            if (pos + 4 > size) return false;
+            uint16_t len = data[pos] | (data[pos + 1] << 8);
+            if (pos + 4 + len > size) return false;
+            out.insert(out.end(), data + pos + 4, data + pos + 4 + len);
+            br.skip(4 + len);
+        } else if (type == 1) {
+            uint8_t lengths[288];
+            memset(lengths, 8, 144);
+            memset(lengths + 144, 9, 112);
+            memset(lengths + 256, 7, 24);
+            memset(lengths + 280, 8, 8);
+            Huffman lit, dist;
+            buildHuffman(lit, lengths, 288);
+            memset(lengths, 5, 30);
+            buildHuffman(dist, lengths, 30);
+            if (!inflateCodes(br, out, lit, dist)) return false;
+        } else if (type == 2) {
+            static const uint8_t order[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+            int nlen = br.bits(5) + 257;
+            int ndist = br.bits(5) + 1;
+            int ncode = br.bits(4) + 4;
+            if (nlen > 286 || ndist > 30) return false;
+
+            uint8_t lengths[320] = {0};
+            for (int i = 0; i < ncode; i++) lengths[order[i]] = br.bits(3);
+            Huffman lencode;
+            buildHuffman(lencode, lengths, 19);
+
+            memset(lengths, 0, sizeof(lengths));
+            int index = 0;
+            while (index < nlen + ndist) {
+                int symbol = decodeSymbol(br, lencode);
+                if (symbol < 0) return false;
+                if (symbol < 16) {
+                    lengths[index++] = symbol;
+                    continue;
+                }
+                int repeat;
+                uint8_t value = 0;
+                if (symbol == 16) {
+                    if (index == 0) return false;
+                    value = lengths[index - 1];
+                    repeat = 3 + br.bits(2);
+                } else if (symbol == 17) {
+                    repeat = 3 + br.bits(3);
+                } else {
+                    repeat = 11 + br.bits(7);
+                }
+                if (index + repeat > nlen + ndist) return false;
+                while (repeat--) lengths[index++] = value;
+            }
+
+            Huffman lit, dist;
+            buildHuffman(lit, lengths, nlen);
+            buildHuffman(dist, lengths + nlen, ndist);
+            if (!inflateCodes(br, out, lit, dist)) return false;
+        } else {
+            return false;
+        }
+        if (br.overrun()) return false;
+    } while (!final);
+    return true;
+}
+
+static uint32_t getBE32(const uint8_t* p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static uint8_t paeth(int a, int b, int c) {
+    int p = a + b - c;
+    int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+    if (pa <= pb && pa <= pc) return a;
+    if (pb <= pc) return b;
+    return c;
+}
+
+bool readPngRGB(const char* path, std::vector<uint8_t>& rgb, int32_t& width, int32_t& height) {
+    FILE* f = fopen(path, "rb");
+    if (!f) return false;
+    std::vector<uint8_t> file;
+    uint8_t buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) file.insert(file.end(), buf, buf + n);
+    fclose(f);
+
+    static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    if (file.size() < 8 || memcmp(file.data(), signature, 8) != 0) return false;
+
+    int colorType = -1;
+    std::vector<uint8_t> idat;
+    size_t pos = 8;
+    while (pos + 12 <= file.size()) {
+        uint32_t length = getBE32(&file[pos]);
+        const char* type = (const char*)&file[pos + 4];
+        const uint8_t* data = &file[pos + 8];
+        if (pos + 12 + length > file.size()) return false;
+
+        if (memcmp(type, "IHDR", 4) == 0) {
+            width = getBE32(data);
+            height = getBE32(data + 4);
+            // Only 8-bit, non-interlaced RGB or RGBA
+            if (data[8] != 8 || data[12] != 0) return false;
+            colorType = data[9];
+            if (colorType != 2 && colorType != 6) return false;
+        } else if (memcmp(type, "IDAT", 4) == 0) {
+            idat.insert(idat.end(), data, data + length);
+        } else if (memcmp(type, "IEND", 4) == 0) {
+            break;
+        }
+        pos += 12 + length;
+    }
+    if (colorType < 0 || idat.size() < 6) return false;
+
+    std::vector<uint8_t> raw;
+    int bpp = colorType == 6 ? 4 : 3;
+    size_t stride = (size_t)width * bpp;
+    raw.reserve((stride + 1) * height);
+    if (!inflate(idat.data() + 2, idat.size() - 2, raw)) return false;
+    if (raw.size() < (stride + 1) * height) return false;
+
+    // Undo the per-row filters in place
+    std::vector<uint8_t> zero(stride, 0);
+    for (int32_t y = 0; y < height; y++) {
+        uint8_t filter = raw[y * (stride + 1)];
+        uint8_t* row = &raw[y * (stride + 1) + 1];
+        const uint8_t* up = y ? &raw[(y - 1) * (stride + 1) + 1] : zero.data();
+        for (size_t x = 0; x < stride; x++) {
+            int a = x >= (size_t)bpp ? row[x - bpp] : 0;
+            int b = up[x];
+            int c = x >= (size_t)bpp ? up[x - bpp] : 0;
+            switch (filter) {
+                case 0: break;
+                case 1: row[x] += a; break;
+                case 2: row[x] += b; break;
+                case 3: row[x] += (a + b) / 2; break;
+                case 4: row[x] += paeth(a, b, c); break;
+                default: return false;
+            }
+        }
+    }
+
+    rgb.resize((size_t)width * height * 3);
+    for (int32_t y = 0; y < height; y++) {
+        const uint8_t* row = &raw[y * (stride + 1) + 1];
+        uint8_t* dst = &rgb[(size_t)y * width * 3];
+        for (int32_t x = 0; x < width; x++) {
+            memcpy(dst + x * 3, row + x * bpp, 3);
+        }
+    }
+    return true;
+}
+
+// Snapshots
+
+static void toRGB(const LovyanGFX& gfx, std::vector<uint8_t>& rgb) {
+    int32_t count = gfx.width() * gfx.height();
+    const uint16_t* src = gfx.getBuffer();
+    rgb.resize((size_t)count * 3);
+    for (int32_t i = 0; i < count; i++) {
+        uint16_t c = src[i];
+        // Replicate the top bits so 0x1F -> 0xFF and the round trip is exact
+        uint8_t r = (c >> 11) & 0x1F, g = (c >> 5) & 0x3F, b = c & 0x1F;
+        rgb[i * 3] = (r << 3) | (r >> 2);
+        rgb[i * 3 + 1] = (g << 2) | (g >> 4);
+        rgb[i * 3 + 2] = (b << 3) | (b >> 2);
+    }
+}
+
+bool saveSnapshot(const LovyanGFX& gfx, const char* path) {
+    if (!gfx.getBuffer()) return false;
+    std::vector<uint8_t> rgb;
+    toRGB(gfx, rgb);
+    return writePngRGB(path, rgb.data(), gfx.width(), gfx.height());
+}
+
+bool compareSnapshot(const LovyanGFX& gfx, const char* goldenPath, SnapshotDiff& result,
+                     uint8_t tolerance, const char* diffPath) {
+    result = SnapshotDiff();
+    result.width = gfx.width();
+    result.height = gfx.height();
+
+    std::vector<uint8_t> golden;
+    int32_t goldenWidth, goldenHeight;
+    if (!gfx.getBuffer() || !readPngRGB(goldenPath, golden, goldenWidth, goldenHeight)) return false;
+    if (goldenWidth != result.width || goldenHeight != result.height) {
+        result.sizeMismatch = true;
+        result.differingPixels = result.width * result.height;
+        return true;
+    }
+
+    std::vector<uint8_t> actual;
+    toRGB(gfx, actual);
+
+    int32_t count = result.width * result.height;
+    std::vector<uint8_t> diff(diffPath ? actual.size() : 0);
+    for (int32_t i = 0; i < count; i++) {
+        uint32_t delta = 0;
+        for (int ch = 0; ch < 3; ch++) {
+            delta = max<uint32_t>(delta, abs(actual[i * 3 + ch] - golden[i * 3 + ch]));
+        }
+        result.maxChannelDelta = max(result.maxChannelDelta, delta);
+        bool differs = delta > tolerance;
+        if (differs) result.differingPixels++;
+
+        if (diffPath) {
+            if (differs) {
+                diff[i * 3] = 255;
+                diff[i * 3 + 1] = 0;
+                diff[i * 3 + 2] = 0;
+            } else {
+                for (int ch = 0; ch < 3; ch++) diff[i * 3 + ch] = actual[i * 3 + ch] / 4;
+            }
+        }
+    }
+
+    if (diffPath && result.differingPixels) {
+        writePngRGB(diffPath, diff.data(), result.width, result.height);
+    }
+    return true;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+// PNG snapshots of a framebuffer or sprite, and pixel diffs against golden
+// images. Snapshots are written as 8-bit RGB; goldens may be any 8-bit RGB or
+// RGBA PNG (e.g. re-saved by an image editor).
+
+#include "host_gfx.h"
+
+#include <vector>
+
+struct SnapshotDiff {
+    int32_t width = 0;
+    int32_t height = 0;
+    bool sizeMismatch = false;
+    uint32_t differingPixels = 0;   // pixels with any channel off by more than the tolerance
+    uint32_t maxChannelDelta = 0;   // largest per-channel difference, 0..255
+};
+
+bool saveSnapshot(const LovyanGFX& gfx, const char* path);
+
+// Compares gfx with the PNG at goldenPath. Returns false if the golden cannot be
+// read. When diffPath is given and pixels differ, writes an image with the
+// differing pixels in red over a dimmed copy of the render.
+bool compareSnapshot(const LovyanGFX& gfx, const char* goldenPath, SnapshotDiff& result,
+                     uint8_t tolerance = 0, const char* diffPath = nullptr);
+
+// Raw 8-bit RGB PNG I/O (rgb is width * height * 3 bytes)
+bool writePngRGB(const char* path, const uint8_t* rgb, int32_t width, int32_t height);
+bool readPngRGB(const char* path, std::vector<uint8_t>& rgb, int32_t& width, int32_t& height);
@@ -0,0 +1,78 @@
+#pragma once
+
+// Host stand-in for knolleary's PubSubClient. Connection state and publish
+// outcomes come from the host network backend; the public API and the state
+// codes match the real library.
+
+#include <functional>
+#include "host_net.h"
+
+#define MQTT_CONNECTION_TIMEOUT     -4
+#define MQTT_CONNECTION_LOST        -3
+#define MQTT_CONNECT_FAILED         -2
+#define MQTT_DISCONNECTED           -1
+#define MQTT_CONNECTED               0
+#define MQTT_CONNECT_BAD_PROTOCOL    1
+#define MQTT_CONNECT_BAD_CLIENT_ID   2
+#define MQTT_CONNECT_UNAVAILABLE     3
+#define MQTT_CONNECT_BAD_CREDENTIALS 4
+#define MQTT_CONNECT_UNAUTHORIZED    5
+
+#define MQTT_MAX_PACKET_SIZE 256
+
+class PubSubClient {
+public:
+    typedef std::function<void(char*, uint8_t*, unsigned int)> Callback;
+
+    PubSubClient() {}
+    explicit PubSubClient(Client& client) : _client(&client) {}
+
+    PubSubClient& setServer(const char* domain, uint16_t port) { _domain = domain; _port = port; return *this; }
+    PubSubClient& setServer(IPAddress ip, uint16_t port) { _domain = ip.toString(); _port = port; return *this; }
+    PubSubClient& setClient(Client& client) { _client = &client; return *this; }
+    PubSubClient& setCallback(Callback callback) { _callback = callback; return *this; }
+    PubSubClient& setKeepAlive(uint16_t seconds) { _keepAlive = seconds; return *this; }
+    PubSubClient& setSocketTimeout(uint16_t seconds) { (void)seconds; return *this; }
+    bool setBufferSize(uint16_t size) { _bufferSize = size; return true; }
+    uint16_t getBufferSize() const { return _bufferSize; }
+
+    bool connect(const char* id) { return connect(id, nullptr, nullptr, nullptr, 0, false, nullptr); }
+    bool connect(const char* id, const char* user, const char* pass) {
+        return connect(id, user, pass, nullptr, 0, false, nullptr);
+    }
+    bool connect(const char* id, const char* willTopic, uint8_t willQos, bool willRetain, const char* willMessage) {
+        return connect(id, nullptr, nullptr, willTopic, willQos, willRetain, willMessage);
+    }
+    bool connect(const char* id, const char* user, const char* pass, const char* willTopic,
+                 uint8_t willQos, bool willRetain, const char* willMessage, bool cleanSession = true);
+    void disconnect();
+
+    bool publish(const char* topic, const char* payload) { return publish(topic, payload, false); }
+    bool publish(const char* topic, const char* payload, bool retained) {
+        return publish(topic, (const uint8_t*)payload, payload ? strlen(payload) : 0, retained);
+    }
+    bool publish(const char* topic, const uint8_t* payload, unsigned int length) { return publish(topic, payload, length, false); }
+    bool publish(const char* topic, const uint8_t* payload, unsigned int length, bool retained);
+
+    bool subscribe(const char* topic, uint8_t qos = 0);
+    bool unsubscribe(const char* topic) { (void)topic; return connected(); }
+
+    bool loop();
+    bool connected();
+    int state() const { return _state; }
+
+    const String& hostServer() const { return _domain; }
+    uint16_t hostPort() const { return _port; }
+
+    // Host: hand an incoming message to the sketch's callback (used by backends from mqttLoop())
+    void hostDeliver(const char* topic, const uint8_t* payload, unsigned int length);
+
+private:
+    Client* _client = nullptr;
+    Callback _callback;
+    String _domain;
+    uint16_t _port = 1883;
+    uint16_t _keepAlive = 15;
+    uint16_t _bufferSize = MQTT_MAX_PACKET_SIZE;
+    int _state = MQTT_DISCONNECTED;
+};
@@ -0,0 +1,39 @@
+#pragma once
+
+// Host stand-in for the Sensirion SCD4x driver; measurements come from the host
+// network backend. Every call returns 0 (no error) unless noted.
+
+#include <Wire.h>
+#include "host_net.h"
+
+class SensirionI2CScd4x {
+public:
+    void begin(TwoWire& wire) { (void)wire; }
+
+    uint16_t startPeriodicMeasurement() { _running = true; return 0; }
+    uint16_t startLowPowerPeriodicMeasurement() { _running = true; return 0; }
+    uint16_t stopPeriodicMeasurement() { _running = false; return 0; }
+    uint16_t getSerialNumber(uint16_t& serial0, uint16_t& serial1, uint16_t& serial2) {
+        serial0 = 0x1234;
+        serial1 = 0x5678;
+        serial2 = 0x9abc;
+        return 0;
+    }
+    uint16_t setAutomaticSelfCalibration(uint16_t enabled) { (void)enabled; return 0; }
+    uint16_t performForcedRecalibration(uint16_t targetCo2, uint16_t& frcCorrection) {
+        frcCorrection = 0x8000 + (targetCo2 - 400);
+        return 0;
+    }
+    uint16_t setTemperatureOffset(float offset) { (void)offset; return 0; }
+
+    uint16_t getDataReadyFlag(bool& ready) {
+        ready = _running && hostNetBackend().scd4xDataReady();
+        return 0;
+    }
+    uint16_t readMeasurement(uint16_t& co2, float& temperature, float& humidity) {
+        return hostNetBackend().scd4xRead(co2, temperature, humidity);
+    }
+
+private:
+    bool _running = false;
+};
@@ -0,0 +1,90 @@
+#pragma once
+
+// Host stand-in for the ESP32 <WiFi.h>: connection state comes from the host
+// network backend (see host_net.h), nothing touches a real network
+
+#include <deque>
+#include <vector>
+
+#include "host_net.h"
+
+typedef enum {
+    WL_NO_SHIELD = 255,
+    WL_IDLE_STATUS = 0,
+    WL_NO_SSID_AVAIL = 1,
+    WL_SCAN_COMPLETED = 2,
+    WL_CONNECTED = 3,
+    WL_CONNECT_FAILED = 4,
+    WL_CONNECTION_LOST = 5,
+    WL_DISCONNECTED = 6
+} wl_status_t;
+
+typedef enum {
+    WIFI_OFF = 0,
+    WIFI_STA = 1,
+    WIFI_AP = 2,
+    WIFI_AP_STA = 3
+} wifi_mode_t;
+
+class WiFiClass {
+public:
+    bool setPins(int clk, int cmd, int d0, int d1, int d2, int d3, int rst) {
+        (void)clk; (void)cmd; (void)d0; (void)d1; (void)d2; (void)d3; (void)rst;
+        return true;
+    }
+    bool mode(wifi_mode_t mode) { _mode = mode; return true; }
+    wifi_mode_t getMode() const { return _mode; }
+    wl_status_t begin(const char* ssid, const char* passphrase = nullptr, int32_t channel = 0,
+                      const uint8_t* bssid = nullptr, bool connect = true);
+    bool disconnect(bool wifiOff = false, bool eraseAp = false);
+    bool config(IPAddress localIP, IPAddress gateway, IPAddress subnet, IPAddress dns1 = IPAddress(),
+                IPAddress dns2 = IPAddress()) {
+        (void)localIP; (void)gateway; (void)subnet; (void)dns1; (void)dns2;
+        return true;
+    }
+    bool reconnect() { hostNetBackend().wifiBegin(); return true; }
+    bool setAutoReconnect(bool enabled) { (void)enabled; return true; }
+    wl_status_t status() { return (wl_status_t)hostNetBackend().wifiStatus(); }
+    bool isConnected() { return status() == WL_CONNECTED; }
+
+    IPAddress localIP() { return hostNetBackend().wifiLocalIP(); }
+    IPAddress gatewayIP() { return IPAddress(192, 168, 1, 1); }
+    IPAddress subnetMask() { return IPAddress(255, 255, 255, 0); }
+    IPAddress dnsIP(uint8_t index = 0) { (void)index; return IPAddress(192, 168, 1, 1); }
+    String SSID() const { return _ssid; }
+    int8_t RSSI() { return isConnected() ? -55 : 0; }
+    String macAddress() const { return "C0:FF:EE:5A:5A:00"; }
+    uint8_t* BSSID() { return isConnected() ? _bssid : nullptr; }
+    int32_t channel() { return isConnected() ? 6 : 0; }
+
+private:
+    wifi_mode_t _mode = WIFI_OFF;
+    String _ssid;
+    uint8_t _bssid[6] = {0x02, 0xAC, 0xCE, 0x55, 0x00, 0x01};
+};
+
+extern WiFiClass WiFi;
+
+// A TCP connection to the broker. Clients that speak MQTT themselves get
+// their packets answered from the backend's mqtt*() calls (CONNACK, PUBACK,
+// PINGRESP); messages the backend delivers only reach PubSubClient.
+class WiFiClient : public Client {
+public:
+    using Client::connect;
+    int connect(const char* host, uint16_t port) override;
+    size_t write(const uint8_t* buf, size_t size) override;
+    int available() override { return (int)_in.size(); }
+    int read(uint8_t* buf, size_t size) override;
+    uint8_t connected() override;
+    void stop() override;
+    void setNoDelay(bool noDelay) { (void)noDelay; }
+
+private:
+    void answer(uint8_t header, const uint8_t* body, size_t length);
+    void reply(std::initializer_list<uint8_t> packet) { _in.insert(_in.end(), packet); }
+
+    bool _open = false;
+    bool _session = false;              // CONNECT accepted
+    std::vector<uint8_t> _out;          // written, not yet a whole packet
+    std::deque<uint8_t> _in;
+};
@@ -0,0 +1,25 @@
+#pragma once
+
+// Host stand-in for <Wire.h>; there is no bus, sensor drivers talk to the host
+// network backend directly
+
+#include <Arduino.h>
+
+class TwoWire {
+public:
+    bool begin(int sda = -1, int scl = -1, uint32_t frequency = 0) { (void)sda; (void)scl; (void)frequency; return true; }
+    void end() {}
+    void setClock(uint32_t frequency) { (void)frequency; }
+    void beginTransmission(uint8_t address) { _address = address; }
+    uint8_t endTransmission(bool sendStop = true) { (void)sendStop; return _address == 0x62 ? 0 : 2; }  // only the SCD4x answers
+    size_t write(uint8_t data) { (void)data; return 1; }
+    uint8_t requestFrom(uint8_t address, uint8_t quantity) { (void)address; (void)quantity; return 0; }
+    int available() { return 0; }
+    int read() { return -1; }
+
+private:
+    uint8_t _address = 0;
+};
+
+extern TwoWire Wire;
+extern TwoWire Wire1;
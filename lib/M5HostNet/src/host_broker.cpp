@@ -0,0 +1,284 @@
+#include "host_broker.h"
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+static uint64_t monotonicUs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+// A length-prefixed string at `pos`; false when it runs past the end
+static bool readString(const uint8_t* body, size_t length, size_t& pos, std::string& out) {
+    if (length - pos < 2) return false;
+    size_t n = body[pos] << 8 | body[pos + 1];
+    if (length - pos - 2 < n) return false;
+    out.assign((const char*)body + pos + 2, n);
+    pos += 2 + n;
+    return true;
+}
+
+static bool sendAll(int fd, const uint8_t* data, size_t length) {
+    return send(fd, data, length, MSG_NOSIGNAL) == (ssize_t)length;
+}
+
+HostBroker::~HostBroker() {
+    for (Connection& c : _connections) ::close(c.fd);
+    if (_listener >= 0) ::close(_listener);
+}
+
+bool HostBroker::listen(uint16_t port) {
+    _listener = socket(AF_INET, SOCK_STREAM, 0);
+    if (_listener < 0) return false;
+    int on = 1;
+    setsockopt(_listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(port ? INADDR_ANY : INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+    socklen_t length = sizeof(address);
+    if (bind(_listener, (sockaddr*)&address, sizeof(address)) != 0 || ::listen(_listener, _options.backlog) != 0 ||
+        getsockname(_listener, (sockaddr*)&address, &length) != 0) {
+        ::close(_listener);
+        _listener = -1;
+        return false;
+    }
+    _port = ntohs(address.sin_port);
+    _startUs = monotonicUs();
+    return true;
+}
+
+HostBrokerStats HostBroker::stats() {
+    std::lock_guard<std::mutex> lock(_statsMutex);
+    return _stats;
+}
+
+// The current second of the run; seconds the broker spent busy carry the
+// connection count over
+HostBrokerSecond& HostBroker::second() {
+    size_t index = (monotonicUs() - _startUs) / 1000000;
+    while (_stats.seconds.size() <= index) {
+        HostBrokerSecond next = {};
+        if (!_stats.seconds.empty()) next.connections = _stats.seconds.back().connections;
+        _stats.seconds.push_back(next);
+    }
+    return _stats.seconds[index];
+}
+
+void HostBroker::run() {
+    static uint8_t buffer[1 << 16];
+    while (!_stopping) {
+        // Sleep until a socket is readable or the next PUBACK is due, and
+        // look at stop() and the keepalives at least every 100 ms
+        uint64_t now = monotonicUs();
+        int64_t waitUs = 100000;
+        for (const Connection& c : _connections) {
+            if (c.acks.empty()) continue;
+            int64_t due = c.acks.front().first > now ? (int64_t)(c.acks.front().first - now) : 0;
+            if (due < waitUs) waitUs = due;
+        }
+        std::vector<pollfd> fds = {{_listener, POLLIN, 0}};
+        for (const Connection& c : _connections) fds.push_back({c.fd, POLLIN, 0});
+        struct timespec timeout = {(time_t)(waitUs / 1000000), (long)(waitUs % 1000000) * 1000};
+        ppoll(fds.data(), fds.size(), &timeout, nullptr);
+
+        std::lock_guard<std::mutex> lock(_statsMutex);
+        if (fds[0].revents & POLLIN) {
+            int fd = accept(_listener, nullptr, nullptr);
+            if (fd >= 0) {
+                int on = 1;
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+                Connection c = {};
+                c.fd = fd;
+                c.lastInUs = monotonicUs();
+                _connections.push_back(c);
+            }
+        }
+
+        // A connection closed here (or taken over by a later one) keeps its
+        // slot with fd -1 until the end of the pass, so the poll results stay
+        // in line with the connections that were there before accept()
+        size_t polled = fds.size() - 1;
+        for (size_t i = 0; i < _connections.size(); i++) {
+            Connection& c = _connections[i];
+            if (c.fd < 0) continue;
+            bool open = true;
+            if (i < polled && fds[i + 1].fd == c.fd && (fds[i + 1].revents & (POLLIN | POLLHUP | POLLERR))) {
+                ssize_t n = recv(c.fd, buffer, sizeof(buffer), 0);
+                if (n <= 0) {
+                    open = false;
+                } else {
+                    c.in.insert(c.in.end(), buffer, buffer + n);
+                    c.lastInUs = monotonicUs();
+                    second().bytesIn += n;
+                    _stats.bytesIn += n;
+                }
+            }
+
+            // Whole packets: type byte, remaining length, body
+            size_t pos = 0;
+            while (open && c.in.size() - pos >= 2) {
+                size_t length = 0, header = 0;
+                for (size_t k = 1; k < 5 && pos + k < c.in.size(); k++) {
+                    length |= (size_t)(c.in[pos + k] & 0x7F) << (7 * (k - 1));
+                    if (!(c.in[pos + k] & 0x80)) {
+                        header = k + 1;
+                        break;
+                    }
+                }
+                if (!header || c.in.size() - pos < header + length) break;
+                open = packet(c, c.in[pos], &c.in[pos + header], length);
+                pos += header + length;
+            }
+            if (open) c.in.erase(c.in.begin(), c.in.begin() + pos);
+
+            // Due PUBACKs go out together
+            uint8_t out[4 * 256];
+            size_t outLength = 0;
+            now = monotonicUs();
+            while (open && !c.acks.empty() && c.acks.front().first <= now && outLength < sizeof(out)) {
+                uint16_t id = c.acks.front().second;
+                uint8_t puback[4] = {0x40, 2, (uint8_t)(id >> 8), (uint8_t)id};
+                memcpy(out + outLength, puback, 4);
+                outLength += 4;
+                c.acks.pop_front();
+            }
+            if (outLength && !sendAll(c.fd, out, outLength)) open = false;
+
+            // Silent for 1.5 keepalive periods: the client is gone
+            if (open && c.keepAliveMs && now - c.lastInUs > c.keepAliveMs * 1500ULL) {
+                second().expired++;
+                _stats.expired++;
+                open = false;
+            }
+            if (!open) close(i, !c.closing);
+        }
+
+        for (size_t i = 0; i < _connections.size(); i++) {
+            if (_connections[i].fd >= 0) continue;
+            _connections.erase(_connections.begin() + i);
+            i--;
+        }
+        second().connections = _connections.size();
+        if (_connections.size() > _stats.connectionsPeak) _stats.connectionsPeak = _connections.size();
+    }
+}
+
+void HostBroker::close(size_t index, bool publishWill) {
+    Connection& c = _connections[index];
+    if (c.fd < 0) return;
+    ::close(c.fd);
+    c.fd = -1;
+    if (publishWill && c.connected && !c.willTopic.empty()) {
+        second().wills++;
+        _stats.wills++;
+        if (c.willRetain) {
+            if (c.willMessage.empty()) {
+                _stats.retained.erase(c.willTopic);
+            } else {
+                _stats.retained[c.willTopic] = c.willMessage;
+            }
+        }
+    }
+}
+
+bool HostBroker::connect(Connection& c, const uint8_t* body, size_t length) {
+    second().connects++;
+    _stats.connects++;
+    if (_options.connectCostUs) usleep(_options.connectCostUs);
+    if (c.connected || length < 10) return false;
+
+    uint8_t flags = body[7];
+    bool clean = flags & 0x02;
+    size_t pos = 10;
+    if (!readString(body, length, pos, c.clientId)) return false;
+    if (flags & 0x04) {
+        if (!readString(body, length, pos, c.willTopic) || !readString(body, length, pos, c.willMessage)) return false;
+        c.willRetain = flags & 0x20;
+    }
+    c.keepAliveMs = (body[8] << 8 | body[9]) * 1000;
+    c.connected = true;
+
+    // The same client id already connected: the older connection goes
+    for (size_t i = 0; i < _connections.size(); i++) {
+        Connection& other = _connections[i];
+        if (&other == &c || other.fd < 0 || !other.connected || other.clientId != c.clientId) continue;
+        second().takeovers++;
+        _stats.takeovers++;
+        close(i, true);
+    }
+
+    // Session present when the same client id connected before without a
+    // clean session
+    auto session = _sessions.find(c.clientId);
+    bool present = !clean && session != _sessions.end();
+    if (clean) {
+        _sessions.erase(c.clientId);
+    } else {
+        _sessions[c.clientId] = true;
+    }
+    uint8_t connack[4] = {0x20, 2, (uint8_t)(present ? 1 : 0), 0};
+    return sendAll(c.fd, connack, sizeof(connack));
+}
+
+// False when the connection is to be closed
+bool HostBroker::packet(Connection& c, uint8_t header, const uint8_t* body, size_t length) {
+    uint8_t reply[5];
+    if ((header & 0xF0) != 0x10 && !c.connected) return false;
+    switch (header & 0xF0) {
+        case 0x10:      // CONNECT
+            return connect(c, body, length);
+        case 0x30: {    // PUBLISH
+            if (length < 2) return false;
+            size_t topicLength = body[0] << 8 | body[1];
+            size_t idLength = (header & 0x06) ? 2 : 0;
+            if (length < 2 + topicLength + idLength) return false;
+            std::string topic((const char*)body + 2, topicLength);
+            second().publishes++;
+            _stats.publishes++;
+            if (topic.size() >= 7 && topic.compare(topic.size() - 7, 7, "/config") == 0) {
+                second().discovery++;
+                _stats.discovery++;
+            }
+            if (header & 0x01) {
+                size_t offset = 2 + topicLength + idLength;
+                if (length == offset) {
+                    _stats.retained.erase(topic);
+                } else {
+                    _stats.retained[topic].assign((const char*)body + offset, length - offset);
+                }
+            }
+            if (idLength) {
+                uint16_t id = body[2 + topicLength] << 8 | body[3 + topicLength];
+                c.acks.push_back(std::make_pair(monotonicUs() + _options.ackDelayUs, id));
+            }
+            // Lost in the middle of a burst: whatever is not acknowledged yet
+            // has to come again after the reconnect
+            if (_options.dropEvery && ++c.publishes % _options.dropEvery == 0) return false;
+            return true;
+        }
+        case 0x80:      // SUBSCRIBE: everything granted at QoS 0
+            if (length < 2) return false;
+            reply[0] = 0x90;
+            reply[1] = 3;
+            reply[2] = body[0];
+            reply[3] = body[1];
+            reply[4] = 0;
+            return sendAll(c.fd, reply, 5);
+        case 0xC0:      // PINGREQ
+            reply[0] = 0xD0;
+            reply[1] = 0;
+            return sendAll(c.fd, reply, 2);
+        case 0xE0:      // DISCONNECT: no will
+            c.closing = true;
+            return false;
+        default:
+            return true;
+    }
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+// A stand-in MQTT 3.1.1 broker on a real TCP port, for host tools that load
+// the MQTT path: tools/mqtt_bench and tools/fleet_sim.
+//
+//   HostBrokerOptions options;
+//   options.connectCostUs = 2000;
+//   HostBroker broker(options);
+//   broker.listen(0);                       // a free port on 127.0.0.1
+//   std::thread serving([&] { broker.run(); });
+//   ... clients connect to broker.port() ...
+//   broker.stop();
+//   serving.join();
+//   HostBrokerStats stats = broker.stats();
+//
+// It answers like a broker: CONNACK (session present when the same client id
+// had a persistent session), PUBACK for QoS 1, SUBACK, PINGRESP. It keeps
+// retained messages, publishes a connection's will (into the retained store
+// when it is retained) when the connection ends without DISCONNECT, disconnects
+// the older connection when a client id connects twice, and closes connections
+// that stay silent for 1.5 keepalive periods. Nothing is routed to
+// subscribers.
+//
+// One thread serves every connection, as Mosquitto does, so connectCostUs
+// (the time a CONNECT keeps the broker busy: authentication, session lookup,
+// persistence) delays everything behind it. stats() counts per second of the
+// run what a broker's $SYS topics would show.
+
+#include <Arduino.h>
+#include <atomic>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct HostBrokerOptions {
+    uint32_t ackDelayUs = 0;        // PUBACKs held this long (the round trip)
+    uint32_t dropEvery = 0;         // close a connection after its every Nth PUBLISH
+    uint32_t connectCostUs = 0;     // broker busy this long per CONNECT
+    int backlog = 128;              // listen() backlog
+};
+
+struct HostBrokerSecond {
+    uint32_t connects;              // CONNECT packets
+    uint32_t publishes;             // PUBLISH packets received
+    uint32_t discovery;             // of them to a .../config topic
+    uint32_t bytesIn;
+    uint32_t wills;                 // wills published
+    uint32_t takeovers;             // connections closed for a newer one with the same client id
+    uint32_t expired;               // connections closed by the keepalive
+    uint32_t connections;           // open at the end of the second
+};
+
+struct HostBrokerStats {
+    uint64_t connects;
+    uint64_t publishes;
+    uint64_t discovery;
+    uint64_t bytesIn;
+    uint64_t wills;
+    uint64_t takeovers;
+    uint64_t expired;
+    uint32_t connectionsPeak;
+    std::vector<HostBrokerSecond> seconds;          // from listen()
+    std::map<std::string, std::string> retained;    // topic -> payload
+};
+
+class HostBroker {
+public:
+    explicit HostBroker(const HostBrokerOptions& options = HostBrokerOptions()) : _options(options) {}
+    ~HostBroker();
+
+    // 0 listens on a free port of the loopback interface, any other port on
+    // all interfaces (for a board to connect to)
+    bool listen(uint16_t port);
+    uint16_t port() const { return _port; }
+
+    // Serves until stop(), which may come from another thread
+    void run();
+    void stop() { _stopping = true; }
+
+    HostBrokerStats stats();
+
+private:
+    struct Connection {
+        int fd;
+        std::vector<uint8_t> in;
+        std::deque<std::pair<uint64_t, uint16_t>> acks;     // (due, packet id)
+        uint32_t publishes;
+        bool connected;             // CONNECT seen
+        std::string clientId;
+        std::string willTopic;
+        std::string willMessage;
+        bool willRetain;
+        uint32_t keepAliveMs;
+        uint64_t lastInUs;
+        bool closing;               // DISCONNECT seen: no will
+    };
+
+    bool packet(Connection& c, uint8_t header, const uint8_t* body, size_t length);
+    bool connect(Connection& c, const uint8_t* body, size_t length);
+    void close(size_t index, bool publishWill);
+    HostBrokerSecond& second();
+
+    HostBrokerOptions _options;
+    int _listener = -1;
+    uint16_t _port = 0;
+    uint64_t _startUs = 0;
+    std::atomic<bool> _stopping{false};
+    std::vector<Connection> _connections;
+    std::map<std::string, bool> _sessions;      // client id -> persistent session kept
+
+    std::mutex _statsMutex;
+    HostBrokerStats _stats = {};
+};
@@ -0,0 +1,233 @@
+#include "host_net.h"
+#include "PubSubClient.h"
+#include "WiFi.h"
+#include "Wire.h"
+
+WiFiClass WiFi;
+TwoWire Wire;
+TwoWire Wire1;
+
+static HostNetSimulated defaultBackend;
+static HostNetBackend* currentBackend = &defaultBackend;
+
+void hostSetNetBackend(HostNetBackend* backend) {
+    currentBackend = backend ? backend : &defaultBackend;
+}
+
+HostNetBackend& hostNetBackend() {
+    return *currentBackend;
+}
+
+// HostNetSimulated
+
+uint8_t HostNetSimulated::wifiStatus() {
+    return WL_CONNECTED;
+}
+
+int HostNetSimulated::mqttConnect(PubSubClient& client, const char* clientId) {
+    (void)client; (void)clientId;
+    return MQTT_CONNECTED;
+}
+
+bool HostNetSimulated::mqttConnected(PubSubClient& client) {
+    (void)client;
+    return true;
+}
+
+bool HostNetSimulated::mqttPublish(PubSubClient& client, const char* topic, const uint8_t* payload,
+                                   size_t length, bool retained) {
+    (void)client; (void)topic; (void)payload; (void)length; (void)retained;
+    _publishCount++;
+    return true;
+}
+
+bool HostNetSimulated::scd4xDataReady() {
+    return millis() - _lastReading >= 5000;
+}
+
+uint16_t HostNetSimulated::scd4xRead(uint16_t& co2, float& temperature, float& humidity) {
+    _lastReading = millis();
+    // An occupied room: slow daily temperature swing, CO2 building up and clearing every hour
+    float hours = millis() / 3600000.0f;
+    temperature = 22.0f + 1.5f * sinf(hours * (float)TWO_PI / 24.0f);
+    humidity = 45.0f + 5.0f * sinf(hours * (float)TWO_PI / 6.0f);
+    co2 = 600 + (uint16_t)(500 * (hours - floorf(hours)));
+    return 0;
+}
+
+// WiFiClass
+
+wl_status_t WiFiClass::begin(const char* ssid, const char* passphrase, int32_t channel,
+                             const uint8_t* bssid, bool connect) {
+    (void)passphrase; (void)channel; (void)bssid;
+    _ssid = ssid;
+    if (connect) hostNetBackend().wifiBegin();
+    return status();
+}
+
+bool WiFiClass::disconnect(bool wifiOff, bool eraseAp) {
+    (void)wifiOff; (void)eraseAp;
+    hostNetBackend().wifiDisconnect();
+    return true;
+}
+
+// WiFiClient
+
+// The backend's mqtt*() calls take the PubSubClient they serve; raw
+// connections share this one
+static PubSubClient& brokerPeer() {
+    static PubSubClient peer;
+    return peer;
+}
+
+int WiFiClient::connect(const char* host, uint16_t port) {
+    (void)host; (void)port;
+    stop();
+    if (hostNetBackend().wifiStatus() != WL_CONNECTED) return 0;
+    _open = true;
+    return 1;
+}
+
+size_t WiFiClient::write(const uint8_t* buf, size_t size) {
+    if (!connected()) return 0;
+    _out.insert(_out.end(), buf, buf + size);
+    // Answers each complete packet: type byte, remaining length, body
+    while (_open && _out.size() >= 2) {
+        size_t length = 0, pos = 1;
+        bool complete = false;
+        while (pos < _out.size() && pos < 5) {
+            uint8_t digit = _out[pos];
+            length |= (size_t)(digit & 0x7F) << (7 * (pos - 1));
+            pos++;
+            if (!(digit & 0x80)) {
+                complete = true;
+                break;
+            }
+        }
+        if (!complete || _out.size() < pos + length) break;
+        answer(_out[0], _out.data() + pos, length);
+        if (_open) _out.erase(_out.begin(), _out.begin() + pos + length);
+    }
+    return size;
+}
+
+void WiFiClient::answer(uint8_t header, const uint8_t* body, size_t length) {
+    HostNetBackend& backend = hostNetBackend();
+    switch (header & 0xF0) {
+        case 0x10: {    // CONNECT: protocol name, level, flags and keepalive, then the client id
+            if (length < 12) break;
+            std::string id((const char*)body + 12, (body[10] << 8 | body[11]));
+            int state = backend.mqttConnect(brokerPeer(), id.c_str());
+            if (state == MQTT_CONNECTED) {
+                _session = true;
+                reply({0x20, 2, 0, 0});
+            } else if (state > 0) {
+                reply({0x20, 2, 0, (uint8_t)state});
+            } else {
+                stop();     // no answer: timeout or refused connection
+            }
+            break;
+        }
+        case 0x30: {    // PUBLISH
+            if (!_session || length < 2) break;
+            uint8_t qos = (header >> 1) & 3;
+            size_t topicLength = body[0] << 8 | body[1];
+            size_t payloadStart = 2 + topicLength + (qos ? 2 : 0);
+            if (length < payloadStart) break;
+            std::string topic((const char*)body + 2, topicLength);
+            if (!backend.mqttPublish(brokerPeer(), topic.c_str(), body + payloadStart, length - payloadStart, header & 1)) {
+                stop();
+            } else if (qos) {
+                reply({0x40, 2, body[2 + topicLength], body[3 + topicLength]});
+            }
+            break;
+        }
+        case 0xC0:      // PINGREQ
+            reply({0xD0, 0});
+            break;
+        case 0xE0:      // DISCONNECT
+            if (_session) backend.mqttDisconnect(brokerPeer());
+            stop();
+            break;
+        default:
+            break;
+    }
+}
+
+int WiFiClient::read(uint8_t* buf, size_t size) {
+    size_t n = size < _in.size() ? size : _in.size();
+    std::copy(_in.begin(), _in.begin() + n, buf);
+    _in.erase(_in.begin(), _in.begin() + n);
+    return (int)n;
+}
+
+uint8_t WiFiClient::connected() {
+    if (!_open) return false;
+    if (hostNetBackend().wifiStatus() != WL_CONNECTED || (_session && !hostNetBackend().mqttConnected(brokerPeer()))) {
+        stop();
+    }
+    return _open;
+}
+
+void WiFiClient::stop() {
+    _open = false;
+    _session = false;
+    _out.clear();
+    _in.clear();
+}
+
+// PubSubClient
+
+bool PubSubClient::connect(const char* id, const char* user, const char* pass, const char* willTopic,
+                           uint8_t willQos, bool willRetain, const char* willMessage, bool cleanSession) {
+    (void)user; (void)pass; (void)willTopic; (void)willQos; (void)willRetain; (void)willMessage; (void)cleanSession;
+    if (connected()) return true;
+    if (hostNetBackend().wifiStatus() != WL_CONNECTED) {
+        _state = MQTT_CONNECT_FAILED;
+        return false;
+    }
+    _state = hostNetBackend().mqttConnect(*this, id);
+    return _state == MQTT_CONNECTED;
+}
+
+void PubSubClient::disconnect() {
+    if (_state == MQTT_CONNECTED) hostNetBackend().mqttDisconnect(*this);
+    _state = MQTT_DISCONNECTED;
+}
+
+bool PubSubClient::publish(const char* topic, const uint8_t* payload, unsigned int length, bool retained) {
+    if (!connected()) return false;
+    // Same limit as the real client: the whole packet has to fit in the buffer
+    size_t packet = 5 + 2 + strlen(topic) + length;
+    if (packet > _bufferSize) return false;
+    return hostNetBackend().mqttPublish(*this, topic, payload, length, retained);
+}
+
+bool PubSubClient::subscribe(const char* topic, uint8_t qos) {
+    (void)qos;
+    if (!connected()) return false;
+    return hostNetBackend().mqttSubscribe(*this, topic);
+}
+
+bool PubSubClient::loop() {
+    if (!connected()) return false;
+    hostNetBackend().mqttLoop(*this);
+    return true;
+}
+
+bool PubSubClient::connected() {
+    if (_state != MQTT_CONNECTED) return false;
+    if (!hostNetBackend().mqttConnected(*this)) {
+        _state = MQTT_CONNECTION_LOST;
+        return false;
+    }
+    return true;
+}
+
+void PubSubClient::hostDeliver(const char* topic, const uint8_t* payload, unsigned int length) {
+    if (!_callback) return;
+    // The real client hands out pointers into its buffer; copy so the callback may modify them
+    std::string topicCopy(topic);
+    std::string payloadCopy((const char*)payload, length);
+    _callback(&topicCopy[0], (uint8_t*)&payloadCopy[0], length);
+}
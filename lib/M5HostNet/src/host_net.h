@@ -0,0 +1,55 @@
+#pragma once
+
+// Everything the network and sensor stand-ins do is decided by one backend
+// object. The default backend is an ideal world (WiFi and the broker always up,
+// a slowly drifting SCD40 reading every 5 s); harnesses such as the trace replay
+// install their own with hostSetNetBackend() before setup() runs.
+
+#include <Arduino.h>
+
+class PubSubClient;
+
+class HostNetBackend {
+public:
+    virtual ~HostNetBackend() {}
+
+    // WiFi (values are wl_status_t)
+    virtual uint8_t wifiStatus() = 0;
+    virtual void wifiBegin() {}
+    virtual void wifiDisconnect() {}
+    virtual IPAddress wifiLocalIP() { return IPAddress(192, 168, 1, 50); }
+
+    // MQTT; mqttConnect() returns the resulting PubSubClient state (0 = connected)
+    virtual int mqttConnect(PubSubClient& client, const char* clientId) = 0;
+    virtual bool mqttConnected(PubSubClient& client) = 0;
+    virtual void mqttDisconnect(PubSubClient& client) { (void)client; }
+    virtual bool mqttPublish(PubSubClient& client, const char* topic, const uint8_t* payload,
+                             size_t length, bool retained) = 0;
+    virtual bool mqttSubscribe(PubSubClient& client, const char* topic) { (void)client; (void)topic; return true; }
+    virtual void mqttLoop(PubSubClient& client) { (void)client; }
+
+    // SCD4x; scd4xRead() returns the driver error code (0 = ok)
+    virtual bool scd4xDataReady() = 0;
+    virtual uint16_t scd4xRead(uint16_t& co2, float& temperature, float& humidity) = 0;
+};
+
+// Ideal-world backend used unless a harness installs another one
+class HostNetSimulated : public HostNetBackend {
+public:
+    uint8_t wifiStatus() override;
+    int mqttConnect(PubSubClient& client, const char* clientId) override;
+    bool mqttConnected(PubSubClient& client) override;
+    bool mqttPublish(PubSubClient& client, const char* topic, const uint8_t* payload,
+                     size_t length, bool retained) override;
+    bool scd4xDataReady() override;
+    uint16_t scd4xRead(uint16_t& co2, float& temperature, float& humidity) override;
+
+    uint32_t publishCount() const { return _publishCount; }
+
+private:
+    uint32_t _publishCount = 0;
+    unsigned long _lastReading = 0;
+};
+
+void hostSetNetBackend(HostNetBackend* backend);
+HostNetBackend& hostNetBackend();
@@ -0,0 +1,68 @@
+#include "socket_client.h"
+
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <string>
+
+int SocketClient::connect(const char* host, uint16_t port) {
+    stop();
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* found = nullptr;
+    if (getaddrinfo(host, std::to_string(port).c_str(), &hints, &found) != 0) return 0;
+    for (addrinfo* a = found; a && _fd < 0; a = a->ai_next) {
+        _fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+        if (_fd >= 0 && ::connect(_fd, a->ai_addr, a->ai_addrlen) != 0) stop();
+    }
+    freeaddrinfo(found);
+    if (_fd < 0) return 0;
+    int on = 1;
+    setsockopt(_fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    return 1;
+}
+
+size_t SocketClient::write(const uint8_t* buf, size_t size) {
+    size_t sent = 0;
+    while (_fd >= 0 && sent < size) {
+        ssize_t n = send(_fd, buf + sent, size - sent, MSG_NOSIGNAL);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) continue;
+            break;
+        }
+        sent += n;
+    }
+    return sent;
+}
+
+int SocketClient::available() {
+    int n = 0;
+    if (_fd < 0 || ioctl(_fd, FIONREAD, &n) != 0) return 0;
+    return n;
+}
+
+int SocketClient::read(uint8_t* buf, size_t size) {
+    if (_fd < 0) return -1;
+    return (int)recv(_fd, buf, size, 0);
+}
+
+uint8_t SocketClient::connected() {
+    if (_fd < 0) return false;
+    uint8_t byte;
+    ssize_t n = recv(_fd, &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+        stop();
+        return false;
+    }
+    return true;
+}
+
+void SocketClient::stop() {
+    if (_fd >= 0) close(_fd);
+    _fd = -1;
+}
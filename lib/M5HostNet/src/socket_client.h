@@ -0,0 +1,32 @@
+#pragma once
+
+// A real TCP socket as an Arduino Client, like WiFiClient with
+// setNoDelay(true), for host tools that talk to a broker on the network
+// rather than to the backend's stand-in.
+
+#include <Arduino.h>
+
+class SocketClient : public Client {
+public:
+    ~SocketClient() { stop(); }
+
+    using Client::connect;
+    int connect(const char* host, uint16_t port) override;
+    size_t write(const uint8_t* buf, size_t size) override;
+    int available() override;
+    int read(uint8_t* buf, size_t size) override;
+    uint8_t connected() override;
+    void stop() override;
+
+    int fd() const { return _fd; }
+    // Forgets the socket without closing it, so the peer sees no FIN: what
+    // a board that loses power or its link leaves behind
+    int release() {
+        int fd = _fd;
+        _fd = -1;
+        return fd;
+    }
+
+private:
+    int _fd = -1;
+};
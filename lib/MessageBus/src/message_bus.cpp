@@ -0,0 +1,174 @@
+#include "message_bus.h"
+
+static TopicBase* allTopics = nullptr;
+
+static int latencyBucket(uint32_t us) {
+    int bucket = 0;
+    while (us > 1 && bucket < MESSAGE_LATENCY_BUCKETS - 1) {
+        us >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+uint32_t TopicMetrics::latencyPercentileUs(int pct) const {
+    uint32_t total = 0;
+    for (int i = 0; i < MESSAGE_LATENCY_BUCKETS; i++) total += latency[i];
+    if (total == 0) return 0;
+
+    uint32_t rank = ((uint64_t)pct * total + 99) / 100;
+    uint32_t seen = 0;
+    for (int i = 0; i < MESSAGE_LATENCY_BUCKETS; i++) {
+        seen += latency[i];
+        if (seen >= rank) {
+            if (i == MESSAGE_LATENCY_BUCKETS - 1) return maxLatencyUs;
+            uint32_t edge = (2u << i) - 1;
+            return edge < maxLatencyUs ? edge : maxLatencyUs;
+        }
+    }
+    return maxLatencyUs;
+}
+
+// SubscriberBase
+
+SubscriberBase::SubscriberBase(TopicBase& topic, const char* name, BackpressurePolicy policy)
+    : _topic(topic), _name(name), _policy(policy) {
+    _head.store(0);
+    _tail.store(0);
+    _latest.store(-1);
+    _dropped.store(0);
+    for (int i = 0; i < MESSAGE_QUEUE_DEPTH; i++) _ring[i].store(-1);
+
+    // Subscribers are set up before anything is published (normally as globals)
+    if (topic._subscriberCount < MESSAGE_MAX_SUBSCRIBERS) {
+        topic._subscribers[topic._subscriberCount++] = this;
+    }
+}
+
+// Publisher side. The caller has already counted this subscriber's reference.
+void SubscriberBase::offer(int slot) {
+    if (_policy == COALESCE_LATEST) {
+        int8_t replaced = _latest.exchange((int8_t)slot, std::memory_order_acq_rel);
+        if (replaced >= 0) {
+            _dropped.fetch_add(1, std::memory_order_relaxed);
+            _topic._coalesced.fetch_add(1, std::memory_order_relaxed);
+            _topic.release(replaced);
+        }
+        return;
+    }
+
+    // DROP_OLDEST: single producer, but the consumer and the producer both
+    // advance head, so a full ring is made room in with a compare-exchange
+    uint32_t tail = _tail.load(std::memory_order_relaxed);
+    for (;;) {
+        uint32_t head = _head.load(std::memory_order_acquire);
+        if (tail - head < (uint32_t)MESSAGE_QUEUE_DEPTH) break;
+        if (_head.compare_exchange_weak(head, head + 1, std::memory_order_acq_rel)) {
+            int8_t oldest = _ring[head & (MESSAGE_QUEUE_DEPTH - 1)].load(std::memory_order_relaxed);
+            _dropped.fetch_add(1, std::memory_order_relaxed);
+            _topic._dropped.fetch_add(1, std::memory_order_relaxed);
+            _topic.release(oldest);
+            break;
+        }
+    }
+    _ring[tail & (MESSAGE_QUEUE_DEPTH - 1)].store((int8_t)slot, std::memory_order_relaxed);
+    _tail.store(tail + 1, std::memory_order_release);
+}
+
+// Subscriber side
+int SubscriberBase::take() {
+    if (_policy == COALESCE_LATEST) {
+        return _latest.exchange(-1, std::memory_order_acq_rel);
+    }
+
+    for (;;) {
+        uint32_t head = _head.load(std::memory_order_acquire);
+        if (head == _tail.load(std::memory_order_acquire)) return -1;
+        int8_t slot = _ring[head & (MESSAGE_QUEUE_DEPTH - 1)].load(std::memory_order_relaxed);
+        // Fails if the publisher dropped this entry in the meantime; then try the next
+        if (_head.compare_exchange_weak(head, head + 1, std::memory_order_acq_rel)) return slot;
+    }
+}
+
+// TopicBase
+
+TopicBase::TopicBase(const char* name, MessageSlot* slots, int slotCount)
+    : _name(name), _slots(slots), _slotCount(slotCount), _sequence(0), _subscriberCount(0) {
+    for (int i = 0; i < MESSAGE_MAX_SUBSCRIBERS; i++) _subscribers[i] = nullptr;
+    resetMetrics();
+    _next = allTopics;
+    allTopics = this;
+}
+
+int TopicBase::acquire() {
+    for (int i = 0; i < _slotCount; i++) {
+        uint8_t expected = 0;
+        if (_slots[i].refs.compare_exchange_strong(expected, 1, std::memory_order_acquire)) return i;
+    }
+    _poolExhausted.fetch_add(1, std::memory_order_relaxed);
+    return -1;
+}
+
+void TopicBase::commit(int slot) {
+    MessageSlot& s = _slots[slot];
+    s.publishedUs = micros();
+    s.sequence = ++_sequence;
+    _published.fetch_add(1, std::memory_order_relaxed);
+
+    // One reference per subscriber before any of them can see the slot
+    s.refs.fetch_add(_subscriberCount, std::memory_order_relaxed);
+    for (int i = 0; i < _subscriberCount; i++) _subscribers[i]->offer(slot);
+    release(slot);   // the publisher's own reference
+}
+
+void TopicBase::release(int slot) {
+    _slots[slot].refs.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+void TopicBase::recordDelivery(int slot) {
+    uint32_t latency = micros() - _slots[slot].publishedUs;
+    _delivered.fetch_add(1, std::memory_order_relaxed);
+    _latency[latencyBucket(latency)].fetch_add(1, std::memory_order_relaxed);
+
+    uint32_t seen = _maxLatencyUs.load(std::memory_order_relaxed);
+    while (latency > seen && !_maxLatencyUs.compare_exchange_weak(seen, latency, std::memory_order_relaxed)) {
+    }
+}
+
+TopicMetrics TopicBase::metrics() const {
+    TopicMetrics m;
+    m.published = _published.load(std::memory_order_relaxed);
+    m.delivered = _delivered.load(std::memory_order_relaxed);
+    m.dropped = _dropped.load(std::memory_order_relaxed);
+    m.coalesced = _coalesced.load(std::memory_order_relaxed);
+    m.poolExhausted = _poolExhausted.load(std::memory_order_relaxed);
+    m.maxLatencyUs = _maxLatencyUs.load(std::memory_order_relaxed);
+    for (int i = 0; i < MESSAGE_LATENCY_BUCKETS; i++) m.latency[i] = _latency[i].load(std::memory_order_relaxed);
+    return m;
+}
+
+void TopicBase::resetMetrics() {
+    _published.store(0);
+    _delivered.store(0);
+    _dropped.store(0);
+    _coalesced.store(0);
+    _poolExhausted.store(0);
+    _maxLatencyUs.store(0);
+    for (int i = 0; i < MESSAGE_LATENCY_BUCKETS; i++) _latency[i].store(0);
+}
+
+void printBusMetrics(Print& out) {
+    for (TopicBase* t = allTopics; t; t = t->_next) {
+        TopicMetrics m = t->metrics();
+        out.printf("bus %s: %u published, %u delivered, %u dropped, %u coalesced, %u no slot, "
+                   "latency p50 %u us p99 %u us max %u us\n",
+                   t->name(), (unsigned)m.published, (unsigned)m.delivered, (unsigned)m.dropped,
+                   (unsigned)m.coalesced, (unsigned)m.poolExhausted, (unsigned)m.latencyPercentileUs(50),
+                   (unsigned)m.latencyPercentileUs(99), (unsigned)m.maxLatencyUs);
+        for (int i = 0; i < t->_subscriberCount; i++) {
+            SubscriberBase* s = t->_subscribers[i];
+            out.printf("    %s (%s): %u missed\n", s->name(),
+                       s->policy() == COALESCE_LATEST ? "latest" : "queue", (unsigned)s->dropped());
+        }
+    }
+}
@@ -0,0 +1,210 @@
+#pragma once
+
+// Typed in-process publish/subscribe with zero-copy fan-out.
+//
+// A Topic<T, SLOTS> owns SLOTS fixed message slots. publish() copies the value
+// into a free slot once and hands every subscriber a reference to that slot;
+// the slot is reused when the last subscriber lets go of it. Nothing is
+// allocated after construction.
+//
+// Each Subscriber has its own queue and backpressure policy:
+//   DROP_OLDEST      a ring of MESSAGE_QUEUE_DEPTH slots; when it is full the
+//                    oldest unread message is dropped (history, logs)
+//   COALESCE_LATEST  holds only the newest unread message; an unread one is
+//                    replaced (display, MQTT state, anything that wants "now")
+//
+// Queues are lock-free, so the publisher and each subscriber can run on
+// different FreeRTOS tasks or cores. A topic may have one publishing task and
+// each subscriber one receiving task.
+//
+// Every topic counts publishes, deliveries, drops, coalesced messages and
+// publishes that found no free slot, and keeps a log2 histogram of publish to
+// receive latency. printBusMetrics() lists all topics.
+//
+// Sizing: a subscriber can pin up to MESSAGE_QUEUE_DEPTH queued slots plus the
+// one it is reading, so SLOTS >= subscribers * (MESSAGE_QUEUE_DEPTH + 1) + 1
+// never runs out; fewer is fine when subscribers keep up.
+
+#include <Arduino.h>
+#include <atomic>
+
+const int MESSAGE_QUEUE_DEPTH = 8;          // power of two
+const int MESSAGE_MAX_SUBSCRIBERS = 6;
+const int MESSAGE_LATENCY_BUCKETS = 24;     // bucket i: [2^i, 2^(i+1)) us, last one open-ended
+
+enum BackpressurePolicy : uint8_t {
+    DROP_OLDEST,
+    COALESCE_LATEST,
+};
+
+struct MessageSlot {
+    std::atomic<uint8_t> refs{0};   // 0 = free
+    uint32_t publishedUs = 0;
+    uint32_t sequence = 0;
+};
+
+struct TopicMetrics {
+    uint32_t published;
+    uint32_t delivered;       // messages handed to a subscriber by receive()
+    uint32_t dropped;         // DROP_OLDEST queue overflows
+    uint32_t coalesced;       // COALESCE_LATEST messages replaced before being read
+    uint32_t poolExhausted;   // publishes that found every slot in use
+    uint32_t maxLatencyUs;
+    uint32_t latency[MESSAGE_LATENCY_BUCKETS];
+
+    // Upper edge of the bucket holding the pct-th percentile (at most the max), in us
+    uint32_t latencyPercentileUs(int pct) const;
+};
+
+class TopicBase;
+
+class SubscriberBase {
+public:
+    const char* name() const { return _name; }
+    BackpressurePolicy policy() const { return _policy; }
+    uint32_t dropped() const { return _dropped.load(std::memory_order_relaxed); }   // messages it never received
+
+protected:
+    SubscriberBase(TopicBase& topic, const char* name, BackpressurePolicy policy);
+
+    // Next slot for this subscriber (its reference already counted), or -1
+    int take();
+
+    TopicBase& _topic;
+
+private:
+    friend class TopicBase;
+    void offer(int slot);   // called by the publisher
+
+    const char* _name;
+    BackpressurePolicy _policy;
+    std::atomic<uint32_t> _head;
+    std::atomic<uint32_t> _tail;
+    std::atomic<int8_t> _ring[MESSAGE_QUEUE_DEPTH];
+    std::atomic<int8_t> _latest;
+    std::atomic<uint32_t> _dropped;
+};
+
+class TopicBase {
+public:
+    const char* name() const { return _name; }
+    TopicMetrics metrics() const;
+    void resetMetrics();
+
+    // Internal: used by MessageRef and SubscriberBase
+    void release(int slot);
+    void recordDelivery(int slot);
+    const MessageSlot& slot(int index) const { return _slots[index]; }
+
+protected:
+    TopicBase(const char* name, MessageSlot* slots, int slotCount);
+
+    int acquire();           // a free slot with the publisher's reference, or -1
+    void commit(int slot);   // stamps it and fans it out
+
+private:
+    friend class SubscriberBase;
+    friend void printBusMetrics(Print& out);
+
+    const char* _name;
+    MessageSlot* _slots;
+    int _slotCount;
+    uint32_t _sequence;
+    SubscriberBase* _subscribers[MESSAGE_MAX_SUBSCRIBERS];
+    int _subscriberCount;
+    TopicBase* _next;    // all topics, for printBusMetrics()
+
+    std::atomic<uint32_t> _published;
+    std::atomic<uint32_t> _delivered;
+    std::atomic<uint32_t> _dropped;
+    std::atomic<uint32_t> _coalesced;
+    std::atomic<uint32_t> _poolExhausted;
+    std::atomic<uint32_t> _maxLatencyUs;
+    std::atomic<uint32_t> _latency[MESSAGE_LATENCY_BUCKETS];
+};
+
+// A received message: keeps its slot alive until it is reset, reused for the
+// next receive() or destroyed. Move-only.
+template <typename T>
+class MessageRef {
+public:
+    MessageRef() {}
+    MessageRef(const MessageRef&) = delete;
+    MessageRef& operator=(const MessageRef&) = delete;
+    MessageRef(MessageRef&& other) : _topic(other._topic), _value(other._value), _slot(other._slot) {
+        other._slot = -1;
+    }
+    ~MessageRef() { reset(); }
+
+    explicit operator bool() const { return _slot >= 0; }
+    const T& operator*() const { return *_value; }
+    const T* operator->() const { return _value; }
+    uint32_t publishedUs() const { return _topic->slot(_slot).publishedUs; }
+    uint32_t sequence() const { return _topic->slot(_slot).sequence; }
+
+    void reset() {
+        if (_slot >= 0) _topic->release(_slot);
+        _slot = -1;
+    }
+
+private:
+    template <typename> friend class Subscriber;
+
+    TopicBase* _topic = nullptr;
+    const T* _value = nullptr;
+    int _slot = -1;
+};
+
+template <typename T, int SLOTS = 8>
+class Topic : public TopicBase {
+public:
+    explicit Topic(const char* name) : TopicBase(name, _slotStorage, SLOTS) {}
+
+    // Copies value into a free slot and queues it for every subscriber.
+    // Returns false (and counts it) if every slot is still in use.
+    bool publish(const T& value) {
+        int slot = acquire();
+        if (slot < 0) return false;
+        _values[slot] = value;
+        commit(slot);
+        return true;
+    }
+
+    // Used by Subscriber<T>
+    const T* value(int slot) const { return &_values[slot]; }
+
+private:
+    MessageSlot _slotStorage[SLOTS];
+    T _values[SLOTS];
+};
+
+template <typename T>
+class Subscriber : public SubscriberBase {
+public:
+    template <int SLOTS>
+    Subscriber(Topic<T, SLOTS>& topic, const char* name, BackpressurePolicy policy)
+        : SubscriberBase(topic, name, policy), _valueAt(&valueAt<SLOTS>) {}
+
+    // Replaces ref with the next message; false (and ref untouched) if there is none
+    bool receive(MessageRef<T>& ref) {
+        int slot = take();
+        if (slot < 0) return false;
+        ref.reset();
+        ref._topic = &_topic;
+        ref._value = _valueAt(_topic, slot);
+        ref._slot = slot;
+        _topic.recordDelivery(slot);
+        return true;
+    }
+
+private:
+    template <int SLOTS>
+    static const T* valueAt(TopicBase& topic, int slot) {
+        return static_cast<Topic<T, SLOTS>&>(topic).value(slot);
+    }
+
+    const T* (*_valueAt)(TopicBase&, int);
+};
+
+// One line per topic: counters and p50/p99/max latency
+void printBusMetrics(Print& out);
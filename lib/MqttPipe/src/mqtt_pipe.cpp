@@ -0,0 +1,445 @@
+#include "mqtt_pipe.h"
+
+#include <string.h>
+
+// Control packet types (the high nibble of the first byte)
+static const uint8_t PACKET_CONNECT = 0x10;
+static const uint8_t PACKET_CONNACK = 0x20;
+static const uint8_t PACKET_PUBLISH = 0x30;
+static const uint8_t PACKET_PUBACK = 0x40;
+static const uint8_t PACKET_SUBSCRIBE = 0x82;      // with its required flags
+static const uint8_t PACKET_PINGREQ = 0xC0;
+static const uint8_t PACKET_PINGRESP = 0xD0;
+static const uint8_t PACKET_DISCONNECT = 0xE0;
+
+static const uint8_t FLAG_DUP = 0x08;
+
+// Remaining length: 7 bits per byte, low bits first; returns the byte count
+static size_t encodeLength(uint8_t* out, size_t length) {
+    size_t count = 0;
+    do {
+        uint8_t digit = length & 0x7F;
+        length >>= 7;
+        out[count++] = length ? digit | 0x80 : digit;
+    } while (length);
+    return count;
+}
+
+// False while the header is incomplete; `header` counts the type byte too
+static bool decodeLength(const uint8_t* data, size_t available, size_t& length, size_t& header, bool& malformed) {
+    length = 0;
+    malformed = false;
+    for (size_t i = 1; i < available; i++) {
+        length |= (size_t)(data[i] & 0x7F) << (7 * (i - 1));
+        if (!(data[i] & 0x80)) {
+            header = i + 1;
+            return true;
+        }
+        if (i == 4) {
+            malformed = true;
+            return false;
+        }
+    }
+    return false;
+}
+
+static size_t stringLength(const char* s) {
+    return s ? 2 + strlen(s) : 0;
+}
+
+MqttPipe& MqttPipe::setServer(const char* domain, uint16_t port) {
+    _domain = domain;
+    _port = port;
+    return *this;
+}
+
+void MqttPipe::setWindow(uint8_t messages) {
+    if (messages < 1) messages = 1;
+    if (messages > MQTT_PIPE_MAX_WINDOW) messages = MQTT_PIPE_MAX_WINDOW;
+    _window = messages;
+}
+
+void MqttPipe::setAckCallback(MqttPipeAckCallback callback, void* user) {
+    _ackCallback = callback;
+    _ackUser = user;
+}
+
+void MqttPipe::setMessageCallback(MqttPipeMessageCallback callback, void* user) {
+    _messageCallback = callback;
+    _messageUser = user;
+}
+
+bool MqttPipe::append(const void* data, size_t length) {
+    const uint8_t* p = (const uint8_t*)data;
+    while (length) {
+        if (_batchLength == sizeof(_batch) && !flush()) return false;
+        size_t chunk = sizeof(_batch) - _batchLength;
+        if (chunk > length) chunk = length;
+        memcpy(_batch + _batchLength, p, chunk);
+        _batchLength += chunk;
+        p += chunk;
+        length -= chunk;
+    }
+    return true;
+}
+
+bool MqttPipe::endPacket() {
+    return _batching ? true : flush();
+}
+
+bool MqttPipe::sendControl(uint8_t type, const uint8_t* body, size_t length) {
+    uint8_t header[5];
+    header[0] = type;
+    size_t headerLength = 1 + encodeLength(header + 1, length);
+    return append(header, headerLength) && append(body, length) && endPacket();
+}
+
+bool MqttPipe::flush() {
+    if (_batchLength == 0) return true;
+    size_t written = _client->write(_batch, _batchLength);
+    _stats.writes++;
+    _stats.bytes += written;
+    bool ok = written == _batchLength;
+    _batchLength = 0;
+    if (!ok) {
+        lost(MQTT_CONNECTION_LOST);
+        return false;
+    }
+    _lastOutMs = millis();
+    return true;
+}
+
+void MqttPipe::lost(int state) {
+    _client->stop();
+    _state = state;
+    // QoS 0 packets still in the batch are gone; QoS 1 ones go out again
+    // from their slots
+    _batchLength = 0;
+}
+
+bool MqttPipe::connect(const char* id, const char* user, const char* pass, const char* willTopic, uint8_t willQos,
+                       bool willRetain, const char* willMessage, bool cleanSession) {
+    if (connected()) return true;
+    _batchLength = 0;
+    _rxLength = 0;
+    _skip = 0;
+    if (!_domain || !_client->connect(_domain, _port)) {
+        _state = MQTT_CONNECT_FAILED;
+        return false;
+    }
+
+    uint8_t flags = cleanSession ? 0x02 : 0;
+    if (willTopic) flags |= 0x04 | (willQos & 3) << 3 | (willRetain ? 0x20 : 0);
+    if (user) flags |= 0x80;
+    if (user && pass) flags |= 0x40;
+
+    size_t length = 10 + stringLength(id);
+    if (willTopic) length += stringLength(willTopic) + stringLength(willMessage ? willMessage : "");
+    if (user) length += stringLength(user);
+    if (user && pass) length += stringLength(pass);
+
+    uint8_t header[5];
+    header[0] = PACKET_CONNECT;
+    size_t headerLength = 1 + encodeLength(header + 1, length);
+    const uint8_t variable[10] = {0, 4, 'M', 'Q', 'T', 'T', 4, flags, (uint8_t)(_keepAlive >> 8), (uint8_t)_keepAlive};
+    append(header, headerLength);
+    append(variable, sizeof(variable));
+    auto appendString = [this](const char* s) {
+        size_t n = strlen(s);
+        uint8_t prefix[2] = {(uint8_t)(n >> 8), (uint8_t)n};
+        append(prefix, 2);
+        append(s, n);
+    };
+    appendString(id);
+    if (willTopic) {
+        appendString(willTopic);
+        appendString(willMessage ? willMessage : "");
+    }
+    if (user) appendString(user);
+    if (user && pass) appendString(pass);
+
+    _state = MQTT_DISCONNECTED;
+    _connack = false;
+    if (!flush()) return false;
+
+    uint32_t start = millis();
+    _lastInMs = start;
+    _pingOutstanding = false;
+    while (!_connack) {
+        if (!_client->connected()) {
+            lost(MQTT_CONNECTION_LOST);
+            return false;
+        }
+        if (millis() - start >= _socketTimeout * 1000UL) {
+            lost(MQTT_CONNECTION_TIMEOUT);
+            return false;
+        }
+        if (_client->available() > 0) {
+            receive();
+        } else {
+            delay(1);
+        }
+    }
+    if (_connackCode != 0) {
+        lost(_connackCode);
+        return false;
+    }
+
+    _state = MQTT_CONNECTED;
+    resend();
+    return flush();
+}
+
+void MqttPipe::disconnect() {
+    if (_state == MQTT_CONNECTED) {
+        sendControl(PACKET_DISCONNECT, nullptr, 0);
+        flush();
+    }
+    _client->stop();
+    _state = MQTT_DISCONNECTED;
+    _batchLength = 0;
+}
+
+bool MqttPipe::connected() {
+    if (_state != MQTT_CONNECTED) return false;
+    if (!_client->connected()) {
+        lost(MQTT_CONNECTION_LOST);
+        return false;
+    }
+    return true;
+}
+
+uint16_t MqttPipe::nextPacketId() {
+    for (;;) {
+        if (++_lastPacketId == 0) _lastPacketId = 1;
+        bool taken = false;
+        for (const Slot& slot : _slots) {
+            if (slot.used && slot.packetId == _lastPacketId) taken = true;
+        }
+        if (!taken) return _lastPacketId;
+    }
+}
+
+bool MqttPipe::publish(const char* topic, const uint8_t* payload, size_t length, bool retained, uint8_t qos) {
+    if (!connected()) return false;
+    qos = qos ? 1 : 0;
+    size_t topicLength = strlen(topic);
+    size_t remaining = 2 + topicLength + (qos ? 2 : 0) + length;
+    uint8_t header[5];
+    header[0] = PACKET_PUBLISH | qos << 1 | (retained ? 1 : 0);
+    size_t headerLength = 1 + encodeLength(header + 1, remaining);
+    if (headerLength + remaining > MQTT_PIPE_PACKET_SIZE) return false;
+    const uint8_t topicPrefix[2] = {(uint8_t)(topicLength >> 8), (uint8_t)topicLength};
+
+    if (qos == 0) {
+        bool ok = append(header, headerLength) && append(topicPrefix, 2) && append(topic, topicLength) &&
+                  append(payload, length) && endPacket();
+        if (ok) _stats.published++;
+        return ok;
+    }
+
+    if (_inflight >= _window) {
+        _stats.windowFull++;
+        return false;
+    }
+    Slot* slot = nullptr;
+    for (Slot& s : _slots) {
+        if (!s.used) {
+            slot = &s;
+            break;
+        }
+    }
+    if (!slot) return false;
+    uint16_t packetId = nextPacketId();
+    uint8_t* p = slot->packet;
+    memcpy(p, header, headerLength);
+    p += headerLength;
+    memcpy(p, topicPrefix, 2);
+    memcpy(p + 2, topic, topicLength);
+    p += 2 + topicLength;
+    *p++ = packetId >> 8;
+    *p++ = packetId & 0xFF;
+    memcpy(p, payload, length);
+    slot->length = headerLength + remaining;
+    slot->packetId = packetId;
+    slot->order = _order++;
+    slot->publishedUs = micros();
+    slot->used = true;
+    _inflight++;
+    _stats.published++;
+    _stats.publishedQos1++;
+    if (_inflight > _stats.inflightPeak) _stats.inflightPeak = _inflight;
+
+    // Stays in the window when the write fails and goes out after the reconnect
+    return append(slot->packet, slot->length) && endPacket();
+}
+
+bool MqttPipe::subscribe(const char* topic, uint8_t qos) {
+    if (!connected()) return false;
+    size_t topicLength = strlen(topic);
+    if (topicLength + 7 > MQTT_PIPE_PACKET_SIZE) return false;
+    uint16_t packetId = nextPacketId();
+    uint8_t header[5];
+    header[0] = PACKET_SUBSCRIBE;
+    size_t headerLength = 1 + encodeLength(header + 1, 2 + 2 + topicLength + 1);
+    const uint8_t variable[4] = {(uint8_t)(packetId >> 8), (uint8_t)packetId, (uint8_t)(topicLength >> 8),
+                                 (uint8_t)topicLength};
+    const uint8_t options = qos ? 1 : 0;
+    return append(header, headerLength) && append(variable, 4) && append(topic, topicLength) &&
+           append(&options, 1) && endPacket();
+}
+
+// The window in publish order, marked as duplicates
+void MqttPipe::resend() {
+    Slot* pending[MQTT_PIPE_MAX_WINDOW];
+    int count = 0;
+    for (Slot& slot : _slots) {
+        if (!slot.used) continue;
+        int i = count++;
+        for (; i > 0 && (int32_t)(slot.order - pending[i - 1]->order) < 0; i--) pending[i] = pending[i - 1];
+        pending[i] = &slot;
+    }
+    for (int i = 0; i < count; i++) {
+        pending[i]->packet[0] |= FLAG_DUP;
+        if (!append(pending[i]->packet, pending[i]->length)) return;
+        _stats.resent++;
+    }
+}
+
+void MqttPipe::acknowledged(uint16_t packetId) {
+    for (Slot& slot : _slots) {
+        if (!slot.used || slot.packetId != packetId) continue;
+        uint32_t latencyUs = micros() - slot.publishedUs;
+        slot.used = false;
+        _inflight--;
+        _stats.acked++;
+        _stats.ackTotalUs += latencyUs;
+        if (_stats.acked == 1 || latencyUs < _stats.ackMinUs) _stats.ackMinUs = latencyUs;
+        if (latencyUs > _stats.ackMaxUs) _stats.ackMaxUs = latencyUs;
+        if (_ackCallback) _ackCallback(packetId, latencyUs, _ackUser);
+        return;
+    }
+}
+
+void MqttPipe::handle(uint8_t header, const uint8_t* body, size_t length) {
+    switch (header & 0xF0) {
+        case PACKET_CONNACK:
+            if (length >= 2) {
+                _connack = true;
+                _connackCode = body[1];
+            }
+            break;
+        case PACKET_PUBACK:
+            if (length >= 2) acknowledged(body[0] << 8 | body[1]);
+            break;
+        case PACKET_PINGRESP:
+            _pingOutstanding = false;
+            break;
+        case PACKET_PUBLISH: {
+            if (length < 2) break;
+            size_t topicLength = body[0] << 8 | body[1];
+            size_t idLength = (header & 0x06) ? 2 : 0;
+            if (length < 2 + topicLength + idLength) break;
+            if (_messageCallback) {
+                // Moved down over its length prefix, the topic has room for
+                // a NUL before the packet id and payload
+                uint8_t* topic = (uint8_t*)body;
+                memmove(topic, body + 2, topicLength);
+                topic[topicLength] = 0;
+                size_t offset = 2 + topicLength + idLength;
+                _messageCallback((const char*)topic, body + offset, length - offset, _messageUser);
+            }
+            if (idLength) sendControl(PACKET_PUBACK, body + 2 + topicLength, 2);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+void MqttPipe::receive() {
+    while (_client->available() > 0) {
+        int n = _client->read(_rx + _rxLength, sizeof(_rx) - _rxLength);
+        if (n <= 0) break;
+        _rxLength += n;
+        _lastInMs = millis();
+
+        size_t pos = 0;
+        while (pos < _rxLength) {
+            if (_skip) {
+                size_t take = _rxLength - pos < _skip ? _rxLength - pos : _skip;
+                pos += take;
+                _skip -= take;
+                continue;
+            }
+            size_t length, header;
+            bool malformed;
+            if (!decodeLength(_rx + pos, _rxLength - pos, length, header, malformed)) {
+                if (malformed) {
+                    lost(MQTT_CONNECTION_LOST);
+                    return;
+                }
+                break;
+            }
+            if (header + length > sizeof(_rx)) {
+                // Too large to keep, but a QoS 1 message still gets its
+                // PUBACK, or the broker sends it again on every connect
+                const uint8_t* p = _rx + pos;
+                if ((p[0] & 0xF0) == PACKET_PUBLISH && (p[0] & 0x06)) {
+                    size_t available = _rxLength - pos;
+                    size_t id = available >= header + 2 ? header + 2 + (p[header] << 8 | p[header + 1]) : 0;
+                    if (!id || available < id + 2) {
+                        if ((id ? id + 2 : header + 2) <= sizeof(_rx)) break;      // read up to the packet id
+                    } else {
+                        sendControl(PACKET_PUBACK, p + id, 2);
+                    }
+                }
+                _skip = header + length;
+                continue;
+            }
+            if (_rxLength - pos < header + length) break;
+            handle(_rx[pos], _rx + pos + header, length);
+            pos += header + length;
+            if (_state == MQTT_CONNECTION_LOST) return;     // answering it failed
+        }
+        memmove(_rx, _rx + pos, _rxLength - pos);
+        _rxLength -= pos;
+    }
+}
+
+bool MqttPipe::loop() {
+    if (!connected()) return false;
+    receive();
+    if (_state != MQTT_CONNECTED) return false;
+
+    uint32_t now = millis();
+    uint32_t keepAliveMs = _keepAlive * 1000UL;
+    if (keepAliveMs && (now - _lastOutMs > keepAliveMs || now - _lastInMs > keepAliveMs)) {
+        if (_pingOutstanding) {
+            lost(MQTT_CONNECTION_TIMEOUT);
+            return false;
+        }
+        sendControl(PACKET_PINGREQ, nullptr, 0);
+        _pingOutstanding = true;
+        _lastInMs = now;
+    }
+    return flush();
+}
+
+void MqttPipe::resetStats() {
+    _stats = MqttPipeStats();
+    _stats.inflightPeak = _inflight;
+}
+
+void MqttPipe::printStats(Print& out) const {
+    out.printf("MQTT: %lu published (%lu QoS 1), %lu acked, %u in flight of %u (peak %lu), %lu resent, %lu window full\n",
+               (unsigned long)_stats.published, (unsigned long)_stats.publishedQos1, (unsigned long)_stats.acked,
+               (unsigned)_inflight, (unsigned)_window, (unsigned long)_stats.inflightPeak, (unsigned long)_stats.resent,
+               (unsigned long)_stats.windowFull);
+    out.printf("MQTT: %lu writes, %lu bytes", (unsigned long)_stats.writes, (unsigned long)_stats.bytes);
+    if (_stats.acked) {
+        out.printf(", ack latency min %lu us, avg %lu, max %lu", (unsigned long)_stats.ackMinUs,
+                   (unsigned long)(_stats.ackTotalUs / _stats.acked), (unsigned long)_stats.ackMaxUs);
+    }
+    out.println();
+}
@@ -0,0 +1,185 @@
+#pragma once
+
+// MQTT 3.1.1 publisher with QoS 1 and several messages in flight.
+//
+//   WiFiClient net;
+//   MqttPipe mqtt(net);
+//
+//   mqtt.setServer("192.168.2.176", 1883);
+//   mqtt.connect("m5tab5_no_1", "user", "pass", willTopic, 0, true, "offline");
+//   mqtt.publish(topic, payload, false, 1);     // false when the window is full
+//   mqtt.loop();                                // each pass: acks, keepalive, writes the batch
+//
+// PubSubClient publishes QoS 0 only and writes each message to the socket as
+// it goes; publish() returning true says nothing about the broker. Here a
+// QoS 1 message keeps its slot in the inflight window, under its packet id,
+// until the broker's PUBACK for that id comes back. Up to window() messages
+// are on their way at once, so a burst costs one round trip rather than one
+// per message. When the connection drops, what is still in the window goes
+// out again with the DUP flag right after the next CONNACK. Connect with the
+// same client id and cleanSession false so the broker keeps its half of the
+// session.
+//
+// Packets are not written one by one either: they collect in a buffer of one
+// TCP segment (MQTT_PIPE_BATCH_BYTES, lwIP's default MSS) that flush() or
+// loop() writes in one go, or as soon as the next packet does not fit.
+// setBatching(false) writes every packet as it is published.
+//
+// stats() counts what was published, acknowledged and sent again, and the
+// time from publish() to PUBACK; setAckCallback() reports each one.
+//
+// subscribe() and setMessageCallback() receive messages of up to
+// MQTT_PIPE_RX_BYTES (header and topic included); larger ones, and all of
+// them when there is no callback, are dropped (and acknowledged). A device
+// that only publishes keeps the default of 128 bytes, enough for acks.
+
+#include <Arduino.h>
+#ifdef ESP_PLATFORM
+#include <Client.h>
+#endif
+
+#ifndef MQTT_PIPE_MAX_WINDOW
+#define MQTT_PIPE_MAX_WINDOW 8
+#endif
+
+// Largest packet publish() takes, header and topic included
+#ifndef MQTT_PIPE_PACKET_SIZE
+#define MQTT_PIPE_PACKET_SIZE 1024
+#endif
+
+#ifndef MQTT_PIPE_BATCH_BYTES
+#define MQTT_PIPE_BATCH_BYTES 1436
+#endif
+
+#ifndef MQTT_PIPE_RX_BYTES
+#define MQTT_PIPE_RX_BYTES 128
+#endif
+
+// Same values as PubSubClient's state()
+#ifndef MQTT_CONNECTED
+#define MQTT_CONNECTION_TIMEOUT     -4
+#define MQTT_CONNECTION_LOST        -3
+#define MQTT_CONNECT_FAILED         -2
+#define MQTT_DISCONNECTED           -1
+#define MQTT_CONNECTED               0
+#define MQTT_CONNECT_BAD_PROTOCOL    1
+#define MQTT_CONNECT_BAD_CLIENT_ID   2
+#define MQTT_CONNECT_UNAVAILABLE     3
+#define MQTT_CONNECT_BAD_CREDENTIALS 4
+#define MQTT_CONNECT_UNAUTHORIZED    5
+#endif
+
+struct MqttPipeStats {
+    uint32_t published;         // accepted by publish(), either QoS
+    uint32_t publishedQos1;
+    uint32_t acked;
+    uint32_t resent;            // after a reconnect
+    uint32_t windowFull;        // QoS 1 publishes refused
+    uint32_t inflightPeak;
+    uint32_t writes;            // socket writes
+    uint32_t bytes;
+    uint32_t ackMinUs;
+    uint32_t ackMaxUs;
+    uint64_t ackTotalUs;
+};
+
+typedef void (*MqttPipeAckCallback)(uint16_t packetId, uint32_t latencyUs, void* user);
+// `topic` is NUL-terminated; both are only valid during the call
+typedef void (*MqttPipeMessageCallback)(const char* topic, const uint8_t* payload, size_t length, void* user);
+
+class MqttPipe {
+public:
+    explicit MqttPipe(Client& client) : _client(&client) {}
+
+    MqttPipe& setServer(const char* domain, uint16_t port);
+    MqttPipe& setKeepAlive(uint16_t seconds) { _keepAlive = seconds; return *this; }
+    MqttPipe& setSocketTimeout(uint16_t seconds) { _socketTimeout = seconds; return *this; }
+    void setWindow(uint8_t messages);           // 1 .. MQTT_PIPE_MAX_WINDOW
+    uint8_t window() const { return _window; }
+    void setBatching(bool enabled) { _batching = enabled; }
+    void setAckCallback(MqttPipeAckCallback callback, void* user = nullptr);
+    void setMessageCallback(MqttPipeMessageCallback callback, void* user = nullptr);
+
+    // Blocks until the CONNACK (or the socket timeout), like PubSubClient,
+    // then sends the window again
+    bool connect(const char* id, const char* user = nullptr, const char* pass = nullptr,
+                 const char* willTopic = nullptr, uint8_t willQos = 0, bool willRetain = false,
+                 const char* willMessage = nullptr, bool cleanSession = false);
+    void disconnect();
+    bool connected();
+    int state() const { return _state; }
+
+    // False when not connected, the packet is larger than
+    // MQTT_PIPE_PACKET_SIZE, or (QoS 1) the window is full
+    bool publish(const char* topic, const uint8_t* payload, size_t length, bool retained = false, uint8_t qos = 0);
+    bool publish(const char* topic, const char* payload, bool retained = false, uint8_t qos = 0) {
+        return publish(topic, (const uint8_t*)payload, strlen(payload), retained, qos);
+    }
+
+    // QoS 0 or 1; the SUBACK is not waited for. Subscribe again after each
+    // connect() unless the session is kept (cleanSession false).
+    bool subscribe(const char* topic, uint8_t qos = 0);
+
+    // Writes the batch; false when the connection broke
+    bool flush();
+    // Reads acks, keeps the connection alive and flushes; false when not connected
+    bool loop();
+
+    uint8_t inflight() const { return _inflight; }
+    const MqttPipeStats& stats() const { return _stats; }
+    void resetStats();
+    void printStats(Print& out) const;
+
+private:
+    struct Slot {
+        bool used;
+        uint16_t packetId;
+        uint32_t order;             // publish order, for sending again
+        uint32_t publishedUs;
+        size_t length;
+        uint8_t packet[MQTT_PIPE_PACKET_SIZE];
+    };
+
+    bool append(const void* data, size_t length);
+    bool endPacket();
+    bool sendControl(uint8_t type, const uint8_t* body, size_t length);
+    void receive();
+    void handle(uint8_t header, const uint8_t* body, size_t length);
+    void acknowledged(uint16_t packetId);
+    uint16_t nextPacketId();
+    void resend();
+    void lost(int state);
+
+    Client* _client;
+    const char* _domain = nullptr;
+    uint16_t _port = 1883;
+    uint16_t _keepAlive = 15;
+    uint16_t _socketTimeout = 15;
+    int _state = MQTT_DISCONNECTED;
+
+    uint8_t _window = MQTT_PIPE_MAX_WINDOW;
+    uint8_t _inflight = 0;
+    uint16_t _lastPacketId = 0;
+    uint32_t _order = 0;
+    Slot _slots[MQTT_PIPE_MAX_WINDOW] = {};
+
+    bool _batching = true;
+    uint8_t _batch[MQTT_PIPE_BATCH_BYTES];
+    size_t _batchLength = 0;
+
+    uint8_t _rx[MQTT_PIPE_RX_BYTES];    // larger packets are skipped
+    size_t _rxLength = 0;
+    size_t _skip = 0;
+    bool _connack = false;
+    uint8_t _connackCode = 0;
+
+    uint32_t _lastOutMs = 0;
+    uint32_t _lastInMs = 0;
+    bool _pingOutstanding = false;
+
+    MqttPipeAckCallback _ackCallback = nullptr;
+    void* _ackUser = nullptr;
+    MqttPipeMessageCallback _messageCallback = nullptr;
+    void* _messageUser = nullptr;
+    MqttPipeStats _stats = {};
+};
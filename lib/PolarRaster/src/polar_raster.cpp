@@ -0,0 +1,149 @@
+#include "polar_raster.h"
+
+#include <esp_heap_caps.h>
+
+// One quadrant (dx, dy >= 0) of angle and distance; the other three are mirrors
+struct PolarEntry {
+    uint16_t angle;      // 0..16384 (0..90 degrees)
+    uint16_t radius16;   // distance in 1/16 px
+};
+
+static const int MAX_TABLE_RADIUS = 4000;   // keeps radius16 within 16 bits
+
+static PolarEntry* table = nullptr;
+static int tableRadius = -1;
+static int tableStride = 0;
+static uint16_t* lineBuffer = nullptr;     // one shaded span, 2 * tableRadius + 1 pixels
+
+bool polarReserve(int radius) {
+    if (radius <= tableRadius) return true;
+    if (radius > MAX_TABLE_RADIUS) return false;
+
+    int stride = radius + 1;
+    PolarEntry* grown = (PolarEntry*)heap_caps_malloc(stride * stride * sizeof(PolarEntry),
+                                                       MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!grown) grown = (PolarEntry*)malloc(stride * stride * sizeof(PolarEntry));
+    uint16_t* line = (uint16_t*)malloc((2 * radius + 1) * sizeof(uint16_t));
+    if (!grown || !line) {
+        free(grown);
+        free(line);
+        return false;
+    }
+
+    for (int dy = 0; dy <= radius; dy++) {
+        for (int dx = 0; dx <= radius; dx++) {
+            PolarEntry& e = grown[dy * stride + dx];
+            e.angle = (dx | dy) ? (uint16_t)lroundf(atan2f(dy, dx) * (32768.0f / PI)) : 0;
+            e.radius16 = (uint16_t)lroundf(sqrtf(dx * dx + dy * dy) * 16.0f);
+        }
+    }
+
+    free(table);
+    free(lineBuffer);
+    table = grown;
+    lineBuffer = line;
+    tableRadius = radius;
+    tableStride = stride;
+    return true;
+}
+
+static inline const PolarEntry& entryAt(int dx, int dy) {
+    return table[abs(dy) * tableStride + abs(dx)];
+}
+
+static inline uint16_t angleAt(int dx, int dy) {
+    uint16_t q = entryAt(dx, dy).angle;
+    if (dx >= 0) return dy >= 0 ? q : (uint16_t)(0 - q);
+    return dy >= 0 ? (uint16_t)(32768 - q) : (uint16_t)(32768 + q);
+}
+
+// Emits the parts of dx = from..to on row dy whose angle lies in the sector
+static void emitSectorRuns(int cx, int cy, int dy, int from, int to,
+                           uint16_t startAngle, uint32_t sweep, PolarSpanFn fn, void* user) {
+    if (sweep >= POLAR_FULL_TURN) {
+        fn(cy + dy, cx + from, cx + to, user);
+        return;
+    }
+    int runStart = 0;
+    bool inRun = false;
+    for (int dx = from; dx <= to; dx++) {
+        bool inside = (uint16_t)(angleAt(dx, dy) - startAngle) <= sweep;
+        if (inside && !inRun) {
+            runStart = dx;
+            inRun = true;
+        } else if (!inside && inRun) {
+            fn(cy + dy, cx + runStart, cx + dx - 1, user);
+            inRun = false;
+        }
+    }
+    if (inRun) fn(cy + dy, cx + runStart, cx + to, user);
+}
+
+void forEachPolarSpan(int cx, int cy, int innerRadius, int outerRadius,
+                      uint16_t startAngle, uint32_t sweep, PolarSpanFn fn, void* user) {
+    if (outerRadius < 0 || innerRadius > outerRadius || sweep == 0) return;
+    if (innerRadius < 0) innerRadius = 0;
+    if (sweep < POLAR_FULL_TURN && !polarReserve(outerRadius)) return;
+
+    // Pixel centres within half a pixel of the edges: (r - 0.5)^2 < d^2 <= (r + 0.5)^2
+    int32_t outer2 = outerRadius * outerRadius + outerRadius;
+    int32_t hole2 = innerRadius > 0 ? innerRadius * innerRadius - innerRadius : -1;
+
+    for (int dy = -outerRadius; dy <= outerRadius; dy++) {
+        int32_t dy2 = dy * dy;
+        int xo = isqrt(outer2 - dy2);
+        if (hole2 >= dy2) {
+            int xi = isqrt(hole2 - dy2);
+            if (xi >= xo) continue;
+            emitSectorRuns(cx, cy, dy, -xo, -xi - 1, startAngle, sweep, fn, user);
+            emitSectorRuns(cx, cy, dy, xi + 1, xo, startAngle, sweep, fn, user);
+        } else {
+            emitSectorRuns(cx, cy, dy, -xo, xo, startAngle, sweep, fn, user);
+        }
+    }
+}
+
+struct SolidSpan {
+    LovyanGFX* gfx;
+    uint16_t color;
+};
+
+void fillPolarArc(LovyanGFX& gfx, int cx, int cy, int innerRadius, int outerRadius,
+                  uint16_t startAngle, uint32_t sweep, uint16_t color) {
+    SolidSpan span = {&gfx, color};
+    gfx.startWrite();
+    forEachPolarSpan(cx, cy, innerRadius, outerRadius, startAngle, sweep,
+                     [](int y, int x0, int x1, void* user) {
+                         SolidSpan* s = (SolidSpan*)user;
+                         s->gfx->drawFastHLine(x0, y, x1 - x0 + 1, s->color);
+                     }, &span);
+    gfx.endWrite();
+}
+
+struct ShadedSpan {
+    LovyanGFX* gfx;
+    int cx;
+    int cy;
+    PolarShader shader;
+    void* user;
+};
+
+void shadePolarArc(LovyanGFX& gfx, int cx, int cy, int innerRadius, int outerRadius,
+                   uint16_t startAngle, uint32_t sweep, PolarShader shader, void* user) {
+    if (!polarReserve(outerRadius)) return;
+
+    ShadedSpan span = {&gfx, cx, cy, shader, user};
+    gfx.startWrite();
+    forEachPolarSpan(cx, cy, innerRadius, outerRadius, startAngle, sweep,
+                     [](int y, int x0, int x1, void* user) {
+                         ShadedSpan* s = (ShadedSpan*)user;
+                         int dy = y - s->cy;
+                         uint16_t* out = lineBuffer;
+                         for (int x = x0; x <= x1; x++) {
+                             int dx = x - s->cx;
+                             *out++ = s->shader(angleAt(dx, dy), entryAt(dx, dy).radius16, s->user);
+                         }
+                         s->gfx->pushImage(x0, y, x1 - x0 + 1, 1, (const lgfx::rgb565_t*)lineBuffer);
+                     }, &span);
+    gfx.endWrite();
+}
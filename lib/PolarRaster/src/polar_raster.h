@@ -0,0 +1,62 @@
+#pragma once
+
+#include <M5GFX.h>
+#include <fast_math.h>
+
+// Polar span rasterizer for rings, arcs, annular sectors and radial/angular
+// gradients.
+//
+// Shapes are emitted as horizontal spans (one drawFastHLine or one pushImage
+// per run of pixels), so filled rings have no holes and cost one call per row
+// instead of one per sample. Angles and radii come from a quadrant lookup table
+// built once with atan2/sqrt; after that no trigonometry runs per pixel. Shaders
+// can use isin()/icos() from fast_math.h, which take the same binary angles.
+//
+// Angles are binary angles: 65536 per full turn, 0 = 3 o'clock, increasing
+// clockwise on screen (the same direction as atan2(dy, dx) with y pointing down).
+// Sweeps are uint32_t so that POLAR_FULL_TURN (a whole ring) is representable.
+
+const uint32_t POLAR_FULL_TURN = 65536;
+
+inline uint16_t polarAngle(float degrees) {
+    return (uint16_t)(int32_t)lroundf(fmodf(degrees, 360.0f) * (65536.0f / 360.0f));
+}
+
+inline uint32_t polarSweep(float degrees) {
+    if (degrees <= 0) return 0;
+    if (degrees >= 360) return POLAR_FULL_TURN;
+    return (uint32_t)lroundf(degrees * (65536.0f / 360.0f));
+}
+
+// Grows the lookup table to cover radius (done lazily by the drawing calls as
+// well; call it from setup() to keep the one-off cost out of the first frame).
+// The table takes 4 * (radius + 1)^2 bytes and prefers PSRAM.
+bool polarReserve(int radius);
+
+// Span callback: pixels x0..x1 inclusive on row y
+typedef void (*PolarSpanFn)(int y, int x0, int x1, void* user);
+
+// Enumerates the spans of the annular sector centred on (cx, cy) that covers
+// innerRadius..outerRadius and the angles startAngle..startAngle + sweep. An
+// innerRadius of 0 gives a pie slice; a sweep of POLAR_FULL_TURN a full ring.
+void forEachPolarSpan(int cx, int cy, int innerRadius, int outerRadius,
+                      uint16_t startAngle, uint32_t sweep, PolarSpanFn fn, void* user);
+
+// Solid fills
+void fillPolarArc(LovyanGFX& gfx, int cx, int cy, int innerRadius, int outerRadius,
+                  uint16_t startAngle, uint32_t sweep, uint16_t color);
+inline void fillPolarRing(LovyanGFX& gfx, int cx, int cy, int innerRadius, int outerRadius, uint16_t color) {
+    fillPolarArc(gfx, cx, cy, innerRadius, outerRadius, 0, POLAR_FULL_TURN, color);
+}
+
+// Shaded fills: the shader returns the RGB565 colour for a pixel from its angle
+// and its distance from the centre in 1/16 px. Each span is shaded into a line
+// buffer and sent with a single pushImage().
+typedef uint16_t (*PolarShader)(uint16_t angle, uint16_t radius16, void* user);
+
+void shadePolarArc(LovyanGFX& gfx, int cx, int cy, int innerRadius, int outerRadius,
+                   uint16_t startAngle, uint32_t sweep, PolarShader shader, void* user = nullptr);
+inline void shadePolarRing(LovyanGFX& gfx, int cx, int cy, int innerRadius, int outerRadius,
+                           PolarShader shader, void* user = nullptr) {
+    shadePolarArc(gfx, cx, cy, innerRadius, outerRadius, 0, POLAR_FULL_TURN, shader, user);
+}
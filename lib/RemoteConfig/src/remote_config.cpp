@@ -0,0 +1,250 @@
+#include "remote_config.h"
+
+#include <ArduinoJson.h>
+#include <json_escape.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef ESP_PLATFORM
+#include <Preferences.h>
+#endif
+
+size_t remoteConfigTopic(char* out, size_t size, const char* deviceId) {
+    return snprintf(out, size, "%s/%s/config", REMOTE_CONFIG_TOPIC_PREFIX, deviceId);
+}
+
+RemoteConfig::~RemoteConfig() {
+    free(_defaults);
+    free(_previous);
+}
+
+void RemoteConfig::begin(const char* nvsNamespace) {
+    _namespace = nvsNamespace;
+    if (!_defaults) _defaults = (uint8_t*)malloc(_schema.size);
+    if (!_previous) _previous = (uint8_t*)malloc(_schema.size);
+    if (_defaults) memcpy(_defaults, _settings, _schema.size);
+    if (_previous) memcpy(_previous, _settings, _schema.size);
+
+#ifdef ESP_PLATFORM
+    Preferences prefs;
+    if (!prefs.begin(_namespace, true)) return;
+    _version = prefs.getULong("version", 0);
+    _rejected = prefs.getULong("rejected", 0);
+    for (uint8_t i = 0; i < _schema.count; i++) {
+        const ConfigField& field = _schema.fields[i];
+        if (!prefs.isKey(field.name)) continue;
+        uint8_t* value = _settings + field.offset;
+        switch (field.type) {
+            case CONFIG_TYPE_STRING:
+                prefs.getString(field.name, (char*)value, field.size);
+                break;
+            case CONFIG_TYPE_UINT32:
+                *(uint32_t*)value = prefs.getULong(field.name, *(uint32_t*)value);
+                break;
+            case CONFIG_TYPE_FLOAT:
+                *(float*)value = prefs.getFloat(field.name, *(float*)value);
+                break;
+            case CONFIG_TYPE_BOOL:
+                *(bool*)value = prefs.getBool(field.name, *(bool*)value);
+                break;
+        }
+    }
+    prefs.end();
+    if (_version) setStatus("ok");
+    if (_previous) memcpy(_previous, _settings, _schema.size);
+#endif
+}
+
+ConfigResult RemoteConfig::apply(const uint8_t* payload, size_t length) {
+    ConfigResult result = {CONFIG_INVALID, 0};
+    JsonDocument doc;
+    DeserializationError parseError = deserializeJson(doc, payload, length);
+    if (parseError) {
+        setStatus("invalid: %s", parseError.c_str());
+        return result;
+    }
+    if (!doc.is<JsonObject>()) {
+        setStatus("invalid: not an object");
+        return result;
+    }
+    JsonObjectConst object = doc.as<JsonObjectConst>();
+    if (!object["version"].is<uint32_t>()) {
+        setStatus("invalid: no version");
+        return result;
+    }
+    uint32_t version = object["version"].as<uint32_t>();
+    if (version <= _version || version == _rejected) {
+        result.status = CONFIG_UNCHANGED;
+        return result;
+    }
+
+    // Every key must be a field; a typo is an error rather than a no-op
+    for (JsonPairConst pair : object) {
+        const char* key = pair.key().c_str();
+        if (strcmp(key, "version") == 0 || strcmp(key, "reset") == 0) continue;
+        bool known = false;
+        for (uint8_t i = 0; i < _schema.count && !known; i++) known = strcmp(key, _schema.fields[i].name) == 0;
+        if (!known) {
+            setStatus("invalid: unknown key %s", key);
+            return result;
+        }
+    }
+
+    uint8_t* next = (uint8_t*)malloc(_schema.size);
+    if (!next || !_previous) {
+        free(next);
+        setStatus("invalid: out of memory");
+        return result;
+    }
+    bool reset = object["reset"].is<bool>() && object["reset"].as<bool>();
+    memcpy(next, reset && _defaults ? _defaults : _settings, _schema.size);
+
+    for (uint8_t i = 0; i < _schema.count; i++) {
+        const ConfigField& field = _schema.fields[i];
+        JsonVariantConst value = object[field.name];
+        if (value.isNull()) continue;
+        uint8_t* member = next + field.offset;
+        bool ok = false;
+        switch (field.type) {
+            case CONFIG_TYPE_STRING:
+                if (value.is<const char*>()) {
+                    size_t n = strlen(value.as<const char*>());
+                    ok = n >= field.min && n < field.size;
+                    if (ok) memcpy(member, value.as<const char*>(), n + 1);
+                }
+                break;
+            case CONFIG_TYPE_UINT32:
+                if (value.is<uint32_t>()) {
+                    uint32_t n = value.as<uint32_t>();
+                    ok = n >= field.min && n <= field.max;
+                    if (ok) *(uint32_t*)member = n;
+                }
+                break;
+            case CONFIG_TYPE_FLOAT:
+                if (value.is<float>()) {
+                    float n = value.as<float>();
+                    ok = n >= field.min && n <= field.max;
+                    if (ok) *(float*)member = n;
+                }
+                break;
+            case CONFIG_TYPE_BOOL:
+                ok = value.is<bool>();
+                if (ok) *(bool*)member = value.as<bool>();
+                break;
+        }
+        if (!ok) {
+            setStatus("invalid: %s", field.name);
+            free(next);
+            return result;
+        }
+    }
+
+    for (uint8_t i = 0; i < _schema.count; i++) {
+        const ConfigField& field = _schema.fields[i];
+        bool changed = field.type == CONFIG_TYPE_STRING
+                           ? strcmp((const char*)next + field.offset, (const char*)_settings + field.offset) != 0
+                           : memcmp(next + field.offset, _settings + field.offset, field.size) != 0;
+        if (changed) result.apply |= field.apply;
+    }
+    // A message on top of one not yet committed keeps the committed
+    // settings to go back to
+    if (!_pending) {
+        memcpy(_previous, _settings, _schema.size);
+        _previousVersion = _version;
+    }
+    memcpy(_settings, next, _schema.size);
+    free(next);
+    _version = version;
+    _pending = true;
+    result.status = CONFIG_APPLIED;
+    setStatus("pending");
+    return result;
+}
+
+void RemoteConfig::commit() {
+    if (!_pending) return;
+    _pending = false;
+    save();
+    setStatus("ok");
+}
+
+void RemoteConfig::revert(const char* reason) {
+    if (!_pending) return;
+    _pending = false;
+    memcpy(_settings, _previous, _schema.size);
+    _rejected = _version;
+    _version = _previousVersion;
+    save();
+    setStatus("reverted %u: %s", (unsigned)_rejected, reason);
+}
+
+void RemoteConfig::save() {
+#ifdef ESP_PLATFORM
+    Preferences prefs;
+    if (!prefs.begin(_namespace, false)) return;
+    // Only what differs from NVS, to spare the flash
+    for (uint8_t i = 0; i < _schema.count; i++) {
+        const ConfigField& field = _schema.fields[i];
+        const uint8_t* value = _settings + field.offset;
+        switch (field.type) {
+            case CONFIG_TYPE_STRING: {
+                char stored[128];
+                bool same = prefs.isKey(field.name) && field.size <= sizeof(stored) &&
+                            prefs.getString(field.name, stored, sizeof(stored)) && strcmp(stored, (const char*)value) == 0;
+                if (!same) prefs.putString(field.name, (const char*)value);
+                break;
+            }
+            case CONFIG_TYPE_UINT32:
+                if (!prefs.isKey(field.name) || prefs.getULong(field.name, 0) != *(const uint32_t*)value) {
+                    prefs.putULong(field.name, *(const uint32_t*)value);
+                }
+                break;
+            case CONFIG_TYPE_FLOAT:
+                if (!prefs.isKey(field.name) || prefs.getFloat(field.name, 0) != *(const float*)value) {
+                    prefs.putFloat(field.name, *(const float*)value);
+                }
+                break;
+            case CONFIG_TYPE_BOOL:
+                if (!prefs.isKey(field.name) || prefs.getBool(field.name, false) != *(const bool*)value) {
+                    prefs.putBool(field.name, *(const bool*)value);
+                }
+                break;
+        }
+    }
+    if (prefs.getULong("version", 0) != _version) prefs.putULong("version", _version);
+    if (prefs.getULong("rejected", 0) != _rejected) prefs.putULong("rejected", _rejected);
+    prefs.end();
+#endif
+}
+
+void RemoteConfig::setStatus(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    vsnprintf(_status, sizeof(_status), format, args);
+    va_end(args);
+}
+
+size_t RemoteConfig::statusJson(char* out, size_t size) const {
+    // The status can quote a key from the message
+    char status[sizeof(_status) * 2];
+    jsonEscape(status, sizeof(status), _status);
+    return snprintf(out, size, "\"config_version\":%u,\"config_status\":\"%s\"", (unsigned)_version, status);
+}
+
+size_t RemoteConfig::settingsJson(char* out, size_t size) const {
+    JsonDocument doc;
+    doc["version"] = _version;
+    for (uint8_t i = 0; i < _schema.count; i++) {
+        const ConfigField& field = _schema.fields[i];
+        if (field.secret) continue;
+        const uint8_t* value = _settings + field.offset;
+        switch (field.type) {
+            case CONFIG_TYPE_STRING: doc[field.name] = (const char*)value; break;
+            case CONFIG_TYPE_UINT32: doc[field.name] = *(const uint32_t*)value; break;
+            case CONFIG_TYPE_FLOAT: doc[field.name] = *(const float*)value; break;
+            case CONFIG_TYPE_BOOL: doc[field.name] = *(const bool*)value; break;
+        }
+    }
+    return serializeJson(doc, out, size);
+}
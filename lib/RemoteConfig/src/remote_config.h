@@ -0,0 +1,157 @@
+#pragma once
+
+// Runtime settings: a struct described by a schema, kept in NVS and updated
+// from a retained MQTT message without a reflash or a reboot.
+//
+//   struct Settings {
+//       char ssid[33];
+//       uint32_t publish_ms;
+//   };
+//   Settings settings = {"Cellarstone IoT", 5000};      // the compiled-in defaults
+//   const ConfigField settingsFields[] = {
+//       CONFIG_STRING(Settings, ssid, 1, CONFIG_APPLY_WIFI),
+//       CONFIG_UINT32(Settings, publish_ms, 5000, 3600000, CONFIG_APPLY_NOW),
+//   };
+//   const ConfigSchema settingsSchema = CONFIG_SCHEMA(settingsFields, Settings);
+//   RemoteConfig config(settingsSchema, &settings);
+//
+//   config.begin();                         // setup(): NVS over the defaults
+//   remoteConfigTopic(topic, sizeof(topic), settings.device_id);
+//   mqttClient.subscribe(topic);            // on each connect
+//   ConfigResult result = config.apply(payload, length);   // the message
+//   ... apply result.apply (reconnect WiFi, MQTT, ...) ...
+//   config.commit();                        // once it works; else config.revert()
+//
+// A message is a JSON object with a "version" and any of the fields:
+//     {"version": 7, "publish_ms": 10000, "mqtt_server": "192.168.2.10"}
+// Fields left out keep their values; "reset": true starts from the defaults.
+// A version not above the current one is ignored, so the retained message
+// that comes again on every connect changes nothing. The message is checked
+// whole (unknown keys, types, ranges, string lengths) and applied all or
+// nothing.
+//
+// apply() changes the settings in RAM and returns what the changed fields
+// need to take effect; the firmware does that (CONFIG_APPLY_WIFI: reconnect
+// WiFi, ...). commit() writes them to NVS. A change that can cut the device
+// off (WiFi, broker, identity) should only be committed once it has
+// reconnected with it; revert() puts the previous settings back and ignores
+// that version from then on, so a bad config cannot take a device out of
+// reach or keep doing so after a reset.
+//
+// statusJson() is the version and the outcome of the last message, for the
+// device's diagnostics. Secret fields (passwords) are never written out.
+// The retained message is readable by every client of the broker, passwords
+// included; restrict the topic in the broker's ACL.
+//
+// NVS keys are the field names, so they must be at most 15 characters. On
+// the host nothing is persisted.
+
+#include <Arduino.h>
+#include <stddef.h>
+
+// m5env/<device_id>/config; outside homeassistant/, where Home Assistant
+// would take it for a discovery config
+#define REMOTE_CONFIG_TOPIC_PREFIX "m5env"
+
+enum ConfigFieldType : uint8_t {
+    CONFIG_TYPE_STRING,     // char array member; size includes the NUL
+    CONFIG_TYPE_UINT32,
+    CONFIG_TYPE_FLOAT,
+    CONFIG_TYPE_BOOL,
+};
+
+// What a changed field needs before it takes effect
+enum ConfigApply : uint8_t {
+    CONFIG_APPLY_NOW = 0,           // read where it is used
+    CONFIG_APPLY_WIFI = 1 << 0,     // WiFi reconnect
+    CONFIG_APPLY_MQTT = 1 << 1,     // broker reconnect
+    CONFIG_APPLY_IDENTITY = 1 << 2, // topics and discovery under another id
+    CONFIG_APPLY_SENSOR = 1 << 3,   // SCD40 settings written again
+    CONFIG_APPLY_OTA = 1 << 4,      // firmware update manifest checked again
+};
+
+struct ConfigField {
+    const char* name;       // JSON key and NVS key
+    ConfigFieldType type;
+    uint16_t offset;
+    uint16_t size;
+    float min;              // numbers; strings: shortest length
+    float max;
+    uint8_t apply;          // ConfigApply flags
+    bool secret;
+};
+
+struct ConfigSchema {
+    const ConfigField* fields;
+    uint8_t count;
+    uint16_t size;          // of the settings struct
+};
+
+#define CONFIG_FIELD_SIZE(Struct, member) (uint16_t)sizeof(((Struct*)nullptr)->member)
+#define CONFIG_STRING(Struct, member, minLength, apply) \
+    {#member, CONFIG_TYPE_STRING, (uint16_t)offsetof(Struct, member), CONFIG_FIELD_SIZE(Struct, member), minLength, 0, apply, false}
+#define CONFIG_SECRET(Struct, member, minLength, apply) \
+    {#member, CONFIG_TYPE_STRING, (uint16_t)offsetof(Struct, member), CONFIG_FIELD_SIZE(Struct, member), minLength, 0, apply, true}
+#define CONFIG_UINT32(Struct, member, min, max, apply) \
+    {#member, CONFIG_TYPE_UINT32, (uint16_t)offsetof(Struct, member), 4, min, max, apply, false}
+#define CONFIG_FLOAT(Struct, member, min, max, apply) \
+    {#member, CONFIG_TYPE_FLOAT, (uint16_t)offsetof(Struct, member), 4, min, max, apply, false}
+#define CONFIG_BOOL(Struct, member, apply) \
+    {#member, CONFIG_TYPE_BOOL, (uint16_t)offsetof(Struct, member), 1, 0, 1, apply, false}
+#define CONFIG_SCHEMA(fields, Struct) {fields, (uint8_t)(sizeof(fields) / sizeof(fields[0])), (uint16_t)sizeof(Struct)}
+
+enum ConfigStatus : uint8_t {
+    CONFIG_UNCHANGED,       // not newer than the current version, or rejected before
+    CONFIG_APPLIED,         // settings changed in RAM; see ConfigResult::apply
+    CONFIG_INVALID,         // nothing changed; error() says why
+};
+
+struct ConfigResult {
+    ConfigStatus status;
+    uint8_t apply;          // ConfigApply flags of the fields that changed
+};
+
+size_t remoteConfigTopic(char* out, size_t size, const char* deviceId);
+
+class RemoteConfig {
+public:
+    RemoteConfig(const ConfigSchema& schema, void* settings) : _schema(schema), _settings((uint8_t*)settings) {}
+    ~RemoteConfig();
+
+    // Keeps the current settings as the defaults and loads the committed
+    // ones from NVS over them
+    void begin(const char* nvsNamespace = "config");
+
+    ConfigResult apply(const uint8_t* payload, size_t length);
+    // Writes the applied settings to NVS
+    void commit();
+    // Back to the last committed settings; the version applied since is not
+    // applied again
+    void revert(const char* reason);
+    bool pending() const { return _pending; }
+
+    // The last committed settings (the old device id, ...)
+    const void* previous() const { return _previous; }
+    uint32_t version() const { return _version; }
+    const char* error() const { return _status; }
+
+    // "config_version":7,"config_status":"ok" (no braces, to go into an object)
+    size_t statusJson(char* out, size_t size) const;
+    // The settings as JSON, secrets left out
+    size_t settingsJson(char* out, size_t size) const;
+
+private:
+    void save();
+    void setStatus(const char* format, ...);
+
+    const ConfigSchema& _schema;
+    uint8_t* _settings;
+    uint8_t* _defaults = nullptr;
+    uint8_t* _previous = nullptr;
+    const char* _namespace = "config";
+    uint32_t _version = 0;
+    uint32_t _previousVersion = 0;
+    uint32_t _rejected = 0;
+    bool _pending = false;
+    char _status[64] = "defaults";
+};
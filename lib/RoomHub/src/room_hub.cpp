@@ -0,0 +1,277 @@
+#include "room_hub.h"
+
+#include <esp_heap_caps.h>
+#include <ha_device.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const uint16_t EMPTY = 0xFFFF;
+static const char STATE_PREFIX[] = "homeassistant/sensor/";
+static const size_t MAX_DEVICES = 4096;
+
+// FNV-1a, then mixed: ids that differ only in their last digits would
+// otherwise land in neighbouring slots and make long probe runs
+static uint32_t hashId(const char* text, size_t length) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) hash = (hash ^ (uint8_t)text[i]) * 16777619u;
+    hash ^= hash >> 16;
+    hash *= 0x85EBCA6Bu;
+    hash ^= hash >> 13;
+    hash *= 0xC2B2AE35u;
+    return hash ^ (hash >> 16);
+}
+
+RoomHub::~RoomHub() {
+    free(_devices);
+    free(_table);
+    free(_tiles);
+    free(_dirty);
+    heap_caps_free(_rings);
+}
+
+bool RoomHub::begin(uint16_t maxDevices, uint16_t historyLength, const char* ownId, uint32_t staleMs) {
+    if (_devices || maxDevices == 0 || maxDevices > MAX_DEVICES || historyLength == 0) return false;
+    // At most half full keeps the probes short
+    size_t tableSize = 1;
+    while (tableSize < 2 * (size_t)maxDevices) tableSize <<= 1;
+
+    _devices = (RoomHubDevice*)calloc(maxDevices, sizeof(RoomHubDevice));
+    _table = (uint16_t*)malloc(tableSize * sizeof(uint16_t));
+    _tiles = (uint16_t*)malloc(maxDevices * sizeof(uint16_t));
+    _dirty = (uint16_t*)malloc(maxDevices * sizeof(uint16_t));
+    // PSRAM first; the rings are the bulk of it and only read to draw a tile
+    size_t ringBytes = (size_t)maxDevices * historyLength * sizeof(RoomHubSample);
+    _rings = (RoomHubSample*)heap_caps_malloc(ringBytes, MALLOC_CAP_SPIRAM);
+    if (!_rings) _rings = (RoomHubSample*)heap_caps_malloc(ringBytes, MALLOC_CAP_8BIT);
+    if (!_devices || !_table || !_tiles || !_dirty || !_rings) {
+        free(_devices);
+        free(_table);
+        free(_tiles);
+        free(_dirty);
+        heap_caps_free(_rings);
+        _devices = nullptr;
+        _table = _tiles = _dirty = nullptr;
+        _rings = nullptr;
+        return false;
+    }
+    memset(_table, 0xFF, tableSize * sizeof(uint16_t));
+    _tableMask = tableSize - 1;
+    _capacity = maxDevices;
+    _historyLength = historyLength;
+    _staleMs = staleMs;
+    setOwnId(ownId);
+    return true;
+}
+
+void RoomHub::setOwnId(const char* ownId) {
+    snprintf(_ownId, sizeof(_ownId), "%s", ownId ? ownId : "");
+}
+
+bool RoomHub::handle(const char* topic, const uint8_t* payload, size_t length, uint32_t nowMs) {
+    // homeassistant/sensor/<id>/state or homeassistant/sensor/<id>/stats/<window>
+    const size_t prefixLength = sizeof(STATE_PREFIX) - 1;
+    const char* id = topic + prefixLength;
+    const char* slash = strncmp(topic, STATE_PREFIX, prefixLength) == 0 ? strchr(id, '/') : nullptr;
+    bool state = slash && strcmp(slash, "/state") == 0;
+    bool window = slash && strncmp(slash, "/stats/", 7) == 0;
+    if (!(state || window) || slash == id || (size_t)(slash - id) >= ROOM_HUB_ID_LENGTH) {
+        _stats.ignored++;
+        return false;
+    }
+    size_t idLength = slash - id;
+    if (strlen(_ownId) == idLength && memcmp(_ownId, id, idLength) == 0) {
+        _stats.ignored++;
+        return false;
+    }
+    if (window) return handleWindow(id, idLength, slash + 7, nowMs);
+
+    float temperature, humidity;
+    uint16_t co2;
+    if (!haParseState(payload, length, temperature, humidity, co2)) {
+        _stats.badPayloads++;
+        return false;
+    }
+    _stats.messages++;
+
+    char key[ROOM_HUB_ID_LENGTH];
+    memcpy(key, id, idLength);
+    key[idLength] = 0;
+    return update(key, temperature, humidity, co2, nowMs) >= 0;
+}
+
+// A window closed on the device: alive, whatever its readings do. The
+// window's length is in its name ("5m", "1h"). A device not known yet is
+// remembered until its reading comes, right after.
+bool RoomHub::handleWindow(const char* id, size_t idLength, const char* window, uint32_t nowMs) {
+    char* end;
+    unsigned long count = strtoul(window, &end, 10);
+    uint32_t unitMs = 0;
+    if (strcmp(end, "s") == 0) unitMs = 1000;
+    else if (strcmp(end, "m") == 0) unitMs = 60000;
+    else if (strcmp(end, "h") == 0) unitMs = 3600000;
+    if (!_devices || end == window || unitMs == 0 || count == 0 || count > 24 * 3600000UL / unitMs) {
+        _stats.ignored++;
+        return false;
+    }
+    _stats.windows++;
+    uint32_t forMs = ROOM_HUB_STALE_WINDOWS * count * unitMs;
+
+    uint32_t hash;
+    int slot = lookup(id, idLength, hash);
+    if (slot < 0) {
+        // The shortest window, when several close at once
+        bool same = strncmp(_windowId, id, idLength) == 0 && _windowId[idLength] == 0;
+        if (!same || nowMs - _windowMs > 1000 || forMs < _windowForMs) {
+            memcpy(_windowId, id, idLength);
+            _windowId[idLength] = 0;
+            _windowMs = nowMs;
+            _windowForMs = forMs;
+        }
+        return true;
+    }
+
+    RoomHubDevice& d = _devices[slot];
+    if (everyReading(d)) return true;     // judged by its readings
+    if (d.stale) d.freshUntilMs = nowMs;
+    keepFresh(d, nowMs + forMs);
+    if (d.stale) {
+        d.stale = false;
+        queue(slot);
+    }
+    return true;
+}
+
+// A device whose last two readings came within staleMs publishes every one
+bool RoomHub::everyReading(const RoomHubDevice& d) const {
+    return d.readingGapMs && d.readingGapMs < _staleMs;
+}
+
+// Extends, never shortens, the time the device counts as fresh
+void RoomHub::keepFresh(RoomHubDevice& d, uint32_t untilMs) {
+    if ((int32_t)(untilMs - d.freshUntilMs) > 0) d.freshUntilMs = untilMs;
+}
+
+int RoomHub::lookup(const char* id, size_t length, uint32_t& hash) const {
+    hash = hashId(id, length);
+    for (uint32_t i = hash & _tableMask;; i = (i + 1) & _tableMask) {
+        uint16_t slot = _table[i];
+        if (slot == EMPTY) return -1;
+        const RoomHubDevice& d = _devices[slot];
+        if (strncmp(d.id, id, length) == 0 && d.id[length] == 0) return slot;
+    }
+}
+
+int RoomHub::find(const char* id) const {
+    if (!_devices) return -1;
+    uint32_t hash;
+    return lookup(id, strlen(id), hash);
+}
+
+// A new device in the first free hash slot, and its tile in id order
+int RoomHub::insert(const char* id, size_t length, uint32_t hash) {
+    if (_count == _capacity) return -1;
+    uint16_t slot = _count++;
+    RoomHubDevice& d = _devices[slot];
+    memcpy(d.id, id, length);
+    d.id[length] = 0;
+
+    uint32_t probes = 1;
+    uint32_t i = hash & _tableMask;
+    while (_table[i] != EMPTY) {
+        i = (i + 1) & _tableMask;
+        probes++;
+    }
+    _table[i] = slot;
+    if (probes > _stats.probeMax) _stats.probeMax = probes;
+
+    uint16_t tile = 0;
+    while (tile < slot && strcmp(_devices[_tiles[tile]].id, d.id) < 0) tile++;
+    memmove(_tiles + tile + 1, _tiles + tile, (slot - tile) * sizeof(uint16_t));
+    _tiles[tile] = slot;
+    for (uint16_t t = tile; t <= slot; t++) _devices[_tiles[t]].tile = t;
+    _layoutChanged = true;
+    return slot;
+}
+
+int RoomHub::update(const char* id, float temperature, float humidity, uint16_t co2, uint32_t nowMs) {
+    if (!_devices) return -1;
+    size_t length = strnlen(id, ROOM_HUB_ID_LENGTH);
+    if (length == 0 || length >= ROOM_HUB_ID_LENGTH) return -1;
+    uint32_t hash;
+    int slot = lookup(id, length, hash);
+    if (slot < 0) slot = insert(id, length, hash);
+    if (slot < 0) {
+        _stats.full++;
+        return -1;
+    }
+
+    RoomHubDevice& d = _devices[slot];
+    if (d.updates) d.readingGapMs = nowMs - d.lastSeenMs;
+    if (d.updates == 0 || d.stale || everyReading(d)) d.freshUntilMs = nowMs + _staleMs;
+    else keepFresh(d, nowMs + _staleMs);
+    if (d.updates == 0 && strcmp(_windowId, d.id) == 0 && nowMs - _windowMs < _staleMs) {
+        keepFresh(d, _windowMs + _windowForMs);     // its window statistics came first
+        _windowId[0] = 0;
+    }
+    d.temperature = temperature;
+    d.humidity = humidity;
+    d.co2 = co2;
+    d.lastSeenMs = nowMs;
+    d.updates++;
+    d.stale = false;
+
+    RoomHubSample& sample = _rings[(size_t)slot * _historyLength + d.head];
+    sample.t = nowMs / 1000;
+    sample.temperature = (int16_t)lroundf(constrain(temperature, -327.0f, 327.0f) * 100);
+    sample.humidity = (uint8_t)lroundf(constrain(humidity, 0.0f, 100.0f));
+    sample.co2 = co2;
+    d.head = (d.head + 1) % _historyLength;
+    if (d.count < _historyLength) d.count++;
+
+    queue(slot);
+    return slot;
+}
+
+void RoomHub::checkStale(uint32_t nowMs) {
+    for (uint16_t slot = 0; slot < _count; slot++) {
+        RoomHubDevice& d = _devices[slot];
+        if (d.stale || (int32_t)(nowMs - d.freshUntilMs) < 0) continue;
+        d.stale = true;
+        queue(slot);
+    }
+}
+
+void RoomHub::queue(uint16_t slot) {
+    RoomHubDevice& d = _devices[slot];
+    if (d.queued) return;
+    d.queued = true;
+    _dirty[(_dirtyHead + _dirtyCount) % _capacity] = slot;
+    _dirtyCount++;
+}
+
+int RoomHub::nextDirty() {
+    if (_dirtyCount == 0) return -1;
+    uint16_t slot = _dirty[_dirtyHead];
+    _dirtyHead = (_dirtyHead + 1) % _capacity;
+    _dirtyCount--;
+    _devices[slot].queued = false;
+    return slot;
+}
+
+bool RoomHub::takeLayoutChange() {
+    if (!_layoutChanged) return false;
+    _layoutChanged = false;
+    while (nextDirty() >= 0) {
+    }
+    return true;
+}
+
+size_t RoomHub::history(uint16_t slot, RoomHubSample* out, size_t max) const {
+    const RoomHubDevice& d = _devices[slot];
+    size_t n = d.count < max ? d.count : max;
+    const RoomHubSample* ring = _rings + (size_t)slot * _historyLength;
+    size_t start = (d.head + _historyLength - n) % _historyLength;
+    for (size_t i = 0; i < n; i++) out[i] = ring[(start + i) % _historyLength];
+    return n;
+}
@@ -0,0 +1,155 @@
+#pragma once
+
+// The readings of every monitor on the broker, for a hub display: the Tab5
+// in hub mode shows one tile per room.
+//
+//   RoomHub hub;
+//   hub.begin(256, 360, device_id);             // setup(): rings in PSRAM
+//   mqttClient.setMessageCallback(onMessage);
+//   mqttClient.subscribe(ROOM_HUB_STATE_TOPICS);
+//   mqttClient.subscribe(ROOM_HUB_STATS_TOPICS);
+//   void onMessage(const char* topic, const uint8_t* payload, size_t length, void*) {
+//       hub.handle(topic, payload, length, millis());
+//   }
+//
+//   void loop() {
+//       hub.checkStale(millis());
+//       if (hub.takeLayoutChange()) { ... repaint every tile ... }
+//       int slot;
+//       while ((slot = hub.nextDirty()) >= 0) drawTile(hub.device(slot));
+//   }
+//
+// A device is found by its id in an open-addressing hash table (FNV-1a,
+// mixed, linear probing, at most half full), so a message costs the same
+// with 10 devices or 500. Devices are never removed; a full hub ignores new
+// ones.
+// Tiles are in device id order: a new device moves the tiles after it, and
+// takeLayoutChange() tells the display to repaint them all. Otherwise only
+// the devices that published, or went stale or came back, are queued for
+// nextDirty(), each once however often it published in between.
+//
+// A device goes stale when it has been silent for staleMs after a reading.
+// A monitor with raw_state off (or a long publish_ms) sends a reading only
+// every 5 minutes or less often, but its window statistics (lib/WindowStats)
+// keep coming: a stats/<window> message keeps it fresh for
+// ROOM_HUB_STALE_WINDOWS windows. That is unless its last two readings came
+// within staleMs: such a device publishes every reading, and staleMs of
+// silence says something is wrong. (A device first heard from between two
+// windows goes stale after staleMs, until its next window says otherwise.)
+//
+// Every device keeps its last `historyLength` readings in a ring, all rings
+// in one PSRAM block (temperature in 1/100 °C, humidity in %, 12 bytes a
+// reading; 256 devices of 360 readings, half an hour at 5 s, take 1.1 MB).
+// Nothing here locks: call it from one task (loop(), where MqttPipe calls
+// its message callback).
+
+#include <Arduino.h>
+
+// What the monitors publish their readings to (lib/HaDevice)
+#define ROOM_HUB_STATE_TOPICS "homeassistant/sensor/+/state"
+// Their 5-minute and hourly statistics, taken as signs of life
+#define ROOM_HUB_STATS_TOPICS "homeassistant/sensor/+/stats/+"
+
+const size_t ROOM_HUB_ID_LENGTH = 32;
+const uint32_t ROOM_HUB_DEFAULT_STALE_MS = 30000;   // six missed readings
+const uint8_t ROOM_HUB_STALE_WINDOWS = 3;          // missed stats windows, for a device without every reading
+
+struct RoomHubSample {
+    uint32_t t;             // seconds since boot
+    int16_t temperature;    // 1/100 °C
+    uint16_t co2;
+    uint8_t humidity;       // %
+};
+
+struct RoomHubDevice {
+    char id[ROOM_HUB_ID_LENGTH];
+    uint16_t tile;          // position in id order
+    float temperature;
+    float humidity;
+    uint16_t co2;
+    uint32_t lastSeenMs;    // of the last reading
+    uint32_t readingGapMs;  // between its last two readings; 0 until it has two
+    uint32_t freshUntilMs;  // stale from then on
+    uint32_t updates;
+    bool stale;
+    bool queued;            // waiting in the dirty queue
+    uint16_t head;          // next ring slot
+    uint16_t count;         // readings in the ring
+};
+
+struct RoomHubStats {
+    uint32_t messages;      // handled
+    uint32_t windows;       // stats messages
+    uint32_t ignored;       // not a state or stats topic, or the hub's own
+    uint32_t badPayloads;
+    uint32_t full;          // readings of devices that did not fit
+    uint32_t probeMax;      // longest hash probe
+};
+
+class RoomHub {
+public:
+    ~RoomHub();
+
+    // Allocates for `maxDevices` (up to 4096); false when it could not.
+    // Messages from `ownId` are ignored: the hub adds its own readings with
+    // update(), also while the broker is out of reach.
+    bool begin(uint16_t maxDevices, uint16_t historyLength, const char* ownId = nullptr,
+               uint32_t staleMs = ROOM_HUB_DEFAULT_STALE_MS);
+
+    // The hub's own id changed (RemoteConfig's device_id): messages from the
+    // new one are ignored from now on; the old one's tile stays and goes stale
+    void setOwnId(const char* ownId);
+
+    // A message on homeassistant/sensor/<id>/state or .../stats/<window> (5m,
+    // 1h); false when it was neither or a state payload did not parse. Stats
+    // do not add a device, its next reading does.
+    bool handle(const char* topic, const uint8_t* payload, size_t length, uint32_t nowMs);
+    // A reading of device `id`; its slot, or -1 when the hub is full
+    int update(const char* id, float temperature, float humidity, uint16_t co2, uint32_t nowMs);
+    // Marks devices silent for too long stale; queues the ones that changed
+    void checkStale(uint32_t nowMs);
+
+    int find(const char* id) const;     // slot or -1
+    uint16_t count() const { return _count; }
+    uint16_t capacity() const { return _capacity; }
+    const RoomHubDevice& device(uint16_t slot) const { return _devices[slot]; }
+    uint16_t slotAt(uint16_t tile) const { return _tiles[tile]; }
+
+    // The next device whose tile needs drawing, or -1
+    int nextDirty();
+    // True once after devices were added (tiles moved); the dirty queue is
+    // emptied, as every tile is to be drawn anyway
+    bool takeLayoutChange();
+
+    // Up to `max` of the newest readings of a device, oldest first
+    size_t history(uint16_t slot, RoomHubSample* out, size_t max) const;
+
+    const RoomHubStats& stats() const { return _stats; }
+
+private:
+    int insert(const char* id, size_t length, uint32_t hash);
+    int lookup(const char* id, size_t length, uint32_t& hash) const;
+    void queue(uint16_t slot);
+    bool everyReading(const RoomHubDevice& d) const;
+    void keepFresh(RoomHubDevice& d, uint32_t untilMs);
+    bool handleWindow(const char* id, size_t idLength, const char* window, uint32_t nowMs);
+
+    RoomHubDevice* _devices = nullptr;
+    uint16_t* _table = nullptr;         // hash slot -> device slot
+    uint16_t _tableMask = 0;
+    uint16_t* _tiles = nullptr;         // tile -> device slot
+    uint16_t* _dirty = nullptr;         // ring of device slots
+    uint16_t _dirtyHead = 0;
+    uint16_t _dirtyCount = 0;
+    RoomHubSample* _rings = nullptr;    // PSRAM
+    uint16_t _historyLength = 0;
+    uint16_t _capacity = 0;
+    uint16_t _count = 0;
+    bool _layoutChanged = false;
+    uint32_t _staleMs = ROOM_HUB_DEFAULT_STALE_MS;
+    char _ownId[ROOM_HUB_ID_LENGTH] = "";
+    char _windowId[ROOM_HUB_ID_LENGTH] = "";    // the last stats of a device not known yet
+    uint32_t _windowMs = 0;
+    uint32_t _windowForMs = 0;
+    RoomHubStats _stats = {};
+};
@@ -0,0 +1,375 @@
+#include "span_trace.h"
+
+#include <atomic>
+#include <esp_heap_caps.h>
+#include <new>
+#include <stdio.h>
+
+#ifdef ESP_PLATFORM
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#endif
+
+#ifndef SPAN_TRACE_SAMPLER_STACK_SIZE
+#define SPAN_TRACE_SAMPLER_STACK_SIZE 2048
+#endif
+
+enum SpanPhase : uint8_t {
+    PHASE_BEGIN = 'B',
+    PHASE_END = 'E',
+    PHASE_INSTANT = 'i',
+    PHASE_COUNTER = 'C',
+    PHASE_SWITCH = 'S',     // arg = task now running on `core`
+};
+
+// stamp is the event's index + 1, stored last; an exporter that reads the same
+// stamp before and after copying the slot knows nobody rewrote it meanwhile
+struct Slot {
+    std::atomic<uint32_t> stamp;
+    uint32_t us;
+    const SpanTraceSite* site;
+    uint32_t arg;
+    uint8_t phase;
+    uint8_t core;
+    uint8_t task;       // the task that recorded it
+    uint8_t reserved;
+};
+
+struct TaskInfo {
+    std::atomic<const void*> handle;
+    char name[16];
+};
+
+static Slot* slots = nullptr;
+static uint32_t capacity = 0;   // power of two
+static std::atomic<uint32_t> head(0);
+static uint32_t rearmHead = 0;
+
+static std::atomic<bool> frozen(false);
+static uint32_t frozenHead = 0;
+static char reason[96];
+static uint32_t triggers = 0;
+
+static uint32_t loopTriggerMs = SPAN_TRACE_LOOP_TRIGGER_MS;
+static uint32_t loopStartUs = 0;
+static const SpanTraceSite loopSite = {"loop", "loop"};
+
+static TaskInfo tasks[SPAN_TRACE_MAX_TASKS];
+static std::atomic<int> taskCount(0);
+
+// Tasks
+
+// Index of a task in tasks[], registering it the first time; tasks beyond
+// SPAN_TRACE_MAX_TASKS share the last index
+static uint8_t taskIndex(const void* handle, const char* name) {
+    int count = taskCount.load(std::memory_order_acquire);
+    if (count > SPAN_TRACE_MAX_TASKS) count = SPAN_TRACE_MAX_TASKS;
+    for (int i = 0; i < count; i++) {
+        if (tasks[i].handle.load(std::memory_order_acquire) == handle) return i;
+    }
+    int i = taskCount.fetch_add(1, std::memory_order_acq_rel);
+    if (i >= SPAN_TRACE_MAX_TASKS) return SPAN_TRACE_MAX_TASKS - 1;
+    snprintf(tasks[i].name, sizeof(tasks[i].name), "%s", name ? name : "?");
+    tasks[i].handle.store(handle, std::memory_order_release);
+    return i;
+}
+
+static uint8_t currentTask() {
+#ifdef ESP_PLATFORM
+    return taskIndex(xTaskGetCurrentTaskHandle(), pcTaskGetName(nullptr));
+#else
+    static thread_local int index = -1;
+    static std::atomic<int> threads(0);
+    if (index < 0) {
+        static thread_local char key;
+        int n = threads.fetch_add(1);
+        char name[16];
+        if (n == 0) {
+            snprintf(name, sizeof(name), "main");
+        } else {
+            snprintf(name, sizeof(name), "thread %d", n);
+        }
+        index = taskIndex(&key, name);
+    }
+    return index;
+#endif
+}
+
+static uint8_t currentCore() {
+#ifdef ESP_PLATFORM
+    return xPortGetCoreID();
+#else
+    return 0;
+#endif
+}
+
+// Recording
+
+static void record(uint8_t phase, const SpanTraceSite* site, uint32_t arg, uint8_t core, uint8_t task) {
+    if (!slots || frozen.load(std::memory_order_relaxed)) return;
+    uint32_t i = head.fetch_add(1, std::memory_order_relaxed);
+    Slot& s = slots[i & (capacity - 1)];
+    s.stamp.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    s.us = micros();
+    s.site = site;
+    s.arg = arg;
+    s.phase = phase;
+    s.core = core;
+    s.task = task;
+    s.stamp.store(i + 1, std::memory_order_release);
+}
+
+void spanTraceBegin(const SpanTraceSite* site) {
+    record(PHASE_BEGIN, site, 0, currentCore(), currentTask());
+}
+
+void spanTraceEnd(const SpanTraceSite* site) {
+    record(PHASE_END, site, 0, currentCore(), currentTask());
+}
+
+void spanTraceInstant(const SpanTraceSite* site, uint32_t arg) {
+    record(PHASE_INSTANT, site, arg, currentCore(), currentTask());
+}
+
+void spanTraceCounter(const SpanTraceSite* site, uint32_t value) {
+    record(PHASE_COUNTER, site, value, currentCore(), currentTask());
+}
+
+void spanTraceLoopBegin() {
+    loopStartUs = micros();
+    spanTraceBegin(&loopSite);
+}
+
+void spanTraceLoopEnd() {
+    spanTraceEnd(&loopSite);
+    uint32_t elapsedMs = (micros() - loopStartUs) / 1000;
+    if (loopTriggerMs && elapsedMs > loopTriggerMs && !frozen.load(std::memory_order_relaxed)) {
+        char text[64];
+        snprintf(text, sizeof(text), "loop() took %u ms, trigger at %u ms", (unsigned)elapsedMs,
+                 (unsigned)loopTriggerMs);
+        spanTraceTrigger(text);
+    }
+}
+
+void spanTraceSetLoopTrigger(uint32_t ms) {
+    loopTriggerMs = ms;
+}
+
+// Core samplers
+
+#ifdef ESP_PLATFORM
+// Runs on one core and watches the other, so it never sees itself
+static void samplerLoop(void* arg) {
+    int watched = (int)(intptr_t)arg;
+    TaskHandle_t last = nullptr;
+    TickType_t wake = xTaskGetTickCount();
+    for (;;) {
+        vTaskDelayUntil(&wake, 1);
+        if (frozen.load(std::memory_order_relaxed)) {
+            last = nullptr;   // the first sample after a rearm starts the row again
+            continue;
+        }
+        TaskHandle_t running = xTaskGetCurrentTaskHandleForCore(watched);
+        if (running == last) continue;
+        last = running;
+        record(PHASE_SWITCH, nullptr, taskIndex(running, pcTaskGetName(running)), watched, currentTask());
+    }
+}
+#endif
+
+bool spanTraceStart(size_t events) {
+    if (slots) return true;
+    uint32_t n = 1;
+    while (n < events) n <<= 1;
+
+    // PSRAM first; internal RAM is too precious for a trace
+    void* memory = heap_caps_malloc(n * sizeof(Slot), MALLOC_CAP_SPIRAM);
+    if (!memory) memory = heap_caps_malloc(n * sizeof(Slot), MALLOC_CAP_8BIT);
+    if (!memory) return false;
+    Slot* ring = new (memory) Slot[n];
+    for (uint32_t i = 0; i < n; i++) ring[i].stamp.store(0, std::memory_order_relaxed);
+    capacity = n;
+    slots = ring;
+
+#ifdef ESP_PLATFORM
+#if portNUM_PROCESSORS > 1
+    xTaskCreatePinnedToCore(samplerLoop, "trace core1", SPAN_TRACE_SAMPLER_STACK_SIZE, (void*)1,
+                            configMAX_PRIORITIES - 1, nullptr, 0);
+    xTaskCreatePinnedToCore(samplerLoop, "trace core0", SPAN_TRACE_SAMPLER_STACK_SIZE, (void*)0,
+                            configMAX_PRIORITIES - 1, nullptr, 1);
+#endif
+#endif
+    return true;
+}
+
+// Triggers
+
+void spanTraceTrigger(const char* why) {
+    bool expected = false;
+    if (!frozen.compare_exchange_strong(expected, true, std::memory_order_acq_rel)) return;
+    frozenHead = head.load(std::memory_order_acquire);
+    snprintf(reason, sizeof(reason), "%s", why ? why : "");
+    triggers++;
+}
+
+bool spanTraceFrozen() {
+    return frozen.load(std::memory_order_acquire);
+}
+
+const char* spanTraceReason() {
+    return frozen.load(std::memory_order_acquire) ? reason : "";
+}
+
+// Export
+
+struct ExportState {
+    bool active;
+    bool done;
+    uint32_t next;        // event index
+    uint32_t end;
+    uint32_t baseUs;
+    bool first;
+    uint8_t depth[SPAN_TRACE_MAX_TASKS];
+    uint8_t coreTask[2];  // running task per core row, 0xFF = none yet
+};
+
+static ExportState exportState;
+
+void spanTraceRearm() {
+    exportState.active = false;
+    exportState.done = false;
+    rearmHead = head.load(std::memory_order_acquire);
+    frozen.store(false, std::memory_order_release);
+}
+
+static void printEscaped(Print& out, const char* s) {
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') out.print('\\');
+        if ((uint8_t)*s >= 0x20) out.print(*s);
+    }
+}
+
+static void beginLine(Print& out, const char* prefix) {
+    if (prefix) out.print(prefix);
+    if (!exportState.first) out.print(',');
+    exportState.first = false;
+}
+
+static void printMetadata(Print& out, const char* prefix, int pid, int tid, const char* kind, const char* name) {
+    beginLine(out, prefix);
+    out.printf("{\"name\":\"%s\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"", kind, pid, tid);
+    printEscaped(out, name);
+    out.print("\"}}\n");
+}
+
+// pid 1 holds a row per task with its spans, pid 2 a row per core with the
+// sampled task switches
+static void printEvent(Print& out, const char* prefix, const Slot& e) {
+    // Tasks on the two cores may take indices slightly out of time order
+    int32_t offset = (int32_t)(e.us - exportState.baseUs);
+    uint32_t ts = offset > 0 ? offset : 0;
+
+    if (e.phase == PHASE_SWITCH) {
+        if (e.core >= 2) return;
+        uint8_t previous = exportState.coreTask[e.core];
+        if (previous != 0xFF) {
+            beginLine(out, prefix);
+            out.printf("{\"name\":\"");
+            printEscaped(out, tasks[previous].name);
+            out.printf("\",\"ph\":\"E\",\"ts\":%u,\"pid\":2,\"tid\":%u}\n", (unsigned)ts, e.core);
+        }
+        exportState.coreTask[e.core] = e.arg;
+        beginLine(out, prefix);
+        out.printf("{\"name\":\"");
+        printEscaped(out, tasks[e.arg < SPAN_TRACE_MAX_TASKS ? e.arg : 0].name);
+        out.printf("\",\"cat\":\"task\",\"ph\":\"B\",\"ts\":%u,\"pid\":2,\"tid\":%u}\n", (unsigned)ts, e.core);
+        return;
+    }
+
+    uint8_t& depth = exportState.depth[e.task];
+    if (e.phase == PHASE_END) {
+        if (depth == 0) return;   // began before the oldest event kept
+        depth--;
+    } else if (e.phase == PHASE_BEGIN) {
+        if (depth < 0xFF) depth++;
+    }
+
+    beginLine(out, prefix);
+    out.print("{\"name\":\"");
+    printEscaped(out, e.site->name);
+    out.print("\",\"cat\":\"");
+    printEscaped(out, e.site->category);
+    out.printf("\",\"ph\":\"%c\",\"ts\":%u,\"pid\":1,\"tid\":%u", e.phase, (unsigned)ts, e.task);
+    if (e.phase == PHASE_INSTANT) out.printf(",\"s\":\"t\",\"args\":{\"arg\":%u}", (unsigned)e.arg);
+    if (e.phase == PHASE_COUNTER) out.printf(",\"args\":{\"value\":%u}", (unsigned)e.arg);
+    out.print("}\n");
+}
+
+// Copies a slot if it still holds the event with this index
+static bool readSlot(uint32_t index, Slot& copy) {
+    Slot& s = slots[index & (capacity - 1)];
+    uint32_t stamp = s.stamp.load(std::memory_order_acquire);
+    if (stamp != index + 1) return false;
+    copy.us = s.us;
+    copy.site = s.site;
+    copy.arg = s.arg;
+    copy.phase = s.phase;
+    copy.core = s.core;
+    copy.task = s.task;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return s.stamp.load(std::memory_order_relaxed) == stamp;
+}
+
+bool spanTraceExport(Print& out, const char* prefix, int maxEvents) {
+    if (!slots || !spanTraceFrozen()) return true;
+
+    ExportState& x = exportState;
+    if (x.done) return true;
+    if (!x.active) {
+        x.active = true;
+        x.end = frozenHead;
+        uint32_t kept = frozenHead - rearmHead;
+        if (kept > capacity) kept = capacity;
+        x.next = frozenHead - kept;
+        x.first = true;
+        memset(x.depth, 0, sizeof(x.depth));
+        memset(x.coreTask, 0xFF, sizeof(x.coreTask));
+        Slot oldest;
+        x.baseUs = readSlot(x.next, oldest) ? oldest.us : 0;
+
+        if (prefix) out.print(prefix);
+        out.print("{\"traceEvents\":[\n");
+        printMetadata(out, prefix, 1, 0, "process_name", "tasks");
+        printMetadata(out, prefix, 2, 0, "process_name", "cores (sampled each tick)");
+        int count = taskCount.load(std::memory_order_acquire);
+        if (count > SPAN_TRACE_MAX_TASKS) count = SPAN_TRACE_MAX_TASKS;
+        for (int i = 0; i < count; i++) printMetadata(out, prefix, 1, i, "thread_name", tasks[i].name);
+        printMetadata(out, prefix, 2, 0, "thread_name", "core 0");
+        printMetadata(out, prefix, 2, 1, "thread_name", "core 1");
+    }
+
+    for (int n = 0; n < maxEvents && x.next != x.end; n++, x.next++) {
+        Slot e;
+        if (readSlot(x.next, e) && (e.site || e.phase == PHASE_SWITCH)) printEvent(out, prefix, e);
+    }
+    if (x.next != x.end) return false;
+
+    if (prefix) out.print(prefix);
+    out.print("],\"displayTimeUnit\":\"ms\",\"otherData\":{\"trigger\":\"");
+    printEscaped(out, reason);
+    out.print("\"}}\n");
+    x.done = true;
+    return true;
+}
+
+SpanTraceStats spanTraceStats() {
+    SpanTraceStats stats;
+    uint32_t last = spanTraceFrozen() ? frozenHead : head.load(std::memory_order_relaxed);
+    stats.recorded = last - rearmHead;
+    stats.capacity = capacity;
+    stats.triggers = triggers;
+    int count = taskCount.load(std::memory_order_relaxed);
+    stats.tasks = count < SPAN_TRACE_MAX_TASKS ? count : SPAN_TRACE_MAX_TASKS;
+    return stats;
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+// Flight recorder of what the firmware was doing, exported as Chrome trace
+// JSON (open it at ui.perfetto.dev or chrome://tracing).
+//
+//   spanTraceStart();                          // setup(): ring in PSRAM
+//
+//   void loop() {
+//       spanTraceLoopBegin();
+//       {
+//           SPAN_TRACE("i2c", "scd4x.readMeasurement");
+//           error = scd4x.readMeasurement(co2, temperature, humidity);
+//       }
+//       spanTraceLoopEnd();                    // freezes the ring if loop() was slow
+//       if (spanTraceFrozen()) spanTraceExport(Serial, "@spt ", 256);
+//   }
+//
+// Every span start, span end, instant and counter is a 20-byte event in a ring
+// of spanTraceStart(events) entries that keeps overwriting its oldest events.
+// Recording takes a slot with one atomic add and never locks, so any task
+// may record. ISRs may too, unless they run while the flash cache is off
+// (IRAM-only ISRs): the ring is in PSRAM.
+//
+// A trigger freezes the ring: recording stops and the last N events stay for
+// export. spanTraceLoopEnd() triggers when loop() took longer than
+// SPAN_TRACE_LOOP_TRIGGER_MS (spanTraceSetLoopTrigger() changes it), and
+// spanTraceTrigger() does it for any other condition. spanTraceRearm() starts
+// recording again.
+//
+// Which task runs on which core is sampled, not hooked: the prebuilt FreeRTOS
+// in the Arduino core has no trace hooks compiled in. A sampler task per core,
+// at the highest priority, looks at the other core every tick (1 ms) and
+// records a switch when its task changed. Tasks that run for less than a tick
+// can be missed. On the host there is no sampler; threads are rows of their own.
+//
+// spanTraceExport() writes the frozen ring as JSON a few events per call, so
+// loop() carries on between the calls. With a line prefix every line of the
+// export starts with it, and the JSON can be cut out of a Serial log:
+//     grep -a '^@spt ' run.log | cut -c6- > trace.json
+// Without one it writes plain JSON, for example into a file on the SD card.
+
+#include <Arduino.h>
+
+#ifndef SPAN_TRACE_LOOP_TRIGGER_MS
+#define SPAN_TRACE_LOOP_TRIGGER_MS 200
+#endif
+
+const size_t SPAN_TRACE_DEFAULT_EVENTS = 16384;
+const int SPAN_TRACE_MAX_TASKS = 32;
+
+// A call site; names must outlive the recorder (string literals)
+struct SpanTraceSite {
+    const char* category;
+    const char* name;
+};
+
+// Allocates the ring (PSRAM when there is some) and starts the core samplers.
+// false if the ring could not be allocated; recording calls are then no-ops.
+bool spanTraceStart(size_t events = SPAN_TRACE_DEFAULT_EVENTS);
+
+void spanTraceBegin(const SpanTraceSite* site);
+void spanTraceEnd(const SpanTraceSite* site);
+void spanTraceInstant(const SpanTraceSite* site, uint32_t arg = 0);
+void spanTraceCounter(const SpanTraceSite* site, uint32_t value);
+
+// Records a "loop" span around loop() and triggers when it ran too long
+void spanTraceLoopBegin();
+void spanTraceLoopEnd();
+void spanTraceSetLoopTrigger(uint32_t ms);   // 0 never triggers
+
+// Freezes the ring; the first trigger's reason is kept (copied)
+void spanTraceTrigger(const char* reason);
+bool spanTraceFrozen();
+const char* spanTraceReason();
+void spanTraceRearm();
+
+// Writes at most maxEvents more events of the frozen ring; true once the
+// whole export is out. Starts over after spanTraceRearm().
+bool spanTraceExport(Print& out, const char* linePrefix = nullptr, int maxEvents = 256);
+
+struct SpanTraceStats {
+    uint32_t recorded;     // since the last rearm
+    uint32_t capacity;
+    uint32_t triggers;
+    int tasks;             // distinct tasks seen
+};
+SpanTraceStats spanTraceStats();
+
+class SpanTraceScope {
+public:
+    explicit SpanTraceScope(const SpanTraceSite* site) : _site(site) { spanTraceBegin(site); }
+    ~SpanTraceScope() { spanTraceEnd(_site); }
+
+private:
+    const SpanTraceSite* _site;
+};
+
+#define SPAN_TRACE_CONCAT2(a, b) a##b
+#define SPAN_TRACE_CONCAT(a, b) SPAN_TRACE_CONCAT2(a, b)
+
+// Records a span from here to the end of the enclosing block. Not across a
+// co_await: the span would include whatever ran while the coroutine waited.
+#define SPAN_TRACE(category, name)                                                            \
+    static const SpanTraceSite SPAN_TRACE_CONCAT(_spanSite, __LINE__) = {category, name};     \
+    SpanTraceScope SPAN_TRACE_CONCAT(_spanScope, __LINE__)(&SPAN_TRACE_CONCAT(_spanSite, __LINE__))
+
+#define SPAN_TRACE_INSTANT(category, name, arg)                                               \
+    do {                                                                                      \
+        static const SpanTraceSite _spanSite = {category, name};                              \
+        spanTraceInstant(&_spanSite, arg);                                                    \
+    } while (0)
+
+#define SPAN_TRACE_COUNTER(category, name, value)                                             \
+    do {                                                                                      \
+        static const SpanTraceSite _spanSite = {category, name};                              \
+        spanTraceCounter(&_spanSite, value);                                                  \
+    } while (0)
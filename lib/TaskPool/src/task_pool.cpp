@@ -0,0 +1,375 @@
+#include "task_pool.h"
+
+#include <atomic>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef ESP_PLATFORM
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <esp_timer.h>
+#else
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#endif
+
+#ifndef TASK_POOL_STACK_SIZE
+#define TASK_POOL_STACK_SIZE 6144
+#endif
+
+// Chase-Lev deque of ranges: the owner pushes and pops at the bottom, thieves
+// take from the top. Splitting halves the range each time, so the depth stays
+// around log2(range / grain) and a small fixed ring is enough; when it is full
+// the owner just stops splitting.
+//
+// Each slot's bounds are atomics of their own: a thief may read a slot that the
+// owner is about to reuse, but then its compare-exchange on top fails and the
+// value it read is thrown away.
+
+const int DEQUE_SIZE = 64;   // power of two
+
+// top and bottom only ever grow and are compared through their difference, so
+// wrapping around after 2^32 pushes is harmless
+struct RangeDeque {
+    std::atomic<uint32_t> top;
+    std::atomic<uint32_t> bottom;
+    std::atomic<int32_t> lo[DEQUE_SIZE];
+    std::atomic<int32_t> hi[DEQUE_SIZE];
+
+    void reset() {
+        top.store(0);
+        bottom.store(0);
+    }
+
+    bool push(int32_t rangeLo, int32_t rangeHi) {
+        uint32_t b = bottom.load(std::memory_order_relaxed);
+        uint32_t t = top.load(std::memory_order_acquire);
+        if ((int32_t)(b - t) >= DEQUE_SIZE) return false;
+        lo[b & (DEQUE_SIZE - 1)].store(rangeLo, std::memory_order_relaxed);
+        hi[b & (DEQUE_SIZE - 1)].store(rangeHi, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom.store(b + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    bool pop(int32_t& rangeLo, int32_t& rangeHi) {
+        uint32_t b = bottom.load(std::memory_order_relaxed) - 1;
+        bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        uint32_t t = top.load(std::memory_order_relaxed);
+        if ((int32_t)(b - t) < 0) {
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return false;
+        }
+        rangeLo = lo[b & (DEQUE_SIZE - 1)].load(std::memory_order_relaxed);
+        rangeHi = hi[b & (DEQUE_SIZE - 1)].load(std::memory_order_relaxed);
+        if (t == b) {
+            // Last entry: race the thieves for it
+            bool won = top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                                   std::memory_order_relaxed);
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return won;
+        }
+        return true;
+    }
+
+    bool steal(int32_t& rangeLo, int32_t& rangeHi) {
+        uint32_t t = top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        uint32_t b = bottom.load(std::memory_order_acquire);
+        if ((int32_t)(b - t) <= 0) return false;
+        rangeLo = lo[t & (DEQUE_SIZE - 1)].load(std::memory_order_relaxed);
+        rangeHi = hi[t & (DEQUE_SIZE - 1)].load(std::memory_order_relaxed);
+        return top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                           std::memory_order_relaxed);
+    }
+};
+
+// One parallelFor() call; lives on the caller's stack
+struct ParallelJob {
+    ParallelRangeFn fn;
+    void* user;
+    int32_t grain;
+    std::atomic<int32_t> remaining;   // items not yet run or dropped
+    std::atomic<bool> cancelled;
+};
+
+struct Participant {
+    RangeDeque deque;
+    std::atomic<uint32_t> busyUs;
+    std::atomic<uint32_t> ranges;
+    std::atomic<uint32_t> items;
+    std::atomic<uint32_t> steals;
+#ifdef ESP_PLATFORM
+    TaskHandle_t task;
+#else
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable wake;
+    int wakeCount;
+#endif
+};
+
+static Participant participants[TASK_POOL_MAX_PARTICIPANTS];
+static int participantCount = 1;
+static std::atomic<ParallelJob*> activeJob(nullptr);
+static std::atomic<bool> callerBusy(false);
+static std::atomic<bool> stopping(false);
+static uint32_t statsResetUs = 0;
+
+// -1 on tasks that are not part of the pool; the caller is 0 while it runs a job
+static thread_local int currentParticipant = -1;
+
+// Platform layer
+
+static uint32_t nowUs() {
+#ifdef ESP_PLATFORM
+    return (uint32_t)esp_timer_get_time();
+#else
+    return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+static void relax() {
+#ifdef ESP_PLATFORM
+    taskYIELD();
+#else
+    std::this_thread::yield();
+#endif
+}
+
+static void wakeWorker(int index) {
+    Participant& p = participants[index];
+#ifdef ESP_PLATFORM
+    if (p.task) xTaskNotifyGive(p.task);
+#else
+    {
+        std::lock_guard<std::mutex> lock(p.mutex);
+        p.wakeCount++;
+    }
+    p.wake.notify_one();
+#endif
+}
+
+// Blocks until woken; wakes are counted, so one sent before the wait is not lost
+static void sleepWorker(int index) {
+#ifdef ESP_PLATFORM
+    (void)index;
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+#else
+    Participant& p = participants[index];
+    std::unique_lock<std::mutex> lock(p.mutex);
+    p.wake.wait(lock, [&p] { return p.wakeCount > 0; });
+    p.wakeCount = 0;
+#endif
+}
+
+// Scheduler
+
+// Runs a range, pushing upper halves for others to steal until it is down to the grain
+static void runRange(int self, ParallelJob* job, int32_t lo, int32_t hi) {
+    Participant& p = participants[self];
+    while (hi - lo > job->grain && !job->cancelled.load(std::memory_order_relaxed)) {
+        int32_t mid = lo + (hi - lo) / 2;
+        if (!p.deque.push(mid, hi)) break;
+        hi = mid;
+    }
+
+    if (!job->cancelled.load(std::memory_order_relaxed)) {
+        uint32_t start = nowUs();
+        job->fn(lo, hi, job->user);
+        p.busyUs.fetch_add(nowUs() - start, std::memory_order_relaxed);
+        p.ranges.fetch_add(1, std::memory_order_relaxed);
+        p.items.fetch_add(hi - lo, std::memory_order_relaxed);
+    }
+    // Last touch of the job: once remaining reaches 0 the caller may return
+    job->remaining.fetch_sub(hi - lo, std::memory_order_acq_rel);
+}
+
+// Own deque first (newest, smallest and cache-warm), then steal round-robin
+static bool takeRange(int self, int32_t& lo, int32_t& hi) {
+    if (participants[self].deque.pop(lo, hi)) return true;
+    for (int i = 1; i < participantCount; i++) {
+        int victim = (self + i) % participantCount;
+        if (participants[victim].deque.steal(lo, hi)) {
+            participants[self].steals.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+static void workerLoop(int self) {
+    currentParticipant = self;
+    while (!stopping.load()) {
+        ParallelJob* job = activeJob.load(std::memory_order_acquire);
+        if (!job) {
+            sleepWorker(self);
+            continue;
+        }
+        // Spin while a job is active: jobs last a frame at most and the
+        // latency of going back to sleep would eat most of the gain. The job
+        // is read again after the take: the one seen above may have finished
+        // since, but a job cannot finish while one of its ranges is unrun.
+        int32_t lo, hi;
+        if (takeRange(self, lo, hi)) runRange(self, activeJob.load(std::memory_order_acquire), lo, hi);
+        else relax();
+    }
+}
+
+#ifdef ESP_PLATFORM
+static void workerTask(void* arg) {
+    workerLoop((int)(intptr_t)arg);
+    participants[(int)(intptr_t)arg].task = nullptr;
+    vTaskDelete(NULL);
+}
+#endif
+
+// Public API
+
+bool taskPoolBegin(int workers) {
+    if (participantCount > 1) return true;
+
+#ifdef ESP_PLATFORM
+    int cores = portNUM_PROCESSORS;
+#else
+    int cores = (int)std::thread::hardware_concurrency();
+    if (cores < 2) cores = 2;
+#endif
+    if (workers < 0) workers = cores - 1;
+    if (workers > TASK_POOL_MAX_PARTICIPANTS - 1) workers = TASK_POOL_MAX_PARTICIPANTS - 1;
+
+    stopping.store(false);
+    for (int i = 0; i < TASK_POOL_MAX_PARTICIPANTS; i++) participants[i].deque.reset();
+    taskPoolResetStats();
+
+    bool ok = true;
+#ifdef ESP_PLATFORM
+    int callerCore = xPortGetCoreID();
+    UBaseType_t priority = uxTaskPriorityGet(NULL);
+    for (int i = 1; i <= workers; i++) {
+        char name[12];
+        snprintf(name, sizeof(name), "pool%d", i);
+        int core = (callerCore + i) % cores;
+        if (xTaskCreatePinnedToCore(workerTask, name, TASK_POOL_STACK_SIZE, (void*)(intptr_t)i,
+                                    priority, &participants[i].task, core) != pdPASS) {
+            participants[i].task = nullptr;
+            ok = false;
+            break;
+        }
+        participantCount = i + 1;
+    }
+#else
+    for (int i = 1; i <= workers; i++) {
+        participants[i].wakeCount = 0;
+        participants[i].thread = std::thread(workerLoop, i);
+        participantCount = i + 1;
+    }
+    // Join before exit() destroys the condition variables the workers sleep on
+    static bool exitHooked = false;
+    if (!exitHooked) {
+        atexit(taskPoolEnd);
+        exitHooked = true;
+    }
+#endif
+    return ok;
+}
+
+void taskPoolEnd() {
+    if (participantCount <= 1) return;
+    stopping.store(true);
+    for (int i = 1; i < participantCount; i++) wakeWorker(i);
+#ifdef ESP_PLATFORM
+    for (int i = 1; i < participantCount; i++) {
+        while (participants[i].task) vTaskDelay(1);
+    }
+#else
+    for (int i = 1; i < participantCount; i++) participants[i].thread.join();
+#endif
+    participantCount = 1;
+}
+
+int taskPoolParticipants() {
+    return participantCount;
+}
+
+bool parallelFor(int begin, int end, int grain, ParallelRangeFn fn, void* user, uint32_t timeoutMs) {
+    if (end <= begin) return true;
+
+    bool expected = false;
+    if (participantCount <= 1 || currentParticipant >= 0 ||
+        !callerBusy.compare_exchange_strong(expected, true)) {
+        fn(begin, end, user);
+        return true;
+    }
+
+    ParallelJob job;
+    job.fn = fn;
+    job.user = user;
+    job.grain = grain > 0 ? grain : (end - begin) / (participantCount * 8);
+    if (job.grain < 1) job.grain = 1;
+    job.remaining.store(end - begin);
+    job.cancelled.store(false);
+
+    // Publish the job before its first range so a thief never holds a range without it
+    currentParticipant = 0;
+    activeJob.store(&job, std::memory_order_release);
+    participants[0].deque.push(begin, end);
+    for (int i = 1; i < participantCount; i++) wakeWorker(i);
+
+    uint32_t start = nowUs();
+    bool timedOut = false;
+    while (job.remaining.load(std::memory_order_acquire) > 0) {
+        int32_t lo, hi;
+        if (takeRange(0, lo, hi)) {
+            runRange(0, &job, lo, hi);
+        } else {
+            relax();
+        }
+        if (!timedOut && timeoutMs != TASK_POOL_FOREVER && nowUs() - start >= timeoutMs * 1000UL) {
+            // Drop what has not started; pieces still queued drain without running
+            timedOut = true;
+            job.cancelled.store(true);
+        }
+    }
+
+    activeJob.store(nullptr, std::memory_order_release);
+    currentParticipant = -1;
+    callerBusy.store(false);
+    return !timedOut;
+}
+
+TaskPoolStats taskPoolStats(int participant) {
+    TaskPoolStats s = {0, 0, 0, 0};
+    if (participant < 0 || participant >= participantCount) return s;
+    const Participant& p = participants[participant];
+    s.busyUs = p.busyUs.load(std::memory_order_relaxed);
+    s.ranges = p.ranges.load(std::memory_order_relaxed);
+    s.items = p.items.load(std::memory_order_relaxed);
+    s.steals = p.steals.load(std::memory_order_relaxed);
+    return s;
+}
+
+void taskPoolResetStats() {
+    for (int i = 0; i < TASK_POOL_MAX_PARTICIPANTS; i++) {
+        Participant& p = participants[i];
+        p.busyUs.store(0);
+        p.ranges.store(0);
+        p.items.store(0);
+        p.steals.store(0);
+    }
+    statsResetUs = nowUs();
+}
+
+uint32_t taskPoolElapsedUs() {
+    return nowUs() - statsResetUs;
+}
+
+float taskPoolUtilisation(int participant) {
+    uint32_t elapsed = taskPoolElapsedUs();
+    if (elapsed == 0) return 0;
+    return (float)taskPoolStats(participant).busyUs / elapsed;
+}
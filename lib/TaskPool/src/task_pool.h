@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stdint.h>
+#include <type_traits>
+
+// Work-stealing parallel_for for the dual-core ESP32-P4.
+//
+// taskPoolBegin() starts one worker task per core other than the caller's,
+// pinned to that core. The task that calls parallelFor() (normally the Arduino
+// loop task) takes part as participant 0, so on the P4 the loop runs one half
+// of the range on core 1 while the worker runs the other half on core 0.
+//
+// Ranges are split lazily: a participant that holds a range larger than the
+// grain pushes its upper half onto its own deque and keeps the lower half. Idle
+// participants steal the oldest (largest) half from someone else's deque. Rows
+// that cost very different amounts (fractal interiors, ripples) still finish
+// together without having to pick a chunk size up front.
+//
+// On the host the same scheduler runs on std::thread (not pinned), so it can be
+// stress-tested under Linux; see m5tab5/task_pool_stress.
+//
+// The body runs on several cores at once. It must only write memory that
+// belongs to its own part of the range (rows of a pixel buffer, say) and must
+// not call into M5.Display, Serial, random() or anything else with shared
+// state; push the finished buffer from the calling task afterwards.
+
+const uint32_t TASK_POOL_FOREVER = 0xFFFFFFFF;
+const int TASK_POOL_MAX_PARTICIPANTS = 8;
+
+// Starts the workers. workers < 0 means one per core other than the caller's
+// (one on the P4; hardware threads - 1 on the host). Returns false if a worker
+// could not be created; the pool then runs with the ones that were.
+bool taskPoolBegin(int workers = -1);
+void taskPoolEnd();
+
+// Number of participants, including the caller; 1 before taskPoolBegin()
+int taskPoolParticipants();
+
+// Calls fn(lo, hi, user) over disjoint sub-ranges that together cover
+// begin..end - 1. Ranges of grain items or fewer are not split further; a grain
+// of 0 picks one that gives each participant about eight pieces.
+//
+// Returns true once every item has run. If timeoutMs passes first, pieces that
+// have not started are dropped, the call waits for the ones already running
+// and returns false (so fn and user may safely go out of scope either way).
+//
+// Called from inside a body, or from a second task while another call is in
+// flight, the range simply runs serially on the calling task.
+typedef void (*ParallelRangeFn)(int lo, int hi, void* user);
+bool parallelFor(int begin, int end, int grain, ParallelRangeFn fn, void* user,
+                 uint32_t timeoutMs = TASK_POOL_FOREVER);
+
+// Same with a lambda: parallelFor(0, height, 4, [&](int lo, int hi) { ... });
+template <typename Body>
+bool parallelFor(int begin, int end, int grain, Body&& body, uint32_t timeoutMs = TASK_POOL_FOREVER) {
+    typedef typename std::remove_reference<Body>::type Fn;
+    return parallelFor(begin, end, grain,
+                       [](int lo, int hi, void* user) { (*(Fn*)user)(lo, hi); },
+                       (void*)&body, timeoutMs);
+}
+
+// Per-participant counters since the last taskPoolResetStats(). Microsecond
+// counters are 32 bit, so reset at least once an hour.
+struct TaskPoolStats {
+    uint32_t busyUs;     // time spent inside bodies
+    uint32_t ranges;     // bodies run
+    uint32_t items;      // items covered by those bodies
+    uint32_t steals;     // ranges taken from another participant's deque
+};
+
+TaskPoolStats taskPoolStats(int participant);
+void taskPoolResetStats();
+uint32_t taskPoolElapsedUs();               // since the last reset
+float taskPoolUtilisation(int participant); // busyUs / elapsed, 0..1
@@ -0,0 +1,407 @@
+#include "telemetry.h"
+
+#include <atomic>
+
+#ifdef ESP_PLATFORM
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#else
+#include <mutex>
+#endif
+
+#ifndef TELEMETRY_BLOCK_BYTES
+#define TELEMETRY_BLOCK_BYTES 4096
+#endif
+
+#ifndef TELEMETRY_BLOCKS
+#define TELEMETRY_BLOCKS 8
+#endif
+
+#ifndef TELEMETRY_STACK_SIZE
+#define TELEMETRY_STACK_SIZE 4096
+#endif
+
+// A partly filled block goes out after this long
+#ifndef TELEMETRY_FLUSH_MS
+#define TELEMETRY_FLUSH_MS 5
+#endif
+
+static_assert(TELEMETRY_BLOCK_BYTES >= TELEMETRY_MAX_ENCODED + 1, "a block must hold the largest frame");
+
+// Blocks form a ring: queuedBlocks full ones starting at sendBlock, then the
+// one being filled. Producers append under blockLock; the block at sendBlock
+// belongs to whoever holds `sending` until it is written out.
+
+alignas(4) static uint8_t blockData[TELEMETRY_BLOCKS][TELEMETRY_BLOCK_BYTES];
+static uint32_t blockLength[TELEMETRY_BLOCKS];
+static int sendBlock = 0;
+static int queuedBlocks = 0;
+static uint32_t fillStartedMs = 0;
+static std::atomic_flag sending = ATOMIC_FLAG_INIT;
+
+#ifdef ESP_PLATFORM
+static portMUX_TYPE blockLock = portMUX_INITIALIZER_UNLOCKED;
+#define LOCK_BLOCKS() portENTER_CRITICAL(&blockLock)
+#define UNLOCK_BLOCKS() portEXIT_CRITICAL(&blockLock)
+static TaskHandle_t senderTask = nullptr;
+#else
+static std::mutex blockLock;
+#define LOCK_BLOCKS() blockLock.lock()
+#define UNLOCK_BLOCKS() blockLock.unlock()
+#endif
+
+static std::atomic<uint8_t> enabledMask(0);
+static std::atomic<bool> leased(false);
+static std::atomic<uint32_t> leaseRenewedMs(0);
+
+static std::atomic<uint16_t> sequence[TELEM_CHANNEL_COUNT];
+static std::atomic<uint32_t> framesQueued(0);
+static std::atomic<uint32_t> bytesSent(0);
+static std::atomic<uint32_t> dropped[TELEM_CHANNEL_COUNT];
+static int maxBlocksQueued = 0;
+
+static bool started = false;
+
+// Codec
+
+// Built during static initialisation, before any task can send
+struct CrcTable {
+    uint16_t entries[256];
+    CrcTable() {
+        for (int i = 0; i < 256; i++) {
+            uint16_t c = i << 8;
+            for (int bit = 0; bit < 8; bit++) c = (c & 0x8000) ? (c << 1) ^ 0x1021 : c << 1;
+            entries[i] = c;
+        }
+    }
+};
+static const CrcTable crcTable;
+
+uint16_t telemetryCrc16(const uint8_t* data, size_t length, uint16_t crc) {
+    for (size_t i = 0; i < length; i++) crc = (crc << 8) ^ crcTable.entries[(crc >> 8) ^ data[i]];
+    return crc;
+}
+
+size_t telemetryCobsEncode(const uint8_t* in, size_t length, uint8_t* out) {
+    size_t codePos = 0;
+    size_t outPos = 1;
+    uint8_t code = 1;
+    for (size_t i = 0; i < length; i++) {
+        if (in[i] != 0) {
+            out[outPos++] = in[i];
+            code++;
+        }
+        if (in[i] == 0 || code == 0xFF) {
+            out[codePos] = code;
+            codePos = outPos++;
+            code = 1;
+        }
+    }
+    out[codePos] = code;
+    return outPos;
+}
+
+size_t telemetryCobsDecode(const uint8_t* in, size_t length, uint8_t* out, size_t cap) {
+    size_t inPos = 0;
+    size_t outPos = 0;
+    while (inPos < length) {
+        uint8_t code = in[inPos++];
+        if (code == 0 || inPos + code - 1 > length) return 0;
+        if (outPos + code - 1 > cap) return 0;
+        for (int i = 1; i < code; i++) {
+            if (in[inPos] == 0) return 0;
+            out[outPos++] = in[inPos++];
+        }
+        if (code != 0xFF && inPos < length) {
+            if (outPos >= cap) return 0;
+            out[outPos++] = 0;
+        }
+    }
+    return outPos;
+}
+
+size_t telemetryEncodeFrame(uint8_t* out, uint8_t channel, uint16_t seq, uint32_t us, const void* payload,
+                            size_t length) {
+    if (length > (size_t)TELEMETRY_MAX_PAYLOAD) length = TELEMETRY_MAX_PAYLOAD;
+    uint8_t frame[TELEMETRY_MAX_FRAME];
+    frame[0] = channel;
+    memcpy(frame + 1, &seq, 2);
+    memcpy(frame + 3, &us, 4);
+    memcpy(frame + TELEMETRY_HEADER_BYTES, payload, length);
+    size_t n = TELEMETRY_HEADER_BYTES + length;
+    uint16_t crc = telemetryCrc16(frame, n);
+    memcpy(frame + n, &crc, 2);
+    n += 2;
+
+    size_t encoded = telemetryCobsEncode(frame, n, out);
+    out[encoded++] = 0;
+    return encoded;
+}
+
+// Producer side
+
+bool telemetryWants(TelemetryChannel channel) {
+    if (!(enabledMask.load(std::memory_order_relaxed) & (1 << channel))) return false;
+    return !leased.load(std::memory_order_relaxed) ||
+           millis() - leaseRenewedMs.load(std::memory_order_relaxed) < TELEMETRY_LEASE_MS;
+}
+
+void telemetryEnable(uint8_t mask) {
+    leased.store(false, std::memory_order_relaxed);
+    enabledMask.store(mask, std::memory_order_relaxed);
+}
+
+static void sendQueued(bool partial);
+
+// Appends an encoded frame; false if neither the current block nor a free one has room
+static bool appendFrame(const uint8_t* bytes, size_t length) {
+    bool closed = false;
+    bool appended = false;
+
+    LOCK_BLOCKS();
+    int fill = (sendBlock + queuedBlocks) % TELEMETRY_BLOCKS;
+    if (blockLength[fill] + length > TELEMETRY_BLOCK_BYTES && queuedBlocks + 1 < TELEMETRY_BLOCKS) {
+        queuedBlocks++;
+        if (queuedBlocks > maxBlocksQueued) maxBlocksQueued = queuedBlocks;
+        fill = (fill + 1) % TELEMETRY_BLOCKS;
+        blockLength[fill] = 0;
+        closed = true;
+    }
+    if (blockLength[fill] == 0) {
+        blockData[fill][0] = 0;   // ends whatever text came before the block
+        blockLength[fill] = 1;
+        fillStartedMs = millis();
+    }
+    if (blockLength[fill] + length <= TELEMETRY_BLOCK_BYTES) {
+        memcpy(&blockData[fill][blockLength[fill]], bytes, length);
+        blockLength[fill] += length;
+        appended = true;
+    }
+    UNLOCK_BLOCKS();
+
+    if (closed) {
+#ifdef ESP_PLATFORM
+        if (senderTask) xTaskNotifyGive(senderTask);
+#else
+        sendQueued(false);
+#endif
+    }
+    return appended;
+}
+
+bool telemetrySend(TelemetryChannel channel, const void* payload, size_t length) {
+    if (channel >= TELEM_CHANNEL_COUNT || !telemetryWants(channel)) return false;
+
+    // A dropped frame still uses its number, so the reader sees the gap
+    uint16_t seq = sequence[channel].fetch_add(1, std::memory_order_relaxed);
+    uint8_t encoded[TELEMETRY_MAX_ENCODED];
+    size_t n = telemetryEncodeFrame(encoded, channel, seq, micros(), payload, length);
+    if (!appendFrame(encoded, n)) {
+        dropped[channel].fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    framesQueued.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+bool telemetrySensor(float co2, float temperature, float humidity) {
+    TelemetrySensor reading = {co2, temperature, humidity};
+    return telemetrySend(TELEM_SENSOR, &reading, sizeof(reading));
+}
+
+bool telemetryImu(const TelemetryImu& sample) {
+    return telemetrySend(TELEM_IMU, &sample, sizeof(sample));
+}
+
+bool telemetryAudio(const int16_t* samples, size_t count, uint32_t sampleRate) {
+    if (!telemetryWants(TELEM_AUDIO)) return false;
+    if (count > (size_t)TELEMETRY_AUDIO_MAX_SAMPLES) count = TELEMETRY_AUDIO_MAX_SAMPLES;
+    uint8_t payload[TELEMETRY_MAX_PAYLOAD];
+    TelemetryAudioHeader header = {sampleRate};
+    memcpy(payload, &header, sizeof(header));
+    memcpy(payload + sizeof(header), samples, count * 2);
+    return telemetrySend(TELEM_AUDIO, payload, sizeof(header) + count * 2);
+}
+
+bool telemetryProfile(const char* section, uint32_t durationUs) {
+    if (!telemetryWants(TELEM_PROFILER)) return false;
+    uint8_t payload[sizeof(TelemetryProfile) + 64];
+    TelemetryProfile profile = {durationUs};
+    memcpy(payload, &profile, sizeof(profile));
+    size_t n = 0;
+    while (section[n] && n < sizeof(payload) - sizeof(profile)) {
+        payload[sizeof(profile) + n] = section[n];
+        n++;
+    }
+    return telemetrySend(TELEM_PROFILER, payload, sizeof(profile) + n);
+}
+
+// Sender side
+
+// Writes without blocking: no more than the USB driver has room for. Gives up
+// (and drops the rest) once no channel is wanted any more, since then nobody
+// is reading.
+static void writeBlock(const uint8_t* data, size_t length) {
+    size_t pos = 0;
+    while (pos < length) {
+#ifdef ESP_PLATFORM
+        int room = Serial.availableForWrite();
+        if (room <= 0) {
+            bool anyWanted = false;
+            for (int c = 0; c < TELEM_CHANNEL_COUNT; c++) anyWanted |= telemetryWants((TelemetryChannel)c);
+            if (!anyWanted) return;
+            vTaskDelay(1);
+            continue;
+        }
+        size_t n = length - pos < (size_t)room ? length - pos : (size_t)room;
+#else
+        size_t n = length - pos;
+#endif
+        n = Serial.write(data + pos, n);
+        pos += n;
+        bytesSent.fetch_add(n, std::memory_order_relaxed);
+    }
+}
+
+// Writes out the full blocks, and the partly filled one if partial is set or
+// it has waited TELEMETRY_FLUSH_MS
+static void sendQueued(bool partial) {
+    if (sending.test_and_set(std::memory_order_acquire)) return;   // someone else is at it
+
+    for (;;) {
+        LOCK_BLOCKS();
+        int fill = (sendBlock + queuedBlocks) % TELEMETRY_BLOCKS;
+        if (queuedBlocks == 0 && blockLength[fill] > 1 &&
+            (partial || millis() - fillStartedMs >= TELEMETRY_FLUSH_MS)) {
+            queuedBlocks++;
+            blockLength[(fill + 1) % TELEMETRY_BLOCKS] = 0;
+        }
+        int block = sendBlock;
+        bool any = queuedBlocks > 0;
+        UNLOCK_BLOCKS();
+        if (!any) break;
+
+        writeBlock(blockData[block], blockLength[block]);
+
+        LOCK_BLOCKS();
+        sendBlock = (sendBlock + 1) % TELEMETRY_BLOCKS;
+        queuedBlocks--;
+        UNLOCK_BLOCKS();
+    }
+
+    sending.clear(std::memory_order_release);
+}
+
+void telemetryFlush() {
+    sendQueued(true);
+}
+
+// Commands arrive as frames on TELEM_CONTROL, like everything else
+static void handleCommand(const uint8_t* frame, size_t length) {
+    uint8_t decoded[TELEMETRY_HEADER_BYTES + sizeof(TelemetryCommand) + 2];
+    size_t n = telemetryCobsDecode(frame, length, decoded, sizeof(decoded));
+    if (n != sizeof(decoded) || decoded[0] != TELEM_CONTROL) return;
+    uint16_t crc;
+    memcpy(&crc, decoded + n - 2, 2);
+    if (crc != telemetryCrc16(decoded, n - 2)) return;
+
+    TelemetryCommand command;
+    memcpy(&command, decoded + TELEMETRY_HEADER_BYTES, sizeof(command));
+    if (command.command == TELEMETRY_COMMAND_ENABLE) {
+        leaseRenewedMs.store(millis(), std::memory_order_relaxed);
+        leased.store(true, std::memory_order_relaxed);
+        enabledMask.store(command.mask, std::memory_order_relaxed);
+    }
+}
+
+static void readCommands() {
+    static uint8_t frame[32];
+    static size_t length = 0;
+    while (Serial.available() > 0) {
+        int c = Serial.read();
+        if (c < 0) break;
+        if (c == 0) {
+            if (length > 0 && length <= sizeof(frame)) handleCommand(frame, length);
+            length = 0;
+        } else if (length < sizeof(frame)) {
+            frame[length++] = c;
+        } else {
+            length = sizeof(frame) + 1;   // too long; skip to the next 0x00
+        }
+    }
+}
+
+static void sendStatus() {
+    uint8_t mask = 0;
+    for (int c = 0; c < TELEM_CHANNEL_COUNT; c++) {
+        if (telemetryWants((TelemetryChannel)c)) mask |= 1 << c;
+    }
+    if (!mask) return;
+
+    TelemetryStatus status = {};
+    status.mask = mask;
+    LOCK_BLOCKS();
+    status.blocksQueued = queuedBlocks;
+    UNLOCK_BLOCKS();
+    status.blocksTotal = TELEMETRY_BLOCKS;
+    status.bytesSent = bytesSent.load(std::memory_order_relaxed);
+    for (int c = 0; c < TELEM_CHANNEL_COUNT; c++) status.dropped[c] = dropped[c].load(std::memory_order_relaxed);
+
+    uint16_t seq = sequence[TELEM_CONTROL].fetch_add(1, std::memory_order_relaxed);
+    uint8_t encoded[TELEMETRY_MAX_ENCODED];
+    size_t n = telemetryEncodeFrame(encoded, TELEM_CONTROL, seq, micros(), &status, sizeof(status));
+    if (!appendFrame(encoded, n)) dropped[TELEM_CONTROL].fetch_add(1, std::memory_order_relaxed);
+}
+
+#ifdef ESP_PLATFORM
+static void senderLoop(void*) {
+    uint32_t lastStatusMs = millis();
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(TELEMETRY_FLUSH_MS));
+        readCommands();
+        if (millis() - lastStatusMs >= TELEMETRY_STATUS_INTERVAL_MS) {
+            lastStatusMs = millis();
+            sendStatus();
+        }
+        sendQueued(false);
+    }
+}
+#endif
+
+void telemetryBegin() {
+    if (started) return;
+    started = true;
+#ifdef ESP_PLATFORM
+    // Room for a whole block, so the sender hands it over in one write
+    Serial.setTxBufferSize(TELEMETRY_BLOCK_BYTES);
+    // Above the loop task, which it must not wait behind; it sleeps between blocks
+    xTaskCreate(senderLoop, "telemetry", TELEMETRY_STACK_SIZE, nullptr, 2, &senderTask);
+#else
+    readCommands();
+    sendStatus();
+#endif
+}
+
+TelemetryStats telemetryStats() {
+    TelemetryStats stats;
+    stats.frames = framesQueued.load(std::memory_order_relaxed);
+    stats.bytesSent = bytesSent.load(std::memory_order_relaxed);
+    for (int c = 0; c < TELEM_CHANNEL_COUNT; c++) stats.dropped[c] = dropped[c].load(std::memory_order_relaxed);
+    LOCK_BLOCKS();
+    stats.maxBlocksQueued = maxBlocksQueued;
+    UNLOCK_BLOCKS();
+    stats.mask = 0;
+    for (int c = 0; c < TELEM_CHANNEL_COUNT; c++) {
+        if (telemetryWants((TelemetryChannel)c)) stats.mask |= 1 << c;
+    }
+    return stats;
+}
+
+void printTelemetryStats(Print& out) {
+    TelemetryStats stats = telemetryStats();
+    out.printf("telemetry: mask %02x, %u frames, %u bytes sent, %d of %d blocks queued at most, dropped",
+               stats.mask, (unsigned)stats.frames, (unsigned)stats.bytesSent, stats.maxBlocksQueued,
+               TELEMETRY_BLOCKS);
+    for (int c = 0; c < TELEM_CHANNEL_COUNT; c++) out.printf(" %u", (unsigned)stats.dropped[c]);
+    out.printf("\n");
+}
@@ -0,0 +1,148 @@
+#pragma once
+
+// Binary telemetry over the USB serial port, for data too fast for text.
+//
+//   telemetryBegin();                                  // once, after Serial.begin()
+//   if (telemetryWants(TELEM_IMU)) telemetryImu(sample);
+//
+// Each record is one frame on a channel: sensor readings, IMU samples, audio
+// blocks, profiler timings. Frames carry a per-channel sequence number and a
+// micros() timestamp, are protected by a CRC-16 and COBS-encoded, so a 0x00
+// byte always ends a frame and a reader that starts mid-stream or loses bytes
+// resynchronises at the next one.
+//
+// telemetrySend() encodes the frame on the calling task and copies it into
+// the block being filled. A sender task writes whole blocks of
+// TELEMETRY_BLOCK_BYTES to Serial, one write per block, and only as much as
+// the USB driver will take without blocking. Each block starts with 0x00, so
+// ordinary Serial text between blocks stays outside of any frame.
+//
+// Flow control:
+//   - Nothing is sent until a reader asks. The reader (tools/telemetry_csv)
+//     sends a channel mask and repeats it every second; the mask lapses after
+//     TELEMETRY_LEASE_MS without one, so a closed reader stops the stream and
+//     a plain serial monitor never sees binary.
+//   - A producer never waits. A frame that finds no free block is dropped and
+//     counted per channel; the counts go out once a second on TELEM_CONTROL
+//     and the reader also sees the gap in the sequence numbers.
+//   - telemetryWants() lets a producer skip sampling for a channel nobody
+//     reads.
+//
+// Wire format (all little endian). Device to host, repeated per block:
+//   0x00, then per frame: COBS(channel u8, seq u16, micros u32, payload, CRC) 0x00
+// CRC-16/CCITT-FALSE over channel..payload. Host to device, the same framing
+// on TELEM_CONTROL with a TelemetryCommand payload.
+//
+// On the host (no ESP_PLATFORM) there is no sender task: a full block is
+// written out at once, and telemetryFlush() writes the partial one.
+
+#include <Arduino.h>
+
+enum TelemetryChannel : uint8_t {
+    TELEM_CONTROL = 0,   // status from the board, commands from the reader
+    TELEM_SENSOR,
+    TELEM_IMU,
+    TELEM_AUDIO,
+    TELEM_PROFILER,
+    TELEM_CHANNEL_COUNT
+};
+
+const int TELEMETRY_HEADER_BYTES = 7;
+const int TELEMETRY_MAX_PAYLOAD = 1024;
+const int TELEMETRY_MAX_FRAME = TELEMETRY_HEADER_BYTES + TELEMETRY_MAX_PAYLOAD + 2;
+// COBS adds a byte per 254 and the frame ends with 0x00
+const int TELEMETRY_MAX_ENCODED = TELEMETRY_MAX_FRAME + TELEMETRY_MAX_FRAME / 254 + 2;
+const uint32_t TELEMETRY_LEASE_MS = 3000;
+const uint32_t TELEMETRY_STATUS_INTERVAL_MS = 1000;
+
+// Payloads
+
+struct __attribute__((packed)) TelemetrySensor {
+    float co2;            // ppm
+    float temperature;    // degrees C
+    float humidity;       // %RH
+};
+
+struct __attribute__((packed)) TelemetryImu {
+    float ax, ay, az;     // g
+    float gx, gy, gz;     // degrees/s
+};
+
+// Followed by int16_t samples, as many as fit in TELEMETRY_MAX_PAYLOAD
+struct __attribute__((packed)) TelemetryAudioHeader {
+    uint32_t sampleRate;
+};
+const int TELEMETRY_AUDIO_MAX_SAMPLES = (TELEMETRY_MAX_PAYLOAD - sizeof(TelemetryAudioHeader)) / 2;
+
+// Followed by the section name, without a terminator
+struct __attribute__((packed)) TelemetryProfile {
+    uint32_t durationUs;
+};
+
+// Sent by the board on TELEM_CONTROL every TELEMETRY_STATUS_INTERVAL_MS while
+// any channel is on
+struct __attribute__((packed)) TelemetryStatus {
+    uint8_t mask;                               // bit per TelemetryChannel
+    uint8_t blocksQueued;
+    uint8_t blocksTotal;
+    uint8_t reserved;
+    uint32_t bytesSent;
+    uint32_t dropped[TELEM_CHANNEL_COUNT];      // frames, since boot
+};
+
+// Sent by the reader on TELEM_CONTROL
+const uint8_t TELEMETRY_COMMAND_ENABLE = 'E';
+struct __attribute__((packed)) TelemetryCommand {
+    uint8_t command;
+    uint8_t mask;
+};
+
+// Board side
+
+// Starts the sender task and enlarges Serial's transmit buffer to a block
+void telemetryBegin();
+
+// True while the reader has this channel on
+bool telemetryWants(TelemetryChannel channel);
+
+// Turns channels on without a reader, with no lease (0 turns them off)
+void telemetryEnable(uint8_t mask);
+
+// Queues one frame; false if the channel is off or no block was free.
+// Payloads longer than TELEMETRY_MAX_PAYLOAD are cut.
+bool telemetrySend(TelemetryChannel channel, const void* payload, size_t length);
+
+bool telemetrySensor(float co2, float temperature, float humidity);
+bool telemetryImu(const TelemetryImu& sample);
+bool telemetryAudio(const int16_t* samples, size_t count, uint32_t sampleRate);
+bool telemetryProfile(const char* section, uint32_t durationUs);
+
+// Writes out everything queued, on the calling task
+void telemetryFlush();
+
+struct TelemetryStats {
+    uint32_t frames;
+    uint32_t bytesSent;
+    uint32_t dropped[TELEM_CHANNEL_COUNT];
+    int maxBlocksQueued;
+    uint8_t mask;
+};
+TelemetryStats telemetryStats();
+void printTelemetryStats(Print& out);
+
+// Codec, shared with the reader
+
+uint16_t telemetryCrc16(const uint8_t* data, size_t length, uint16_t crc = 0xFFFF);
+
+// Encodes length bytes into out (at least length + length / 254 + 1 bytes);
+// returns the encoded length, without the trailing 0x00
+size_t telemetryCobsEncode(const uint8_t* in, size_t length, uint8_t* out);
+
+// Decodes one frame (without its 0x00); returns the decoded length, or 0 if
+// it is malformed or longer than cap
+size_t telemetryCobsDecode(const uint8_t* in, size_t length, uint8_t* out, size_t cap);
+
+// Builds a complete frame (header, payload, CRC, COBS, 0x00) in out, which
+// holds TELEMETRY_MAX_ENCODED bytes; returns its length
+size_t telemetryEncodeFrame(uint8_t* out, uint8_t channel, uint16_t seq, uint32_t us, const void* payload,
+                            size_t length);
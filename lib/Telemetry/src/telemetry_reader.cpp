@@ -0,0 +1,95 @@
+#include "telemetry_reader.h"
+
+TelemetryReader::TelemetryReader(FrameHandler onFrame, TextHandler onText, void* user)
+    : _onFrame(onFrame), _onText(onText), _user(user) {}
+
+void TelemetryReader::feed(const uint8_t* data, size_t length) {
+    bytes += length;
+    size_t start = 0;
+    for (size_t i = 0; i < length; i++) {
+        if (data[i] != 0) continue;
+        // Common case: the whole piece is in this chunk and nothing is pending
+        if (_pendingLength == 0 && !_overlong) {
+            piece(data + start, i - start);
+        } else {
+            size_t n = i - start;
+            if (!_overlong && _pendingLength + n <= sizeof(_pending)) {
+                memcpy(_pending + _pendingLength, data + start, n);
+                _pendingLength += n;
+                piece(_pending, _pendingLength);
+            } else {
+                if (_onText) _onText(_pending, _pendingLength, _user);   // a long line of text
+                if (_onText && n) _onText(data + start, n, _user);
+            }
+            _pendingLength = 0;
+            _overlong = false;
+        }
+        start = i + 1;
+    }
+
+    size_t rest = length - start;
+    if (!rest) return;
+    if (!_overlong && _pendingLength + rest <= sizeof(_pending)) {
+        memcpy(_pending + _pendingLength, data + start, rest);
+        _pendingLength += rest;
+        return;
+    }
+    // Longer than any frame: text, hand it on as it comes
+    if (_onText) {
+        _onText(_pending, _pendingLength, _user);
+        _onText(data + start, rest, _user);
+    }
+    _pendingLength = 0;
+    _overlong = true;
+}
+
+static bool printable(const uint8_t* data, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        uint8_t c = data[i];
+        if (c < 0x20 && c != '\r' && c != '\n' && c != '\t') return false;
+        if (c == 0x7F) return false;
+    }
+    return true;
+}
+
+void TelemetryReader::piece(const uint8_t* data, size_t length) {
+    if (length == 0) return;   // the 0x00 that starts a block
+
+    uint8_t frame[TELEMETRY_MAX_FRAME];
+    size_t n = telemetryCobsDecode(data, length, frame, sizeof(frame));
+    bool valid = n >= (size_t)TELEMETRY_HEADER_BYTES + 2 && frame[0] < TELEM_CHANNEL_COUNT;
+    if (valid) {
+        uint16_t crc;
+        memcpy(&crc, frame + n - 2, 2);
+        valid = crc == telemetryCrc16(frame, n - 2);
+    }
+    if (!valid) {
+        if (printable(data, length)) {
+            if (_onText) _onText(data, length, _user);
+        } else {
+            corrupt++;
+        }
+        return;
+    }
+
+    TelemetryFrame f;
+    f.channel = frame[0];
+    memcpy(&f.seq, frame + 1, 2);
+    memcpy(&f.micros, frame + 3, 4);
+    f.payload = frame + TELEMETRY_HEADER_BYTES;
+    f.length = n - TELEMETRY_HEADER_BYTES - 2;
+
+    if (_seen[f.channel]) lost[f.channel] += (uint16_t)(f.seq - _nextSeq[f.channel]);
+    _seen[f.channel] = true;
+    _nextSeq[f.channel] = f.seq + 1;
+    frames[f.channel]++;
+
+    if (_onFrame) _onFrame(f, _user);
+}
+
+size_t telemetryEnableCommand(uint8_t* out, uint8_t mask) {
+    TelemetryCommand command = {TELEMETRY_COMMAND_ENABLE, mask};
+    size_t n = telemetryEncodeFrame(out + 1, TELEM_CONTROL, 0, 0, &command, sizeof(command));
+    out[0] = 0;   // ends any partial frame the board has buffered
+    return n + 1;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+// Reader side of lib/Telemetry, for host tools (see tools/telemetry_csv).
+//
+//   TelemetryReader reader(onFrame, onText, nullptr);
+//   reader.feed(buffer, n);          // any chunking, straight from read()
+//
+// Splits the stream at 0x00, decodes each piece as a frame and checks its
+// CRC. A piece that is not a frame is Serial text when it is printable (the
+// board's own println output between blocks) and goes to onText; anything
+// else is counted as corrupt. Sequence numbers are tracked per channel, so
+// frames dropped on the board or lost on the way show up in lost[].
+
+#include "telemetry.h"
+
+struct TelemetryFrame {
+    uint8_t channel;
+    uint16_t seq;
+    uint32_t micros;
+    const uint8_t* payload;
+    size_t length;
+};
+
+class TelemetryReader {
+public:
+    typedef void (*FrameHandler)(const TelemetryFrame& frame, void* user);
+    typedef void (*TextHandler)(const uint8_t* text, size_t length, void* user);
+
+    TelemetryReader(FrameHandler onFrame, TextHandler onText, void* user);
+
+    void feed(const uint8_t* bytes, size_t length);
+
+    uint64_t bytes = 0;
+    uint32_t frames[TELEM_CHANNEL_COUNT] = {};
+    uint32_t lost[TELEM_CHANNEL_COUNT] = {};    // gaps in the sequence numbers
+    uint32_t corrupt = 0;                       // pieces that were neither frames nor text
+
+private:
+    void piece(const uint8_t* data, size_t length);
+
+    FrameHandler _onFrame;
+    TextHandler _onText;
+    void* _user;
+    uint8_t _pending[TELEMETRY_MAX_ENCODED];
+    size_t _pendingLength = 0;
+    bool _overlong = false;
+    bool _seen[TELEM_CHANNEL_COUNT] = {};
+    uint16_t _nextSeq[TELEM_CHANNEL_COUNT] = {};
+};
+
+// Builds the command that turns the given channels on for TELEMETRY_LEASE_MS;
+// send it every second. Returns its length (out holds 32 bytes).
+size_t telemetryEnableCommand(uint8_t* out, uint8_t mask);
@@ -0,0 +1,638 @@
+#include "tls_client.h"
+
+#include <json_escape.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <string.h>
+
+#ifdef ESP_PLATFORM
+#include <Preferences.h>
+#include <esp_attr.h>
+#include <mbedtls/ctr_drbg.h>
+#include <mbedtls/entropy.h>
+#include <mbedtls/net_sockets.h>
+#include <mbedtls/ssl.h>
+#include <mbedtls/version.h>
+#include <mbedtls/x509_crt.h>
+#else
+#include <arpa/inet.h>
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+#include <openssl/x509v3.h>
+#define RTC_NOINIT_ATTR
+#endif
+
+static const uint32_t CACHE_MAGIC = 0x7150CA5E;
+
+struct KeptSession {
+    uint32_t peer;          // hash of the server name and port
+    uint16_t length;        // 0: none
+    uint8_t data[TLS_SESSION_BYTES];
+};
+
+struct RtcState {
+    uint32_t magic;
+    KeptSession session;
+    TlsStats stats;
+    uint32_t checksum;
+};
+
+RTC_NOINIT_ATTR static RtcState rtc;
+static bool loaded = false;
+
+static uint32_t fnv(const void* data, size_t length, uint32_t hash = 2166136261u) {
+    const uint8_t* p = (const uint8_t*)data;
+    for (size_t i = 0; i < length; i++) hash = (hash ^ p[i]) * 16777619u;
+    return hash;
+}
+
+static void seal() {
+    rtc.checksum = fnv(&rtc, offsetof(RtcState, checksum));
+}
+
+static bool rtcValid() {
+    return rtc.magic == CACHE_MAGIC && rtc.checksum == fnv(&rtc, offsetof(RtcState, checksum));
+}
+
+// NVS holds the session only; counters stay in RTC memory so a connect does
+// not write flash
+static void loadNvs() {
+#ifdef ESP_PLATFORM
+    Preferences prefs;
+    if (!prefs.begin("tlssession", true)) return;
+    KeptSession session;
+    size_t n = prefs.getBytes("session", &session, sizeof(session));
+    if (n >= offsetof(KeptSession, data) && session.length <= sizeof(session.data) &&
+        n == offsetof(KeptSession, data) + session.length) {
+        memcpy(&rtc.session, &session, n);
+    }
+    prefs.end();
+#endif
+}
+
+static void saveNvs() {
+#ifdef ESP_PLATFORM
+    Preferences prefs;
+    if (!prefs.begin("tlssession", false)) return;
+    if (rtc.session.length) {
+        prefs.putBytes("session", &rtc.session, offsetof(KeptSession, data) + rtc.session.length);
+    } else {
+        prefs.remove("session");
+    }
+    prefs.end();
+#endif
+}
+
+static void loadCache() {
+    if (loaded) return;
+    loaded = true;
+    if (!rtcValid()) {
+        memset(&rtc, 0, sizeof(rtc));
+        rtc.magic = CACHE_MAGIC;
+        loadNvs();
+        seal();
+    }
+}
+
+#ifdef ESP_PLATFORM
+
+// mbedTLS (2.28 on the CoreInk and Paper cores, 3.x on the Tab5's), reading
+// and writing through the transport
+struct TlsBackend {
+    mbedtls_ssl_context ssl;
+    mbedtls_ssl_config conf;
+    mbedtls_entropy_context entropy;
+    mbedtls_ctr_drbg_context drbg;
+    mbedtls_x509_crt ca;
+    bool verified = false;  // a certificate was checked: a full handshake
+    bool closed = false;
+
+    static int send(void* context, const unsigned char* buf, size_t length) {
+        TlsClient& c = *(TlsClient*)context;
+        if (!c._transport.connected()) return MBEDTLS_ERR_NET_CONN_RESET;
+        size_t n = c.transportWrite(buf, length);
+        return n ? (int)n : MBEDTLS_ERR_SSL_WANT_WRITE;
+    }
+
+    static int receive(void* context, unsigned char* buf, size_t length) {
+        TlsClient& c = *(TlsClient*)context;
+        int available = c._transport.available();
+        if (available <= 0) return c._transport.connected() ? MBEDTLS_ERR_SSL_WANT_READ : MBEDTLS_ERR_NET_CONN_RESET;
+        int n = c.transportRead(buf, length < (size_t)available ? length : (size_t)available);
+        return n > 0 ? n : MBEDTLS_ERR_SSL_WANT_READ;
+    }
+
+    static int verify(void* context, mbedtls_x509_crt* crt, int depth, uint32_t* flags) {
+        (void)crt;
+        (void)depth;
+        (void)flags;
+        ((TlsBackend*)context)->verified = true;
+        return 0;
+    }
+
+    static TlsBackend* open(TlsClient& c, const char* name) {
+        static const int suites[] = {
+            MBEDTLS_TLS_ECDHE_ECDSA_WITH_AES_128_GCM_SHA256,
+            MBEDTLS_TLS_ECDHE_ECDSA_WITH_CHACHA20_POLY1305_SHA256,
+            MBEDTLS_TLS_ECDHE_RSA_WITH_AES_128_GCM_SHA256,
+            0,
+        };
+        TlsBackend* b = new TlsBackend;
+        mbedtls_ssl_init(&b->ssl);
+        mbedtls_ssl_config_init(&b->conf);
+        mbedtls_entropy_init(&b->entropy);
+        mbedtls_ctr_drbg_init(&b->drbg);
+        mbedtls_x509_crt_init(&b->ca);
+
+        const char* error = nullptr;
+        if (mbedtls_ctr_drbg_seed(&b->drbg, mbedtls_entropy_func, &b->entropy, (const unsigned char*)"m5env", 5) != 0) {
+            error = "no random numbers";
+        } else if (mbedtls_x509_crt_parse(&b->ca, (const unsigned char*)c._caCert, strlen(c._caCert) + 1) != 0) {
+            error = "CA certificate unreadable";
+        } else if (mbedtls_ssl_config_defaults(&b->conf, MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_STREAM,
+                                               MBEDTLS_SSL_PRESET_DEFAULT) != 0) {
+            error = "TLS setup";
+        }
+        if (!error) {
+            mbedtls_ssl_conf_authmode(&b->conf, MBEDTLS_SSL_VERIFY_REQUIRED);
+            mbedtls_ssl_conf_ca_chain(&b->conf, &b->ca, nullptr);
+            mbedtls_ssl_conf_rng(&b->conf, mbedtls_ctr_drbg_random, &b->drbg);
+            mbedtls_ssl_conf_verify(&b->conf, verify, b);
+            mbedtls_ssl_conf_ciphersuites(&b->conf, suites);
+#if MBEDTLS_VERSION_NUMBER >= 0x03000000
+            static const uint16_t groups[] = {MBEDTLS_SSL_IANA_TLS_GROUP_SECP256R1, MBEDTLS_SSL_IANA_TLS_GROUP_NONE};
+            mbedtls_ssl_conf_max_tls_version(&b->conf, MBEDTLS_SSL_VERSION_TLS1_2);
+            mbedtls_ssl_conf_groups(&b->conf, groups);
+#else
+            static const mbedtls_ecp_group_id curves[] = {MBEDTLS_ECP_DP_SECP256R1, MBEDTLS_ECP_DP_NONE};
+            mbedtls_ssl_conf_max_version(&b->conf, MBEDTLS_SSL_MAJOR_VERSION_3, MBEDTLS_SSL_MINOR_VERSION_3);
+            mbedtls_ssl_conf_curves(&b->conf, curves);
+#endif
+#if defined(MBEDTLS_SSL_SESSION_TICKETS)
+            mbedtls_ssl_conf_session_tickets(&b->conf, MBEDTLS_SSL_SESSION_TICKETS_ENABLED);
+#endif
+            if (mbedtls_ssl_setup(&b->ssl, &b->conf) != 0 || mbedtls_ssl_set_hostname(&b->ssl, name) != 0) {
+                error = "TLS setup";
+            }
+        }
+        if (error) {
+            destroy(b);
+            c.fail("%s", error);
+            return nullptr;
+        }
+        mbedtls_ssl_set_bio(&b->ssl, &c, send, receive, nullptr);
+        return b;
+    }
+
+    static bool offer(TlsBackend* b, const uint8_t* data, size_t length) {
+        mbedtls_ssl_session session;
+        mbedtls_ssl_session_init(&session);
+        bool ok = mbedtls_ssl_session_load(&session, data, length) == 0 && mbedtls_ssl_set_session(&b->ssl, &session) == 0;
+        mbedtls_ssl_session_free(&session);
+        return ok;
+    }
+
+    // 1 done, 0 waiting for the broker, -1 failed (the client's error says why)
+    static int handshake(TlsClient& c, const char* name) {
+        TlsBackend* b = c._backend;
+        int r = mbedtls_ssl_handshake(&b->ssl);
+        if (r == 0) return 1;
+        if (r == MBEDTLS_ERR_SSL_WANT_READ || r == MBEDTLS_ERR_SSL_WANT_WRITE) return 0;
+        uint32_t flags = mbedtls_ssl_get_verify_result(&b->ssl);
+        if (r == MBEDTLS_ERR_X509_CERT_VERIFY_FAILED && (flags & MBEDTLS_X509_BADCERT_CN_MISMATCH)) {
+            c.fail("certificate is not for %s", name);
+        } else if (r == MBEDTLS_ERR_X509_CERT_VERIFY_FAILED && (flags & MBEDTLS_X509_BADCERT_NOT_TRUSTED)) {
+            c.fail("certificate not signed by the CA");
+        } else if (r == MBEDTLS_ERR_X509_CERT_VERIFY_FAILED) {
+            c.fail("certificate rejected (0x%lx)", (unsigned long)flags);
+        } else if (r == MBEDTLS_ERR_NET_CONN_RESET) {
+            c.fail("closed by the broker");
+        } else {
+            c.fail("handshake error -0x%04x", -r);
+        }
+        return -1;
+    }
+
+    static bool resumed(TlsBackend* b) {
+        return !b->verified;
+    }
+
+    static size_t save(TlsBackend* b, uint8_t* out, size_t size) {
+        mbedtls_ssl_session session;
+        mbedtls_ssl_session_init(&session);
+        size_t n = 0;
+        if (mbedtls_ssl_get_session(&b->ssl, &session) != 0 || mbedtls_ssl_session_save(&session, out, size, &n) != 0) n = 0;
+        mbedtls_ssl_session_free(&session);
+        return n;
+    }
+
+    // Bytes read, 0 for none yet, -1 once the connection is closed
+    static int read(TlsClient& c, uint8_t* buf, size_t size) {
+        TlsBackend* b = c._backend;
+        int r = mbedtls_ssl_read(&b->ssl, buf, size);
+        if (r > 0) return r;
+        if (r == MBEDTLS_ERR_SSL_WANT_READ || r == MBEDTLS_ERR_SSL_WANT_WRITE) return 0;
+        b->closed = true;
+        return -1;
+    }
+
+    static size_t write(TlsClient& c, const uint8_t* buf, size_t size) {
+        TlsBackend* b = c._backend;
+        size_t sent = 0;
+        uint32_t start = millis();
+        while (sent < size && !b->closed) {
+            int r = mbedtls_ssl_write(&b->ssl, buf + sent, size - sent);
+            if (r > 0) {
+                sent += r;
+            } else if ((r == MBEDTLS_ERR_SSL_WANT_WRITE || r == MBEDTLS_ERR_SSL_WANT_READ) &&
+                       millis() - start < TLS_HANDSHAKE_TIMEOUT_MS) {
+                delay(1);
+            } else {
+                b->closed = true;
+            }
+        }
+        return sent;
+    }
+
+    static void close(TlsClient& c) {
+        TlsBackend* b = c._backend;
+        if (!b->closed) mbedtls_ssl_close_notify(&b->ssl);
+        destroy(b);
+    }
+
+    static void destroy(TlsBackend* b) {
+        mbedtls_ssl_free(&b->ssl);
+        mbedtls_ssl_config_free(&b->conf);
+        mbedtls_ctr_drbg_free(&b->drbg);
+        mbedtls_entropy_free(&b->entropy);
+        mbedtls_x509_crt_free(&b->ca);
+        delete b;
+    }
+};
+
+#else
+
+// OpenSSL with memory BIOs: records go through the transport like on the
+// device
+struct TlsBackend {
+    SSL_CTX* ctx = nullptr;
+    SSL* ssl = nullptr;
+    BIO* in = nullptr;      // from the broker, for OpenSSL to read
+    BIO* out = nullptr;     // from OpenSSL, for the broker
+    bool closed = false;
+
+    static void push(TlsClient& c) {
+        uint8_t buf[1024];
+        int n;
+        while ((n = BIO_read(c._backend->out, buf, sizeof(buf))) > 0) c.transportWrite(buf, n);
+    }
+
+    static void pull(TlsClient& c) {
+        uint8_t buf[1024];
+        int available;
+        while ((available = c._transport.available()) > 0) {
+            int n = c.transportRead(buf, available < (int)sizeof(buf) ? available : sizeof(buf));
+            if (n <= 0) break;
+            BIO_write(c._backend->in, buf, n);
+        }
+    }
+
+    static TlsBackend* open(TlsClient& c, const char* name) {
+        TlsBackend* b = new TlsBackend;
+        b->ctx = SSL_CTX_new(TLS_client_method());
+        SSL_CTX_set_min_proto_version(b->ctx, TLS1_2_VERSION);
+        SSL_CTX_set_max_proto_version(b->ctx, TLS1_2_VERSION);
+        SSL_CTX_set_cipher_list(b->ctx, "ECDHE-ECDSA-AES128-GCM-SHA256:ECDHE-ECDSA-CHACHA20-POLY1305:ECDHE-RSA-AES128-GCM-SHA256");
+        SSL_CTX_set1_groups_list(b->ctx, "P-256");
+        SSL_CTX_set_verify(b->ctx, SSL_VERIFY_PEER, nullptr);
+
+        int certificates = 0;
+        BIO* pem = BIO_new_mem_buf(c._caCert, -1);
+        X509* crt;
+        while ((crt = PEM_read_bio_X509(pem, nullptr, nullptr, nullptr)) != nullptr) {
+            if (X509_STORE_add_cert(SSL_CTX_get_cert_store(b->ctx), crt) == 1) certificates++;
+            X509_free(crt);
+        }
+        BIO_free(pem);
+        ERR_clear_error();
+        if (!certificates) {
+            destroy(b);
+            c.fail("CA certificate unreadable");
+            return nullptr;
+        }
+
+        b->ssl = SSL_new(b->ctx);
+        b->in = BIO_new(BIO_s_mem());
+        b->out = BIO_new(BIO_s_mem());
+        SSL_set_bio(b->ssl, b->in, b->out);
+        SSL_set_connect_state(b->ssl);
+        uint8_t address[16];
+        if (inet_pton(AF_INET, name, address) == 1 || inet_pton(AF_INET6, name, address) == 1) {
+            X509_VERIFY_PARAM_set1_ip_asc(SSL_get0_param(b->ssl), name);
+        } else {
+            SSL_set_tlsext_host_name(b->ssl, name);
+            SSL_set1_host(b->ssl, name);
+        }
+        return b;
+    }
+
+    static bool offer(TlsBackend* b, const uint8_t* data, size_t length) {
+        const uint8_t* p = data;
+        SSL_SESSION* session = d2i_SSL_SESSION(nullptr, &p, (long)length);
+        bool ok = session && SSL_set_session(b->ssl, session) == 1;
+        SSL_SESSION_free(session);
+        return ok;
+    }
+
+    static int handshake(TlsClient& c, const char* name) {
+        TlsBackend* b = c._backend;
+        pull(c);
+        int r = SSL_do_handshake(b->ssl);
+        push(c);
+        if (r == 1) return 1;
+        int e = SSL_get_error(b->ssl, r);
+        if (e == SSL_ERROR_WANT_READ && (c._transport.available() > 0 || c._transport.connected())) return 0;
+        long result = SSL_get_verify_result(b->ssl);
+        if (e == SSL_ERROR_WANT_READ) {
+            c.fail("closed by the broker");
+        } else if (result == X509_V_ERR_HOSTNAME_MISMATCH || result == X509_V_ERR_IP_ADDRESS_MISMATCH) {
+            c.fail("certificate is not for %s", name);
+        } else if (result == X509_V_ERR_UNABLE_TO_GET_ISSUER_CERT_LOCALLY || result == X509_V_ERR_DEPTH_ZERO_SELF_SIGNED_CERT ||
+                   result == X509_V_ERR_SELF_SIGNED_CERT_IN_CHAIN) {
+            c.fail("certificate not signed by the CA");
+        } else if (result != X509_V_OK) {
+            c.fail("certificate rejected (%s)", X509_verify_cert_error_string(result));
+        } else {
+            unsigned long code = ERR_get_error();
+            c.fail("handshake error %s", code ? ERR_reason_error_string(code) : "");
+        }
+        ERR_clear_error();
+        return -1;
+    }
+
+    static bool resumed(TlsBackend* b) {
+        return SSL_session_reused(b->ssl) == 1;
+    }
+
+    static size_t save(TlsBackend* b, uint8_t* out, size_t size) {
+        SSL_SESSION* session = SSL_get1_session(b->ssl);
+        if (!session) return 0;
+        int n = i2d_SSL_SESSION(session, nullptr);
+        if (n <= 0 || (size_t)n > size) {
+            n = 0;
+        } else {
+            uint8_t* p = out;
+            i2d_SSL_SESSION(session, &p);
+        }
+        SSL_SESSION_free(session);
+        return n;
+    }
+
+    static int read(TlsClient& c, uint8_t* buf, size_t size) {
+        TlsBackend* b = c._backend;
+        pull(c);
+        int r = SSL_read(b->ssl, buf, (int)size);
+        push(c);
+        if (r > 0) return r;
+        if (SSL_get_error(b->ssl, r) == SSL_ERROR_WANT_READ && (c._transport.available() > 0 || c._transport.connected())) {
+            return 0;
+        }
+        ERR_clear_error();
+        b->closed = true;
+        return -1;
+    }
+
+    // Memory BIOs take any amount, so a write goes out whole or not at all
+    static size_t write(TlsClient& c, const uint8_t* buf, size_t size) {
+        TlsBackend* b = c._backend;
+        int r = SSL_write(b->ssl, buf, (int)size);
+        push(c);
+        if (r > 0) return r;
+        ERR_clear_error();
+        b->closed = true;
+        return 0;
+    }
+
+    static void close(TlsClient& c) {
+        TlsBackend* b = c._backend;
+        if (!b->closed && SSL_is_init_finished(b->ssl)) {
+            SSL_shutdown(b->ssl);
+            push(c);
+        }
+        ERR_clear_error();
+        destroy(b);
+    }
+
+    static void destroy(TlsBackend* b) {
+        SSL_free(b->ssl);   // and its BIOs
+        SSL_CTX_free(b->ctx);
+        delete b;
+    }
+};
+
+#endif
+
+TlsClient::~TlsClient() {
+    if (_backend) {
+        TlsBackend::close(*this);
+        _backend = nullptr;
+    }
+}
+
+int TlsClient::connect(const char* host, uint16_t port) {
+    stop();
+    _secure = _tls;
+    if (!_tls) return _transport.connect(host, port);
+    if (!_caCert || !*_caCert) return fail("no CA certificate");
+    if (!_transport.connect(host, port)) return fail("no connection to %s:%u", host, (unsigned)port);
+
+    loadCache();
+    const char* name = _serverName ? _serverName : host;
+    uint32_t peer = fnv(&port, sizeof(port), fnv(name, strlen(name)));
+    _backend = TlsBackend::open(*this, name);
+    if (!_backend) {
+        _transport.stop();
+        return 0;
+    }
+    KeptSession& kept = rtc.session;
+    bool offered = kept.length && kept.peer == peer && TlsBackend::offer(_backend, kept.data, kept.length);
+
+    _bytesIn = _bytesOut = 0;
+    _counting = true;
+    uint32_t start = millis();
+    int step;
+    while ((step = TlsBackend::handshake(*this, name)) == 0) {
+        if (millis() - start >= TLS_HANDSHAKE_TIMEOUT_MS) {
+            fail("handshake timed out");
+            step = -1;
+            break;
+        }
+        if (_transport.available() <= 0) delay(1);
+    }
+    _counting = false;
+    _lastMs = millis() - start;
+
+    if (step < 0) {
+        // The kept session may be what the broker choked on
+        rtc.stats.failures++;
+        kept.length = 0;
+        seal();
+        stop();
+        return 0;
+    }
+
+    _lastResumed = offered && TlsBackend::resumed(_backend);
+    TlsHandshakeStats& s = rtc.stats.kind[_lastResumed ? TLS_HANDSHAKE_RESUMED : TLS_HANDSHAKE_FULL];
+    s.count++;
+    s.lastMs = _lastMs;
+    if (s.count == 1 || _lastMs < s.minMs) s.minMs = _lastMs;
+    if (_lastMs > s.maxMs) s.maxMs = _lastMs;
+    s.totalMs += _lastMs;
+    s.lastBytes = _bytesIn + _bytesOut;
+    s.totalBytes += s.lastBytes;
+    if (offered) {
+        rtc.stats.offered++;
+        if (!_lastResumed) rtc.stats.rejected++;
+    }
+
+    kept.length = TlsBackend::save(_backend, kept.data, sizeof(kept.data));
+    kept.peer = peer;
+    seal();
+    if (!_lastResumed) saveNvs();
+    _error[0] = 0;
+    return 1;
+}
+
+int TlsClient::connect(IPAddress ip, uint16_t port) {
+    return connect(ip.toString().c_str(), port);
+}
+
+size_t TlsClient::write(const uint8_t* buf, size_t size) {
+    if (!_secure) return _transport.write(buf, size);
+    if (!_backend) return 0;
+    return TlsBackend::write(*this, buf, size);
+}
+
+int TlsClient::available() {
+    if (!_secure) return _transport.available();
+    if (_rxPos < _rxLength) return _rxLength - _rxPos;
+    if (!_backend) return 0;
+    int n = TlsBackend::read(*this, _rx, sizeof(_rx));
+    if (n <= 0) return 0;   // closed: connected() says so
+    _rxPos = 0;
+    _rxLength = n;
+    return n;
+}
+
+int TlsClient::read(uint8_t* buf, size_t size) {
+    if (!_secure) return _transport.read(buf, size);
+    int n = available();
+    if (n <= 0) return -1;
+    if ((size_t)n > size) n = size;
+    memcpy(buf, _rx + _rxPos, n);
+    _rxPos += n;
+    return n;
+}
+
+int TlsClient::read() {
+    uint8_t byte;
+    return read(&byte, 1) == 1 ? byte : -1;
+}
+
+int TlsClient::peek() {
+#ifdef ESP_PLATFORM
+    if (!_secure) return _transport.peek();
+#endif
+    return available() > 0 ? _rx[_rxPos] : -1;
+}
+
+uint8_t TlsClient::connected() {
+    if (!_secure) return _transport.connected();
+    if (_rxPos < _rxLength) return 1;
+    return _backend && !_backend->closed && _transport.connected();
+}
+
+void TlsClient::stop() {
+    if (_backend) {
+        TlsBackend::close(*this);
+        _backend = nullptr;
+    }
+    _rxPos = _rxLength = 0;
+    _transport.stop();
+}
+
+size_t TlsClient::statusJson(char* out, size_t size) const {
+    const TlsStats& s = tlsStats();
+    uint32_t resumed = s.kind[TLS_HANDSHAKE_RESUMED].count;
+    uint32_t total = s.kind[TLS_HANDSHAKE_FULL].count + resumed;
+    char text[96];
+    if (!_tls) {
+        snprintf(text, sizeof(text), "off");
+    } else if (_error[0]) {
+        snprintf(text, sizeof(text), "failed: %s", _error);
+    } else if (!total) {
+        snprintf(text, sizeof(text), "no handshake yet");
+    } else {
+        snprintf(text, sizeof(text), "%s in %lu ms, %lu of %lu resumed", _lastResumed ? "resumed" : "full",
+                 (unsigned long)_lastMs, (unsigned long)resumed, (unsigned long)total);
+    }
+    // The error can quote the server name
+    char status[sizeof(text) * 2];
+    jsonEscape(status, sizeof(status), text);
+    return snprintf(out, size, "\"tls\":\"%s\"", status);
+}
+
+int TlsClient::fail(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    vsnprintf(_error, sizeof(_error), format, args);
+    va_end(args);
+    return 0;
+}
+
+size_t TlsClient::transportWrite(const uint8_t* buf, size_t size) {
+    size_t n = _transport.write(buf, size);
+    if (_counting) _bytesOut += n;
+    return n;
+}
+
+int TlsClient::transportRead(uint8_t* buf, size_t size) {
+    int n = _transport.read(buf, size);
+    if (_counting && n > 0) _bytesIn += n;
+    return n;
+}
+
+void tlsForgetSession() {
+    loadCache();
+    rtc.session.length = 0;
+    seal();
+    saveNvs();
+}
+
+size_t tlsSessionBytes() {
+    loadCache();
+    return rtc.session.length;
+}
+
+const TlsStats& tlsStats() {
+    loadCache();
+    return rtc.stats;
+}
+
+void printTlsStats(Print& out) {
+    static const char* names[TLS_HANDSHAKE_COUNT] = {"full", "resumed"};
+    const TlsStats& stats = tlsStats();
+    out.println("TLS handshakes:");
+    for (int k = 0; k < TLS_HANDSHAKE_COUNT; k++) {
+        const TlsHandshakeStats& s = stats.kind[k];
+        out.printf("  %-7s %4lu", names[k], (unsigned long)s.count);
+        if (s.count) {
+            out.printf(", last %lu ms, min %lu, avg %lu, max %lu, %lu bytes avg", (unsigned long)s.lastMs,
+                       (unsigned long)s.minMs, (unsigned long)(s.totalMs / s.count), (unsigned long)s.maxMs,
+                       (unsigned long)(s.totalBytes / s.count));
+        }
+        out.println();
+    }
+    out.printf("  %lu failed, %lu offered a kept session, %lu of them got a full handshake\n", (unsigned long)stats.failures,
+               (unsigned long)stats.offered, (unsigned long)stats.rejected);
+}
@@ -0,0 +1,155 @@
+#pragma once
+
+// MQTT over TLS without paying for a full handshake on every reconnect: a
+// Client that wraps the TCP one and resumes the last TLS session.
+//
+//   WiFiClient wifiClient;
+//   TlsClient tlsClient(wifiClient);
+//   MqttPipe mqttClient(tlsClient);         // or PubSubClient
+//   tlsClient.setCaCert(mqtt_ca);           // PEM
+//   tlsClient.setTls(settings.mqtt_tls);    // off: plain TCP, as before
+//   ... mqttClient.connect() ...
+//   tlsClient.lastResumed(), tlsClient.lastHandshakeMs()
+//
+// TLS 1.2 with ECDHE on P-256 only, ECDSA suites first; ECDHE-RSA-AES128-GCM
+// is still offered for a broker that has not moved yet. With an ECDSA P-256
+// certificate the handshake is a third smaller than with an RSA-2048 one
+// (1.1 KB against 1.7 KB on the host build) and the session, which holds
+// the certificate, fits TLS_SESSION_BYTES (about 720 bytes against 1.1 KB:
+// an RSA broker's is only kept with TLS_SESSION_BYTES raised to 1536). The broker's certificate
+// is checked against the CA given and the name connected to
+// (setServerName() for another one); the devices have no clock, so not its
+// dates.
+//
+// A full handshake costs two round trips, the key exchange and the signature
+// check; a resumed one is a single round trip with none of them. After each
+// handshake the session (its ID and the broker's ticket, RFC 5077) is kept
+// in RTC memory, which survives resets and deep sleep, and after a full one
+// in NVS as well, for power-on; resumptions only write RTC memory, as the
+// ticket the broker renews on each is good for its lifetime anyway. The next
+// connect to the same broker offers it; a broker that no longer knows it
+// answers with a full handshake. A failed handshake drops it.
+//
+// Handshakes are counted per kind (full, resumed) with their times and bytes
+// in RTC memory; printTlsStats() reports them. tools/tls_bench compares the
+// two against a local TLS broker stand-in and makes ECDSA certificates.
+//
+// Mosquitto resumes both ways out of the box: by session ID from its cache
+// and by ticket (OpenSSL issues them unless told not to). Its ticket keys
+// are made at startup, so after a broker restart the next connect is a full
+// handshake, once. On the device the TLS buffers (about 40 KB with the
+// core's mbedTLS settings) are held from connect() to stop() only. The host
+// build uses OpenSSL (link -lssl -lcrypto), the devices mbedTLS.
+
+#include <Arduino.h>
+
+#ifndef TLS_SESSION_BYTES
+#define TLS_SESSION_BYTES 1024      // a serialized session; larger ones are not kept
+#endif
+
+#ifndef TLS_HANDSHAKE_TIMEOUT_MS
+#define TLS_HANDSHAKE_TIMEOUT_MS 10000
+#endif
+
+enum TlsHandshake : uint8_t {
+    TLS_HANDSHAKE_FULL,
+    TLS_HANDSHAKE_RESUMED,
+    TLS_HANDSHAKE_COUNT,
+};
+
+struct TlsHandshakeStats {
+    uint32_t count;         // completed
+    uint32_t lastMs;
+    uint32_t minMs;
+    uint32_t maxMs;
+    uint32_t totalMs;
+    uint32_t lastBytes;     // sent and received during the handshake
+    uint32_t totalBytes;
+};
+
+struct TlsStats {
+    TlsHandshakeStats kind[TLS_HANDSHAKE_COUNT];
+    uint32_t failures;      // handshakes that did not complete
+    uint32_t offered;       // handshakes that offered a kept session
+    uint32_t rejected;      // of them answered with a full handshake
+};
+
+struct TlsBackend;
+
+class TlsClient : public Client {
+public:
+    explicit TlsClient(Client& transport) : _transport(transport) {}
+    ~TlsClient();
+
+    // Off passes everything through to the transport; takes effect on the
+    // next connect()
+    void setTls(bool on) { _tls = on; }
+    bool tls() const { return _tls; }
+    // The CA that signed the broker's certificate, PEM; kept by pointer
+    void setCaCert(const char* pem) { _caCert = pem; }
+    // The name checked in the certificate (and sent as SNI); nullptr: the
+    // host given to connect()
+    void setServerName(const char* name) { _serverName = name; }
+
+    int connect(const char* host, uint16_t port);
+    int connect(IPAddress ip, uint16_t port);
+    // The ESP32 core's Client has these too; the transport's own timeout
+    // applies, and TLS_HANDSHAKE_TIMEOUT_MS to the handshake
+    int connect(const char* host, uint16_t port, int32_t timeout) { (void)timeout; return connect(host, port); }
+    int connect(IPAddress ip, uint16_t port, int32_t timeout) { (void)timeout; return connect(ip, port); }
+    size_t write(const uint8_t* buf, size_t size);
+    size_t write(uint8_t byte) { return write(&byte, 1); }
+    int available();
+    int read(uint8_t* buf, size_t size);
+    int read();
+    int peek();
+    void flush() {}
+    uint8_t connected();
+    void stop();
+    operator bool() { return connected(); }
+
+    // The last handshake
+    bool lastResumed() const { return _lastResumed; }
+    uint32_t lastHandshakeMs() const { return _lastMs; }
+    uint32_t lastHandshakeBytes() const { return _bytesIn + _bytesOut; }
+    // Why the last connect() failed; empty after one that worked
+    const char* error() const { return _error; }
+    // "tls":"resumed in 85 ms, 12 of 14 resumed" (no braces, to go into an
+    // object)
+    size_t statusJson(char* out, size_t size) const;
+
+private:
+    friend struct TlsBackend;
+
+    int fail(const char* format, ...);
+    size_t transportWrite(const uint8_t* buf, size_t size);
+    int transportRead(uint8_t* buf, size_t size);
+    void close();
+
+    Client& _transport;
+    bool _tls = false;
+    bool _secure = false;           // this connection is TLS
+    const char* _caCert = nullptr;
+    const char* _serverName = nullptr;
+    TlsBackend* _backend = nullptr;
+    char _error[64] = "";
+
+    bool _lastResumed = false;
+    uint32_t _lastMs = 0;
+    uint32_t _bytesIn = 0;          // of the handshake
+    uint32_t _bytesOut = 0;
+    bool _counting = false;
+
+    // Decrypted bytes not read yet
+    uint8_t _rx[512];
+    uint16_t _rxPos = 0;
+    uint16_t _rxLength = 0;
+};
+
+// Drops the kept session from RTC memory and NVS; the next connect is a full
+// handshake
+void tlsForgetSession();
+// The kept session's size; 0 for none
+size_t tlsSessionBytes();
+const TlsStats& tlsStats();
+void printTlsStats(Print& out);
@@ -0,0 +1,249 @@
+#include "wifi_fast.h"
+
+#include <WiFi.h>
+#include <stddef.h>
+#include <string.h>
+
+#ifdef ESP_PLATFORM
+#include <Preferences.h>
+#include <esp_attr.h>
+#else
+#define RTC_NOINIT_ATTR
+#endif
+
+static const uint32_t CACHE_MAGIC = 0x57F1FA57;
+
+struct AccessPoint {
+    uint32_t ssidHash;
+    uint8_t bssid[6];
+    uint8_t channel;
+    uint8_t valid;
+};
+
+// The DHCP lease; 0 for none
+struct Lease {
+    uint32_t ip;
+    uint32_t gateway;
+    uint32_t subnet;
+    uint32_t dns;
+};
+
+struct RtcState {
+    uint32_t magic;
+    AccessPoint ap;
+    Lease lease;
+    uint32_t leaseReuses;   // direct connects on the lease since DHCP last ran
+    WiFiFastPathStats stats[WIFI_PATH_COUNT];
+    uint32_t checksum;
+};
+
+RTC_NOINIT_ATTR static RtcState rtc;
+
+static const char* ssid = nullptr;
+static const char* password = nullptr;
+static Print* out = nullptr;
+
+static bool hasStaticIP = false;
+static IPAddress staticIP, staticGateway, staticSubnet, staticDns;
+
+static WiFiFastState state = WIFI_FAST_IDLE;
+static WiFiFastPath path = WIFI_PATH_SCAN;
+static bool reusedLease = false;
+static uint32_t connectStartMs = 0;
+static uint32_t pathStartMs = 0;
+static uint32_t lastMs = 0;
+static uint32_t directFailedMs = 0;     // of this attempt; 0 if the direct path was not tried or worked
+
+static uint32_t fnv(const void* data, size_t length, uint32_t hash = 2166136261u) {
+    const uint8_t* p = (const uint8_t*)data;
+    for (size_t i = 0; i < length; i++) hash = (hash ^ p[i]) * 16777619u;
+    return hash;
+}
+
+static void seal() {
+    rtc.checksum = fnv(&rtc, offsetof(RtcState, checksum));
+}
+
+static bool rtcValid() {
+    return rtc.magic == CACHE_MAGIC && rtc.checksum == fnv(&rtc, offsetof(RtcState, checksum));
+}
+
+// NVS holds the access point only. The lease stays in RTC memory: after a
+// power cut it may be days old and its address someone else's, so the
+// first connect after power-on asks DHCP. The counters stay there too, so a
+// connect does not write flash.
+static void loadNvs() {
+#ifdef ESP_PLATFORM
+    Preferences prefs;
+    if (!prefs.begin("wififast", true)) return;
+    AccessPoint ap;
+    if (prefs.getBytes("ap", &ap, sizeof(ap)) == sizeof(ap)) rtc.ap = ap;
+    prefs.end();
+#endif
+}
+
+static void saveNvs() {
+#ifdef ESP_PLATFORM
+    Preferences prefs;
+    if (!prefs.begin("wififast", false)) return;
+    AccessPoint stored;
+    if (prefs.getBytes("ap", &stored, sizeof(stored)) != sizeof(stored) || memcmp(&stored, &rtc.ap, sizeof(stored)) != 0) {
+        prefs.putBytes("ap", &rtc.ap, sizeof(rtc.ap));
+    }
+    prefs.end();
+#endif
+}
+
+void wifiFastBegin(const char* ssidIn, const char* passwordIn, Print& log) {
+    ssid = ssidIn;
+    password = passwordIn;
+    out = &log;
+    if (!rtcValid()) {
+        memset(&rtc, 0, sizeof(rtc));
+        rtc.magic = CACHE_MAGIC;
+        loadNvs();
+        seal();
+    }
+}
+
+void wifiFastStaticIP(IPAddress ip, IPAddress gateway, IPAddress subnet, IPAddress dns) {
+    hasStaticIP = true;
+    staticIP = ip;
+    staticGateway = gateway;
+    staticSubnet = subnet;
+    staticDns = dns;
+}
+
+bool wifiFastCached() {
+    return ssid && rtc.ap.valid && rtc.ap.ssidHash == fnv(ssid, strlen(ssid));
+}
+
+void wifiFastForget() {
+    memset(&rtc.ap, 0, sizeof(rtc.ap));
+    memset(&rtc.lease, 0, sizeof(rtc.lease));
+    rtc.leaseReuses = 0;
+    seal();
+    saveNvs();
+}
+
+static void startPath(WiFiFastPath next) {
+    path = next;
+    pathStartMs = millis();
+    rtc.stats[path].attempts++;
+    seal();
+
+    WiFi.disconnect();
+    reusedLease = false;
+    if (hasStaticIP) {
+        WiFi.config(staticIP, staticGateway, staticSubnet, staticDns);
+    } else if (path == WIFI_PATH_DIRECT && rtc.lease.ip && rtc.leaseReuses < WIFI_FAST_LEASE_REUSES) {
+        const Lease& lease = rtc.lease;
+        WiFi.config(IPAddress(lease.ip), IPAddress(lease.gateway), IPAddress(lease.subnet), IPAddress(lease.dns));
+        reusedLease = true;
+    } else {
+        WiFi.config(IPAddress(), IPAddress(), IPAddress());   // DHCP
+    }
+
+    if (path == WIFI_PATH_DIRECT) {
+        WiFi.begin(ssid, password, rtc.ap.channel, rtc.ap.bssid);
+    } else {
+        WiFi.begin(ssid, password);
+    }
+}
+
+void wifiFastConnect() {
+    if (!ssid) return;
+    state = WIFI_FAST_CONNECTING;
+    connectStartMs = millis();
+    directFailedMs = 0;
+    startPath(wifiFastCached() ? WIFI_PATH_DIRECT : WIFI_PATH_SCAN);
+}
+
+static void remember() {
+    AccessPoint& ap = rtc.ap;
+    uint8_t* bssid = WiFi.BSSID();
+    if (bssid) memcpy(ap.bssid, bssid, sizeof(ap.bssid));
+    ap.channel = WiFi.channel();
+    ap.ssidHash = fnv(ssid, strlen(ssid));
+    ap.valid = bssid && ap.channel;
+    if (!hasStaticIP) {
+        Lease& lease = rtc.lease;
+        lease.ip = (uint32_t)WiFi.localIP();
+        lease.gateway = (uint32_t)WiFi.gatewayIP();
+        lease.subnet = (uint32_t)WiFi.subnetMask();
+        lease.dns = (uint32_t)WiFi.dnsIP();
+    }
+    rtc.leaseReuses = reusedLease ? rtc.leaseReuses + 1 : 0;
+    seal();
+    saveNvs();
+}
+
+WiFiFastState wifiFastPoll() {
+    if (state != WIFI_FAST_CONNECTING) return state;
+    uint32_t now = millis();
+    uint32_t pathMs = now - pathStartMs;
+
+    if (WiFi.status() == WL_CONNECTED) {
+        WiFiFastPathStats& s = rtc.stats[path];
+        s.lastMs = pathMs;
+        s.totalMs += pathMs;
+        if (s.attempts - s.failures == 1 || pathMs < s.minMs) s.minMs = pathMs;   // first success
+        if (pathMs > s.maxMs) s.maxMs = pathMs;
+        lastMs = now - connectStartMs;
+        remember();
+        state = WIFI_FAST_CONNECTED;
+        if (out) {
+            out->printf("WiFi: connected %s on channel %d in %lu ms%s", path == WIFI_PATH_DIRECT ? "directly" : "after a scan",
+                        (int)rtc.ap.channel, (unsigned long)lastMs, reusedLease ? " (lease reused)" : "");
+            if (directFailedMs) out->printf(", the cached access point gave up after %lu ms", (unsigned long)directFailedMs);
+            out->println();
+        }
+        return state;
+    }
+
+    if (path == WIFI_PATH_DIRECT && pathMs >= WIFI_FAST_DIRECT_TIMEOUT_MS) {
+        rtc.stats[path].failures++;
+        directFailedMs = pathMs;
+        startPath(WIFI_PATH_SCAN);
+    } else if (path == WIFI_PATH_SCAN && pathMs >= WIFI_FAST_SCAN_TIMEOUT_MS) {
+        rtc.stats[path].failures++;
+        seal();
+        state = WIFI_FAST_FAILED;
+        if (out) out->printf("WiFi: no connection after %lu ms\n", (unsigned long)(now - connectStartMs));
+    }
+    return state;
+}
+
+bool wifiFastConnectBlocking(uint32_t timeoutMs) {
+    wifiFastConnect();
+    uint32_t start = millis();
+    while (wifiFastPoll() == WIFI_FAST_CONNECTING && millis() - start < timeoutMs) delay(10);
+    return state == WIFI_FAST_CONNECTED;
+}
+
+WiFiFastPath wifiFastLastPath() {
+    return path;
+}
+
+uint32_t wifiFastLastMs() {
+    return lastMs;
+}
+
+const WiFiFastPathStats& wifiFastStats(WiFiFastPath which) {
+    return rtc.stats[which];
+}
+
+void printWiFiFastStats(Print& out) {
+    static const char* names[WIFI_PATH_COUNT] = {"direct", "scan"};
+    out.println("WiFi connect times:");
+    for (int p = 0; p < WIFI_PATH_COUNT; p++) {
+        const WiFiFastPathStats& s = rtc.stats[p];
+        uint32_t successes = s.attempts - s.failures;
+        out.printf("  %-6s %4lu attempts, %3lu failed", names[p], (unsigned long)s.attempts, (unsigned long)s.failures);
+        if (successes) {
+            out.printf(", last %lu ms, min %lu, avg %lu, max %lu", (unsigned long)s.lastMs, (unsigned long)s.minMs,
+                       (unsigned long)(s.totalMs / successes), (unsigned long)s.maxMs);
+        }
+        out.println();
+    }
+}
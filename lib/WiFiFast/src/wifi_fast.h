@@ -0,0 +1,90 @@
+#pragma once
+
+// WiFi fast connect: skips the channel scan (and DHCP) when the access point
+// from last time is still there.
+//
+//   wifiFastBegin(ssid, password, Serial);     // setup(), after WiFi.mode(WIFI_STA)
+//   wifiFastConnect();
+//   while (wifiFastPoll() == WIFI_FAST_CONNECTING) delay(10);
+//
+// A successful connect caches the access point's BSSID and channel and the
+// DHCP lease (address, gateway, netmask, DNS). The cache lives in RTC memory,
+// which survives deep sleep and resets; the BSSID and channel are also kept
+// in NVS for power-on, the lease is not (it may have run out while the power
+// was off). Flash is only written when the cached values change.
+//
+// wifiFastConnect() tries the direct path first when there is a cache:
+// WiFi.begin() with the BSSID and channel, so the driver associates without
+// scanning, and the cached lease (if RTC memory has one) as a static
+// address, so there is no DHCP exchange. When that has not connected within WIFI_FAST_DIRECT_TIMEOUT_MS
+// (the access point moved channel, or another one took over), it falls back
+// to a full scan with DHCP and caches whatever that finds.
+//
+// Reusing a lease as a static address skips the DHCP server, which may hand
+// the address to someone else once the lease runs out. A lease is therefore
+// reused at most WIFI_FAST_LEASE_REUSES times in a row; then the direct path
+// asks DHCP again (and still skips the scan). wifiFastStaticIP() sets a fixed
+// address instead, when the network has one reserved for the device.
+//
+// Attempts, failures and connect times are counted per path and kept in RTC
+// memory with the cache, so a device that wakes from deep sleep for each
+// reading accumulates them across wakes.
+
+#include <Arduino.h>
+
+#ifndef WIFI_FAST_DIRECT_TIMEOUT_MS
+#define WIFI_FAST_DIRECT_TIMEOUT_MS 2000
+#endif
+
+#ifndef WIFI_FAST_SCAN_TIMEOUT_MS
+#define WIFI_FAST_SCAN_TIMEOUT_MS 10000
+#endif
+
+#ifndef WIFI_FAST_LEASE_REUSES
+#define WIFI_FAST_LEASE_REUSES 16
+#endif
+
+enum WiFiFastPath : uint8_t {
+    WIFI_PATH_DIRECT,       // cached BSSID and channel, no scan
+    WIFI_PATH_SCAN,         // full scan and DHCP
+    WIFI_PATH_COUNT,
+};
+
+enum WiFiFastState : uint8_t {
+    WIFI_FAST_IDLE,
+    WIFI_FAST_CONNECTING,
+    WIFI_FAST_CONNECTED,
+    WIFI_FAST_FAILED,
+};
+
+struct WiFiFastPathStats {
+    uint32_t attempts;
+    uint32_t failures;
+    uint32_t lastMs;        // of the last successful connect
+    uint32_t minMs;
+    uint32_t maxMs;
+    uint32_t totalMs;       // over all successful connects
+};
+
+// Remembers the credentials and loads the cache (RTC memory, else NVS).
+// Connect results are printed to `log`.
+void wifiFastBegin(const char* ssid, const char* password, Print& log = Serial);
+
+// A fixed address for every path, instead of reusing the DHCP lease
+void wifiFastStaticIP(IPAddress ip, IPAddress gateway, IPAddress subnet, IPAddress dns);
+
+// Starts an attempt (disconnecting first); drive it with wifiFastPoll()
+void wifiFastConnect();
+WiFiFastState wifiFastPoll();
+
+// Connects and waits, for firmwares without a cooperative loop; true once
+// connected. The timeout covers both paths.
+bool wifiFastConnectBlocking(uint32_t timeoutMs = WIFI_FAST_DIRECT_TIMEOUT_MS + WIFI_FAST_SCAN_TIMEOUT_MS);
+
+WiFiFastPath wifiFastLastPath();
+uint32_t wifiFastLastMs();              // from wifiFastConnect() to connected, both paths
+bool wifiFastCached();
+void wifiFastForget();                  // drops the cache in RTC memory and NVS
+
+const WiFiFastPathStats& wifiFastStats(WiFiFastPath path);
+void printWiFiFastStats(Print& out);
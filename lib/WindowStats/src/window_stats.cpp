@@ -0,0 +1,50 @@
+#include "window_stats.h"
+
+static const char* const QUANTITY_NAMES[STAT_QUANTITY_COUNT] = {"temperature", "humidity", "co2"};
+static const int QUANTITY_DECIMALS[STAT_QUANTITY_COUNT] = {2, 1, 0};
+
+void StatWindow::restart(uint32_t startMs) {
+    _startMs = startMs;
+    _open.count = 0;
+    for (StatAccumulator& accumulator : _open.quantity) accumulator.reset();
+}
+
+bool StatWindow::add(uint32_t nowMs, float temperature, float humidity, float co2) {
+    bool closed = false;
+    if (!_started) {
+        _started = true;
+        restart(nowMs);
+    } else if (nowMs - _startMs >= _lengthMs) {
+        if (_open.count) {
+            _closed = _open;
+            _pending = true;
+            closed = true;
+        }
+        restart(_startMs + (nowMs - _startMs) / _lengthMs * _lengthMs);
+    }
+
+    _open.count++;
+    _open.quantity[STAT_TEMPERATURE].add(temperature);
+    _open.quantity[STAT_HUMIDITY].add(humidity);
+    _open.quantity[STAT_CO2].add(co2);
+    return closed;
+}
+
+size_t StatWindow::json(char* out, size_t size) const {
+    int length = snprintf(out, size, "{\"window\": \"%s\", \"count\": %u", _name, (unsigned)_closed.count);
+    for (uint8_t q = 0; q < STAT_QUANTITY_COUNT && length > 0 && (size_t)length < size; q++) {
+        const StatAccumulator& accumulator = _closed.quantity[q];
+        int decimals = QUANTITY_DECIMALS[q];
+        length += snprintf(out + length, size - length,
+                           ", \"%s\": {\"mean\": %.*f, \"min\": %.*f, \"max\": %.*f, \"last\": %.*f}",
+                           QUANTITY_NAMES[q], decimals, _closed.mean((StatQuantity)q), decimals, accumulator.min,
+                           decimals, accumulator.max, decimals, accumulator.last);
+    }
+    if (length <= 0 || (size_t)length + 2 > size) {
+        if (size) out[0] = 0;
+        return 0;
+    }
+    out[length++] = '}';
+    out[length] = 0;
+    return length;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+// Statistics of the readings over fixed windows, computed on the device:
+// Home Assistant records a message per window instead of one per reading.
+//
+//   StatWindow stats5m(300000, "5m"), stats1h(3600000, "1h");
+//   ... on each reading:
+//   stats5m.add(millis(), temperature, humidity, co2);
+//   if (stats5m.pending()) {
+//       stats5m.json(payload, sizeof(payload));
+//       if (mqttClient.publish(topic, payload)) stats5m.sent();
+//   }
+//
+// Each window holds an accumulator per quantity (sum, min, max, last) for
+// the open window and the closed one: a fixed 128 bytes whatever the
+// window's length, and a reading costs a few compares and adds. The sums
+// are floats: an hour of CO2 at 5 s stays below 2^22, where a float still
+// has quarter-ppm steps. A window starts with the first reading and
+// closes with the first one at or after its end, which starts the next
+// window; the following windows stay on the same grid (start + n × length),
+// so they do not drift by the reading interval. After a gap longer than a
+// window (no readings, the sensor being reconfigured) the next window
+// starts on the grid point before the reading. The closed window's summary
+// is kept for json() until the next one closes, marked pending until sent():
+// one that could not go out is sent with the next chance, or replaced by
+// the next window.
+
+#include <Arduino.h>
+
+enum StatQuantity : uint8_t {
+    STAT_TEMPERATURE,
+    STAT_HUMIDITY,
+    STAT_CO2,
+    STAT_QUANTITY_COUNT,
+};
+
+struct StatAccumulator {
+    float sum;
+    float min;
+    float max;
+    float last;
+
+    void reset() { sum = 0; min = INFINITY; max = -INFINITY; last = NAN; }
+    void add(float value) {
+        sum += value;
+        if (value < min) min = value;
+        if (value > max) max = value;
+        last = value;
+    }
+};
+
+struct StatSummary {
+    uint32_t count;                 // readings; 0 for no window closed yet
+    StatAccumulator quantity[STAT_QUANTITY_COUNT];
+
+    float mean(StatQuantity q) const { return count ? quantity[q].sum / count : NAN; }
+};
+
+class StatWindow {
+public:
+    // `name` goes into the payload ("5m"); kept by pointer
+    StatWindow(uint32_t lengthMs, const char* name) : _lengthMs(lengthMs), _name(name) { restart(0); }
+
+    // Folds a reading in; true when it closed the window first
+    bool add(uint32_t nowMs, float temperature, float humidity, float co2);
+
+    // The last window closed
+    const StatSummary& closed() const { return _closed; }
+    bool pending() const { return _pending; }
+    void sent() { _pending = false; }
+
+    // Readings in the window still open
+    uint32_t count() const { return _open.count; }
+    uint32_t lengthMs() const { return _lengthMs; }
+    const char* name() const { return _name; }
+
+    // The closed window, e.g.
+    // {"window": "5m", "count": 60, "temperature": {"mean": 22.41, "min": 22.3,
+    //  "max": 22.56, "last": 22.5}, "humidity": {...}, "co2": {...}}
+    // with temperature to 1/100 °C, humidity to 1/10 % and CO2 in whole ppm;
+    // 0 when it did not fit
+    size_t json(char* out, size_t size) const;
+
+private:
+    void restart(uint32_t startMs);
+
+    uint32_t _lengthMs;
+    const char* _name;
+    uint32_t _startMs = 0;
+    bool _started = false;
+    bool _pending = false;
+    StatSummary _open;
+    StatSummary _closed = {};
+};
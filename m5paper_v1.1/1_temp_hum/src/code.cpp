@@ -3,7 +3,15 @@
 #include <Preferences.h>
 #include <WiFi.h>
 #include <PubSubClient.h>
-#include <ArduinoJson.h>
+#include <deferlog.h>
+#include <boot_sequence.h>
+#include <wifi_fast.h>
+#include <ha_device.h>
+#include <remote_config.h>
+#include <delta_ota.h>
+#include <tls_client.h>
+#include <window_stats.h>
+#include <co2_analytics.h>
 
 // WiFi Configuration - UPDATE THESE VALUES
 const char* ssid = "Cellarstone IoT";
@@ -14,14 +22,107 @@ const char* mqtt_server = "192.168.2.176";
 const int mqtt_port = 1883;
 const char* mqtt_user = "mqtt_user";
 const char* mqtt_password = "mqtt";
+// MQTT over TLS (see lib/TlsClient), off until mqtt_tls is set (and
+// mqtt_port, to 8883 as a rule): the PEM of the CA that signed the broker's
+// certificate; tools/tls_bench --make-certs makes an ECDSA pair
+const bool mqtt_tls = false;
+const char* mqtt_ca = "";
 
 // Device identification
 const char* device_name = "M5Paper_no_1";
 const char* device_id = "m5paper_no_1";
 
-// MQTT clients
+// Firmware updates (see lib/DeltaOta): the manifest tools/ota_delta made, on
+// an HTTP server on the LAN; empty for none
+const char* ota_url = "";
+
+// The values above and the intervals and SCD40 settings below are the
+// defaults; setup() copies them into `settings`, NVS and the retained
+// m5env/<device_id>/config topic override them there (see lib/RemoteConfig)
+struct Settings {
+    char ssid[33];
+    char password[65];
+    char mqtt_server[64];
+    uint32_t mqtt_port;
+    char mqtt_user[33];
+    char mqtt_password[65];
+    bool mqtt_tls;
+    char device_name[32];
+    char device_id[32];
+    uint32_t publish_ms;
+    bool raw_state;
+    uint32_t wifi_check_ms;
+    bool asc;
+    float temp_offset;
+    float room_m3;
+    uint32_t frc_ppm;
+    uint32_t calib_wait_s;
+    char ota_url[128];
+    uint32_t ota_check_min;
+};
+
+Settings settings;
+const ConfigField settingsFields[] = {
+    CONFIG_STRING(Settings, ssid, 1, CONFIG_APPLY_WIFI),
+    CONFIG_SECRET(Settings, password, 0, CONFIG_APPLY_WIFI),
+    CONFIG_STRING(Settings, mqtt_server, 1, CONFIG_APPLY_MQTT),
+    CONFIG_UINT32(Settings, mqtt_port, 1, 65535, CONFIG_APPLY_MQTT),
+    CONFIG_STRING(Settings, mqtt_user, 0, CONFIG_APPLY_MQTT),
+    CONFIG_SECRET(Settings, mqtt_password, 0, CONFIG_APPLY_MQTT),
+    CONFIG_BOOL(Settings, mqtt_tls, CONFIG_APPLY_MQTT),
+    CONFIG_STRING(Settings, device_name, 1, CONFIG_APPLY_IDENTITY),
+    CONFIG_STRING(Settings, device_id, 1, CONFIG_APPLY_IDENTITY),
+    CONFIG_UINT32(Settings, publish_ms, 5000, 3600000, CONFIG_APPLY_NOW),
+    CONFIG_BOOL(Settings, raw_state, CONFIG_APPLY_NOW),
+    CONFIG_UINT32(Settings, wifi_check_ms, 5000, 600000, CONFIG_APPLY_NOW),
+    CONFIG_BOOL(Settings, asc, CONFIG_APPLY_SENSOR),
+    CONFIG_FLOAT(Settings, temp_offset, 0, 20, CONFIG_APPLY_SENSOR),
+    CONFIG_FLOAT(Settings, room_m3, 5, 5000, CONFIG_APPLY_NOW),
+    CONFIG_UINT32(Settings, frc_ppm, 400, 2000, CONFIG_APPLY_NOW),
+    CONFIG_UINT32(Settings, calib_wait_s, 5, 600, CONFIG_APPLY_NOW),
+    CONFIG_STRING(Settings, ota_url, 0, CONFIG_APPLY_OTA),
+    CONFIG_UINT32(Settings, ota_check_min, 0, 10080, CONFIG_APPLY_NOW),
+};
+const ConfigSchema settingsSchema = CONFIG_SCHEMA(settingsFields, Settings);
+RemoteConfig config(settingsSchema, &settings);
+HaDevice haDevice = {settings.device_id, settings.device_name, "M5Paper"};
+// What the discovery announces, and an id change takes back: temperature,
+// humidity and CO2, their 5-minute and hourly statistics, then the CO2 trend,
+// air changes and occupancy (see lib/HaDevice)
+const HaEntity* const haEntities[] = {&HA_SCD40_ENTITIES[0], &HA_SCD40_ENTITIES[1], &HA_SCD40_ENTITIES[2],
+                                      &HA_STATS_ENTITIES[0], &HA_STATS_ENTITIES[1], &HA_STATS_ENTITIES[2],
+                                      &HA_STATS_ENTITIES[3], &HA_STATS_ENTITIES[4], &HA_STATS_ENTITIES[5],
+                                      &HA_AIR_ENTITIES[0], &HA_AIR_ENTITIES[1], &HA_AIR_ENTITIES[2]};
+
+// A config message is applied from loop(); one that needs a reconnect is
+// committed once the broker is back with it, or reverted after
+// CONFIG_CONFIRM_TIMEOUT
+char configTopic[80];
+uint8_t configActions = 0;      // CONFIG_APPLY_* flags still to carry out
+uint8_t configReconnects = 0;   // the reconnects the pending config needed
+bool configReport = false;      // diagnostics to publish with the outcome
+unsigned long configAppliedAt = 0;
+const unsigned long CONFIG_CONFIRM_TIMEOUT = 60000;
+
+// MQTT clients, over TLS when mqtt_tls is set (a reconnect resumes the last
+// session, so a wake or a retry skips most of the handshake)
 WiFiClient wifiClient;
-PubSubClient mqttClient(wifiClient);
+TlsClient tlsClient(wifiClient);
+PubSubClient mqttClient(tlsClient);
+
+// Firmware updates: the manifest is checked once the broker is reached, then
+// every ota_check_min minutes (0: only when ota_url changes). loop() blocks
+// anyway, so a patch is applied up to OTA_POLL_BUDGET per pass; the display
+// shows the progress every OTA_PROGRESS_STEP percent, as a refresh is slow.
+WiFiClient otaClient;
+DeltaOta ota(otaClient);
+bool otaCheckDue = true;
+unsigned long lastOtaCheck = 0;
+int otaShownStep = -1;
+DeltaOtaState otaLastState = DELTA_OTA_IDLE;
+const uint32_t OTA_POLL_BUDGET = 1000;
+const uint32_t OTA_CHECK_INTERVAL_MIN = 60;
+const int OTA_PROGRESS_STEP = 10;
 
 // Network status
 bool wifiConnected = false;
@@ -30,9 +131,28 @@ unsigned long lastMqttPublish = 0;
 unsigned long lastMqttReconnect = 0;
 unsigned long lastWifiCheck = 0;
 unsigned long lastMqttCheck = 0;
-const unsigned long WIFI_CHECK_INTERVAL = 30000;  // Check WiFi every 30 seconds
+const unsigned long WIFI_CHECK_INTERVAL = 30000;  // Check WiFi every 30 seconds (default)
+const unsigned long PUBLISH_INTERVAL = 5000;      // Publish at most every 5 seconds (default)
 const unsigned long MQTT_CHECK_INTERVAL = 30000;  // Check MQTT every 30 seconds
 
+// 5-minute and hourly statistics of the readings (mean, min, max, last) on
+// their own topics, one message per window, for Home Assistant to record
+// (see lib/WindowStats); with raw_state off, "state" gets a reading only as
+// a 5-minute window closes
+StatWindow stats5m(300000, "5m");
+StatWindow stats1h(3600000, "1h");
+bool stateDue = false;
+
+// The CO2 trend, the air changes measured from decays and the occupancy they
+// imply (see lib/Co2Analytics), on the "air" topic as each 5-minute window
+// closes; occupancy takes room_m3
+Co2Analytics co2Analytics;
+bool airDue = false;
+
+// Per-reading messages go through the deferred log (see lib/DeferLog)
+DeferLogModule sensorLog("sensor", DLOG_INFO);
+DeferLogModule mqttLog("mqtt", DLOG_INFO);
+
 // M5Paper Port A (Grove) pins - External I2C
 const int PortA_SDA = 25;  // Yellow wire - Port A SDA for M5Paper
 const int PortA_SCL = 32;  // White wire - Port A SCL for M5Paper
@@ -48,39 +168,128 @@ Preferences preferences;
 bool invertDisplay = false;  // Flag for visual update indicator
 bool calibrationMode = false;
 unsigned long calibrationStartTime = 0;
-const unsigned long CALIBRATION_DURATION = 15000;  // 15 seconds for testing (was 180000 for 3 minutes)
+const unsigned long CALIBRATION_DURATION = 15000;  // 15 seconds for testing (was 180000 for 3 minutes); default of calib_wait_s
+const uint16_t CALIBRATION_PPM = 420;  // Outdoor CO2 level; default of frc_ppm
+
+// setup() runs its init steps as boot stages side by side (see
+// lib/BootSequence); the stage timings and the time to the first reading on
+// the display and the first publish go to Serial
+BootSequence boot;
 
 // Sensor data for MQTT
 float lastTemperature = 0;
 float lastHumidity = 0;
 uint16_t lastCO2 = 0;
 
-void setupWiFi() {
-    Serial.println("Setting up WiFi...");
+// Boot stages: each one is called again until it is done and must not block
+
+BootStatus bootWiFi(BootStage& stage) {
+    if (stage.phase == 0) {
+        Serial.println("Setting up WiFi...");
+        WiFi.mode(WIFI_STA);
+        // Straight to last boot's access point when it is cached, else a scan
+        wifiFastBegin(settings.ssid, settings.password, Serial);
+        wifiFastConnect();
+        stage.next();
+    }
+    WiFiFastState state = wifiFastPoll();
+    if (state == WIFI_FAST_CONNECTING) return BOOT_RUNNING;
+    if (state == WIFI_FAST_FAILED) return BOOT_FAILED;
     
-    WiFi.mode(WIFI_STA);
-    WiFi.begin(ssid, password);
+    wifiConnected = true;
+    Serial.println("WiFi connected!");
+    Serial.print("IP address: ");
+    Serial.println(WiFi.localIP());
+    return BOOT_DONE;
+}
+
+// Stops whatever the SCD40 was doing and restarts periodic measurement; the
+// first measurement is ready about 5 seconds after that
+BootStatus bootSensor(BootStage& stage) {
+    uint16_t error;
+    char errorMessage[256];
     
-    int attempts = 0;
-    while (WiFi.status() != WL_CONNECTED && attempts < 20) {
-        delay(500);
-        Serial.print(".");
-        attempts++;
+    if (stage.phase == 0) {
+        // Initialize I2C on Port A - M5Paper uses Wire1 for external I2C
+        Wire1.begin(PortA_SDA, PortA_SCL);
+        Serial.printf("I2C initialized on Port A using Wire1 (SDA=%d, SCL=%d)\n", PortA_SDA, PortA_SCL);
+        
+        // Scan for I2C devices on external bus
+        Serial.println("Scanning for I2C devices on Port A...");
+        for (int address = 1; address < 127; address++) {
+            Wire1.beginTransmission(address);
+            int error = Wire1.endTransmission();
+            if (error == 0) {
+                Serial.printf("I2C device found at address 0x%02X\n", address);
+            }
+        }
+        Serial.println("I2C scan complete.");
+        
+        scd4x.begin(Wire1);  // Use Wire1 for external I2C
+        
+        // Stop any potentially running measurement
+        error = scd4x.stopPeriodicMeasurement();
+        if (error) {
+            Serial.print("Error stopping measurement: ");
+            errorToString(error, errorMessage, 256);
+            Serial.println(errorMessage);
+        }
+        stage.next();
     }
+    if (stage.phaseMs() < 500) return BOOT_RUNNING;
     
-    if (WiFi.status() == WL_CONNECTED) {
-        wifiConnected = true;
-        Serial.println("\nWiFi connected!");
-        Serial.print("IP address: ");
-        Serial.println(WiFi.localIP());
+    // Automatic Self-Calibration is off by default for better accuracy
+    error = scd4x.setAutomaticSelfCalibration(settings.asc);
+    if (error) {
+        Serial.print("Error setting ASC: ");
+        errorToString(error, errorMessage, 256);
+        Serial.println(errorMessage);
+    }
+    scd4x.setTemperatureOffset(settings.temp_offset);
+    
+    // Start periodic measurement
+    error = scd4x.startPeriodicMeasurement();
+    if (error) {
+        Serial.print("Error starting measurement: ");
+        errorToString(error, errorMessage, 256);
+        Serial.println(errorMessage);
+        return BOOT_FAILED;
+    }
+    Serial.println("SCD40 initialized successfully!");
+    
+    // Check last calibration time
+    preferences.begin("scd40", true);
+    unsigned long lastCalib = preferences.getULong("lastCalib", 0);
+    preferences.end();
+    
+    if (lastCalib == 0) {
+        Serial.println("Note: Sensor has never been calibrated");
+        Serial.println("Press center button for 3 seconds to start calibration");
     } else {
-        wifiConnected = false;
-        Serial.println("\nWiFi connection failed!");
+        Serial.printf("Last calibration: %lu ms ago\n", millis() - lastCalib);
     }
+    return BOOT_DONE;
+}
+
+// A full clear of the e-paper panel blocks for a while; the stages added
+// before this one have their hardware busy by then
+BootStatus bootDisplay(BootStage&) {
+    M5.EPD.SetRotation(0);  // Native landscape orientation
+    M5.EPD.Clear(true);
+    
+    // Create canvas in native resolution
+    canvas.createCanvas(960, 540);
+    canvas.setTextSize(3);
+    
+    // Show initialization message
+    canvas.fillCanvas(0);
+    canvas.drawString("Starting...", 50, 200);
+    canvas.pushCanvas(0, 0, UPDATE_MODE_DU4);
+    return BOOT_DONE;
 }
 
 void checkWiFiConnection() {
-    if (millis() - lastWifiCheck < WIFI_CHECK_INTERVAL) return;
+    if (millis() - lastWifiCheck < settings.wifi_check_ms) return;
     lastWifiCheck = millis();
     
     if (WiFi.status() != WL_CONNECTED) {
@@ -88,24 +297,14 @@ void checkWiFiConnection() {
         mqttConnected = false;  // If WiFi is down, MQTT is also down
         Serial.println("WiFi disconnected! Attempting to reconnect...");
         
-        WiFi.disconnect();
-        delay(1000);
-        WiFi.begin(ssid, password);
-        
-        int attempts = 0;
-        while (WiFi.status() != WL_CONNECTED && attempts < 10) {
-            delay(500);
-            Serial.print(".");
-            attempts++;
-        }
-        
-        if (WiFi.status() == WL_CONNECTED) {
+        // Cached access point first, then a full scan
+        if (wifiFastConnectBlocking()) {
             wifiConnected = true;
-            Serial.println("\nWiFi reconnected!");
+            Serial.println("WiFi reconnected!");
             Serial.print("IP address: ");
             Serial.println(WiFi.localIP());
         } else {
-            Serial.println("\nWiFi reconnection failed!");
+            Serial.println("WiFi reconnection failed!");
         }
     } else {
         wifiConnected = true;
@@ -115,82 +314,43 @@ void checkWiFiConnection() {
 void publishDiscovery() {
     if (!mqttConnected) return;
     
-    JsonDocument doc;
     char topic[200];
     char payload[1024];
-    char stateTopic[100];
-    char availTopic[100];
-    
-    // Prepare common topics
-    snprintf(stateTopic, sizeof(stateTopic), "homeassistant/sensor/%s/state", device_id);
-    snprintf(availTopic, sizeof(availTopic), "homeassistant/sensor/%s/availability", device_id);
-    
-    // Temperature sensor discovery
-    snprintf(topic, sizeof(topic), "homeassistant/sensor/%s_temperature/config", device_id);
-    doc.clear();
-    doc["name"] = "Temperature";
-    doc["device_class"] = "temperature";
-    doc["unit_of_measurement"] = "°C";
-    doc["state_topic"] = stateTopic;
-    doc["availability_topic"] = availTopic;
-    doc["value_template"] = "{{ value_json.temperature }}";
-    doc["unique_id"] = String(device_id) + "_temperature";
-    
-    JsonObject device = doc["device"].to<JsonObject>();
-    device["identifiers"][0] = device_id;
-    device["name"] = device_name;
-    device["model"] = "M5Paper";
-    device["manufacturer"] = "M5Stack";
-    
-    serializeJson(doc, payload);
-    if (mqttClient.publish(topic, payload, true)) {
-        Serial.printf("Published discovery: %s\n", topic);
-    }
-    delay(50);
-    
-    // Humidity sensor discovery
-    snprintf(topic, sizeof(topic), "homeassistant/sensor/%s_humidity/config", device_id);
-    doc.clear();
-    doc["name"] = "Humidity";
-    doc["device_class"] = "humidity";
-    doc["unit_of_measurement"] = "%";
-    doc["state_topic"] = stateTopic;
-    doc["availability_topic"] = availTopic;
-    doc["value_template"] = "{{ value_json.humidity }}";
-    doc["unique_id"] = String(device_id) + "_humidity";
-    
-    device = doc["device"].to<JsonObject>();
-    device["identifiers"][0] = device_id;
-    device["name"] = device_name;
-    device["model"] = "M5Paper";
-    device["manufacturer"] = "M5Stack";
-    
-    serializeJson(doc, payload);
-    if (mqttClient.publish(topic, payload, true)) {
-        Serial.printf("Published discovery: %s\n", topic);
-    }
-    delay(50);
-    
-    // CO2 sensor discovery
-    snprintf(topic, sizeof(topic), "homeassistant/sensor/%s_co2/config", device_id);
-    doc.clear();
-    doc["name"] = "CO2";
-    doc["device_class"] = "carbon_dioxide";
-    doc["unit_of_measurement"] = "ppm";
-    doc["state_topic"] = stateTopic;
-    doc["availability_topic"] = availTopic;
-    doc["value_template"] = "{{ value_json.co2 }}";
-    doc["unique_id"] = String(device_id) + "_co2";
-    
-    device = doc["device"].to<JsonObject>();
-    device["identifiers"][0] = device_id;
-    device["name"] = device_name;
-    device["model"] = "M5Paper";
-    device["manufacturer"] = "M5Stack";
-    
-    serializeJson(doc, payload);
+    
+    const int count = sizeof(haEntities) / sizeof(haEntities[0]);
+    for (int i = 0; i < count; i++) {
+        haConfigTopic(topic, sizeof(topic), haDevice, *haEntities[i]);
+        haConfigPayload(payload, sizeof(payload), haDevice, *haEntities[i]);
+        if (mqttClient.publish(topic, payload, true)) {
+            DLOG_I(mqttLog, "Published discovery: %s", topic);
+        }
+        if (i + 1 < count) delay(50);
+    }
+}
+
+// The config version and the outcome of the last config message, and the
+// state of the firmware update (retained)
+void publishDiagnostics() {
+    if (!mqttConnected) return;
+    
+    char topic[100];
+    char payload[768];
+    haTopic(topic, sizeof(topic), haDevice, "diagnostics");
+    payload[0] = '{';
+    size_t length = 1 + config.statusJson(payload + 1, sizeof(payload) - 1);
+    if (length + 2 < sizeof(payload)) {
+        payload[length++] = ',';
+        length += ota.statusJson(payload + length, sizeof(payload) - length);
+    }
+    if (length + 2 < sizeof(payload)) {
+        payload[length++] = ',';
+        length += tlsClient.statusJson(payload + length, sizeof(payload) - length);
+    }
+    if (length + 2 >= sizeof(payload)) return;  // a status cut short is not JSON
+    payload[length++] = '}';
+    payload[length] = 0;
     if (mqttClient.publish(topic, payload, true)) {
-        Serial.printf("Published discovery: %s\n", topic);
+        DLOG_I(mqttLog, "Published diagnostics: %s", payload);
     }
 }
 
@@ -211,7 +371,7 @@ void checkMQTTConnection() {
 }
 
 void connectMQTT() {
-    if (!wifiConnected || millis() - lastMqttReconnect < 5000) return;
+    if (!wifiConnected || (lastMqttReconnect && millis() - lastMqttReconnect < 5000)) return;
     
     // Double-check MQTT is not already connected
     if (mqttClient.connected()) {
@@ -221,61 +381,109 @@ void connectMQTT() {
     
     lastMqttReconnect = millis();
     
-    Serial.printf("Connecting to MQTT broker %s:%d...", mqtt_server, mqtt_port);
-    String clientId = String(device_id) + "_" + String(random(0xffff), HEX);
-    
-    // Set last will message
-    char willTopic[100];
-    snprintf(willTopic, sizeof(willTopic), "homeassistant/sensor/%s/availability", device_id);
+    Serial.printf("Connecting to MQTT broker %s:%u%s...", settings.mqtt_server, (unsigned)settings.mqtt_port,
+                  tlsClient.tls() ? " over TLS" : "");
+    String clientId = String(settings.device_id) + "_" + String(random(0xffff), HEX);
     
-    bool connected = false;
-    if (strlen(mqtt_user) > 0) {
-        Serial.printf(" with auth (user: %s)...", mqtt_user);
-        connected = mqttClient.connect(clientId.c_str(), mqtt_user, mqtt_password, willTopic, 0, true, "offline");
+    if (strlen(settings.mqtt_user) > 0) {
+        Serial.printf(" with auth (user: %s)...", settings.mqtt_user);
     } else {
         Serial.print(" without auth...");
-        connected = mqttClient.connect(clientId.c_str(), willTopic, 0, true, "offline");
     }
+    // Retained "offline" as the last will
+    bool connected = haConnect(mqttClient, haDevice, clientId.c_str(), settings.mqtt_user, settings.mqtt_password);
     
     if (connected) {
         mqttConnected = true;
-        Serial.println(" connected!");
+        if (tlsClient.tls()) {
+            Serial.printf(" connected! (TLS %s in %lu ms)\n", tlsClient.lastResumed() ? "resumed" : "full handshake",
+                          (unsigned long)tlsClient.lastHandshakeMs());
+        } else {
+            Serial.println(" connected!");
+        }
+        // A new firmware on trial reached the broker: it stays
+        deltaOtaConfirm();
         
         // Publish availability
-        mqttClient.publish(willTopic, "online", true);
+        char availTopic[100];
+        haTopic(availTopic, sizeof(availTopic), haDevice, "availability");
+        mqttClient.publish(availTopic, "online", true);
+        
+        // The retained config comes right back, and with every change
+        remoteConfigTopic(configTopic, sizeof(configTopic), settings.device_id);
+        mqttClient.subscribe(configTopic, 1);
         
         // Small delay to ensure connection is stable
         delay(100);
         
         // Publish discovery messages
         publishDiscovery();
+        publishDiagnostics();
     } else {
         int state = mqttClient.state();
         Serial.printf(" failed, rc=%d\n", state);
+        if (tlsClient.tls() && tlsClient.error()[0]) Serial.printf("  TLS: %s\n", tlsClient.error());
+    }
+}
+
+// Publishes a closed statistics window on stats/<name>; one that does not go
+// out stays pending for the next reading
+void publishStats(StatWindow& window) {
+    if (!window.pending() || !mqttConnected || !mqttClient.connected()) return;
+    
+    char topic[100];
+    char payload[384];
+    char level[16];
+    snprintf(level, sizeof(level), "stats/%s", window.name());
+    haTopic(topic, sizeof(topic), haDevice, level);
+    if (window.json(payload, sizeof(payload)) == 0) {
+        window.sent();      // cannot fit; not worth trying again
+        return;
+    }
+    if (mqttClient.publish(topic, payload)) {
+        window.sent();
+        DLOG_I(mqttLog, "Published to %s: %s", topic, payload);
+    }
+}
+
+// Publishes the CO2 analytics on "air"; nothing before the trend has a
+// minute of readings
+void publishAir() {
+    if (!airDue || !mqttConnected || !mqttClient.connected()) return;
+    
+    char topic[100];
+    char payload[128];
+    haTopic(topic, sizeof(topic), haDevice, "air");
+    if (co2Analytics.json(payload, sizeof(payload)) == 0) {
+        airDue = false;     // no trend yet; the next window has one
+        return;
+    }
+    if (mqttClient.publish(topic, payload)) {
+        airDue = false;
+        DLOG_I(mqttLog, "Published to %s: %s", topic, payload);
     }
 }
 
 void publishSensorData() {
+    // With raw_state off a reading goes out only as a 5-minute window closes
+    if (!settings.raw_state && !stateDue) return;
     // Check both flag and actual connection state
-    if (!mqttConnected || !mqttClient.connected() || millis() - lastMqttPublish < 5000) return;
+    if (!mqttConnected || !mqttClient.connected() || millis() - lastMqttPublish < settings.publish_ms) return;
     
     lastMqttPublish = millis();
     
-    JsonDocument doc;
-    doc["temperature"] = lastTemperature;
-    doc["humidity"] = round(lastHumidity);
-    doc["co2"] = lastCO2;
-    
     char payload[256];
-    serializeJson(doc, payload);
+    haStatePayload(payload, sizeof(payload), lastTemperature, lastHumidity, lastCO2);
     
     char topic[100];
-    snprintf(topic, sizeof(topic), "homeassistant/sensor/%s/state", device_id);
+    haTopic(topic, sizeof(topic), haDevice, "state");
     
     if (mqttClient.publish(topic, payload)) {
-        Serial.printf("Published to %s: %s\n", topic, payload);
+        DLOG_I(mqttLog, "Published to %s: %s", topic, payload);
+        boot.milestone("first publish");
+        stateDue = false;
     } else {
-        Serial.println("Failed to publish sensor data!");
+        DLOG_W(mqttLog, "Failed to publish sensor data!");
         // Force reconnection on next loop
         mqttConnected = false;
     }
@@ -295,8 +503,8 @@ void performCalibration() {
     }
     delay(500);
     
-    // Perform forced recalibration to 420 ppm (current outdoor CO2 level)
-    error = scd4x.performForcedRecalibration(420, frcCorrection);
+    // Perform forced recalibration to the outdoor CO2 level (420 ppm unless configured)
+    error = scd4x.performForcedRecalibration(settings.frc_ppm, frcCorrection);
     
     if (error) {
         Serial.print("Calibration failed: ");
@@ -309,7 +517,7 @@ void performCalibration() {
         canvas.drawString("FAILED!", 100, 250);
         canvas.pushCanvas(0, 0, UPDATE_MODE_DU4);
     } else {
-        Serial.printf("Calibration successful! Set to 420 ppm, correction: %d\n", frcCorrection);
+        Serial.printf("Calibration successful! Set to %u ppm, correction: %d\n", (unsigned)settings.frc_ppm, frcCorrection);
         
         // Save calibration timestamp
         preferences.begin("scd40", false);
@@ -320,7 +528,9 @@ void performCalibration() {
         canvas.setTextSize(4);
         canvas.drawString("Calibration", 100, 200);
         canvas.drawString("SUCCESS!", 100, 250);
-        canvas.drawString("420 ppm set", 100, 300);
+        char ppmStr[32];
+        snprintf(ppmStr, sizeof(ppmStr), "%u ppm set", (unsigned)settings.frc_ppm);
+        canvas.drawString(ppmStr, 100, 300);
         canvas.pushCanvas(0, 0, UPDATE_MODE_DU4);
     }
     
@@ -337,70 +547,221 @@ void performCalibration() {
     calibrationMode = false;
 }
 
-void setup() {
-    // Initialize M5Paper
-    M5.begin();
-    M5.EPD.SetRotation(0);  // Native landscape orientation
-    M5.EPD.Clear(true);
-    
-    Serial.begin(115200);
-    delay(1000);
-    Serial.println("\n=== SCD40 Temperature & Humidity Monitor (M5Paper v1.1) ===");
-    
-    // Create canvas in native resolution
-    canvas.createCanvas(960, 540);
-    canvas.setTextSize(3);
-    
-    // Show initialization message
-    canvas.fillCanvas(0);
-    canvas.drawString("Initializing SCD40...", 50, 200);
-    canvas.pushCanvas(0, 0, UPDATE_MODE_DU4);
+// A message on the config topic: checked and applied, the reconnects it
+// needs are left to applyConfig()
+void onMqttMessage(char* topic, byte* payload, unsigned int length) {
+    if (strcmp(topic, configTopic) != 0) return;
+    ConfigResult result = config.apply(payload, length);
+    if (result.status == CONFIG_UNCHANGED) return;
+    configReport = true;
+    if (result.status == CONFIG_INVALID) {
+        Serial.printf("Config rejected: %s\n", config.error());
+        return;
+    }
+    Serial.printf("Config version %u received\n", (unsigned)config.version());
+    configActions |= result.apply;
+    configAppliedAt = millis();
+}
+
+// The SCD40 takes settings only while idle
+void configureSensor() {
+    scd4x.stopPeriodicMeasurement();
+    delay(500);
+    scd4x.setAutomaticSelfCalibration(settings.asc);
+    scd4x.setTemperatureOffset(settings.temp_offset);
+    uint16_t error = scd4x.startPeriodicMeasurement();
+    Serial.printf("SCD40: ASC %s, temperature offset %.1f%s\n", settings.asc ? "on" : "off", settings.temp_offset,
+                  error ? ", restart failed" : "");
+}
+
+// Carries out what a config message changed: the SCD40 settings at once, a
+// reconnect for WiFi, broker or identity changes. Those are committed once
+// the broker is back with them, and reverted otherwise.
+void applyConfig() {
+    if (configActions & CONFIG_APPLY_SENSOR) {
+        configActions &= ~CONFIG_APPLY_SENSOR;
+        configureSensor();
+    }
+    if (configActions & CONFIG_APPLY_OTA) {
+        configActions &= ~CONFIG_APPLY_OTA;
+        otaCheckDue = true;
+    }
     
-    // Initialize I2C on Port A - M5Paper uses Wire1 for external I2C
-    Wire1.begin(PortA_SDA, PortA_SCL);
-    Serial.printf("I2C initialized on Port A using Wire1 (SDA=%d, SCL=%d)\n", PortA_SDA, PortA_SCL);
-    
-    // Scan for I2C devices on external bus
-    Serial.println("Scanning for I2C devices on Port A...");
-    for (int address = 1; address < 127; address++) {
-        Wire1.beginTransmission(address);
-        int error = Wire1.endTransmission();
-        if (error == 0) {
-            Serial.printf("I2C device found at address 0x%02X\n", address);
+    uint8_t reconnect = configActions & (CONFIG_APPLY_WIFI | CONFIG_APPLY_MQTT | CONFIG_APPLY_IDENTITY);
+    if (reconnect) {
+        configActions &= ~reconnect;
+        if (config.pending()) configReconnects |= reconnect;
+        if ((reconnect & CONFIG_APPLY_IDENTITY) && mqttConnected) {
+            // The old id's entities leave Home Assistant and its config goes
+            const Settings* old = (const Settings*)config.previous();
+            HaDevice oldDevice = {old->device_id, old->device_name, haDevice.model};
+            haClearIdentity(oldDevice, haEntities, sizeof(haEntities) / sizeof(haEntities[0]),
+                            [](const char* topic, const char* payload) { mqttClient.publish(topic, payload, true); });
+            char topic[200];
+            remoteConfigTopic(topic, sizeof(topic), old->device_id);
+            mqttClient.publish(topic, "", true);
+        }
+        Serial.println("Config: reconnecting with the new settings");
+        mqttClient.disconnect();
+        tlsClient.setTls(settings.mqtt_tls);
+        mqttClient.setServer(settings.mqtt_server, settings.mqtt_port);
+        mqttConnected = false;
+        lastMqttReconnect = 0;
+        if (reconnect & CONFIG_APPLY_WIFI) {
+            WiFi.disconnect();
+            wifiConnected = false;
+            lastWifiCheck = millis() - settings.wifi_check_ms;  // checked on the next pass
         }
     }
-    Serial.println("I2C scan complete.");
-    
-    // Initialize SCD40 sensor
-    uint16_t error;
-    char errorMessage[256];
-    
-    scd4x.begin(Wire1);  // Use Wire1 for external I2C
     
-    // Stop any potentially running measurement
-    error = scd4x.stopPeriodicMeasurement();
-    if (error) {
-        Serial.print("Error stopping measurement: ");
-        errorToString(error, errorMessage, 256);
-        Serial.println(errorMessage);
+    if (config.pending()) {
+        if (!configReconnects) {
+            config.commit();
+        } else if (mqttConnected) {
+            // Connected, and discovery is out under the new settings
+            config.commit();
+            configReconnects = 0;
+        } else if (millis() - configAppliedAt > CONFIG_CONFIRM_TIMEOUT) {
+            config.revert("no broker");
+            configActions |= configReconnects;
+            configReconnects = 0;
+        } else {
+            return;
+        }
+        Serial.printf("Config version %u: %s\n", (unsigned)config.version(), config.error());
+        configReport = true;
+    }
+    if (configReport && mqttConnected) {
+        configReport = false;
+        publishDiagnostics();
+    }
+}
+
+// The update's progress as a bar along the bottom edge, over what the canvas
+// shows
+void drawOtaBar() {
+    if (ota.state() != DELTA_OTA_DOWNLOADING) return;
+    canvas.drawLine(20, 534, 940, 534, 15);
+    canvas.fillRect(20, 528, 920 * ota.progress() / 100, 6, 15);
+}
+
+// Starts a manifest check when one is due and moves an update on by up to
+// OTA_POLL_BUDGET; a new image is restarted into at once, on trial until it
+// reaches the broker
+void updateOta() {
+    deltaOtaCheckTrial();
+    if (!ota.active()) {
+        bool due = otaCheckDue ||
+                   (settings.ota_check_min && millis() - lastOtaCheck > settings.ota_check_min * 60000UL);
+        if (!due || !mqttConnected || settings.ota_url[0] == 0) return;
+        otaCheckDue = false;
+        lastOtaCheck = millis();
+        otaShownStep = -1;
+        ota.check(settings.ota_url);
     }
-    delay(500);
     
-    // Disable Automatic Self-Calibration for better accuracy
-    error = scd4x.setAutomaticSelfCalibration(0);
-    if (error) {
-        Serial.print("Error disabling ASC: ");
-        errorToString(error, errorMessage, 256);
-        Serial.println(errorMessage);
+    DeltaOtaState state = ota.poll(OTA_POLL_BUDGET);
+    if (state == DELTA_OTA_DOWNLOADING && ota.progress() / OTA_PROGRESS_STEP != otaShownStep) {
+        otaShownStep = ota.progress() / OTA_PROGRESS_STEP;
+        drawOtaBar();
+        canvas.pushCanvas(0, 0, UPDATE_MODE_DU4);
+    }
+    if (state == otaLastState) return;
+    otaLastState = state;
+    const DeltaOtaStats& stats = ota.stats();
+    switch (state) {
+        case DELTA_OTA_DOWNLOADING:
+            Serial.printf("OTA: updating to %s (%s)\n", ota.version(), stats.oldSize ? "patch" : "whole image");
+            break;
+        case DELTA_OTA_UP_TO_DATE:
+            DLOG_I(mqttLog, "OTA: up to date (%s)", ota.version());
+            break;
+        case DELTA_OTA_FAILED:
+            Serial.printf("OTA: %s\n", ota.error());
+            publishDiagnostics();
+            break;
+        case DELTA_OTA_READY:
+            Serial.printf("OTA: %s ready, %u bytes downloaded for %u in %u ms; restarting\n", ota.version(),
+                          (unsigned)stats.patchBytes, (unsigned)stats.imageBytes, (unsigned)stats.patchMs);
+            publishDiagnostics();
+            deltaOtaRestart();
+            break;
+        default:
+            break;
     }
+}
+
+// connectMQTT() tries at most every 5 seconds; each try blocks until the
+// broker answers or the connection times out
+BootStatus bootMQTT(BootStage& stage) {
+    if (stage.phase == 0) {
+        tlsClient.setCaCert(mqtt_ca);
+        tlsClient.setTls(settings.mqtt_tls);
+        mqttClient.setServer(settings.mqtt_server, settings.mqtt_port);
+        mqttClient.setBufferSize(1024);
+        mqttClient.setCallback(onMqttMessage);
+        stage.next();
+    }
+    connectMQTT();
+    return mqttConnected ? BOOT_DONE : BOOT_RUNNING;
+}
+
+// The compiled-in defaults, then what NVS has from the config topic
+void loadSettings() {
+    snprintf(settings.ssid, sizeof(settings.ssid), "%s", ssid);
+    snprintf(settings.password, sizeof(settings.password), "%s", password);
+    snprintf(settings.mqtt_server, sizeof(settings.mqtt_server), "%s", mqtt_server);
+    settings.mqtt_port = mqtt_port;
+    snprintf(settings.mqtt_user, sizeof(settings.mqtt_user), "%s", mqtt_user);
+    snprintf(settings.mqtt_password, sizeof(settings.mqtt_password), "%s", mqtt_password);
+    settings.mqtt_tls = mqtt_tls;
+    snprintf(settings.device_name, sizeof(settings.device_name), "%s", device_name);
+    snprintf(settings.device_id, sizeof(settings.device_id), "%s", device_id);
+    settings.publish_ms = PUBLISH_INTERVAL;
+    settings.raw_state = true;      // every reading on "state"
+    settings.wifi_check_ms = WIFI_CHECK_INTERVAL;
+    settings.asc = false;
+    settings.temp_offset = 4.0f;    // the SCD40's factory offset
+    settings.room_m3 = 40.0f;       // 4 x 4 m, 2.5 m high
+    settings.frc_ppm = CALIBRATION_PPM;
+    settings.calib_wait_s = CALIBRATION_DURATION / 1000;
+    snprintf(settings.ota_url, sizeof(settings.ota_url), "%s", ota_url);
+    settings.ota_check_min = OTA_CHECK_INTERVAL_MIN;
+    config.begin();
+    remoteConfigTopic(configTopic, sizeof(configTopic), settings.device_id);
+    Serial.printf("Config version %u (%s), device %s\n", (unsigned)config.version(), config.error(),
+                  settings.device_id);
+}
+
+// The Arduino core marks a new firmware valid before setup() unless this says
+// it will be checked later: deltaOtaConfirm() does, once the broker is reached
+extern "C" bool verifyRollbackLater() {
+    return true;
+}
+
+void setup() {
+    // Initialize M5Paper
+    M5.begin();
     
-    // Start periodic measurement
-    error = scd4x.startPeriodicMeasurement();
-    if (error) {
-        Serial.print("Error starting measurement: ");
-        errorToString(error, errorMessage, 256);
-        Serial.println(errorMessage);
-        
+    Serial.begin(115200);
+    deferLogBegin(Serial);
+    // A new firmware that keeps failing goes back to the previous one here
+    deltaOtaBoot(Serial);
+    Serial.println("\n=== SCD40 Temperature & Humidity Monitor (M5Paper v1.1) ===");
+    loadSettings();
+    
+    // WiFi association, the SCD40 restart and the first e-paper refresh
+    // overlap; loop() draws the first reading as soon as the sensor has one
+    uint32_t wifi = boot.add("wifi", bootWiFi);       // times out in WiFiFast
+    uint32_t sensor = boot.add("scd40", bootSensor);
+    boot.add("display", bootDisplay);
+    boot.add("mqtt", bootMQTT, wifi, 8000);
+    boot.run();
+    boot.report(Serial);
+    printWiFiFastStats(Serial);
+    if (tlsClient.tls()) printTlsStats(Serial);
+    
+    if (!boot.done(sensor)) {
         canvas.fillCanvas(0);
         canvas.setTextSize(4);
         canvas.drawString("SCD40 Failed!", 50, 200);
@@ -410,51 +771,13 @@ void setup() {
         while(1) delay(1000); // Stop here if init failed
     }
     
-    Serial.println("SCD40 initialized successfully!");
-    Serial.println("Waiting for first measurement (5 seconds)...");
-    
-    canvas.fillCanvas(0);
-    canvas.setTextSize(4);
-    canvas.drawString("SCD40 Ready!", 50, 200);
-    canvas.drawString("Waiting for data...", 50, 260);
-    canvas.pushCanvas(0, 0, UPDATE_MODE_DU4);
-    
-    // Wait for first measurement
-    delay(5000);
-    
-    // Check last calibration time
-    preferences.begin("scd40", true);
-    unsigned long lastCalib = preferences.getULong("lastCalib", 0);
-    preferences.end();
-    
-    if (lastCalib == 0) {
-        Serial.println("Note: Sensor has never been calibrated");
-        Serial.println("Press center button for 3 seconds to start calibration");
-    } else {
-        Serial.printf("Last calibration: %lu ms ago\n", millis() - lastCalib);
-    }
-    
-    // Setup WiFi and MQTT
     canvas.fillCanvas(0);
     canvas.setTextSize(3);
-    canvas.drawString("Connecting to WiFi...", 50, 200);
-    canvas.pushCanvas(0, 0, UPDATE_MODE_DU4);
-    
-    setupWiFi();
-    
     if (wifiConnected) {
-        canvas.fillCanvas(0);
-        canvas.setTextSize(3);
         canvas.drawString("WiFi Connected!", 50, 200);
         char ipStr[32];
         snprintf(ipStr, sizeof(ipStr), "IP: %s", WiFi.localIP().toString().c_str());
         canvas.drawString(ipStr, 50, 250);
-        canvas.pushCanvas(0, 0, UPDATE_MODE_DU4);
-        
-        // Setup MQTT
-        mqttClient.setServer(mqtt_server, mqtt_port);
-        mqttClient.setBufferSize(1024);
-        connectMQTT();
         
         if (mqttConnected) {
             canvas.drawString("MQTT: Connected to Home Assistant", 50, 300);
@@ -462,13 +785,12 @@ void setup() {
             canvas.drawString("MQTT: Failed to connect", 50, 300);
         }
     } else {
-        canvas.fillCanvas(0);
-        canvas.setTextSize(3);
+        Serial.println("WiFi connection failed!");
         canvas.drawString("WiFi: Connection failed", 50, 200);
         canvas.drawString("Running in offline mode", 50, 250);
     }
+    canvas.drawString("Waiting for data...", 50, 400);
     canvas.pushCanvas(0, 0, UPDATE_MODE_DU4);
-    delay(3000);
 }
 
 void loop() {
@@ -490,6 +812,12 @@ void loop() {
         }
     }
     
+    // Changes from the config topic
+    applyConfig();
+    
+    // Firmware update, a slice per pass
+    updateOta();
+    
     // Check wheel control for calibration mode
     // M5Paper has a wheel: rotate UP/Left (BtnL/G37), push (BtnP/G38), rotate DOWN/Right (BtnR/G39)
     M5.update();
@@ -502,7 +830,9 @@ void loop() {
         canvas.setTextSize(4);
         canvas.drawString("CALIBRATION MODE", 250, 100);
         canvas.drawString("Take device outside!", 230, 180);
-        canvas.drawString("Wait 15 seconds", 280, 260);
+        char waitStr[32];
+        snprintf(waitStr, sizeof(waitStr), "Wait %u seconds", (unsigned)settings.calib_wait_s);
+        canvas.drawString(waitStr, 280, 260);
         canvas.drawString("Rotate wheel DOWN", 260, 340);
         canvas.drawString("to calibrate", 320, 400);
         canvas.pushCanvas(0, 0, UPDATE_MODE_DU4);
@@ -520,11 +850,12 @@ void loop() {
         canvas.drawString("Stabilizing...", 320, 240);
         
         char timeStr[32];
-        unsigned long remaining = (CALIBRATION_DURATION - elapsed) / 1000;
+        unsigned long calibrationDuration = settings.calib_wait_s * 1000UL;
+        unsigned long remaining = elapsed < calibrationDuration ? (calibrationDuration - elapsed) / 1000 : 0;
         snprintf(timeStr, sizeof(timeStr), "Wait: %lu seconds", remaining);
         canvas.drawString(timeStr, 280, 320);
         
-        if (elapsed >= CALIBRATION_DURATION) {
+        if (elapsed >= calibrationDuration) {
             canvas.setTextSize(6);
             canvas.drawString("READY!", 360, 380);
             canvas.setTextSize(3);
@@ -606,20 +937,27 @@ void loop() {
         canvas.pushCanvas(0, 0, UPDATE_MODE_DU4);
         
     } else if (co2 == 0) {
-        Serial.println("Invalid sample (CO2=0), skipping...");
+        DLOG_W(sensorLog, "Invalid sample (CO2=0), skipping...");
         
     } else {
         // Valid measurement received
-        Serial.printf("Temperature: %.1f°C, Humidity: %.1f%%, CO2: %d ppm\n", 
-                     temperature, humidity, co2);
+        DLOG_I(sensorLog, "Temperature: %.1f°C, Humidity: %.1f%%, CO2: %d ppm", temperature, humidity, co2);
         
         // Store values for MQTT
         lastTemperature = temperature;
         lastHumidity = humidity;
         lastCO2 = co2;
         
+        if (stats5m.add(millis(), temperature, humidity, co2)) stateDue = airDue = true;
+        stats1h.add(millis(), temperature, humidity, co2);
+        co2Analytics.setRoom(settings.room_m3);
+        co2Analytics.add(millis(), co2);
+        
         // Publish to MQTT if connected
         publishSensorData();
+        publishStats(stats5m);
+        publishStats(stats1h);
+        publishAir();
         
         // Force a full display clear on first valid reading to remove any artifacts
         static bool firstReading = true;
@@ -687,6 +1025,7 @@ void loop() {
         
         // Push the updated canvas to display
         canvas.pushCanvas(0, 0, UPDATE_MODE_DU4);
+        boot.milestone("first render");
         
         // Set flag to show inverted display on next update
         invertDisplay = true;
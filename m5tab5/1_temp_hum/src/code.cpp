@@ -1,9 +1,29 @@
 #include <M5Unified.h>
 #include <Wire.h>
 #include <WiFi.h>
-#include <PubSubClient.h>
 #include <ArduinoJson.h>
 #include <SensirionI2CScd4x.h>
+#include <input_trace.h>
+#include <polar_raster.h>
+#include <message_bus.h>
+#include <co_task.h>
+#include <deferlog.h>
+#include <telemetry.h>
+#include <span_trace.h>
+#include <loop_watch.h>
+#include <boot_sequence.h>
+#include <wifi_fast.h>
+#include <mqtt_pipe.h>
+#include <cbor_pack.h>
+#include <ha_device.h>
+#include <remote_config.h>
+#include <delta_ota.h>
+#include <tls_client.h>
+#include <window_stats.h>
+#include <co2_analytics.h>
+#ifdef HUB_MODE
+#include <room_hub.h>
+#endif
 
 // SDIO pins for WiFi communication with ESP32-C6
 #define SDIO2_CLK GPIO_NUM_12
@@ -23,14 +43,104 @@ const char* mqtt_server = "192.168.2.176";
 const int mqtt_port = 1883;
 const char* mqtt_user = "mqtt_user";  // UPDATE with your MQTT username
 const char* mqtt_password = "mqtt";  // UPDATE with your MQTT password
+// MQTT over TLS (see lib/TlsClient), off until mqtt_tls is set (and
+// mqtt_port, to 8883 as a rule): the PEM of the CA that signed the broker's
+// certificate; tools/tls_bench --make-certs makes an ECDSA pair
+const bool mqtt_tls = false;
+const char* mqtt_ca = "";
 
 // Device identification
 const char* device_name = "M5Tab5_No_1";
 const char* device_id = "m5tab5_no_1";
 
-// MQTT clients
+// Firmware updates (see lib/DeltaOta): the manifest tools/ota_delta made, on
+// an HTTP server on the LAN; empty for none
+const char* ota_url = "";
+
+// The values above and the intervals and SCD40 settings below are the
+// defaults; setup() copies them into `settings`, NVS and the retained
+// m5env/<device_id>/config topic override them there (see lib/RemoteConfig).
+// The rest of the firmware reads `settings` only.
+struct Settings {
+    char ssid[33];
+    char password[65];
+    char mqtt_server[64];
+    uint32_t mqtt_port;
+    char mqtt_user[33];
+    char mqtt_password[65];
+    bool mqtt_tls;
+    char device_name[32];
+    char device_id[32];
+    uint32_t publish_ms;
+    bool raw_state;
+    uint32_t wifi_check_ms;
+    bool asc;
+    float temp_offset;
+    float room_m3;
+    char ota_url[128];
+    uint32_t ota_check_min;
+};
+
+Settings settings;
+const ConfigField settingsFields[] = {
+    CONFIG_STRING(Settings, ssid, 1, CONFIG_APPLY_WIFI),
+    CONFIG_SECRET(Settings, password, 0, CONFIG_APPLY_WIFI),
+    CONFIG_STRING(Settings, mqtt_server, 1, CONFIG_APPLY_MQTT),
+    CONFIG_UINT32(Settings, mqtt_port, 1, 65535, CONFIG_APPLY_MQTT),
+    CONFIG_STRING(Settings, mqtt_user, 0, CONFIG_APPLY_MQTT),
+    CONFIG_SECRET(Settings, mqtt_password, 0, CONFIG_APPLY_MQTT),
+    CONFIG_BOOL(Settings, mqtt_tls, CONFIG_APPLY_MQTT),
+    CONFIG_STRING(Settings, device_name, 1, CONFIG_APPLY_IDENTITY),
+    CONFIG_STRING(Settings, device_id, 1, CONFIG_APPLY_IDENTITY),
+    CONFIG_UINT32(Settings, publish_ms, 5000, 3600000, CONFIG_APPLY_NOW),
+    CONFIG_BOOL(Settings, raw_state, CONFIG_APPLY_NOW),
+    CONFIG_UINT32(Settings, wifi_check_ms, 5000, 600000, CONFIG_APPLY_NOW),
+    CONFIG_BOOL(Settings, asc, CONFIG_APPLY_SENSOR),
+    CONFIG_FLOAT(Settings, temp_offset, 0, 20, CONFIG_APPLY_SENSOR),
+    CONFIG_FLOAT(Settings, room_m3, 5, 5000, CONFIG_APPLY_NOW),
+    CONFIG_STRING(Settings, ota_url, 0, CONFIG_APPLY_OTA),
+    CONFIG_UINT32(Settings, ota_check_min, 0, 10080, CONFIG_APPLY_NOW),
+};
+const ConfigSchema settingsSchema = CONFIG_SCHEMA(settingsFields, Settings);
+RemoteConfig config(settingsSchema, &settings);
+HaDevice haDevice = {settings.device_id, settings.device_name, "M5Tab5"};
+// What the discovery announces, and an id change takes back: temperature,
+// humidity and CO2, their 5-minute and hourly statistics, the CO2 trend, air
+// changes and occupancy, then the loop stall diagnostics (the histogram per
+// cause is in the attributes); see lib/HaDevice
+const HaEntity* const haEntities[] = {&HA_SCD40_ENTITIES[0], &HA_SCD40_ENTITIES[1], &HA_SCD40_ENTITIES[2],
+                                      &HA_STATS_ENTITIES[0], &HA_STATS_ENTITIES[1], &HA_STATS_ENTITIES[2],
+                                      &HA_STATS_ENTITIES[3], &HA_STATS_ENTITIES[4], &HA_STATS_ENTITIES[5],
+                                      &HA_AIR_ENTITIES[0], &HA_AIR_ENTITIES[1], &HA_AIR_ENTITIES[2],
+                                      &HA_LOOP_STALLS_ENTITY};
+
+// A config message is applied from loop(); one that needs a reconnect is
+// committed once the broker is back with it, or reverted after
+// CONFIG_CONFIRM_TIMEOUT
+char configTopic[80];
+uint8_t configActions = 0;      // CONFIG_APPLY_* flags still to carry out
+uint8_t configReconnects = 0;   // the reconnects the pending config needed
+bool configReport = false;      // diagnostics to publish with the outcome
+unsigned long configAppliedAt = 0;
+const unsigned long CONFIG_CONFIRM_TIMEOUT = 60000;
+
+// MQTT clients; readings go out as QoS 1 with up to MQTT_PIPE_MAX_WINDOW in flight,
+// over TLS when mqtt_tls is set (a reconnect resumes the last session)
 WiFiClient wifiClient;
-PubSubClient mqttClient(wifiClient);
+TlsClient tlsClient(wifiClient);
+MqttPipe mqttClient(tlsClient);
+
+// Firmware updates: the manifest is checked once the broker is reached, then
+// every ota_check_min minutes (0: only when ota_url changes); a patch is
+// downloaded and applied a slice per loop() pass, so readings go on
+WiFiClient otaClient;
+DeltaOta ota(otaClient);
+bool otaCheckDue = true;
+unsigned long lastOtaCheck = 0;
+int otaShownProgress = -1;      // on the display; -1 draws it again
+DeltaOtaState otaLastState = DELTA_OTA_IDLE;
+const uint32_t OTA_POLL_BUDGET = 30;
+const uint32_t OTA_CHECK_INTERVAL_MIN = 60;
 
 // Button to republish discovery
 unsigned long lastButtonCheck = 0;
@@ -42,7 +152,41 @@ SensirionI2CScd4x scd4x;
 const int GROVE_SDA = 53;
 const int GROVE_SCL = 54;
 
-// Sensor data
+// Readings go out on the bus once; history, the Serial log, MQTT and the
+// display each take them from their own subscription. New consumers (SD log,
+// alerts) subscribe here instead of being called from loop().
+struct SensorReading {
+    float temperature;
+    float humidity;
+    uint16_t co2;
+};
+
+Topic<SensorReading, 8> sensorReadings("sensor/reading");
+Subscriber<SensorReading> historyInbox(sensorReadings, "history", DROP_OLDEST);
+Subscriber<SensorReading> logInbox(sensorReadings, "serial", DROP_OLDEST);
+Subscriber<SensorReading> mqttInbox(sensorReadings, "mqtt", COALESCE_LATEST);
+Subscriber<SensorReading> displayInbox(sensorReadings, "display", COALESCE_LATEST);
+Subscriber<SensorReading> statsInbox(sensorReadings, "stats", DROP_OLDEST);
+MessageRef<SensorReading> pendingPublish;   // newest reading MQTT has not sent yet
+
+// Home Assistant records the 5-minute and hourly statistics of the readings
+// (mean, min, max, last) from their own topics, one message per window (see
+// lib/WindowStats). With raw_state off, "state" gets a reading only as a
+// 5-minute window closes, so Home Assistant records 25 messages an hour
+// from the device (37 with the "air" topic) instead of 720.
+StatWindow stats5m(300000, "5m");
+StatWindow stats1h(3600000, "1h");
+bool stateDue = false;          // with raw_state off: a window closed, the next reading goes out
+
+// The CO2 trend, the air changes measured from decays and the occupancy they
+// imply (see lib/Co2Analytics), on the "air" topic as each 5-minute window
+// closes; occupancy takes room_m3
+Co2Analytics co2Analytics;
+bool airDue = false;
+unsigned long lastBusMetrics = 0;
+const unsigned long BUS_METRICS_INTERVAL = 300000;  // Print bus metrics every 5 minutes
+
+// Latest reading as shown on the display
 float temperature = 22.5;
 float humidity = 45.0;
 uint16_t co2 = 650;
@@ -58,6 +202,28 @@ uint16_t co2History[HISTORY_SIZE] = {0};
 int historyIndex = 0;
 bool historyFull = false;
 
+// The last HISTORY_BATCH_SIZE readings go out together on the history topic,
+// as JSON or, built with -DPAYLOAD_CBOR, as CBOR (see lib/CborPack) that
+// tools/cbor_bridge republishes as JSON. The topic ends in the encoding.
+struct HistoryRow {
+    uint32_t t;             // seconds since boot
+    float temperature;
+    float humidity;
+    uint16_t co2;
+};
+
+const CborField historyFields[] = {
+    CBOR_FIELD(HistoryRow, t, CBOR_UINT32),
+    CBOR_FIELD(HistoryRow, temperature, CBOR_HALF),
+    CBOR_FIELD(HistoryRow, humidity, CBOR_HALF),
+    CBOR_FIELD(HistoryRow, co2, CBOR_UINT16),
+};
+const CborSchema historySchema = CBOR_SCHEMA(historyFields);
+
+const int HISTORY_BATCH_SIZE = 12;  // About a minute of readings
+HistoryRow historyBatch[HISTORY_BATCH_SIZE];
+int historyBatchCount = 0;
+
 // Display dimensions
 const int SCREEN_WIDTH = 1280;
 const int SCREEN_HEIGHT = 720;
@@ -65,12 +231,83 @@ const int SCREEN_HEIGHT = 720;
 // Network status
 bool wifiConnected = false;
 bool mqttConnected = false;
-unsigned long lastMqttPublish = 0;
-unsigned long lastMqttReconnect = 0;
+bool offlineNote = false;  // "Offline Mode" is in the header
 unsigned long lastWifiCheck = 0;
 unsigned long lastMqttCheck = 0;
-const unsigned long WIFI_CHECK_INTERVAL = 30000;  // Check WiFi every 30 seconds
+const unsigned long WIFI_CHECK_INTERVAL = 30000;  // Check WiFi every 30 seconds (default)
 const unsigned long MQTT_CHECK_INTERVAL = 30000;  // Check MQTT every 30 seconds
+const unsigned long MQTT_RETRY_INTERVAL = 5000;
+const unsigned long PUBLISH_INTERVAL = 5000;      // Read and publish every 5 seconds (default)
+
+// Reconnection runs as coroutines polled from loop(), so waiting for WiFi or
+// between broker retries no longer stalls readings and the display
+CoTaskId wifiTask = 0;
+CoTaskId mqttTask = 0;
+CoTaskId sensorTask = 0;
+
+// Per-reading messages go through the deferred log (see lib/DeferLog)
+DeferLogModule sensorLog("sensor", DLOG_INFO);
+DeferLogModule mqttLog("mqtt", DLOG_INFO);
+
+// A loop() slower than SPAN_TRACE_LOOP_TRIGGER_MS freezes the span trace (see
+// lib/SpanTrace); it is then written to Serial as "@spt" lines and recording
+// starts again after SPAN_TRACE_REARM_INTERVAL
+const unsigned long SPAN_TRACE_REARM_INTERVAL = 600000;
+
+// loop() is marked into sections for the loop watchdog (see lib/LoopWatch);
+// its stall histogram survives resets and goes to Home Assistant as a
+// diagnostic sensor
+unsigned long lastDiagnostics = 0;
+const unsigned long DIAGNOSTICS_INTERVAL = 600000;  // Publish the stall histogram every 10 minutes
+
+#ifdef HUB_MODE
+// Hub mode (-DHUB_MODE, pio run -e esp32p4_hub): the screen is a grid of
+// tiles, one per monitor publishing on the broker, this one included (see
+// lib/RoomHub). A tile is drawn again only when its device published or went
+// stale, and at most HUB_TILES_PER_PASS of them per loop() pass, so a burst of
+// messages cannot hold up the loop.
+RoomHub hub;
+const uint16_t HUB_MAX_DEVICES = 256;
+const uint16_t HUB_HISTORY = 360;               // half an hour at 5 s
+const int HUB_TILES_PER_PASS = 24;
+const int HUB_GRID_TOP = 100;
+const int HUB_GRID_HEIGHT = 580;
+const unsigned long HUB_STALE_CHECK_INTERVAL = 1000;
+int hubColumns = 0, hubRows = 0;
+uint16_t hubSweep = 0;          // next tile of a full repaint; count() when none is going on
+unsigned long lastHubStaleCheck = 0;
+#endif
+
+// setup() runs its init steps as boot stages side by side (see
+// lib/BootSequence); the stage timings and the time to the first rendered
+// reading and the first publish go to Serial
+BootSequence boot;
+
+// Function declarations
+bool mqttPublish(const char* topic, const char* payload, bool retained = false, uint8_t qos = 0);
+bool mqttPublish(const char* topic, const uint8_t* payload, size_t length, bool retained = false, uint8_t qos = 0);
+void publishHistory();
+void publishStats(StatWindow& window);
+void publishAir();
+void recordTraceInputs();
+void deliverReadings();
+void exportSpanTrace();
+void publishDiagnostics();
+bool readSensor();
+void updateDisplay();
+void clearOfflineNote();
+bool connectMQTT();
+CoTask reconnectWiFi();
+CoTask reconnectMQTT();
+CoTask reconfigureSensor();
+void onMqttMessage(const char* topic, const uint8_t* payload, size_t length, void*);
+void applyConfig();
+void updateOta();
+void drawOtaProgress();
+#ifdef HUB_MODE
+void updateHubDisplay();
+void updateHubStatus();
+#endif
 
 // Colors
 #define BG_COLOR TFT_BLACK
@@ -121,18 +358,9 @@ void drawGauge(int cx, int cy, int radius, float value, float minVal, float maxV
     M5.Display.drawCircle(cx, cy, radius, TEXT_SECONDARY);
     M5.Display.drawCircle(cx, cy, radius-1, TEXT_SECONDARY);
     
-    // Draw arc based on value
+    // Draw arc based on value, as one filled annular sector
     float angle = map(value * 100, minVal * 100, maxVal * 100, -135, 135);
-    int segments = 20;
-    for (int i = -135; i <= angle; i += 270/segments) {
-        float rad = i * PI / 180;
-        int x1 = cx + (radius - 10) * cos(rad);
-        int y1 = cy + (radius - 10) * sin(rad);
-        int x2 = cx + (radius - 5) * cos(rad);
-        int y2 = cy + (radius - 5) * sin(rad);
-        M5.Display.drawLine(x1, y1, x2, y2, color);
-        M5.Display.drawLine(x1, y1+1, x2, y2+1, color);
-    }
+    fillPolarArc(M5.Display, cx, cy, radius - 10, radius - 5, polarAngle(-135), polarSweep(angle + 135), color);
     
     // Draw value
     M5.Display.setTextColor(color);
@@ -185,10 +413,10 @@ void drawGraph(int x, int y, int w, int h, float* data, int dataSize, uint16_t c
     }
 }
 
-void updateHistory() {
-    tempHistory[historyIndex] = temperature;
-    humHistory[historyIndex] = humidity;
-    co2History[historyIndex] = co2;
+void updateHistory(const SensorReading& reading) {
+    tempHistory[historyIndex] = reading.temperature;
+    humHistory[historyIndex] = reading.humidity;
+    co2History[historyIndex] = reading.co2;
     
     historyIndex++;
     if (historyIndex >= HISTORY_SIZE) {
@@ -197,159 +425,229 @@ void updateHistory() {
     }
     
     // Update min/max
-    if (temperature < tempMin) tempMin = temperature;
-    if (temperature > tempMax) tempMax = temperature;
-    if (humidity < humMin) humMin = humidity;
-    if (humidity > humMax) humMax = humidity;
-    if (co2 < co2Min) co2Min = co2;
-    if (co2 > co2Max) co2Max = co2;
+    if (reading.temperature < tempMin) tempMin = reading.temperature;
+    if (reading.temperature > tempMax) tempMax = reading.temperature;
+    if (reading.humidity < humMin) humMin = reading.humidity;
+    if (reading.humidity > humMax) humMax = reading.humidity;
+    if (reading.co2 < co2Min) co2Min = reading.co2;
+    if (reading.co2 > co2Max) co2Max = reading.co2;
+}
+
+// Boot stages: each one is called again until it is done and must not block
+
+BootStatus bootWiFi(BootStage& stage) {
+    if (stage.phase == 0) {
+        Serial.println("Setting up WiFi...");
+        M5.Display.setTextColor(TEXT_SECONDARY);
+        M5.Display.setTextSize(2);
+        M5.Display.setCursor(50, 120);
+        M5.Display.print("Connecting to WiFi...");
+        
+        // Configure SDIO pins for ESP32-C6 communication
+        WiFi.setPins(SDIO2_CLK, SDIO2_CMD, SDIO2_D0, SDIO2_D1, SDIO2_D2, SDIO2_D3, SDIO2_RST);
+        
+        WiFi.mode(WIFI_STA);
+#ifdef INPUT_TRACE
+        WiFi.onEvent([](WiFiEvent_t event, WiFiEventInfo_t info) {
+            if (event == ARDUINO_EVENT_WIFI_STA_GOT_IP) traceWifi(WL_CONNECTED);
+            else if (event == ARDUINO_EVENT_WIFI_STA_DISCONNECTED || event == ARDUINO_EVENT_WIFI_STA_LOST_IP) traceWifi(WL_DISCONNECTED);
+        });
+#endif
+        // Straight to last boot's access point when it is cached, else a scan
+        wifiFastBegin(settings.ssid, settings.password, Serial);
+        wifiFastConnect();
+        stage.next();
+    }
+    WiFiFastState state = wifiFastPoll();
+    if (state == WIFI_FAST_CONNECTING) return BOOT_RUNNING;
+    if (state == WIFI_FAST_FAILED) return BOOT_FAILED;
+    
+    wifiConnected = true;
+    Serial.println("WiFi connected!");
+    Serial.print("IP address: ");
+    Serial.println(WiFi.localIP());
+    M5.Display.setTextColor(CO2_GOOD);
+    M5.Display.setTextSize(2);
+    M5.Display.setCursor(300, 120);
+    M5.Display.print("Connected: ");
+    M5.Display.print(WiFi.localIP());
+    return BOOT_DONE;
 }
 
-void setupWiFi() {
-    Serial.println("Setting up WiFi...");
+// Stops whatever the SCD40 was doing and restarts periodic measurement; the
+// first measurement is ready about 5 seconds after that
+BootStatus bootSensor(BootStage& stage) {
+    if (stage.phase == 0) {
+        Wire.begin(GROVE_SDA, GROVE_SCL);
+        M5.Display.setTextColor(TEXT_SECONDARY);
+        M5.Display.setTextSize(2);
+        M5.Display.setCursor(50, 80);
+        M5.Display.print("Initializing SCD40 sensor...");
+        
+        scd4x.begin(Wire);
+        scd4x.stopPeriodicMeasurement();
+        stage.next();
+    }
+    if (stage.phaseMs() < 500) return BOOT_RUNNING;
     
-    // Configure SDIO pins for ESP32-C6 communication
-    WiFi.setPins(SDIO2_CLK, SDIO2_CMD, SDIO2_D0, SDIO2_D1, SDIO2_D2, SDIO2_D3, SDIO2_RST);
+    uint16_t serial0, serial1, serial2;
+    uint16_t error = scd4x.getSerialNumber(serial0, serial1, serial2);
+    M5.Display.setTextSize(2);
+    M5.Display.setCursor(400, 80);
+    if (error) {
+        M5.Display.setTextColor(CO2_BAD);
+        M5.Display.print("SCD40: Not found");
+        return BOOT_FAILED;
+    }
+    M5.Display.setTextColor(CO2_GOOD);
+    M5.Display.printf("SCD40: %04x%04x%04x", serial0, serial1, serial2);
+    Serial.printf("SCD40 Serial: %04x%04x%04x\n", serial0, serial1, serial2);
     
-    WiFi.mode(WIFI_STA);
-    WiFi.begin(ssid, password);
+    scd4x.setAutomaticSelfCalibration(settings.asc);
+    scd4x.setTemperatureOffset(settings.temp_offset);
+    error = scd4x.startPeriodicMeasurement();
+    return error ? BOOT_FAILED : BOOT_DONE;
+}
+
+BootStatus bootDisplay(BootStage&) {
+    M5.Display.setTextColor(TEXT_PRIMARY);
+    M5.Display.setTextSize(4);
+    M5.Display.setCursor(50, 30);
+#ifdef HUB_MODE
+    M5.Display.print("Room Hub");
+#else
+    M5.Display.print("Environmental Monitor");
+#endif
     
-    int attempts = 0;
-    while (WiFi.status() != WL_CONNECTED && attempts < 20) {
-        delay(500);
-        Serial.print(".");
-        attempts++;
+    M5.Display.setTextSize(2);
+    M5.Display.setTextColor(TEXT_SECONDARY);
+    M5.Display.setCursor(750, 40);
+    M5.Display.print("(Home Assistant Ready)");
+    return BOOT_DONE;
+}
+
+// reconnectMQTT() goes on retrying from loop() if the broker is not there
+// by the stage's timeout
+BootStatus bootMQTT(BootStage& stage) {
+    if (stage.phase == 0) {
+        // MqttPipe fills whole segments itself, so Nagle would only add delay
+        wifiClient.setNoDelay(true);
+        tlsClient.setCaCert(mqtt_ca);
+        tlsClient.setTls(settings.mqtt_tls);
+        mqttClient.setServer(settings.mqtt_server, settings.mqtt_port);
+        mqttClient.setMessageCallback(onMqttMessage);
+        mqttTask = coStart(reconnectMQTT(), "mqtt");
+        stage.next();
     }
+    coPoll();
+    if (!mqttConnected) return BOOT_RUNNING;
     
-    if (WiFi.status() == WL_CONNECTED) {
-        wifiConnected = true;
-        Serial.println("\nWiFi connected!");
-        Serial.print("IP address: ");
-        Serial.println(WiFi.localIP());
-    } else {
-        wifiConnected = false;
-        Serial.println("\nWiFi connection failed!");
-    }
+    M5.Display.setTextColor(CO2_GOOD);
+    M5.Display.setTextSize(2);
+    M5.Display.setCursor(600, 120);
+    M5.Display.print("MQTT: Connected");
+    return BOOT_DONE;
+}
+
+// Polls the SCD40 until its first measurement is on the bus
+BootStatus bootFirstReading(BootStage& stage) {
+    if (stage.phaseMs() < 100) return BOOT_RUNNING;
+    stage.next();
+    return readSensor() ? BOOT_DONE : BOOT_RUNNING;
+}
+
+BootStatus bootRender(BootStage&) {
+    deliverReadings();
+#ifdef HUB_MODE
+    updateHubDisplay();
+    updateHubStatus();
+#else
+    updateDisplay();
+#endif
+    const BootStage* reading = boot.stage("reading");
+    if (reading && reading->status == BOOT_DONE) boot.milestone("first render");
+    return BOOT_DONE;
 }
 
 void checkWiFiConnection() {
-    if (millis() - lastWifiCheck < WIFI_CHECK_INTERVAL) return;
+    if (coRunning(wifiTask)) return;
+    if (millis() - lastWifiCheck < settings.wifi_check_ms) return;
     lastWifiCheck = millis();
     
+    SPAN_TRACE("wifi", "WiFi.status");
     if (WiFi.status() != WL_CONNECTED) {
         wifiConnected = false;
         mqttConnected = false;  // If WiFi is down, MQTT is also down
-        Serial.println("WiFi disconnected! Attempting to reconnect...");
-        
-        WiFi.disconnect();
-        delay(1000);
-        WiFi.begin(ssid, password);
-        
-        int attempts = 0;
-        while (WiFi.status() != WL_CONNECTED && attempts < 10) {
-            delay(500);
-            Serial.print(".");
-            attempts++;
-        }
-        
-        if (WiFi.status() == WL_CONNECTED) {
-            wifiConnected = true;
-            Serial.println("\nWiFi reconnected!");
-            Serial.print("IP address: ");
-            Serial.println(WiFi.localIP());
-        } else {
-            Serial.println("\nWiFi reconnection failed!");
-        }
+        wifiTask = coStart(reconnectWiFi(), "wifi");
     } else {
         wifiConnected = true;
     }
 }
 
+CoTask reconnectWiFi() {
+    Serial.println("WiFi disconnected! Attempting to reconnect...");
+    
+    {
+        SPAN_TRACE("wifi", "wifiFastConnect");
+        wifiFastConnect();
+    }
+    
+    // wifiFastPoll() falls back from the cached access point to a scan and
+    // gives up on its own
+    co_await coUntil([] { return wifiFastPoll() != WIFI_FAST_CONNECTING; });
+    if (wifiFastPoll() == WIFI_FAST_CONNECTED) {
+        wifiConnected = true;
+        Serial.println("WiFi reconnected!");
+        Serial.print("IP address: ");
+        Serial.println(WiFi.localIP());
+    } else {
+        Serial.println("WiFi reconnection failed!");
+    }
+    lastWifiCheck = millis();
+}
+
 void publishDiscovery() {
     if (!mqttConnected) return;
     
-    JsonDocument doc;
     char topic[200];
     char payload[1024];
-    char stateTopic[100];
-    char availTopic[100];
-    
-    // Prepare common topics
-    snprintf(stateTopic, sizeof(stateTopic), "homeassistant/sensor/%s/state", device_id);
-    snprintf(availTopic, sizeof(availTopic), "homeassistant/sensor/%s/availability", device_id);
-    
-    // Temperature sensor discovery
-    snprintf(topic, sizeof(topic), "homeassistant/sensor/%s_temperature/config", device_id);
-    doc.clear();
-    doc["name"] = "Temperature";
-    doc["device_class"] = "temperature";
-    doc["unit_of_measurement"] = "°C";
-    doc["state_topic"] = stateTopic;
-    doc["availability_topic"] = availTopic;
-    doc["value_template"] = "{{ value_json.temperature }}";
-    doc["unique_id"] = String(device_id) + "_temperature";
-    
-    JsonObject device = doc["device"].to<JsonObject>();
-    device["identifiers"][0] = device_id;
-    device["name"] = device_name;
-    device["model"] = "M5Tab5";
-    device["manufacturer"] = "M5Stack";
-    
-    serializeJson(doc, payload);
-    if (mqttClient.publish(topic, payload, true)) {
-        Serial.printf("Published discovery: %s\n", topic);
-    } else {
-        Serial.printf("FAILED to publish discovery: %s\n", topic);
-    }
-    delay(50);  // Small delay between messages
-    
-    // Humidity sensor discovery
-    snprintf(topic, sizeof(topic), "homeassistant/sensor/%s_humidity/config", device_id);
-    doc.clear();
-    doc["name"] = "Humidity";
-    doc["device_class"] = "humidity";
-    doc["unit_of_measurement"] = "%";
-    doc["state_topic"] = stateTopic;
-    doc["availability_topic"] = availTopic;
-    doc["value_template"] = "{{ value_json.humidity }}";
-    doc["unique_id"] = String(device_id) + "_humidity";
-    
-    device = doc["device"].to<JsonObject>();
-    device["identifiers"][0] = device_id;
-    device["name"] = device_name;
-    device["model"] = "M5Tab5";
-    device["manufacturer"] = "M5Stack";
-    
-    serializeJson(doc, payload);
-    if (mqttClient.publish(topic, payload, true)) {
-        Serial.printf("Published discovery: %s\n", topic);
-    } else {
-        Serial.printf("FAILED to publish discovery: %s\n", topic);
-    }
-    delay(50);  // Small delay between messages
-    
-    // CO2 sensor discovery
-    snprintf(topic, sizeof(topic), "homeassistant/sensor/%s_co2/config", device_id);
-    doc.clear();
-    doc["name"] = "CO2";
-    doc["device_class"] = "carbon_dioxide";
-    doc["unit_of_measurement"] = "ppm";
-    doc["state_topic"] = stateTopic;
-    doc["availability_topic"] = availTopic;
-    doc["value_template"] = "{{ value_json.co2 }}";
-    doc["unique_id"] = String(device_id) + "_co2";
-    
-    device = doc["device"].to<JsonObject>();
-    device["identifiers"][0] = device_id;
-    device["name"] = device_name;
-    device["model"] = "M5Tab5";
-    device["manufacturer"] = "M5Stack";
-    
-    serializeJson(doc, payload);
-    if (mqttClient.publish(topic, payload, true)) {
-        Serial.printf("Published discovery: %s\n", topic);
-    } else {
-        Serial.printf("FAILED to publish discovery: %s\n", topic);
+    
+    for (const HaEntity* entity : haEntities) {
+        haConfigTopic(topic, sizeof(topic), haDevice, *entity);
+        haConfigPayload(payload, sizeof(payload), haDevice, *entity);
+        if (mqttPublish(topic, payload, true)) {
+            DLOG_I(mqttLog, "Published discovery: %s", topic);
+        } else {
+            Serial.printf("FAILED to publish discovery: %s\n", topic);
+        }
+    }
+    // The configs went into the batch together; out in as few segments as they fit
+    mqttClient.flush();
+}
+
+// Publishes the config version and the loop stall histogram (retained, so
+// it is there after a restart)
+void publishDiagnostics() {
+    if (!mqttConnected) return;
+    
+    char topic[100];
+    char payload[960];  // what is left of the 1024-byte MQTT buffer after the topic
+    haTopic(topic, sizeof(topic), haDevice, "diagnostics");
+    payload[0] = '{';
+    size_t length = 1 + config.statusJson(payload + 1, sizeof(payload) - 1);
+    if (length + 2 < sizeof(payload)) {
+        payload[length++] = ',';
+        length += ota.statusJson(payload + length, sizeof(payload) - length);
+    }
+    if (length + 2 < sizeof(payload)) {
+        payload[length++] = ',';
+        length += tlsClient.statusJson(payload + length, sizeof(payload) - length);
+    }
+    if (length + 2 >= sizeof(payload) || loopWatchJson(payload + length, sizeof(payload) - length) == 0) return;
+    payload[length] = ',';  // in place of the histogram's opening brace
+    if (mqttPublish(topic, payload, true) && mqttClient.flush()) {
+        lastDiagnostics = millis();
+        DLOG_I(mqttLog, "Published diagnostics: %s", topic);
     }
 }
 
@@ -362,6 +660,7 @@ void checkMQTTConnection() {
     // Periodically check if MQTT is really connected
     if (millis() - lastMqttCheck > MQTT_CHECK_INTERVAL) {
         lastMqttCheck = millis();
+        SPAN_TRACE("mqtt", "checkConnection");
         if (!mqttClient.connected()) {
             mqttConnected = false;
             Serial.println("MQTT connection lost!");
@@ -369,48 +668,61 @@ void checkMQTTConnection() {
     }
 }
 
-void connectMQTT() {
-    if (!wifiConnected || millis() - lastMqttReconnect < 5000) return;
-    
+// One connection attempt; discovery is published by reconnectMQTT()
+bool connectMQTT() {
+    SPAN_TRACE("mqtt", "connect");
+    LoopWatchScope watch("mqtt.connect");
     // Double-check MQTT is not already connected
     if (mqttClient.connected()) {
         mqttConnected = true;
-        return;
+        return true;
     }
     
-    lastMqttReconnect = millis();
-    
-    Serial.printf("Connecting to MQTT broker %s:%d...", mqtt_server, mqtt_port);
-    String clientId = String(device_id) + "_" + String(random(0xffff), HEX);
-    
-    // Set last will message
-    char willTopic[100];
-    snprintf(willTopic, sizeof(willTopic), "homeassistant/sensor/%s/availability", device_id);
+    Serial.printf("Connecting to MQTT broker %s:%u%s...", settings.mqtt_server, (unsigned)settings.mqtt_port,
+                  tlsClient.tls() ? " over TLS" : "");
+    // Same id every time: the broker keeps the session, and the readings
+    // still in flight are sent again once it is back
+    const char* clientId = settings.device_id;
     
-    bool connected = false;
-    if (strlen(mqtt_user) > 0) {
-        Serial.printf(" with auth (user: %s)...", mqtt_user);
-        connected = mqttClient.connect(clientId.c_str(), mqtt_user, mqtt_password, willTopic, 0, true, "offline");
+    if (strlen(settings.mqtt_user) > 0) {
+        Serial.printf(" with auth (user: %s)...", settings.mqtt_user);
     } else {
         Serial.print(" without auth...");
-        connected = mqttClient.connect(clientId.c_str(), willTopic, 0, true, "offline");
     }
+    // Retained "offline" as the last will
+    unsigned long connectStart = millis();
+    bool connected = haConnect(mqttClient, haDevice, clientId, settings.mqtt_user, settings.mqtt_password);
+    traceMqttConnect(connected, mqttClient.state(), millis() - connectStart);
     
     if (connected) {
         mqttConnected = true;
-        Serial.println(" connected!");
+        if (tlsClient.tls()) {
+            Serial.printf(" connected! (TLS %s in %lu ms)\n", tlsClient.lastResumed() ? "resumed" : "full handshake",
+                          (unsigned long)tlsClient.lastHandshakeMs());
+        } else {
+            Serial.println(" connected!");
+        }
+        // A new firmware on trial reached the broker: it stays
+        deltaOtaConfirm();
         
         // Publish availability
-        mqttClient.publish(willTopic, "online", true);
-        
-        // Small delay to ensure connection is stable
-        delay(100);
-        
-        // Publish discovery messages
-        publishDiscovery();
+        char availTopic[100];
+        haTopic(availTopic, sizeof(availTopic), haDevice, "availability");
+        mqttPublish(availTopic, "online", true);
+        // The retained config comes right back, and with every change
+        remoteConfigTopic(configTopic, sizeof(configTopic), settings.device_id);
+        mqttClient.subscribe(configTopic, 1);
+#ifdef HUB_MODE
+        // Every monitor's readings, for the tiles, and its window statistics,
+        // which say it is alive when it sends readings only now and then
+        mqttClient.subscribe(ROOM_HUB_STATE_TOPICS);
+        mqttClient.subscribe(ROOM_HUB_STATS_TOPICS);
+#endif
+        return true;
     } else {
         int state = mqttClient.state();
         Serial.printf(" failed, rc=%d\n", state);
+        if (tlsClient.tls() && tlsClient.error()[0]) Serial.printf("  TLS: %s\n", tlsClient.error());
         switch(state) {
             case -4: Serial.println("  MQTT_CONNECTION_TIMEOUT - server didn't respond"); break;
             case -3: Serial.println("  MQTT_CONNECTION_LOST - network connection broken"); break;
@@ -422,36 +734,270 @@ void connectMQTT() {
             case 4: Serial.println("  MQTT_CONNECT_BAD_CREDENTIALS - username/password rejected"); break;
             case 5: Serial.println("  MQTT_CONNECT_UNAUTHORIZED - not authorized (check if broker requires auth)"); break;
         }
+        return false;
     }
 }
 
-void publishSensorData() {
-    // Check both flag and actual connection state
-    if (!mqttConnected || !mqttClient.connected() || millis() - lastMqttPublish < 5000) return;
+// Connects to the broker, retrying every MQTT_RETRY_INTERVAL while WiFi is up
+CoTask reconnectMQTT() {
+    while (wifiConnected) {
+        unsigned long attemptStart = millis();
+        if (connectMQTT()) {
+            // Small delay to ensure connection is stable
+            co_await coSleep(100);
+            
+            // Publish discovery messages
+            publishDiscovery();
+            publishDiagnostics();
+            co_return;
+        }
+        // The interval counts from the start of the attempt
+        unsigned long elapsed = millis() - attemptStart;
+        co_await coSleep(elapsed < MQTT_RETRY_INTERVAL ? MQTT_RETRY_INTERVAL - elapsed : 0);
+    }
+}
+
+// Reads the SCD40 when it has a new measurement and puts it on the bus;
+// true when it did
+bool readSensor() {
+    uint16_t error;
+    bool isDataReady = false;
     
-    lastMqttPublish = millis();
+    {
+        SPAN_TRACE("i2c", "scd4x.getDataReadyFlag");
+        error = scd4x.getDataReadyFlag(isDataReady);
+    }
+    if (error || !isDataReady) return false;
     
-    JsonDocument doc;
-    doc["temperature"] = temperature;
-    doc["humidity"] = round(humidity);
-    doc["co2"] = co2;
+    float newTemp, newHum;
+    uint16_t newCO2;
+    {
+        SPAN_TRACE("i2c", "scd4x.readMeasurement");
+        error = scd4x.readMeasurement(newCO2, newTemp, newHum);
+    }
+    traceSensor(error, newCO2, newTemp, newHum);
+    if (error || newCO2 == 0) return false;
+    
+    SensorReading reading = {newTemp, newHum, newCO2};
+    sensorReadings.publish(reading);
+    return true;
+}
+
+// Returns true once the reading has a slot in MqttPipe's window; from there
+// it goes out again after a reconnect until the broker acknowledges it
+bool publishSensorData(const SensorReading& reading) {
+    // Check both flag and actual connection state
+    if (!mqttConnected || !mqttClient.connected()) return false;
     
     char payload[256];
-    serializeJson(doc, payload);
+    haStatePayload(payload, sizeof(payload), reading.temperature, reading.humidity, reading.co2);
     
     char topic[100];
-    snprintf(topic, sizeof(topic), "homeassistant/sensor/%s/state", device_id);
-    
-    if (mqttClient.publish(topic, payload)) {
-        Serial.printf("Published to %s: %s\n", topic, payload);
+    haTopic(topic, sizeof(topic), haDevice, "state");
+    
+    // QoS 1, written right away rather than with the next loop() pass. A
+    // failed write leaves the reading in the window, so it is not published
+    // again here: the window resends it after the reconnect.
+    if (mqttPublish(topic, payload, false, 1)) {
+        if (mqttClient.flush()) {
+            DLOG_I(mqttLog, "Published to %s: %s", topic, payload);
+            boot.milestone("first publish");
+        } else {
+            DLOG_W(mqttLog, "Connection lost sending sensor data, resent on reconnect");
+            mqttConnected = false;
+        }
+        return true;
+    } else if (mqttClient.connected()) {
+        // The window is full of readings the broker has not acknowledged
+        // yet; tried again on the next pass
+        return false;
     } else {
-        Serial.println("Failed to publish sensor data!");
+        DLOG_W(mqttLog, "Failed to publish sensor data!");
         // Force reconnection on next loop
         mqttConnected = false;
+        return false;
     }
 }
 
+// Publishes the batched readings, oldest first, as
+// {"device": ..., "fields": ["t", "temperature", "humidity", "co2"], "rows": [[...], ...]}
+void publishHistory() {
+    if (!mqttConnected || !mqttClient.connected()) return;
+    SPAN_TRACE("mqtt", "history");
+    
+    char topic[100];
+    uint8_t payload[768];
+    size_t length;
+#ifdef PAYLOAD_CBOR
+    haTopic(topic, sizeof(topic), haDevice, "history/cbor");
+    CborWriter cbor(payload, sizeof(payload));
+    cbor.beginMap(3);
+    cbor.writeText("device");
+    cbor.writeText(settings.device_id);
+    cbor.writeText("fields");
+    cborWriteNames(cbor, historySchema);
+    cbor.writeText("rows");
+    cbor.beginArray(historyBatchCount);
+    for (int i = 0; i < historyBatchCount; i++) cborWriteRow(cbor, historySchema, &historyBatch[i]);
+    if (cbor.overflow()) return;
+    length = cbor.length();
+#else
+    haTopic(topic, sizeof(topic), haDevice, "history/json");
+    JsonDocument doc;
+    doc["device"] = settings.device_id;
+    JsonArray fields = doc["fields"].to<JsonArray>();
+    for (uint8_t i = 0; i < historySchema.count; i++) fields.add(historyFields[i].name);
+    JsonArray rows = doc["rows"].to<JsonArray>();
+    for (int i = 0; i < historyBatchCount; i++) {
+        JsonArray row = rows.add<JsonArray>();
+        row.add(historyBatch[i].t);
+        row.add(historyBatch[i].temperature);
+        row.add(historyBatch[i].humidity);
+        row.add(historyBatch[i].co2);
+    }
+    length = serializeJson(doc, (char*)payload, sizeof(payload));
+#endif
+    
+    if (mqttPublish(topic, payload, length)) {
+        DLOG_I(mqttLog, "Published %d readings to %s (%u bytes)", historyBatchCount, topic, (unsigned)length);
+        historyBatchCount = 0;
+    }
+}
+
+// Publishes a closed statistics window on stats/<name> (QoS 0, not
+// retained); one that does not go out stays pending for the next pass
+void publishStats(StatWindow& window) {
+    if (!window.pending() || !mqttConnected || !mqttClient.connected()) return;
+    
+    char topic[100];
+    char payload[384];
+    char level[16];
+    snprintf(level, sizeof(level), "stats/%s", window.name());
+    haTopic(topic, sizeof(topic), haDevice, level);
+    if (window.json(payload, sizeof(payload)) == 0) {
+        window.sent();      // cannot fit; not worth trying again
+        return;
+    }
+    if (mqttPublish(topic, payload)) {
+        window.sent();
+        DLOG_I(mqttLog, "Published to %s: %s", topic, payload);
+    }
+}
+
+// Publishes the CO2 analytics on "air" (QoS 0, not retained); nothing
+// before the trend has a minute of readings
+void publishAir() {
+    if (!airDue || !mqttConnected || !mqttClient.connected()) return;
+    
+    char topic[100];
+    char payload[128];
+    haTopic(topic, sizeof(topic), haDevice, "air");
+    if (co2Analytics.json(payload, sizeof(payload)) == 0) {
+        airDue = false;     // no trend yet; the next window has one
+        return;
+    }
+    if (mqttPublish(topic, payload)) {
+        airDue = false;
+        DLOG_I(mqttLog, "Published to %s: %s", topic, payload);
+    }
+}
+
+// Hands new readings to each consumer
+void deliverReadings() {
+    MessageRef<SensorReading> reading;
+    
+    while (statsInbox.receive(reading)) {
+        uint32_t now = millis();
+        if (stats5m.add(now, reading->temperature, reading->humidity, reading->co2)) stateDue = airDue = true;
+        stats1h.add(now, reading->temperature, reading->humidity, reading->co2);
+        co2Analytics.setRoom(settings.room_m3);
+        co2Analytics.add(now, reading->co2);
+    }
+    publishStats(stats5m);
+    publishStats(stats1h);
+    publishAir();
+    
+    while (historyInbox.receive(reading)) {
+        updateHistory(*reading);
+        
+        // The oldest row makes room while the broker is out of reach
+        if (historyBatchCount == HISTORY_BATCH_SIZE) {
+            memmove(historyBatch, historyBatch + 1, sizeof(historyBatch) - sizeof(historyBatch[0]));
+            historyBatchCount--;
+        }
+        historyBatch[historyBatchCount++] = {(uint32_t)(millis() / 1000), reading->temperature, reading->humidity, reading->co2};
+        if (historyBatchCount == HISTORY_BATCH_SIZE) publishHistory();
+    }
+    
+    while (logInbox.receive(reading)) {
+        DLOG_I(sensorLog, "T=%.1f°C, H=%.1f%%, CO2=%d ppm", reading->temperature, reading->humidity, reading->co2);
+        telemetrySensor(reading->co2, reading->temperature, reading->humidity);
+    }
+    
+    // Kept until it has a slot in the MQTT window, where it stays (and is sent
+    // again after a reconnect) until the broker acknowledges it; a newer
+    // reading replaces one still waiting for a slot
+    // With raw_state off it waits for the next 5-minute window to close
+    mqttInbox.receive(pendingPublish);
+    if (pendingPublish && (settings.raw_state || stateDue) && publishSensorData(*pendingPublish)) {
+        pendingPublish.reset();
+        stateDue = false;
+    }
+    
+    if (displayInbox.receive(reading)) {
+        temperature = reading->temperature;
+        humidity = reading->humidity;
+        co2 = reading->co2;
+#ifdef HUB_MODE
+        // Its own tile does not wait for the broker's echo (which is ignored)
+        hub.update(settings.device_id, temperature, humidity, co2, millis());
+#endif
+    }
+}
+
+// Publishes and records the outcome and how long the client blocked
+bool mqttPublish(const char* topic, const char* payload, bool retained, uint8_t qos) {
+    return mqttPublish(topic, (const uint8_t*)payload, strlen(payload), retained, qos);
+}
+
+bool mqttPublish(const char* topic, const uint8_t* payload, size_t length, bool retained, uint8_t qos) {
+    SPAN_TRACE("mqtt", "publish");
+    unsigned long start = micros();
+    bool ok = mqttClient.publish(topic, payload, length, retained, qos);
+    tracePublish(ok, length, micros() - start);
+    return ok;
+}
+
+// Records touch, button and MQTT state changes for the input trace
+void recordTraceInputs() {
+#ifdef INPUT_TRACE
+    static bool lastPressed = false;
+    static int16_t lastX = -1, lastY = -1;
+    static int lastMqttState = MQTT_DISCONNECTED;
+
+    auto touch = M5.Touch.getDetail();
+    bool pressed = touch.isPressed();
+    if (pressed != lastPressed || (pressed && (touch.x != lastX || touch.y != lastY))) {
+        traceTouch(touch.x, touch.y, pressed);
+        lastPressed = pressed;
+        lastX = touch.x;
+        lastY = touch.y;
+    }
+
+    if (M5.BtnA.wasPressed()) traceButton(0, true);
+    if (M5.BtnA.wasReleased()) traceButton(0, false);
+
+    int state = mqttClient.state();
+    if (state != lastMqttState) {
+        traceMqttState(state);
+        lastMqttState = state;
+    }
+#endif
+}
+
 void updateDisplay() {
+    SPAN_TRACE("display", "updateDisplay");
+    clearOfflineNote();
     // Clear main area
     M5.Display.fillRect(0, 100, SCREEN_WIDTH, SCREEN_HEIGHT - 100, BG_COLOR);
     
@@ -554,7 +1100,7 @@ void updateDisplay() {
     M5.Display.setTextColor(TEXT_SECONDARY);
     M5.Display.setTextSize(2);
     M5.Display.setCursor(50, statusY + 60);
-    M5.Display.printf("Next update in %d seconds", 5 - ((millis() % 5000) / 1000));
+    M5.Display.printf("Next update in %d seconds", (int)((settings.publish_ms - millis() % settings.publish_ms) / 1000));
     
     // Button hint
     if (mqttConnected) {
@@ -581,99 +1127,406 @@ void updateDisplay() {
     }
 }
 
-void setup() {
-    // Initialize M5Stack
-    auto cfg = M5.config();
-    cfg.external_spk = false;
-    M5.begin(cfg);
-    
-    M5.Display.setRotation(1);
-    M5.Display.fillScreen(BG_COLOR);
-    
-    Serial.begin(115200);
-    delay(1000);
-    Serial.println("\n=== M5Tab5 Environmental Monitor ===");
-    Serial.println("ESP32-P4 + ESP32-C6 WiFi Version");
+// Takes the boot's "Offline Mode" out of the header once WiFi has connected
+void clearOfflineNote() {
+    if (!offlineNote || !wifiConnected) return;
+    M5.Display.fillRect(750, 70, SCREEN_WIDTH - 750, 16, BG_COLOR);
+    offlineNote = false;
+}
+
+// Config messages, and in hub mode the other monitors' readings
+void onMqttMessage(const char* topic, const uint8_t* payload, size_t length, void*) {
+    if (strcmp(topic, configTopic) == 0) {
+        ConfigResult result = config.apply(payload, length);
+        if (result.status == CONFIG_UNCHANGED) return;
+        configReport = true;
+        if (result.status == CONFIG_INVALID) {
+            Serial.printf("Config rejected: %s\n", config.error());
+            return;
+        }
+        Serial.printf("Config version %u received\n", (unsigned)config.version());
+        configActions |= result.apply;
+        configAppliedAt = millis();
+        return;
+    }
+#ifdef HUB_MODE
+    hub.handle(topic, payload, length, millis());
+#endif
+}
+
+// Carries out what a config message changed: the SCD40 settings at once, a
+// reconnect for WiFi, broker or identity changes. Those are committed once
+// the broker is back with them, and reverted otherwise.
+void applyConfig() {
+    if ((configActions & CONFIG_APPLY_SENSOR) && !coRunning(sensorTask)) {
+        configActions &= ~CONFIG_APPLY_SENSOR;
+        sensorTask = coStart(reconfigureSensor(), "scd40");
+    }
+    if (configActions & CONFIG_APPLY_OTA) {
+        configActions &= ~CONFIG_APPLY_OTA;
+        otaCheckDue = true;
+    }
     
-    // Title
-    M5.Display.setTextColor(TEXT_PRIMARY);
-    M5.Display.setTextSize(4);
-    M5.Display.setCursor(50, 30);
-    M5.Display.print("Environmental Monitor");
+    uint8_t reconnect = configActions & (CONFIG_APPLY_WIFI | CONFIG_APPLY_MQTT | CONFIG_APPLY_IDENTITY);
+    if (reconnect) {
+        configActions &= ~reconnect;
+        if (config.pending()) configReconnects |= reconnect;
+        if ((reconnect & CONFIG_APPLY_IDENTITY) && mqttConnected) {
+            // The old id's entities leave Home Assistant and its config goes
+            const Settings* old = (const Settings*)config.previous();
+            HaDevice oldDevice = {old->device_id, old->device_name, haDevice.model};
+            haClearIdentity(oldDevice, haEntities, sizeof(haEntities) / sizeof(haEntities[0]),
+                            [](const char* topic, const char* payload) { mqttPublish(topic, payload, true); });
+            char topic[200];
+            remoteConfigTopic(topic, sizeof(topic), old->device_id);
+            mqttPublish(topic, "", true);
+            mqttClient.flush();
+        }
+#ifdef HUB_MODE
+        // Its own readings come back under the new id, to be ignored
+        if (reconnect & CONFIG_APPLY_IDENTITY) hub.setOwnId(settings.device_id);
+#endif
+        Serial.println("Config: reconnecting with the new settings");
+        mqttClient.disconnect();
+        tlsClient.setTls(settings.mqtt_tls);
+        mqttClient.setServer(settings.mqtt_server, settings.mqtt_port);
+        mqttConnected = false;
+        if (reconnect & CONFIG_APPLY_WIFI) {
+            WiFi.disconnect();
+            wifiConnected = false;
+            if (!coRunning(wifiTask)) wifiTask = coStart(reconnectWiFi(), "wifi");
+        }
+    }
     
-    M5.Display.setTextSize(2);
-    M5.Display.setTextColor(TEXT_SECONDARY);
-    M5.Display.setCursor(750, 40);
-    M5.Display.print("(Home Assistant Ready)");
+    if (config.pending()) {
+        if (!configReconnects) {
+            config.commit();
+        } else if (mqttConnected && !coRunning(mqttTask)) {
+            // Connected, and discovery is out under the new settings
+            config.commit();
+            configReconnects = 0;
+        } else if (millis() - configAppliedAt > CONFIG_CONFIRM_TIMEOUT) {
+            config.revert("no broker");
+            Serial.printf("Config: %s\n", config.error());
+            configActions |= configReconnects;
+            configReconnects = 0;
+        } else {
+            return;
+        }
+        Serial.printf("Config version %u: %s\n", (unsigned)config.version(), config.error());
+        configReport = true;
+    }
+    if (configReport && mqttConnected) {
+        configReport = false;
+        publishDiagnostics();
+    }
+}
+
+// Starts a manifest check when one is due and moves an update on by up to
+// OTA_POLL_BUDGET; a new image is restarted into at once, on trial until it
+// reaches the broker
+void updateOta() {
+    deltaOtaCheckTrial();
+    if (!ota.active()) {
+        bool due = otaCheckDue ||
+                   (settings.ota_check_min && millis() - lastOtaCheck > settings.ota_check_min * 60000UL);
+        if (!due || !mqttConnected || settings.ota_url[0] == 0) return;
+        otaCheckDue = false;
+        lastOtaCheck = millis();
+        ota.check(settings.ota_url);
+    }
     
-    // Initialize I2C
-    Wire.begin(GROVE_SDA, GROVE_SCL);
+    DeltaOtaState state;
+    {
+        SPAN_TRACE("ota", "poll");
+        state = ota.poll(OTA_POLL_BUDGET);
+    }
+    drawOtaProgress();
+    if (state == otaLastState) return;
+    otaLastState = state;
+    const DeltaOtaStats& stats = ota.stats();
+    switch (state) {
+        case DELTA_OTA_DOWNLOADING:
+            Serial.printf("OTA: updating to %s (%s)\n", ota.version(), stats.oldSize ? "patch" : "whole image");
+            break;
+        case DELTA_OTA_UP_TO_DATE:
+            DLOG_I(mqttLog, "OTA: up to date (%s)", ota.version());
+            break;
+        case DELTA_OTA_FAILED:
+            Serial.printf("OTA: %s\n", ota.error());
+            publishDiagnostics();
+            break;
+        case DELTA_OTA_READY:
+            Serial.printf("OTA: %s ready, %u bytes downloaded for %u in %u ms; restarting\n", ota.version(),
+                          (unsigned)stats.patchBytes, (unsigned)stats.imageBytes, (unsigned)stats.patchMs);
+            publishDiagnostics();
+            mqttClient.flush();
+            deltaOtaRestart();
+            break;
+        default:
+            break;
+    }
+}
+
+// A bar along the bottom edge while an update downloads
+void drawOtaProgress() {
+    if (ota.state() != DELTA_OTA_DOWNLOADING && ota.state() != DELTA_OTA_READY) return;
+    int progress = ota.progress();
+    if (progress == otaShownProgress) return;
+    otaShownProgress = progress;
+    const int barHeight = 6;
+    int width = SCREEN_WIDTH * progress / 100;
+    M5.Display.fillRect(0, SCREEN_HEIGHT - barHeight, width, barHeight, TEMP_COLD);
+    M5.Display.fillRect(width, SCREEN_HEIGHT - barHeight, SCREEN_WIDTH - width, barHeight, GRID_COLOR);
+}
+
+// The SCD40 takes settings only while idle: stopped, and 500 ms later
+// written and started again
+CoTask reconfigureSensor() {
+    scd4x.stopPeriodicMeasurement();
+    co_await coSleep(500);
+    scd4x.setAutomaticSelfCalibration(settings.asc);
+    scd4x.setTemperatureOffset(settings.temp_offset);
+    scd4x.startPeriodicMeasurement();
+    Serial.printf("SCD40: ASC %s, temperature offset %.1f\n", settings.asc ? "on" : "off", settings.temp_offset);
+}
+
+#ifdef HUB_MODE
+
+// The smallest grid that has a tile for every device
+void hubGrid(uint16_t count, int& columns, int& rows) {
+    static const uint8_t grids[][2] = {{2, 1}, {3, 2}, {4, 3}, {6, 4}, {8, 5}, {10, 7}, {12, 9}, {16, 12}, {20, 13}};
+    for (const auto& grid : grids) {
+        columns = grid[0];
+        rows = grid[1];
+        if (columns * rows >= count) return;
+    }
+}
+
+// Large tiles get a CO2 line of the device's history; small ones the id and
+// CO2 only. A stale tile keeps its last values, greyed out.
+void drawHubTile(uint16_t slot) {
+    static RoomHubSample samples[HUB_HISTORY];
+    const RoomHubDevice& d = hub.device(slot);
+    if (d.tile >= hubColumns * hubRows) return;
+    int w = SCREEN_WIDTH / hubColumns;
+    int h = HUB_GRID_HEIGHT / hubRows;
+    int x = (d.tile % hubColumns) * w;
+    int y = HUB_GRID_TOP + (d.tile / hubColumns) * h;
+    uint16_t color = d.stale ? TEXT_SECONDARY : getCO2Color(d.co2);
+    bool large = h >= 140;
+    bool medium = h >= 70;
+    
+    M5.Display.fillRect(x + 2, y + 2, w - 4, h - 4, BG_COLOR);
+    M5.Display.drawRoundRect(x + 2, y + 2, w - 4, h - 4, 6, d.stale ? GRID_COLOR : color);
+    
+    // The id, cut to the tile
+    int nameSize = large ? 2 : 1;
+    M5.Display.setTextSize(nameSize);
     M5.Display.setTextColor(TEXT_SECONDARY);
-    M5.Display.setCursor(50, 80);
-    M5.Display.print("Initializing SCD40 sensor...");
+    M5.Display.setCursor(x + 8, y + 8);
+    M5.Display.printf("%.*s", (w - 16) / (6 * nameSize), d.id);
     
-    // Initialize SCD40
-    scd4x.begin(Wire);
-    
-    uint16_t error;
-    error = scd4x.stopPeriodicMeasurement();
-    delay(500);
-    
-    uint16_t serial0, serial1, serial2;
-    error = scd4x.getSerialNumber(serial0, serial1, serial2);
-    if (!error) {
-        M5.Display.setTextColor(CO2_GOOD);
-        M5.Display.setCursor(400, 80);
-        M5.Display.printf("SCD40: %04x%04x%04x", serial0, serial1, serial2);
-        Serial.printf("SCD40 Serial: %04x%04x%04x\n", serial0, serial1, serial2);
+    int co2Size = large ? 5 : medium ? 3 : 2;
+    int co2Y = y + 8 + 8 * nameSize + 6;
+    M5.Display.setTextSize(co2Size);
+    M5.Display.setTextColor(color);
+    M5.Display.setCursor(x + 8, co2Y);
+    M5.Display.printf("%d", d.co2);
+    if (!medium) return;
+    
+    int lineY = co2Y + 8 * co2Size + 6;
+    int lineSize = large ? 2 : 1;
+    M5.Display.setTextSize(lineSize);
+    M5.Display.setCursor(x + 8, lineY);
+    if (d.stale) {
+        M5.Display.printf("no data %lu min", (millis() - d.lastSeenMs) / 60000);
     } else {
-        M5.Display.setTextColor(CO2_BAD);
-        M5.Display.setCursor(400, 80);
-        M5.Display.print("SCD40: Not found");
+        M5.Display.setTextColor(getTemperatureColor(d.temperature));
+        M5.Display.printf("%.1f°C ", d.temperature);
+        M5.Display.setTextColor(getHumidityColor(d.humidity));
+        M5.Display.printf("%d%%", (int)round(d.humidity));
+    }
+    if (!large) return;
+    
+    // CO2 over the readings that fit, a pixel each
+    int graphX = x + 8;
+    int graphY = lineY + 8 * lineSize + 6;
+    int graphW = w - 16;
+    int graphH = y + h - 8 - graphY;
+    if (graphH < 16) return;
+    size_t n = hub.history(slot, samples, graphW < HUB_HISTORY ? graphW : HUB_HISTORY);
+    M5.Display.drawRect(graphX, graphY, graphW, graphH, GRID_COLOR);
+    for (size_t i = 1; i < n; i++) {
+        int y1 = graphY + graphH - 1 - (int)(constrain(samples[i - 1].co2, 400, 2000) - 400) * (graphH - 2) / 1600;
+        int y2 = graphY + graphH - 1 - (int)(constrain(samples[i].co2, 400, 2000) - 400) * (graphH - 2) / 1600;
+        M5.Display.drawLine(graphX + i - 1, y1, graphX + i, y2, color);
+    }
+}
+
+// Tiles of devices that published or went stale; after a device was added
+// (tiles moved, maybe a new grid) all of them, spread over passes
+void updateHubDisplay() {
+    SPAN_TRACE("display", "hubTiles");
+    if (millis() - lastHubStaleCheck > HUB_STALE_CHECK_INTERVAL) {
+        lastHubStaleCheck = millis();
+        hub.checkStale(millis());
+    }
+    if (hub.takeLayoutChange()) {
+        int columns, rows;
+        hubGrid(hub.count(), columns, rows);
+        if (columns != hubColumns || rows != hubRows) {
+            hubColumns = columns;
+            hubRows = rows;
+            M5.Display.fillRect(0, HUB_GRID_TOP, SCREEN_WIDTH, HUB_GRID_HEIGHT, BG_COLOR);
+        }
+        hubSweep = 0;
     }
     
-    error = scd4x.startPeriodicMeasurement();
-    
-    // Setup WiFi
-    M5.Display.setTextColor(TEXT_SECONDARY);
-    M5.Display.setCursor(50, 120);
-    M5.Display.print("Connecting to WiFi...");
-    setupWiFi();
+    int budget = HUB_TILES_PER_PASS;
+    while (budget > 0 && hubSweep < hub.count()) {
+        drawHubTile(hub.slotAt(hubSweep++));
+        budget--;
+    }
+    int slot;
+    while (budget > 0 && (slot = hub.nextDirty()) >= 0) {
+        drawHubTile(slot);
+        budget--;
+    }
+}
+
+// The line under the grid: rooms, stale ones, network
+void updateHubStatus() {
+    clearOfflineNote();
+    int statusY = HUB_GRID_TOP + HUB_GRID_HEIGHT;
+    int stale = 0;
+    for (uint16_t slot = 0; slot < hub.count(); slot++) {
+        if (hub.device(slot).stale) stale++;
+    }
+    M5.Display.fillRect(0, statusY, SCREEN_WIDTH, SCREEN_HEIGHT - statusY, 0x0841);
+    M5.Display.setTextSize(2);
+    M5.Display.setCursor(50, statusY + 12);
+    M5.Display.setTextColor(TEXT_PRIMARY);
+    M5.Display.printf("%u rooms", hub.count());
+    if (stale) {
+        M5.Display.setTextColor(TFT_ORANGE);
+        M5.Display.printf(", %d without data", stale);
+    }
     
+    M5.Display.setCursor(700, statusY + 12);
     if (wifiConnected) {
         M5.Display.setTextColor(CO2_GOOD);
-        M5.Display.setCursor(300, 120);
-        M5.Display.print("Connected: ");
+        M5.Display.print("WiFi: ");
         M5.Display.print(WiFi.localIP());
-        
-        // Setup MQTT with larger buffer for discovery messages
-        mqttClient.setServer(mqtt_server, mqtt_port);
-        mqttClient.setBufferSize(1024);  // Increase buffer size for discovery payloads
-        connectMQTT();
-        
         if (mqttConnected) {
-            M5.Display.setTextColor(CO2_GOOD);
-            M5.Display.setCursor(600, 120);
-            M5.Display.print("MQTT: Connected");
+            M5.Display.print(" | MQTT: Connected");
+        } else {
+            M5.Display.setTextColor(TFT_ORANGE);
+            M5.Display.print(" | MQTT: Disconnected");
         }
     } else {
         M5.Display.setTextColor(TFT_ORANGE);
-        M5.Display.setCursor(300, 120);
-        M5.Display.print("Offline Mode");
+        M5.Display.print("WiFi: Disconnected");
     }
+}
+#endif
+
+// The compiled-in defaults, then what NVS has from the config topic
+void loadSettings() {
+    snprintf(settings.ssid, sizeof(settings.ssid), "%s", ssid);
+    snprintf(settings.password, sizeof(settings.password), "%s", password);
+    snprintf(settings.mqtt_server, sizeof(settings.mqtt_server), "%s", mqtt_server);
+    settings.mqtt_port = mqtt_port;
+    snprintf(settings.mqtt_user, sizeof(settings.mqtt_user), "%s", mqtt_user);
+    snprintf(settings.mqtt_password, sizeof(settings.mqtt_password), "%s", mqtt_password);
+    settings.mqtt_tls = mqtt_tls;
+    snprintf(settings.device_name, sizeof(settings.device_name), "%s", device_name);
+    snprintf(settings.device_id, sizeof(settings.device_id), "%s", device_id);
+    settings.publish_ms = PUBLISH_INTERVAL;
+    settings.raw_state = true;      // every reading on "state"
+    settings.wifi_check_ms = WIFI_CHECK_INTERVAL;
+    settings.asc = true;            // the SCD40's factory settings
+    settings.temp_offset = 4.0f;
+    settings.room_m3 = 40.0f;       // 4 x 4 m, 2.5 m high
+    snprintf(settings.ota_url, sizeof(settings.ota_url), "%s", ota_url);
+    settings.ota_check_min = OTA_CHECK_INTERVAL_MIN;
+    config.begin();
+    remoteConfigTopic(configTopic, sizeof(configTopic), settings.device_id);
+    Serial.printf("Config version %u (%s), device %s\n", (unsigned)config.version(), config.error(),
+                  settings.device_id);
+}
+
+// The Arduino core marks a new firmware valid before setup() unless this says
+// it will be checked later: deltaOtaConfirm() does, once the broker is reached
+extern "C" bool verifyRollbackLater() {
+    return true;
+}
+
+void setup() {
+    // Initialize M5Stack
+    auto cfg = M5.config();
+    cfg.external_spk = false;
+    M5.begin(cfg);
     
-    delay(2000);
+    M5.Display.setRotation(1);
+    M5.Display.fillScreen(BG_COLOR);
+    polarReserve(90);  // gauge arcs
     
-    // Initial display
-    updateDisplay();
+    Serial.begin(115200);
+    traceBegin(Serial);
+    deferLogBegin(Serial);
+    telemetryBegin();
+    spanTraceStart();
+    // A new firmware that keeps failing goes back to the previous one here
+    deltaOtaBoot(Serial);
+    loadSettings();
+#ifdef HUB_MODE
+    if (!hub.begin(HUB_MAX_DEVICES, HUB_HISTORY, settings.device_id)) Serial.println("Room hub: out of memory");
+#endif
+    bool stallsKept = loopWatchStart(Serial);
+    Serial.println("\n=== M5Tab5 Environmental Monitor ===");
+    Serial.println("ESP32-P4 + ESP32-C6 WiFi Version");
+    if (stallsKept) {
+        Serial.printf("Loop stall histogram kept over reset (%u boots)\n", (unsigned)loopWatchHistogram().boots);
+    }
+    
+    // WiFi association and the MQTT connection overlap the SCD40 restart and
+    // its first measurement; the first screen shows that measurement
+    uint32_t wifi = boot.add("wifi", bootWiFi);       // times out in WiFiFast
+    uint32_t sensor = boot.add("scd40", bootSensor);
+    uint32_t display = boot.add("display", bootDisplay);
+    boot.add("mqtt", bootMQTT, wifi, 8000);
+    uint32_t reading = boot.add("reading", bootFirstReading, sensor, 10000);
+    boot.add("render", bootRender, display, 0, reading);
+    boot.run();
+    boot.report(Serial);
+    printWiFiFastStats(Serial);
+    
+    if (!wifiConnected) {
+        Serial.println("WiFi connection failed!");
+        // The readings go on without the network; the note stays until WiFi is back
+        M5.Display.setTextColor(TFT_ORANGE);
+        M5.Display.setTextSize(2);
+        M5.Display.setCursor(750, 70);
+        M5.Display.print("Offline Mode");
+        offlineNote = true;
+    }
 }
 
 void loop() {
     static unsigned long lastUpdate = 0;
     
-    M5.update();
+    spanTraceLoopBegin();
+    loopWatchBegin();
+    loopWatchSection("input");
+    {
+        SPAN_TRACE("input", "M5.update");
+        M5.update();
+    }
+    recordTraceInputs();
     
     // Check for button press to republish discovery
+    loopWatchSection("button");
     if (M5.BtnA.wasPressed() && mqttConnected) {
         Serial.println("Button pressed - republishing discovery messages...");
         publishDiscovery();
@@ -686,51 +1539,111 @@ void loop() {
     }
     
     // Check WiFi connection periodically
+    loopWatchSection("wifi");
     checkWiFiConnection();
     
     // Check and handle MQTT connection
+    loopWatchSection("mqtt");
     if (wifiConnected) {
         checkMQTTConnection();  // Check if MQTT is really connected
         
         if (!mqttConnected || !mqttClient.connected()) {
             mqttConnected = false;
-            connectMQTT();
+            if (!coRunning(mqttTask)) mqttTask = coStart(reconnectMQTT(), "mqtt");
         } else {
+            SPAN_TRACE("mqtt", "mqttClient.loop");
             mqttClient.loop();
         }
     }
     
-    // Update every 5 seconds
-    if (millis() - lastUpdate > 5000) {
+    // Changes from the config topic
+    loopWatchSection("config");
+    applyConfig();
+    
+    // Firmware update, a slice per pass
+    loopWatchSection("ota");
+    updateOta();
+    
+    // Advance WiFi and MQTT reconnection
+    loopWatchSection("co");
+    {
+        SPAN_TRACE("co", "coPoll");
+        coPoll();
+    }
+    
+    // Update every publish interval (5 seconds unless configured)
+    if (millis() - lastUpdate > settings.publish_ms) {
         lastUpdate = millis();
         
         // Read sensor
-        uint16_t error;
-        bool isDataReady = false;
-        
-        error = scd4x.getDataReadyFlag(isDataReady);
-        if (!error && isDataReady) {
-            float newTemp, newHum;
-            uint16_t newCO2;
-            
-            error = scd4x.readMeasurement(newCO2, newTemp, newHum);
-            if (!error && newCO2 > 0) {
-                temperature = newTemp;
-                humidity = newHum;
-                co2 = newCO2;
-                
-                updateHistory();
-                
-                Serial.printf("T=%.1f°C, H=%.1f%%, CO2=%d ppm\n", temperature, humidity, co2);
-                
-                // Publish to MQTT if connected
-                publishSensorData();
-            }
-        }
+        loopWatchSection("scd4x");
+        readSensor();
         
         // Update display
+        loopWatchSection("deliver");
+        deliverReadings();
+        loopWatchSection("display");
+#ifdef HUB_MODE
+        updateHubStatus();
+#else
         updateDisplay();
+#endif
+        otaShownProgress = -1;
+        SPAN_TRACE_COUNTER("memory", "free heap", ESP.getFreeHeap());
+    } else {
+        // Retries a reading MQTT could not send yet
+        loopWatchSection("deliver");
+        deliverReadings();
     }
     
+#ifdef HUB_MODE
+    // Tiles of the monitors that published since the last pass
+    loopWatchSection("hub");
+    updateHubDisplay();
+#endif
+    
+    loopWatchSection("metrics");
+    if (millis() - lastBusMetrics > BUS_METRICS_INTERVAL) {
+        lastBusMetrics = millis();
+        printBusMetrics(Serial);
+        printWiFiFastStats(Serial);
+        if (tlsClient.tls()) printTlsStats(Serial);
+        mqttClient.printStats(Serial);
+#ifdef HUB_MODE
+        const RoomHubStats& hubStats = hub.stats();
+        Serial.printf("Room hub: %u devices, %u messages, %u windows, %u ignored, %u bad, %u over capacity, "
+                      "longest probe %u\n",
+                      hub.count(), (unsigned)hubStats.messages, (unsigned)hubStats.windows, (unsigned)hubStats.ignored,
+                      (unsigned)hubStats.badPayloads, (unsigned)hubStats.full, (unsigned)hubStats.probeMax);
+#endif
+    }
+    if (mqttConnected && millis() - lastDiagnostics > DIAGNOSTICS_INTERVAL) {
+        publishDiagnostics();
+    }
+    
+    traceFlush();
+    loopWatchEnd();
+    spanTraceLoopEnd();
+    exportSpanTrace();
     delay(100);
+}
+
+// Writes out a frozen span trace a piece per loop, then records again
+void exportSpanTrace() {
+    static bool exported = false;
+    static unsigned long exportedAt = 0;
+    
+    if (!spanTraceFrozen()) return;
+    if (!exported) {
+        exported = spanTraceExport(Serial, "@spt ", 256);
+        if (exported) {
+            exportedAt = millis();
+            Serial.printf("Span trace written (%s); grep '^@spt ' to extract it\n", spanTraceReason());
+        }
+        return;
+    }
+    if (millis() - exportedAt > SPAN_TRACE_REARM_INTERVAL) {
+        exported = false;
+        spanTraceRearm();
+    }
 }
\ No newline at end of file
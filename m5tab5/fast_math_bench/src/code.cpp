@@ -0,0 +1,293 @@
+#include <Arduino.h>
+#include <fast_math.h>
+
+// Accuracy and speed of lib/FastMath against libm.
+//
+// Accuracy: every function is swept over its documented range and compared with
+// the double-precision libm result; the worst error is checked against the bound
+// the header documents. Speed: each function is timed against the call the demos
+// make today (double libm, since sin(x * 0.1) promotes to double) and against the
+// float libm call (sinf), in ns per call.
+
+struct AccuracyResult {
+    const char* name;
+    const char* range;
+    const char* unit;     // "abs", "rel" or "lsb"
+    double maxError;
+    double bound;
+    uint32_t samples;
+};
+
+struct SpeedResult {
+    const char* name;
+    float doubleNs;
+    float floatNs;
+    float fastNs;
+};
+
+const int MAX_RESULTS = 24;
+AccuracyResult accuracy[MAX_RESULTS];
+int accuracyCount = 0;
+SpeedResult speed[MAX_RESULTS];
+int speedCount = 0;
+
+const uint32_t TIMING_CALLS = 200000;
+volatile float sink = 0;
+
+// Function declarations
+void checkAccuracy();
+void measureSpeed();
+void addAccuracy(const char* name, const char* range, const char* unit, double maxError, double bound, uint32_t samples);
+float nsPerCall(unsigned long startUs, unsigned long endUs);
+String buildReport();
+
+// Evenly spaced samples over [lo, hi] that also hit both ends
+inline float sweep(float lo, float hi, uint32_t i, uint32_t n) {
+    return lo + (hi - lo) * (double)i / (n - 1);
+}
+
+void setup() {
+    Serial.begin(115200);
+    delay(1000);
+    Serial.println("fast_math_bench: checking accuracy...");
+
+    checkAccuracy();
+
+    bool quick = false;
+#ifdef M5HOST
+    quick = hostArg("quick") != nullptr;
+#endif
+    if (!quick) {
+        Serial.println("fast_math_bench: timing...");
+        measureSpeed();
+    }
+
+    int failures = 0;
+    for (int i = 0; i < accuracyCount; i++) {
+        const AccuracyResult& r = accuracy[i];
+        bool ok = r.maxError <= r.bound;
+        if (!ok) failures++;
+        Serial.printf("  %-12s %-22s max %s error %.3g (bound %.3g) %s\n",
+                      r.name, r.range, r.unit, r.maxError, r.bound, ok ? "ok" : "EXCEEDED");
+    }
+    for (int i = 0; i < speedCount; i++) {
+        const SpeedResult& r = speed[i];
+        Serial.printf("  %-12s double %7.1f ns  float %7.1f ns  fast %7.1f ns\n",
+                      r.name, r.doubleNs, r.floatNs, r.fastNs);
+    }
+
+    Serial.println("--- fast_math_bench report ---");
+    Serial.println(buildReport());
+    Serial.println("--- end report ---");
+
+#ifdef M5HOST
+    hostExit(failures ? 1 : 0);
+#endif
+}
+
+void loop() {
+    delay(1000);
+}
+
+void addAccuracy(const char* name, const char* range, const char* unit, double maxError, double bound, uint32_t samples) {
+    if (accuracyCount >= MAX_RESULTS) return;
+    accuracy[accuracyCount++] = {name, range, unit, maxError, bound, samples};
+}
+
+void checkAccuracy() {
+    const uint32_t N = 2000001;
+    double worst;
+
+    worst = 0;
+    for (uint32_t i = 0; i < N; i++) {
+        float x = sweep(-1000, 1000, i, N);
+        worst = fmax(worst, fabs(fastSin(x) - sin((double)x)));
+    }
+    addAccuracy("fastSin", "[-1000, 1000]", "abs", worst, FAST_SIN_MAX_ERROR, N);
+
+    worst = 0;
+    for (uint32_t i = 0; i < N; i++) {
+        float x = sweep(-1000, 1000, i, N);
+        worst = fmax(worst, fabs(fastCos(x) - cos((double)x)));
+    }
+    addAccuracy("fastCos", "[-1000, 1000]", "abs", worst, FAST_SIN_MAX_ERROR, N);
+
+    worst = 0;
+    for (uint32_t i = 0; i < N; i++) {
+        float x = sweep(-100, 100, i, N);
+        float s, c;
+        fastSinCos(x, s, c);
+        worst = fmax(worst, fmax(fabs(s - sin((double)x)), fabs(c - cos((double)x))));
+    }
+    addAccuracy("fastSinCos", "[-100, 100]", "abs", worst, FAST_SIN_MAX_ERROR, N);
+
+    // atan2 over a polar grid so every octant and both axes are covered
+    worst = 0;
+    uint32_t samples = 0;
+    for (int ri = 0; ri < 40; ri++) {
+        float radius = powf(10, -3 + ri * 0.2f);
+        for (uint32_t i = 0; i < 50000; i++) {
+            double a = sweep(-M_PI, M_PI, i, 50000);
+            float y = radius * sin(a), x = radius * cos(a);
+            double err = fabs(fastAtan2(y, x) - atan2((double)y, (double)x));
+            // +pi and -pi are the same direction
+            worst = fmax(worst, fmin(err, fabs(err - 2 * M_PI)));
+            samples++;
+        }
+    }
+    addAccuracy("fastAtan2", "r in [1e-3, 1e5]", "abs", worst, FAST_ATAN_MAX_ERROR, samples);
+
+    worst = 0;
+    for (uint32_t i = 0; i < N; i++) {
+        float x = powf(10, sweep(-30, 30, i, N));
+        worst = fmax(worst, fabs(fastSqrt(x) - sqrt((double)x)) / sqrt((double)x));
+    }
+    addAccuracy("fastSqrt", "[1e-30, 1e30]", "rel", worst, 6e-8, N);
+
+    worst = 0;
+    for (uint32_t i = 0; i < N; i++) {
+        float x = powf(10, sweep(-30, 30, i, N));
+        double ref = 1 / sqrt((double)x);
+        worst = fmax(worst, fabs(fastInvSqrt(x) - ref) / ref);
+    }
+    addAccuracy("fastInvSqrt", "[1e-30, 1e30]", "rel", worst, FAST_INV_SQRT_MAX_REL_ERROR, N);
+
+    worst = 0;
+    for (uint32_t i = 0; i < N; i++) {
+        float x = sweep(-125, 127, i, N);
+        double ref = exp2((double)x);
+        worst = fmax(worst, fabs(fastExp2(x) - ref) / ref);
+    }
+    addAccuracy("fastExp2", "[-125, 127]", "rel", worst, FAST_EXP_MAX_REL_ERROR, N);
+
+    worst = 0;
+    for (uint32_t i = 0; i < N; i++) {
+        float x = sweep(-80, 80, i, N);
+        double ref = exp((double)x);
+        worst = fmax(worst, fabs(fastExp(x) - ref) / ref);
+    }
+    addAccuracy("fastExp", "[-80, 80]", "rel", worst, FAST_EXP_E_MAX_REL_ERROR, N);
+
+    worst = 0;
+    for (uint32_t i = 0; i < N; i++) {
+        float x = powf(10, sweep(-37, 38, i, N));
+        worst = fmax(worst, fabs(fastLog2(x) - log2((double)x)));
+    }
+    addAccuracy("fastLog2", "[1e-37, 1e38]", "abs", worst, FAST_LOG2_MAX_ERROR, N);
+
+    // pow: bound is relative to the magnitude of the exponent, as documented
+    worst = 0;
+    samples = 0;
+    for (int bi = 0; bi <= 40; bi++) {
+        float b = -10 + bi * 0.5f;
+        for (uint32_t i = 0; i < 20000; i++) {
+            float a = powf(10, sweep(-2, 2, i, 20000));
+            double ref = pow((double)a, (double)b);
+            double bound = fabs(b * log2((double)a)) * 2e-7 + 3e-7;
+            worst = fmax(worst, fabs(fastPow(a, b) - ref) / ref / bound);
+            samples++;
+        }
+    }
+    addAccuracy("fastPow", "a [0.01, 100] b [-10, 10]", "rel/bound", worst, 1.0, samples);
+
+    // Integer variants
+    worst = 0;
+    for (uint32_t a = 0; a < 65536; a++) {
+        double ref = sin(a * (2 * M_PI / 65536)) * 32767;
+        worst = fmax(worst, fmax(fabs(isin(a) - ref), fabs(icos(a) - cos(a * (2 * M_PI / 65536)) * 32767)));
+    }
+    addAccuracy("isin/icos", "all 65536 angles", "lsb", worst, FAST_ISIN_MAX_ERROR_LSB, 65536);
+
+    worst = 0;
+    samples = 0;
+    for (int y = -2000; y <= 2000; y += 3) {
+        for (int x = -2000; x <= 2000; x += 3) {
+            double ref = atan2((double)y, (double)x) * (32768 / M_PI);
+            if (ref < 0) ref += 65536;
+            double err = fabs(iatan2(y, x) - ref);
+            worst = fmax(worst, fmin(err, 65536 - err));
+            samples++;
+        }
+    }
+    addAccuracy("iatan2", "|x|, |y| <= 2000", "units", worst, FAST_IATAN2_MAX_ERROR, samples);
+
+    uint32_t isqrtErrors = 0;
+    samples = 0;
+    for (uint32_t n = 0; n < (1u << 22); n++, samples++) {
+        uint32_t r = isqrt(n);
+        if ((uint64_t)r * r > n || (uint64_t)(r + 1) * (r + 1) <= n) isqrtErrors++;
+    }
+    for (uint32_t i = 0; i < 1000000; i++, samples++) {
+        uint32_t n = 0xFFFFFFFFu - i * 4093;
+        uint32_t r = isqrt(n);
+        if ((uint64_t)r * r > n || (uint64_t)(r + 1) * (r + 1) <= n) isqrtErrors++;
+    }
+    addAccuracy("isqrt", "exhaustive < 2^22 + top", "wrong", isqrtErrors, 0, samples);
+}
+
+float nsPerCall(unsigned long startUs, unsigned long endUs) {
+    return (endUs - startUs) * 1000.0f / TIMING_CALLS;
+}
+
+// Times three loops over the same inputs: the demos' double call, the float libm
+// call and the fast function. The inputs step by a non-round amount so nothing
+// folds to a constant.
+#define TIME_THREE(NAME, DOUBLE_EXPR, FLOAT_EXPR, FAST_EXPR, START, STEP)      \
+    {                                                                          \
+        SpeedResult r = {NAME, 0, 0, 0};                                       \
+        float acc = 0;                                                         \
+        float x = START;                                                       \
+        unsigned long t0 = micros();                                           \
+        for (uint32_t i = 0; i < TIMING_CALLS; i++, x += STEP) acc += DOUBLE_EXPR; \
+        unsigned long t1 = micros();                                           \
+        x = START;                                                             \
+        for (uint32_t i = 0; i < TIMING_CALLS; i++, x += STEP) acc += FLOAT_EXPR; \
+        unsigned long t2 = micros();                                           \
+        x = START;                                                             \
+        for (uint32_t i = 0; i < TIMING_CALLS; i++, x += STEP) acc += FAST_EXPR; \
+        unsigned long t3 = micros();                                           \
+        sink = acc;                                                            \
+        r.doubleNs = nsPerCall(t0, t1);                                        \
+        r.floatNs = nsPerCall(t1, t2);                                         \
+        r.fastNs = nsPerCall(t2, t3);                                          \
+        if (speedCount < MAX_RESULTS) speed[speedCount++] = r;                 \
+    }
+
+void measureSpeed() {
+    TIME_THREE("sin", sin((double)x), sinf(x), fastSin(x), -50.0f, 0.000731f);
+    TIME_THREE("cos", cos((double)x), cosf(x), fastCos(x), -50.0f, 0.000731f);
+    TIME_THREE("atan2", atan2((double)x, 1.7), atan2f(x, 1.7f), fastAtan2(x, 1.7f), -50.0f, 0.000731f);
+    TIME_THREE("sqrt", sqrt((double)x), sqrtf(x), fastSqrt(x), 0.5f, 0.0731f);
+    TIME_THREE("1/sqrt", 1 / sqrt((double)x), 1 / sqrtf(x), fastInvSqrt(x), 0.5f, 0.0731f);
+    TIME_THREE("exp", exp((double)x), expf(x), fastExp(x), -20.0f, 0.000197f);
+    TIME_THREE("log2", log2((double)x), log2f(x), fastLog2(x), 0.5f, 0.0731f);
+    TIME_THREE("pow", pow(2.0, (double)x), powf(2.0f, x), fastPow(2.0f, x), -10.0f, 0.0000497f);
+    TIME_THREE("isin", sin((double)x), sinf(x), isin((uint16_t)(int32_t)(x * 10430.378f)) * (1.0f / 32767),
+               -50.0f, 0.000731f);
+}
+
+String buildReport() {
+#ifdef M5HOST
+    String out = "{\"target\":\"host\",\"accuracy\":[";
+#else
+    String out = "{\"target\":\"esp32p4\",\"accuracy\":[";
+#endif
+    for (int i = 0; i < accuracyCount; i++) {
+        const AccuracyResult& r = accuracy[i];
+        char line[256];
+        snprintf(line, sizeof(line), "%s\n{\"name\":\"%s\",\"unit\":\"%s\",\"max_error\":%.4g,\"bound\":%.4g,\"samples\":%u,\"ok\":%s}",
+                 i ? "," : "", r.name, r.unit, r.maxError, r.bound, (unsigned)r.samples,
+                 r.maxError <= r.bound ? "true" : "false");
+        out += line;
+    }
+    out += "\n],\"speed_ns\":[";
+    for (int i = 0; i < speedCount; i++) {
+        const SpeedResult& r = speed[i];
+        char line[160];
+        snprintf(line, sizeof(line), "%s\n{\"name\":\"%s\",\"double\":%.1f,\"float\":%.1f,\"fast\":%.1f}",
+                 i ? "," : "", r.name, r.doubleNs, r.floatNs, r.fastNs);
+        out += line;
+    }
+    out += "\n]}";
+    return out;
+}
@@ -0,0 +1,322 @@
+#include <Arduino.h>
+#include <room_hub.h>
+
+// Cost of a state message in lib/RoomHub against the number of monitors.
+//
+// Each round every device publishes one reading, as the monitors do every
+// 5 s; the Tab5 in hub mode gets them through its MqttPipe message callback
+// and hands them to RoomHub::handle(). After each round the dirty tiles are
+// taken as updateHubDisplay() takes them. The timing covers handle() alone;
+// a second pass without timing checks the values, the history, the tile order
+// and the stale detection. A last run checks the stale detection for monitors
+// that send a reading only every 5 minutes or hour but their window
+// statistics every 5 minutes.
+
+const uint16_t FLEETS[] = {16, 64, 256, 1024};
+const int ROUNDS = 10;
+const uint16_t HISTORY = 360;
+const uint32_t INTERVAL_MS = 5000;
+
+struct FleetResult {
+    uint16_t devices;
+    float usPerMessage;
+    float usDirtyRound;     // taking a round's dirty tiles
+    uint32_t probeMax;
+    bool ok;
+};
+
+FleetResult results[sizeof(FLEETS) / sizeof(FLEETS[0])];
+int resultCount = 0;
+
+// Function declarations
+void deviceId(uint16_t i, char* out, size_t size);
+void readingAt(uint16_t device, int round, float& temperature, float& humidity, uint16_t& co2);
+size_t message(uint16_t device, int round, char* topic, size_t topicSize, char* payload, size_t payloadSize);
+FleetResult runFleet(uint16_t devices);
+bool checkFleet(RoomHub& hub, uint16_t devices);
+bool checkWindowed();
+bool checkOwnId();
+String buildReport();
+
+void setup() {
+    Serial.begin(115200);
+    delay(1000);
+
+    int failures = 0;
+    for (uint16_t devices : FLEETS) {
+        FleetResult& r = results[resultCount++];
+        r = runFleet(devices);
+        if (!r.ok) failures++;
+        Serial.printf("  %5u devices  %6.2f us/message  %7.1f us dirty tiles/round  probe max %u  %s\n",
+                      r.devices, r.usPerMessage, r.usDirtyRound, (unsigned)r.probeMax, r.ok ? "ok" : "FAILED");
+    }
+
+    bool windowed = checkWindowed();
+    if (!windowed) failures++;
+    Serial.printf("  stale detection with window statistics  %s\n", windowed ? "ok" : "FAILED");
+    bool ownId = checkOwnId();
+    if (!ownId) failures++;
+    Serial.printf("  own id changed at runtime  %s\n", ownId ? "ok" : "FAILED");
+
+    Serial.println("--- hub_bench report ---");
+    Serial.println(buildReport());
+    Serial.println("--- end report ---");
+
+#ifdef M5HOST
+    hostExit(failures ? 1 : 0);
+#endif
+}
+
+void loop() {
+    delay(1000);
+}
+
+// A mixed fleet: m5coreink_no_1, m5paper_no_1, m5tab5_no_1, m5coreink_no_2, ...
+void deviceId(uint16_t i, char* out, size_t size) {
+    static const char* kinds[] = {"m5coreink", "m5paper", "m5tab5"};
+    snprintf(out, size, "%s_no_%u", kinds[i % 3], i / 3 + 1);
+}
+
+void readingAt(uint16_t device, int round, float& temperature, float& humidity, uint16_t& co2) {
+    temperature = 18.0f + ((device * 37 + round * 11) % 900) * 0.01f;
+    humidity = 30 + (device * 7 + round) % 40;
+    co2 = 420 + (device * 53 + round * 29) % 1800;
+}
+
+// As the monitors publish it (lib/HaDevice: haTopic, haStatePayload)
+size_t message(uint16_t device, int round, char* topic, size_t topicSize, char* payload, size_t payloadSize) {
+    char id[ROOM_HUB_ID_LENGTH];
+    deviceId(device, id, sizeof(id));
+    snprintf(topic, topicSize, "homeassistant/sensor/%s/state", id);
+    float temperature, humidity;
+    uint16_t co2;
+    readingAt(device, round, temperature, humidity, co2);
+    return snprintf(payload, payloadSize, "{\"temperature\":%.2f,\"humidity\":%d,\"co2\":%u}", temperature,
+                    (int)humidity, co2);
+}
+
+FleetResult runFleet(uint16_t devices) {
+    FleetResult r = {devices, 0, 0, 0, true};
+    RoomHub hub;
+    if (!hub.begin(devices, HISTORY, "m5tab5_hub")) {
+        Serial.printf("%u devices: out of memory\n", devices);
+        r.ok = false;
+        return r;
+    }
+
+    // The messages are made up front, as they arrive whole in MqttPipe's buffer
+    char (*topics)[64] = new char[devices][64];
+    char (*payloads)[64] = new char[devices][64];
+    size_t* lengths = new size_t[devices];
+    unsigned long handleUs = 0, dirtyUs = 0;
+    for (int round = 0; round < ROUNDS; round++) {
+        for (uint16_t d = 0; d < devices; d++) {
+            lengths[d] = message(d, round, topics[d], sizeof(topics[d]), payloads[d], sizeof(payloads[d]));
+        }
+        uint32_t now = 1000 + round * INTERVAL_MS;
+        unsigned long t0 = micros();
+        for (uint16_t d = 0; d < devices; d++) {
+            if (!hub.handle(topics[d], (const uint8_t*)payloads[d], lengths[d], now)) r.ok = false;
+        }
+        unsigned long t1 = micros();
+        hub.takeLayoutChange();
+        int taken = 0;
+        while (hub.nextDirty() >= 0) taken++;
+        unsigned long t2 = micros();
+        handleUs += t1 - t0;
+        dirtyUs += t2 - t1;
+        // Every device once; none the first round, as tiles all moved then
+        if (taken != (round == 0 ? 0 : devices)) {
+            Serial.printf("%u devices, round %d: %d dirty tiles\n", devices, round, taken);
+            r.ok = false;
+        }
+    }
+    r.usPerMessage = (float)handleUs / (ROUNDS * devices);
+    r.usDirtyRound = (float)dirtyUs / ROUNDS;
+    r.probeMax = hub.stats().probeMax;
+    if (!checkFleet(hub, devices)) r.ok = false;
+
+    delete[] topics;
+    delete[] payloads;
+    delete[] lengths;
+    return r;
+}
+
+bool checkFleet(RoomHub& hub, uint16_t devices) {
+    bool ok = hub.count() == devices;
+    char id[ROOM_HUB_ID_LENGTH];
+    RoomHubSample samples[ROUNDS];
+    for (uint16_t d = 0; d < devices && ok; d++) {
+        deviceId(d, id, sizeof(id));
+        int slot = hub.find(id);
+        if (slot < 0) {
+            Serial.printf("%s not found\n", id);
+            return false;
+        }
+        const RoomHubDevice& device = hub.device(slot);
+        float temperature, humidity;
+        uint16_t co2;
+        readingAt(d, ROUNDS - 1, temperature, humidity, co2);
+        if (fabsf(device.temperature - temperature) > 0.006f || device.co2 != co2 || device.updates != ROUNDS) {
+            Serial.printf("%s: %.2f °C, %u ppm, %u updates\n", id, device.temperature, device.co2,
+                          (unsigned)device.updates);
+            ok = false;
+        }
+        size_t n = hub.history(slot, samples, ROUNDS);
+        for (size_t i = 0; i < n && ok; i++) {
+            readingAt(d, i, temperature, humidity, co2);
+            if (samples[i].co2 != co2 || samples[i].humidity != (uint8_t)humidity ||
+                samples[i].temperature != (int16_t)lroundf(temperature * 100)) {
+                Serial.printf("%s: reading %u of the history differs\n", id, (unsigned)i);
+                ok = false;
+            }
+        }
+        if (n != ROUNDS) ok = false;
+    }
+    for (uint16_t t = 1; t < hub.count() && ok; t++) {
+        if (strcmp(hub.device(hub.slotAt(t - 1)).id, hub.device(hub.slotAt(t)).id) >= 0) {
+            Serial.printf("tile %u out of order\n", t);
+            ok = false;
+        }
+    }
+
+    // The messages of other topics, the hub's own and broken payloads change nothing
+    const uint8_t good[] = "{\"temperature\":20,\"humidity\":40,\"co2\":500}";
+    const uint8_t broken[] = "{\"temperature\":20,\"humidity\":40}";
+    uint32_t last = 1000 + (ROUNDS - 1) * INTERVAL_MS;
+    if (hub.handle("homeassistant/sensor/m5tab5_hub/state", good, sizeof(good) - 1, last) ||
+        hub.handle("homeassistant/sensor/m5paper_no_1_co2/config", good, sizeof(good) - 1, last) ||
+        hub.handle("homeassistant/sensor/m5paper_no_1/state", broken, sizeof(broken) - 1, last) ||
+        hub.count() != devices) {
+        Serial.println("a message that is not a reading was taken");
+        ok = false;
+    }
+
+    // One device goes on publishing, the others go quiet
+    deviceId(0, id, sizeof(id));
+    uint32_t later = last + ROOM_HUB_DEFAULT_STALE_MS;
+    hub.update(id, 21, 40, 600, later);
+    hub.checkStale(later);
+    int stale = 0, dirty = 0;
+    for (uint16_t slot = 0; slot < hub.count(); slot++) {
+        if (hub.device(slot).stale) stale++;
+    }
+    while (hub.nextDirty() >= 0) dirty++;
+    if (stale != devices - 1 || dirty != devices) {
+        Serial.printf("%d stale and %d dirty, %u and %u expected\n", stale, dirty, devices - 1, devices);
+        ok = false;
+    }
+    return ok;
+}
+
+// Four monitors over two hours, at the readings' 5 s: "raw" publishes every
+// reading, "windowed" (raw_state off) one as each 5-minute window closes,
+// "hourly" (publish_ms of an hour) one an hour; all publish stats/5m and
+// stats/1h. The Tab5 publishes the statistics of a closing window before
+// the reading, the CoreInk and Paper after it ("windowed_ink"); the hub
+// meets each at its first reading after a window closed. "raw" goes
+// quiet at 60 minutes and must be stale within ROOM_HUB_DEFAULT_STALE_MS,
+// window statistics or not; "hourly" goes quiet at 90 minutes and must stay
+// fresh for ROOM_HUB_STALE_WINDOWS windows and then go stale. The windowed
+// ones must never be stale.
+bool checkWindowed() {
+    RoomHub hub;
+    if (!hub.begin(8, 16, "m5tab5_hub")) return false;
+    const int MONITORS = 4;
+    const char* ids[MONITORS] = {"raw", "windowed", "windowed_ink", "hourly"};
+    const uint32_t quietAtMs[MONITORS] = {3600000, 0xFFFFFFFF, 0xFFFFFFFF, 5400000};
+    const uint32_t readingEveryMs[MONITORS] = {INTERVAL_MS, 300000, 300000, 3600000};
+    const bool statsFirst[MONITORS] = {true, true, false, true};
+    const uint8_t reading[] = "{\"temperature\":20,\"humidity\":40,\"co2\":500}";
+    const uint8_t stats[] = "{\"window\": \"5m\", \"count\": 60}";
+    uint32_t staleAtMs[MONITORS] = {};
+    bool ok = true;
+
+    char topic[64];
+    hub.handle("homeassistant/sensor/unknown/stats/5m", stats, sizeof(stats) - 1, 1000);
+    if (hub.count() != 0) {
+        Serial.println("stats added a device");
+        ok = false;
+    }
+    for (uint32_t t = 0; t <= 2 * 3600000UL; t += INTERVAL_MS) {
+        uint32_t now = 1000 + t;
+        for (int i = 0; i < MONITORS; i++) {
+            if (t >= quietAtMs[i]) continue;
+            for (int pass = 0; pass < 2; pass++) {
+                if (pass == (statsFirst[i] ? 0 : 1)) {
+                    // A window closes every 5 minutes from boot
+                    if (t % 300000 == 0 && t > 0) {
+                        snprintf(topic, sizeof(topic), "homeassistant/sensor/%s/stats/5m", ids[i]);
+                        if (!hub.handle(topic, stats, sizeof(stats) - 1, now)) ok = false;
+                    }
+                    if (t % 3600000 == 0 && t > 0) {
+                        snprintf(topic, sizeof(topic), "homeassistant/sensor/%s/stats/1h", ids[i]);
+                        if (!hub.handle(topic, stats, sizeof(stats) - 1, now)) ok = false;
+                    }
+                } else if (t > 0 && t % readingEveryMs[i] == 0) {
+                    snprintf(topic, sizeof(topic), "homeassistant/sensor/%s/state", ids[i]);
+                    if (!hub.handle(topic, reading, sizeof(reading) - 1, now)) ok = false;
+                }
+            }
+        }
+        hub.checkStale(now);
+        while (hub.nextDirty() >= 0) {
+        }
+        for (int i = 0; i < MONITORS; i++) {
+            int slot = hub.find(ids[i]);
+            if (slot >= 0 && hub.device(slot).stale && !staleAtMs[i]) staleAtMs[i] = t;
+        }
+    }
+
+    uint32_t rawLimit = quietAtMs[0] - INTERVAL_MS + ROOM_HUB_DEFAULT_STALE_MS;
+    if (!staleAtMs[0] || staleAtMs[0] > rawLimit) {
+        Serial.printf("raw: stale at %lu ms, by %lu expected\n", (unsigned long)staleAtMs[0], (unsigned long)rawLimit);
+        ok = false;
+    }
+    for (int i = 1; i <= 2; i++) {
+        if (staleAtMs[i]) {
+            Serial.printf("%s: stale at %lu ms\n", ids[i], (unsigned long)staleAtMs[i]);
+            ok = false;
+        }
+    }
+    uint32_t lastWindow = (quietAtMs[3] - 1) / 300000 * 300000;
+    uint32_t hourlyAt = lastWindow + ROOM_HUB_STALE_WINDOWS * 300000UL;
+    if (staleAtMs[3] != hourlyAt) {
+        Serial.printf("hourly: stale at %lu ms, at %lu expected\n", (unsigned long)staleAtMs[3],
+                      (unsigned long)hourlyAt);
+        ok = false;
+    }
+    return ok;
+}
+
+// The hub's device_id changes through RemoteConfig: the broker's echo of
+// its readings under the new id is ignored, the old id is a room like any other
+bool checkOwnId() {
+    RoomHub hub;
+    if (!hub.begin(8, 16, "m5tab5_hub")) return false;
+    const uint8_t reading[] = "{\"temperature\":20,\"humidity\":40,\"co2\":500}";
+    hub.setOwnId("m5tab5_lobby");
+    bool newIgnored = !hub.handle("homeassistant/sensor/m5tab5_lobby/state", reading, sizeof(reading) - 1, 1000);
+    bool oldTaken = hub.handle("homeassistant/sensor/m5tab5_hub/state", reading, sizeof(reading) - 1, 1000);
+    if (!newIgnored || !oldTaken || hub.count() != 1) {
+        Serial.printf("own id: new %s, old %s, %u devices\n", newIgnored ? "ignored" : "taken",
+                      oldTaken ? "taken" : "ignored", hub.count());
+        return false;
+    }
+    return true;
+}
+
+String buildReport() {
+    String report = "{\"fleets\":[";
+    for (int i = 0; i < resultCount; i++) {
+        const FleetResult& r = results[i];
+        char line[200];
+        snprintf(line, sizeof(line),
+                 "%s{\"devices\":%u,\"us_per_message\":%.2f,\"us_dirty_round\":%.1f,\"probe_max\":%u,\"ok\":%s}",
+                 i ? "," : "", r.devices, r.usPerMessage, r.usDirtyRound, (unsigned)r.probeMax,
+                 r.ok ? "true" : "false");
+        report += line;
+    }
+    report += "]}";
+    return report;
+}
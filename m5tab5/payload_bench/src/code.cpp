@@ -0,0 +1,304 @@
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <cbor_pack.h>
+#include <cbor_json.h>
+
+// Size and encode time of the 1_temp_hum payloads, ArduinoJson against
+// lib/CborPack.
+//
+// The state message is one reading as publishSensorData() sends it; the
+// history message is 12 readings as publishHistory() sends them. Each is
+// encoded the way the firmware does it (ArduinoJson document, then
+// serializeJson into a char buffer) and with a CborWriter over a stack
+// buffer. Every CBOR payload is turned back into JSON with cborToJson() and
+// compared with the text expected from its 16-bit values, which is what
+// tools/cbor_bridge hands to Home Assistant, as are a few maps with array
+// and map keys.
+
+struct StateRecord {
+    float temperature;
+    float humidity;
+    uint16_t co2;
+};
+
+struct HistoryRow {
+    uint32_t t;
+    float temperature;
+    float humidity;
+    uint16_t co2;
+};
+
+const CborField stateFields[] = {
+    CBOR_FIELD(StateRecord, temperature, CBOR_HALF),
+    CBOR_FIELD(StateRecord, humidity, CBOR_HALF),
+    CBOR_FIELD(StateRecord, co2, CBOR_UINT16),
+};
+const CborSchema stateSchema = CBOR_SCHEMA(stateFields);
+
+const CborField historyFields[] = {
+    CBOR_FIELD(HistoryRow, t, CBOR_UINT32),
+    CBOR_FIELD(HistoryRow, temperature, CBOR_HALF),
+    CBOR_FIELD(HistoryRow, humidity, CBOR_HALF),
+    CBOR_FIELD(HistoryRow, co2, CBOR_UINT16),
+};
+const CborSchema historySchema = CBOR_SCHEMA(historyFields);
+
+const int HISTORY_ROWS = 12;
+const char* DEVICE_ID = "m5tab5_no_1";
+
+struct PayloadResult {
+    const char* name;
+    size_t jsonBytes;
+    size_t cborBytes;
+    size_t bridgedBytes;    // the CBOR as JSON again
+    float jsonUs;
+    float cborUs;
+    bool roundTrip;
+};
+
+PayloadResult results[2];
+int resultCount = 0;
+
+const uint32_t TIMING_ENCODES = 20000;
+volatile size_t sink = 0;
+
+// Function declarations
+StateRecord stateAt(uint32_t i);
+void historyAt(uint32_t i, HistoryRow* rows);
+size_t stateJson(const StateRecord& r, char* out, size_t size);
+size_t stateCbor(const StateRecord& r, uint8_t* out, size_t size);
+size_t historyJson(const HistoryRow* rows, char* out, size_t size);
+size_t historyCbor(const HistoryRow* rows, uint8_t* out, size_t size);
+size_t expectedStateJson(const StateRecord& r, char* out, size_t size);
+size_t expectedHistoryJson(const HistoryRow* rows, char* out, size_t size);
+bool checkRoundTrip(const uint8_t* cbor, size_t length, const char* expected, size_t& bridgedBytes);
+int checkKeys();
+float usPerEncode(unsigned long startUs, unsigned long endUs);
+String buildReport();
+
+void setup() {
+    Serial.begin(115200);
+    delay(1000);
+
+    bool quick = false;
+#ifdef M5HOST
+    quick = hostArg("quick") != nullptr;
+#endif
+
+    char json[1024];
+    char expected[1024];
+    uint8_t cbor[512];
+
+    PayloadResult& state = results[resultCount++];
+    state = {"state", 0, 0, 0, 0, 0, true};
+    for (uint32_t i = 0; i < 1000 && state.roundTrip; i++) {
+        StateRecord r = stateAt(i);
+        size_t n = stateCbor(r, cbor, sizeof(cbor));
+        expectedStateJson(r, expected, sizeof(expected));
+        state.roundTrip = checkRoundTrip(cbor, n, expected, state.bridgedBytes);
+        if (!state.roundTrip) Serial.printf("state: %s expected\n", expected);
+    }
+    state.jsonBytes = stateJson(stateAt(0), json, sizeof(json));
+    state.cborBytes = stateCbor(stateAt(0), cbor, sizeof(cbor));
+    checkRoundTrip(cbor, state.cborBytes, nullptr, state.bridgedBytes);
+
+    PayloadResult& history = results[resultCount++];
+    history = {"history (12 rows)", 0, 0, 0, 0, 0, true};
+    HistoryRow rows[HISTORY_ROWS];
+    for (uint32_t i = 0; i < 1000 && history.roundTrip; i++) {
+        historyAt(i, rows);
+        size_t n = historyCbor(rows, cbor, sizeof(cbor));
+        expectedHistoryJson(rows, expected, sizeof(expected));
+        history.roundTrip = checkRoundTrip(cbor, n, expected, history.bridgedBytes);
+        if (!history.roundTrip) Serial.printf("history: %s expected\n", expected);
+    }
+    historyAt(0, rows);
+    history.jsonBytes = historyJson(rows, json, sizeof(json));
+    history.cborBytes = historyCbor(rows, cbor, sizeof(cbor));
+    checkRoundTrip(cbor, history.cborBytes, nullptr, history.bridgedBytes);
+
+    if (!quick) {
+        Serial.println("payload_bench: timing...");
+        unsigned long t0 = micros();
+        for (uint32_t i = 0; i < TIMING_ENCODES; i++) sink = sink + stateJson(stateAt(i), json, sizeof(json));
+        unsigned long t1 = micros();
+        for (uint32_t i = 0; i < TIMING_ENCODES; i++) sink = sink + stateCbor(stateAt(i), cbor, sizeof(cbor));
+        unsigned long t2 = micros();
+        state.jsonUs = usPerEncode(t0, t1);
+        state.cborUs = usPerEncode(t1, t2);
+
+        // The rows are filled outside the timed loops, as the firmware has them in a batch already
+        const uint32_t SETS = 16;
+        HistoryRow sets[SETS][HISTORY_ROWS];
+        for (uint32_t s = 0; s < SETS; s++) historyAt(s, sets[s]);
+        t0 = micros();
+        for (uint32_t i = 0; i < TIMING_ENCODES; i++) sink = sink + historyJson(sets[i % SETS], json, sizeof(json));
+        t1 = micros();
+        for (uint32_t i = 0; i < TIMING_ENCODES; i++) sink = sink + historyCbor(sets[i % SETS], cbor, sizeof(cbor));
+        t2 = micros();
+        history.jsonUs = usPerEncode(t0, t1);
+        history.cborUs = usPerEncode(t1, t2);
+    }
+
+    int failures = checkKeys();
+    for (int i = 0; i < resultCount; i++) {
+        const PayloadResult& r = results[i];
+        if (!r.roundTrip) failures++;
+        Serial.printf("  %-18s JSON %4u B %7.2f us  CBOR %4u B %7.2f us  (%.0f%%, bridged %u B)  round trip %s\n",
+                      r.name, (unsigned)r.jsonBytes, r.jsonUs, (unsigned)r.cborBytes, r.cborUs,
+                      100.0 * r.cborBytes / r.jsonBytes, (unsigned)r.bridgedBytes, r.roundTrip ? "ok" : "FAILED");
+    }
+
+    Serial.println("--- payload_bench report ---");
+    Serial.println(buildReport());
+    Serial.println("--- end report ---");
+
+#ifdef M5HOST
+    hostExit(failures ? 1 : 0);
+#endif
+}
+
+void loop() {
+    delay(1000);
+}
+
+// SCD40-like readings that move a little from one to the next
+StateRecord stateAt(uint32_t i) {
+    StateRecord r;
+    r.temperature = 18.0f + (i * 37 % 900) * 0.01f;
+    r.humidity = 30.0f + (i * 53 % 400) * 0.1f;
+    r.co2 = 420 + i * 7 % 1800;
+    return r;
+}
+
+void historyAt(uint32_t i, HistoryRow* rows) {
+    for (int k = 0; k < HISTORY_ROWS; k++) {
+        StateRecord r = stateAt(i * HISTORY_ROWS + k);
+        rows[k] = {3600 + (i * HISTORY_ROWS + k) * 5, r.temperature, r.humidity, r.co2};
+    }
+}
+
+// As publishSensorData()
+size_t stateJson(const StateRecord& r, char* out, size_t size) {
+    JsonDocument doc;
+    doc["temperature"] = r.temperature;
+    doc["humidity"] = round(r.humidity);
+    doc["co2"] = r.co2;
+    return serializeJson(doc, out, size);
+}
+
+size_t stateCbor(const StateRecord& r, uint8_t* out, size_t size) {
+    StateRecord rounded = {r.temperature, roundf(r.humidity), r.co2};
+    CborWriter cbor(out, size);
+    cborWriteMap(cbor, stateSchema, &rounded);
+    return cbor.overflow() ? 0 : cbor.length();
+}
+
+// As publishHistory()
+size_t historyJson(const HistoryRow* rows, char* out, size_t size) {
+    JsonDocument doc;
+    doc["device"] = DEVICE_ID;
+    JsonArray fields = doc["fields"].to<JsonArray>();
+    for (uint8_t i = 0; i < historySchema.count; i++) fields.add(historyFields[i].name);
+    JsonArray array = doc["rows"].to<JsonArray>();
+    for (int i = 0; i < HISTORY_ROWS; i++) {
+        JsonArray row = array.add<JsonArray>();
+        row.add(rows[i].t);
+        row.add(rows[i].temperature);
+        row.add(rows[i].humidity);
+        row.add(rows[i].co2);
+    }
+    return serializeJson(doc, out, size);
+}
+
+size_t historyCbor(const HistoryRow* rows, uint8_t* out, size_t size) {
+    CborWriter cbor(out, size);
+    cbor.beginMap(3);
+    cbor.writeText("device");
+    cbor.writeText(DEVICE_ID);
+    cbor.writeText("fields");
+    cborWriteNames(cbor, historySchema);
+    cbor.writeText("rows");
+    cbor.beginArray(HISTORY_ROWS);
+    for (int i = 0; i < HISTORY_ROWS; i++) cborWriteRow(cbor, historySchema, &rows[i]);
+    return cbor.overflow() ? 0 : cbor.length();
+}
+
+// A float sent as a half, printed the way cbor_json.h documents
+inline double half(float value) {
+    return cborHalfToFloat(cborHalf(value));
+}
+
+size_t expectedStateJson(const StateRecord& r, char* out, size_t size) {
+    return snprintf(out, size, "{\"temperature\":%.5g,\"humidity\":%.5g,\"co2\":%u}", half(r.temperature),
+                    half(roundf(r.humidity)), (unsigned)r.co2);
+}
+
+size_t expectedHistoryJson(const HistoryRow* rows, char* out, size_t size) {
+    size_t n = snprintf(out, size, "{\"device\":\"%s\",\"fields\":[\"t\",\"temperature\",\"humidity\",\"co2\"],\"rows\":[",
+                        DEVICE_ID);
+    for (int i = 0; i < HISTORY_ROWS && n < size; i++) {
+        n += snprintf(out + n, size - n, "%s[%u,%.5g,%.5g,%u]", i ? "," : "", (unsigned)rows[i].t,
+                      half(rows[i].temperature), half(rows[i].humidity), (unsigned)rows[i].co2);
+    }
+    if (n < size) n += snprintf(out + n, size - n, "]}");
+    return n;
+}
+
+// `expected` may be null to measure the bridged size only
+bool checkRoundTrip(const uint8_t* cbor, size_t length, const char* expected, size_t& bridgedBytes) {
+    char json[1024];
+    bridgedBytes = length ? cborToJson(cbor, length, json, sizeof(json)) : 0;
+    if (bridgedBytes == 0) return false;
+    return !expected || strcmp(json, expected) == 0;
+}
+
+// Map keys that are not text come out as JSON strings: an array or map key
+// is its JSON rendering, escaped (twice for a key inside a key). Returns the
+// number of failures.
+int checkKeys() {
+    struct KeyCase {
+        uint8_t cbor[8];
+        size_t length;
+        const char* expected;
+    };
+    static const KeyCase cases[] = {
+        {{0xA1, 0x01, 0x02}, 3, "{\"1\":2}"},
+        {{0xA1, 0x82, 0x01, 0x63, 0x61, 0x22, 0x62, 0xF5}, 8, "{\"[1,\\\"a\\\\\\\"b\\\"]\":true}"},
+        {{0xA1, 0xA1, 0x61, 0x6B, 0x81, 0x41, 0x00, 0xF6}, 8, "{\"{\\\"k\\\":[\\\"00\\\"]}\":null}"},
+        {{0xA1, 0xA1, 0x82, 0x02, 0x61, 0x78, 0x01, 0x00}, 8, "{\"{\\\"[2,\\\\\\\"x\\\\\\\"]\\\":1}\":0}"},
+    };
+    int failures = 0;
+    for (const KeyCase& c : cases) {
+        char json[128];
+        size_t n = cborToJson(c.cbor, c.length, json, sizeof(json));
+        bool ok = n && strcmp(json, c.expected) == 0;
+        if (!ok) failures++;
+        Serial.printf("  map key %-36s %s\n", n ? json : "(no JSON)", ok ? "ok" : "FAILED");
+    }
+    return failures;
+}
+
+float usPerEncode(unsigned long startUs, unsigned long endUs) {
+    return (float)(endUs - startUs) / TIMING_ENCODES;
+}
+
+String buildReport() {
+#ifdef M5HOST
+    String out = "{\"target\":\"host\",\"payloads\":[";
+#else
+    String out = "{\"target\":\"esp32p4\",\"payloads\":[";
+#endif
+    for (int i = 0; i < resultCount; i++) {
+        const PayloadResult& r = results[i];
+        char line[256];
+        snprintf(line, sizeof(line),
+                 "%s\n{\"name\":\"%s\",\"json_bytes\":%u,\"cbor_bytes\":%u,\"bridged_bytes\":%u,"
+                 "\"json_us\":%.2f,\"cbor_us\":%.2f,\"round_trip\":%s}",
+                 i ? "," : "", r.name, (unsigned)r.jsonBytes, (unsigned)r.cborBytes, (unsigned)r.bridgedBytes,
+                 r.jsonUs, r.cborUs, r.roundTrip ? "true" : "false");
+        out += line;
+    }
+    out += "\n]}";
+    return out;
+}
@@ -0,0 +1,239 @@
+#include <Arduino.h>
+#include <task_pool.h>
+#include <atomic>
+
+// Stress test for lib/TaskPool.
+//
+// Coverage: thousands of random ranges and grains, every item must be visited
+// exactly once. Timeout: a slow body with a short timeout must return false,
+// and every item that started must also have finished. Nesting: a parallelFor
+// inside a body runs serially and still covers its range. Balance: a workload
+// whose cost grows along the range (like fractal rows) is timed against a
+// serial run, with the utilisation of each participant.
+
+const int MAX_ITEMS = 4096;
+uint8_t visits[MAX_ITEMS];
+uint8_t started[MAX_ITEMS];
+uint8_t finished[MAX_ITEMS];
+std::atomic<uint32_t> sink(0);   // keeps the busy loops from being optimised away
+
+struct CheckResult {
+    const char* name;
+    bool ok;
+    String detail;
+};
+
+const int MAX_CHECKS = 8;
+CheckResult checks[MAX_CHECKS];
+int checkCount = 0;
+
+float serialMs = 0;
+float parallelMs = 0;
+float utilisation[TASK_POOL_MAX_PARTICIPANTS];
+TaskPoolStats balanceStats[TASK_POOL_MAX_PARTICIPANTS];
+
+// Function declarations
+void checkCoverage(uint32_t rounds);
+void checkTimeout();
+void checkNesting();
+void measureBalance();
+void addCheck(const char* name, bool ok, const String& detail);
+uint32_t nextRandom();
+uint32_t spin(uint32_t iterations);
+String buildReport();
+
+void setup() {
+    Serial.begin(115200);
+    delay(1000);
+
+    int workers = -1;
+    uint32_t rounds = 5000;
+#ifdef M5HOST
+    workers = atoi(hostArg("workers", "-1"));
+    rounds = atoi(hostArg("rounds", "5000"));
+#endif
+    taskPoolBegin(workers);
+    Serial.printf("task_pool_stress: %d participants, %u rounds\n", taskPoolParticipants(), (unsigned)rounds);
+
+    checkCoverage(rounds);
+    checkTimeout();
+    checkNesting();
+    measureBalance();
+
+    int failures = 0;
+    for (int i = 0; i < checkCount; i++) {
+        if (!checks[i].ok) failures++;
+        Serial.printf("  %-10s %s  %s\n", checks[i].name, checks[i].ok ? "ok    " : "FAILED", checks[i].detail.c_str());
+    }
+    Serial.printf("  balance    serial %.2f ms  parallel %.2f ms  speedup %.2fx\n",
+                  serialMs, parallelMs, parallelMs > 0 ? serialMs / parallelMs : 0);
+    for (int i = 0; i < taskPoolParticipants(); i++) {
+        Serial.printf("  participant %d: %4.1f%% busy, %u ranges, %u steals\n", i, utilisation[i] * 100,
+                      (unsigned)balanceStats[i].ranges, (unsigned)balanceStats[i].steals);
+    }
+
+    Serial.println("--- task_pool_stress report ---");
+    Serial.println(buildReport());
+    Serial.println("--- end report ---");
+
+    taskPoolEnd();
+#ifdef M5HOST
+    hostExit(failures ? 1 : 0);
+#endif
+}
+
+void loop() {
+    delay(1000);
+}
+
+void addCheck(const char* name, bool ok, const String& detail) {
+    if (checkCount >= MAX_CHECKS) return;
+    checks[checkCount++] = {name, ok, detail};
+}
+
+// xorshift32; only called from setup(), never from a body
+uint32_t nextRandom() {
+    static uint32_t state = 0x9E3779B9;
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+uint32_t spin(uint32_t iterations) {
+    uint32_t x = iterations;
+    for (uint32_t i = 0; i < iterations; i++) x = x * 1664525 + 1013904223;
+    return x;
+}
+
+void checkCoverage(uint32_t rounds) {
+    uint32_t badRounds = 0;
+    uint32_t firstBad = 0;
+    uint64_t items = 0;
+    unsigned long start = micros();
+
+    for (uint32_t round = 0; round < rounds; round++) {
+        int begin = nextRandom() % 64;
+        int end = begin + nextRandom() % (MAX_ITEMS - 64);
+        int grain = nextRandom() % 4 == 0 ? 0 : 1 + nextRandom() % 64;
+        memset(visits, 0, sizeof(visits));
+
+        parallelFor(begin, end, grain, [&](int lo, int hi) {
+            for (int i = lo; i < hi; i++) visits[i]++;
+        });
+
+        bool ok = true;
+        for (int i = 0; i < MAX_ITEMS; i++) {
+            if (visits[i] != (i >= begin && i < end ? 1 : 0)) ok = false;
+        }
+        if (!ok && badRounds++ == 0) firstBad = round;
+        items += end - begin;
+    }
+
+    float ms = (micros() - start) / 1000.0f;
+    String detail = String(rounds) + " ranges, " + String((unsigned long)items) + " items in " + String(ms, 1) + " ms";
+    if (badRounds) detail += ", " + String(badRounds) + " wrong (first at round " + String(firstBad) + ")";
+    addCheck("coverage", badRounds == 0, detail);
+}
+
+void checkTimeout() {
+    memset(started, 0, sizeof(started));
+    memset(finished, 0, sizeof(finished));
+
+    // 1024 items of ~1 ms each cannot finish within 20 ms on any participant count
+    unsigned long start = micros();
+    bool completed = parallelFor(0, 1024, 1, [&](int lo, int hi) {
+        for (int i = lo; i < hi; i++) {
+            started[i] = 1;
+            unsigned long until = micros() + 1000;
+            while ((long)(micros() - until) < 0) {}
+            finished[i] = 1;
+        }
+    }, 20);
+    float ms = (micros() - start) / 1000.0f;
+
+    int ran = 0, halfRun = 0;
+    for (int i = 0; i < 1024; i++) {
+        ran += finished[i];
+        if (started[i] != finished[i]) halfRun++;
+    }
+    bool ok = !completed && halfRun == 0 && ran < 1024 && ms < 200;
+    addCheck("timeout", ok, String(completed ? "completed" : "timed out") + " after " + String(ms, 1) +
+             " ms, " + String(ran) + " items ran, " + String(halfRun) + " half-run");
+
+    // The pool must be usable straight after a timeout
+    memset(visits, 0, sizeof(visits));
+    bool again = parallelFor(0, MAX_ITEMS, 16, [&](int lo, int hi) {
+        for (int i = lo; i < hi; i++) visits[i]++;
+    });
+    int wrong = 0;
+    for (int i = 0; i < MAX_ITEMS; i++) wrong += visits[i] != 1;
+    addCheck("recovery", again && wrong == 0, String(wrong) + " items wrong after the timed-out call");
+}
+
+void checkNesting() {
+    memset(visits, 0, sizeof(visits));
+    const int ROWS = 64, COLUMNS = 64;
+
+    parallelFor(0, ROWS, 1, [&](int lo, int hi) {
+        for (int row = lo; row < hi; row++) {
+            parallelFor(0, COLUMNS, 8, [&](int c0, int c1) {
+                for (int c = c0; c < c1; c++) visits[row * COLUMNS + c]++;
+            });
+        }
+    });
+
+    int wrong = 0;
+    for (int i = 0; i < ROWS * COLUMNS; i++) wrong += visits[i] != 1;
+    addCheck("nesting", wrong == 0, String(wrong) + " of " + String(ROWS * COLUMNS) + " items wrong");
+}
+
+void measureBalance() {
+    // Item i costs i units: the last quarter of the range is ~44% of the work,
+    // so a static split in halves would leave one core idle a third of the time
+    const int ITEMS = 512;
+    const uint32_t UNIT = 200;
+    auto body = [&](int lo, int hi) {
+        uint32_t acc = 0;
+        for (int i = lo; i < hi; i++) acc += spin(i * UNIT);
+        sink.fetch_add(acc, std::memory_order_relaxed);
+    };
+
+    unsigned long start = micros();
+    body(0, ITEMS);
+    serialMs = (micros() - start) / 1000.0f;
+
+    taskPoolResetStats();
+    start = micros();
+    parallelFor(0, ITEMS, 4, body);
+    parallelMs = (micros() - start) / 1000.0f;
+
+    for (int i = 0; i < taskPoolParticipants(); i++) {
+        utilisation[i] = taskPoolUtilisation(i);
+        balanceStats[i] = taskPoolStats(i);
+    }
+}
+
+String buildReport() {
+#ifdef M5HOST
+    String out = "{\"target\":\"host\"";
+#else
+    String out = "{\"target\":\"esp32p4\"";
+#endif
+    out += ",\"participants\":" + String(taskPoolParticipants());
+    out += ",\"checks\":[";
+    for (int i = 0; i < checkCount; i++) {
+        out += String(i ? "," : "") + "\n{\"name\":\"" + checks[i].name + "\",\"ok\":" +
+               (checks[i].ok ? "true" : "false") + ",\"detail\":\"" + checks[i].detail + "\"}";
+    }
+    char line[96];
+    snprintf(line, sizeof(line), "\n],\"balance\":{\"serial_ms\":%.2f,\"parallel_ms\":%.2f,\"utilisation\":[",
+             serialMs, parallelMs);
+    out += line;
+    for (int i = 0; i < taskPoolParticipants(); i++) {
+        snprintf(line, sizeof(line), "%s%.3f", i ? "," : "", utilisation[i]);
+        out += line;
+    }
+    out += "]}}";
+    return out;
+}
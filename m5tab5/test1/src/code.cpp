@@ -17,15 +17,32 @@ struct Button {
     bool pressed;
 };
 
+// Screen-space rectangle used for dirty-area tracking
+struct Box {
+    int x, y, w, h;
+};
+
 // Global variables
 Button buttons[3];
 int selectedShape = 0;
 float animationAngle = 0;
 unsigned long lastTime = 0;
 
+// Off-screen buffer for the animated shape and the area it covered last frame
+LGFX_Sprite shapeSprite(&M5.Display);
+Box prevShapeBox = {0, 0, 0, 0};
+
+// FPS counter
+unsigned long fpsWindowStart = 0;
+int fpsFrames = 0;
+int fps = 0;
+
 // Function declarations
 void drawButtons();
 void drawShape(int shape, float angle);
+void renderShape(LovyanGFX* gfx, int shape, float angle, int centerX, int centerY);
+Box shapeBounds(int shape, float angle, int centerX, int centerY);
+Box unionBox(const Box& a, const Box& b);
 void handleTouch();
 
 void setup() {
@@ -56,7 +73,13 @@ void setup() {
     buttons[2] = {startX + (buttonWidth + 20) * 2, startY, buttonWidth, buttonHeight, "Triangle", COLOR_BUTTON_BG, false};
     
     drawButtons();
+    
+    // Sized for the largest shape; drawShape() grows it if a dirty area ever exceeds this
+    shapeSprite.setColorDepth(16);
+    shapeSprite.createSprite(200, 200);
+    
     lastTime = millis();
+    fpsWindowStart = lastTime;
 }
 
 void drawButtons() {
@@ -76,26 +99,48 @@ void drawButtons() {
     }
 }
 
-void drawShape(int shape, float angle) {
-    // Clear drawing area (keep header and buttons)
-    M5.Display.fillRect(0, 60, M5.Display.width(), M5.Display.height() - 130, COLOR_BACKGROUND);
-    
-    int centerX = M5.Display.width() / 2;
-    int centerY = M5.Display.height() / 2 - 20;
-    
+Box shapeBounds(int shape, float angle, int centerX, int centerY) {
+    // Conservative bounding box of everything renderShape() touches, outlines included
+    int halfW = 0, halfH = 0;
+    switch (shape) {
+        case 0: // Circle: orbiting dots sit at radius + 15 and are 3 px wide
+            halfW = halfH = (int)(50 + sin(angle) * 20) + 15 + 3 + 1;
+            break;
+        case 1: // Rectangle: outline is 5 px outside, corner dots have radius 5
+            halfW = (int)(100 + sin(angle) * 30) / 2 + 5 + 1;
+            halfH = (int)(60 + cos(angle) * 20) / 2 + 5 + 1;
+            break;
+        case 2: // Triangle: every vertex lies on a circle of radius "size"
+            halfW = halfH = (int)(60 + sin(angle) * 20) + 2;
+            break;
+    }
+    return {centerX - halfW, centerY - halfH, halfW * 2 + 1, halfH * 2 + 1};
+}
+
+Box unionBox(const Box& a, const Box& b) {
+    if (a.w <= 0 || a.h <= 0) return b;
+    if (b.w <= 0 || b.h <= 0) return a;
+    int x0 = min(a.x, b.x);
+    int y0 = min(a.y, b.y);
+    int x1 = max(a.x + a.w, b.x + b.w);
+    int y1 = max(a.y + a.h, b.y + b.h);
+    return {x0, y0, x1 - x0, y1 - y0};
+}
+
+void renderShape(LovyanGFX* gfx, int shape, float angle, int centerX, int centerY) {
     switch (shape) {
         case 0: // Circle
             {
                 int radius = 50 + sin(angle) * 20;
-                M5.Display.fillCircle(centerX, centerY, radius, COLOR_CIRCLE);
-                M5.Display.drawCircle(centerX, centerY, radius + 5, COLOR_TEXT);
+                gfx->fillCircle(centerX, centerY, radius, COLOR_CIRCLE);
+                gfx->drawCircle(centerX, centerY, radius + 5, COLOR_TEXT);
                 
                 // Draw rotating dots around circle
                 for (int i = 0; i < 8; i++) {
                     float dotAngle = angle + (i * PI / 4);
                     int dotX = centerX + cos(dotAngle) * (radius + 15);
                     int dotY = centerY + sin(dotAngle) * (radius + 15);
-                    M5.Display.fillCircle(dotX, dotY, 3, COLOR_TEXT);
+                    gfx->fillCircle(dotX, dotY, 3, COLOR_TEXT);
                 }
             }
             break;
@@ -104,8 +149,8 @@ void drawShape(int shape, float angle) {
             {
                 int width = 100 + sin(angle) * 30;
                 int height = 60 + cos(angle) * 20;
-                M5.Display.fillRect(centerX - width/2, centerY - height/2, width, height, COLOR_RECT);
-                M5.Display.drawRect(centerX - width/2 - 5, centerY - height/2 - 5, width + 10, height + 10, COLOR_TEXT);
+                gfx->fillRect(centerX - width/2, centerY - height/2, width, height, COLOR_RECT);
+                gfx->drawRect(centerX - width/2 - 5, centerY - height/2 - 5, width + 10, height + 10, COLOR_TEXT);
                 
                 // Draw corner decorations
                 int corners[4][2] = {
@@ -115,7 +160,7 @@ void drawShape(int shape, float angle) {
                     {centerX - width/2, centerY + height/2}
                 };
                 for (int i = 0; i < 4; i++) {
-                    M5.Display.fillCircle(corners[i][0], corners[i][1], 5, COLOR_TEXT);
+                    gfx->fillCircle(corners[i][0], corners[i][1], 5, COLOR_TEXT);
                 }
             }
             break;
@@ -141,23 +186,47 @@ void drawShape(int shape, float angle) {
                 int rx3 = centerX + (x3 - centerX) * cosA - (y3 - centerY) * sinA;
                 int ry3 = centerY + (x3 - centerX) * sinA + (y3 - centerY) * cosA;
                 
-                M5.Display.fillTriangle(rx1, ry1, rx2, ry2, rx3, ry3, COLOR_TRIANGLE);
-                M5.Display.drawTriangle(rx1, ry1, rx2, ry2, rx3, ry3, COLOR_TEXT);
+                gfx->fillTriangle(rx1, ry1, rx2, ry2, rx3, ry3, COLOR_TRIANGLE);
+                gfx->drawTriangle(rx1, ry1, rx2, ry2, rx3, ry3, COLOR_TEXT);
             }
             break;
     }
+}
+
+void drawShape(int shape, float angle) {
+    int centerX = M5.Display.width() / 2;
+    int centerY = M5.Display.height() / 2 - 20;
+    
+    // Only the area covered by the previous frame and this frame needs repainting
+    Box newBox = shapeBounds(shape, angle, centerX, centerY);
+    Box dirty = unionBox(prevShapeBox, newBox);
+    prevShapeBox = newBox;
+    
+    // Grow the off-screen buffer if this dirty area is bigger than anything seen so far
+    if (dirty.w > shapeSprite.width() || dirty.h > shapeSprite.height()) {
+        shapeSprite.deleteSprite();
+        shapeSprite.createSprite(max(dirty.w, (int)shapeSprite.width()), max(dirty.h, (int)shapeSprite.height()));
+    }
+    
+    // Draw into the sprite with the dirty box origin at (0, 0), then push just that box
+    shapeSprite.fillSprite(COLOR_BACKGROUND);
+    renderShape(&shapeSprite, shape, angle, centerX - dirty.x, centerY - dirty.y);
     
-    // Display info text
+    M5.Display.setClipRect(dirty.x, dirty.y, dirty.w, dirty.h);
+    shapeSprite.pushSprite(dirty.x, dirty.y);
+    M5.Display.clearClipRect();
+    
+    // Display info text (background colour overwrites the previous value in place)
     M5.Display.setTextSize(1);
-    M5.Display.setTextColor(COLOR_TEXT);
+    M5.Display.setTextColor(COLOR_TEXT, COLOR_BACKGROUND);
     M5.Display.setCursor(10, 80);
-    M5.Display.printf("Animation: %.1f", angle * 180 / PI);
+    M5.Display.printf("Animation: %5.1f", angle * 180 / PI);
     
     // Display touch coordinates if touched
     auto touch = M5.Touch.getDetail();
     if (touch.wasPressed()) {
         M5.Display.setCursor(10, 95);
-        M5.Display.printf("Touch: (%d, %d)", touch.x, touch.y);
+        M5.Display.printf("Touch: (%4d, %4d)", touch.x, touch.y);
     }
 }
 
@@ -193,25 +262,28 @@ void loop() {
     // Handle touch input
     handleTouch();
     
-    // Update animation
+    // Advance the animation by elapsed time so speed no longer depends on frame rate
+    // (0.05 rad per 50 ms, as before)
     unsigned long currentTime = millis();
-    if (currentTime - lastTime > 50) { // Update every 50ms
-        animationAngle += 0.05;
-        if (animationAngle > 2 * PI) {
-            animationAngle = 0;
-        }
-        
-        // Draw animated shape
-        drawShape(selectedShape, animationAngle);
-        
-        lastTime = currentTime;
+    animationAngle += 0.001 * (currentTime - lastTime);
+    if (animationAngle > 2 * PI) {
+        animationAngle -= 2 * PI;
     }
+    lastTime = currentTime;
     
-    // Display system info
-    M5.Display.setTextSize(1);
-    M5.Display.setTextColor(COLOR_TEXT);
-    M5.Display.setCursor(10, 110);
-    M5.Display.printf("FPS: %d", (int)(1000.0 / (currentTime - lastTime + 1)));
+    // Draw animated shape every loop; only its dirty box reaches the panel
+    drawShape(selectedShape, animationAngle);
     
-    delay(10);
+    // FPS counter, refreshed once per second
+    fpsFrames++;
+    if (currentTime - fpsWindowStart >= 1000) {
+        fps = fpsFrames * 1000 / (currentTime - fpsWindowStart);
+        fpsFrames = 0;
+        fpsWindowStart = currentTime;
+        
+        M5.Display.setTextSize(1);
+        M5.Display.setTextColor(COLOR_TEXT, COLOR_BACKGROUND);
+        M5.Display.setCursor(10, 110);
+        M5.Display.printf("FPS: %4d", fps);
+    }
 }
\ No newline at end of file
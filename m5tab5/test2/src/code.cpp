@@ -1,9 +1,17 @@
 #include <M5Unified.h>
 #include <M5GFX.h>
+#include "palette_fx.h"
 
 // Create sprite object for effects
 LGFX_Sprite sprite;
 
+// Full-screen palette-indexed canvas shared by the gradient and wave demos.
+// The index field is generated when a demo starts; each frame only the LUT changes.
+PaletteCanvas fxCanvas;
+const int FX_TOP = 40;
+int fxCanvasDemo = -1;      // Demo whose index field is currently in fxCanvas
+uint8_t paletteOffset = 0;
+
 // Demo state variables
 int currentDemo = 0;
 const int totalDemos = 6;
@@ -16,13 +24,14 @@ bool touchDetected = false;
 int touchX = 0, touchY = 0;
 
 // Function declarations
-void demo1_GradientAndAlpha();
+void demo1_GradientAndSpheres();
 void demo2_RotatingSprites();
 void demo3_TextEffects();
 void demo4_DrawingPrimitives();
 void demo5_ParticleSystem();
 void demo6_WaveEffect();
 void drawDemoTitle(const char* title);
+bool preparePaletteDemo(int demo);
 
 // Particle system for demo 5
 struct Particle {
@@ -49,6 +58,11 @@ void setup() {
     sprite.setColorDepth(16);
     sprite.createSprite(100, 100);
     
+    // Palette canvas covers everything below the title bar
+    if (!fxCanvas.begin(M5.Display.width(), M5.Display.height() - FX_TOP)) {
+        Serial.println("Palette canvas allocation failed");
+    }
+    
     // Initialize particles
     for (int i = 0; i < MAX_PARTICLES; i++) {
         particles[i].life = 0;
@@ -90,13 +104,20 @@ void loop() {
     
     // Update animation time
     animationTime += 0.02;
-    
-    // Clear display directly (simpler approach)
-    M5.Display.fillScreen(TFT_BLACK);
+    paletteOffset += 2;
+    
+    // Palette demos repaint the whole canvas with one blit, so they only need a
+    // clear when they are first shown; the others still clear every frame
+    static int lastDemo = -1;
+    bool paletteDemo = (currentDemo == 0 || currentDemo == 5) && fxCanvas.width() > 0;
+    if (!paletteDemo || currentDemo != lastDemo) {
+        M5.Display.fillScreen(TFT_BLACK);
+    }
+    lastDemo = currentDemo;
     
     // Run current demo directly on display
     switch (currentDemo) {
-        case 0: demo1_GradientAndAlpha(); break;
+        case 0: demo1_GradientAndSpheres(); break;
         case 1: demo2_RotatingSprites(); break; 
         case 2: demo3_TextEffects(); break;
         case 3: demo4_DrawingPrimitives(); break;
@@ -107,33 +128,30 @@ void loop() {
     delay(10);
 }
 
-void demo1_GradientAndAlpha() {
-    drawDemoTitle("Gradients & Alpha Blending");
-    
-    // Vertical gradient
-    for (int y = 40; y < 140; y++) {
-        uint8_t r = map(y, 40, 140, 0, 255);
-        uint8_t g = map(y, 40, 140, 255, 0);
-        uint8_t b = 128;
-        M5.Display.drawFastHLine(20, y, 100, M5.Display.color565(r, g, b));
+bool preparePaletteDemo(int demo) {
+    if (fxCanvas.width() == 0) return false;
+    if (fxCanvasDemo == demo) return true;
+    
+    // One-time row generation when the demo is entered
+    if (demo == 0) {
+        buildRainbowPalette(fxCanvas);
+        generateLinearGradient(fxCanvas, 48, 96);
+    } else {
+        buildPlasmaPalette(fxCanvas);
+        generatePlasma(fxCanvas);
     }
-    
-    // Horizontal gradient
-    for (int x = 150; x < 250; x++) {
-        uint8_t r = 128;
-        uint8_t g = map(x, 150, 250, 0, 255);
-        uint8_t b = map(x, 150, 250, 255, 0);
-        M5.Display.drawFastVLine(x, 40, 100, M5.Display.color565(r, g, b));
+    fxCanvasDemo = demo;
+    return true;
+}
+
+void demo1_GradientAndSpheres() {
+    // Full-screen diagonal gradient animated purely by palette cycling
+    if (preparePaletteDemo(0)) {
+        fxCanvas.cyclePalette(paletteOffset);
+        fxCanvas.push(&M5.Display, 0, FX_TOP);
     }
     
-    // Radial gradient circles with alpha
-    int centerX = M5.Display.width() - 100;
-    int centerY = 90;
-    for (int r = 50; r > 0; r -= 2) {
-        uint8_t alpha = map(r, 0, 50, 255, 0);
-        uint16_t color = M5.Display.color565(255 * alpha / 255, 100 * alpha / 255, 200 * alpha / 255);
-        M5.Display.fillCircle(centerX, centerY, r, color);
-    }
+    drawDemoTitle("Gradients & Shaded Spheres");
     
     // Animated overlapping circles
     for (int i = 0; i < 3; i++) {
@@ -141,7 +159,7 @@ void demo1_GradientAndAlpha() {
         int y = 180 + sin(animationTime + i * 2.09) * 30;
         uint16_t colors[] = {TFT_RED, TFT_GREEN, TFT_BLUE};
         
-        // Draw with transparency effect (simplified)
+        // Shaded by drawing smaller, brighter circles on top
         for (int r = 30; r > 0; r--) {
             uint8_t intensity = map(r, 0, 30, 100, 20);
             uint16_t color = M5.Display.color565(
@@ -359,21 +377,14 @@ void demo5_ParticleSystem() {
 }
 
 void demo6_WaveEffect() {
-    drawDemoTitle("Wave & Plasma Effects");
-    
-    // Plasma effect
-    for (int y = 40; y < 140; y += 4) {
-        for (int x = 10; x < 310; x += 4) {
-            float value = sin(x * 0.05 + animationTime) + 
-                         sin(y * 0.05 + animationTime * 1.1) +
-                         sin(sqrt((x-160)*(x-160) + (y-90)*(y-90)) * 0.05 - animationTime);
-            
-            uint8_t color = (uint8_t)((value + 3) * 42);
-            uint16_t pixelColor = M5.Display.color565(color, color/2, 255 - color);
-            M5.Display.fillRect(x, y, 4, 4, pixelColor);
-        }
+    // Full-screen plasma: the field is static, the motion comes from the LUT
+    if (preparePaletteDemo(5)) {
+        fxCanvas.cyclePalette(paletteOffset);
+        fxCanvas.push(&M5.Display, 0, FX_TOP);
     }
     
+    drawDemoTitle("Wave & Plasma Effects");
+    
     // Sine wave lines
     M5.Display.drawFastHLine(0, 160, M5.Display.width(), TFT_DARKGREY);
     
@@ -0,0 +1,153 @@
+#include "palette_fx.h"
+
+#include <esp_heap_caps.h>
+
+static inline uint16_t swapped565(uint8_t r, uint8_t g, uint8_t b) {
+    uint16_t c = ((r & 0xF8) << 8) | ((g & 0xFC) << 3) | (b >> 3);
+    return (c >> 8) | (c << 8);
+}
+
+PaletteCanvas::~PaletteCanvas() {
+    end();
+}
+
+bool PaletteCanvas::begin(int width, int height) {
+    end();
+
+    // The index buffer is large (1 byte per pixel) so it goes to PSRAM; the chunk
+    // buffers are small and must be DMA-capable internal RAM
+    _pixels = (uint8_t*)heap_caps_malloc(width * height, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!_pixels) _pixels = (uint8_t*)malloc(width * height);
+    for (int i = 0; i < 2; i++) {
+        _chunk[i] = (uint16_t*)heap_caps_malloc(width * CHUNK_ROWS * sizeof(uint16_t),
+                                                 MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+    }
+    if (!_pixels || !_chunk[0] || !_chunk[1]) {
+        end();
+        return false;
+    }
+
+    _width = width;
+    _height = height;
+    memset(_pixels, 0, width * height);
+    for (int i = 0; i < 256; i++) {
+        _basePalette[i] = swapped565(i, i, i);
+        _lut[i] = _basePalette[i];
+    }
+    return true;
+}
+
+void PaletteCanvas::end() {
+    free(_pixels);
+    free(_chunk[0]);
+    free(_chunk[1]);
+    _pixels = nullptr;
+    _chunk[0] = _chunk[1] = nullptr;
+    _width = _height = 0;
+}
+
+void PaletteCanvas::setPaletteColor(uint8_t index, uint8_t r, uint8_t g, uint8_t b) {
+    _basePalette[index] = swapped565(r, g, b);
+}
+
+void PaletteCanvas::cyclePalette(uint8_t offset) {
+    for (int i = 0; i < 256; i++) {
+        _lut[i] = _basePalette[(uint8_t)(i + offset)];
+    }
+}
+
+void PaletteCanvas::push(LovyanGFX* dst, int x, int y) {
+    if (!_pixels) return;
+
+    dst->startWrite();
+    int chunk = 0;
+    for (int y0 = 0; y0 < _height; y0 += CHUNK_ROWS, chunk ^= 1) {
+        int rows = min(CHUNK_ROWS, _height - y0);
+        int count = rows * _width;
+        const uint8_t* src = _pixels + y0 * _width;
+        uint16_t* out = _chunk[chunk];
+
+        // The buffer being filled was last sent two chunks ago, and we waited for
+        // that transfer before queueing the previous one, so it is free to reuse
+        int i = 0;
+        for (; i + 4 <= count; i += 4) {
+            out[i]     = _lut[src[i]];
+            out[i + 1] = _lut[src[i + 1]];
+            out[i + 2] = _lut[src[i + 2]];
+            out[i + 3] = _lut[src[i + 3]];
+        }
+        for (; i < count; i++) {
+            out[i] = _lut[src[i]];
+        }
+
+        dst->waitDMA();
+        dst->pushImageDMA(x, y + y0, _width, rows, (const lgfx::swap565_t*)out);
+    }
+    dst->waitDMA();
+    dst->endWrite();
+}
+
+void generateLinearGradient(PaletteCanvas& canvas, int dx, int dy) {
+    // dx/dy are palette steps per pixel in 8.8 fixed point; each row is a
+    // single running sum, no per-pixel multiply
+    for (int y = 0; y < canvas.height(); y++) {
+        uint8_t* row = canvas.row(y);
+        uint32_t acc = y * dy;
+        for (int x = 0; x < canvas.width(); x++) {
+            row[x] = acc >> 8;
+            acc += dx;
+        }
+    }
+}
+
+void generatePlasma(PaletteCanvas& canvas) {
+    // Same field as the old per-frame plasma, but evaluated once: the column and
+    // row sine terms are tabulated, only the radial term is computed per pixel
+    int w = canvas.width();
+    int h = canvas.height();
+    float* colTerm = (float*)malloc(w * sizeof(float));
+    if (!colTerm) return;
+    for (int x = 0; x < w; x++) {
+        colTerm[x] = sinf(x * 0.02f);
+    }
+
+    int cx = w / 2;
+    int cy = h / 2;
+    for (int y = 0; y < h; y++) {
+        uint8_t* row = canvas.row(y);
+        float rowTerm = sinf(y * 0.02f);
+        int dy2 = (y - cy) * (y - cy);
+        for (int x = 0; x < w; x++) {
+            float radial = sinf(sqrtf((float)((x - cx) * (x - cx) + dy2)) * 0.03f);
+            float value = colTerm[x] + rowTerm + radial;
+            row[x] = (uint8_t)((value + 3.0f) * 42.5f);
+        }
+    }
+    free(colTerm);
+}
+
+void buildRainbowPalette(PaletteCanvas& canvas) {
+    // Six linear segments around the hue circle, so cycling wraps seamlessly
+    for (int i = 0; i < 256; i++) {
+        int segment = i * 6 / 256;
+        uint8_t t = (i * 6) % 256;
+        uint8_t r, g, b;
+        switch (segment) {
+            case 0:  r = 255;     g = t;       b = 0;       break;
+            case 1:  r = 255 - t; g = 255;     b = 0;       break;
+            case 2:  r = 0;       g = 255;     b = t;       break;
+            case 3:  r = 0;       g = 255 - t; b = 255;     break;
+            case 4:  r = t;       g = 0;       b = 255;     break;
+            default: r = 255;     g = 0;       b = 255 - t; break;
+        }
+        canvas.setPaletteColor(i, r, g, b);
+    }
+}
+
+void buildPlasmaPalette(PaletteCanvas& canvas) {
+    // Triangle ramp of the old color565(c, c/2, 255 - c) scheme, symmetric so it cycles smoothly
+    for (int i = 0; i < 256; i++) {
+        uint8_t c = i < 128 ? i * 2 : (255 - i) * 2;
+        canvas.setPaletteColor(i, c, c / 2, 255 - c);
+    }
+}
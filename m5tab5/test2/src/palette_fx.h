@@ -0,0 +1,49 @@
+#pragma once
+
+#include <M5GFX.h>
+
+// 8-bit palette-indexed framebuffer for full-screen effects.
+//
+// Effects write palette indices once (or rarely) into an 8bpp buffer in PSRAM.
+// Animation happens by changing the 256-entry lookup table only, and push()
+// expands indices to RGB565 in small chunks that are sent with DMA while the
+// next chunk is being expanded.
+class PaletteCanvas {
+public:
+    // Rows expanded per DMA transfer (two chunk buffers live in internal RAM)
+    static constexpr int CHUNK_ROWS = 8;
+
+    ~PaletteCanvas();
+
+    bool begin(int width, int height);
+    void end();
+
+    int width() const { return _width; }
+    int height() const { return _height; }
+    uint8_t* row(int y) { return _pixels + y * _width; }
+
+    // Base palette: the colours an index maps to before any cycling
+    void setPaletteColor(uint8_t index, uint8_t r, uint8_t g, uint8_t b);
+
+    // Rebuild the active LUT so that index i shows base colour (i + offset)
+    void cyclePalette(uint8_t offset);
+
+    // Expand 8bpp -> RGB565 and blit the whole canvas at (x, y)
+    void push(LovyanGFX* dst, int x, int y);
+
+private:
+    int _width = 0;
+    int _height = 0;
+    uint8_t* _pixels = nullptr;
+    uint16_t* _chunk[2] = {nullptr, nullptr};
+    uint16_t _basePalette[256];   // byte-swapped RGB565, as the panel expects
+    uint16_t _lut[256];
+};
+
+// Row generators: fill the index buffer once, then animate with cyclePalette()
+void generateLinearGradient(PaletteCanvas& canvas, int dx, int dy);
+void generatePlasma(PaletteCanvas& canvas);
+
+// Palettes
+void buildRainbowPalette(PaletteCanvas& canvas);
+void buildPlasmaPalette(PaletteCanvas& canvas);
@@ -17,6 +17,7 @@
  */
 
 #include <M5Unified.h>
+#include <polar_raster.h>
 
 enum ColorDemo {
     DEMO_RGB_BASICS,
@@ -156,16 +157,12 @@ void drawColorWheel() {
     int centerY = 150;
     int radius = 60;
     
-    // Draw color wheel
-    for (float angle = 0; angle < 360; angle += 2) {
-        float hue = angle / 360.0;
-        for (int r = 0; r < radius; r += 2) {
-            float saturation = (float)r / radius;
-            int x = centerX + r * cos(angle * PI / 180);
-            int y = centerY + r * sin(angle * PI / 180);
-            M5.Display.fillRect(x, y, 2, 2, hsv2rgb(hue, saturation, 1.0));
-        }
-    }
+    // Draw color wheel: hue from the angle, saturation from the distance
+    shadePolarRing(M5.Display, centerX, centerY, 0, radius,
+                   [](uint16_t angle, uint16_t radius16, void* user) {
+                       float saturation = radius16 / (16.0f * *(int*)user);
+                       return hsv2rgb(angle / 65536.0f, saturation > 1 ? 1 : saturation, 1.0);
+                   }, &radius);
     
     // Value bar
     M5.Display.drawString("Value:", 10, 220);
@@ -20,6 +20,8 @@
  */
 
 #include <M5Unified.h>
+#include <task_pool.h>
+#include <esp_heap_caps.h>
 
 // Forward declarations
 void displayWelcome();
@@ -32,6 +34,7 @@ void drawImageScalingDemo();
 void drawImageEffectsDemo();
 void drawImageManipulationDemo();
 void drawPerformanceTipsDemo();
+uint16_t* filterBuffer();
 
 // Demo modes for different image features
 enum ImageDemo {
@@ -63,6 +66,11 @@ int animationStep = 0;
 LGFX_Sprite imageCache(&M5.Display);
 LGFX_Sprite workingImage(&M5.Display);
 
+// Source copy plus one 64x64 tile per filter in the effects demo
+const int FILTER_TILE_PIXELS = 64 * 64;
+const int FILTER_TILES = 7;
+uint16_t* filterPixels = nullptr;
+
 // Simple embedded image data (8x8 smiley face)
 const uint16_t smileyData[] = {
     0x0000, 0x0000, 0xFFE0, 0xFFE0, 0xFFE0, 0xFFE0, 0x0000, 0x0000,
@@ -98,6 +106,9 @@ void setup() {
     imageCache.createSprite(64, 64);
     workingImage.createSprite(128, 128);
     
+    // Second core runs half of the image filters
+    taskPoolBegin();
+    
     // Welcome screen
     displayWelcome();
     delay(2000);
@@ -355,6 +366,7 @@ void drawProceduralImagesDemo() {
     // Update cells every few frames
     if (animationStep % 10 == 0) {
         bool newCells[50][40];
+        memcpy(newCells, cells, sizeof(cells));  // border cells are not updated, keep them as they were
         for (int x = 1; x < 49; x++) {
             for (int y = 1; y < 39; y++) {
                 int neighbors = 0;
@@ -486,6 +498,15 @@ void drawImageScalingDemo() {
     M5.Display.drawString("Scale: " + String(scale, 2) + "x", 220, startY + 190);
 }
 
+uint16_t* filterBuffer() {
+    if (!filterPixels) {
+        size_t size = FILTER_TILES * FILTER_TILE_PIXELS * sizeof(uint16_t);
+        filterPixels = (uint16_t*)heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (!filterPixels) filterPixels = (uint16_t*)malloc(size);
+    }
+    return filterPixels;
+}
+
 void drawImageEffectsDemo() {
     int startY = 70;
     M5.Display.setTextColor(TFT_CYAN);
@@ -504,95 +525,89 @@ void drawImageEffectsDemo() {
     M5.Display.drawString("Original:", 10, startY + 20);
     imageCache.pushSprite(10, startY + 35);
     
-    // Invert colors
-    M5.Display.drawString("Inverted:", 90, startY + 20);
-    for (int y = 0; y < 64; y++) {
-        for (int x = 0; x < 64; x++) {
-            uint16_t color = imageCache.readPixel(x, y);
-            uint8_t r = 255 - ((color >> 11) & 0x1F) * 8;
-            uint8_t g = 255 - ((color >> 5) & 0x3F) * 4;
-            uint8_t b = 255 - (color & 0x1F) * 8;
-            M5.Display.drawPixel(90 + x, startY + 35 + y, M5.Display.color565(r, g, b));
-        }
-    }
-    
-    // Grayscale
-    M5.Display.drawString("Grayscale:", 170, startY + 20);
-    for (int y = 0; y < 64; y++) {
-        for (int x = 0; x < 64; x++) {
-            uint16_t color = imageCache.readPixel(x, y);
-            uint8_t r = ((color >> 11) & 0x1F) * 8;
-            uint8_t g = ((color >> 5) & 0x3F) * 4;
-            uint8_t b = (color & 0x1F) * 8;
-            uint8_t gray = (r * 0.3 + g * 0.59 + b * 0.11);
-            M5.Display.drawPixel(170 + x, startY + 35 + y, M5.Display.color565(gray, gray, gray));
-        }
-    }
-    
-    // Sepia tone
-    M5.Display.drawString("Sepia:", 250, startY + 20);
-    for (int y = 0; y < 64; y++) {
-        for (int x = 0; x < 64; x++) {
-            uint16_t color = imageCache.readPixel(x, y);
-            uint8_t r = ((color >> 11) & 0x1F) * 8;
-            uint8_t g = ((color >> 5) & 0x3F) * 4;
-            uint8_t b = (color & 0x1F) * 8;
-            
-            uint8_t sepiaR = min(255, (int)(r * 0.393 + g * 0.769 + b * 0.189));
-            uint8_t sepiaG = min(255, (int)(r * 0.349 + g * 0.686 + b * 0.168));
-            uint8_t sepiaB = min(255, (int)(r * 0.272 + g * 0.534 + b * 0.131));
-            
-            M5.Display.drawPixel(250 + x, startY + 35 + y, M5.Display.color565(sepiaR, sepiaG, sepiaB));
-        }
-    }
-    
-    // Brightness adjustment
-    M5.Display.drawString("Brightness:", 10, startY + 110);
     int brightness = 50 * sin(animationStep * 0.05);
-    for (int y = 0; y < 64; y++) {
-        for (int x = 0; x < 64; x++) {
-            uint16_t color = imageCache.readPixel(x, y);
-            uint8_t r = constrain(((color >> 11) & 0x1F) * 8 + brightness, 0, 255);
-            uint8_t g = constrain(((color >> 5) & 0x3F) * 4 + brightness, 0, 255);
-            uint8_t b = constrain((color & 0x1F) * 8 + brightness, 0, 255);
-            M5.Display.drawPixel(10 + x, startY + 125 + y, M5.Display.color565(r, g, b));
-        }
-    }
-    
-    // Contrast adjustment
-    M5.Display.drawString("Contrast:", 90, startY + 110);
     float contrast = 1.5 + 0.5 * sin(animationStep * 0.07);
-    for (int y = 0; y < 64; y++) {
-        for (int x = 0; x < 64; x++) {
-            uint16_t color = imageCache.readPixel(x, y);
-            uint8_t r = constrain(((((color >> 11) & 0x1F) * 8 - 128) * contrast) + 128, 0, 255);
-            uint8_t g = constrain(((((color >> 5) & 0x3F) * 4 - 128) * contrast) + 128, 0, 255);
-            uint8_t b = constrain((((color & 0x1F) * 8 - 128) * contrast) + 128, 0, 255);
-            M5.Display.drawPixel(90 + x, startY + 125 + y, M5.Display.color565(r, g, b));
-        }
-    }
     
-    // Blur effect (simplified)
-    M5.Display.drawString("Blur:", 170, startY + 110);
-    for (int y = 1; y < 63; y++) {
-        for (int x = 1; x < 63; x++) {
-            uint32_t rSum = 0, gSum = 0, bSum = 0;
-            int count = 0;
-            
-            // 3x3 kernel
-            for (int dy = -1; dy <= 1; dy++) {
-                for (int dx = -1; dx <= 1; dx++) {
-                    uint16_t color = imageCache.readPixel(x + dx, y + dy);
-                    rSum += ((color >> 11) & 0x1F) * 8;
-                    gSum += ((color >> 5) & 0x3F) * 4;
-                    bSum += (color & 0x1F) * 8;
-                    count++;
-                }
+    // readPixel() goes through the sprite and is not safe from two cores, so
+    // take one copy of the source and run all six filters from it, split by
+    // rows across both cores
+    uint16_t* source = filterBuffer();
+    if (source) {
+        for (int y = 0; y < 64; y++) {
+            for (int x = 0; x < 64; x++) {
+                source[y * 64 + x] = imageCache.readPixel(x, y);
             }
-            
-            M5.Display.drawPixel(170 + x, startY + 125 + y, 
-                               M5.Display.color565(rSum/count, gSum/count, bSum/count));
         }
+        uint16_t* inverted = source + FILTER_TILE_PIXELS;
+        uint16_t* grayscale = inverted + FILTER_TILE_PIXELS;
+        uint16_t* sepia = grayscale + FILTER_TILE_PIXELS;
+        uint16_t* brightened = sepia + FILTER_TILE_PIXELS;
+        uint16_t* contrasted = brightened + FILTER_TILE_PIXELS;
+        uint16_t* blurred = contrasted + FILTER_TILE_PIXELS;   // 62 x 62, the edges are skipped
+        
+        parallelFor(0, 64, 4, [&](int rowBegin, int rowEnd) {
+            for (int y = rowBegin; y < rowEnd; y++) {
+                for (int x = 0; x < 64; x++) {
+                    int i = y * 64 + x;
+                    uint16_t color = source[i];
+                    uint8_t r = ((color >> 11) & 0x1F) * 8;
+                    uint8_t g = ((color >> 5) & 0x3F) * 4;
+                    uint8_t b = (color & 0x1F) * 8;
+                    
+                    // Invert colors
+                    inverted[i] = M5.Display.color565(255 - r, 255 - g, 255 - b);
+                    
+                    // Grayscale
+                    uint8_t gray = (r * 0.3 + g * 0.59 + b * 0.11);
+                    grayscale[i] = M5.Display.color565(gray, gray, gray);
+                    
+                    // Sepia tone
+                    uint8_t sepiaR = min(255, (int)(r * 0.393 + g * 0.769 + b * 0.189));
+                    uint8_t sepiaG = min(255, (int)(r * 0.349 + g * 0.686 + b * 0.168));
+                    uint8_t sepiaB = min(255, (int)(r * 0.272 + g * 0.534 + b * 0.131));
+                    sepia[i] = M5.Display.color565(sepiaR, sepiaG, sepiaB);
+                    
+                    // Brightness adjustment
+                    brightened[i] = M5.Display.color565(constrain(r + brightness, 0, 255),
+                                                        constrain(g + brightness, 0, 255),
+                                                        constrain(b + brightness, 0, 255));
+                    
+                    // Contrast adjustment
+                    contrasted[i] = M5.Display.color565(constrain(((r - 128) * contrast) + 128, 0, 255),
+                                                        constrain(((g - 128) * contrast) + 128, 0, 255),
+                                                        constrain(((b - 128) * contrast) + 128, 0, 255));
+                    
+                    // Blur effect (simplified 3x3 kernel)
+                    if (y < 1 || y > 62 || x < 1 || x > 62) continue;
+                    uint32_t rSum = 0, gSum = 0, bSum = 0;
+                    int count = 0;
+                    for (int dy = -1; dy <= 1; dy++) {
+                        for (int dx = -1; dx <= 1; dx++) {
+                            uint16_t c = source[i + dy * 64 + dx];
+                            rSum += ((c >> 11) & 0x1F) * 8;
+                            gSum += ((c >> 5) & 0x3F) * 4;
+                            bSum += (c & 0x1F) * 8;
+                            count++;
+                        }
+                    }
+                    blurred[(y - 1) * 62 + (x - 1)] = M5.Display.color565(rSum/count, gSum/count, bSum/count);
+                }
+            }
+        });
+        
+        // Colours are in the form drawPixel() takes, not byte-swapped
+        M5.Display.drawString("Inverted:", 90, startY + 20);
+        M5.Display.pushImage(90, startY + 35, 64, 64, (const lgfx::rgb565_t*)inverted);
+        M5.Display.drawString("Grayscale:", 170, startY + 20);
+        M5.Display.pushImage(170, startY + 35, 64, 64, (const lgfx::rgb565_t*)grayscale);
+        M5.Display.drawString("Sepia:", 250, startY + 20);
+        M5.Display.pushImage(250, startY + 35, 64, 64, (const lgfx::rgb565_t*)sepia);
+        M5.Display.drawString("Brightness:", 10, startY + 110);
+        M5.Display.pushImage(10, startY + 125, 64, 64, (const lgfx::rgb565_t*)brightened);
+        M5.Display.drawString("Contrast:", 90, startY + 110);
+        M5.Display.pushImage(90, startY + 125, 64, 64, (const lgfx::rgb565_t*)contrasted);
+        M5.Display.drawString("Blur:", 170, startY + 110);
+        M5.Display.pushImage(171, startY + 126, 62, 62, (const lgfx::rgb565_t*)blurred);
     }
     
     // Information
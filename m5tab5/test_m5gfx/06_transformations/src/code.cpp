@@ -20,6 +20,7 @@
  */
 
 #include <M5Unified.h>
+#include <fast_math.h>
 #include <math.h>
 
 // Forward declarations
@@ -200,8 +201,8 @@ void drawCurrentTransformDemo() {
 }
 
 Point2D rotatePoint(Point2D point, float angle, Point2D pivot) {
-    float cosA = cos(angle);
-    float sinA = sin(angle);
+    float sinA, cosA;
+    fastSinCos(angle, sinA, cosA);
     
     // Translate to origin
     float dx = point.x - pivot.x;
@@ -518,6 +519,10 @@ void drawCombinedTransformsDemo() {
     float scale = 0.8 + 0.4 * sin(animationStep * 0.1);
     Point2D translate = {20 * cos(animationStep * 0.05), 15 * sin(animationStep * 0.08)};
     
+    // One sin/cos pair for every vertex below
+    float sinA, cosA;
+    fastSinCos(angle, sinA, cosA);
+    
     // Method 1: Rotate -> Scale -> Translate
     M5.Display.setTextColor(TFT_YELLOW);
     M5.Display.drawString("R->S->T", center1.x - 15, startY + 35);
@@ -527,8 +532,8 @@ void drawCombinedTransformsDemo() {
         
         // Rotate first
         Point2D rotated;
-        rotated.x = p.x * cos(angle) - p.y * sin(angle);
-        rotated.y = p.x * sin(angle) + p.y * cos(angle);
+        rotated.x = p.x * cosA - p.y * sinA;
+        rotated.y = p.x * sinA + p.y * cosA;
         
         // Then scale
         Point2D scaled;
@@ -544,8 +549,8 @@ void drawCombinedTransformsDemo() {
         Point2D pNext = baseShape[next];
         
         Point2D rotatedNext;
-        rotatedNext.x = pNext.x * cos(angle) - pNext.y * sin(angle);
-        rotatedNext.y = pNext.x * sin(angle) + pNext.y * cos(angle);
+        rotatedNext.x = pNext.x * cosA - pNext.y * sinA;
+        rotatedNext.y = pNext.x * sinA + pNext.y * cosA;
         
         Point2D scaledNext;
         scaledNext.x = rotatedNext.x * scale;
@@ -572,8 +577,8 @@ void drawCombinedTransformsDemo() {
         
         // Then rotate
         Point2D rotated;
-        rotated.x = scaled.x * cos(angle) - scaled.y * sin(angle);
-        rotated.y = scaled.x * sin(angle) + scaled.y * cos(angle);
+        rotated.x = scaled.x * cosA - scaled.y * sinA;
+        rotated.y = scaled.x * sinA + scaled.y * cosA;
         
         // Then translate
         Point2D final;
@@ -588,8 +593,8 @@ void drawCombinedTransformsDemo() {
         scaledNext.y = pNext.y * scale;
         
         Point2D rotatedNext;
-        rotatedNext.x = scaledNext.x * cos(angle) - scaledNext.y * sin(angle);
-        rotatedNext.y = scaledNext.x * sin(angle) + scaledNext.y * cos(angle);
+        rotatedNext.x = scaledNext.x * cosA - scaledNext.y * sinA;
+        rotatedNext.y = scaledNext.x * sinA + scaledNext.y * cosA;
         
         Point2D finalNext;
         finalNext.x = rotatedNext.x + translate.x + center2.x;
@@ -683,24 +688,30 @@ Point2D project3D(Point3D point3d, float distance) {
 
 Point3D rotateX(Point3D p, float angle) {
     Point3D result;
+    float s, c;
+    fastSinCos(angle, s, c);
     result.x = p.x;
-    result.y = p.y * cos(angle) - p.z * sin(angle);
-    result.z = p.y * sin(angle) + p.z * cos(angle);
+    result.y = p.y * c - p.z * s;
+    result.z = p.y * s + p.z * c;
     return result;
 }
 
 Point3D rotateY(Point3D p, float angle) {
     Point3D result;
-    result.x = p.x * cos(angle) + p.z * sin(angle);
+    float s, c;
+    fastSinCos(angle, s, c);
+    result.x = p.x * c + p.z * s;
     result.y = p.y;
-    result.z = -p.x * sin(angle) + p.z * cos(angle);
+    result.z = -p.x * s + p.z * c;
     return result;
 }
 
 Point3D rotateZ(Point3D p, float angle) {
     Point3D result;
-    result.x = p.x * cos(angle) - p.y * sin(angle);
-    result.y = p.x * sin(angle) + p.y * cos(angle);
+    float s, c;
+    fastSinCos(angle, s, c);
+    result.x = p.x * c - p.y * s;
+    result.y = p.x * s + p.y * c;
     result.z = p.z;
     return result;
 }
@@ -20,8 +20,26 @@
  */
 
 #include <M5Unified.h>
+#include <fast_math.h>
 #include <math.h>
 
+// Forward declarations
+void initParticleSystem();
+void initPhysicsObjects();
+void initScrollLayers();
+void displayWelcome();
+void displayCurrentDemo();
+void drawCurrentAnimationDemo();
+void drawEasingFunctionsDemo();
+void spawnParticle(float x, float y, float vx, float vy, float life, uint16_t color);
+void updateParticles();
+void drawParticleSystemsDemo();
+void drawScrollingParallaxDemo();
+void drawSmoothTransitionsDemo();
+void updatePhysics();
+void drawPhysicsSimulationDemo();
+void drawSequencedAnimationsDemo();
+
 // Demo modes for different animation techniques
 enum AnimationDemo {
     DEMO_EASING_FUNCTIONS,
@@ -55,7 +73,7 @@ float animationTime = 0;
 int animationStep = 0;
 bool animationDirection = true;
 
-// Easing functions
+// Easing functions (float only: PI and pow(2, x) would otherwise pull in software double math)
 float easeLinear(float t) { return t; }
 float easeInQuad(float t) { return t * t; }
 float easeOutQuad(float t) { return t * (2 - t); }
@@ -63,15 +81,16 @@ float easeInOutQuad(float t) { return t < 0.5 ? 2 * t * t : -1 + (4 - 2 * t) * t
 float easeInCubic(float t) { return t * t * t; }
 float easeOutCubic(float t) { return (--t) * t * t + 1; }
 float easeInOutCubic(float t) { return t < 0.5 ? 4 * t * t * t : (t - 1) * (2 * t - 2) * (2 * t - 2) + 1; }
-float easeInSine(float t) { return 1 - cos(t * PI / 2); }
-float easeOutSine(float t) { return sin(t * PI / 2); }
-float easeInOutSine(float t) { return -(cos(PI * t) - 1) / 2; }
+float easeInSine(float t) { return 1 - fastCos(t * (float)HALF_PI); }
+float easeOutSine(float t) { return fastSin(t * (float)HALF_PI); }
+float easeInOutSine(float t) { return -(fastCos((float)PI * t) - 1) / 2; }
 float easeInElastic(float t) { 
     if (t == 0) return 0;
     if (t == 1) return 1;
     float p = 0.3;
     float s = p / 4;
-    return -(pow(2, 10 * (t -= 1)) * sin((t - s) * (2 * PI) / p));
+    t -= 1;
+    return -(fastExp2(10 * t) * fastSin((t - s) * (2 * (float)PI) / p));
 }
 float easeOutBounce(float t) {
     if (t < (1/2.75)) return (7.5625 * t * t);
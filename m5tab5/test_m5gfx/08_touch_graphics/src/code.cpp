@@ -22,6 +22,24 @@
 #include <M5Unified.h>
 #include <math.h>
 
+// Forward declarations
+void initTouchSystem();
+void initDragObjects();
+void initPaintSystem();
+void updateTouch();
+bool isPointInRect(int px, int py, int x, int y, int width, int height);
+void displayWelcome();
+void displayCurrentDemo();
+void drawCurrentTouchDemo();
+void drawTouchButtonsDemo();
+void drawDragDropDemo();
+void drawDrawingPaintDemo();
+float calculateDistance(int x1, int y1, int x2, int y2);
+String recognizeGesture();
+void drawGestureRecognitionDemo();
+void drawInteractiveUIDemo();
+void drawTouchEffectsDemo();
+
 // Demo modes for different touch interaction features
 enum TouchDemo {
     DEMO_TOUCH_BUTTONS,
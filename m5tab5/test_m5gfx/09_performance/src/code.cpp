@@ -10,6 +10,8 @@
  * - Memory usage optimization
  * - Drawing operation profiling
  * - Real-world optimization examples
+ * - Streaming frame and operation timings over USB while tools/telemetry_csv
+ *   asks for the profiler channel (see lib/Telemetry)
  * 
  * Key concepts:
  * - Transaction-based drawing
@@ -21,6 +23,24 @@
 
 #include <M5Unified.h>
 #include <math.h>
+#include <telemetry.h>
+
+// Forward declarations
+void initPerformanceStats();
+void initTestObjects();
+void initDirtyRectSystem();
+void addDirtyRect(int x, int y, int width, int height);
+void clearDirtyRects();
+void updatePerformanceStats();
+void displayWelcome();
+void displayCurrentDemo();
+void drawCurrentPerformanceDemo();
+void drawBatchOperationsDemo();
+void drawDirtyRectanglesDemo();
+void drawBufferManagementDemo();
+void drawFPSOptimizationDemo();
+void drawMemoryManagementDemo();
+void drawProfilingToolsDemo();
 
 // Demo modes for different performance techniques
 enum PerformanceDemo {
@@ -96,6 +116,7 @@ bool measurementMode = false;
 void setup() {
     auto cfg = M5.config();
     M5.begin(cfg);
+    telemetryBegin();
     
     M5.Display.setRotation(3);
     M5.Display.fillScreen(TFT_BLACK);
@@ -834,7 +855,7 @@ void drawMemoryManagementDemo() {
     static uint32_t heapHistory[80];
     static int heapHistoryIndex = 0;
     
-    if (frameCount % 5 == 0) { // Update every 5 frames
+    if (stats.frameCount % 5 == 0) { // Update every 5 frames
         heapHistory[heapHistoryIndex] = freeHeap;
         heapHistoryIndex = (heapHistoryIndex + 1) % 80;
     }
@@ -954,6 +975,10 @@ void drawProfilingToolsDemo() {
     }
     operations[5] = {"Sprites", micros() - startTime};
     
+    for (int i = 0; i < 6; i++) {
+        telemetryProfile(operations[i].name, operations[i].time);
+    }
+    
     // Display timing results
     M5.Display.setTextColor(TFT_WHITE);
     M5.Display.drawString("Operation Timing (μs):", 10, startY + 70);
@@ -1038,7 +1063,9 @@ void loop() {
         if (animationStep > 1000) animationStep = 0;
         
         // Redraw current demo
+        unsigned long drawStart = micros();
         drawCurrentPerformanceDemo();
+        telemetryProfile(performanceDemoNames[currentDemo], micros() - drawStart);
         
         lastUpdate = millis();
     }
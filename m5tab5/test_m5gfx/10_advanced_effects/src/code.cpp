@@ -20,8 +20,32 @@
  */
 
 #include <M5Unified.h>
+#include <polar_raster.h>
+#include <fast_math.h>
+#include <task_pool.h>
+#include <esp_heap_caps.h>
 #include <math.h>
 
+// Forward declarations
+void initColorPalettes();
+void initFireSimulation();
+void initMatrixRain();
+void initWaterRipples();
+void displayWelcome();
+void displayCurrentDemo();
+void drawCurrentEffectDemo();
+void drawPlasmaEffectsDemo();
+void draw3DWireframeDemo();
+int mandelbrot(float x0, float y0, int maxIter);
+uint16_t* effectBuffer();
+void drawFractalsDemo();
+void updateFireSimulation();
+void drawFireSimulationDemo();
+void updateMatrixRain();
+void drawMatrixRainDemo();
+void updateWaterRipples();
+void drawWaterRipplesDemo();
+
 // Demo modes for different advanced effects
 enum EffectDemo {
     DEMO_PLASMA_EFFECTS,
@@ -117,6 +141,29 @@ uint16_t fireColors[256];
 uint16_t plasmaColors[256];
 uint16_t fractalColors[256];
 
+// The pixel-per-pixel effects are computed into this buffer on both cores with
+// parallelFor() and then pushed in one go; the display itself is only ever
+// touched from the loop task
+const int EFFECT_BUFFER_PIXELS = 400 * 120;
+uint16_t* effectPixels = nullptr;
+
+// Calls shadeRow(y, row) for every row of a w x h block, spread over both
+// cores, then draws the block at (x, y). shadeRow writes w colours to row and
+// must not touch the display or any other shared state.
+template <typename RowShader>
+void renderEffect(int x, int y, int w, int h, int grain, RowShader shadeRow) {
+    uint16_t* pixels = effectBuffer();
+    if (!pixels || w * h > EFFECT_BUFFER_PIXELS) return;
+    
+    parallelFor(0, h, grain, [&](int rowBegin, int rowEnd) {
+        for (int row = rowBegin; row < rowEnd; row++) {
+            shadeRow(row, pixels + row * w);
+        }
+    });
+    // Colours are in the form drawPixel() takes, not byte-swapped
+    M5.Display.pushImage(x, y, w, h, (const lgfx::rgb565_t*)pixels);
+}
+
 void setup() {
     auto cfg = M5.config();
     M5.begin(cfg);
@@ -124,6 +171,9 @@ void setup() {
     M5.Display.setRotation(3);
     M5.Display.fillScreen(TFT_BLACK);
     
+    // Second core renders half of the heavy effects
+    taskPoolBegin();
+    
     // Initialize color palettes
     initColorPalettes();
     
@@ -140,6 +190,14 @@ void setup() {
     displayCurrentDemo();
 }
 
+uint16_t* effectBuffer() {
+    if (!effectPixels) {
+        effectPixels = (uint16_t*)heap_caps_malloc(EFFECT_BUFFER_PIXELS * sizeof(uint16_t),
+                                                   MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (!effectPixels) effectPixels = (uint16_t*)malloc(EFFECT_BUFFER_PIXELS * sizeof(uint16_t));
+    }
+    return effectPixels;
+}
 void initColorPalettes() {
     // Fire palette: black -> red -> yellow -> white
     for (int i = 0; i < 256; i++) {
@@ -219,24 +277,30 @@ Point2D project3D(Point3D point, float distance) {
 
 Point3D rotateX(Point3D p, float angle) {
     Point3D result;
+    float s, c;
+    fastSinCos(angle, s, c);
     result.x = p.x;
-    result.y = p.y * cos(angle) - p.z * sin(angle);
-    result.z = p.y * sin(angle) + p.z * cos(angle);
+    result.y = p.y * c - p.z * s;
+    result.z = p.y * s + p.z * c;
     return result;
 }
 
 Point3D rotateY(Point3D p, float angle) {
     Point3D result;
-    result.x = p.x * cos(angle) + p.z * sin(angle);
+    float s, c;
+    fastSinCos(angle, s, c);
+    result.x = p.x * c + p.z * s;
     result.y = p.y;
-    result.z = -p.x * sin(angle) + p.z * cos(angle);
+    result.z = -p.x * s + p.z * c;
     return result;
 }
 
 Point3D rotateZ(Point3D p, float angle) {
     Point3D result;
-    result.x = p.x * cos(angle) - p.y * sin(angle);
-    result.y = p.x * sin(angle) + p.y * cos(angle);
+    float s, c;
+    fastSinCos(angle, s, c);
+    result.x = p.x * c - p.y * s;
+    result.y = p.x * s + p.y * c;
     result.z = p.z;
     return result;
 }
@@ -328,16 +392,14 @@ void drawPlasmaEffectsDemo() {
     int plasmaStartX = 10;
     int plasmaStartY = startY + 20;
     
-    M5.Display.startWrite(); // Batch for performance
-    
-    for (int y = 0; y < plasmaHeight; y++) {
+    renderEffect(plasmaStartX, plasmaStartY, plasmaWidth, plasmaHeight, 4, [&](int y, uint16_t* row) {
         for (int x = 0; x < plasmaWidth; x++) {
-            // Multiple sine waves create plasma effect
-            float value1 = sin(x * 0.1 + plasmaTime);
-            float value2 = sin(y * 0.1 + plasmaTime * 1.3);
-            float value3 = sin((x + y) * 0.08 + plasmaTime * 0.7);
-            float value4 = sin(sqrt((x - plasmaWidth/2) * (x - plasmaWidth/2) + 
-                                  (y - plasmaHeight/2) * (y - plasmaHeight/2)) * 0.15 + plasmaTime * 2);
+            // Multiple sine waves create plasma effect (float throughout: the P4 has no double FPU)
+            float value1 = fastSin(x * 0.1f + plasmaTime);
+            float value2 = fastSin(y * 0.1f + plasmaTime * 1.3f);
+            float value3 = fastSin((x + y) * 0.08f + plasmaTime * 0.7f);
+            float value4 = fastSin(fastSqrt((x - plasmaWidth/2) * (x - plasmaWidth/2) + 
+                                            (y - plasmaHeight/2) * (y - plasmaHeight/2)) * 0.15f + plasmaTime * 2);
             
             float plasma = (value1 + value2 + value3 + value4) * 0.25;
             
@@ -345,11 +407,9 @@ void drawPlasmaEffectsDemo() {
             int colorIndex = (int)((plasma + 1) * 127.5);
             colorIndex = constrain(colorIndex, 0, 255);
             
-            M5.Display.drawPixel(plasmaStartX + x, plasmaStartY + y, plasmaColors[colorIndex]);
+            row[x] = plasmaColors[colorIndex];
         }
-    }
-    
-    M5.Display.endWrite();
+    });
     
     // Smaller plasma variants
     M5.Display.setTextColor(TFT_WHITE);
@@ -358,33 +418,27 @@ void drawPlasmaEffectsDemo() {
     // Circular plasma
     int circleX = 170, circleY = startY + 40;
     int radius = 30;
-    for (int y = -radius; y <= radius; y++) {
-        for (int x = -radius; x <= radius; x++) {
-            if (x*x + y*y <= radius*radius) {
-                float distance = sqrt(x*x + y*y);
-                float angle = atan2(y, x);
-                float plasma = sin(distance * 0.3 + plasmaTime * 2) * 
-                              cos(angle * 4 + plasmaTime);
-                
-                int colorIndex = (int)((plasma + 1) * 127.5);
-                colorIndex = constrain(colorIndex, 0, 255);
-                
-                M5.Display.drawPixel(circleX + x, circleY + y, plasmaColors[colorIndex]);
-            }
-        }
-    }
+    // sin(distance * 0.3 + t * 2) * cos(angle * 4 + t), in binary angles (65536 per turn)
+    uint16_t phases[2] = {polarAngle(plasmaTime * 2 * RAD_TO_DEG), polarAngle(plasmaTime * RAD_TO_DEG)};
+    shadePolarRing(M5.Display, circleX, circleY, 0, radius,
+                   [](uint16_t angle, uint16_t radius16, void* user) {
+                       const uint16_t* phase = (const uint16_t*)user;
+                       int32_t plasma = (int32_t)isin(radius16 * 196 + phase[0]) *
+                                        icos(angle * 4 + phase[1]) >> 15;
+                       return plasmaColors[(plasma + 32768) >> 8];
+                   }, phases);
     
     // Tunnel effect
     int tunnelX = 250, tunnelY = startY + 40;
     int tunnelSize = 40;
     for (int y = -tunnelSize/2; y <= tunnelSize/2; y++) {
         for (int x = -tunnelSize/2; x <= tunnelSize/2; x++) {
-            float distance = sqrt(x*x + y*y);
-            float angle = atan2(y, x);
+            float distance = fastSqrt(x*x + y*y);
+            float angle = fastAtan2(y, x);
             
             if (distance > 5) { // Avoid division by zero
-                float tunnel = sin(32/distance + plasmaTime * 3) + 
-                              sin(angle * 8 + plasmaTime * 2);
+                float tunnel = fastSin(32/distance + plasmaTime * 3) + 
+                              fastSin(angle * 8 + plasmaTime * 2);
                 
                 int colorIndex = (int)((tunnel + 2) * 63.75);
                 colorIndex = constrain(colorIndex, 0, 255);
@@ -399,11 +453,11 @@ void drawPlasmaEffectsDemo() {
     int intSize = 50;
     for (int y = 0; y < intSize; y++) {
         for (int x = 0; x < intSize; x++) {
-            float dist1 = sqrt((x-15)*(x-15) + (y-15)*(y-15));
-            float dist2 = sqrt((x-35)*(x-35) + (y-25)*(y-25));
+            float dist1 = fastSqrt((x-15)*(x-15) + (y-15)*(y-15));
+            float dist2 = fastSqrt((x-35)*(x-35) + (y-25)*(y-25));
             
-            float interference = sin(dist1 * 0.5 + plasmaTime * 4) + 
-                               sin(dist2 * 0.5 + plasmaTime * 4);
+            float interference = fastSin(dist1 * 0.5f + plasmaTime * 4) + 
+                               fastSin(dist2 * 0.5f + plasmaTime * 4);
             
             int colorIndex = (int)((interference + 2) * 63.75);
             colorIndex = constrain(colorIndex, 0, 255);
@@ -544,11 +598,14 @@ void draw3DWireframeDemo() {
         for (int v = 0; v < 12; v++) {
             float theta = u * 2 * PI / 16;
             float phi = v * 2 * PI / 12;
+            float sinTheta, cosTheta, sinPhi, cosPhi;
+            fastSinCos(theta, sinTheta, cosTheta);
+            fastSinCos(phi, sinPhi, cosPhi);
             
             Point3D torusPoint;
-            torusPoint.x = (R + r * cos(phi)) * cos(theta);
-            torusPoint.y = (R + r * cos(phi)) * sin(theta);
-            torusPoint.z = r * sin(phi);
+            torusPoint.x = (R + r * cosPhi) * cosTheta;
+            torusPoint.y = (R + r * cosPhi) * sinTheta;
+            torusPoint.z = r * sinPhi;
             
             torusPoint = rotateX(torusPoint, angleX * 0.3);
             torusPoint = rotateY(torusPoint, angleY * 0.6);
@@ -621,9 +678,9 @@ void drawFractalsDemo() {
     float centerX = -0.5 + 0.3 * cos(animationTime * 0.3);
     float centerY = 0 + 0.3 * sin(animationTime * 0.4);
     
-    M5.Display.startWrite();
-    
-    for (int py = 0; py < mandelbrotHeight; py++) {
+    // Rows inside the set cost 32 iterations a pixel and rows outside it a few,
+    // so small grains let the idle core steal the expensive ones
+    renderEffect(mandelbrotX, mandelbrotY, mandelbrotWidth, mandelbrotHeight, 2, [&](int py, uint16_t* row) {
         for (int px = 0; px < mandelbrotWidth; px++) {
             float x = centerX + (px - mandelbrotWidth/2) * 0.01 / zoom;
             float y = centerY + (py - mandelbrotHeight/2) * 0.01 / zoom;
@@ -638,11 +695,9 @@ void drawFractalsDemo() {
                 color = fractalColors[colorIndex];
             }
             
-            M5.Display.drawPixel(mandelbrotX + px, mandelbrotY + py, color);
+            row[px] = color;
         }
-    }
-    
-    M5.Display.endWrite();
+    });
     
     // Julia set
     M5.Display.setTextColor(TFT_WHITE);
@@ -657,7 +712,7 @@ void drawFractalsDemo() {
     float cReal = 0.3 * cos(animationTime * 0.7);
     float cImag = 0.3 * sin(animationTime * 0.5);
     
-    for (int py = 0; py < juliaHeight; py++) {
+    renderEffect(juliaX, juliaY, juliaWidth, juliaHeight, 2, [&](int py, uint16_t* row) {
         for (int px = 0; px < juliaWidth; px++) {
             float x = (px - juliaWidth/2) * 0.04;
             float y = (py - juliaHeight/2) * 0.04;
@@ -680,9 +735,9 @@ void drawFractalsDemo() {
                 color = fractalColors[colorIndex];
             }
             
-            M5.Display.drawPixel(juliaX + px, juliaY + py, color);
+            row[px] = color;
         }
-    }
+    });
     
     // Burning Ship fractal
     M5.Display.setTextColor(TFT_WHITE);
@@ -695,7 +750,7 @@ void drawFractalsDemo() {
     
     float shipZoom = 1 + 0.3 * sin(animationTime * 0.3);
     
-    for (int py = 0; py < shipHeight; py++) {
+    renderEffect(shipX, shipY, shipWidth, shipHeight, 2, [&](int py, uint16_t* row) {
         for (int px = 0; px < shipWidth; px++) {
             float x0 = -1.8 + (px - shipWidth/2) * 0.02 / shipZoom;
             float y0 = -0.08 + (py - shipHeight/2) * 0.02 / shipZoom;
@@ -719,9 +774,9 @@ void drawFractalsDemo() {
                 color = fractalColors[colorIndex];
             }
             
-            M5.Display.drawPixel(shipX + px, shipY + py, color);
+            row[px] = color;
         }
-    }
+    });
     
     // Sierpinski triangle
     M5.Display.setTextColor(TFT_WHITE);
@@ -828,20 +883,17 @@ void drawFireSimulationDemo() {
     int fireDisplayY = startY + 20;
     int pixelSize = 3;
     
-    M5.Display.startWrite();
-    
-    for (int y = 0; y < FIRE_HEIGHT; y++) {
+    // One pushImage of the scaled-up buffer instead of 2400 fillRects. The
+    // simulation step above stays serial: each row reads the one below it and
+    // random() is not safe to call from two cores.
+    renderEffect(fireDisplayX, fireDisplayY, FIRE_WIDTH * pixelSize, FIRE_HEIGHT * pixelSize, 8,
+                 [&](int py, uint16_t* row) {
+        const uint8_t* heat = fireBuffer + (py / pixelSize) * FIRE_WIDTH;
         for (int x = 0; x < FIRE_WIDTH; x++) {
-            int heat = fireBuffer[x + y * FIRE_WIDTH];
-            uint16_t color = fireColors[heat];
-            
-            M5.Display.fillRect(fireDisplayX + x * pixelSize, 
-                               fireDisplayY + y * pixelSize,
-                               pixelSize, pixelSize, color);
+            uint16_t color = fireColors[heat[x]];
+            for (int i = 0; i < pixelSize; i++) *row++ = color;
         }
-    }
-    
-    M5.Display.endWrite();
+    });
     
     // Draw fire particles
     for (int i = 0; i < MAX_FIRE_PARTICLES; i++) {
@@ -1096,31 +1148,30 @@ void drawWaterRipplesDemo() {
     int waterX = 10;
     int waterY = startY + 30;
     
-    // Background water color
-    M5.Display.fillRect(waterX, waterY, waterWidth, waterHeight, M5.Display.color565(0, 50, 100));
-    
-    // Calculate water surface with ripples
-    M5.Display.startWrite();
+    uint16_t waterColor = M5.Display.color565(0, 50, 100);
+    uint16_t skyColor = M5.Display.color565(100, 150, 255);
+    uint16_t foamColor = M5.Display.color565(200, 220, 255);
     
-    for (int y = 0; y < waterHeight; y++) {
+    // Calculate water surface with ripples, rows split across both cores
+    renderEffect(waterX, waterY, waterWidth, waterHeight, 4, [&](int y, uint16_t* row) {
         for (int x = 0; x < waterWidth; x++) {
             float surfaceHeight = 0;
             
             // Base wave pattern
-            surfaceHeight += 5 * sin((x + waterTime * 20) * 0.02);
-            surfaceHeight += 3 * sin((x + waterTime * 15) * 0.05 + 1);
+            surfaceHeight += 5 * fastSin((x + waterTime * 20) * 0.02f);
+            surfaceHeight += 3 * fastSin((x + waterTime * 15) * 0.05f + 1);
             
             // Add ripple effects
             for (int r = 0; r < MAX_RIPPLES; r++) {
                 if (ripples[r].active) {
                     float dx = x - (ripples[r].x - waterX);
                     float dy = y - (ripples[r].y - waterY);
-                    float distance = sqrt(dx*dx + dy*dy);
+                    float distance = fastSqrt(dx*dx + dy*dy);
                     
                     if (distance < ripples[r].radius && distance > ripples[r].radius - 20) {
                         float rippleHeight = ripples[r].amplitude * 
-                                           sin((distance - ripples[r].radius) * 0.5) *
-                                           exp(-(distance - ripples[r].radius) * 0.1);
+                                           fastSin((distance - ripples[r].radius) * 0.5f) *
+                                           fastExp(-(distance - ripples[r].radius) * 0.1f);
                         surfaceHeight += rippleHeight * 10;
                     }
                 }
@@ -1130,17 +1181,16 @@ void drawWaterRipplesDemo() {
             int baseHeight = waterHeight / 2;
             if (y < baseHeight + surfaceHeight) {
                 // Above water - lighter blue
-                uint16_t color = M5.Display.color565(100, 150, 255);
-                M5.Display.drawPixel(waterX + x, waterY + y, color);
+                row[x] = skyColor;
             } else if (y < baseHeight + surfaceHeight + 5) {
                 // Water surface - white foam
-                uint16_t color = M5.Display.color565(200, 220, 255);
-                M5.Display.drawPixel(waterX + x, waterY + y, color);
+                row[x] = foamColor;
+            } else {
+                // Background water color
+                row[x] = waterColor;
             }
         }
-    }
-    
-    M5.Display.endWrite();
+    });
     
     // Draw ripple circles
     for (int i = 0; i < MAX_RIPPLES; i++) {
@@ -0,0 +1,343 @@
+#include <M5Unified.h>
+#include <algorithm>
+
+#include "demo_plugin.h"
+
+#ifdef M5HOST
+#include <sys/stat.h>
+#include "host_snapshot.h"
+#endif
+
+// Runs every registered test_m5gfx demo headless for a fixed number of frames
+// and prints a JSON report of frame times and heap usage over Serial.
+//
+// On the host build, --frames=N overrides RUNNER_FRAMES, --only=<text> runs just
+// the demos whose program or name contains <text>, and --report=<file> also
+// writes the report to a file.
+//
+// Host runs use a virtual clock that advances FRAME_STEP_US per frame, so the
+// final frame of each demo renders identically on every run. --snapshots=<dir>
+// saves it as <dir>/<program>-<demo index>.png, and --golden=<dir> diffs it
+// against the PNG of the same name there (--tolerance=N allows N/255 per
+// channel). Any mismatch makes the process exit with status 1.
+
+#ifndef RUNNER_FRAMES
+#define RUNNER_FRAMES 120
+#endif
+
+const unsigned long FRAME_STEP_US = 50000;  // the demos' own 20 FPS animation tick
+
+struct DemoResult {
+    uint32_t frames;
+    uint32_t initUs;
+    uint32_t p50Us;
+    uint32_t p90Us;
+    uint32_t p99Us;
+    uint32_t maxUs;
+    uint32_t meanUs;
+    uint32_t updateMeanUs;
+    uint32_t heapBefore;
+    uint32_t heapAfterInit;
+    uint32_t heapAfter;
+    uint32_t psramBefore;
+    uint32_t psramAfter;
+#ifdef M5HOST
+    bool goldenChecked;
+    bool goldenFound;
+    SnapshotDiff diff;
+#endif
+};
+
+DemoResult results[MAX_DEMO_PLUGINS];
+bool selected[MAX_DEMO_PLUGINS];
+uint32_t* frameTimes = nullptr;
+int framesPerDemo = RUNNER_FRAMES;
+int currentPlugin = -1;
+int currentFrame = 0;
+uint64_t updateTotalUs = 0;
+bool reportDone = false;
+
+#ifdef M5HOST
+const char* snapshotDir = nullptr;
+const char* goldenDir = nullptr;
+uint8_t goldenTolerance = 0;
+int snapshotFailures = 0;
+#endif
+
+// Function declarations
+void selectPlugins();
+void startPlugin(int index);
+void finishPlugin(int index);
+int nextSelectedPlugin(int after);
+uint32_t percentile(const uint32_t* sorted, int count, int pct);
+String buildReport();
+void writeJsonString(String& out, const char* s);
+unsigned long frameClock();
+#ifdef M5HOST
+void checkSnapshot(int index);
+#endif
+
+void setup() {
+    auto cfg = M5.config();
+    M5.begin(cfg);
+    Serial.begin(115200);
+
+    M5.Display.setRotation(3);
+    M5.Display.fillScreen(TFT_BLACK);
+
+#ifdef M5HOST
+    hostUseVirtualClock(true);
+    framesPerDemo = atoi(hostArg("frames", "0"));
+    if (framesPerDemo <= 0) framesPerDemo = RUNNER_FRAMES;
+    snapshotDir = hostArg("snapshots");
+    goldenDir = hostArg("golden");
+    goldenTolerance = constrain(atoi(hostArg("tolerance", "0")), 0, 255);
+    if (snapshotDir) mkdir(snapshotDir, 0755);
+#endif
+
+    frameTimes = (uint32_t*)malloc(framesPerDemo * sizeof(uint32_t));
+    if (!frameTimes) {
+        Serial.println("demo_runner: out of memory for frame times");
+        reportDone = true;
+        return;
+    }
+
+    selectPlugins();
+    Serial.printf("demo_runner: %d demos, %d frames each\n", demoPluginCount(), framesPerDemo);
+
+    currentPlugin = nextSelectedPlugin(-1);
+    if (currentPlugin >= 0) startPlugin(currentPlugin);
+}
+
+void loop() {
+    if (reportDone) {
+        delay(1000);
+        return;
+    }
+
+    // One frame per loop() so the Arduino task keeps yielding between frames
+    if (currentPlugin >= 0) {
+        const DemoPlugin& plugin = demoPlugin(currentPlugin);
+
+#ifdef M5HOST
+        hostAdvanceClock(FRAME_STEP_US);
+#endif
+        unsigned long start = frameClock();
+        plugin.update(plugin.variant);
+        unsigned long updated = frameClock();
+        plugin.draw(plugin.variant);
+        M5.Display.display();
+        unsigned long end = frameClock();
+
+        updateTotalUs += updated - start;
+        frameTimes[currentFrame++] = end - start;
+
+        if (currentFrame >= framesPerDemo) {
+            finishPlugin(currentPlugin);
+            currentPlugin = nextSelectedPlugin(currentPlugin);
+            if (currentPlugin >= 0) startPlugin(currentPlugin);
+        }
+        return;
+    }
+
+    String report = buildReport();
+    Serial.println("--- demo_runner report ---");
+    Serial.println(report);
+    Serial.println("--- end report ---");
+    reportDone = true;
+
+#ifdef M5HOST
+    const char* reportPath = hostArg("report");
+    if (reportPath) {
+        FILE* f = fopen(reportPath, "w");
+        if (f) {
+            fwrite(report.c_str(), 1, report.length(), f);
+            fclose(f);
+        }
+    }
+    if (snapshotFailures) {
+        Serial.printf("demo_runner: %d snapshot mismatches\n", snapshotFailures);
+    }
+    hostExit(snapshotFailures ? 1 : 0);
+#endif
+}
+
+// Frame timing always uses the real clock; on the host millis()/micros() are virtual
+unsigned long frameClock() {
+#ifdef M5HOST
+    return hostWallMicros();
+#else
+    return micros();
+#endif
+}
+
+void selectPlugins() {
+    const char* only = nullptr;
+#ifdef M5HOST
+    only = hostArg("only");
+#endif
+    for (int i = 0; i < demoPluginCount(); i++) {
+        const DemoPlugin& plugin = demoPlugin(i);
+        selected[i] = !only || strstr(plugin.program, only) || strstr(plugin.name, only);
+    }
+}
+
+int nextSelectedPlugin(int after) {
+    for (int i = after + 1; i < demoPluginCount(); i++) {
+        if (selected[i]) return i;
+    }
+    return -1;
+}
+
+void startPlugin(int index) {
+    const DemoPlugin& plugin = demoPlugin(index);
+    DemoResult& result = results[index];
+
+    Serial.printf("  %s / %s\n", plugin.program, plugin.name);
+
+    // Each demo starts from the same clock and random sequence no matter which
+    // demos ran before it, so --only runs render the same frames as full runs
+#ifdef M5HOST
+    hostSetClock((unsigned long)index * (framesPerDemo + 20) * FRAME_STEP_US);
+#endif
+    randomSeed(index + 1);
+
+    result.heapBefore = ESP.getFreeHeap();
+    result.psramBefore = ESP.getFreePsram();
+
+    unsigned long start = frameClock();
+    plugin.init(plugin.variant);
+    result.initUs = frameClock() - start;
+    result.heapAfterInit = ESP.getFreeHeap();
+
+    currentFrame = 0;
+    updateTotalUs = 0;
+}
+
+void finishPlugin(int index) {
+    DemoResult& result = results[index];
+
+    result.heapAfter = ESP.getFreeHeap();
+    result.psramAfter = ESP.getFreePsram();
+    result.frames = currentFrame;
+
+    uint64_t total = 0;
+    for (int i = 0; i < currentFrame; i++) {
+        total += frameTimes[i];
+    }
+    result.meanUs = total / currentFrame;
+    result.updateMeanUs = updateTotalUs / currentFrame;
+
+    std::sort(frameTimes, frameTimes + currentFrame);
+    result.p50Us = percentile(frameTimes, currentFrame, 50);
+    result.p90Us = percentile(frameTimes, currentFrame, 90);
+    result.p99Us = percentile(frameTimes, currentFrame, 99);
+    result.maxUs = frameTimes[currentFrame - 1];
+
+#ifdef M5HOST
+    checkSnapshot(index);
+#endif
+}
+
+#ifdef M5HOST
+void checkSnapshot(int index) {
+    const DemoPlugin& plugin = demoPlugin(index);
+    DemoResult& result = results[index];
+    char name[128];
+    char path[512];
+    snprintf(name, sizeof(name), "%s-%d", plugin.program, plugin.variant);
+
+    if (snapshotDir) {
+        snprintf(path, sizeof(path), "%s/%s.png", snapshotDir, name);
+        saveSnapshot(M5.Display, path);
+    }
+    if (!goldenDir) return;
+
+    char diffPath[512];
+    snprintf(path, sizeof(path), "%s/%s.png", goldenDir, name);
+    snprintf(diffPath, sizeof(diffPath), "%s/%s-diff.png", snapshotDir, name);
+
+    result.goldenChecked = true;
+    result.goldenFound = compareSnapshot(M5.Display, path, result.diff, goldenTolerance,
+                                         snapshotDir ? diffPath : nullptr);
+    if (!result.goldenFound || result.diff.differingPixels) {
+        snapshotFailures++;
+        Serial.printf("    snapshot mismatch: %s\n", result.goldenFound ?
+                      (String(result.diff.differingPixels) + " pixels differ").c_str() : "no golden");
+    }
+}
+#endif
+
+// Nearest-rank percentile of an ascending array
+uint32_t percentile(const uint32_t* sorted, int count, int pct) {
+    int rank = (pct * count + 99) / 100;
+    if (rank < 1) rank = 1;
+    return sorted[rank - 1];
+}
+
+void writeJsonString(String& out, const char* s) {
+    out += '"';
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') out += '\\';
+        out += *s;
+    }
+    out += '"';
+}
+
+String buildReport() {
+    String out;
+    out.reserve(256 * demoPluginCount());
+
+#ifdef M5HOST
+    out += "{\"target\":\"host\"";
+#else
+    out += "{\"target\":\"esp32p4\"";
+#endif
+    out += ",\"display\":[" + String(M5.Display.width()) + "," + String(M5.Display.height()) + "]";
+    out += ",\"frames\":" + String(framesPerDemo);
+    out += ",\"demos\":[";
+
+    bool first = true;
+    for (int i = 0; i < demoPluginCount(); i++) {
+        if (!selected[i]) continue;
+        const DemoPlugin& plugin = demoPlugin(i);
+        const DemoResult& r = results[i];
+
+        if (!first) out += ",";
+        first = false;
+
+        out += "\n{\"program\":";
+        writeJsonString(out, plugin.program);
+        out += ",\"demo\":";
+        writeJsonString(out, plugin.name);
+        out += ",\"frames\":" + String(r.frames);
+        out += ",\"init_us\":" + String(r.initUs);
+        out += ",\"frame_us\":{\"p50\":" + String(r.p50Us) +
+               ",\"p90\":" + String(r.p90Us) +
+               ",\"p99\":" + String(r.p99Us) +
+               ",\"max\":" + String(r.maxUs) +
+               ",\"mean\":" + String(r.meanUs) + "}";
+        out += ",\"update_mean_us\":" + String(r.updateMeanUs);
+        // Negative deltas mean the demo allocated and kept memory
+        out += ",\"heap\":{\"before\":" + String(r.heapBefore) +
+               ",\"after_init\":" + String(r.heapAfterInit) +
+               ",\"after\":" + String(r.heapAfter) +
+               ",\"init_delta\":" + String((long)r.heapAfterInit - (long)r.heapBefore) +
+               ",\"run_delta\":" + String((long)r.heapAfter - (long)r.heapAfterInit) + "}";
+        out += ",\"psram_delta\":" + String((long)r.psramAfter - (long)r.psramBefore);
+#ifdef M5HOST
+        if (r.goldenChecked) {
+            if (r.goldenFound) {
+                out += ",\"snapshot\":{\"differing_pixels\":" + String(r.diff.differingPixels) +
+                       ",\"max_channel_delta\":" + String(r.diff.maxChannelDelta) + "}";
+            } else {
+                out += ",\"snapshot\":{\"missing_golden\":true}";
+            }
+        }
+#endif
+        out += "}";
+    }
+
+    out += "\n],\"min_free_heap\":" + String(ESP.getMinFreeHeap()) + "}";
+    return out;
+}
@@ -0,0 +1,40 @@
+#include "demo_plugin.h"
+
+#include <string.h>
+
+// Function-local so registration works regardless of static initialization order
+static DemoPlugin* pluginTable(int** count) {
+    static DemoPlugin plugins[MAX_DEMO_PLUGINS];
+    static int pluginCount = 0;
+    *count = &pluginCount;
+    return plugins;
+}
+
+bool registerDemoProgram(const char* program, const char* const* names, int count,
+                         void (*init)(int), void (*update)(int), void (*draw)(int)) {
+    int* total;
+    DemoPlugin* plugins = pluginTable(&total);
+    if (*total + count > MAX_DEMO_PLUGINS) return false;
+
+    // Keep the table sorted by program so the run order does not depend on link order
+    int pos = *total;
+    while (pos > 0 && strcmp(plugins[pos - 1].program, program) > 0) pos--;
+    memmove(&plugins[pos + count], &plugins[pos], (*total - pos) * sizeof(DemoPlugin));
+
+    for (int i = 0; i < count; i++) {
+        plugins[pos + i] = {program, names[i], i, init, update, draw};
+    }
+    *total += count;
+    return true;
+}
+
+int demoPluginCount() {
+    int* total;
+    pluginTable(&total);
+    return *total;
+}
+
+const DemoPlugin& demoPlugin(int index) {
+    int* total;
+    return pluginTable(&total)[index];
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <M5Unified.h>
+
+// One sub-demo of one of the test_m5gfx programs, driven headless by the runner.
+// init() puts the program into the demo's starting state, then every frame is
+// update() (advance animation state) followed by draw() (render it).
+struct DemoPlugin {
+    const char* program;
+    const char* name;
+    int variant;                // the program's currentDemo value for this demo
+    void (*init)(int variant);
+    void (*update)(int variant);
+    void (*draw)(int variant);
+};
+
+const int MAX_DEMO_PLUGINS = 64;
+
+// Registers one plugin per entry of names[]; meant to be called from a static
+// initializer in each demos_*.cpp file. Returns false when the table is full.
+bool registerDemoProgram(const char* program, const char* const* names, int count,
+                         void (*init)(int), void (*update)(int), void (*draw)(int));
+
+int demoPluginCount();
+const DemoPlugin& demoPlugin(int index);
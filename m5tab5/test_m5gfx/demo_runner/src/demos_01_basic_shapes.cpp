@@ -0,0 +1,36 @@
+#include "demo_plugin.h"
+#include <math.h>
+
+namespace basic_shapes {
+#include "../../01_basic_shapes/src/code.cpp"
+
+static void pluginInit(int variant) {
+    if (!spriteInitialized) {
+        demoSprite.setColorDepth(16);
+        spriteInitialized = demoSprite.createSprite(M5.Display.width(), M5.Display.height() - 120) != nullptr;
+    }
+    animationAngle = 0;
+    animationStep = 0;
+    currentDemo = (ShapeDemo)variant;
+    needsFullRedraw = true;
+    displayCurrentDemo();
+}
+
+// Same steps as pressing Animate in loop()
+static void pluginUpdate(int variant) {
+    animationAngle += 10;
+    if (animationAngle >= 360) animationAngle = 0;
+    animationStep += 2;
+}
+
+static void pluginDraw(int variant) {
+    needsFullRedraw = false;
+    displayCurrentDemo();
+    if (currentDemo == DEMO_INTERACTIVE) {
+        drawInteractiveDemo();
+    }
+}
+
+static bool registered = registerDemoProgram("01_basic_shapes", shapeDemoNames, SHAPE_DEMO_COUNT,
+                                             pluginInit, pluginUpdate, pluginDraw);
+}
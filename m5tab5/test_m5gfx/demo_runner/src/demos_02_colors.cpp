@@ -0,0 +1,23 @@
+#include "demo_plugin.h"
+#include <math.h>
+#include <polar_raster.h>
+
+namespace colors {
+#include "../../02_colors/src/code.cpp"
+
+static void pluginInit(int variant) {
+    currentDemo = (ColorDemo)variant;
+    drawInterface();
+}
+
+// The color demos are static; each frame is a full redraw
+static void pluginUpdate(int variant) {
+}
+
+static void pluginDraw(int variant) {
+    drawInterface();
+}
+
+static bool registered = registerDemoProgram("02_colors", demoNames, DEMO_COUNT,
+                                             pluginInit, pluginUpdate, pluginDraw);
+}
@@ -0,0 +1,30 @@
+#include "demo_plugin.h"
+#include <math.h>
+
+namespace text_rendering {
+#include "../../03_text_rendering/src/code.cpp"
+
+static void pluginInit(int variant) {
+    animationAngle = 0;
+    animationStep = 0;
+    currentDemo = (TextDemo)variant;
+    displayCurrentDemo();
+}
+
+static void pluginUpdate(int variant) {
+    animationAngle += 5;
+    if (animationAngle >= 360) animationAngle = 0;
+
+    animationStep++;
+    if (animationStep > 1000) animationStep = 0;
+}
+
+// loop() only redraws the animated demos; the runner redraws every demo so
+// static ones report their render cost too
+static void pluginDraw(int variant) {
+    drawCurrentTextDemo();
+}
+
+static bool registered = registerDemoProgram("03_text_rendering", textDemoNames, TEXT_DEMO_COUNT,
+                                             pluginInit, pluginUpdate, pluginDraw);
+}
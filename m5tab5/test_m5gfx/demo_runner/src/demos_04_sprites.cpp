@@ -0,0 +1,36 @@
+#include "demo_plugin.h"
+#include <math.h>
+
+namespace sprites {
+#include "../../04_sprites/src/code.cpp"
+
+static void pluginInit(int variant) {
+    static bool spritesCreated = false;
+    if (!spritesCreated) {
+        initializeSprites();
+        spritesCreated = true;
+    }
+    initializeObjects();
+    animationAngle = 0;
+    animationStep = 0;
+    currentDemo = (SpriteDemo)variant;
+    displayCurrentDemo();
+}
+
+static void pluginUpdate(int variant) {
+    frameStartTime = millis();
+
+    animationAngle += 3;
+    if (animationAngle >= 360) animationAngle = 0;
+
+    animationStep++;
+    if (animationStep > 1000) animationStep = 0;
+}
+
+static void pluginDraw(int variant) {
+    drawCurrentSpriteDemo();
+}
+
+static bool registered = registerDemoProgram("04_sprites", spriteDemoNames, SPRITE_DEMO_COUNT,
+                                             pluginInit, pluginUpdate, pluginDraw);
+}
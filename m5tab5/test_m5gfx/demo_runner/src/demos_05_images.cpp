@@ -0,0 +1,37 @@
+#include "demo_plugin.h"
+#include <math.h>
+#include <task_pool.h>
+#include <esp_heap_caps.h>
+
+namespace images {
+#include "../../05_images/src/code.cpp"
+
+static void pluginInit(int variant) {
+    static bool cacheCreated = false;
+    if (!cacheCreated) {
+        imageCache.createSprite(64, 64);
+        workingImage.createSprite(128, 128);
+        taskPoolBegin();
+        cacheCreated = true;
+    }
+    animationAngle = 0;
+    animationStep = 0;
+    currentDemo = (ImageDemo)variant;
+    displayCurrentDemo();
+}
+
+static void pluginUpdate(int variant) {
+    animationAngle += 5;
+    if (animationAngle >= 360) animationAngle = 0;
+
+    animationStep++;
+    if (animationStep > 1000) animationStep = 0;
+}
+
+static void pluginDraw(int variant) {
+    drawCurrentImageDemo();
+}
+
+static bool registered = registerDemoProgram("05_images", imageDemoNames, IMAGE_DEMO_COUNT,
+                                             pluginInit, pluginUpdate, pluginDraw);
+}
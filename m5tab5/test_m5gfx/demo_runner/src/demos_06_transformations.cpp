@@ -0,0 +1,29 @@
+#include "demo_plugin.h"
+#include <math.h>
+#include <fast_math.h>
+
+namespace transformations {
+#include "../../06_transformations/src/code.cpp"
+
+static void pluginInit(int variant) {
+    animationAngle = 0;
+    animationStep = 0;
+    currentDemo = (TransformDemo)variant;
+    displayCurrentDemo();
+}
+
+static void pluginUpdate(int variant) {
+    animationAngle += 3;
+    if (animationAngle >= 360) animationAngle = 0;
+
+    animationStep++;
+    if (animationStep > 1000) animationStep = 0;
+}
+
+static void pluginDraw(int variant) {
+    drawCurrentTransformDemo();
+}
+
+static bool registered = registerDemoProgram("06_transformations", transformDemoNames, TRANSFORM_DEMO_COUNT,
+                                             pluginInit, pluginUpdate, pluginDraw);
+}
@@ -0,0 +1,38 @@
+#include "demo_plugin.h"
+#include <math.h>
+#include <fast_math.h>
+
+namespace animations {
+#include "../../07_animations/src/code.cpp"
+
+static void pluginInit(int variant) {
+    initParticleSystem();
+    initPhysicsObjects();
+    initScrollLayers();
+    animationTime = 0;
+    animationStep = 0;
+    frameCount = 0;
+    currentDemo = (AnimationDemo)variant;
+    displayCurrentDemo();
+}
+
+// Fixed 50 ms step instead of wall-clock time, so every run simulates the same frames
+static void pluginUpdate(int variant) {
+    frameStartTime = millis();
+    deltaTime = 0.05;
+
+    animationTime += deltaTime;
+    if (animationTime > TWO_PI) animationTime -= TWO_PI;
+    frameCount++;
+
+    animationStep++;
+    if (animationStep > 10000) animationStep = 0;
+}
+
+static void pluginDraw(int variant) {
+    drawCurrentAnimationDemo();
+}
+
+static bool registered = registerDemoProgram("07_animations", animationDemoNames, ANIMATION_DEMO_COUNT,
+                                             pluginInit, pluginUpdate, pluginDraw);
+}
@@ -0,0 +1,30 @@
+#include "demo_plugin.h"
+#include <math.h>
+
+namespace touch_graphics {
+#include "../../08_touch_graphics/src/code.cpp"
+
+static void pluginInit(int variant) {
+    initTouchSystem();
+    initDragObjects();
+    initPaintSystem();
+    animationStep = 0;
+    currentDemo = (TouchDemo)variant;
+    displayCurrentDemo();
+}
+
+// Nothing touches the panel during a headless run, so this measures the idle UI
+static void pluginUpdate(int variant) {
+    updateTouch();
+
+    animationStep++;
+    if (animationStep > 1000) animationStep = 0;
+}
+
+static void pluginDraw(int variant) {
+    drawCurrentTouchDemo();
+}
+
+static bool registered = registerDemoProgram("08_touch_graphics", touchDemoNames, TOUCH_DEMO_COUNT,
+                                             pluginInit, pluginUpdate, pluginDraw);
+}
@@ -0,0 +1,36 @@
+#include "demo_plugin.h"
+#include <math.h>
+#include <telemetry.h>
+
+namespace performance {
+#include "../../09_performance/src/code.cpp"
+
+static void pluginInit(int variant) {
+    static bool bufferCreated = false;
+    if (!bufferCreated) {
+        performanceBuffer.createSprite(M5.Display.width(), M5.Display.height());
+        bufferCreated = true;
+    }
+    initPerformanceStats();
+    initTestObjects();
+    initDirtyRectSystem();
+    animationStep = 0;
+    currentDemo = (PerformanceDemo)variant;
+    displayCurrentDemo();
+}
+
+static void pluginUpdate(int variant) {
+    stats.frameStartTime = millis();
+    updatePerformanceStats();
+
+    animationStep++;
+    if (animationStep > 1000) animationStep = 0;
+}
+
+static void pluginDraw(int variant) {
+    drawCurrentPerformanceDemo();
+}
+
+static bool registered = registerDemoProgram("09_performance", performanceDemoNames, PERFORMANCE_DEMO_COUNT,
+                                             pluginInit, pluginUpdate, pluginDraw);
+}
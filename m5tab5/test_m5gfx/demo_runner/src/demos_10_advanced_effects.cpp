@@ -0,0 +1,41 @@
+#include "demo_plugin.h"
+#include <math.h>
+#include <fast_math.h>
+#include <polar_raster.h>
+#include <task_pool.h>
+#include <esp_heap_caps.h>
+
+namespace advanced_effects {
+#include "../../10_advanced_effects/src/code.cpp"
+
+static void pluginInit(int variant) {
+    static bool palettesReady = false;
+    if (!palettesReady) {
+        taskPoolBegin();
+        initColorPalettes();
+        palettesReady = true;
+    }
+    initFireSimulation();
+    initMatrixRain();
+    initWaterRipples();
+    animationTime = 0;
+    animationStep = 0;
+    plasmaTime = 0;
+    waterTime = 0;
+    currentDemo = (EffectDemo)variant;
+    displayCurrentDemo();
+}
+
+static void pluginUpdate(int variant) {
+    animationTime += 0.1;
+    animationStep++;
+    if (animationStep > 1000) animationStep = 0;
+}
+
+static void pluginDraw(int variant) {
+    drawCurrentEffectDemo();
+}
+
+static bool registered = registerDemoProgram("10_advanced_effects", effectDemoNames, EFFECT_DEMO_COUNT,
+                                             pluginInit, pluginUpdate, pluginDraw);
+}
@@ -15,9 +15,11 @@
  * - M5.Speaker.playWAV() for audio file playback
  * - Non-blocking vs blocking audio playback
  * - Audio buffer management
+ * - Sequencing sounds with coroutines (lib/CoTask) instead of delay()
  */
 
 #include <M5Unified.h>
+#include <co_task.h>
 
 // Menu states for different audio demos
 enum AudioDemo {
@@ -61,11 +63,10 @@ int melodyLength = sizeof(melody) / sizeof(melody[0]);
 
 // UI Variables
 int currentVolume = 128;  // 0-255
-int currentNote = 0;
-unsigned long lastNoteTime = 0;
-bool melodyPlaying = false;
-int sweepFreq = 100;
-bool sweepUp = true;
+
+// Melody, sweep and effects run as coroutines so touch and the navigation
+// buttons stay responsive while they play; switching demos cancels them
+CoTaskId demoTask = 0;
 
 // Virtual button structure for Tab5
 struct NavButton {
@@ -84,6 +85,11 @@ void handleMelodyDemo();
 void handleVolumeTestDemo();
 void handleFrequencySweepDemo();
 void handleSoundEffectsDemo();
+void stopDemoTask();
+CoTask playMelody();
+CoTask playFrequencySweep();
+CoTask playVolumeTest();
+CoTask playSoundEffect(int zone);
 void drawNavigationButtons();
 void checkNavigationButtons();
 
@@ -254,155 +260,148 @@ void handleToneDemo() {
 
 void handleMelodyDemo() {
     auto touch = M5.Touch.getDetail();
-    if (M5.Touch.isEnabled() && touch.wasPressed() && !melodyPlaying) {
-        melodyPlaying = true;
-        currentNote = 0;
-        lastNoteTime = millis();
+    if (M5.Touch.isEnabled() && touch.wasPressed() && !coRunning(demoTask)) {
+        demoTask = coStart(playMelody(), "melody");
+    }
+}
+
+CoTask playMelody() {
+    M5.Display.fillRect(10, 240, 300, 30, TFT_BLUE);
+    M5.Display.setTextColor(TFT_WHITE);
+    M5.Display.setTextDatum(MC_DATUM);
+    M5.Display.drawString("Playing Melody...", M5.Display.width()/2, 255);
+    
+    for (int note = 0; note < melodyLength; note++) {
+        int duration = 1000 / noteDurations[note];
+        M5.Speaker.tone(melody[note], duration);
         
-        M5.Display.fillRect(10, 240, 300, 30, TFT_BLUE);
-        M5.Display.setTextColor(TFT_WHITE);
+        // Show current note
+        M5.Display.fillRect(250, 240, 80, 15, TFT_GREEN);
+        M5.Display.setTextColor(TFT_BLACK);
         M5.Display.setTextDatum(MC_DATUM);
-        M5.Display.drawString("Playing Melody...", M5.Display.width()/2, 255);
+        M5.Display.drawString("Note " + String(note + 1), 290, 247);
+        
+        co_await coSleep(duration);
     }
     
-    if (melodyPlaying) {
-        if (millis() - lastNoteTime > (1000 / noteDurations[currentNote])) {
-            if (currentNote < melodyLength) {
-                M5.Speaker.tone(melody[currentNote], 1000 / noteDurations[currentNote]);
-                
-                // Show current note
-                M5.Display.fillRect(250, 240, 80, 15, TFT_GREEN);
-                M5.Display.setTextColor(TFT_BLACK);
-                M5.Display.setTextDatum(MC_DATUM);
-                M5.Display.drawString("Note " + String(currentNote + 1), 290, 247);
-                
-                currentNote++;
-                lastNoteTime = millis();
-            } else {
-                melodyPlaying = false;
-                currentNote = 0;
-                M5.Display.fillRect(10, 240, 300, 30, TFT_BLACK);
-                M5.Display.setTextColor(TFT_GREEN);
-                M5.Display.setTextDatum(MC_DATUM);
-                M5.Display.drawString("Melody Complete!", M5.Display.width()/2, 255);
-            }
-        }
-    }
+    M5.Display.fillRect(10, 240, 300, 30, TFT_BLACK);
+    M5.Display.setTextColor(TFT_GREEN);
+    M5.Display.setTextDatum(MC_DATUM);
+    M5.Display.drawString("Melody Complete!", M5.Display.width()/2, 255);
 }
 
 void handleVolumeTestDemo() {
     auto touch = M5.Touch.getDetail();
-    if (touch.wasPressed()) {
-        // Play test tone at current volume
-        M5.Speaker.tone(1000, 500);
-        
-        // Visual feedback
-        M5.Display.fillRect(10, 240, 300, 30, TFT_PURPLE);
-        M5.Display.setTextColor(TFT_WHITE);
-        M5.Display.setTextDatum(MC_DATUM);
-        M5.Display.drawString("Testing Volume: " + String((currentVolume * 100) / 255) + "%", 
-                             M5.Display.width()/2, 255);
-        
-        delay(500);
-        M5.Display.fillRect(10, 240, 300, 30, TFT_BLACK);
+    if (touch.wasPressed() && !coRunning(demoTask)) {
+        demoTask = coStart(playVolumeTest(), "volume test");
     }
 }
 
-void handleFrequencySweepDemo() {
-    static bool sweeping = false;
-    static unsigned long lastSweepTime = 0;
+CoTask playVolumeTest() {
+    // Play test tone at current volume
+    M5.Speaker.tone(1000, 500);
     
+    // Visual feedback
+    M5.Display.fillRect(10, 240, 300, 30, TFT_PURPLE);
+    M5.Display.setTextColor(TFT_WHITE);
+    M5.Display.setTextDatum(MC_DATUM);
+    M5.Display.drawString("Testing Volume: " + String((currentVolume * 100) / 255) + "%", 
+                         M5.Display.width()/2, 255);
+    
+    co_await coSleep(500);
+    M5.Display.fillRect(10, 240, 300, 30, TFT_BLACK);
+}
+
+void handleFrequencySweepDemo() {
     auto touch = M5.Touch.getDetail();
-    if (touch.wasPressed() && !sweeping) {
-        sweeping = true;
-        sweepFreq = 100;
-        sweepUp = true;
-        lastSweepTime = millis();
-        
-        M5.Display.fillRect(10, 240, 300, 30, TFT_ORANGE);
-        M5.Display.setTextColor(TFT_BLACK);
-        M5.Display.setTextDatum(MC_DATUM);
-        M5.Display.drawString("Frequency Sweep Started...", M5.Display.width()/2, 255);
+    if (touch.wasPressed() && !coRunning(demoTask)) {
+        demoTask = coStart(playFrequencySweep(), "sweep");
     }
+}
+
+CoTask playFrequencySweep() {
+    M5.Display.fillRect(10, 240, 300, 30, TFT_ORANGE);
+    M5.Display.setTextColor(TFT_BLACK);
+    M5.Display.setTextDatum(MC_DATUM);
+    M5.Display.drawString("Frequency Sweep Started...", M5.Display.width()/2, 255);
     
-    if (sweeping && millis() - lastSweepTime > 50) {
-        M5.Speaker.tone(sweepFreq, 50);
-        
-        // Update frequency
-        if (sweepUp) {
-            sweepFreq += 50;
-            if (sweepFreq >= 3000) {
-                sweepUp = false;
-            }
-        } else {
-            sweepFreq -= 50;
-            if (sweepFreq <= 100) {
-                sweeping = false;
-                M5.Display.fillRect(10, 240, 300, 30, TFT_BLACK);
-                M5.Display.setTextColor(TFT_GREEN);
-                M5.Display.setTextDatum(MC_DATUM);
-                M5.Display.drawString("Sweep Complete!", M5.Display.width()/2, 255);
-            }
-        }
+    // Up to 3000Hz and back down in 50Hz steps of 50ms
+    for (int step = 0; step < 116; step++) {
+        int freq = step <= 58 ? 100 + step * 50 : 3000 - (step - 58) * 50;
+        M5.Speaker.tone(freq, 50);
         
         // Show current frequency
-        if (sweeping) {
-            M5.Display.fillRect(250, 240, 80, 15, TFT_RED);
-            M5.Display.setTextColor(TFT_WHITE);
-            M5.Display.setTextDatum(MC_DATUM);
-            M5.Display.drawString(String(sweepFreq) + "Hz", 290, 247);
-        }
+        M5.Display.fillRect(250, 240, 80, 15, TFT_RED);
+        M5.Display.setTextColor(TFT_WHITE);
+        M5.Display.setTextDatum(MC_DATUM);
+        M5.Display.drawString(String(freq) + "Hz", 290, 247);
         
-        lastSweepTime = millis();
+        co_await coSleep(50);
     }
+    
+    M5.Display.fillRect(10, 240, 300, 30, TFT_BLACK);
+    M5.Display.setTextColor(TFT_GREEN);
+    M5.Display.setTextDatum(MC_DATUM);
+    M5.Display.drawString("Sweep Complete!", M5.Display.width()/2, 255);
 }
 
 void handleSoundEffectsDemo() {
     if (M5.Touch.isEnabled()) {
         auto touch = M5.Touch.getDetail();
-        if (touch.wasPressed()) {
-            int y = touch.y;
+        if (touch.wasPressed() && !coRunning(demoTask)) {
             int screenThird = M5.Display.height() / 3;
-            
-            if (y < screenThird) {
-                // Top area: Beep effect
-                M5.Speaker.tone(1000, 100);
-                delay(50);
-                M5.Speaker.tone(1200, 100);
-                M5.Display.fillRect(10, 240, 100, 20, TFT_CYAN);
-                M5.Display.setTextColor(TFT_BLACK);
-                M5.Display.setTextDatum(MC_DATUM);
-                M5.Display.drawString("BEEP", 60, 250);
-                
-            } else if (y < screenThird * 2) {
-                // Middle area: Chirp effect
-                for (int freq = 500; freq < 1500; freq += 100) {
-                    M5.Speaker.tone(freq, 50);
-                    delay(30);
-                }
-                M5.Display.fillRect(120, 240, 100, 20, TFT_GREEN);
-                M5.Display.setTextColor(TFT_BLACK);
-                M5.Display.setTextDatum(MC_DATUM);
-                M5.Display.drawString("CHIRP", 170, 250);
-                
-            } else {
-                // Bottom area: Buzz effect
-                for (int i = 0; i < 5; i++) {
-                    M5.Speaker.tone(200, 100);
-                    delay(50);
-                    M5.Speaker.tone(150, 100);
-                    delay(50);
-                }
-                M5.Display.fillRect(230, 240, 100, 20, TFT_RED);
-                M5.Display.setTextColor(TFT_WHITE);
-                M5.Display.setTextDatum(MC_DATUM);
-                M5.Display.drawString("BUZZ", 280, 250);
-            }
-            
-            delay(500);
-            M5.Display.fillRect(10, 240, 320, 30, TFT_BLACK);
+            int zone = touch.y < screenThird ? 0 : (touch.y < screenThird * 2 ? 1 : 2);
+            demoTask = coStart(playSoundEffect(zone), "effect");
+        }
+    }
+}
+
+CoTask playSoundEffect(int zone) {
+    if (zone == 0) {
+        // Top area: Beep effect
+        M5.Speaker.tone(1000, 100);
+        co_await coSleep(50);
+        M5.Speaker.tone(1200, 100);
+        M5.Display.fillRect(10, 240, 100, 20, TFT_CYAN);
+        M5.Display.setTextColor(TFT_BLACK);
+        M5.Display.setTextDatum(MC_DATUM);
+        M5.Display.drawString("BEEP", 60, 250);
+        
+    } else if (zone == 1) {
+        // Middle area: Chirp effect
+        for (int freq = 500; freq < 1500; freq += 100) {
+            M5.Speaker.tone(freq, 50);
+            co_await coSleep(30);
+        }
+        M5.Display.fillRect(120, 240, 100, 20, TFT_GREEN);
+        M5.Display.setTextColor(TFT_BLACK);
+        M5.Display.setTextDatum(MC_DATUM);
+        M5.Display.drawString("CHIRP", 170, 250);
+        
+    } else {
+        // Bottom area: Buzz effect
+        for (int i = 0; i < 5; i++) {
+            M5.Speaker.tone(200, 100);
+            co_await coSleep(50);
+            M5.Speaker.tone(150, 100);
+            co_await coSleep(50);
         }
+        M5.Display.fillRect(230, 240, 100, 20, TFT_RED);
+        M5.Display.setTextColor(TFT_WHITE);
+        M5.Display.setTextDatum(MC_DATUM);
+        M5.Display.drawString("BUZZ", 280, 250);
     }
+    
+    co_await coSleep(500);
+    M5.Display.fillRect(10, 240, 320, 30, TFT_BLACK);
+}
+
+// Cancels whatever the current demo is playing
+void stopDemoTask() {
+    if (!coRunning(demoTask)) return;
+    coCancel(demoTask);
+    M5.Speaker.stop();
+    M5.Display.fillRect(10, 240, 320, 30, TFT_BLACK);
 }
 
 void drawNavigationButtons() {
@@ -463,6 +462,7 @@ void checkNavigationButtons() {
                 
                 switch(i) {
                     case 0: // Previous demo
+                        stopDemoTask();
                         currentDemo = (AudioDemo)((currentDemo - 1 + DEMO_COUNT) % DEMO_COUNT);
                         displayCurrentDemo();
                         M5.Speaker.tone(400, 100);
@@ -477,6 +477,7 @@ void checkNavigationButtons() {
                         break;
                         
                     case 2: // Next demo
+                        stopDemoTask();
                         currentDemo = (AudioDemo)((currentDemo + 1) % DEMO_COUNT);
                         displayCurrentDemo();
                         M5.Speaker.tone(600, 100);
@@ -497,6 +498,9 @@ void loop() {
     // Check virtual navigation buttons for Tab5
     checkNavigationButtons();
     
+    // Advance the melody, sweep or effect that is playing
+    coPoll();
+    
     // Handle current demo
     switch(currentDemo) {
         case DEMO_TONES:
@@ -516,7 +520,7 @@ void loop() {
             break;
     }
     
-    // Note: On Tab5, touch "< Prev" button to stop melody during playback
+    // Note: On Tab5, touch "< Prev" or "Next >" to stop a melody or sweep
     
     delay(10);
 }
\ No newline at end of file
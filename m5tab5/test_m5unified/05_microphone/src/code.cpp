@@ -10,9 +10,14 @@
  * 
  * Note: M5Stack Tab5 may not have a microphone
  * This demo shows the API usage for devices that do
+ * (without one it animates simulated data as a coroutine, see lib/CoTask)
+ * Recorded blocks also stream over USB while tools/telemetry_csv asks for
+ * the audio channel (see lib/Telemetry)
  */
 
 #include <M5Unified.h>
+#include <co_task.h>
+#include <telemetry.h>
 
 const int SAMPLES = 256;
 int16_t audioBuffer[SAMPLES];
@@ -22,12 +27,13 @@ unsigned long peakTime = 0;
 
 // Forward declarations
 void drawInterface();
-void showSimulatedDemo();
+CoTask showSimulatedDemo();
 
 void setup() {
     auto cfg = M5.config();
     cfg.internal_mic = true;  // Enable microphone if available
     M5.begin(cfg);
+    telemetryBegin();
     
     M5.Display.setRotation(3);
     M5.Display.fillScreen(TFT_BLACK);
@@ -42,8 +48,8 @@ void setup() {
         M5.Display.drawString("This demo shows mic API usage", M5.Display.width()/2, M5.Display.height()/2 + 20);
         M5.Display.drawString("for compatible M5Stack devices", M5.Display.width()/2, M5.Display.height()/2 + 40);
         
-        // Show simulated data instead
-        showSimulatedDemo();
+        // Show simulated data instead; loop() keeps polling it until a touch
+        coStart(showSimulatedDemo(), "simulated mic");
         return;
     }
     
@@ -76,12 +82,10 @@ void drawInterface() {
     M5.Display.drawString("Status:", 20, 210);
 }
 
-void showSimulatedDemo() {
+CoTask showSimulatedDemo() {
     float time = 0;
     
     while(1) {
-        M5.update();
-        
         // Simulate audio data
         time += 0.05;
         audioLevel = (sin(time) + 1) * 50;
@@ -114,7 +118,7 @@ void showSimulatedDemo() {
             break;
         }
         
-        delay(50);
+        co_await coSleep(50);
     }
 }
 
@@ -122,11 +126,15 @@ void loop() {
     M5.update();
     
     if (!M5.Mic.isEnabled()) {
+        coPoll();
+        delay(10);
         return;
     }
     
     // Record audio samples
     if (M5.Mic.record(audioBuffer, SAMPLES)) {
+        telemetryAudio(audioBuffer, SAMPLES, M5.Mic.config().sample_rate);
+        
         // Calculate audio level
         float sum = 0;
         int16_t maxVal = 0;
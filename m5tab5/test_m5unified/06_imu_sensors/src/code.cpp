@@ -16,9 +16,13 @@
  * - M5.Imu.getAhrsData() for orientation
  * - Real-time sensor visualization
  * - Motion-based interactions
+ * - Streaming samples at IMU_STREAM_HZ over USB while tools/telemetry_csv
+ *   asks for the imu channel (see lib/Telemetry)
  */
 
 #include <M5Unified.h>
+#include <fast_math.h>
+#include <telemetry.h>
 #include <math.h>
 
 // Demo modes
@@ -70,6 +74,9 @@ int calibrationCount = 0;
 float accOffsetX = 0, accOffsetY = 0, accOffsetZ = 0;
 float gyroOffsetX = 0, gyroOffsetY = 0, gyroOffsetZ = 0;
 
+// Telemetry sampling rate, independent of the 20 FPS display
+const int IMU_STREAM_HZ = 400;
+
 // Virtual button structure for navigation
 struct NavButton {
     int x, y, w, h;
@@ -93,11 +100,13 @@ void drawMotionDetectBackground();
 void initNavButtons();
 void drawNavButtons();
 bool checkNavButtons();
+void streamIMUData(unsigned long ms);
 
 void setup() {
     auto cfg = M5.config();
     cfg.internal_imu = true;  // Enable IMU
     M5.begin(cfg);
+    telemetryBegin();
     
     M5.Display.setRotation(3);
     M5.Display.fillScreen(TFT_BLACK);
@@ -455,14 +464,14 @@ void readIMUData() {
     // Read magnetometer (if available)
     M5.Imu.getMag(&magX, &magY, &magZ);
     
-    // Calculate orientation
-    pitch = atan2(-accX, sqrt(accY * accY + accZ * accZ)) * 180.0 / PI;
-    roll = atan2(accY, accZ) * 180.0 / PI;
-    yaw = atan2(-magY, magX) * 180.0 / PI;
+    // Calculate orientation (float throughout; 180.0 / PI would promote to software double)
+    pitch = fastAtan2(-accX, fastSqrt(accY * accY + accZ * accZ)) * (float)RAD_TO_DEG;
+    roll = fastAtan2(accY, accZ) * (float)RAD_TO_DEG;
+    yaw = fastAtan2(-magY, magX) * (float)RAD_TO_DEG;
     
     // Calculate motion
     prevAccMagnitude = accMagnitude;
-    accMagnitude = sqrt(accX * accX + accY * accY + accZ * accZ);
+    accMagnitude = fastSqrt(accX * accX + accY * accY + accZ * accZ);
     float motionChange = abs(accMagnitude - prevAccMagnitude);
     motionDetected = (motionChange > motionThreshold);
     
@@ -472,10 +481,38 @@ void readIMUData() {
     
     // Update history
     accHistory[historyIndex] = accMagnitude;
-    gyroHistory[historyIndex] = sqrt(gyroX * gyroX + gyroY * gyroY + gyroZ * gyroZ);
+    gyroHistory[historyIndex] = fastSqrt(gyroX * gyroX + gyroY * gyroY + gyroZ * gyroZ);
     historyIndex = (historyIndex + 1) % HISTORY_SIZE;
 }
 
+// Waits out the frame. While the telemetry reader wants the imu channel it
+// samples at IMU_STREAM_HZ meanwhile, from this task, so the I2C bus is never
+// shared with readIMUData().
+void streamIMUData(unsigned long ms) {
+    if (!telemetryWants(TELEM_IMU)) {
+        delay(ms);
+        return;
+    }
+    
+    const unsigned long periodUs = 1000000 / IMU_STREAM_HZ;
+    unsigned long start = micros();
+    unsigned long next = start;
+    while (micros() - start < ms * 1000) {
+        if ((long)(micros() - next) < 0) {
+            delay(1);
+            continue;
+        }
+        next += periodUs;
+        
+        float ax, ay, az, gx, gy, gz;
+        M5.Imu.update();
+        if (!M5.Imu.getAccel(&ax, &ay, &az) || !M5.Imu.getGyro(&gx, &gy, &gz)) continue;
+        TelemetryImu sample = {ax - accOffsetX, ay - accOffsetY, az - accOffsetZ,
+                               gx - gyroOffsetX, gy - gyroOffsetY, gz - gyroOffsetZ};
+        telemetryImu(sample);
+    }
+}
+
 void handleAccelerometerDemo() {
     // Clear much larger visualization area
     M5.Display.fillRect(11, 81, M5.Display.width() - 22, 248, TFT_BLACK);
@@ -743,5 +780,5 @@ void loop() {
         lastButtonDraw = millis();
     }
     
-    delay(50);  // 20 FPS update rate
+    streamIMUData(50);  // 20 FPS update rate
 }
\ No newline at end of file
@@ -18,6 +18,7 @@
  */
 
 #include <M5Unified.h>
+#include <polar_raster.h>
 
 // Demo modes
 enum RTCDemo {
@@ -270,28 +271,19 @@ void drawAnalogClock() {
     M5.Display.fillCircle(centerX, centerY, radius + 5, TFT_BLACK);
     
     // Draw clock face
-    M5.Display.drawCircle(centerX, centerY, radius, TFT_WHITE);
-    M5.Display.drawCircle(centerX, centerY, radius - 1, TFT_WHITE);
+    fillPolarRing(M5.Display, centerX, centerY, radius - 1, radius, TFT_WHITE);
     
-    // Draw hour markers
+    // Draw hour markers (1.5 degree wide sectors centred on each hour)
     for (int i = 0; i < 12; i++) {
-        float angle = (i * 30 - 90) * PI / 180.0;
-        int x1 = centerX + (radius - 10) * cos(angle);
-        int y1 = centerY + (radius - 10) * sin(angle);
-        int x2 = centerX + (radius - 3) * cos(angle);
-        int y2 = centerY + (radius - 3) * sin(angle);
-        M5.Display.drawLine(x1, y1, x2, y2, TFT_WHITE);
+        fillPolarArc(M5.Display, centerX, centerY, radius - 10, radius - 3,
+                     polarAngle(i * 30 - 90 - 0.75), polarSweep(1.5), TFT_WHITE);
     }
     
     // Draw minute markers
     for (int i = 0; i < 60; i++) {
         if (i % 5 != 0) {  // Skip hour markers
-            float angle = (i * 6 - 90) * PI / 180.0;
-            int x1 = centerX + (radius - 5) * cos(angle);
-            int y1 = centerY + (radius - 5) * sin(angle);
-            int x2 = centerX + (radius - 2) * cos(angle);
-            int y2 = centerY + (radius - 2) * sin(angle);
-            M5.Display.drawPixel(x1, y1, TFT_DARKGREY);
+            fillPolarArc(M5.Display, centerX, centerY, radius - 5, radius - 5,
+                         polarAngle(i * 6 - 90 - 0.5), polarSweep(1), TFT_DARKGREY);
         }
     }
     
@@ -0,0 +1,146 @@
+#include <Arduino.h>
+#include <mqtt_pipe.h>
+#include <socket_client.h>
+#include <cbor_json.h>
+#include <poll.h>
+#include <signal.h>
+#include <string>
+#include <vector>
+
+// Subscribes to CBOR topics (last level "cbor") and republishes each message
+// as JSON on the same topic ending in "json". The payloads describe
+// themselves, so the bridge needs no schema; see lib/CborPack.
+
+const unsigned long RECONNECT_INTERVAL = 5000;
+const unsigned long STATS_INTERVAL = 60000;
+
+SocketClient socketClient;
+MqttPipe mqtt(socketClient);
+std::string subscription;
+bool verbose = false;
+
+uint32_t converted = 0;
+uint32_t invalid = 0;
+uint64_t bytesIn = 0;
+uint64_t bytesOut = 0;
+
+// Function declarations
+int decodeFile(const char* path);
+void onMessage(const char* topic, const uint8_t* payload, size_t length, void* user);
+void printStats();
+
+void setup() {
+    signal(SIGPIPE, SIG_IGN);
+    if (const char* path = hostArg("decode")) hostExit(decodeFile(path));
+
+    const char* broker = hostArg("broker");
+    if (!broker) {
+        fprintf(stderr, "usage: program --broker=host[:port] [--user=U --password=P] [--topic=filter/cbor] [--verbose=1]\n"
+                        "       program --decode=payload.cbor\n");
+        hostExit(2);
+    }
+    std::string host = broker;
+    size_t colon = host.rfind(':');
+    uint16_t port = colon == std::string::npos ? 1883 : atoi(host.c_str() + colon + 1);
+    if (colon != std::string::npos) host.resize(colon);
+    const char* user = hostArg("user");
+    const char* password = hostArg("password");
+    subscription = hostArg("topic", "homeassistant/sensor/+/history/cbor");
+    verbose = atoi(hostArg("verbose", "0")) != 0;
+    if (subscription.size() < 5 || subscription.compare(subscription.size() - 5, 5, "/cbor") != 0) {
+        fprintf(stderr, "--topic has to end in /cbor\n");
+        hostExit(2);
+    }
+
+    mqtt.setServer(host.c_str(), port);
+    mqtt.setMessageCallback(onMessage);
+
+    unsigned long lastAttempt = 0;
+    unsigned long lastStats = millis();
+    bool first = true;
+    for (;;) {
+        if (!mqtt.connected()) {
+            if (!first && millis() - lastAttempt < RECONNECT_INTERVAL) {
+                delay(100);
+                continue;
+            }
+            first = false;
+            lastAttempt = millis();
+            // A clean session: messages that came while the bridge was away
+            // are not worth a burst after the reconnect
+            if (mqtt.connect("cbor_bridge", user, password, nullptr, 0, false, nullptr, true) &&
+                mqtt.subscribe(subscription.c_str(), 0) && mqtt.flush()) {
+                fprintf(stderr, "cbor_bridge: connected to %s:%u, %s -> .../json\n", host.c_str(), (unsigned)port,
+                        subscription.c_str());
+            } else {
+                fprintf(stderr, "cbor_bridge: cannot connect to %s:%u (state %d), retrying\n", host.c_str(),
+                        (unsigned)port, mqtt.state());
+                continue;
+            }
+        }
+
+        // Sleep until the broker sends something, at most until the next keepalive check
+        pollfd fd = {socketClient.fd(), POLLIN, 0};
+        poll(&fd, 1, 1000);
+        if (!mqtt.loop()) fprintf(stderr, "cbor_bridge: connection lost (state %d)\n", mqtt.state());
+
+        if (millis() - lastStats >= STATS_INTERVAL) {
+            lastStats = millis();
+            printStats();
+        }
+    }
+}
+
+void loop() {
+}
+
+int decodeFile(const char* path) {
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        fprintf(stderr, "cannot open %s\n", path);
+        return 2;
+    }
+    std::vector<uint8_t> cbor;
+    uint8_t buffer[4096];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0) cbor.insert(cbor.end(), buffer, buffer + n);
+    fclose(f);
+
+    // JSON text is at most a few times the CBOR size (hex byte strings: 2x,
+    // short numbers and escaped control characters: up to 6x)
+    std::vector<char> json(cbor.size() * 8 + 64);
+    if (cborToJson(cbor.data(), cbor.size(), json.data(), json.size()) == 0) {
+        fprintf(stderr, "%s: not one valid CBOR item (%u bytes)\n", path, (unsigned)cbor.size());
+        return 1;
+    }
+    printf("%s\n", json.data());
+    return 0;
+}
+
+void onMessage(const char* topic, const uint8_t* payload, size_t length, void* user) {
+    (void)user;
+    static char json[MQTT_PIPE_PACKET_SIZE];
+    std::string jsonTopic = topic;
+    if (jsonTopic.size() < 5 || jsonTopic.compare(jsonTopic.size() - 5, 5, "/cbor") != 0) return;
+    jsonTopic.replace(jsonTopic.size() - 4, 4, "json");
+
+    // The JSON has to fit one packet with its topic
+    size_t room = sizeof(json) - jsonTopic.size() - 8;
+    size_t n = cborToJson(payload, length, json, room);
+    if (n == 0) {
+        invalid++;
+        fprintf(stderr, "cbor_bridge: %s: not valid CBOR, or too large as JSON (%u bytes)\n", topic, (unsigned)length);
+        return;
+    }
+    if (!mqtt.publish(jsonTopic.c_str(), (const uint8_t*)json, n)) return;
+    converted++;
+    bytesIn += length;
+    bytesOut += n;
+    if (verbose) printf("%s (%u bytes) -> %s: %s\n", topic, (unsigned)length, jsonTopic.c_str(), json);
+    fflush(stdout);
+}
+
+void printStats() {
+    fprintf(stderr, "cbor_bridge: %u converted, %u invalid, %llu bytes of CBOR -> %llu bytes of JSON\n",
+            (unsigned)converted, (unsigned)invalid, (unsigned long long)bytesIn, (unsigned long long)bytesOut);
+}
@@ -0,0 +1,358 @@
+#include <Arduino.h>
+#include <co2_analytics.h>
+#include <math.h>
+#include <time.h>
+#include <random>
+#include <string>
+#include <vector>
+
+// Runs lib/Co2Analytics over CO2 traces. Without --trace it simulates rooms
+// whose ventilation and occupancy are known, reads them through a model of
+// the SCD40 (a 60 s response, noise, whole ppm) and checks the trend, the
+// air changes and the occupancy it estimates against the truth, then does
+// the same for the traces in traces/ with what is known of their rooms; the
+// run exits with status 1 when one is off by more than the limits below.
+// With --trace it runs one trace and prints what it estimates over time,
+// and checks it when --ach or --people say what to expect.
+
+struct Occupancy {
+    float fromH;            // hours into the run
+    float people;
+};
+
+struct Room {
+    const char* name;
+    float volumeM3;
+    float ach;
+    float hours;
+    std::vector<Occupancy> schedule;    // from then on, until the next one
+};
+
+const Room rooms[] = {
+    {"office, closed, 0.5/h", 40, 0.5f, 24, {{0, 0}, {8, 2}, {12, 0}, {13, 3}, {17, 0}}},
+    {"meeting room, 2/h", 60, 2.0f, 12, {{0, 0}, {1, 6}, {2, 0}, {4, 4}, {5.5f, 0}, {8, 8}, {9, 0}}},
+    {"bedroom, 0.3/h", 30, 0.3f, 24, {{0, 0}, {2, 2}, {11, 0}, {20, 1}}},
+    {"classroom, 3/h", 180, 3.0f, 10, {{0, 0}, {1, 25}, {2, 0}, {3, 25}, {4, 0}, {6, 20}, {7.5f, 0}}},
+};
+
+const float STEP_S = 5;
+const float SENSOR_TAU_S = 60;
+const float MAX_ACH_ERROR = 0.25f;          // of the true rate
+const float MAX_OCCUPANCY_ERROR = 0.5f;     // people, mean once settled
+const float MAX_OCCUPANCY_SHARE = 0.05f;    // or of the most people in the room, if more
+const float SETTLE_H = 0.25f;               // after people come or go
+
+struct TracePoint {
+    double t;               // seconds
+    float co2;
+};
+
+// The mean occupancy expected over part of a trace
+struct PeopleWindow {
+    float fromH;            // hours from the first reading
+    float toH;
+    float people;
+};
+
+struct TraceTruth {
+    float ach;              // NaN: not checked
+    std::vector<PeopleWindow> people;
+};
+
+struct RecordedTrace {
+    const char* file;       // in traces/
+    float volumeM3;
+    float outdoorPpm;
+    TraceTruth truth;
+};
+
+// See traces/README.md. The windows start once the air changes are measured
+// and people have settled, as for the simulated rooms.
+const RecordedTrace recordedTraces[] = {
+    {"office.csv", 35, 415, {0.8f, {{2.5f, 3.75f, 0}, {4.0f, 5.0f, 3}}}},
+};
+
+// Function declarations
+float peopleAt(const Room& room, float hours, float* sinceChangeH);
+bool runRoom(const Room& room, float noisePpm, uint32_t seed, const char* writePath);
+int runTrace(const char* path, float volumeM3, float outdoorPpm, float everyMin, const TraceTruth& truth);
+bool parsePeople(const char* text, std::vector<PeopleWindow>& windows);
+bool readTrace(const char* path, std::vector<TracePoint>& points);
+bool parseIsoTime(const char* text, double& seconds);
+
+void setup() {
+    float noisePpm = atof(hostArg("noise-ppm", "8"));
+    uint32_t seed = atoi(hostArg("seed", "1"));
+
+    if (const char* trace = hostArg("trace")) {
+        TraceTruth truth = {NAN, {}};
+        if (const char* ach = hostArg("ach")) truth.ach = atof(ach);
+        if (const char* people = hostArg("people")) {
+            if (!parsePeople(people, truth.people)) {
+                fprintf(stderr, "--people=from-to:people[,...], in hours from the first reading\n");
+                hostExit(2);
+            }
+        }
+        printf("--- co2_analytics report ---\n");
+        int status = runTrace(trace, atof(hostArg("room-m3", "40")), atof(hostArg("outdoor-ppm", "420")),
+                              atof(hostArg("every-min", "15")), truth);
+        printf("--- end report ---\n");
+        hostExit(status);
+    }
+
+    const char* only = hostArg("room");
+    printf("--- co2_analytics report ---\n");
+    printf("simulated rooms, SCD40 model: %.0f s response, noise %.1f ppm, whole ppm, a reading every %.0f s\n",
+           SENSOR_TAU_S, noisePpm, STEP_S);
+    printf("limits: air changes within %.0f%%, occupancy within %.1f people (or %.0f%% of the most) on average "
+           "once settled\n\n",
+           MAX_ACH_ERROR * 100, MAX_OCCUPANCY_ERROR, MAX_OCCUPANCY_SHARE * 100);
+    printf("%-24s %6s %6s %6s %6s %8s %8s %8s %8s %7s\n", "room", "ach", "found", "err", "decays", "trend", "occ",
+           "occ set", "before", "ns");
+    printf("%-24s %6s %6s %6s %6s %8s %8s %8s %8s %7s\n", "", "/h", "/h", "%", "", "rms/h", "mae", "mae", "mae",
+           "/read");
+    bool ok = true;
+    for (size_t i = 0; i < sizeof(rooms) / sizeof(rooms[0]); i++) {
+        if (only && atoi(only) != (int)i + 1) continue;
+        ok &= runRoom(rooms[i], noisePpm, seed + i, hostArg("write"));
+    }
+    if (!only) {
+        const char* dir = hostArg("traces", "traces");
+        printf("\nrecorded traces in %s/\n", dir);
+        for (const RecordedTrace& trace : recordedTraces) {
+            std::string path = std::string(dir) + "/" + trace.file;
+            ok &= runTrace(path.c_str(), trace.volumeM3, trace.outdoorPpm, 0, trace.truth) == 0;
+        }
+    }
+    printf("--- end report ---\n");
+    hostExit(ok ? 0 : 1);
+}
+
+void loop() {
+}
+
+float peopleAt(const Room& room, float hours, float* sinceChangeH) {
+    float people = 0;
+    float from = 0;
+    for (const Occupancy& o : room.schedule) {
+        if (o.fromH > hours) break;
+        people = o.people;
+        from = o.fromH;
+    }
+    if (sinceChangeH) *sinceChangeH = hours - from;
+    return people;
+}
+
+// dC/dt = λ (Co - C) + N G 1000 / V, stepped at 1 s; the sensor follows the
+// room with a first-order lag and is read every STEP_S
+bool runRoom(const Room& room, float noisePpm, uint32_t seed, const char* writePath) {
+    std::mt19937 rng(seed);
+    std::normal_distribution<float> noise(0, noisePpm);
+    FILE* out = nullptr;
+    if (writePath) {
+        out = fopen(writePath, "w");
+        if (out) fprintf(out, "time_us,seq,co2,temperature,humidity\n");
+    }
+
+    Co2Analytics air;
+    air.setRoom(room.volumeM3, CO2_OUTDOOR_PPM);
+    double room_ppm = CO2_OUTDOOR_PPM;
+    double sensor = CO2_OUTDOOR_PPM;
+    double trendSquares = 0, occupancyError = 0, settledError = 0, beforeError = 0;
+    uint32_t trendCount = 0, occupancyCount = 0, settledCount = 0, beforeCount = 0, seq = 0;
+    double addNs = 0;
+    uint32_t steps = room.hours * 3600;
+
+    for (uint32_t s = 1; s <= steps; s++) {
+        float hours = s / 3600.0f;
+        float sinceChange;
+        float people = peopleAt(room, hours, &sinceChange);
+        double rate = room.ach * (CO2_OUTDOOR_PPM - room_ppm) + people * CO2_PERSON_LPH * 1000 / room.volumeM3;
+        room_ppm += rate / 3600;
+        sensor += (room_ppm - sensor) / SENSOR_TAU_S;
+        if (s % (uint32_t)STEP_S) continue;
+
+        float reading = roundf(sensor + noise(rng));
+        if (out) fprintf(out, "%llu,%u,%.0f,22.0,45.0\n", (unsigned long long)s * 1000000ULL, (unsigned)seq++, reading);
+        struct timespec a, b;
+        clock_gettime(CLOCK_MONOTONIC, &a);
+        air.add(s * 1000, reading);
+        clock_gettime(CLOCK_MONOTONIC, &b);
+        addNs += (b.tv_sec - a.tv_sec) * 1e9 + (b.tv_nsec - a.tv_nsec);
+
+        float trend = air.trend();
+        if (isnan(trend) || hours < 0.25f) continue;
+        trendSquares += (trend - rate) * (trend - rate);
+        trendCount++;
+        float error = fabsf(air.occupancy() - people);
+        occupancyError += error;
+        occupancyCount++;
+        if (air.decays() == 0) {
+            beforeError += error;
+            beforeCount++;
+        } else if (sinceChange >= SETTLE_H) {
+            settledError += error;
+            settledCount++;
+        }
+    }
+    if (out) fclose(out);
+
+    float achError = (air.airChanges() - room.ach) / room.ach;
+    float settled = settledCount ? settledError / settledCount : NAN;
+    float most = 0;
+    for (const Occupancy& o : room.schedule) most = fmaxf(most, o.people);
+    bool ok = air.decays() > 0 && fabsf(achError) <= MAX_ACH_ERROR &&
+              settled <= fmaxf(MAX_OCCUPANCY_ERROR, MAX_OCCUPANCY_SHARE * most);
+    printf("%-24s %6.2f %6.2f %+6.0f %6u %8.0f %8.2f %8.2f %8.2f %7.0f%s\n", room.name, room.ach, air.airChanges(),
+           achError * 100, (unsigned)air.decays(), sqrt(trendSquares / (trendCount ? trendCount : 1)),
+           occupancyError / (occupancyCount ? occupancyCount : 1), settled,
+           beforeCount ? beforeError / beforeCount : NAN, addNs / (steps / STEP_S), ok ? "" : "  FAILED");
+    return ok;
+}
+
+// Prints the estimates every everyMin minutes (none for 0), then checks
+// them against what is known: 0 when they are within the limits, 1 when
+// not, 2 when the trace could not be read
+int runTrace(const char* path, float volumeM3, float outdoorPpm, float everyMin, const TraceTruth& truth) {
+    std::vector<TracePoint> points;
+    if (!readTrace(path, points) || points.empty()) {
+        fprintf(stderr, "no CO2 readings in %s\n", path);
+        return 2;
+    }
+
+    // Readings held every STEP_S, as the device takes them; Home Assistant's
+    // history only has the changes. A gap of over 5 minutes is left a gap.
+    Co2Analytics air;
+    air.setRoom(volumeM3, outdoorPpm);
+    printf("%s: %u readings over %.1f h, room %.0f m³, outside %.0f ppm\n", path, (unsigned)points.size(),
+           (points.back().t - points.front().t) / 3600, volumeM3, outdoorPpm);
+    if (everyMin > 0) {
+        printf("\n%8s %6s %6s %8s %6s %6s %6s\n", "h:mm", "co2", "level", "trend/h", "ach/h", "decays", "people");
+    }
+
+    double start = points.front().t;
+    double nextPrint = 0;
+    uint16_t decays = 0;
+    std::vector<double> peopleSum(truth.people.size());
+    std::vector<uint32_t> peopleCount(truth.people.size());
+    size_t i = 0;
+    for (double t = start; t <= points.back().t; t += STEP_S) {
+        while (i + 1 < points.size() && points[i + 1].t <= t) i++;
+        if (t - points[i].t > 300) continue;
+        air.add((uint32_t)((t - start) * 1000), points[i].co2);
+
+        double elapsed = t - start;
+        float occupancy = air.occupancy();
+        for (size_t w = 0; w < truth.people.size(); w++) {
+            const PeopleWindow& window = truth.people[w];
+            if (elapsed < window.fromH * 3600 || elapsed >= window.toH * 3600 || isnan(occupancy)) continue;
+            peopleSum[w] += occupancy;
+            peopleCount[w]++;
+        }
+        if (everyMin <= 0) continue;
+        int h = elapsed / 3600, m = fmod(elapsed, 3600) / 60;
+        if (air.decays() != decays) {
+            decays = air.decays();
+            printf("%5d:%02d  decay measured, air changes now %.2f/h\n", h, m, air.airChanges());
+        }
+        if (elapsed >= nextPrint) {
+            nextPrint += everyMin * 60;
+            printf("%5d:%02d %6.0f %6.0f %8.0f %6.2f %6u %6.1f%s\n", h, m, points[i].co2, air.level(), air.trend(),
+                   air.airChanges(), (unsigned)air.decays(), occupancy, air.decaying() ? "  decaying" : "");
+        }
+    }
+
+    bool ok = true;
+    if (!isnan(truth.ach)) {
+        float achError = (air.airChanges() - truth.ach) / truth.ach;
+        bool achOk = air.decays() > 0 && fabsf(achError) <= MAX_ACH_ERROR;
+        printf("  air changes %.2f/h from %u decays, %.2f/h known (%+.0f%%)%s\n", air.airChanges(),
+               (unsigned)air.decays(), truth.ach, achError * 100, achOk ? "" : "  FAILED");
+        ok &= achOk;
+    }
+    for (size_t w = 0; w < truth.people.size(); w++) {
+        const PeopleWindow& window = truth.people[w];
+        float mean = peopleCount[w] ? peopleSum[w] / peopleCount[w] : NAN;
+        bool peopleOk = fabsf(mean - window.people) <= fmaxf(MAX_OCCUPANCY_ERROR, MAX_OCCUPANCY_SHARE * window.people);
+        printf("  %.2f-%.2f h: %.2f people on average, %.0f known%s\n", window.fromH, window.toH, mean, window.people,
+               peopleOk ? "" : "  FAILED");
+        ok &= peopleOk;
+    }
+    return ok ? 0 : 1;
+}
+
+// 2.5-3.75:0,4-5:3
+bool parsePeople(const char* text, std::vector<PeopleWindow>& windows) {
+    while (*text) {
+        PeopleWindow window;
+        int used = 0;
+        if (sscanf(text, "%f-%f:%f%n", &window.fromH, &window.toH, &window.people, &used) != 3 ||
+            window.toH <= window.fromH) {
+            return false;
+        }
+        windows.push_back(window);
+        text += used;
+        if (*text == ',') text++;
+        else if (*text) return false;
+    }
+    return !windows.empty();
+}
+
+// A tools/telemetry_csv sensor.csv (time_us,seq,co2,...), a Home Assistant
+// history export (entity_id,state,last_changed) or plain seconds,co2 lines;
+// # starts a comment line
+bool readTrace(const char* path, std::vector<TracePoint>& points) {
+    FILE* in = fopen(path, "r");
+    if (!in) return false;
+    char line[256];
+    enum { PLAIN, TELEMETRY, HOME_ASSISTANT } format = PLAIN;
+    uint64_t clockHigh = 0;
+    double lastUs = -1;
+    while (fgets(line, sizeof(line), in)) {
+        if (line[0] == '#') continue;
+        if (strncmp(line, "time_us,", 8) == 0) {
+            format = TELEMETRY;
+            continue;
+        }
+        if (strncmp(line, "entity_id,", 10) == 0) {
+            format = HOME_ASSISTANT;
+            continue;
+        }
+        TracePoint p;
+        if (format == TELEMETRY) {
+            double us;
+            unsigned seq;
+            if (sscanf(line, "%lf,%u,%f", &us, &seq, &p.co2) != 3) continue;
+            // The board's micros() wraps every 71 minutes unless the tool unwrapped it
+            if (lastUs >= 0 && us + clockHigh < lastUs) clockHigh += 4294967296ULL;
+            lastUs = us + clockHigh;
+            p.t = lastUs / 1e6;
+        } else if (format == HOME_ASSISTANT) {
+            char* state = strchr(line, ',');
+            char* when = state ? strchr(state + 1, ',') : nullptr;
+            if (!when) continue;
+            char* end;
+            p.co2 = strtof(state + 1, &end);
+            if (end == state + 1 || !parseIsoTime(when + 1, p.t)) continue;   // "unavailable"
+        } else if (sscanf(line, "%lf,%f", &p.t, &p.co2) != 2) {
+            continue;
+        }
+        if (p.co2 <= 0 || (!points.empty() && p.t < points.back().t)) continue;
+        points.push_back(p);
+    }
+    fclose(in);
+    return true;
+}
+
+// 2026-10-01T12:00:05.123Z, in UTC
+bool parseIsoTime(const char* text, double& seconds) {
+    struct tm tm = {};
+    float second;
+    if (sscanf(text, "%d-%d-%dT%d:%d:%f", &tm.tm_year, &tm.tm_mon, &tm.tm_mday, &tm.tm_hour, &tm.tm_min, &second) != 6) {
+        return false;
+    }
+    tm.tm_year -= 1900;
+    tm.tm_mon -= 1;
+    seconds = timegm(&tm) + second;
+    return true;
+}
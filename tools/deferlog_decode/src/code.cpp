@@ -0,0 +1,231 @@
+#include <Arduino.h>
+#include <deferlog.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+#include <map>
+#include <string>
+#include <vector>
+
+// Decodes a lib/DeferLog stream. Frames are DEFERLOG_MAGIC0 DEFERLOG_MAGIC1,
+// type, u16 length, payload, XOR check (see deferlog.h); everything else is
+// ordinary Serial output and is passed through as it is.
+
+struct SiteInfo {
+    uint8_t level;
+    std::string module;
+    std::string format;
+    std::string types;
+};
+
+std::map<uint32_t, SiteInfo> dictionary;
+std::vector<uint8_t> pending;
+FILE* rawCapture = nullptr;
+
+uint32_t framesDecoded = 0;
+uint32_t unknownRecords = 0;
+uint32_t badFrames = 0;
+uint32_t droppedOnBoard = 0;
+
+// Function declarations
+int openInput(const char* path);
+void consume();
+void handleFrame(uint8_t type, const uint8_t* payload, size_t length);
+void passThrough(const uint8_t* bytes, size_t length);
+bool checkRender();
+
+void setup() {
+    if (hostArg("check")) hostExit(checkRender() ? 0 : 1);
+
+    const char* in = hostArg("in");
+    if (!in) {
+        fprintf(stderr, "usage: program --in=/dev/ttyACM0|capture.bin [--raw=capture.bin] | --check=1\n");
+        hostExit(2);
+    }
+    int fd = openInput(in);
+    if (fd < 0) {
+        fprintf(stderr, "cannot open %s\n", in);
+        hostExit(2);
+    }
+    const char* raw = hostArg("raw");
+    if (raw) rawCapture = fopen(raw, "wb");
+
+    uint8_t buffer[4096];
+    for (;;) {
+        ssize_t n = read(fd, buffer, sizeof(buffer));
+        if (n <= 0) break;
+        if (rawCapture) fwrite(buffer, 1, n, rawCapture);
+        pending.insert(pending.end(), buffer, buffer + n);
+        consume();
+        fflush(stdout);
+    }
+    passThrough(pending.data(), pending.size());
+
+    fprintf(stderr, "deferlog_decode: %u frames, %u records with unknown ids, %u bad frames, %u dropped on the board\n",
+            (unsigned)framesDecoded, (unsigned)unknownRecords, (unsigned)badFrames, (unsigned)droppedOnBoard);
+    if (rawCapture) fclose(rawCapture);
+    hostExit(0);
+}
+
+void loop() {
+}
+
+// A serial port is switched to raw 115200 8N1; a file is read as it is
+int openInput(const char* path) {
+    int fd = open(path, O_RDONLY | O_NOCTTY);
+    if (fd < 0) return -1;
+    if (isatty(fd)) {
+        struct termios tty;
+        if (tcgetattr(fd, &tty) == 0) {
+            cfmakeraw(&tty);
+            cfsetispeed(&tty, B115200);
+            cfsetospeed(&tty, B115200);
+            tty.c_cc[VMIN] = 1;
+            tty.c_cc[VTIME] = 0;
+            tcsetattr(fd, TCSANOW, &tty);
+        }
+    }
+    return fd;
+}
+
+void passThrough(const uint8_t* bytes, size_t length) {
+    fwrite(bytes, 1, length, stdout);
+}
+
+// Decodes every complete frame in pending and passes the bytes between them
+// through. A magic that does not start a valid frame is treated as text.
+void consume() {
+    size_t pos = 0;
+    size_t textStart = 0;
+    while (pos < pending.size()) {
+        if (pending[pos] != DEFERLOG_MAGIC0) {
+            pos++;
+            continue;
+        }
+        size_t available = pending.size() - pos;
+        if (available < 5) break;   // wait for the header
+
+        const uint8_t* frame = &pending[pos];
+        uint8_t type = frame[2];
+        size_t length = frame[3] | (frame[4] << 8);
+        bool plausible = frame[1] == DEFERLOG_MAGIC1 && length <= 1024 &&
+                         (type == DEFERLOG_FRAME_RECORD || type == DEFERLOG_FRAME_DICT || type == DEFERLOG_FRAME_DROPPED);
+        if (!plausible) {
+            pos++;
+            continue;
+        }
+        if (available < 5 + length + 1) break;   // wait for the rest
+
+        uint8_t check = 0;
+        for (size_t i = 0; i < length; i++) check ^= frame[5 + i];
+        if (check != frame[5 + length]) {
+            badFrames++;
+            pos++;
+            continue;
+        }
+
+        passThrough(&pending[textStart], pos - textStart);
+        handleFrame(type, frame + 5, length);
+        pos += 5 + length + 1;
+        textStart = pos;
+    }
+    // Keep a partial frame (from textStart if nothing was cut off mid-frame)
+    size_t keepFrom = pos < pending.size() ? pos : pending.size();
+    passThrough(&pending[textStart], keepFrom - textStart);
+    pending.erase(pending.begin(), pending.begin() + keepFrom);
+}
+
+void handleFrame(uint8_t type, const uint8_t* payload, size_t length) {
+    framesDecoded++;
+
+    if (type == DEFERLOG_FRAME_DICT) {
+        if (length < 5) return;
+        uint32_t id;
+        memcpy(&id, payload, 4);
+        SiteInfo site;
+        site.level = payload[4];
+        const char* p = (const char*)payload + 5;
+        const char* end = (const char*)payload + length;
+        std::string* fields[] = {&site.module, &site.format, &site.types};
+        for (std::string* field : fields) {
+            size_t n = strnlen(p, end - p);
+            field->assign(p, n);
+            p += n < (size_t)(end - p) ? n + 1 : n;
+        }
+        dictionary[id] = site;
+        return;
+    }
+
+    if (type == DEFERLOG_FRAME_DROPPED) {
+        uint32_t count = 0;
+        if (length >= 4) memcpy(&count, payload, 4);
+        droppedOnBoard += count;
+        printf("W deferlog: %u records dropped on the board, ring full\n", (unsigned)count);
+        return;
+    }
+
+    if (length < 8) return;
+    uint32_t id, us;
+    memcpy(&id, payload, 4);
+    memcpy(&us, payload + 4, 4);
+
+    auto it = dictionary.find(id);
+    if (it == dictionary.end()) {
+        unknownRecords++;
+        printf("? (%lu) <unknown %08x, %u bytes of arguments>\n", (unsigned long)(us / 1000), (unsigned)id,
+               (unsigned)(length - 8));
+        return;
+    }
+    const SiteInfo& site = it->second;
+    char text[1024];
+    deferLogRender(text, sizeof(text), site.format.c_str(), site.types.c_str(), payload + 8, length - 8);
+    printf("%c (%lu) %s: %s\n", deferLogLevelLetter(site.level), (unsigned long)(us / 1000), site.module.c_str(), text);
+}
+
+struct RenderCase {
+    const char* format;
+    const char* types;
+    int32_t a, b;
+    double c;
+    const char* expected;
+};
+
+// Renders format strings as they could arrive in dictionary frames; the
+// specs that do not fit deferLogRender's buffer must come out as "<?>"
+bool checkRender() {
+    const RenderCase cases[] = {
+        {"%d ppm", "i", 650, 0, 0, "650 ppm"},
+        {"%*.*f", "iid", 8, 3, 3.14159, "   3.142"},
+        {"%-+ #0*.*f!", "iid", INT32_MIN, INT32_MIN, 1.5, "<?>!"},
+        {"a %-+ #0-+ #0*d b", "ii", INT32_MIN, 7, 0, "a <?> b"},
+        {"%0123456789.123456789d|%u", "iu", 1, 2, 0, "<?>|2"},
+        {"%+-*s|", "is", 6, 0, 0, "x     |"},
+    };
+    bool ok = true;
+    for (const RenderCase& c : cases) {
+        uint8_t args[64];
+        size_t length = 0;
+        int32_t ints[] = {c.a, c.b};
+        int next = 0;
+        for (const char* t = c.types; *t; t++) {
+            if (*t == 'd') {
+                memcpy(args + length, &c.c, 8);
+                length += 8;
+            } else if (*t == 's') {
+                uint16_t n = 1;
+                memcpy(args + length, &n, 2);
+                args[length + 2] = 'x';
+                length += 3;
+            } else {
+                memcpy(args + length, &ints[next++], 4);
+                length += 4;
+            }
+        }
+        char text[256];
+        deferLogRender(text, sizeof(text), c.format, c.types, args, length);
+        bool match = strcmp(text, c.expected) == 0;
+        printf("%-4s %-28s -> \"%s\"\n", match ? "ok" : "FAIL", c.format, text);
+        ok &= match;
+    }
+    return ok;
+}
@@ -0,0 +1,655 @@
+#include <Arduino.h>
+#include <mqtt_pipe.h>
+#include <socket_client.h>
+#include <host_broker.h>
+#include <ha_device.h>
+#include <math.h>
+#include <signal.h>
+#include <unistd.h>
+#include <algorithm>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+// A fleet of 1_temp_hum monitors in one process, each a thread that goes
+// through what its firmware does on the MQTT side: connect with the will,
+// "online", discovery (lib/HaDevice, so the same topics and payloads as the
+// boards) and a reading every 5 s from a synthetic SCD40. The broker is a
+// HostBroker in this process (lib/M5HostNet) unless --broker names a real
+// one. Network faults come from FaultyClient: a power cut for the whole fleet,
+// a network outage, random link drops, failed connects and added latency. A
+// device that loses power or its link leaves its socket open without a FIN,
+// as a board does, so the broker only notices through the keepalive or a
+// client id takeover.
+
+// What differs between the firmwares' MQTT paths
+struct Profile {
+    const char* kind;               // device_id prefix
+    const char* namePrefix;
+    const char* model;
+    bool pipelined;                 // MqttPipe, QoS 1 readings, persistent session under device_id (Tab5);
+                                    // else PubSubClient: clean session under device_id + random suffix, QoS 0
+    bool loopStalls;                // the loop stall entity and the diagnostics topic
+    uint32_t discoveryGapMs;        // delay() between discovery configs
+    uint32_t loopMs;                // one pass of loop()
+};
+
+const Profile profiles[] = {
+    {"m5tab5", "M5Tab5_No_", "M5Tab5", true, true, 0, 100},
+    {"m5coreink", "M5CoreInk_No_", "M5CoreInk", false, false, 50, 50},
+    {"m5paper", "M5Paper_no_", "M5Paper", false, false, 50, 50},
+};
+
+const unsigned long READING_INTERVAL = 5000;
+const unsigned long MQTT_RETRY_INTERVAL = 5000;
+const unsigned long SCD40_FIRST_READING = 5000;     // after the sensor starts
+
+// A representative loop stall histogram, as lib/LoopWatch publishes it
+const char* DIAGNOSTICS_PAYLOAD =
+    "{\"boots\":1,\"stalls\":0,\"resets\":0,\"budget_ms\":250,\"loop_max_ms\":120,"
+    "\"bucket_ms\":[500,1000,2000,5000,10000],\"causes\":{}}";
+
+struct Window {
+    unsigned long start;
+    unsigned long end;
+    bool contains(unsigned long t) const { return t >= start && t < end; }
+};
+
+struct Faults {
+    Window powerCut;                // whole fleet off
+    Window outage;                  // the network down, devices powered
+    double connectFail;             // share of TCP connects refused
+    uint32_t latencyMs;             // before every write
+    uint32_t connectTimeoutMs;      // a connect while the network is down
+    uint32_t bootJitterMs;          // WiFi association after power comes back
+};
+
+struct DeviceStats {
+    uint32_t attempts;
+    uint32_t failures;
+    uint32_t readings;
+    uint32_t published;
+    uint32_t acked;
+    uint32_t linkLosses;
+    uint32_t discoveryMessages;
+    uint64_t discoveryBytes;
+    std::vector<uint32_t> connectMs;            // successful attempts
+    std::vector<unsigned long> connectedAt;     // run time of each successful connect
+    std::vector<unsigned long> discoveredAt;    // discovery published
+};
+
+Faults faults = {};
+unsigned long runStart = 0;
+unsigned long runMs = 0;
+std::string brokerHost = "127.0.0.1";
+uint16_t brokerPort = 0;
+const char* mqttUser = nullptr;
+const char* mqttPassword = nullptr;
+
+// Sockets left open by devices that lost power or their link
+std::mutex zombieMutex;
+std::vector<int> zombies;
+
+unsigned long runTime() {
+    return millis() - runStart;
+}
+
+// A WiFiClient on a link that fails as the faults say
+class FaultyClient : public Client {
+public:
+    FaultyClient(uint32_t seed, const std::vector<Window>& drops) : _rng(seed), _drops(drops) {}
+
+    bool linkUp() const {
+        unsigned long t = runTime();
+        if (faults.powerCut.contains(t) || faults.outage.contains(t)) return false;
+        for (const Window& w : _drops) {
+            if (w.contains(t)) return false;
+        }
+        return true;
+    }
+
+    // The link went down under an open socket: no FIN reaches the broker
+    void abandon() {
+        if (_socket.fd() < 0) return;
+        std::lock_guard<std::mutex> lock(zombieMutex);
+        zombies.push_back(_socket.release());
+        _losses++;
+    }
+    uint32_t losses() const { return _losses; }
+
+    using Client::connect;
+    int connect(const char* host, uint16_t port) override {
+        if (!linkUp()) {
+            // No answer to the SYN until the timeout
+            delay(faults.connectTimeoutMs);
+            return 0;
+        }
+        if (faults.connectFail > 0 && std::uniform_real_distribution<double>(0, 1)(_rng) < faults.connectFail) {
+            return 0;
+        }
+        return _socket.connect(host, port);
+    }
+    size_t write(const uint8_t* buf, size_t size) override {
+        if (!linkUp()) {
+            abandon();
+            return 0;
+        }
+        if (faults.latencyMs) delay(faults.latencyMs);
+        return _socket.write(buf, size);
+    }
+    int available() override { return linkUp() ? _socket.available() : 0; }
+    int read(uint8_t* buf, size_t size) override { return linkUp() ? _socket.read(buf, size) : -1; }
+    uint8_t connected() override {
+        if (!linkUp()) {
+            abandon();
+            return false;
+        }
+        return _socket.connected();
+    }
+    void stop() override {
+        if (linkUp()) {
+            _socket.stop();
+        } else {
+            abandon();
+        }
+    }
+
+private:
+    SocketClient _socket;
+    std::mt19937 _rng;
+    std::vector<Window> _drops;
+    uint32_t _losses = 0;
+};
+
+// PubSubClient on CoreInk and Paper: a clean session, and every packet
+// written as it is published
+struct PubSubLike {
+    MqttPipe& pipe;
+    bool connect(const char* id, const char* user, const char* pass, const char* willTopic, uint8_t willQos,
+                 bool willRetain, const char* willMessage) {
+        return pipe.connect(id, user, pass, willTopic, willQos, willRetain, willMessage, true);
+    }
+};
+
+// An SCD40 in an office: temperature and humidity drift, CO2 follows people
+// coming and going
+class SyntheticScd40 {
+public:
+    explicit SyntheticScd40(uint32_t seed) : _rng(seed) {
+        std::uniform_real_distribution<float> start(0, 1);
+        _temperature = 20.5f + 3 * start(_rng);
+        _humidity = 38 + 15 * start(_rng);
+        _phase = 6.2832f * start(_rng);
+    }
+
+    void next(float& temperature, float& humidity, uint16_t& co2) {
+        std::normal_distribution<float> noise(0, 1);
+        _temperature += 0.02f * noise(_rng) + 0.01f * (22.5f - _temperature);
+        _humidity += 0.1f * noise(_rng) + 0.01f * (45 - _humidity);
+        _phase += 6.2832f * READING_INTERVAL / 1800000.0f;     // a half-hour cycle
+        float occupancy = fmaxf(0, sinf(_phase));
+        float target = 430 + 900 * occupancy;
+        _co2 += 0.05f * (target - _co2) + 8 * noise(_rng);
+        if (_co2 < 400) _co2 = 400;
+        // The SCD40's resolution
+        temperature = roundf(_temperature * 100) / 100;
+        humidity = roundf(_humidity * 100) / 100;
+        co2 = (uint16_t)_co2;
+    }
+
+private:
+    std::mt19937 _rng;
+    float _temperature;
+    float _humidity;
+    float _co2 = 600;
+    float _phase;
+};
+
+class VirtualDevice {
+public:
+    VirtualDevice(const Profile& profile, int number, uint32_t seed, const std::vector<Window>& drops)
+        : profile(profile), _net(seed, drops), _mqtt(_net), _sensor(seed ^ 0x5CD40), _rng(seed * 7919) {
+        id = std::string(profile.kind) + "_no_" + std::to_string(number);
+        name = profile.namePrefix + std::to_string(number);
+        _ha = {id.c_str(), name.c_str(), profile.model};
+    }
+
+    void start() { _thread = std::thread([this] { run(); }); }
+    void join() { _thread.join(); }
+
+    const Profile& profile;
+    std::string id;
+    std::string name;
+    DeviceStats stats = {};
+    bool connectedAtEnd = false;
+
+private:
+    void run();
+    void boot();
+    bool connectMQTT();
+    void publishDiscovery();
+    bool publishSensorData();
+
+    HaDevice _ha;
+    FaultyClient _net;
+    MqttPipe _mqtt;
+    SyntheticScd40 _sensor;
+    std::mt19937 _rng;
+    std::thread _thread;
+
+    bool _mqttConnected = false;
+    unsigned long _bootAt = 0;
+    unsigned long _lastAttempt = 0;
+    bool _attempted = false;
+    unsigned long _nextReading = 0;
+    bool _pending = false;
+    float _temperature = 0;
+    float _humidity = 0;
+    uint16_t _co2 = 0;
+};
+
+// Power on: WiFi association, then MQTT; the SCD40 has its first reading 5 s
+// after it starts
+void VirtualDevice::boot() {
+    stats.acked += _mqtt.stats().acked;
+    _mqtt = MqttPipe(_net);
+    _mqtt.setServer(brokerHost.c_str(), brokerPort);
+    _mqtt.setBatching(profile.pipelined);
+    if (!profile.pipelined) _mqtt.setWindow(1);
+    _mqttConnected = false;
+    _attempted = false;
+    _pending = false;
+    unsigned long now = runTime();
+    _bootAt = now + std::uniform_int_distribution<uint32_t>(0, faults.bootJitterMs)(_rng);
+    _nextReading = now + SCD40_FIRST_READING;
+}
+
+void VirtualDevice::run() {
+    boot();
+    bool powered = true;
+    while (runTime() < runMs) {
+        unsigned long now = runTime();
+        if (faults.powerCut.contains(now)) {
+            if (powered) {
+                _net.abandon();
+                powered = false;
+            }
+            delay(50);
+            continue;
+        }
+        if (!powered) {
+            powered = true;
+            boot();
+        }
+        if (now < _bootAt) {
+            delay(10);
+            continue;
+        }
+
+        // As loop(): reconnect at most every 5 s, else let the client read
+        if (!_mqttConnected) {
+            if (!_attempted || now - _lastAttempt >= MQTT_RETRY_INTERVAL) {
+                _attempted = true;
+                _lastAttempt = now;
+                if (connectMQTT()) publishDiscovery();
+            }
+        } else if (!_mqtt.loop()) {
+            _mqttConnected = false;
+        }
+
+        if (runTime() >= _nextReading) {
+            _nextReading += READING_INTERVAL;
+            _sensor.next(_temperature, _humidity, _co2);
+            stats.readings++;
+            _pending = true;
+        }
+        // The newest reading waits for a connection (Tab5) or is sent once (PubSubClient)
+        if (_pending && _mqttConnected) {
+            if (publishSensorData() || !profile.pipelined) _pending = false;
+        } else if (_pending && !profile.pipelined) {
+            _pending = false;
+        }
+        delay(profile.loopMs);
+    }
+    connectedAtEnd = _mqttConnected && _mqtt.connected();
+    stats.acked += _mqtt.stats().acked;
+    stats.linkLosses = _net.losses();
+}
+
+bool VirtualDevice::connectMQTT() {
+    stats.attempts++;
+    // Tab5 keeps its session under device_id; the others add a random suffix
+    char clientId[64];
+    if (profile.pipelined) {
+        snprintf(clientId, sizeof(clientId), "%s", id.c_str());
+    } else {
+        snprintf(clientId, sizeof(clientId), "%s_%x", id.c_str(), (unsigned)(_rng() & 0xFFFF));
+    }
+    unsigned long start = millis();
+    bool connected;
+    if (profile.pipelined) {
+        connected = haConnect(_mqtt, _ha, clientId, mqttUser, mqttPassword);
+    } else {
+        PubSubLike client = {_mqtt};
+        connected = haConnect(client, _ha, clientId, mqttUser, mqttPassword);
+    }
+    if (!connected) {
+        stats.failures++;
+        return false;
+    }
+    stats.connectMs.push_back(millis() - start);
+    stats.connectedAt.push_back(runTime());
+    _mqttConnected = true;
+
+    char availTopic[100];
+    haTopic(availTopic, sizeof(availTopic), _ha, "availability");
+    _mqtt.publish(availTopic, "online", true);
+    _mqtt.flush();
+    // Small delay to ensure connection is stable
+    delay(100);
+    return true;
+}
+
+void VirtualDevice::publishDiscovery() {
+    char topic[200];
+    char payload[1024];
+    std::vector<const HaEntity*> entities = {&HA_SCD40_ENTITIES[0], &HA_SCD40_ENTITIES[1], &HA_SCD40_ENTITIES[2]};
+    for (const HaEntity& entity : HA_STATS_ENTITIES) entities.push_back(&entity);
+    for (const HaEntity& entity : HA_AIR_ENTITIES) entities.push_back(&entity);
+    if (profile.loopStalls) entities.push_back(&HA_LOOP_STALLS_ENTITY);
+    for (size_t i = 0; i < entities.size(); i++) {
+        haConfigTopic(topic, sizeof(topic), _ha, *entities[i]);
+        size_t length = haConfigPayload(payload, sizeof(payload), _ha, *entities[i]);
+        if (_mqtt.publish(topic, (const uint8_t*)payload, length, true)) {
+            stats.discoveryMessages++;
+            stats.discoveryBytes += length;
+        }
+        if (profile.discoveryGapMs && i + 1 < entities.size()) delay(profile.discoveryGapMs);
+    }
+    if (profile.loopStalls) {
+        haTopic(topic, sizeof(topic), _ha, "diagnostics");
+        _mqtt.publish(topic, DIAGNOSTICS_PAYLOAD, true);
+    }
+    if (_mqtt.flush()) stats.discoveredAt.push_back(runTime());
+}
+
+bool VirtualDevice::publishSensorData() {
+    char payload[256];
+    char topic[100];
+    haStatePayload(payload, sizeof(payload), _temperature, _humidity, _co2);
+    haTopic(topic, sizeof(topic), _ha, "state");
+    bool ok = _mqtt.publish(topic, payload, false, profile.pipelined ? 1 : 0) && _mqtt.flush();
+    if (ok) {
+        stats.published++;
+    } else if (!_mqtt.connected()) {
+        // Force reconnection on next loop
+        _mqttConnected = false;
+    }
+    return ok;
+}
+
+// Function declarations
+std::vector<Window> randomDrops(std::mt19937& rng, double mtbfS, uint32_t dropMs);
+uint32_t percentile(std::vector<uint32_t> values, double p);
+void printTimeline(const HostBrokerStats& broker);
+void printRecovery(const char* event, unsigned long at, const std::vector<VirtualDevice*>& devices, String& report);
+
+void setup() {
+    signal(SIGPIPE, SIG_IGN);
+    runMs = atoi(hostArg("duration-s", "90")) * 1000UL;
+    unsigned long cutAt = atoi(hostArg("power-cut-at-s", "30")) * 1000UL;
+    faults.powerCut = {cutAt, cutAt + atoi(hostArg("power-cut-s", "5")) * 1000UL};
+    unsigned long outageAt = atoi(hostArg("outage-at-s", "0")) * 1000UL;
+    faults.outage = {outageAt, outageAt + atoi(hostArg("outage-s", "0")) * 1000UL};
+    faults.connectFail = atof(hostArg("connect-fail", "0"));
+    faults.latencyMs = atoi(hostArg("latency-ms", "0"));
+    faults.connectTimeoutMs = atoi(hostArg("connect-timeout-ms", "3000"));
+    faults.bootJitterMs = atoi(hostArg("boot-jitter-ms", "3000"));
+    double dropMtbfS = atof(hostArg("drop-mtbf-s", "0"));
+    uint32_t dropMs = atoi(hostArg("drop-s", "2")) * 1000;
+    uint32_t seed = atoi(hostArg("seed", "1"));
+    mqttUser = hostArg("user");
+    mqttPassword = hostArg("password");
+
+    HostBrokerOptions brokerOptions;
+    brokerOptions.connectCostUs = atoi(hostArg("connect-cost-us", "0"));
+    brokerOptions.ackDelayUs = atoi(hostArg("ack-delay-us", "2000"));
+    brokerOptions.backlog = atoi(hostArg("backlog", "128"));
+    HostBroker broker(brokerOptions);
+    std::thread serving;
+    const char* external = hostArg("broker");
+    if (external) {
+        brokerHost = external;
+        size_t colon = brokerHost.rfind(':');
+        brokerPort = colon == std::string::npos ? 1883 : atoi(brokerHost.c_str() + colon + 1);
+        if (colon != std::string::npos) brokerHost.resize(colon);
+    } else {
+        if (!broker.listen(0)) {
+            fprintf(stderr, "cannot start the stand-in broker\n");
+            hostExit(2);
+        }
+        brokerPort = broker.port();
+        serving = std::thread([&broker] { broker.run(); });
+    }
+
+    // --fleet=m5tab5:10,m5coreink:20,m5paper:10
+    std::vector<VirtualDevice*> devices;
+    std::mt19937 rng(seed);
+    std::string fleet = hostArg("fleet", "m5tab5:8,m5coreink:8,m5paper:8");
+    size_t pos = 0;
+    while (pos < fleet.size()) {
+        size_t comma = fleet.find(',', pos);
+        std::string part = fleet.substr(pos, comma == std::string::npos ? std::string::npos : comma - pos);
+        pos = comma == std::string::npos ? fleet.size() : comma + 1;
+        size_t colon = part.find(':');
+        std::string kind = part.substr(0, colon);
+        int count = colon == std::string::npos ? 1 : atoi(part.c_str() + colon + 1);
+        const Profile* profile = nullptr;
+        for (const Profile& p : profiles) {
+            if (kind == p.kind) profile = &p;
+        }
+        if (!profile) {
+            fprintf(stderr, "unknown device kind %s (m5tab5, m5coreink, m5paper)\n", kind.c_str());
+            hostExit(2);
+        }
+        for (int i = 1; i <= count; i++) {
+            devices.push_back(new VirtualDevice(*profile, i, rng(), randomDrops(rng, dropMtbfS, dropMs)));
+        }
+    }
+
+    fprintf(stderr, "fleet_sim: %u devices against %s:%u for %lu s\n", (unsigned)devices.size(), brokerHost.c_str(),
+            (unsigned)brokerPort, runMs / 1000);
+    runStart = millis();
+    for (VirtualDevice* d : devices) d->start();
+    for (VirtualDevice* d : devices) d->join();
+
+    HostBrokerStats brokerStats = {};
+    if (!external) {
+        broker.stop();
+        serving.join();
+        brokerStats = broker.stats();
+    }
+
+    printf("--- fleet_sim report ---\n");
+    printf("%u devices, %lu s", (unsigned)devices.size(), runMs / 1000);
+    if (faults.powerCut.end > faults.powerCut.start) {
+        printf(", power cut at %lu s for %lu s", faults.powerCut.start / 1000,
+               (faults.powerCut.end - faults.powerCut.start) / 1000);
+    }
+    if (faults.outage.end > faults.outage.start) {
+        printf(", network outage at %lu s for %lu s", faults.outage.start / 1000,
+               (faults.outage.end - faults.outage.start) / 1000);
+    }
+    printf("\n");
+    if (!external) {
+        printf("stand-in broker: CONNECT costs %u us, PUBACK after %u us\n\n", (unsigned)brokerOptions.connectCostUs,
+               (unsigned)brokerOptions.ackDelayUs);
+        printTimeline(brokerStats);
+    }
+
+    String report = "{\"devices\":" + String((unsigned)devices.size()) + ",\"profiles\":[";
+    printf("\n%-10s %4s %8s %8s %9s %9s %9s %9s %9s %9s %7s\n", "kind", "n", "attempts", "failed", "conn p50",
+           "p99", "max ms", "readings", "published", "acked", "lost");
+    bool firstProfile = true;
+    for (const Profile& p : profiles) {
+        DeviceStats sum = {};
+        int n = 0;
+        for (VirtualDevice* d : devices) {
+            if (&d->profile != &p) continue;
+            n++;
+            sum.attempts += d->stats.attempts;
+            sum.failures += d->stats.failures;
+            sum.readings += d->stats.readings;
+            sum.published += d->stats.published;
+            sum.acked += d->stats.acked;
+            sum.linkLosses += d->stats.linkLosses;
+            sum.discoveryMessages += d->stats.discoveryMessages;
+            sum.discoveryBytes += d->stats.discoveryBytes;
+            sum.connectMs.insert(sum.connectMs.end(), d->stats.connectMs.begin(), d->stats.connectMs.end());
+        }
+        if (!n) continue;
+        printf("%-10s %4d %8lu %8lu %9lu %9lu %9lu %9lu %9lu %9s %7lu\n", p.kind, n, (unsigned long)sum.attempts,
+               (unsigned long)sum.failures, (unsigned long)percentile(sum.connectMs, 0.5),
+               (unsigned long)percentile(sum.connectMs, 0.99), (unsigned long)percentile(sum.connectMs, 1.0),
+               (unsigned long)sum.readings, (unsigned long)sum.published,
+               p.pipelined ? String((unsigned long)sum.acked).c_str() : "-",
+               (unsigned long)(sum.readings - sum.published));
+        char line[400];
+        snprintf(line, sizeof(line),
+                 "%s\n{\"kind\":\"%s\",\"devices\":%d,\"connect_attempts\":%lu,\"connect_failures\":%lu,"
+                 "\"connect_ms\":{\"p50\":%lu,\"p99\":%lu,\"max\":%lu},\"readings\":%lu,\"published\":%lu,"
+                 "\"acked\":%lu,\"link_losses\":%lu,\"discovery_messages\":%lu,\"discovery_bytes\":%llu}",
+                 firstProfile ? "" : ",", p.kind, n, (unsigned long)sum.attempts, (unsigned long)sum.failures,
+                 (unsigned long)percentile(sum.connectMs, 0.5), (unsigned long)percentile(sum.connectMs, 0.99),
+                 (unsigned long)percentile(sum.connectMs, 1.0), (unsigned long)sum.readings,
+                 (unsigned long)sum.published, (unsigned long)sum.acked, (unsigned long)sum.linkLosses,
+                 (unsigned long)sum.discoveryMessages, (unsigned long long)sum.discoveryBytes);
+        report += line;
+        firstProfile = false;
+    }
+    report += "\n]";
+
+    printf("\n");
+    if (faults.powerCut.end > faults.powerCut.start) printRecovery("power cut", faults.powerCut.end, devices, report);
+    if (faults.outage.end > faults.outage.start) printRecovery("outage", faults.outage.end, devices, report);
+
+    // Availability as Home Assistant sees it now: a will that fired after
+    // the device was back leaves a connected device "offline"
+    int connected = 0, staleOffline = 0;
+    for (VirtualDevice* d : devices) {
+        if (!d->connectedAtEnd) continue;
+        connected++;
+        auto found = brokerStats.retained.find("homeassistant/sensor/" + d->id + "/availability");
+        if (!external && found != brokerStats.retained.end() && found->second == "offline") staleOffline++;
+    }
+    printf("at the end: %d of %u devices connected", connected, (unsigned)devices.size());
+    if (!external) {
+        printf(", %d of them shown offline in Home Assistant; broker: %llu wills, %llu takeovers, %llu keepalive expiries",
+               staleOffline, (unsigned long long)brokerStats.wills, (unsigned long long)brokerStats.takeovers,
+               (unsigned long long)brokerStats.expired);
+    }
+    printf("\n");
+
+    char line[400];
+    snprintf(line, sizeof(line), ",\"connected_at_end\":%d,\"offline_at_end\":%d", connected, staleOffline);
+    report += line;
+    if (!external) {
+        uint32_t peakConnects = 0, peakPublishes = 0;
+        for (const HostBrokerSecond& s : brokerStats.seconds) {
+            peakConnects = std::max(peakConnects, s.connects);
+            peakPublishes = std::max(peakPublishes, s.publishes);
+        }
+        snprintf(line, sizeof(line),
+                 ",\"broker\":{\"connects\":%llu,\"publishes\":%llu,\"discovery\":%llu,\"bytes_in\":%llu,"
+                 "\"wills\":%llu,\"takeovers\":%llu,\"expired\":%llu,\"connections_peak\":%u,"
+                 "\"connects_per_s_peak\":%u,\"publishes_per_s_peak\":%u,\"publishes_per_s_avg\":%.1f}",
+                 (unsigned long long)brokerStats.connects, (unsigned long long)brokerStats.publishes,
+                 (unsigned long long)brokerStats.discovery, (unsigned long long)brokerStats.bytesIn,
+                 (unsigned long long)brokerStats.wills, (unsigned long long)brokerStats.takeovers,
+                 (unsigned long long)brokerStats.expired, (unsigned)brokerStats.connectionsPeak,
+                 (unsigned)peakConnects, (unsigned)peakPublishes,
+                 brokerStats.seconds.empty() ? 0.0 : (double)brokerStats.publishes / brokerStats.seconds.size());
+        report += line;
+    }
+    report += "}";
+    printf("%s\n", report.c_str());
+    printf("--- end report ---\n");
+
+    for (int fd : zombies) close(fd);
+    int status = connected == (int)devices.size() ? 0 : 1;
+    for (VirtualDevice* d : devices) delete d;
+    hostExit(status);
+}
+
+void loop() {
+}
+
+// Link drops of dropMs at exponentially distributed intervals
+std::vector<Window> randomDrops(std::mt19937& rng, double mtbfS, uint32_t dropMs) {
+    std::vector<Window> drops;
+    if (mtbfS <= 0) return drops;
+    std::exponential_distribution<double> gap(1.0 / (mtbfS * 1000));
+    unsigned long t = 0;
+    for (;;) {
+        t += (unsigned long)gap(rng);
+        if (t >= runMs) break;
+        drops.push_back({t, t + dropMs});
+        t += dropMs;
+    }
+    return drops;
+}
+
+uint32_t percentile(std::vector<uint32_t> values, double p) {
+    if (values.empty()) return 0;
+    std::sort(values.begin(), values.end());
+    size_t index = (size_t)(p * (values.size() - 1) + 0.5);
+    return values[index];
+}
+
+// Per second of the run, as the broker saw it; '*' marks the power cut and
+// the outage
+void printTimeline(const HostBrokerStats& broker) {
+    printf("%5s %6s %8s %9s %10s %8s %6s %9s %8s\n", "s", "conns", "CONNECT", "PUBLISH", "discovery", "kB in",
+           "wills", "takeover", "expired");
+    for (size_t i = 0; i < broker.seconds.size(); i++) {
+        const HostBrokerSecond& s = broker.seconds[i];
+        unsigned long t = i * 1000;
+        bool fault = faults.powerCut.contains(t) || faults.outage.contains(t);
+        printf("%4u%c %6u %8u %9u %10u %8.1f %6u %9u %8u\n", (unsigned)i, fault ? '*' : ' ', (unsigned)s.connections,
+               (unsigned)s.connects, (unsigned)s.publishes, (unsigned)s.discovery, s.bytesIn / 1000.0,
+               (unsigned)s.wills, (unsigned)s.takeovers, (unsigned)s.expired);
+    }
+}
+
+// How long after the fault ended each device was connected, and had its
+// discovery out, again
+void printRecovery(const char* event, unsigned long at, const std::vector<VirtualDevice*>& devices, String& report) {
+    std::vector<uint32_t> connected, discovered;
+    int missing = 0;
+    for (VirtualDevice* d : devices) {
+        auto c = std::find_if(d->stats.connectedAt.begin(), d->stats.connectedAt.end(),
+                              [at](unsigned long t) { return t >= at; });
+        auto p = std::find_if(d->stats.discoveredAt.begin(), d->stats.discoveredAt.end(),
+                              [at](unsigned long t) { return t >= at; });
+        if (c == d->stats.connectedAt.end() || p == d->stats.discoveredAt.end()) {
+            missing++;
+            continue;
+        }
+        connected.push_back(*c - at);
+        discovered.push_back(*p - at);
+    }
+    printf("after the %s: connected again p50 %lu ms, all %lu ms; discovery out p50 %lu ms, all %lu ms",
+           event, (unsigned long)percentile(connected, 0.5), (unsigned long)percentile(connected, 1.0),
+           (unsigned long)percentile(discovered, 0.5), (unsigned long)percentile(discovered, 1.0));
+    if (missing) printf("; %d devices never came back", missing);
+    printf("\n");
+    char line[200];
+    snprintf(line, sizeof(line), ",\"%s\":{\"connected_p50_ms\":%lu,\"connected_all_ms\":%lu,"
+             "\"discovered_p50_ms\":%lu,\"discovered_all_ms\":%lu,\"missing\":%d}",
+             strcmp(event, "power cut") == 0 ? "power_cut" : "outage", (unsigned long)percentile(connected, 0.5),
+             (unsigned long)percentile(connected, 1.0), (unsigned long)percentile(discovered, 0.5),
+             (unsigned long)percentile(discovered, 1.0), missing);
+    report += line;
+}
@@ -0,0 +1,197 @@
+#include <Arduino.h>
+#include <mqtt_pipe.h>
+#include <socket_client.h>
+#include <host_broker.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+// Publishes through lib/MqttPipe as fast as each mode allows and reports
+// messages per second and the time to each PUBACK. The broker is a stand-in
+// forked from this program that holds every PUBACK for --ack-delay-us, which
+// models the WiFi round trip; --broker=host:port measures a real one
+// (Mosquitto) instead.
+
+struct Mode {
+    const char* name;
+    uint8_t qos;
+    uint8_t window;
+    bool batching;
+};
+
+struct Result {
+    double seconds;
+    uint32_t acked;
+    uint32_t writes;
+    uint32_t resent;
+    uint32_t reconnects;
+    std::vector<uint32_t> ackUs;
+};
+
+const Mode defaultModes[] = {
+    {"QoS 0, a write per message", 0, 1, false},
+    {"QoS 0, batched", 0, 1, true},
+    {"QoS 1, window 1", 1, 1, false},
+    {"QoS 1, window 4, batched", 1, 4, true},
+    {"QoS 1, window 8, batched", 1, 8, true},
+};
+
+HostBrokerOptions brokerOptions;
+
+// Function declarations
+uint64_t monotonicUs();
+Result runMode(const Mode& mode, const char* host, uint16_t port, uint32_t messages, size_t size);
+void onAck(uint16_t packetId, uint32_t latencyUs, void* user);
+uint32_t percentile(std::vector<uint32_t>& values, double p);
+
+void setup() {
+    signal(SIGPIPE, SIG_IGN);
+    uint32_t messages = atoi(hostArg("messages", "2000"));
+    size_t size = atoi(hostArg("size", "64"));
+    brokerOptions.ackDelayUs = atoi(hostArg("ack-delay-us", "2000"));
+    brokerOptions.dropEvery = atoi(hostArg("drop-every", "0"));
+
+    // --serve=1883: only the stand-in broker, for other clients or a board
+    if (const char* serve = hostArg("serve")) {
+        HostBroker broker(brokerOptions);
+        if (!broker.listen(atoi(serve))) {
+            fprintf(stderr, "cannot listen on port %s\n", serve);
+            hostExit(2);
+        }
+        fprintf(stderr, "stand-in broker on port %s, PUBACK after %u us\n", serve, (unsigned)brokerOptions.ackDelayUs);
+        broker.run();
+    }
+
+    std::string host = "127.0.0.1";
+    uint16_t port = 0;
+    pid_t broker = 0;
+    if (const char* external = hostArg("broker")) {
+        host = external;
+        size_t colon = host.rfind(':');
+        port = colon == std::string::npos ? 1883 : atoi(host.c_str() + colon + 1);
+        if (colon != std::string::npos) host.resize(colon);
+    } else {
+        // In a process of its own, so it does not share a core with the client
+        HostBroker standIn(brokerOptions);
+        if (!standIn.listen(0)) {
+            fprintf(stderr, "cannot start the stand-in broker\n");
+            hostExit(2);
+        }
+        port = standIn.port();
+        broker = fork();
+        if (broker == 0) {
+            standIn.run();
+            _exit(0);
+        }
+    }
+
+    std::vector<Mode> modes(std::begin(defaultModes), std::end(defaultModes));
+    if (hostArg("qos") || hostArg("window") || hostArg("batch")) {
+        uint8_t qos = atoi(hostArg("qos", "1"));
+        modes = {{"selected", qos, (uint8_t)atoi(hostArg("window", "8")), atoi(hostArg("batch", "1")) != 0}};
+    }
+
+    printf("--- mqtt_bench report ---\n");
+    if (broker) {
+        printf("stand-in broker on port %u, PUBACK after %u us", (unsigned)port, (unsigned)brokerOptions.ackDelayUs);
+        if (brokerOptions.dropEvery) {
+            printf(", drops the connection every %u publishes", (unsigned)brokerOptions.dropEvery);
+        }
+        printf("\n");
+    } else {
+        printf("broker %s:%u\n", host.c_str(), (unsigned)port);
+    }
+    printf("%u messages of %u bytes each\n\n", (unsigned)messages, (unsigned)size);
+    printf("%-28s %9s %7s %7s %7s %9s %9s %9s\n", "mode", "msg/s", "writes", "resent", "reconn", "ack p50", "p99", "max us");
+
+    int status = 0;
+    for (const Mode& mode : modes) {
+        Result r = runMode(mode, host.c_str(), port, messages, size);
+        printf("%-28s %9.0f %7lu %7lu %7lu", mode.name, messages / r.seconds, (unsigned long)r.writes,
+               (unsigned long)r.resent, (unsigned long)r.reconnects);
+        if (mode.qos) {
+            printf(" %9lu %9lu %9lu", (unsigned long)percentile(r.ackUs, 0.5), (unsigned long)percentile(r.ackUs, 0.99),
+                   (unsigned long)percentile(r.ackUs, 1.0));
+            if (r.acked != messages) {
+                printf("  %lu never acknowledged", (unsigned long)(messages - r.acked));
+                status = 1;
+            }
+        }
+        printf("\n");
+        fflush(stdout);
+    }
+    printf("--- end report ---\n");
+
+    if (broker) {
+        kill(broker, SIGTERM);
+        waitpid(broker, nullptr, 0);
+    }
+    hostExit(status);
+}
+
+void loop() {
+}
+
+uint64_t monotonicUs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+// Publishes `messages` messages in one mode: as many as the window takes, then
+// loop() until a PUBACK frees a slot. QoS 0 counts until the last write.
+Result runMode(const Mode& mode, const char* host, uint16_t port, uint32_t messages, size_t size) {
+    Result r = {};
+    SocketClient socket;
+    MqttPipe mqtt(socket);
+    mqtt.setServer(host, port);
+    mqtt.setWindow(mode.window);
+    mqtt.setBatching(mode.batching);
+    mqtt.setAckCallback(onAck, &r);
+
+    auto connect = [&]() {
+        while (!mqtt.connect("mqtt_bench", nullptr, nullptr, nullptr, 0, false, nullptr, false)) {
+            delay(10);
+        }
+    };
+    connect();
+
+    std::vector<uint8_t> payload(size, 'x');
+    uint64_t start = monotonicUs();
+    for (uint32_t i = 0; i < messages; i++) {
+        while (!mqtt.publish("bench/mqtt_pipe", payload.data(), payload.size(), false, mode.qos)) {
+            if (!mqtt.loop()) {
+                r.reconnects++;
+                connect();
+            }
+        }
+    }
+    while (!mqtt.flush() || mqtt.inflight() > 0) {
+        if (!mqtt.loop()) {
+            r.reconnects++;
+            connect();
+        }
+    }
+    r.seconds = (monotonicUs() - start) / 1e6;
+    r.acked = mqtt.stats().acked;
+    r.writes = mqtt.stats().writes;
+    r.resent = mqtt.stats().resent;
+    mqtt.disconnect();
+    return r;
+}
+
+void onAck(uint16_t packetId, uint32_t latencyUs, void* user) {
+    (void)packetId;
+    ((Result*)user)->ackUs.push_back(latencyUs);
+}
+
+uint32_t percentile(std::vector<uint32_t>& values, double p) {
+    if (values.empty()) return 0;
+    std::sort(values.begin(), values.end());
+    size_t index = (size_t)(p * (values.size() - 1) + 0.5);
+    return values[index];
+}
@@ -0,0 +1,412 @@
+#include <Arduino.h>
+#include <delta_ota.h>
+#include <socket_client.h>
+#include <signal.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+// Makes delta OTA patches (lib/DeltaOta) from firmware images, and plays the
+// device against an HTTP server: fetches the manifest, picks a patch for its
+// "running" image, applies it with the firmware's code and reports what it
+// cost.
+
+const uint8_t WINDOW_BITS = 12;         // 4 KB LZSS window on the device
+const uint8_t LOOKAHEAD_BITS = 6;       // matches of 3..66 bytes
+const uint8_t MIN_MATCH = 3;
+const int CHAIN_DEPTH = 256;            // hash chain entries tried per match
+
+typedef std::vector<uint8_t> Bytes;
+
+// Function declarations
+int makePatches();
+int playDevice();
+bool readFile(const std::string& path, Bytes& out);
+bool writeFile(const std::string& path, const Bytes& data);
+std::string shaHex(const Bytes& data);
+Bytes diff(const Bytes& oldImage, const Bytes& newImage);
+Bytes compress(const Bytes& data);
+Bytes patchFile(const Bytes& oldImage, const Bytes& newImage);
+int checkUrls();
+
+void setup() {
+    signal(SIGPIPE, SIG_IGN);
+    if (hostArg("make")) hostExit(makePatches());
+    if (hostArg("device")) hostExit(playDevice());
+    if (hostArg("check")) hostExit(checkUrls());
+    fprintf(stderr,
+            "usage: program --make=1 --old=a.bin[,b.bin...] --new=new.bin --out=dir [--version=1.4.0]\n"
+            "       program --device=running.bin --manifest=http://127.0.0.1:8000/manifest.txt --out=update.bin\n"
+            "       program --check=1\n");
+    hostExit(2);
+}
+
+void loop() {}
+
+// ---- Making patches ----
+
+bool readFile(const std::string& path, Bytes& out) {
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f) return false;
+    uint8_t buffer[65536];
+    size_t n;
+    out.clear();
+    while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0) out.insert(out.end(), buffer, buffer + n);
+    fclose(f);
+    return true;
+}
+
+bool writeFile(const std::string& path, const Bytes& data) {
+    FILE* f = fopen(path.c_str(), "wb");
+    if (!f) return false;
+    bool ok = fwrite(data.data(), 1, data.size(), f) == data.size();
+    return fclose(f) == 0 && ok;
+}
+
+static void sha256(const Bytes& data, uint8_t out[32]) {
+    DeltaSha256 sha;
+    sha.begin();
+    sha.update(data.data(), data.size());
+    sha.finish(out);
+}
+
+std::string shaHex(const Bytes& data) {
+    uint8_t sha[32];
+    sha256(data, sha);
+    char hex[65];
+    for (int i = 0; i < 32; i++) snprintf(hex + 2 * i, 3, "%02x", sha[i]);
+    return hex;
+}
+
+// Suffix array of `data` by prefix doubling; entry 0 is the empty suffix,
+// as bsdiff's search expects
+static std::vector<int32_t> suffixArray(const Bytes& data) {
+    int32_t n = data.size();
+    std::vector<int32_t> sa(n + 1), rank(n + 1), next(n + 1);
+    for (int32_t i = 0; i <= n; i++) {
+        sa[i] = i;
+        rank[i] = i < n ? data[i] + 1 : 0;
+    }
+    for (int32_t k = 1;; k <<= 1) {
+        auto key = [&](int32_t i) { return std::make_pair(rank[i], i + k <= n ? rank[i + k] : -1); };
+        std::sort(sa.begin(), sa.end(), [&](int32_t a, int32_t b) { return key(a) < key(b); });
+        next[sa[0]] = 0;
+        for (int32_t i = 1; i <= n; i++) next[sa[i]] = next[sa[i - 1]] + (key(sa[i - 1]) < key(sa[i]));
+        rank.swap(next);
+        if (rank[sa[n]] == n) break;
+    }
+    return sa;
+}
+
+static int32_t matchLength(const uint8_t* a, int32_t aLength, const uint8_t* b, int32_t bLength) {
+    int32_t i = 0;
+    while (i < aLength && i < bLength && a[i] == b[i]) i++;
+    return i;
+}
+
+static int32_t search(const std::vector<int32_t>& sa, const Bytes& oldImage, const uint8_t* target,
+                      int32_t targetLength, int32_t start, int32_t end, int32_t& pos) {
+    int32_t oldSize = oldImage.size();
+    while (end - start >= 2) {
+        int32_t middle = start + (end - start) / 2;
+        int32_t length = std::min(oldSize - sa[middle], targetLength);
+        if (memcmp(oldImage.data() + sa[middle], target, length) < 0) start = middle;
+        else end = middle;
+    }
+    int32_t x = matchLength(oldImage.data() + sa[start], oldSize - sa[start], target, targetLength);
+    int32_t y = matchLength(oldImage.data() + sa[end], oldSize - sa[end], target, targetLength);
+    pos = x > y ? sa[start] : sa[end];
+    return std::max(x, y);
+}
+
+static void putLe32(Bytes& out, uint32_t value) {
+    for (int i = 0; i < 4; i++) out.push_back(value >> (8 * i));
+}
+
+// bsdiff (Colin Percival's algorithm): approximate matches found through the
+// suffix array of the old image, each written as add (new minus old bytes,
+// mostly zeros where only addresses moved), copy (new bytes) and seek.
+// Operations and their bytes are interleaved, so the device needs no
+// separate streams.
+Bytes diff(const Bytes& oldImage, const Bytes& newImage) {
+    Bytes out;
+    int32_t oldSize = oldImage.size(), newSize = newImage.size();
+    const uint8_t* o = oldImage.data();
+    const uint8_t* n = newImage.data();
+    if (oldSize == 0) {
+        putLe32(out, 0);
+        putLe32(out, newSize);
+        putLe32(out, 0);
+        out.insert(out.end(), newImage.begin(), newImage.end());
+        return out;
+    }
+    std::vector<int32_t> sa = suffixArray(oldImage);
+
+    int32_t scan = 0, length = 0, pos = 0;
+    int32_t lastScan = 0, lastPos = 0, lastOffset = 0;
+    while (scan < newSize) {
+        int32_t oldScore = 0;
+        int32_t scsc = scan += length;
+        for (; scan < newSize; scan++) {
+            length = search(sa, oldImage, n + scan, newSize - scan, 0, oldSize, pos);
+            for (; scsc < scan + length; scsc++) {
+                if (scsc + lastOffset < oldSize && o[scsc + lastOffset] == n[scsc]) oldScore++;
+            }
+            if ((length == oldScore && length != 0) || length > oldScore + 8) break;
+            if (scan + lastOffset < oldSize && o[scan + lastOffset] == n[scan]) oldScore--;
+        }
+        if (length == oldScore && scan != newSize) continue;
+
+        // Extend the last match forwards and this one backwards, then split
+        // where they overlap
+        int32_t s = 0, best = 0, forward = 0;
+        for (int32_t i = 0; lastScan + i < scan && lastPos + i < oldSize;) {
+            if (o[lastPos + i] == n[lastScan + i]) s++;
+            i++;
+            if (s * 2 - i > best * 2 - forward) {
+                best = s;
+                forward = i;
+            }
+        }
+        int32_t backward = 0;
+        if (scan < newSize) {
+            s = 0;
+            best = 0;
+            for (int32_t i = 1; scan >= lastScan + i && pos >= i; i++) {
+                if (o[pos - i] == n[scan - i]) s++;
+                if (s * 2 - i > best * 2 - backward) {
+                    best = s;
+                    backward = i;
+                }
+            }
+        }
+        if (lastScan + forward > scan - backward) {
+            int32_t overlap = lastScan + forward - (scan - backward);
+            s = 0;
+            best = 0;
+            int32_t split = 0;
+            for (int32_t i = 0; i < overlap; i++) {
+                if (n[lastScan + forward - overlap + i] == o[lastPos + forward - overlap + i]) s++;
+                if (n[scan - backward + i] == o[pos - backward + i]) s--;
+                if (s > best) {
+                    best = s;
+                    split = i + 1;
+                }
+            }
+            forward += split - overlap;
+            backward -= split;
+        }
+
+        int32_t copy = scan - backward - (lastScan + forward);
+        putLe32(out, forward);
+        putLe32(out, copy);
+        putLe32(out, (uint32_t)((pos - backward) - (lastPos + forward)));
+        for (int32_t i = 0; i < forward; i++) out.push_back(n[lastScan + i] - o[lastPos + i]);
+        out.insert(out.end(), n + lastScan + forward, n + lastScan + forward + copy);
+
+        lastScan = scan - backward;
+        lastPos = pos - backward;
+        lastOffset = pos - scan;
+    }
+    return out;
+}
+
+// LZSS in the format DeltaPatch decodes, MSB first: 1 and a literal byte, or
+// 0, distance - 1 and length - MIN_MATCH. Greedy, with hash chains over the
+// window.
+Bytes compress(const Bytes& data) {
+    const int32_t window = 1 << WINDOW_BITS;
+    const int32_t maxMatch = MIN_MATCH + (1 << LOOKAHEAD_BITS) - 1;
+    const int32_t size = data.size();
+    std::vector<int32_t> head(1 << 16, -1), chain(size, -1);
+    auto hash = [&](int32_t i) { return ((data[i] << 8) ^ (data[i + 1] << 4) ^ data[i + 2]) & 0xFFFF; };
+    auto insert = [&](int32_t i) {
+        if (i + MIN_MATCH > size) return;
+        int32_t h = hash(i);
+        chain[i] = head[h];
+        head[h] = i;
+    };
+
+    Bytes out;
+    uint32_t bits = 0;
+    int bitCount = 0;
+    auto put = [&](uint32_t value, int count) {
+        for (int b = count - 1; b >= 0; b--) {
+            bits = (bits << 1) | ((value >> b) & 1);
+            if (++bitCount == 8) {
+                out.push_back(bits);
+                bits = 0;
+                bitCount = 0;
+            }
+        }
+    };
+
+    for (int32_t i = 0; i < size;) {
+        int32_t bestLength = 0, bestDistance = 0;
+        if (i + MIN_MATCH <= size) {
+            int depth = CHAIN_DEPTH;
+            for (int32_t j = head[hash(i)]; j >= 0 && i - j <= window && depth--; j = chain[j]) {
+                int32_t length = matchLength(data.data() + j, size - j, data.data() + i, std::min(maxMatch, size - i));
+                if (length > bestLength) {
+                    bestLength = length;
+                    bestDistance = i - j;
+                    if (length == maxMatch) break;
+                }
+            }
+        }
+        if (bestLength >= MIN_MATCH) {
+            put(0, 1);
+            put(bestDistance - 1, WINDOW_BITS);
+            put(bestLength - MIN_MATCH, LOOKAHEAD_BITS);
+            for (int32_t k = 0; k < bestLength; k++) insert(i + k);
+            i += bestLength;
+        } else {
+            put(1, 1);
+            put(data[i], 8);
+            insert(i);
+            i++;
+        }
+    }
+    if (bitCount) out.push_back(bits << (8 - bitCount));
+    return out;
+}
+
+Bytes patchFile(const Bytes& oldImage, const Bytes& newImage) {
+    Bytes out = {'M', '5', 'D', 'P', DELTA_OTA_FORMAT, WINDOW_BITS, LOOKAHEAD_BITS, 0};
+    putLe32(out, oldImage.size());
+    putLe32(out, newImage.size());
+    uint8_t sha[32];
+    if (oldImage.empty()) memset(sha, 0, sizeof(sha));
+    else sha256(oldImage, sha);
+    out.insert(out.end(), sha, sha + 32);
+    sha256(newImage, sha);
+    out.insert(out.end(), sha, sha + 32);
+    Bytes body = compress(diff(oldImage, newImage));
+    out.insert(out.end(), body.begin(), body.end());
+    return out;
+}
+
+int makePatches() {
+    const char* newPath = hostArg("new");
+    const char* oldPaths = hostArg("old", "");
+    std::string outDir = hostArg("out", ".");
+    Bytes newImage;
+    if (!newPath || !readFile(newPath, newImage) || newImage.empty()) {
+        fprintf(stderr, "--new=image.bin is needed\n");
+        return 2;
+    }
+
+    std::string manifest = std::string("version ") + hostArg("version", "dev") + "\n";
+    manifest += "image " + std::to_string(newImage.size()) + " " + shaHex(newImage) + "\n";
+    std::string rest = oldPaths;
+    int patches = 0;
+    while (!rest.empty()) {
+        size_t comma = rest.find(',');
+        std::string path = rest.substr(0, comma);
+        rest = comma == std::string::npos ? "" : rest.substr(comma + 1);
+        Bytes oldImage;
+        if (!readFile(path, oldImage) || oldImage.empty()) {
+            fprintf(stderr, "cannot read %s\n", path.c_str());
+            return 1;
+        }
+        if (++patches >= DELTA_OTA_MAX_PATCHES) {
+            fprintf(stderr, "at most %u old images\n", DELTA_OTA_MAX_PATCHES - 1);
+            return 2;
+        }
+        uint32_t start = millis();
+        std::string sha = shaHex(oldImage);
+        Bytes patch = patchFile(oldImage, newImage);
+        std::string file = "from-" + sha.substr(0, 12) + ".patch";
+        if (!writeFile(outDir + "/" + file, patch)) {
+            fprintf(stderr, "cannot write %s/%s\n", outDir.c_str(), file.c_str());
+            return 1;
+        }
+        manifest += "patch " + std::to_string(oldImage.size()) + " " + sha + " " + std::to_string(patch.size()) +
+                    " " + file + "\n";
+        printf("%s: %zu -> %zu bytes, patch %zu bytes (%.1f%% of the image), %lu ms\n", path.c_str(),
+               oldImage.size(), newImage.size(), patch.size(), 100.0 * patch.size() / newImage.size(),
+               (unsigned long)(millis() - start));
+    }
+
+    // For any other running image: the whole image, LZSS-compressed
+    Bytes full = patchFile(Bytes(), newImage);
+    if (!writeFile(outDir + "/full.patch", full)) {
+        fprintf(stderr, "cannot write %s/full.patch\n", outDir.c_str());
+        return 1;
+    }
+    manifest += "patch 0 - " + std::to_string(full.size()) + " full.patch\n";
+    printf("full image: %zu bytes, compressed %zu bytes (%.1f%%)\n", newImage.size(), full.size(),
+           100.0 * full.size() / newImage.size());
+    if (!writeFile(outDir + "/manifest.txt", Bytes(manifest.begin(), manifest.end()))) return 1;
+    printf("wrote %s/manifest.txt\n", outDir.c_str());
+    return 0;
+}
+
+// ---- Playing the device ----
+
+int playDevice() {
+    const char* running = hostArg("device");
+    const char* manifest = hostArg("manifest");
+    const char* out = hostArg("out", "update.bin");
+    if (!manifest) {
+        fprintf(stderr, "--manifest=http://host:port/path/manifest.txt is needed\n");
+        return 2;
+    }
+    deltaOtaHostFiles(running, out);
+    SocketClient client;
+    DeltaOta ota(client);
+    ota.check(manifest);
+
+    uint32_t start = millis();
+    DeltaOtaState state = ota.state();
+    uint8_t shown = 0;
+    while (ota.active()) {
+        state = ota.poll(30);
+        if (state == DELTA_OTA_DOWNLOADING && ota.progress() >= shown + 10) {
+            shown = ota.progress() / 10 * 10;
+            printf("  %3u%%\n", shown);
+        }
+        if (ota.active()) delay(1);
+    }
+    state = ota.state();
+    const DeltaOtaStats& stats = ota.stats();
+    switch (state) {
+        case DELTA_OTA_UP_TO_DATE:
+            printf("up to date with %s (checked in %lu ms)\n", ota.version(), (unsigned long)stats.checkMs);
+            return 0;
+        case DELTA_OTA_READY:
+            printf("ready: %s written to %s\n", ota.version(), out);
+            printf("  %s, %lu bytes downloaded for a %lu byte image (%.1f%%)\n",
+                   stats.oldSize ? "patch" : "whole image", (unsigned long)stats.patchBytes,
+                   (unsigned long)stats.imageBytes, 100.0 * stats.patchBytes / stats.imageBytes);
+            printf("  check %lu ms, download and patch %lu ms, total %lu ms; %lu bytes of buffers\n",
+                   (unsigned long)stats.checkMs, (unsigned long)stats.patchMs, (unsigned long)(millis() - start),
+                   (unsigned long)stats.peakRam);
+            return 0;
+        default:
+            printf("failed: %s\n", ota.error());
+            return 1;
+    }
+}
+
+// ---- Checks ----
+
+// Where a device looks for a patch, for the manifest URLs an ota_url can hold
+int checkUrls() {
+    static const char* const cases[][2] = {
+        {"http://192.168.2.10:8000/coreink/manifest.txt", "http://192.168.2.10:8000/coreink/from-ab12.patch"},
+        {"http://192.168.2.10:8000/manifest.txt", "http://192.168.2.10:8000/from-ab12.patch"},
+        {"http://192.168.2.10:8000/", "http://192.168.2.10:8000/from-ab12.patch"},
+        {"http://192.168.2.10:8000", "http://192.168.2.10:8000/from-ab12.patch"},
+        {"http://ota.lan", "http://ota.lan/from-ab12.patch"},
+    };
+    int failures = 0;
+    for (const auto& c : cases) {
+        char url[256];
+        deltaOtaFileUrl(url, sizeof(url), c[0], "from-ab12.patch");
+        bool ok = strcmp(url, c[1]) == 0;
+        printf("%-4s %-48s -> %s\n", ok ? "ok" : "FAIL", c[0], url);
+        if (!ok) failures++;
+    }
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,255 @@
+#include <Arduino.h>
+#include <telemetry_reader.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <string>
+
+// Reads a lib/Telemetry stream and writes one CSV file per channel. On a
+// serial port it also keeps the requested channels switched on (the board
+// stops sending a few seconds after the last request).
+
+const char* channelNames[TELEM_CHANNEL_COUNT] = {"control", "sensor", "imu", "audio", "profiler"};
+const char* csvHeaders[TELEM_CHANNEL_COUNT] = {
+    nullptr,
+    "time_us,seq,co2,temperature,humidity",
+    "time_us,seq,ax,ay,az,gx,gy,gz",
+    "time_us,seq,sample",
+    "time_us,seq,section,duration_us",
+};
+
+std::string outDir = ".";
+FILE* csv[TELEM_CHANNEL_COUNT] = {};
+FILE* rawCapture = nullptr;
+
+// The board's micros() wraps every 71 minutes
+uint64_t clockHigh = 0;
+uint32_t lastMicros = 0;
+
+TelemetryStatus boardStatus;
+bool boardStatusSeen = false;
+
+// Function declarations
+int openInput(const char* path, bool& isTty);
+uint8_t parseChannels(const char* list);
+uint64_t monotonicUs();
+uint64_t unwrap(uint32_t us);
+FILE* csvFor(uint8_t channel);
+void onFrame(const TelemetryFrame& frame, void* user);
+void onText(const uint8_t* text, size_t length, void* user);
+void printProgress(const TelemetryReader& reader, double seconds, uint64_t bytes);
+
+void setup() {
+    const char* in = hostArg("in");
+    if (!in) {
+        fprintf(stderr, "usage: program --in=/dev/ttyACM0|capture.bin [--channels=sensor,imu,audio,profiler] "
+                        "[--out=dir] [--seconds=N] [--raw=capture.bin]\n");
+        hostExit(2);
+    }
+    bool isTty = false;
+    int fd = openInput(in, isTty);
+    if (fd < 0) {
+        fprintf(stderr, "cannot open %s\n", in);
+        hostExit(2);
+    }
+    uint8_t mask = parseChannels(hostArg("channels", "sensor,imu,audio,profiler"));
+    outDir = hostArg("out", ".");
+    mkdir(outDir.c_str(), 0755);
+    double seconds = atof(hostArg("seconds", "0"));
+    const char* raw = hostArg("raw");
+    if (raw) rawCapture = fopen(raw, "wb");
+
+    TelemetryReader reader(onFrame, onText, nullptr);
+    static uint8_t buffer[1 << 16];
+    uint64_t startUs = monotonicUs();
+    uint64_t lastCommandUs = 0;
+    uint64_t lastProgressUs = startUs;
+    uint64_t bytesAtProgress = 0;
+
+    for (;;) {
+        uint64_t now = monotonicUs();
+        if (seconds > 0 && now - startUs >= seconds * 1e6) break;
+
+        if (isTty && (lastCommandUs == 0 || now - lastCommandUs >= 1000000)) {
+            uint8_t command[32];
+            size_t n = telemetryEnableCommand(command, mask);
+            if (write(fd, command, n) != (ssize_t)n) fprintf(stderr, "could not send the channel request\n");
+            lastCommandUs = now;
+        }
+        if (isTty && now - lastProgressUs >= 1000000) {
+            printProgress(reader, (now - lastProgressUs) / 1e6, reader.bytes - bytesAtProgress);
+            lastProgressUs = now;
+            bytesAtProgress = reader.bytes;
+        }
+
+        struct pollfd p = {fd, POLLIN, 0};
+        if (isTty && poll(&p, 1, 100) <= 0) continue;
+        ssize_t n = read(fd, buffer, sizeof(buffer));
+        if (n <= 0) break;
+        if (rawCapture) fwrite(buffer, 1, n, rawCapture);
+        reader.feed(buffer, n);
+    }
+
+    if (isTty) {
+        uint8_t command[32];
+        size_t n = telemetryEnableCommand(command, 0);
+        if (write(fd, command, n) != (ssize_t)n) fprintf(stderr, "could not switch the channels off\n");
+    }
+    double elapsed = (monotonicUs() - startUs) / 1e6;
+    printProgress(reader, elapsed, reader.bytes);
+    for (FILE* f : csv) {
+        if (f) fclose(f);
+    }
+    if (rawCapture) fclose(rawCapture);
+    hostExit(0);
+}
+
+void loop() {
+}
+
+// A serial port is switched to raw mode (USB CDC ignores the baud rate); a
+// file is read as it is
+int openInput(const char* path, bool& isTty) {
+    int fd = open(path, O_RDWR | O_NOCTTY);
+    if (fd < 0) fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+    isTty = isatty(fd);
+    if (isTty) {
+        struct termios tty;
+        if (tcgetattr(fd, &tty) == 0) {
+            cfmakeraw(&tty);
+            cfsetispeed(&tty, B115200);
+            cfsetospeed(&tty, B115200);
+            tty.c_cc[VMIN] = 0;
+            tty.c_cc[VTIME] = 0;
+            tcsetattr(fd, TCSANOW, &tty);
+        }
+        tcflush(fd, TCIFLUSH);
+    }
+    return fd;
+}
+
+uint8_t parseChannels(const char* list) {
+    uint8_t mask = 0;
+    std::string s = list;
+    size_t start = 0;
+    while (start <= s.size()) {
+        size_t end = s.find(',', start);
+        if (end == std::string::npos) end = s.size();
+        std::string name = s.substr(start, end - start);
+        bool known = false;
+        for (int c = 1; c < TELEM_CHANNEL_COUNT; c++) {
+            if (name == channelNames[c]) {
+                mask |= 1 << c;
+                known = true;
+            }
+        }
+        if (!known && !name.empty()) fprintf(stderr, "unknown channel %s\n", name.c_str());
+        start = end + 1;
+    }
+    return mask;
+}
+
+uint64_t monotonicUs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Frames from different tasks may arrive a little out of order, so only a
+// large step backwards counts as a wrap
+uint64_t unwrap(uint32_t us) {
+    if (us < lastMicros && lastMicros - us > 0x80000000u) clockHigh += 1ull << 32;
+    lastMicros = us;
+    return clockHigh | us;
+}
+
+FILE* csvFor(uint8_t channel) {
+    if (!csv[channel]) {
+        std::string path = outDir + "/" + channelNames[channel] + ".csv";
+        csv[channel] = fopen(path.c_str(), "w");
+        if (!csv[channel]) {
+            fprintf(stderr, "cannot write %s\n", path.c_str());
+            hostExit(1);
+        }
+        fprintf(csv[channel], "%s\n", csvHeaders[channel]);
+    }
+    return csv[channel];
+}
+
+void onFrame(const TelemetryFrame& frame, void*) {
+    uint64_t us = unwrap(frame.micros);
+    unsigned long long t = us;
+
+    switch (frame.channel) {
+        case TELEM_CONTROL: {
+            if (frame.length < sizeof(TelemetryStatus)) return;
+            memcpy(&boardStatus, frame.payload, sizeof(boardStatus));
+            boardStatusSeen = true;
+            return;
+        }
+        case TELEM_SENSOR: {
+            if (frame.length < sizeof(TelemetrySensor)) return;
+            TelemetrySensor s;
+            memcpy(&s, frame.payload, sizeof(s));
+            fprintf(csvFor(frame.channel), "%llu,%u,%.1f,%.2f,%.2f\n", t, frame.seq, s.co2, s.temperature,
+                    s.humidity);
+            return;
+        }
+        case TELEM_IMU: {
+            if (frame.length < sizeof(TelemetryImu)) return;
+            TelemetryImu s;
+            memcpy(&s, frame.payload, sizeof(s));
+            fprintf(csvFor(frame.channel), "%llu,%u,%.4f,%.4f,%.4f,%.3f,%.3f,%.3f\n", t, frame.seq, s.ax, s.ay,
+                    s.az, s.gx, s.gy, s.gz);
+            return;
+        }
+        case TELEM_AUDIO: {
+            if (frame.length < sizeof(TelemetryAudioHeader)) return;
+            TelemetryAudioHeader header;
+            memcpy(&header, frame.payload, sizeof(header));
+            size_t count = (frame.length - sizeof(header)) / 2;
+            FILE* f = csvFor(frame.channel);
+            // The frame is stamped when the block was complete; spread the
+            // samples out backwards from there
+            for (size_t i = 0; i < count; i++) {
+                int16_t sample;
+                memcpy(&sample, frame.payload + sizeof(header) + i * 2, 2);
+                uint64_t back = header.sampleRate ? (uint64_t)(count - 1 - i) * 1000000 / header.sampleRate : 0;
+                fprintf(f, "%llu,%u,%d\n", (unsigned long long)(us > back ? us - back : 0), frame.seq, sample);
+            }
+            return;
+        }
+        case TELEM_PROFILER: {
+            if (frame.length < sizeof(TelemetryProfile)) return;
+            TelemetryProfile p;
+            memcpy(&p, frame.payload, sizeof(p));
+            int nameLength = frame.length - sizeof(p);
+            fprintf(csvFor(frame.channel), "%llu,%u,%.*s,%u\n", t, frame.seq, nameLength,
+                    (const char*)frame.payload + sizeof(p), (unsigned)p.durationUs);
+            return;
+        }
+    }
+}
+
+void onText(const uint8_t* text, size_t length, void*) {
+    fwrite(text, 1, length, stdout);
+    fflush(stdout);
+}
+
+void printProgress(const TelemetryReader& reader, double seconds, uint64_t bytes) {
+    double mbit = seconds > 0 ? bytes * 8 / seconds / 1e6 : 0;
+    fprintf(stderr, "telemetry_csv: %.2f Mbit/s, frames", mbit);
+    for (int c = 0; c < TELEM_CHANNEL_COUNT; c++) fprintf(stderr, " %s %u", channelNames[c], (unsigned)reader.frames[c]);
+    fprintf(stderr, ", lost");
+    for (int c = 1; c < TELEM_CHANNEL_COUNT; c++) fprintf(stderr, " %u", (unsigned)reader.lost[c]);
+    fprintf(stderr, ", %u corrupt", (unsigned)reader.corrupt);
+    if (boardStatusSeen) {
+        fprintf(stderr, "; board queue %u/%u, dropped", boardStatus.blocksQueued, boardStatus.blocksTotal);
+        for (int c = 1; c < TELEM_CHANNEL_COUNT; c++) fprintf(stderr, " %u", (unsigned)boardStatus.dropped[c]);
+    }
+    fprintf(stderr, "\n");
+}
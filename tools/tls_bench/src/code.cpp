@@ -0,0 +1,513 @@
+#include <Arduino.h>
+#include <host_broker.h>
+#include <mqtt_pipe.h>
+#include <socket_client.h>
+#include <tls_client.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <openssl/err.h>
+#include <openssl/pem.h>
+#include <openssl/rand.h>
+#include <openssl/ssl.h>
+#include <openssl/x509v3.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Connects to the broker over lib/TlsClient again and again, each time as
+// connectMQTT() does (TCP, TLS, MQTT CONNECT until the CONNACK), with the
+// session forgotten before each connect (a full handshake) and kept (a
+// resumed one), and reports the connect times, the client's CPU time and the
+// handshake bytes. The broker is a TLS stand-in forked from this program, in
+// front of lib/M5HostNet's stand-in MQTT broker, that holds each of its
+// flights for --rtt-ms, which models the WiFi round trip; --broker=host:port
+// with --ca measures a real one (Mosquitto) instead. --make-certs writes an
+// ECDSA CA and broker certificate for Mosquitto and the firmwares.
+
+struct Mode {
+    const char* name;
+    bool rsa;               // the stand-in's certificates
+    bool resume;
+};
+
+struct Result {
+    uint32_t connects;
+    uint32_t resumed;
+    uint32_t failures;
+    uint64_t bytes;
+    uint32_t sessionBytes;  // kept for the next connect; 0: none, or too large
+    std::vector<uint32_t> connectUs;
+    std::vector<uint32_t> cpuUs;
+    std::string error;
+};
+
+struct Certificates {
+    std::string caPem;
+    std::string caKeyPem;
+    std::string brokerPem;
+    std::string brokerKeyPem;
+};
+
+const Mode defaultModes[] = {
+    {"ECDSA P-256, full", false, false},
+    {"ECDSA P-256, resumed", false, true},
+    {"RSA-2048, full", true, false},
+    {"RSA-2048, resumed", true, true},
+};
+
+uint32_t rttMs = 5;
+bool tickets = true;
+
+// Function declarations
+uint64_t monotonicUs();
+uint64_t cpuUs();
+Certificates makeCertificates(const char* name, bool rsa);
+X509* makeCertificate(EVP_PKEY* key, const char* commonName, X509* issuer, EVP_PKEY* issuerKey, const char* altName);
+void addExtension(X509* crt, X509* issuer, int nid, const char* value);
+std::string pemOf(X509* crt);
+std::string pemOf(EVP_PKEY* key);
+bool writeFile(const std::string& path, const std::string& text);
+bool readFile(const std::string& path, std::string& text);
+SSL_CTX* serverContext(const Certificates& certificates);
+int listenOn(uint16_t port, uint16_t& bound);
+void serveStandIn(SSL_CTX* ctx, int listener, uint16_t brokerPort);
+void serveConnection(SSL_CTX* ctx, int fd, uint16_t brokerPort);
+bool sendAll(int fd, BIO* out, bool hold);
+pid_t startStandIn(const Certificates& certificates, uint16_t& port);
+Result runMode(const Mode& mode, const char* host, uint16_t port, const char* ca, const char* name, uint32_t connects);
+uint32_t percentile(std::vector<uint32_t>& values, double p);
+
+void setup() {
+    signal(SIGPIPE, SIG_IGN);
+    uint32_t connects = atoi(hostArg("connects", "50"));
+    rttMs = atoi(hostArg("rtt-ms", "5"));
+    tickets = atoi(hostArg("tickets", "1")) != 0;
+    const char* name = hostArg("name", "127.0.0.1");
+
+    // --make-certs=dir: a CA and a broker certificate, ECDSA P-256, for the
+    // address or name the devices connect to
+    if (const char* dir = hostArg("make-certs")) {
+        Certificates c = makeCertificates(name, atoi(hostArg("rsa", "0")) != 0);
+        std::string d = dir;
+        if (!writeFile(d + "/ca.pem", c.caPem) || !writeFile(d + "/ca.key", c.caKeyPem) ||
+            !writeFile(d + "/broker.pem", c.brokerPem) || !writeFile(d + "/broker.key", c.brokerKeyPem)) {
+            fprintf(stderr, "cannot write into %s\n", dir);
+            hostExit(2);
+        }
+        printf("%s/ca.pem        the CA: cafile for Mosquitto, mqtt_ca in the firmwares\n", dir);
+        printf("%s/broker.pem    certfile for Mosquitto, for %s\n", dir, name);
+        printf("%s/broker.key    keyfile for Mosquitto\n", dir);
+        printf("%s/ca.key        keep it off the broker; it signs the next broker certificate\n", dir);
+        hostExit(0);
+    }
+
+    // --serve=8883 --certs=dir: only the stand-in, for a board
+    if (const char* serve = hostArg("serve")) {
+        Certificates c;
+        std::string d = hostArg("certs", ".");
+        if (!readFile(d + "/broker.pem", c.brokerPem) || !readFile(d + "/broker.key", c.brokerKeyPem)) {
+            fprintf(stderr, "no broker.pem and broker.key in %s (make them with --make-certs)\n", d.c_str());
+            hostExit(2);
+        }
+        SSL_CTX* ctx = serverContext(c);
+        HostBroker broker;
+        uint16_t port = 0;
+        int listener = listenOn(atoi(serve), port);
+        if (!ctx || listener < 0 || !broker.listen(0)) {
+            fprintf(stderr, "cannot listen on port %s\n", serve);
+            hostExit(2);
+        }
+        fprintf(stderr, "stand-in TLS broker on port %s, flights held %u ms, session tickets %s\n", serve,
+                (unsigned)rttMs, tickets ? "on" : "off");
+        std::thread mqtt([&] { broker.run(); });
+        serveStandIn(ctx, listener, broker.port());
+    }
+
+    std::vector<Mode> modes(std::begin(defaultModes), std::end(defaultModes));
+    std::string host = "127.0.0.1";
+    uint16_t port = 0;
+    std::string ca;
+    if (const char* external = hostArg("broker")) {
+        host = external;
+        size_t colon = host.rfind(':');
+        port = colon == std::string::npos ? 8883 : atoi(host.c_str() + colon + 1);
+        if (colon != std::string::npos) host.resize(colon);
+        if (!readFile(hostArg("ca", "ca.pem"), ca)) {
+            fprintf(stderr, "--ca=ca.pem: the CA of the broker's certificate\n");
+            hostExit(2);
+        }
+        if (!hostArg("name")) name = host.c_str();
+        modes = {{"full", false, false}, {"resumed", false, true}};
+    }
+
+    printf("--- tls_bench report ---\n");
+    if (port) {
+        printf("broker %s:%u, certificate checked for %s\n", host.c_str(), (unsigned)port, name);
+    } else {
+        printf("stand-in TLS broker in front of the stand-in MQTT broker, each of its flights held %u ms, session tickets %s\n",
+               (unsigned)rttMs, tickets ? "on" : "off");
+    }
+    printf("%u connects per mode, each TCP, TLS 1.2, MQTT CONNECT to CONNACK\n\n", (unsigned)connects);
+    printf("%-22s %8s %9s %9s %10s %10s %10s\n", "mode", "resumed", "p50 ms", "p99 ms", "cpu us", "hs bytes", "session");
+
+    int status = 0;
+    for (const Mode& mode : modes) {
+        pid_t standIn = 0;
+        uint16_t modePort = port;
+        std::string modeCa = ca;
+        if (!port) {
+            Certificates c = makeCertificates(name, mode.rsa);
+            modeCa = c.caPem;
+            standIn = startStandIn(c, modePort);
+        }
+        Result r = runMode(mode, host.c_str(), modePort, modeCa.c_str(), name, connects);
+        if (standIn) {
+            kill(standIn, SIGTERM);
+            waitpid(standIn, nullptr, 0);
+        }
+        uint32_t done = r.connects - r.failures;
+        printf("%-22s %4lu/%-3lu %9.1f %9.1f %10lu %10lu %10lu", mode.name, (unsigned long)r.resumed, (unsigned long)done,
+               percentile(r.connectUs, 0.5) / 1000.0, percentile(r.connectUs, 0.99) / 1000.0,
+               (unsigned long)percentile(r.cpuUs, 0.5), (unsigned long)(done ? r.bytes / done : 0),
+               (unsigned long)r.sessionBytes);
+        if (r.failures) {
+            printf("  %lu failed: %s", (unsigned long)r.failures, r.error.c_str());
+            status = 1;
+        } else if (mode.resume && !r.sessionBytes) {
+            printf("  session over TLS_SESSION_BYTES (%u), not kept", (unsigned)TLS_SESSION_BYTES);
+        } else if (mode.resume && r.resumed != done && !port) {
+            printf("  not all resumed");
+            status = 1;
+        }
+        printf("\n");
+        fflush(stdout);
+    }
+    printf("\n");
+    printTlsStats(Serial);
+    printf("--- end report ---\n");
+    hostExit(status);
+}
+
+void loop() {
+}
+
+uint64_t monotonicUs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+uint64_t cpuUs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+// `connects` connects and disconnects; a resumed mode connects once first so
+// there is a session to resume
+Result runMode(const Mode& mode, const char* host, uint16_t port, const char* ca, const char* name, uint32_t connects) {
+    Result r = {};
+    SocketClient socket;
+    TlsClient tls(socket);
+    tls.setTls(true);
+    tls.setCaCert(ca);
+    tls.setServerName(name);
+    MqttPipe mqtt(tls);
+    mqtt.setServer(host, port);
+
+    tlsForgetSession();
+    if (mode.resume && mqtt.connect("tls_bench")) mqtt.disconnect();
+    for (uint32_t i = 0; i < connects; i++) {
+        if (!mode.resume) tlsForgetSession();
+        uint64_t start = monotonicUs();
+        uint64_t startCpu = cpuUs();
+        bool ok = mqtt.connect("tls_bench");
+        uint64_t cpu = cpuUs() - startCpu;
+        uint64_t elapsed = monotonicUs() - start;
+        r.connects++;
+        if (!ok) {
+            r.failures++;
+            r.error = tls.error()[0] ? tls.error() : "no CONNACK";
+            continue;
+        }
+        r.connectUs.push_back(elapsed);
+        r.cpuUs.push_back(cpu);
+        r.bytes += tls.lastHandshakeBytes();
+        if (tls.lastResumed()) r.resumed++;
+        r.sessionBytes = tlsSessionBytes();
+        mqtt.disconnect();
+    }
+    return r;
+}
+
+uint32_t percentile(std::vector<uint32_t>& values, double p) {
+    if (values.empty()) return 0;
+    std::sort(values.begin(), values.end());
+    size_t index = (size_t)(p * (values.size() - 1) + 0.5);
+    return values[index];
+}
+
+// A CA and a broker certificate it signed, for `name` (an address goes in as
+// an IP subjectAltName, a host name as a DNS one, and as the CN either way,
+// which is what mbedTLS 2.28 checks)
+Certificates makeCertificates(const char* name, bool rsa) {
+    EVP_PKEY* caKey = rsa ? EVP_RSA_gen(2048) : EVP_EC_gen("P-256");
+    EVP_PKEY* brokerKey = rsa ? EVP_RSA_gen(2048) : EVP_EC_gen("P-256");
+    X509* ca = makeCertificate(caKey, "m5env broker CA", nullptr, nullptr, nullptr);
+    X509* broker = makeCertificate(brokerKey, name, ca, caKey, name);
+    Certificates c = {pemOf(ca), pemOf(caKey), pemOf(broker), pemOf(brokerKey)};
+    X509_free(broker);
+    X509_free(ca);
+    EVP_PKEY_free(brokerKey);
+    EVP_PKEY_free(caKey);
+    return c;
+}
+
+// Self-signed (a CA) without an issuer, else a server certificate
+X509* makeCertificate(EVP_PKEY* key, const char* commonName, X509* issuer, EVP_PKEY* issuerKey, const char* altName) {
+    X509* crt = X509_new();
+    X509_set_version(crt, 2);
+    uint8_t serial[8];
+    RAND_bytes(serial, sizeof(serial));
+    serial[0] &= 0x7F;
+    BIGNUM* bn = BN_bin2bn(serial, sizeof(serial), nullptr);
+    BN_to_ASN1_INTEGER(bn, X509_get_serialNumber(crt));
+    BN_free(bn);
+    X509_gmtime_adj(X509_getm_notBefore(crt), -3600);
+    X509_gmtime_adj(X509_getm_notAfter(crt), issuer ? 825L * 86400 : 3650L * 86400);
+    X509_set_pubkey(crt, key);
+    X509_NAME* subject = X509_get_subject_name(crt);
+    X509_NAME_add_entry_by_txt(subject, "CN", MBSTRING_ASC, (const unsigned char*)commonName, -1, -1, 0);
+    X509_set_issuer_name(crt, issuer ? X509_get_subject_name(issuer) : subject);
+
+    if (!issuer) {
+        addExtension(crt, crt, NID_basic_constraints, "critical,CA:TRUE,pathlen:0");
+        addExtension(crt, crt, NID_key_usage, "critical,keyCertSign,cRLSign");
+        addExtension(crt, crt, NID_subject_key_identifier, "hash");
+    } else {
+        unsigned char address[16];
+        bool ip = inet_pton(AF_INET, altName, address) == 1 || inet_pton(AF_INET6, altName, address) == 1;
+        std::string san = std::string(ip ? "IP:" : "DNS:") + altName;
+        addExtension(crt, issuer, NID_basic_constraints, "critical,CA:FALSE");
+        addExtension(crt, issuer, NID_key_usage, EVP_PKEY_is_a(key, "RSA") ? "critical,digitalSignature,keyEncipherment"
+                                                                             : "critical,digitalSignature");
+        addExtension(crt, issuer, NID_ext_key_usage, "serverAuth");
+        addExtension(crt, issuer, NID_subject_alt_name, san.c_str());
+        addExtension(crt, issuer, NID_authority_key_identifier, "keyid");
+    }
+    X509_sign(crt, issuerKey ? issuerKey : key, EVP_sha256());
+    return crt;
+}
+
+void addExtension(X509* crt, X509* issuer, int nid, const char* value) {
+    X509V3_CTX ctx;
+    X509V3_set_ctx(&ctx, issuer, crt, nullptr, nullptr, 0);
+    X509_EXTENSION* ext = X509V3_EXT_conf_nid(nullptr, &ctx, nid, value);
+    if (ext) {
+        X509_add_ext(crt, ext, -1);
+        X509_EXTENSION_free(ext);
+    }
+}
+
+std::string pemOf(X509* crt) {
+    BIO* bio = BIO_new(BIO_s_mem());
+    PEM_write_bio_X509(bio, crt);
+    char* data;
+    long n = BIO_get_mem_data(bio, &data);
+    std::string text(data, n);
+    BIO_free(bio);
+    return text;
+}
+
+std::string pemOf(EVP_PKEY* key) {
+    BIO* bio = BIO_new(BIO_s_mem());
+    PEM_write_bio_PrivateKey(bio, key, nullptr, nullptr, 0, nullptr, nullptr);
+    char* data;
+    long n = BIO_get_mem_data(bio, &data);
+    std::string text(data, n);
+    BIO_free(bio);
+    return text;
+}
+
+bool writeFile(const std::string& path, const std::string& text) {
+    FILE* f = fopen(path.c_str(), "wb");
+    if (!f) return false;
+    bool ok = fwrite(text.data(), 1, text.size(), f) == text.size();
+    return fclose(f) == 0 && ok;
+}
+
+bool readFile(const std::string& path, std::string& text) {
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f) return false;
+    char buf[4096];
+    size_t n;
+    text.clear();
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) text.append(buf, n);
+    fclose(f);
+    return !text.empty();
+}
+
+// As Mosquitto sets OpenSSL up: a server session cache, and tickets unless
+// --tickets=0
+SSL_CTX* serverContext(const Certificates& certificates) {
+    SSL_CTX* ctx = SSL_CTX_new(TLS_server_method());
+    BIO* crtBio = BIO_new_mem_buf(certificates.brokerPem.data(), (int)certificates.brokerPem.size());
+    BIO* keyBio = BIO_new_mem_buf(certificates.brokerKeyPem.data(), (int)certificates.brokerKeyPem.size());
+    X509* crt = PEM_read_bio_X509(crtBio, nullptr, nullptr, nullptr);
+    EVP_PKEY* key = PEM_read_bio_PrivateKey(keyBio, nullptr, nullptr, nullptr);
+    bool ok = crt && key && SSL_CTX_use_certificate(ctx, crt) == 1 && SSL_CTX_use_PrivateKey(ctx, key) == 1;
+    X509_free(crt);
+    EVP_PKEY_free(key);
+    BIO_free(crtBio);
+    BIO_free(keyBio);
+    if (!ok) {
+        SSL_CTX_free(ctx);
+        return nullptr;
+    }
+    SSL_CTX_set_session_id_context(ctx, (const unsigned char*)"tls_bench", 9);
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+    if (!tickets) SSL_CTX_set_options(ctx, SSL_OP_NO_TICKET);
+    return ctx;
+}
+
+// 0 listens on a free port of the loopback interface, any other port on all
+// interfaces
+int listenOn(uint16_t port, uint16_t& bound) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(port ? INADDR_ANY : INADDR_LOOPBACK);
+    socklen_t length = sizeof(address);
+    if (bind(fd, (sockaddr*)&address, sizeof(address)) != 0 || listen(fd, 64) != 0 ||
+        getsockname(fd, (sockaddr*)&address, &length) != 0) {
+        close(fd);
+        return -1;
+    }
+    bound = ntohs(address.sin_port);
+    return fd;
+}
+
+// The stand-in TLS broker and the MQTT one behind it in a process of their
+// own, so they do not share a core with the client
+pid_t startStandIn(const Certificates& certificates, uint16_t& port) {
+    SSL_CTX* ctx = serverContext(certificates);
+    int listener = listenOn(0, port);
+    HostBroker broker;
+    if (!ctx || listener < 0 || !broker.listen(0)) {
+        fprintf(stderr, "cannot start the stand-in broker\n");
+        hostExit(2);
+    }
+    pid_t pid = fork();
+    if (pid == 0) {
+        std::thread mqtt([&] { broker.run(); });
+        serveStandIn(ctx, listener, broker.port());
+        _exit(0);
+    }
+    close(listener);
+    SSL_CTX_free(ctx);
+    return pid;
+}
+
+void serveStandIn(SSL_CTX* ctx, int listener, uint16_t brokerPort) {
+    for (;;) {
+        int fd = accept(listener, nullptr, nullptr);
+        if (fd < 0) continue;
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        std::thread(serveConnection, ctx, fd, brokerPort).detach();
+    }
+}
+
+// Sends what OpenSSL wrote, held for the round trip first when `hold`
+bool sendAll(int fd, BIO* out, bool hold) {
+    char buf[4096];
+    int n;
+    bool held = false;
+    while ((n = BIO_read(out, buf, sizeof(buf))) > 0) {
+        if (hold && !held && rttMs) {
+            usleep(rttMs * 1000);
+            held = true;
+        }
+        if (send(fd, buf, n, MSG_NOSIGNAL) != n) return false;
+    }
+    return true;
+}
+
+// One client: the handshake, then the records relayed to and from the MQTT
+// broker in the clear. Every flight to the client waits --rtt-ms.
+void serveConnection(SSL_CTX* ctx, int fd, uint16_t brokerPort) {
+    SSL* ssl = SSL_new(ctx);
+    BIO* in = BIO_new(BIO_s_mem());
+    BIO* out = BIO_new(BIO_s_mem());
+    SSL_set_bio(ssl, in, out);
+    SSL_set_accept_state(ssl);
+    char buf[4096];
+    int broker = -1;
+
+    for (;;) {
+        int r = SSL_do_handshake(ssl);
+        if (!sendAll(fd, out, true)) goto done;
+        if (r == 1) break;
+        if (SSL_get_error(ssl, r) != SSL_ERROR_WANT_READ) goto done;
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n <= 0) goto done;
+        BIO_write(in, buf, (int)n);
+    }
+
+    {
+        broker = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(brokerPort);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (connect(broker, (sockaddr*)&address, sizeof(address)) != 0) goto done;
+        int on = 1;
+        setsockopt(broker, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    }
+
+    for (;;) {
+        // Records already in (the client's first one can come with its Finished)
+        int n;
+        while ((n = SSL_read(ssl, buf, sizeof(buf))) > 0) {
+            if (send(broker, buf, n, MSG_NOSIGNAL) != n) goto done;
+        }
+        if (SSL_get_error(ssl, n) != SSL_ERROR_WANT_READ) goto done;
+
+        pollfd fds[2] = {{fd, POLLIN, 0}, {broker, POLLIN, 0}};
+        if (poll(fds, 2, -1) < 0) goto done;
+        if (fds[0].revents) {
+            ssize_t got = recv(fd, buf, sizeof(buf), 0);
+            if (got <= 0) goto done;
+            BIO_write(in, buf, (int)got);
+        }
+        if (fds[1].revents) {
+            ssize_t got = recv(broker, buf, sizeof(buf), 0);
+            if (got <= 0 || SSL_write(ssl, buf, (int)got) <= 0 || !sendAll(fd, out, true)) goto done;
+        }
+    }
+
+done:
+    // Mosquitto sends its close_notify however the connection ended, which
+    // keeps the session in the cache (OpenSSL drops the session of a
+    // connection freed without one)
+    if (SSL_is_init_finished(ssl)) {
+        SSL_shutdown(ssl);
+        sendAll(fd, out, false);
+    }
+    ERR_clear_error();
+    SSL_free(ssl);
+    if (broker >= 0) close(broker);
+    close(fd);
+}